@@ -0,0 +1,104 @@
+## @file
+# Convert a disk image to a compressed RAM disk image for RamDiskDxe.
+#
+# The disk image is split in chunks that are compressed one by one with the
+# UEFI compression algorithm, so that RamDiskDxe decompresses a chunk only
+# when the chunk is read. The image is a header, followed by a table with an
+# entry for each chunk, followed by the compressed chunks:
+#
+#   Header:  UINT64 Signature ('RDCOMPRS'), UINT32 Version (1),
+#            UINT32 ChunkSize, UINT64 DiskSize
+#   Entry:   UINT64 Offset, UINT32 Size (0 for a chunk of zeros),
+#            UINT32 Reserved
+#
+# TianoCompress from BaseTools must be in PATH.
+#
+# SPDX-License-Identifier: BSD-2-Clause-Patent
+#
+
+'''
+CompressRamDiskImage
+'''
+
+import os
+import sys
+import argparse
+import struct
+import subprocess
+import tempfile
+
+#
+# Globals for help information
+#
+__prog__        = 'CompressRamDiskImage'
+__description__ = 'Convert a disk image to a compressed RAM disk image for RamDiskDxe.\n'
+
+RAM_DISK_COMPRESSED_IMAGE_SIGNATURE = b'RDCOMPRS'
+RAM_DISK_COMPRESSED_IMAGE_VERSION   = 1
+HEADER_FORMAT                       = '<8sIIQ'
+CHUNK_FORMAT                        = '<QII'
+
+def CompressChunk (Chunk, TempDir):
+    Input  = os.path.join (TempDir, 'Chunk.bin')
+    Output = os.path.join (TempDir, 'Chunk.cmp')
+    with open (Input, 'wb') as File:
+        File.write (Chunk)
+    subprocess.check_call (['TianoCompress', '-e', '--uefi', '-q', '-o', Output, Input])
+    with open (Output, 'rb') as File:
+        return File.read ()
+
+def CompressImage (Disk, ChunkSize):
+    ChunkCount = (len (Disk) + ChunkSize - 1) // ChunkSize
+    Offset     = struct.calcsize (HEADER_FORMAT) + ChunkCount * struct.calcsize (CHUNK_FORMAT)
+    Table      = bytearray ()
+    Data       = bytearray ()
+    with tempfile.TemporaryDirectory () as TempDir:
+        for Index in range (ChunkCount):
+            Chunk = Disk[Index * ChunkSize:(Index + 1) * ChunkSize]
+            if Chunk.count (0) == len (Chunk):
+                Table += struct.pack (CHUNK_FORMAT, 0, 0, 0)
+                continue
+            Compressed = CompressChunk (Chunk, TempDir)
+            Table     += struct.pack (CHUNK_FORMAT, Offset + len (Data), len (Compressed), 0)
+            Data      += Compressed
+    Header = struct.pack (
+               HEADER_FORMAT,
+               RAM_DISK_COMPRESSED_IMAGE_SIGNATURE,
+               RAM_DISK_COMPRESSED_IMAGE_VERSION,
+               ChunkSize,
+               len (Disk)
+               )
+    return Header + Table + Data
+
+if __name__ == '__main__':
+    def ValidateChunkSize (Argument):
+        try:
+            Value = int (Argument, 0)
+        except:
+            Message = '{Argument} is not a valid integer value.'.format (Argument = Argument)
+            raise argparse.ArgumentTypeError (Message)
+        if Value < 512 or Value > 0x80000000 or (Value & (Value - 1)) != 0:
+            Message = '{Argument} is not a power of two from 512.'.format (Argument = Argument)
+            raise argparse.ArgumentTypeError (Message)
+        return Value
+
+    parser = argparse.ArgumentParser (prog = __prog__,
+                                      description = __description__,
+                                      conflict_handler = 'resolve')
+    parser.add_argument ("-i", "--input", dest = 'InputFile', type = argparse.FileType ('rb'), required = True,
+                         help = "Input disk image filename.")
+    parser.add_argument ("-o", "--output", dest = 'OutputFile', type = argparse.FileType ('wb'), required = True,
+                         help = "Output compressed RAM disk image filename.")
+    parser.add_argument ("-c", "--chunk-size", dest = 'ChunkSize', type = ValidateChunkSize, default = 0x10000,
+                         help = "Size of a chunk in bytes, a power of two from 512.  Default is 0x10000.")
+
+    args = parser.parse_args ()
+
+    Disk = args.InputFile.read ()
+    args.InputFile.close ()
+    if len (Disk) == 0:
+        print ('{Prog}: error: {File} is empty'.format (Prog = __prog__, File = args.InputFile.name), file = sys.stderr)
+        sys.exit (1)
+
+    args.OutputFile.write (CompressImage (Disk, args.ChunkSize))
+    args.OutputFile.close ()
@@ -8,6 +8,227 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 
 #include "Fat.h"
 
+//
+// States of a cache page read ahead. Only the completion of the read-ahead
+// moves the page out of CACHE_PAGE_READING.
+//
+#define CACHE_PAGE_READY        0
+#define CACHE_PAGE_READING      1
+#define CACHE_PAGE_READ_FAILED  2
+
+/**
+
+  Get the address of the cache page of a cache tag.
+
+  @param  DiskCache             - The disk cache.
+  @param  CacheTag              - The Cache Tag of the page.
+
+  @return The address of the cache page.
+
+**/
+STATIC
+UINT8 *
+FatGetCachePageAddress (
+  IN DISK_CACHE  *DiskCache,
+  IN CACHE_TAG   *CacheTag
+  )
+{
+  return DiskCache->CacheBase + ((UINTN)(CacheTag - DiskCache->CacheTag) << DiskCache->PageAlignment);
+}
+
+/**
+
+  Wait for the read-ahead of a cache page to complete.
+  If the read-ahead failed, the page is dropped from the cache.
+
+  @param  CacheTag              - The Cache Tag of the page.
+
+**/
+STATIC
+VOID
+FatWaitCachePage (
+  IN CACHE_TAG  *CacheTag
+  )
+{
+  UINT8  ReadAheadState;
+
+  for ( ; ;) {
+    EfiAcquireLock (&FatTaskLock);
+    ReadAheadState = CacheTag->ReadAheadState;
+    EfiReleaseLock (&FatTaskLock);
+    if (ReadAheadState != CACHE_PAGE_READING) {
+      break;
+    }
+
+    CpuPause ();
+  }
+
+  if (ReadAheadState == CACHE_PAGE_READ_FAILED) {
+    CacheTag->RealSize       = 0;
+    CacheTag->ReadAhead      = FALSE;
+    CacheTag->ReadAheadState = CACHE_PAGE_READY;
+  }
+}
+
+/**
+
+  Look up the cache page of PageNo, which may still be being read ahead.
+
+  @param  DiskCache             - The disk cache.
+  @param  PageNo                - PageNo to match with the cache.
+
+  @return The Cache Tag of the page, or NULL if the page is not cached.
+
+**/
+STATIC
+CACHE_TAG *
+FatLookupCachePage (
+  IN DISK_CACHE  *DiskCache,
+  IN UINTN       PageNo
+  )
+{
+  CACHE_TAG  *CacheTag;
+  UINTN      SetCount;
+  UINTN      Way;
+
+  SetCount = DiskCache->SetMask + 1;
+  CacheTag = &DiskCache->CacheTag[PageNo & DiskCache->SetMask];
+  for (Way = 0; Way < DiskCache->WayCount; Way++) {
+    if ((CacheTag->RealSize > 0) && (CacheTag->PageNo == PageNo)) {
+      return CacheTag;
+    }
+
+    CacheTag += SetCount;
+  }
+
+  return NULL;
+}
+
+/**
+
+  Find the cache page of PageNo, and wait for its read-ahead to complete.
+
+  @param  DiskCache             - The disk cache.
+  @param  PageNo                - PageNo to match with the cache.
+
+  @return The Cache Tag of the page, or NULL if the page is not cached.
+
+**/
+STATIC
+CACHE_TAG *
+FatFindCachePage (
+  IN DISK_CACHE  *DiskCache,
+  IN UINTN       PageNo
+  )
+{
+  CACHE_TAG  *CacheTag;
+
+  CacheTag = FatLookupCachePage (DiskCache, PageNo);
+  if ((CacheTag != NULL) && (CacheTag->ReadAheadState != CACHE_PAGE_READY)) {
+    FatWaitCachePage (CacheTag);
+    if (CacheTag->RealSize == 0) {
+      CacheTag = NULL;
+    }
+  }
+
+  return CacheTag;
+}
+
+/**
+
+  Record an access to a cache page found in the cache.
+
+  @param  DiskCache             - The disk cache.
+  @param  CacheTag              - The Cache Tag of the page.
+
+**/
+STATIC
+VOID
+FatTouchCachePage (
+  IN DISK_CACHE  *DiskCache,
+  IN CACHE_TAG   *CacheTag
+  )
+{
+  DiskCache->Counters.Hits++;
+  if (CacheTag->ReadAhead) {
+    DiskCache->Counters.ReadAheadHits++;
+    CacheTag->ReadAhead = FALSE;
+  }
+
+  CacheTag->LastAccess = ++DiskCache->AccessClock;
+}
+
+/**
+
+  Choose the cache page of the set of PageNo to be replaced by PageNo.
+
+  An unused page is chosen first, then the least recently used one.
+  Pages being read ahead are only chosen when no other page can be.
+
+  @param  DiskCache             - The disk cache.
+  @param  PageNo                - PageNo to be cached.
+  @param  Clean                 - TRUE to only choose a page that is not dirty,
+                                  and not being read ahead.
+
+  @return The Cache Tag of the page to be replaced, or NULL if Clean is TRUE
+          and there is no such page.
+
+**/
+STATIC
+CACHE_TAG *
+FatGetVictimCachePage (
+  IN DISK_CACHE  *DiskCache,
+  IN UINTN       PageNo,
+  IN BOOLEAN     Clean
+  )
+{
+  CACHE_TAG  *CacheTag;
+  CACHE_TAG  *Victim;
+  CACHE_TAG  *Reading;
+  UINTN      SetCount;
+  UINTN      Way;
+  UINT8      ReadAheadState;
+
+  Victim   = NULL;
+  Reading  = NULL;
+  SetCount = DiskCache->SetMask + 1;
+  CacheTag = &DiskCache->CacheTag[PageNo & DiskCache->SetMask];
+  for (Way = 0; Way < DiskCache->WayCount; Way++, CacheTag += SetCount) {
+    ReadAheadState = CacheTag->ReadAheadState;
+    if (ReadAheadState == CACHE_PAGE_READING) {
+      if ((Reading == NULL) || (CacheTag->LastAccess < Reading->LastAccess)) {
+        Reading = CacheTag;
+      }
+
+      continue;
+    }
+
+    if (ReadAheadState == CACHE_PAGE_READ_FAILED) {
+      FatWaitCachePage (CacheTag);
+    }
+
+    if (CacheTag->RealSize == 0) {
+      return CacheTag;
+    }
+
+    if (Clean && CacheTag->Dirty) {
+      continue;
+    }
+
+    if ((Victim == NULL) || (CacheTag->LastAccess < Victim->LastAccess)) {
+      Victim = CacheTag;
+    }
+  }
+
+  if ((Victim == NULL) && !Clean) {
+    ASSERT (Reading != NULL);
+    FatWaitCachePage (Reading);
+    Victim = Reading;
+  }
+
+  return Victim;
+}
+
 /**
 
   This function is used by the Data Cache.
@@ -38,24 +259,18 @@ FatFlushDataCacheRange (
   )
 {
   UINTN       PageNo;
-  UINTN       GroupNo;
-  UINTN       GroupMask;
   UINTN       PageSize;
   UINT8       PageAlignment;
   DISK_CACHE  *DiskCache;
   CACHE_TAG   *CacheTag;
-  UINT8       *BaseAddress;
 
   DiskCache     = &Volume->DiskCache[CacheData];
-  BaseAddress   = DiskCache->CacheBase;
-  GroupMask     = DiskCache->GroupMask;
   PageAlignment = DiskCache->PageAlignment;
   PageSize      = (UINTN)1 << PageAlignment;
 
   for (PageNo = StartPageNo; PageNo < EndPageNo; PageNo++) {
-    GroupNo  = PageNo & GroupMask;
-    CacheTag = &DiskCache->CacheTag[GroupNo];
-    if ((CacheTag->RealSize > 0) && (CacheTag->PageNo == PageNo)) {
+    CacheTag = FatFindCachePage (DiskCache, PageNo);
+    if (CacheTag != NULL) {
       //
       // When reading data form disk directly, if some dirty data
       // in cache is in this rang, this data in the Buffer need to
@@ -65,7 +280,7 @@ FatFlushDataCacheRange (
         if (CacheTag->Dirty) {
           CopyMem (
             Buffer + ((PageNo - StartPageNo) << PageAlignment),
-            BaseAddress + (GroupNo << PageAlignment),
+            FatGetCachePageAddress (DiskCache, CacheTag),
             PageSize
             );
         }
@@ -74,6 +289,7 @@ FatFlushDataCacheRange (
         // Make all valid entries in this range invalid.
         //
         CacheTag->RealSize = 0;
+        CacheTag->Dirty    = FALSE;
       }
     }
   }
@@ -104,7 +320,6 @@ FatExchangeCachePage (
   )
 {
   EFI_STATUS  Status;
-  UINTN       GroupNo;
   UINTN       PageNo;
   UINTN       WriteCount;
   UINTN       RealSize;
@@ -116,9 +331,8 @@ FatExchangeCachePage (
 
   DiskCache     = &Volume->DiskCache[DataType];
   PageNo        = CacheTag->PageNo;
-  GroupNo       = PageNo & DiskCache->GroupMask;
   PageAlignment = DiskCache->PageAlignment;
-  PageAddress   = DiskCache->CacheBase + (GroupNo << PageAlignment);
+  PageAddress   = FatGetCachePageAddress (DiskCache, CacheTag);
   EntryPos      = DiskCache->BaseAddress + LShiftU64 (PageNo, PageAlignment);
   RealSize      = CacheTag->RealSize;
   if (IoMode == ReadDisk) {
@@ -128,6 +342,8 @@ FatExchangeCachePage (
       DEBUG ((DEBUG_INFO, "FatDiskIo: Cache Page OutBound occurred! \n"));
       RealSize = (UINTN)MaxSize;
     }
+  } else {
+    DiskCache->Counters.PagesWritten++;
   }
 
   WriteCount = 1;
@@ -144,6 +360,10 @@ FatExchangeCachePage (
       return Status;
     }
 
+    if (IoMode == WriteDisk) {
+      DiskCache->Counters.WriteBacks++;
+    }
+
     EntryPos += Volume->FatSize;
   } while (--WriteCount > 0);
 
@@ -168,28 +388,34 @@ FatExchangeCachePage (
 STATIC
 EFI_STATUS
 FatGetCachePage (
-  IN FAT_VOLUME       *Volume,
-  IN CACHE_DATA_TYPE  CacheDataType,
-  IN UINTN            PageNo,
-  IN CACHE_TAG        *CacheTag
+  IN  FAT_VOLUME       *Volume,
+  IN  CACHE_DATA_TYPE  CacheDataType,
+  IN  UINTN            PageNo,
+  OUT CACHE_TAG        **CacheTag
   )
 {
   EFI_STATUS  Status;
-  UINTN       OldPageNo;
+  DISK_CACHE  *DiskCache;
+  CACHE_TAG   *Victim;
 
-  OldPageNo = CacheTag->PageNo;
-  if ((CacheTag->RealSize > 0) && (OldPageNo == PageNo)) {
+  DiskCache = &Volume->DiskCache[CacheDataType];
+  *CacheTag = FatFindCachePage (DiskCache, PageNo);
+  if (*CacheTag != NULL) {
     //
     // Cache Hit occurred
     //
+    FatTouchCachePage (DiskCache, *CacheTag);
     return EFI_SUCCESS;
   }
 
+  DiskCache->Counters.Misses++;
+  Victim = FatGetVictimCachePage (DiskCache, PageNo, FALSE);
+
   //
   // Write dirty cache page back to disk
   //
-  if ((CacheTag->RealSize > 0) && CacheTag->Dirty) {
-    Status = FatExchangeCachePage (Volume, CacheDataType, WriteDisk, CacheTag, NULL);
+  if ((Victim->RealSize > 0) && Victim->Dirty) {
+    Status = FatExchangeCachePage (Volume, CacheDataType, WriteDisk, Victim, NULL);
     if (EFI_ERROR (Status)) {
       return Status;
     }
@@ -198,10 +424,17 @@ FatGetCachePage (
   //
   // Load new data from disk;
   //
-  CacheTag->PageNo = PageNo;
-  Status           = FatExchangeCachePage (Volume, CacheDataType, ReadDisk, CacheTag, NULL);
+  Victim->PageNo     = PageNo;
+  Victim->ReadAhead  = FALSE;
+  Victim->LastAccess = ++DiskCache->AccessClock;
+  Status             = FatExchangeCachePage (Volume, CacheDataType, ReadDisk, Victim, NULL);
+  if (EFI_ERROR (Status)) {
+    Victim->RealSize = 0;
+    return Status;
+  }
 
-  return Status;
+  *CacheTag = Victim;
+  return EFI_SUCCESS;
 }
 
 /**
@@ -238,14 +471,11 @@ FatAccessUnalignedCachePage (
   VOID        *Destination;
   DISK_CACHE  *DiskCache;
   CACHE_TAG   *CacheTag;
-  UINTN       GroupNo;
 
   DiskCache = &Volume->DiskCache[CacheDataType];
-  GroupNo   = PageNo & DiskCache->GroupMask;
-  CacheTag  = &DiskCache->CacheTag[GroupNo];
-  Status    = FatGetCachePage (Volume, CacheDataType, PageNo, CacheTag);
+  Status    = FatGetCachePage (Volume, CacheDataType, PageNo, &CacheTag);
   if (!EFI_ERROR (Status)) {
-    Source      = DiskCache->CacheBase + (GroupNo << DiskCache->PageAlignment) + Offset;
+    Source      = FatGetCachePageAddress (DiskCache, CacheTag) + Offset;
     Destination = Buffer;
     if (IoMode != ReadDisk) {
       CacheTag->Dirty  = TRUE;
@@ -260,6 +490,319 @@ FatAccessUnalignedCachePage (
   return Status;
 }
 
+/**
+
+  Read whole pages of the data area, from the data cache for the pages it holds
+  and from the disk for the others.
+
+  @param  Volume                - FAT file system volume.
+  @param  PageNo                - The number of the first page.
+  @param  PageCount             - The number of pages.
+  @param  Buffer                - Buffer to receive the data.
+  @param  Task                    point to task instance.
+
+  @retval EFI_SUCCESS           - The data was read correctly.
+  @return Others                - An error occurred when reading the disk.
+
+**/
+STATIC
+EFI_STATUS
+FatReadAlignedDataPages (
+  IN  FAT_VOLUME  *Volume,
+  IN  UINTN       PageNo,
+  IN  UINTN       PageCount,
+  OUT UINT8       *Buffer,
+  IN  FAT_TASK    *Task
+  )
+{
+  EFI_STATUS  Status;
+  DISK_CACHE  *DiskCache;
+  CACHE_TAG   *CacheTag;
+  UINTN       Index;
+  UINTN       RunCount;
+  UINT8       PageAlignment;
+
+  DiskCache     = &Volume->DiskCache[CacheData];
+  PageAlignment = DiskCache->PageAlignment;
+  RunCount      = 0;
+  for (Index = 0; Index <= PageCount; Index++) {
+    CacheTag = NULL;
+    if (Index < PageCount) {
+      CacheTag = FatFindCachePage (DiskCache, PageNo + Index);
+      if (CacheTag == NULL) {
+        RunCount++;
+        continue;
+      }
+    }
+
+    //
+    // Read the pages before this one that are not cached with one disk access
+    //
+    if (RunCount > 0) {
+      Status = FatDiskIo (
+                 Volume,
+                 ReadDisk,
+                 DiskCache->BaseAddress + LShiftU64 (PageNo + Index - RunCount, PageAlignment),
+                 RunCount << PageAlignment,
+                 Buffer + ((Index - RunCount) << PageAlignment),
+                 Task
+                 );
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      RunCount = 0;
+    }
+
+    if (CacheTag != NULL) {
+      FatTouchCachePage (DiskCache, CacheTag);
+      CopyMem (
+        Buffer + (Index << PageAlignment),
+        FatGetCachePageAddress (DiskCache, CacheTag),
+        (UINTN)1 << PageAlignment
+        );
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Notification function of the completion of a read-ahead.
+
+  @param  Event                 Event whose notification function is being invoked.
+  @param  Context               The pointer to the notification function's context,
+                                which is the FAT_READ_AHEAD.
+
+**/
+STATIC
+VOID
+EFIAPI
+FatOnReadAheadComplete (
+  IN  EFI_EVENT  Event,
+  IN  VOID       *Context
+  )
+{
+  FAT_READ_AHEAD  *ReadAhead;
+  UINT8           ReadAheadState;
+  UINTN           Index;
+
+  ASSERT (EfiGetCurrentTpl () == FatTaskLock.Tpl);
+
+  ReadAhead = (FAT_READ_AHEAD *)Context;
+  ASSERT (ReadAhead->Signature == FAT_READ_AHEAD_SIGNATURE);
+
+  ReadAheadState = CACHE_PAGE_READY;
+  if (EFI_ERROR (ReadAhead->DiskIo2Token.TransactionStatus)) {
+    ReadAheadState = CACHE_PAGE_READ_FAILED;
+  }
+
+  for (Index = 0; Index < ReadAhead->PageCount; Index++) {
+    ReadAhead->CacheTag[Index].ReadAheadState = ReadAheadState;
+  }
+
+  ReadAhead->DiskCache->ReadAheadPending--;
+
+  gBS->CloseEvent (Event);
+  FreePool (ReadAhead);
+}
+
+/**
+
+  Read contiguous cache pages of the data cache with a non-blocking read.
+
+  @param  Volume                - FAT file system volume.
+  @param  CacheTag              - The Cache Tag of the first page. The Cache
+                                  Tags of the pages follow it, their PageNo
+                                  and RealSize are set, and they are in the
+                                  CACHE_PAGE_READING state.
+  @param  PageCount             - The number of pages.
+
+  @retval EFI_SUCCESS           - The read was submitted.
+  @return Others                - The read could not be submitted, and the
+                                  pages were dropped from the cache.
+
+**/
+STATIC
+EFI_STATUS
+FatSubmitReadAhead (
+  IN FAT_VOLUME  *Volume,
+  IN CACHE_TAG   *CacheTag,
+  IN UINTN       PageCount
+  )
+{
+  EFI_STATUS      Status;
+  DISK_CACHE      *DiskCache;
+  FAT_READ_AHEAD  *ReadAhead;
+  UINTN           BufferSize;
+  UINTN           Index;
+  UINT64          EntryPos;
+  UINT8           *PageAddress;
+
+  DiskCache  = &Volume->DiskCache[CacheData];
+  BufferSize = 0;
+  for (Index = 0; Index < PageCount; Index++) {
+    BufferSize += CacheTag[Index].RealSize;
+  }
+
+  ReadAhead = AllocateZeroPool (sizeof (*ReadAhead));
+  if (ReadAhead == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Done;
+  }
+
+  ReadAhead->Signature = FAT_READ_AHEAD_SIGNATURE;
+  ReadAhead->DiskCache = DiskCache;
+  ReadAhead->CacheTag  = CacheTag;
+  ReadAhead->PageCount = PageCount;
+  Status               = gBS->CreateEvent (
+                                EVT_NOTIFY_SIGNAL,
+                                TPL_NOTIFY,
+                                FatOnReadAheadComplete,
+                                ReadAhead,
+                                &ReadAhead->DiskIo2Token.Event
+                                );
+  if (EFI_ERROR (Status)) {
+    FreePool (ReadAhead);
+    goto Done;
+  }
+
+  EntryPos    = DiskCache->BaseAddress + LShiftU64 (CacheTag->PageNo, DiskCache->PageAlignment);
+  PageAddress = FatGetCachePageAddress (DiskCache, CacheTag);
+  FatWaitNonblockingAccess (Volume, FALSE, EntryPos, BufferSize, PageAddress);
+
+  EfiAcquireLock (&FatTaskLock);
+  DiskCache->ReadAheadPending++;
+  EfiReleaseLock (&FatTaskLock);
+
+  //
+  // The read may complete, and free ReadAhead, before it returns.
+  //
+  Status = Volume->DiskIo2->ReadDiskEx (
+                              Volume->DiskIo2,
+                              Volume->MediaId,
+                              EntryPos,
+                              &ReadAhead->DiskIo2Token,
+                              BufferSize,
+                              PageAddress
+                              );
+  if (EFI_ERROR (Status)) {
+    EfiAcquireLock (&FatTaskLock);
+    DiskCache->ReadAheadPending--;
+    EfiReleaseLock (&FatTaskLock);
+    gBS->CloseEvent (ReadAhead->DiskIo2Token.Event);
+    FreePool (ReadAhead);
+  }
+
+Done:
+  if (EFI_ERROR (Status)) {
+    for (Index = 0; Index < PageCount; Index++) {
+      CacheTag[Index].RealSize       = 0;
+      CacheTag[Index].ReadAhead      = FALSE;
+      CacheTag[Index].ReadAheadState = CACHE_PAGE_READY;
+    }
+  } else {
+    DiskCache->Counters.ReadAheadPages += PageCount;
+  }
+
+  return Status;
+}
+
+/**
+
+  Read ahead the pages that follow a sequential read of the data area.
+
+  The window of ReadAheadPageCount pages after PageNo is read when less than
+  half of it was read ahead already. Contiguous pages that are replaced in
+  the same way of the cache are read with one non-blocking DiskIo2 read.
+  Pages that are cached already are skipped; only pages that are not dirty
+  are replaced.
+
+  @param  Volume                - FAT file system volume.
+  @param  PageNo                - The page after the last page read.
+
+**/
+STATIC
+VOID
+FatReadAheadDataCache (
+  IN FAT_VOLUME  *Volume,
+  IN UINTN       PageNo
+  )
+{
+  DISK_CACHE  *DiskCache;
+  CACHE_TAG   *CacheTag;
+  CACHE_TAG   *FirstTag;
+  UINTN       EndPageNo;
+  UINTN       MaxPageNo;
+  UINTN       PageCount;
+  UINTN       PageSize;
+  UINT64      EntryPos;
+
+  DiskCache = &Volume->DiskCache[CacheData];
+  if (DiskCache->ReadAheadPageNo < PageNo) {
+    DiskCache->ReadAheadPageNo = PageNo;
+  }
+
+  if (DiskCache->ReadAheadPageNo - PageNo > DiskCache->ReadAheadPageCount / 2) {
+    return;
+  }
+
+  PageSize  = (UINTN)1 << DiskCache->PageAlignment;
+  MaxPageNo = (UINTN)RShiftU64 (
+                       DiskCache->LimitAddress - DiskCache->BaseAddress + PageSize - 1,
+                       DiskCache->PageAlignment
+                       );
+  EndPageNo = MIN (PageNo + DiskCache->ReadAheadPageCount, MaxPageNo);
+
+  FirstTag  = NULL;
+  PageCount = 0;
+  while (DiskCache->ReadAheadPageNo < EndPageNo) {
+    CacheTag = NULL;
+    if (FatLookupCachePage (DiskCache, DiskCache->ReadAheadPageNo) == NULL) {
+      CacheTag = FatGetVictimCachePage (DiskCache, DiskCache->ReadAheadPageNo, TRUE);
+      if (CacheTag == NULL) {
+        break;
+      }
+    }
+
+    //
+    // Submit the pages gathered when this page does not extend them
+    //
+    if ((PageCount > 0) && (CacheTag != FirstTag + PageCount)) {
+      if (EFI_ERROR (FatSubmitReadAhead (Volume, FirstTag, PageCount))) {
+        return;
+      }
+
+      PageCount = 0;
+    }
+
+    if (CacheTag != NULL) {
+      //
+      // The page is not chosen again before the read is submitted, as it is
+      // in the CACHE_PAGE_READING state.
+      //
+      EntryPos                 = DiskCache->BaseAddress + LShiftU64 (DiskCache->ReadAheadPageNo, DiskCache->PageAlignment);
+      CacheTag->PageNo         = DiskCache->ReadAheadPageNo;
+      CacheTag->RealSize       = (UINTN)MIN (PageSize, DiskCache->LimitAddress - EntryPos);
+      CacheTag->Dirty          = FALSE;
+      CacheTag->ReadAhead      = TRUE;
+      CacheTag->ReadAheadState = CACHE_PAGE_READING;
+      CacheTag->LastAccess     = ++DiskCache->AccessClock;
+      if (PageCount == 0) {
+        FirstTag = CacheTag;
+      }
+
+      PageCount++;
+    }
+
+    DiskCache->ReadAheadPageNo++;
+  }
+
+  if (PageCount > 0) {
+    FatSubmitReadAhead (Volume, FirstTag, PageCount);
+  }
+}
+
 /**
 
   Read BufferSize bytes from the position of Offset into Buffer,
@@ -274,7 +817,10 @@ FatAccessUnalignedCachePage (
   2. Access of Data cache (CACHE_DATA):
      The access data will be divided into UnderRun data, Aligned data and OverRun data;
      The UnderRun data and OverRun data will be accessed by the Data cache,
-     but the Aligned data will be accessed with disk directly.
+     but the Aligned data will be accessed with disk directly, except for the
+     pages of a blocking read that are in the Data cache.
+     Blocking reads that follow the previous one start a read-ahead of the pages
+     after them.
 
   @param  Volume                - FAT file system volume.
   @param  CacheDataType         - The type of cache: CACHE_DATA or CACHE_FAT.
@@ -309,6 +855,9 @@ FatAccessCache (
   UINTN       PageNo;
   UINTN       AlignedPageCount;
   UINTN       OverRunPageNo;
+  UINTN       EndPageNo;
+  UINTN       Index;
+  BOOLEAN     Sequential;
   DISK_CACHE  *DiskCache;
   UINT64      EntryPos;
   UINT8       PageAlignment;
@@ -323,6 +872,22 @@ FatAccessCache (
   PageNo        = (UINTN)RShiftU64 (EntryPos, PageAlignment);
   UnderRun      = ((UINTN)EntryPos) & (PageSize - 1);
 
+  //
+  // A blocking read of the data area is sequential when it starts in the last
+  // page of the previous one or right after it.
+  //
+  Sequential = FALSE;
+  if ((CacheDataType == CacheData) && (IoMode == ReadDisk) && (Task == NULL) &&
+      (DiskCache->ReadAheadPageCount > 0) && (BufferSize > 0))
+  {
+    Sequential            = (BOOLEAN)((PageNo == DiskCache->NextPageNo) || (PageNo + 1 == DiskCache->NextPageNo));
+    EndPageNo             = (UINTN)RShiftU64 (EntryPos + BufferSize + PageSize - 1, PageAlignment);
+    DiskCache->NextPageNo = EndPageNo;
+    if (!Sequential) {
+      DiskCache->ReadAheadPageNo = 0;
+    }
+  }
+
   if (UnderRun > 0) {
     Length = PageSize - UnderRun;
     if (Length > BufferSize) {
@@ -345,23 +910,48 @@ FatAccessCache (
   // The access of the Aligned data
   //
   if (AlignedPageCount > 0) {
-    //
-    // Accessing fat table cannot have alignment data
-    //
-    ASSERT (CacheDataType == CacheData);
-
-    EntryPos    = Volume->RootPos + LShiftU64 (PageNo, PageAlignment);
     AlignedSize = AlignedPageCount << PageAlignment;
-    Status      = FatDiskIo (Volume, IoMode, EntryPos, AlignedSize, Buffer, Task);
-    if (EFI_ERROR (Status)) {
-      return Status;
+    if (CacheDataType == CacheFat) {
+      //
+      // The FAT is only accessed through its cache, a page at a time
+      //
+      for (Index = 0; Index < AlignedPageCount; Index++) {
+        Status = FatAccessUnalignedCachePage (
+                   Volume,
+                   CacheDataType,
+                   IoMode,
+                   PageNo + Index,
+                   0,
+                   PageSize,
+                   Buffer + (Index << PageAlignment)
+                   );
+        if (EFI_ERROR (Status)) {
+          return Status;
+        }
+      }
+    } else if (IoMode == ReadDisk) {
+      //
+      // The pages in the cache are copied now, even for a non-blocking read,
+      // as their dirty data is newer than the disk.
+      //
+      Status = FatReadAlignedDataPages (Volume, PageNo, AlignedPageCount, Buffer, Task);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    } else {
+      EntryPos = Volume->RootPos + LShiftU64 (PageNo, PageAlignment);
+      Status   = FatDiskIo (Volume, IoMode, EntryPos, AlignedSize, Buffer, Task);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      //
+      // If these access data over laps the relative cache range, these cache pages need
+      // to be updated.
+      //
+      FatFlushDataCacheRange (Volume, IoMode, PageNo, OverRunPageNo, Buffer);
     }
 
-    //
-    // If these access data over laps the relative cache range, these cache pages need
-    // to be updated.
-    //
-    FatFlushDataCacheRange (Volume, IoMode, PageNo, OverRunPageNo, Buffer);
     Buffer     += AlignedSize;
     BufferSize -= AlignedSize;
   }
@@ -377,12 +967,168 @@ FatAccessCache (
     Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, OverRunPageNo, 0, OverRun, Buffer);
   }
 
+  if (!EFI_ERROR (Status) && Sequential) {
+    FatReadAheadDataCache (Volume, DiskCache->NextPageNo);
+  }
+
   return Status;
 }
 
+/**
+
+  Compare the PageNo of two cache pages, for QuickSort().
+
+  @param  Buffer1               - Pointer to the first CACHE_TAG pointer.
+  @param  Buffer2               - Pointer to the second CACHE_TAG pointer.
+
+  @retval 0                     - The pages are the same.
+  @retval <0                    - The first page is before the second one.
+  @retval >0                    - The first page is after the second one.
+
+**/
+STATIC
+INTN
+EFIAPI
+FatCompareCachePageNo (
+  IN CONST VOID  *Buffer1,
+  IN CONST VOID  *Buffer2
+  )
+{
+  UINTN  PageNo1;
+  UINTN  PageNo2;
+
+  PageNo1 = (*(CACHE_TAG *CONST *)Buffer1)->PageNo;
+  PageNo2 = (*(CACHE_TAG *CONST *)Buffer2)->PageNo;
+  if (PageNo1 == PageNo2) {
+    return 0;
+  }
+
+  return (PageNo1 < PageNo2) ? -1 : 1;
+}
+
+/**
+
+  Write dirty cache pages of contiguous PageNo back to the disk with one write.
+
+  The pages are written from the cache when they are contiguous in it; a
+  blocking write gathers them in a temporary buffer otherwise. They are
+  written one by one when neither is possible.
+
+  @param  Volume                - FAT file system volume.
+  @param  CacheDataType         - The cache type: CACHE_FAT or CACHE_DATA.
+  @param  DirtyTag              - The Cache Tags of the pages, in PageNo order.
+  @param  PageCount             - The number of pages.
+  @param  Task                    point to task instance.
+
+  @retval EFI_SUCCESS           - The pages were written successfully.
+  @return Others                - An error occurred when writing the disk.
+
+**/
+STATIC
+EFI_STATUS
+FatWriteBackCachePages (
+  IN FAT_VOLUME       *Volume,
+  IN CACHE_DATA_TYPE  CacheDataType,
+  IN CACHE_TAG        **DirtyTag,
+  IN UINTN            PageCount,
+  IN FAT_TASK         *Task
+  )
+{
+  EFI_STATUS  Status;
+  DISK_CACHE  *DiskCache;
+  UINT8       *WriteBuffer;
+  UINT8       *TempBuffer;
+  UINTN       BufferSize;
+  UINTN       WriteCount;
+  UINTN       Index;
+  UINT64      EntryPos;
+  UINT8       PageAlignment;
+  BOOLEAN     Contiguous;
+
+  if (PageCount == 1) {
+    return FatExchangeCachePage (Volume, CacheDataType, WriteDisk, DirtyTag[0], Task);
+  }
+
+  DiskCache     = &Volume->DiskCache[CacheDataType];
+  PageAlignment = DiskCache->PageAlignment;
+  Contiguous    = TRUE;
+  BufferSize    = 0;
+  for (Index = 0; Index < PageCount; Index++) {
+    if (DirtyTag[Index] != DirtyTag[0] + Index) {
+      Contiguous = FALSE;
+    }
+
+    BufferSize += DirtyTag[Index]->RealSize;
+  }
+
+  TempBuffer  = NULL;
+  WriteBuffer = FatGetCachePageAddress (DiskCache, DirtyTag[0]);
+  if (!Contiguous) {
+    if (Task == NULL) {
+      TempBuffer = AllocatePool (BufferSize);
+    }
+
+    if (TempBuffer == NULL) {
+      for (Index = 0; Index < PageCount; Index++) {
+        Status = FatExchangeCachePage (Volume, CacheDataType, WriteDisk, DirtyTag[Index], Task);
+        if (EFI_ERROR (Status)) {
+          return Status;
+        }
+      }
+
+      return EFI_SUCCESS;
+    }
+
+    for (Index = 0; Index < PageCount; Index++) {
+      CopyMem (
+        TempBuffer + (Index << PageAlignment),
+        FatGetCachePageAddress (DiskCache, DirtyTag[Index]),
+        DirtyTag[Index]->RealSize
+        );
+    }
+
+    WriteBuffer = TempBuffer;
+  }
+
+  WriteCount = 1;
+  if (CacheDataType == CacheFat) {
+    WriteCount = Volume->NumFats;
+  }
+
+  EntryPos = DiskCache->BaseAddress + LShiftU64 (DirtyTag[0]->PageNo, PageAlignment);
+  do {
+    //
+    // Only fat table writing will execute more than once
+    //
+    Status = FatDiskIo (Volume, WriteDisk, EntryPos, BufferSize, WriteBuffer, Task);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    DiskCache->Counters.WriteBacks++;
+    EntryPos += Volume->FatSize;
+  } while (--WriteCount > 0);
+
+  if (TempBuffer != NULL) {
+    FreePool (TempBuffer);
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  DiskCache->Counters.PagesWritten += PageCount;
+  for (Index = 0; Index < PageCount; Index++) {
+    DirtyTag[Index]->Dirty = FALSE;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
 
   Flush all the dirty cache back, include the FAT cache and the Data cache.
+  Dirty pages of contiguous PageNo are written back together.
 
   @param  Volume                - FAT file system volume.
   @param  Task                    point to task instance.
@@ -399,28 +1145,52 @@ FatVolumeFlushCache (
 {
   EFI_STATUS       Status;
   CACHE_DATA_TYPE  CacheDataType;
-  UINTN            GroupIndex;
-  UINTN            GroupMask;
+  UINTN            TagIndex;
+  UINTN            TagCount;
+  UINTN            DirtyCount;
+  UINTN            Index;
+  UINTN            PageCount;
+  UINTN            PageSize;
   DISK_CACHE       *DiskCache;
   CACHE_TAG        *CacheTag;
+  CACHE_TAG        **DirtyTag;
+  CACHE_TAG        *SortBuffer;
 
   for (CacheDataType = (CACHE_DATA_TYPE)0; CacheDataType < CacheMaxType; CacheDataType++) {
     DiskCache = &Volume->DiskCache[CacheDataType];
     if (DiskCache->Dirty) {
       //
-      // Data cache or fat cache is dirty, write the dirty data back
+      // Data cache or fat cache is dirty, collect the dirty pages
       //
-      GroupMask = DiskCache->GroupMask;
-      for (GroupIndex = 0; GroupIndex <= GroupMask; GroupIndex++) {
-        CacheTag = &DiskCache->CacheTag[GroupIndex];
+      DirtyTag   = DiskCache->DirtyTag;
+      TagCount   = (DiskCache->SetMask + 1) * DiskCache->WayCount;
+      DirtyCount = 0;
+      for (TagIndex = 0; TagIndex < TagCount; TagIndex++) {
+        CacheTag = &DiskCache->CacheTag[TagIndex];
         if ((CacheTag->RealSize > 0) && CacheTag->Dirty) {
-          //
-          // Write back all Dirty Data Cache Page to disk
-          //
-          Status = FatExchangeCachePage (Volume, CacheDataType, WriteDisk, CacheTag, Task);
-          if (EFI_ERROR (Status)) {
-            return Status;
-          }
+          DirtyTag[DirtyCount++] = CacheTag;
+        }
+      }
+
+      QuickSort (DirtyTag, DirtyCount, sizeof (*DirtyTag), FatCompareCachePageNo, &SortBuffer);
+
+      //
+      // Write back all Dirty Data Cache Page to disk, contiguous pages at once
+      //
+      PageSize = (UINTN)1 << DiskCache->PageAlignment;
+      for (Index = 0; Index < DirtyCount; Index += PageCount) {
+        PageCount = 1;
+        while ((Index + PageCount < DirtyCount) &&
+               (PageCount < FAT_CACHE_MAX_WRITE_BACK_PAGES) &&
+               (DirtyTag[Index + PageCount]->PageNo == DirtyTag[Index]->PageNo + PageCount) &&
+               (DirtyTag[Index + PageCount - 1]->RealSize == PageSize))
+        {
+          PageCount++;
+        }
+
+        Status = FatWriteBackCachePages (Volume, CacheDataType, &DirtyTag[Index], PageCount, Task);
+        if (EFI_ERROR (Status)) {
+          return Status;
         }
       }
 
@@ -435,10 +1205,79 @@ FatVolumeFlushCache (
   return Status;
 }
 
+/**
+
+  Wait for the read-ahead requests of the data cache to complete.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+VOID
+FatWaitCacheReadAhead (
+  IN FAT_VOLUME  *Volume
+  )
+{
+  UINTN  ReadAheadPending;
+
+  for ( ; ;) {
+    EfiAcquireLock (&FatTaskLock);
+    ReadAheadPending = Volume->DiskCache[CacheData].ReadAheadPending;
+    EfiReleaseLock (&FatTaskLock);
+    if (ReadAheadPending == 0) {
+      break;
+    }
+
+    CpuPause ();
+  }
+}
+
+/**
+
+  Get the statistics of the disk cache of the volume.
+
+  @param  Volume                - FAT file system volume.
+  @param  BufferSize            - Size of Buffer.
+  @param  Buffer                - Buffer containing the statistics.
+
+  @retval EFI_SUCCESS           - Get the statistics successfully.
+  @retval EFI_BUFFER_TOO_SMALL  - The buffer is too small.
+
+**/
+EFI_STATUS
+FatGetDiskCacheStatistics (
+  IN     FAT_VOLUME  *Volume,
+  IN OUT UINTN       *BufferSize,
+  OUT    VOID        *Buffer
+  )
+{
+  FAT_DISK_CACHE_STATISTICS  *Statistics;
+  DISK_CACHE                 *DiskCache;
+
+  if (*BufferSize < sizeof (FAT_DISK_CACHE_STATISTICS)) {
+    *BufferSize = sizeof (FAT_DISK_CACHE_STATISTICS);
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  *BufferSize = sizeof (FAT_DISK_CACHE_STATISTICS);
+  Statistics  = Buffer;
+  DiskCache   = Volume->DiskCache;
+
+  Statistics->FatPageSize   = (UINT32)1 << DiskCache[CacheFat].PageAlignment;
+  Statistics->FatPageCount  = (UINT32)((DiskCache[CacheFat].SetMask + 1) * DiskCache[CacheFat].WayCount);
+  Statistics->DataPageSize  = (UINT32)1 << DiskCache[CacheData].PageAlignment;
+  Statistics->DataPageCount = (UINT32)((DiskCache[CacheData].SetMask + 1) * DiskCache[CacheData].WayCount);
+  CopyMem (&Statistics->Fat, &DiskCache[CacheFat].Counters, sizeof (FAT_DISK_CACHE_COUNTERS));
+  CopyMem (&Statistics->Data, &DiskCache[CacheData].Counters, sizeof (FAT_DISK_CACHE_COUNTERS));
+  return EFI_SUCCESS;
+}
+
 /**
 
   Initialize the disk cache according to Volume's FatType.
 
+  The data cache has PcdFatDataCachePageCount pages, and reads
+  PcdFatDataCacheReadAheadPageCount pages ahead when the disk produces DiskIo2.
+
   @param  Volume                - FAT file system volume.
 
   @retval EFI_SUCCESS           - The disk cache is successfully initialized.
@@ -452,8 +1291,12 @@ FatInitializeDiskCache (
 {
   DISK_CACHE  *DiskCache;
   UINTN       FatCacheGroupCount;
+  UINTN       DataCachePageCount;
+  UINTN       DataCacheSetCount;
   UINTN       DataCacheSize;
   UINTN       FatCacheSize;
+  UINTN       TagCount;
+  UINT64      CacheBufferSize;
   UINT8       *CacheBuffer;
 
   DiskCache = Volume->DiskCache;
@@ -470,18 +1313,53 @@ FatInitializeDiskCache (
     DiskCache[CacheData].PageAlignment = FAT_DATACACHE_PAGE_MAX_ALIGNMENT;
   }
 
-  DiskCache[CacheData].GroupMask    = FAT_DATACACHE_GROUP_COUNT - 1;
+  //
+  // The data cache has FAT_DATACACHE_WAY_COUNT ways of a power of 2 sets,
+  // or one set when it is smaller than that.
+  //
+  DataCachePageCount = MAX (PcdGet32 (PcdFatDataCachePageCount), 1);
+  DataCacheSetCount  = 1;
+  if (DataCachePageCount >= FAT_DATACACHE_WAY_COUNT) {
+    DataCacheSetCount  = GetPowerOfTwo32 ((UINT32)(DataCachePageCount / FAT_DATACACHE_WAY_COUNT));
+    DataCachePageCount = DataCacheSetCount * FAT_DATACACHE_WAY_COUNT;
+  }
+
+  DiskCache[CacheData].SetMask      = DataCacheSetCount - 1;
+  DiskCache[CacheData].WayCount     = DataCachePageCount / DataCacheSetCount;
   DiskCache[CacheData].BaseAddress  = Volume->RootPos;
   DiskCache[CacheData].LimitAddress = Volume->VolumeSize;
-  DiskCache[CacheFat].GroupMask     = FatCacheGroupCount - 1;
+  DiskCache[CacheFat].SetMask       = 0;
+  DiskCache[CacheFat].WayCount      = FatCacheGroupCount;
   DiskCache[CacheFat].BaseAddress   = Volume->FatPos;
   DiskCache[CacheFat].LimitAddress  = Volume->FatPos + Volume->FatSize;
-  FatCacheSize                      = FatCacheGroupCount << DiskCache[CacheFat].PageAlignment;
-  DataCacheSize                     = FAT_DATACACHE_GROUP_COUNT << DiskCache[CacheData].PageAlignment;
+  TagCount                          = FatCacheGroupCount + DataCachePageCount;
+
+  //
+  // The size of the cache buffer overflows UINTN on IA32 for a large
+  // PcdFatDataCachePageCount, so compute it in UINT64
+  //
+  CacheBufferSize = LShiftU64 (FatCacheGroupCount, DiskCache[CacheFat].PageAlignment) +
+                    LShiftU64 (DataCachePageCount, DiskCache[CacheData].PageAlignment) +
+                    MultU64x32 (TagCount, sizeof (CACHE_TAG) + sizeof (CACHE_TAG *));
+  if (CacheBufferSize > MAX_UINTN) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  FatCacheSize  = FatCacheGroupCount << DiskCache[CacheFat].PageAlignment;
+  DataCacheSize = DataCachePageCount << DiskCache[CacheData].PageAlignment;
+
+  //
+  // Read ahead at most half of the data cache, and only with DiskIo2
+  //
+  if (Volume->DiskIo2 != NULL) {
+    DiskCache[CacheData].ReadAheadPageCount = MIN (PcdGet32 (PcdFatDataCacheReadAheadPageCount), DataCachePageCount / 2);
+  }
+
   //
-  // Allocate the Fat Cache buffer
+  // Allocate the Fat Cache buffer, followed by the Cache Tags and the
+  // scratch lists of dirty Cache Tags
   //
-  CacheBuffer = AllocateZeroPool (FatCacheSize + DataCacheSize);
+  CacheBuffer = AllocateZeroPool ((UINTN)CacheBufferSize);
   if (CacheBuffer == NULL) {
     return EFI_OUT_OF_RESOURCES;
   }
@@ -489,5 +1367,9 @@ FatInitializeDiskCache (
   Volume->CacheBuffer            = CacheBuffer;
   DiskCache[CacheFat].CacheBase  = CacheBuffer;
   DiskCache[CacheData].CacheBase = CacheBuffer + FatCacheSize;
+  DiskCache[CacheFat].CacheTag   = (CACHE_TAG *)(CacheBuffer + FatCacheSize + DataCacheSize);
+  DiskCache[CacheData].CacheTag  = DiskCache[CacheFat].CacheTag + FatCacheGroupCount;
+  DiskCache[CacheFat].DirtyTag   = (CACHE_TAG **)(DiskCache[CacheData].CacheTag + DataCachePageCount);
+  DiskCache[CacheData].DirtyTag  = DiskCache[CacheFat].DirtyTag + FatCacheGroupCount;
   return EFI_SUCCESS;
 }
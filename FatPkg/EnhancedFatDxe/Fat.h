@@ -14,6 +14,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Guid/FileInfo.h>
 #include <Guid/FileSystemInfo.h>
 #include <Guid/FileSystemVolumeLabelInfo.h>
+#include <Guid/FatDiskCacheStatistics.h>
 #include <Protocol/BlockIo.h>
 #include <Protocol/DiskIo.h>
 #include <Protocol/DiskIo2.h>
@@ -35,13 +36,14 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 //
 // The FAT signature
 //
-#define FAT_VOLUME_SIGNATURE   SIGNATURE_32 ('f', 'a', 't', 'v')
-#define FAT_IFILE_SIGNATURE    SIGNATURE_32 ('f', 'a', 't', 'i')
-#define FAT_ODIR_SIGNATURE     SIGNATURE_32 ('f', 'a', 't', 'd')
-#define FAT_DIRENT_SIGNATURE   SIGNATURE_32 ('f', 'a', 't', 'e')
-#define FAT_OFILE_SIGNATURE    SIGNATURE_32 ('f', 'a', 't', 'o')
-#define FAT_TASK_SIGNATURE     SIGNATURE_32 ('f', 'a', 't', 'T')
-#define FAT_SUBTASK_SIGNATURE  SIGNATURE_32 ('f', 'a', 't', 'S')
+#define FAT_VOLUME_SIGNATURE      SIGNATURE_32 ('f', 'a', 't', 'v')
+#define FAT_IFILE_SIGNATURE       SIGNATURE_32 ('f', 'a', 't', 'i')
+#define FAT_ODIR_SIGNATURE        SIGNATURE_32 ('f', 'a', 't', 'd')
+#define FAT_DIRENT_SIGNATURE      SIGNATURE_32 ('f', 'a', 't', 'e')
+#define FAT_OFILE_SIGNATURE       SIGNATURE_32 ('f', 'a', 't', 'o')
+#define FAT_TASK_SIGNATURE        SIGNATURE_32 ('f', 'a', 't', 'T')
+#define FAT_SUBTASK_SIGNATURE     SIGNATURE_32 ('f', 'a', 't', 'S')
+#define FAT_READ_AHEAD_SIGNATURE  SIGNATURE_32 ('f', 'a', 't', 'R')
 
 #define ASSERT_VOLUME_LOCKED(a)  ASSERT_LOCKED (&FatFsLock)
 
@@ -75,14 +77,24 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 //
 // Minimum fat page size is 8K, maximum fat page alignment is 32K
 // Minimum data page size is 8K, maximum fat page alignment is 64K
+// The fat cache is fully associative, the data cache is 8-way set associative.
+// At most 16 contiguous dirty pages are written back at once.
 //
 #define FAT_FATCACHE_PAGE_MIN_ALIGNMENT   13
 #define FAT_FATCACHE_PAGE_MAX_ALIGNMENT   15
 #define FAT_DATACACHE_PAGE_MIN_ALIGNMENT  13
 #define FAT_DATACACHE_PAGE_MAX_ALIGNMENT  16
-#define FAT_DATACACHE_GROUP_COUNT         64
+#define FAT_DATACACHE_WAY_COUNT           8
 #define FAT_FATCACHE_GROUP_MIN_COUNT      1
 #define FAT_FATCACHE_GROUP_MAX_COUNT      16
+#define FAT_CACHE_MAX_WRITE_BACK_PAGES    16
+
+//
+// The extent map of a file grows from 8 extents up to 64K extents,
+// the chain of a more fragmented file is walked past that
+//
+#define FAT_EXTENT_MAP_MIN_COUNT  8
+#define FAT_EXTENT_MAP_MAX_COUNT  0x10000
 
 //
 // Used in 8.3 generation algorithm
@@ -145,24 +157,55 @@ typedef enum {
 typedef struct {
   UINTN      PageNo;
   UINTN      RealSize;
+  UINT64     LastAccess;              // Value of the cache's AccessClock at the last access
   BOOLEAN    Dirty;
+  BOOLEAN    ReadAhead;               // The page was read ahead and not accessed yet
+  UINT8      ReadAheadState;          // Whether the read-ahead of the page completed
 } CACHE_TAG;
 
+//
+// The page PageNo is cached in one of the WayCount tags of the set
+// PageNo & SetMask. The tag of way Way in set Set is
+// CacheTag[Way * (SetMask + 1) + Set], and its page is at the same index in
+// CacheBase, so that consecutive pages cached in the same way are contiguous.
+//
 typedef struct {
-  UINT64       BaseAddress;
-  UINT64       LimitAddress;
-  UINT8        *CacheBase;
-  BOOLEAN      Dirty;
-  UINT8        PageAlignment;
-  UINTN        GroupMask;
-  CACHE_TAG    CacheTag[FAT_DATACACHE_GROUP_COUNT];
+  UINT64                     BaseAddress;
+  UINT64                     LimitAddress;
+  UINT8                      *CacheBase;
+  BOOLEAN                    Dirty;
+  UINT8                      PageAlignment;
+  UINTN                      SetMask;
+  UINTN                      WayCount;
+  CACHE_TAG                  *CacheTag;
+  CACHE_TAG                  **DirtyTag;    // Scratch list of the dirty tags for flush
+  UINT64                     AccessClock;
+  //
+  // Sequential read stream detection and read-ahead
+  //
+  UINTN                      NextPageNo;         // Page after the last page read
+  UINTN                      ReadAheadPageNo;    // Page after the last page read ahead
+  UINTN                      ReadAheadPageCount; // Read-ahead window, 0 if disabled
+  UINTN                      ReadAheadPending;   // Number of read-ahead requests in progress
+  FAT_DISK_CACHE_COUNTERS    Counters;
 } DISK_CACHE;
 
 //
-// Hash table size
+// A run of consecutive clusters of a file
+//
+typedef struct {
+  UINTN    FileCluster; // Index of the first cluster in the file
+  UINTN    Cluster;     // First cluster on the volume
+  UINTN    Count;       // Number of clusters
+} FAT_EXTENT;
+
+//
+// Hash table size. The hash tables of a directory start small and double
+// while the directory has more entries than buckets. A directory has at
+// most 64K entries.
 //
-#define HASH_TABLE_SIZE  0x400
-#define HASH_TABLE_MASK  (HASH_TABLE_SIZE - 1)
+#define HASH_TABLE_MIN_SIZE  0x20
+#define HASH_TABLE_MAX_SIZE  0x10000
 
 //
 // The directory entry for opened directory
@@ -182,6 +225,8 @@ struct _FAT_DIRENT {
   FAT_OFILE              *OFile;                // The OFile of the corresponding directory entry
   FAT_DIRENT             *ShortNameForwardLink; // Hash successor link for short filename
   FAT_DIRENT             *LongNameForwardLink;  // Hash successor link for long filename
+  UINT32                 ShortNameHash;         // Hash value of the short filename
+  UINT32                 LongNameHash;          // Hash value of the upper-cased long filename
   LIST_ENTRY             Link;                  // Connection of every directory entry
   FAT_DIRECTORY_ENTRY    Entry;                 // The physical directory entry stored in disk
 };
@@ -195,8 +240,10 @@ struct _FAT_ODIR {
   BOOLEAN       EndOfDir;                     // Indicate whether we have reached the end of the directory
   LIST_ENTRY    DirCacheLink;                 // Linked in Volume->DirCacheList when discarded
   UINTN         DirCacheTag;                  // The identification of the directory when in directory cache
-  FAT_DIRENT    *LongNameHashTable[HASH_TABLE_SIZE];
-  FAT_DIRENT    *ShortNameHashTable[HASH_TABLE_SIZE];
+  FAT_DIRENT    **LongNameHashTable;          // Buckets of the long filenames, followed by ShortNameHashTable
+  FAT_DIRENT    **ShortNameHashTable;         // Buckets of the short filenames
+  UINT32        HashTableSize;                // Number of buckets of each hash table, a power of 2
+  UINT32        HashEntryCount;               // Number of directory entries in the hash tables
 };
 
 typedef struct {
@@ -221,13 +268,32 @@ typedef struct {
   UINTN                 Signature;
   EFI_DISK_IO2_TOKEN    DiskIo2Token;
   FAT_TASK              *Task;
+  FAT_VOLUME            *Volume;
   BOOLEAN               Write;
   UINT64                Offset;
   VOID                  *Buffer;
   UINTN                 BufferSize;
   LIST_ENTRY            Link;
+  //
+  // Once queued, the subtask is in the in-flight list of the volume, or in
+  // its deferred list until the earlier accesses it overlaps complete.
+  //
+  BOOLEAN               Queued;
+  BOOLEAN               Deferred;
+  LIST_ENTRY            VolumeLink;
 } FAT_SUBTASK;
 
+//
+// A non-blocking read of contiguous pages into the data cache
+//
+typedef struct {
+  UINTN                 Signature;
+  EFI_DISK_IO2_TOKEN    DiskIo2Token;
+  DISK_CACHE            *DiskCache;
+  CACHE_TAG             *CacheTag;            // Tag of the first page, the others follow it
+  UINTN                 PageCount;
+} FAT_READ_AHEAD;
+
 //
 // FAT_OFILE - Each opened file
 //
@@ -271,6 +337,14 @@ struct _FAT_OFILE {
   UINT64        PosDisk;        // on the disk
   UINTN         PosRem;         // remaining in this disk run
   //
+  // The extent map of the cluster chain, built as the file is accessed.
+  // It covers the first MappedClusterCount clusters of the file.
+  //
+  FAT_EXTENT    *Extents;
+  UINTN         ExtentCount;
+  UINTN         MaxExtentCount;
+  UINTN         MappedClusterCount;
+  //
   // The opened parent, full path length and currently opened child files
   //
   FAT_OFILE     *Parent;
@@ -335,6 +409,11 @@ struct _FAT_VOLUME {
   UINTN                              FreeInfoPos;    // Pos with the free cluster info
   BOOLEAN                            FreeInfoValid;  // If free cluster info is valid
   //
+  // One bit per cluster, set if the cluster is free. It is built by the
+  // first allocation, and NULL until then or if it could not be allocated.
+  //
+  UINT64                             *FreeBitmap;
+  //
   // Unpacked Fat BPB info
   //
   UINTN                              NumFats;
@@ -374,6 +453,15 @@ struct _FAT_VOLUME {
   //
   VOID                               *CacheBuffer;
   DISK_CACHE                         DiskCache[CacheMaxType];
+
+  //
+  // Non-blocking disk accesses of all the files, in the order they were
+  // queued, protected by FatTaskLock. DispatchEvent submits the deferred
+  // ones once they no longer overlap an earlier access.
+  //
+  LIST_ENTRY                         InFlightSubtasks;
+  LIST_ENTRY                         DeferredSubtasks;
+  EFI_EVENT                          DispatchEvent;
 };
 
 //
@@ -751,6 +839,37 @@ FatAccessCache (
   IN     FAT_TASK         *Task
   );
 
+/**
+
+  Wait for the read-ahead requests of the data cache to complete.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+VOID
+FatWaitCacheReadAhead (
+  IN FAT_VOLUME  *Volume
+  );
+
+/**
+
+  Get the statistics of the disk cache of the volume.
+
+  @param  Volume                - FAT file system volume.
+  @param  BufferSize            - Size of Buffer.
+  @param  Buffer                - Buffer containing the statistics.
+
+  @retval EFI_SUCCESS           - Get the statistics successfully.
+  @retval EFI_BUFFER_TOO_SMALL  - The buffer is too small.
+
+**/
+EFI_STATUS
+FatGetDiskCacheStatistics (
+  IN     FAT_VOLUME  *Volume,
+  IN OUT UINTN       *BufferSize,
+  OUT    VOID        *Buffer
+  );
+
 /**
 
   Flush all the dirty cache back, include the FAT cache and the Data cache.
@@ -948,6 +1067,27 @@ FatOFilePosition (
   IN UINTN      PosLimit
   );
 
+/**
+
+  Seek OFile to requested position by running its cluster chain, and
+  calculate the number of consecutive clusters from the position in the file.
+  It is used when the extent map of the file can not grow.
+
+  @param  OFile                 - The open file.
+  @param  Position              - The file's position which will be accessed.
+  @param  PosLimit              - The maximum length current reading/writing may access
+
+  @retval EFI_SUCCESS           - Set the info successfully.
+  @retval EFI_VOLUME_CORRUPTED  - Cluster chain corrupt.
+
+**/
+EFI_STATUS
+FatWalkOFilePosition (
+  IN FAT_OFILE  *OFile,
+  IN UINTN      Position,
+  IN UINTN      PosLimit
+  );
+
 /**
 
   Update the free cluster info of FatInfoSector of the volume.
@@ -1093,6 +1233,45 @@ FatQueueTask (
   IN FAT_TASK   *Task
   );
 
+/**
+
+  Wait for the non-blocking disk accesses queued on the volume that a
+  blocking disk access has to be ordered after: those that overlap it on
+  the disk and either of them writes the disk, or that overlap its buffer
+  and either of them writes the buffer.
+
+  @param  Volume                - FAT file system volume.
+  @param  Write                 - TRUE if the access writes the disk.
+  @param  Offset                - The starting byte offset on the disk.
+  @param  BufferSize            - Size of Buffer.
+  @param  Buffer                - The buffer of the access.
+
+**/
+VOID
+FatWaitNonblockingAccess (
+  IN FAT_VOLUME  *Volume,
+  IN BOOLEAN     Write,
+  IN UINT64      Offset,
+  IN UINTN       BufferSize,
+  IN VOID        *Buffer
+  );
+
+/**
+  Submit the deferred non-blocking disk accesses of the volume that no
+  longer overlap an earlier access.
+
+  @param  Event                 Event whose notification function is being invoked.
+  @param  Context               The pointer to the notification function's context,
+                                which is the FAT_VOLUME.
+
+**/
+VOID
+EFIAPI
+FatOnDispatchSubtasks (
+  IN  EFI_EVENT  Event,
+  IN  VOID       *Context
+  );
+
 /**
 
   Set the volume as dirty or not.
@@ -1768,6 +1947,21 @@ FatSetVolumeEntry (
 // Hash.c
 //
 
+/**
+
+  Allocate the hash tables of a directory, with the minimum size.
+
+  @param  ODir                  - The directory.
+
+  @retval EFI_SUCCESS           - The hash tables were allocated.
+  @retval EFI_OUT_OF_RESOURCES  - Not enough memory for the hash tables.
+
+**/
+EFI_STATUS
+FatInitializeHashTable (
+  IN FAT_ODIR  *ODir
+  );
+
 /**
 
   Search the long name hash table for the directory entry.
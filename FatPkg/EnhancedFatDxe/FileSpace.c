@@ -161,10 +161,18 @@ FatSetFatEntry (
     if (Index < Volume->FatInfoSector.FreeInfo.NextCluster) {
       Volume->FatInfoSector.FreeInfo.NextCluster = (UINT32)Index;
     }
+
+    if ((Volume->FreeBitmap != NULL) && (Index <= Volume->MaxCluster + 1)) {
+      Volume->FreeBitmap[Index / 64] |= LShiftU64 (1, Index % 64);
+    }
   } else if ((Value != FAT_CLUSTER_FREE) && (OriginalVal == FAT_CLUSTER_FREE)) {
     if (Volume->FatInfoSector.FreeInfo.ClusterCount != 0) {
       Volume->FatInfoSector.FreeInfo.ClusterCount -= 1;
     }
+
+    if (Volume->FreeBitmap != NULL) {
+      Volume->FreeBitmap[Index / 64] &= ~LShiftU64 (1, Index % 64);
+    }
   }
 
   //
@@ -314,6 +322,300 @@ FatAllocateCluster (
   return Cluster;
 }
 
+/**
+
+  Build the free cluster bitmap of the volume, and compute the free cluster
+  info of FatInfoSector with it.
+
+  The FAT entries are read a FAT cache page at a time, and tested a UINT64 at
+  a time for a free (zero) entry, so that the allocated parts of the FAT are
+  skipped fast. Reading through the FAT cache returns its dirty entries.
+
+  @param  Volume                - FAT file system volume.
+
+  @retval EFI_SUCCESS           - The bitmap is built.
+  @retval EFI_OUT_OF_RESOURCES  - Can not allocate the bitmap.
+  @return other                 - An error occurred when reading the FAT.
+
+**/
+STATIC
+EFI_STATUS
+FatBuildFreeBitmap (
+  IN FAT_VOLUME  *Volume
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      *Bitmap;
+  UINT64      *Buffer;
+  UINTN       EntryCount;
+  UINTN       EntriesPerWord;
+  UINTN       PageSize;
+  UINTN       FreeCount;
+  UINTN       Cluster;
+  UINTN       Count;
+  UINTN       WordCount;
+  UINTN       Word;
+  UINTN       Lane;
+  UINTN       Index;
+  UINTN       Entry;
+  UINT64      Value;
+  UINT64      EntryMask;
+  UINT64      LaneLow;
+  UINT64      LaneHigh;
+
+  ASSERT (Volume->FreeBitmap == NULL);
+
+  EntryCount = Volume->MaxCluster + 2;
+  Bitmap     = AllocateZeroPool ((EntryCount + 63) / 64 * sizeof (UINT64));
+  if (Bitmap == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status    = EFI_SUCCESS;
+  FreeCount = 0;
+  if (Volume->FatType == Fat12) {
+    //
+    // A FAT12 is at most 6K, and its entries are not byte aligned
+    //
+    for (Index = FAT_MIN_CLUSTER; Index < EntryCount; Index++) {
+      if (FatGetFatEntry (Volume, Index) == FAT_CLUSTER_FREE) {
+        Bitmap[Index / 64] |= LShiftU64 (1, Index % 64);
+        FreeCount++;
+      }
+    }
+
+    if (Volume->DiskError) {
+      Status = EFI_DEVICE_ERROR;
+    }
+  } else {
+    PageSize = (UINTN)1 << Volume->DiskCache[CacheFat].PageAlignment;
+    Buffer   = AllocatePool (PageSize);
+    if (Buffer == NULL) {
+      FreePool (Bitmap);
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    //
+    // A UINT64 has a free entry if one of its lanes is zero: subtracting 1
+    // from each lane only borrows into the top bit of a lane that was 0.
+    //
+    if (Volume->FatType == Fat16) {
+      EntryMask = MAX_UINT64;
+      LaneLow   = 0x0001000100010001ULL;
+      LaneHigh  = 0x8000800080008000ULL;
+    } else {
+      EntryMask = 0x0FFFFFFF0FFFFFFFULL;
+      LaneLow   = 0x0000000100000001ULL;
+      LaneHigh  = 0x8000000080000000ULL;
+    }
+
+    EntriesPerWord = sizeof (UINT64) / Volume->FatEntrySize;
+    for (Cluster = 0; Cluster < EntryCount; Cluster += Count) {
+      Count     = MIN (EntryCount - Cluster, PageSize / Volume->FatEntrySize);
+      WordCount = (Count + EntriesPerWord - 1) / EntriesPerWord;
+      //
+      // The lanes past the end of the FAT are not free
+      //
+      Buffer[WordCount - 1] = MAX_UINT64;
+      Status                = FatDiskIo (
+                                Volume,
+                                ReadFat,
+                                Volume->FatPos + Cluster * Volume->FatEntrySize,
+                                Count * Volume->FatEntrySize,
+                                Buffer,
+                                NULL
+                                );
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+
+      for (Word = 0; Word < WordCount; Word++) {
+        Value = Buffer[Word] & EntryMask;
+        if (((Value - LaneLow) & ~Value & LaneHigh) == 0) {
+          continue;
+        }
+
+        for (Lane = 0; Lane < EntriesPerWord; Lane++) {
+          Index = Cluster + Word * EntriesPerWord + Lane;
+          if (Volume->FatType == Fat16) {
+            Entry = ((UINT16 *)&Buffer[Word])[Lane];
+          } else {
+            Entry = ((UINT32 *)&Buffer[Word])[Lane] & FAT_CLUSTER_MASK_FAT32;
+          }
+
+          if ((Entry == FAT_CLUSTER_FREE) && (Index >= FAT_MIN_CLUSTER) && (Index < EntryCount)) {
+            Bitmap[Index / 64] |= LShiftU64 (1, Index % 64);
+            FreeCount++;
+          }
+        }
+      }
+    }
+
+    FreePool (Buffer);
+  }
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Bitmap);
+    return Status;
+  }
+
+  Volume->FreeBitmap                          = Bitmap;
+  Volume->FreeInfoValid                       = TRUE;
+  Volume->FatInfoSector.FreeInfo.ClusterCount = (UINT32)FreeCount;
+  Volume->FatInfoSector.Signature             = FAT_INFO_SIGNATURE;
+  Volume->FatInfoSector.InfoBeginSignature    = FAT_INFO_BEGIN_SIGNATURE;
+  Volume->FatInfoSector.InfoEndSignature      = FAT_INFO_END_SIGNATURE;
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Find the first free cluster in the free cluster bitmap, from a cluster on.
+
+  @param  Volume                - FAT file system volume.
+  @param  Cluster               - The cluster to start from.
+
+  @return The index of the free cluster, or MAX_UINTN if there is none.
+
+**/
+STATIC
+UINTN
+FatFindFreeCluster (
+  IN FAT_VOLUME  *Volume,
+  IN UINTN       Cluster
+  )
+{
+  UINTN   Index;
+  UINTN   WordCount;
+  UINT64  Word;
+
+  WordCount = (Volume->MaxCluster + 2 + 63) / 64;
+  Index     = Cluster / 64;
+  if (Index >= WordCount) {
+    return MAX_UINTN;
+  }
+
+  Word = Volume->FreeBitmap[Index] & LShiftU64 (MAX_UINT64, Cluster % 64);
+  while (Word == 0) {
+    Index++;
+    if (Index == WordCount) {
+      return MAX_UINTN;
+    }
+
+    Word = Volume->FreeBitmap[Index];
+  }
+
+  return Index * 64 + (UINTN)LowBitSet64 (Word);
+}
+
+/**
+
+  Count the free clusters that follow each other in the free cluster bitmap.
+
+  @param  Volume                - FAT file system volume.
+  @param  Cluster               - The first cluster of the run, it is free.
+  @param  MaxCount              - The maximum number of clusters to count.
+
+  @return The number of free clusters from Cluster on, at most MaxCount.
+
+**/
+STATIC
+UINTN
+FatGetFreeRunLength (
+  IN FAT_VOLUME  *Volume,
+  IN UINTN       Cluster,
+  IN UINTN       MaxCount
+  )
+{
+  UINTN   Index;
+  UINTN   WordCount;
+  UINTN   Bit;
+  UINTN   Run;
+  UINTN   Count;
+  UINT64  Word;
+
+  WordCount = (Volume->MaxCluster + 2 + 63) / 64;
+  Count     = 0;
+  while (Count < MaxCount) {
+    Index = (Cluster + Count) / 64;
+    Bit   = (Cluster + Count) % 64;
+    if (Index >= WordCount) {
+      break;
+    }
+
+    //
+    // Find the first allocated cluster from Bit on
+    //
+    Word   = RShiftU64 (~Volume->FreeBitmap[Index], Bit);
+    Run    = (Word == 0) ? 64 - Bit : (UINTN)LowBitSet64 (Word);
+    Count += Run;
+    if (Run < 64 - Bit) {
+      break;
+    }
+  }
+
+  return MIN (Count, MaxCount);
+}
+
+/**
+
+  Allocate a run of free clusters that follow each other on the volume.
+
+  The run starts right after PrevCluster if that cluster is free, so that
+  a growing file stays contiguous. Otherwise, it is the first free run from
+  the allocation hint on. The clusters are still marked free in the FAT.
+
+  @param  Volume                - FAT file system volume.
+  @param  PrevCluster           - The last cluster of the file, or FAT_CLUSTER_FREE.
+  @param  MaxCount              - The maximum number of clusters to allocate.
+  @param  Count                 - The number of clusters allocated.
+
+  @return The index of the first cluster of the run, or FAT_CLUSTER_LAST
+          if the volume is full.
+
+**/
+STATIC
+UINTN
+FatAllocateClusters (
+  IN  FAT_VOLUME  *Volume,
+  IN  UINTN       PrevCluster,
+  IN  UINTN       MaxCount,
+  OUT UINTN       *Count
+  )
+{
+  UINTN  Cluster;
+
+  *Count = 1;
+  if (Volume->DiskError) {
+    return (UINTN)FAT_CLUSTER_LAST;
+  }
+
+  //
+  // Without the bitmap, fall back to search the FAT a cluster at a time
+  //
+  if (Volume->FreeBitmap == NULL) {
+    FatBuildFreeBitmap (Volume);
+    if (Volume->FreeBitmap == NULL) {
+      return FatAllocateCluster (Volume);
+    }
+  }
+
+  Cluster = PrevCluster + 1;
+  if ((PrevCluster == FAT_CLUSTER_FREE) || (FatFindFreeCluster (Volume, Cluster) != Cluster)) {
+    Cluster = FatFindFreeCluster (Volume, Volume->FatInfoSector.FreeInfo.NextCluster);
+    if (Cluster > Volume->MaxCluster + 1) {
+      Cluster = FatFindFreeCluster (Volume, FAT_MIN_CLUSTER);
+      if (Cluster > Volume->MaxCluster + 1) {
+        return (UINTN)FAT_CLUSTER_LAST;
+      }
+    }
+  }
+
+  *Count                                     = FatGetFreeRunLength (Volume, Cluster, MaxCount);
+  Volume->FatInfoSector.FreeInfo.NextCluster = (UINT32)(Cluster + *Count);
+  return Cluster;
+}
+
 /**
 
   Count the number of clusters given a size.
@@ -341,6 +643,152 @@ FatSizeToClusters (
   return Clusters;
 }
 
+/**
+
+  Append a run of consecutive clusters to the extent map of the open file.
+
+  @param  OFile                 - The open file.
+  @param  Cluster               - The first cluster of the run.
+  @param  Count                 - The number of clusters in the run.
+
+  @retval EFI_SUCCESS           - The run is appended.
+  @retval EFI_OUT_OF_RESOURCES  - The extent map can not grow.
+
+**/
+STATIC
+EFI_STATUS
+FatAppendExtent (
+  IN FAT_OFILE  *OFile,
+  IN UINTN      Cluster,
+  IN UINTN      Count
+  )
+{
+  FAT_EXTENT  *Extent;
+  UINTN       MaxExtentCount;
+
+  if (OFile->ExtentCount != 0) {
+    Extent = &OFile->Extents[OFile->ExtentCount - 1];
+    if (Extent->Cluster + Extent->Count == Cluster) {
+      Extent->Count             += Count;
+      OFile->MappedClusterCount += Count;
+      return EFI_SUCCESS;
+    }
+  }
+
+  if (OFile->ExtentCount == OFile->MaxExtentCount) {
+    if (OFile->MaxExtentCount == FAT_EXTENT_MAP_MAX_COUNT) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    MaxExtentCount = MAX (OFile->MaxExtentCount * 2, FAT_EXTENT_MAP_MIN_COUNT);
+    Extent         = ReallocatePool (
+                       OFile->MaxExtentCount * sizeof (FAT_EXTENT),
+                       MaxExtentCount * sizeof (FAT_EXTENT),
+                       OFile->Extents
+                       );
+    if (Extent == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    OFile->Extents        = Extent;
+    OFile->MaxExtentCount = MaxExtentCount;
+  }
+
+  Extent                     = &OFile->Extents[OFile->ExtentCount];
+  Extent->FileCluster        = OFile->MappedClusterCount;
+  Extent->Cluster            = Cluster;
+  Extent->Count              = Count;
+  OFile->ExtentCount        += 1;
+  OFile->MappedClusterCount += Count;
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Walk the cluster chain of the open file past the end of its extent map,
+  until the map covers a cluster of the file.
+
+  @param  OFile                 - The open file.
+  @param  ClusterIndex          - The index of the cluster in the file.
+
+  @retval EFI_SUCCESS           - The extent map covers the cluster.
+  @retval EFI_VOLUME_CORRUPTED  - Cluster chain corrupt.
+  @retval EFI_OUT_OF_RESOURCES  - The extent map can not grow.
+
+**/
+STATIC
+EFI_STATUS
+FatMapClusters (
+  IN FAT_OFILE  *OFile,
+  IN UINTN      ClusterIndex
+  )
+{
+  FAT_VOLUME  *Volume;
+  FAT_EXTENT  *Extent;
+  UINTN       Cluster;
+  EFI_STATUS  Status;
+
+  Volume = OFile->Volume;
+  while (OFile->MappedClusterCount <= ClusterIndex) {
+    if (OFile->ExtentCount == 0) {
+      Cluster = OFile->FileCluster;
+    } else {
+      Extent  = &OFile->Extents[OFile->ExtentCount - 1];
+      Cluster = FatGetFatEntry (Volume, Extent->Cluster + Extent->Count - 1);
+    }
+
+    if ((Cluster < FAT_MIN_CLUSTER) || (Cluster > Volume->MaxCluster + 1)) {
+      DEBUG ((DEBUG_INIT | DEBUG_ERROR, "FatMapClusters: cluster chain corrupt\n"));
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    Status = FatAppendExtent (OFile, Cluster, 1);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Find the extent of a cluster of the open file in its extent map.
+
+  @param  OFile                 - The open file.
+  @param  ClusterIndex          - The index of the cluster in the file, the
+                                  extent map covers it.
+
+  @return The index of the extent in the extent map.
+
+**/
+STATIC
+UINTN
+FatFindExtent (
+  IN FAT_OFILE  *OFile,
+  IN UINTN      ClusterIndex
+  )
+{
+  UINTN  Low;
+  UINTN  High;
+  UINTN  Middle;
+
+  ASSERT (ClusterIndex < OFile->MappedClusterCount);
+
+  Low  = 0;
+  High = OFile->ExtentCount - 1;
+  while (Low < High) {
+    Middle = (Low + High + 1) / 2;
+    if (OFile->Extents[Middle].FileCluster <= ClusterIndex) {
+      Low = Middle;
+    } else {
+      High = Middle - 1;
+    }
+  }
+
+  return Low;
+}
+
 /**
 
   Shrink the end of the open file base on the file size.
@@ -357,6 +805,7 @@ FatShrinkEof (
   )
 {
   FAT_VOLUME  *Volume;
+  FAT_EXTENT  *Extent;
   UINTN       NewSize;
   UINTN       CurSize;
   UINTN       Cluster;
@@ -368,13 +817,36 @@ FatShrinkEof (
   NewSize = FatSizeToClusters (Volume, OFile->FileSize);
 
   //
-  // Find the address of the last cluster
+  // Find the address of the last cluster, in the extent map if it covers
+  // it, and drop the clusters past it from the map
   //
   Cluster     = OFile->FileCluster;
   LastCluster = FAT_CLUSTER_FREE;
 
+  if (OFile->MappedClusterCount >= NewSize) {
+    CurSize = NewSize;
+    if (NewSize != 0) {
+      Extent      = &OFile->Extents[FatFindExtent (OFile, NewSize - 1)];
+      LastCluster = Extent->Cluster + NewSize - 1 - Extent->FileCluster;
+      Cluster     = FatGetFatEntry (Volume, LastCluster);
+    }
+
+    while ((OFile->ExtentCount != 0) && (OFile->Extents[OFile->ExtentCount - 1].FileCluster >= NewSize)) {
+      OFile->ExtentCount -= 1;
+    }
+
+    if (OFile->ExtentCount != 0) {
+      Extent        = &OFile->Extents[OFile->ExtentCount - 1];
+      Extent->Count = NewSize - Extent->FileCluster;
+    }
+
+    OFile->MappedClusterCount = NewSize;
+  } else {
+    CurSize = 0;
+  }
+
   if (NewSize != 0) {
-    for (CurSize = 0; CurSize < NewSize; CurSize++) {
+    for ( ; CurSize < NewSize; CurSize++) {
       if ((Cluster == FAT_CLUSTER_FREE) || (Cluster >= FAT_CLUSTER_SPECIAL)) {
         DEBUG ((DEBUG_INIT | DEBUG_ERROR, "FatShrinkEof: cluster chain corrupt\n"));
         return EFI_VOLUME_CORRUPTED;
@@ -439,6 +911,7 @@ FatGrowEof (
   UINTN       LastCluster;
   UINTN       NewCluster;
   UINTN       ClusterCount;
+  UINTN       Index;
 
   //
   // For FAT file system, the max file is 4GB.
@@ -494,7 +967,7 @@ FatGrowEof (
     LastCluster = OFile->FileLastCluster;
 
     while (CurSize < NewSize) {
-      NewCluster = FatAllocateCluster (Volume);
+      NewCluster = FatAllocateClusters (Volume, LastCluster, NewSize - CurSize, &ClusterCount);
       if (FAT_END_OF_FAT_CHAIN (NewCluster)) {
         if (LastCluster != FAT_CLUSTER_FREE) {
           FatSetFatEntry (Volume, LastCluster, (UINTN)FAT_CLUSTER_LAST);
@@ -505,11 +978,28 @@ FatGrowEof (
         goto Done;
       }
 
-      if ((NewCluster < FAT_MIN_CLUSTER) || (NewCluster > Volume->MaxCluster + 1)) {
+      if ((NewCluster < FAT_MIN_CLUSTER) || (NewCluster + ClusterCount - 1 > Volume->MaxCluster + 1)) {
         Status = EFI_VOLUME_CORRUPTED;
         goto Done;
       }
 
+      //
+      // Chain the clusters of the run and terminate the cluster list
+      //
+      // Note that we must do this EVERY time we allocate clusters, because
+      // FatAllocateClusters looks for clusters that are free in the FAT, and
+      // the run is no longer free!  Usually, FatAllocateClusters will start
+      // looking with the cluster after the run; however, when the run is
+      // the last free space, it will find the run a second time.  There
+      // are other, less predictable scenarios where this could happen, as
+      // well.
+      //
+      for (Index = NewCluster; Index < NewCluster + ClusterCount - 1; Index++) {
+        FatSetFatEntry (Volume, Index, Index + 1);
+      }
+
+      FatSetFatEntry (Volume, Index, (UINTN)FAT_CLUSTER_LAST);
+
       if (LastCluster != 0) {
         FatSetFatEntry (Volume, LastCluster, NewCluster);
       } else {
@@ -517,21 +1007,15 @@ FatGrowEof (
         OFile->FileCurrentCluster = NewCluster;
       }
 
-      LastCluster = NewCluster;
-      CurSize    += 1;
-
-      //
-      // Terminate the cluster list
       //
-      // Note that we must do this EVERY time we allocate a cluster, because
-      // FatAllocateCluster scans the FAT looking for a free cluster and
-      // "LastCluster" is no longer free!  Usually, FatAllocateCluster will
-      // start looking with the cluster after "LastCluster"; however, when
-      // there is only one free cluster left, it will find "LastCluster"
-      // a second time.  There are other, less predictable scenarios
-      // where this could happen, as well.
+      // Keep the extent map complete if it covers the whole file
       //
-      FatSetFatEntry (Volume, LastCluster, (UINTN)FAT_CLUSTER_LAST);
+      if (OFile->MappedClusterCount == CurSize) {
+        FatAppendExtent (OFile, NewCluster, ClusterCount);
+      }
+
+      LastCluster            = Index;
+      CurSize               += ClusterCount;
       OFile->FileLastCluster = LastCluster;
     }
   }
@@ -545,11 +1029,98 @@ Done:
   return Status;
 }
 
+/**
+
+  Seek OFile to requested position by running its cluster chain, and
+  calculate the number of consecutive clusters from the position in the file.
+  It is used when the extent map of the file can not grow.
+
+  @param  OFile                 - The open file.
+  @param  Position              - The file's position which will be accessed.
+  @param  PosLimit              - The maximum length current reading/writing may access
+
+  @retval EFI_SUCCESS           - Set the info successfully.
+  @retval EFI_VOLUME_CORRUPTED  - Cluster chain corrupt.
+
+**/
+EFI_STATUS
+FatWalkOFilePosition (
+  IN FAT_OFILE  *OFile,
+  IN UINTN      Position,
+  IN UINTN      PosLimit
+  )
+{
+  FAT_VOLUME  *Volume;
+  UINTN       ClusterSize;
+  UINTN       Cluster;
+  UINTN       StartPos;
+  UINTN       Run;
+
+  Volume      = OFile->Volume;
+  ClusterSize = Volume->ClusterSize;
+
+  //
+  // Run the file's cluster chain to find the current position
+  // If possible, run from the current cluster rather than
+  // start from beginning
+  // Assumption: OFile->Position is always consistent with
+  // OFile->FileCurrentCluster.
+  // OFile->Position is not modified outside this function;
+  // OFile->FileCurrentCluster is modified outside this function
+  // to be the same as OFile->FileCluster
+  // when OFile->FileCluster is updated, so make a check of this
+  // and invalidate the original OFile->Position in this case
+  //
+  Cluster  = OFile->FileCurrentCluster;
+  StartPos = OFile->Position;
+  if ((Position < StartPos) || (OFile->FileCluster == Cluster)) {
+    StartPos = 0;
+    Cluster  = OFile->FileCluster;
+  }
+
+  while (StartPos + ClusterSize <= Position) {
+    StartPos += ClusterSize;
+    if ((Cluster == FAT_CLUSTER_FREE) || (Cluster >= FAT_CLUSTER_SPECIAL)) {
+      DEBUG ((DEBUG_INIT | DEBUG_ERROR, "FatOFilePosition:" " cluster chain corrupt\n"));
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    Cluster = FatGetFatEntry (Volume, Cluster);
+  }
+
+  if ((Cluster < FAT_MIN_CLUSTER) || (Cluster > Volume->MaxCluster + 1)) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  OFile->PosDisk = Volume->FirstClusterPos +
+                   LShiftU64 (Cluster - FAT_MIN_CLUSTER, Volume->ClusterAlignment) +
+                   Position - StartPos;
+  OFile->FileCurrentCluster = Cluster;
+  OFile->Position           = StartPos;
+
+  //
+  // Compute the number of consecutive clusters in the file
+  //
+  Run = StartPos + ClusterSize - Position;
+  if (!FAT_END_OF_FAT_CHAIN (Cluster)) {
+    while ((FatGetFatEntry (Volume, Cluster) == Cluster + 1) && Run < PosLimit) {
+      Run     += ClusterSize;
+      Cluster += 1;
+    }
+  }
+
+  OFile->PosRem = Run;
+  return EFI_SUCCESS;
+}
+
 /**
 
   Seek OFile to requested position, and calculate the number of
   consecutive clusters from the position in the file
 
+  The clusters are looked up in the extent map of the file, which is
+  extended by walking the cluster chain when the position is past its end.
+
   @param  OFile                 - The open file.
   @param  Position              - The file's position which will be accessed.
   @param  PosLimit              - The maximum length current reading/writing may access
@@ -566,9 +1137,13 @@ FatOFilePosition (
   )
 {
   FAT_VOLUME  *Volume;
+  FAT_EXTENT  *Extent;
+  EFI_STATUS  Status;
   UINTN       ClusterSize;
+  UINTN       ClusterIndex;
+  UINTN       ExtentIndex;
+  UINTN       FileClusters;
   UINTN       Cluster;
-  UINTN       StartPos;
   UINTN       Run;
 
   Volume      = OFile->Volume;
@@ -582,57 +1157,47 @@ FatOFilePosition (
   //
   if (OFile->IsFixedRootDir) {
     OFile->PosDisk = Volume->RootPos + Position;
-    Run            = OFile->FileSize - Position;
-  } else {
-    //
-    // Run the file's cluster chain to find the current position
-    // If possible, run from the current cluster rather than
-    // start from beginning
-    // Assumption: OFile->Position is always consistent with
-    // OFile->FileCurrentCluster.
-    // OFile->Position is not modified outside this function;
-    // OFile->FileCurrentCluster is modified outside this function
-    // to be the same as OFile->FileCluster
-    // when OFile->FileCluster is updated, so make a check of this
-    // and invalidate the original OFile->Position in this case
-    //
-    Cluster  = OFile->FileCurrentCluster;
-    StartPos = OFile->Position;
-    if ((Position < StartPos) || (OFile->FileCluster == Cluster)) {
-      StartPos = 0;
-      Cluster  = OFile->FileCluster;
-    }
+    OFile->PosRem  = OFile->FileSize - Position;
+    return EFI_SUCCESS;
+  }
 
-    while (StartPos + ClusterSize <= Position) {
-      StartPos += ClusterSize;
-      if ((Cluster == FAT_CLUSTER_FREE) || (Cluster >= FAT_CLUSTER_SPECIAL)) {
-        DEBUG ((DEBUG_INIT | DEBUG_ERROR, "FatOFilePosition:" " cluster chain corrupt\n"));
-        return EFI_VOLUME_CORRUPTED;
-      }
+  ClusterIndex = Position >> Volume->ClusterAlignment;
+  Status       = FatMapClusters (OFile, ClusterIndex);
+  if (Status == EFI_OUT_OF_RESOURCES) {
+    return FatWalkOFilePosition (OFile, Position, PosLimit);
+  }
 
-      Cluster = FatGetFatEntry (Volume, Cluster);
-    }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
 
-    if ((Cluster < FAT_MIN_CLUSTER) || (Cluster > Volume->MaxCluster + 1)) {
-      return EFI_VOLUME_CORRUPTED;
-    }
+  ExtentIndex = FatFindExtent (OFile, ClusterIndex);
+  Extent      = &OFile->Extents[ExtentIndex];
+  Cluster     = Extent->Cluster + ClusterIndex - Extent->FileCluster;
 
-    OFile->PosDisk = Volume->FirstClusterPos +
-                     LShiftU64 (Cluster - FAT_MIN_CLUSTER, Volume->ClusterAlignment) +
-                     Position - StartPos;
-    OFile->FileCurrentCluster = Cluster;
-    OFile->Position           = StartPos;
+  OFile->PosDisk = Volume->FirstClusterPos +
+                   LShiftU64 (Cluster - FAT_MIN_CLUSTER, Volume->ClusterAlignment) +
+                   (Position & (ClusterSize - 1));
+  OFile->FileCurrentCluster = Cluster;
+  OFile->Position           = Position & ~(ClusterSize - 1);
 
-    //
-    // Compute the number of consecutive clusters in the file
-    //
-    Run = StartPos + ClusterSize - Position;
-    if (!FAT_END_OF_FAT_CHAIN (Cluster)) {
-      while ((FatGetFatEntry (Volume, Cluster) == Cluster + 1) && Run < PosLimit) {
-        Run     += ClusterSize;
-        Cluster += 1;
-      }
+  //
+  // The consecutive clusters run to the end of the extent. The last extent
+  // may go on past the end of the map, so map more of the file while it
+  // does and the access needs them.
+  //
+  Run          = ((Extent->FileCluster + Extent->Count - ClusterIndex) << Volume->ClusterAlignment) -
+                 (Position & (ClusterSize - 1));
+  FileClusters = FatSizeToClusters (Volume, OFile->FileSize);
+  while ((Run < PosLimit) && (ExtentIndex == OFile->ExtentCount - 1) &&
+         (OFile->MappedClusterCount < FileClusters))
+  {
+    Status = FatMapClusters (OFile, OFile->MappedClusterCount);
+    if (EFI_ERROR (Status) || (ExtentIndex != OFile->ExtentCount - 1)) {
+      break;
     }
+
+    Run += ClusterSize;
   }
 
   OFile->PosRem = Run;
@@ -724,9 +1289,10 @@ FatComputeFreeInfo (
   UINTN  Index;
 
   //
-  // If we don't have valid info, compute it now
+  // If we don't have valid info, compute it now.
+  // The free cluster bitmap computes it as it is built
   //
-  if (!Volume->FreeInfoValid) {
+  if (!Volume->FreeInfoValid && ((Volume->FreeBitmap != NULL) || EFI_ERROR (FatBuildFreeBitmap (Volume)))) {
     Volume->FreeInfoValid                       = TRUE;
     Volume->FatInfoSector.FreeInfo.ClusterCount = 0;
     for (Index = Volume->MaxCluster + 1; Index >= FAT_MIN_CLUSTER; Index--) {
@@ -34,7 +34,7 @@ FatHashLongName (
     );
   FatStrUpr (UpCasedLongFileName);
   gBS->CalculateCrc32 (UpCasedLongFileName, StrSize (UpCasedLongFileName), &HashValue);
-  return (HashValue & HASH_TABLE_MASK);
+  return HashValue;
 }
 
 /**
@@ -55,7 +55,87 @@ FatHashShortName (
   UINT32  HashValue;
 
   gBS->CalculateCrc32 (ShortNameString, FAT_NAME_LEN, &HashValue);
-  return (HashValue & HASH_TABLE_MASK);
+  return HashValue;
+}
+
+/**
+
+  Replace the hash tables of a directory with tables of another size, and
+  move the directory entries to them.
+
+  @param  ODir                  - The directory.
+  @param  NewSize               - The number of buckets of each new table, a power of 2.
+
+  @retval EFI_SUCCESS           - The hash tables were resized.
+  @retval EFI_OUT_OF_RESOURCES  - Not enough memory, the old tables are kept.
+
+**/
+STATIC
+EFI_STATUS
+FatResizeHashTable (
+  IN FAT_ODIR  *ODir,
+  IN UINT32    NewSize
+  )
+{
+  FAT_DIRENT  **LongNameHashTable;
+  FAT_DIRENT  **ShortNameHashTable;
+  FAT_DIRENT  *DirEnt;
+  FAT_DIRENT  *NextDirEnt;
+  UINT32      Index;
+  UINT32      HashTableIndex;
+
+  LongNameHashTable = AllocateZeroPool (2 * NewSize * sizeof (FAT_DIRENT *));
+  if (LongNameHashTable == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ShortNameHashTable = LongNameHashTable + NewSize;
+  //
+  // Rehash with the hash values saved in the directory entries
+  //
+  for (Index = 0; Index < ODir->HashTableSize; Index++) {
+    for (DirEnt = ODir->ShortNameHashTable[Index]; DirEnt != NULL; DirEnt = NextDirEnt) {
+      NextDirEnt                         = DirEnt->ShortNameForwardLink;
+      HashTableIndex                     = DirEnt->ShortNameHash & (NewSize - 1);
+      DirEnt->ShortNameForwardLink       = ShortNameHashTable[HashTableIndex];
+      ShortNameHashTable[HashTableIndex] = DirEnt;
+    }
+
+    for (DirEnt = ODir->LongNameHashTable[Index]; DirEnt != NULL; DirEnt = NextDirEnt) {
+      NextDirEnt                        = DirEnt->LongNameForwardLink;
+      HashTableIndex                    = DirEnt->LongNameHash & (NewSize - 1);
+      DirEnt->LongNameForwardLink       = LongNameHashTable[HashTableIndex];
+      LongNameHashTable[HashTableIndex] = DirEnt;
+    }
+  }
+
+  if (ODir->LongNameHashTable != NULL) {
+    FreePool (ODir->LongNameHashTable);
+  }
+
+  ODir->LongNameHashTable  = LongNameHashTable;
+  ODir->ShortNameHashTable = ShortNameHashTable;
+  ODir->HashTableSize      = NewSize;
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Allocate the hash tables of a directory, with the minimum size.
+
+  @param  ODir                  - The directory.
+
+  @retval EFI_SUCCESS           - The hash tables were allocated.
+  @retval EFI_OUT_OF_RESOURCES  - Not enough memory for the hash tables.
+
+**/
+EFI_STATUS
+FatInitializeHashTable (
+  IN FAT_ODIR  *ODir
+  )
+{
+  ASSERT (ODir->LongNameHashTable == NULL);
+  return FatResizeHashTable (ODir, HASH_TABLE_MIN_SIZE);
 }
 
 /**
@@ -75,13 +155,21 @@ FatLongNameHashSearch (
   )
 {
   FAT_DIRENT  **PreviousHashNode;
+  UINT32      HashValue;
 
-  for (PreviousHashNode   = &ODir->LongNameHashTable[FatHashLongName (LongNameString)];
+  //
+  // Only the entries with the same hash value are compared with the
+  // collation protocol
+  //
+  HashValue = FatHashLongName (LongNameString);
+  for (PreviousHashNode   = &ODir->LongNameHashTable[HashValue & (ODir->HashTableSize - 1)];
        *PreviousHashNode != NULL;
        PreviousHashNode   = &(*PreviousHashNode)->LongNameForwardLink
        )
   {
-    if (FatStriCmp (LongNameString, (*PreviousHashNode)->FileString) == 0) {
+    if (((*PreviousHashNode)->LongNameHash == HashValue) &&
+        (FatStriCmp (LongNameString, (*PreviousHashNode)->FileString) == 0))
+    {
       break;
     }
   }
@@ -106,13 +194,17 @@ FatShortNameHashSearch (
   )
 {
   FAT_DIRENT  **PreviousHashNode;
+  UINT32      HashValue;
 
-  for (PreviousHashNode   = &ODir->ShortNameHashTable[FatHashShortName (ShortNameString)];
+  HashValue = FatHashShortName (ShortNameString);
+  for (PreviousHashNode   = &ODir->ShortNameHashTable[HashValue & (ODir->HashTableSize - 1)];
        *PreviousHashNode != NULL;
        PreviousHashNode   = &(*PreviousHashNode)->ShortNameForwardLink
        )
   {
-    if (CompareMem (ShortNameString, (*PreviousHashNode)->Entry.FileName, FAT_NAME_LEN) == 0) {
+    if (((*PreviousHashNode)->ShortNameHash == HashValue) &&
+        (CompareMem (ShortNameString, (*PreviousHashNode)->Entry.FileName, FAT_NAME_LEN) == 0))
+    {
       break;
     }
   }
@@ -137,17 +229,28 @@ FatInsertToHashTable (
   FAT_DIRENT  **HashTable;
   UINT32      HashTableIndex;
 
+  //
+  // Keep at most one entry per bucket on average. If the tables cannot
+  // grow, the entry goes to the current ones with longer chains.
+  //
+  ODir->HashEntryCount++;
+  if ((ODir->HashEntryCount > ODir->HashTableSize) && (ODir->HashTableSize < HASH_TABLE_MAX_SIZE)) {
+    FatResizeHashTable (ODir, ODir->HashTableSize * 2);
+  }
+
   //
   // Insert hash table index for short name
   //
-  HashTableIndex               = FatHashShortName (DirEnt->Entry.FileName);
+  DirEnt->ShortNameHash        = FatHashShortName (DirEnt->Entry.FileName);
+  HashTableIndex               = DirEnt->ShortNameHash & (ODir->HashTableSize - 1);
   HashTable                    = ODir->ShortNameHashTable;
   DirEnt->ShortNameForwardLink = HashTable[HashTableIndex];
   HashTable[HashTableIndex]    = DirEnt;
   //
   // Insert hash table index for long name
   //
-  HashTableIndex              = FatHashLongName (DirEnt->FileString);
+  DirEnt->LongNameHash        = FatHashLongName (DirEnt->FileString);
+  HashTableIndex              = DirEnt->LongNameHash & (ODir->HashTableSize - 1);
   HashTable                   = ODir->LongNameHashTable;
   DirEnt->LongNameForwardLink = HashTable[HashTableIndex];
   HashTable[HashTableIndex]   = DirEnt;
@@ -167,6 +270,26 @@ FatDeleteFromHashTable (
   IN FAT_DIRENT  *DirEnt
   )
 {
-  *FatShortNameHashSearch (ODir, DirEnt->Entry.FileName) = DirEnt->ShortNameForwardLink;
-  *FatLongNameHashSearch (ODir, DirEnt->FileString)      = DirEnt->LongNameForwardLink;
+  FAT_DIRENT  **PreviousHashNode;
+
+  //
+  // Unlink the node itself, found with its saved hash values, rather than
+  // the first node with the same names
+  //
+  PreviousHashNode = &ODir->ShortNameHashTable[DirEnt->ShortNameHash & (ODir->HashTableSize - 1)];
+  while (*PreviousHashNode != DirEnt) {
+    ASSERT (*PreviousHashNode != NULL);
+    PreviousHashNode = &(*PreviousHashNode)->ShortNameForwardLink;
+  }
+
+  *PreviousHashNode = DirEnt->ShortNameForwardLink;
+
+  PreviousHashNode = &ODir->LongNameHashTable[DirEnt->LongNameHash & (ODir->HashTableSize - 1)];
+  while (*PreviousHashNode != DirEnt) {
+    ASSERT (*PreviousHashNode != NULL);
+    PreviousHashNode = &(*PreviousHashNode)->LongNameForwardLink;
+  }
+
+  *PreviousHashNode = DirEnt->LongNameForwardLink;
+  ODir->HashEntryCount--;
 }
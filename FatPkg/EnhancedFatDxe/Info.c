@@ -540,6 +540,10 @@ FatSetOrGetInfo (
       if (CompareGuid (Type, &gEfiFileSystemVolumeLabelInfoIdGuid)) {
         Status = FatGetVolumeLabelInfo (Volume, BufferSize, Buffer);
       }
+
+      if (CompareGuid (Type, &gEdkiiFatDiskCacheStatisticsGuid)) {
+        Status = FatGetDiskCacheStatistics (Volume, BufferSize, Buffer);
+      }
     }
   }
 
@@ -56,6 +56,21 @@ FatAllocateVolume (
   Volume->VolumeInterface.OpenVolume = FatOpenVolume;
   InitializeListHead (&Volume->CheckRef);
   InitializeListHead (&Volume->DirCacheList);
+  InitializeListHead (&Volume->InFlightSubtasks);
+  InitializeListHead (&Volume->DeferredSubtasks);
+  if (DiskIo2 != NULL) {
+    Status = gBS->CreateEvent (
+                    EVT_NOTIFY_SIGNAL,
+                    TPL_CALLBACK,
+                    FatOnDispatchSubtasks,
+                    Volume,
+                    &Volume->DispatchEvent
+                    );
+    if (EFI_ERROR (Status)) {
+      goto Done;
+    }
+  }
+
   //
   // Initialize Root Directory entry
   //
@@ -103,12 +103,148 @@ FatDestroySubtask (
 
   gBS->CloseEvent (Subtask->DiskIo2Token.Event);
 
+  if (Subtask->Queued) {
+    RemoveEntryList (&Subtask->VolumeLink);
+  }
+
   Link = RemoveEntryList (&Subtask->Link);
   FreePool (Subtask);
 
   return Link;
 }
 
+/**
+
+  Check whether an access has to wait for a non-blocking disk access in
+  progress or deferred: they overlap on the disk and either of them writes
+  the disk, or they overlap in memory and either of them writes the memory.
+
+  @param  Subtask               - The non-blocking disk access.
+  @param  Write                 - TRUE if the access writes the disk.
+  @param  Offset                - The starting byte offset on the disk.
+  @param  BufferSize            - Size of Buffer.
+  @param  Buffer                - The buffer of the access.
+
+  @retval TRUE                  - The access has to wait for Subtask.
+  @retval FALSE                 - The accesses are independent.
+
+**/
+STATIC
+BOOLEAN
+FatSubtaskOverlaps (
+  IN FAT_SUBTASK  *Subtask,
+  IN BOOLEAN      Write,
+  IN UINT64       Offset,
+  IN UINTN        BufferSize,
+  IN UINT8        *Buffer
+  )
+{
+  UINT8  *SubtaskBuffer;
+
+  if ((Write || Subtask->Write) &&
+      (Offset < Subtask->Offset + Subtask->BufferSize) && (Subtask->Offset < Offset + BufferSize))
+  {
+    return TRUE;
+  }
+
+  SubtaskBuffer = Subtask->Buffer;
+  if ((!Write || !Subtask->Write) &&
+      (Buffer < SubtaskBuffer + Subtask->BufferSize) && (SubtaskBuffer < Buffer + BufferSize))
+  {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+
+  Check whether an access has to wait for a non-blocking disk access of the
+  volume. The caller holds FatTaskLock.
+
+  @param  Volume                - FAT file system volume.
+  @param  Write                 - TRUE if the access writes the disk.
+  @param  Offset                - The starting byte offset on the disk.
+  @param  BufferSize            - Size of Buffer.
+  @param  Buffer                - The buffer of the access.
+  @param  DeferredLink          - The deferred accesses before this link are
+                                  checked, the in-flight ones all are.
+
+  @retval TRUE                  - The access has to wait.
+  @retval FALSE                 - The access can start.
+
+**/
+STATIC
+BOOLEAN
+FatIsAccessBlocked (
+  IN FAT_VOLUME  *Volume,
+  IN BOOLEAN     Write,
+  IN UINT64      Offset,
+  IN UINTN       BufferSize,
+  IN VOID        *Buffer,
+  IN LIST_ENTRY  *DeferredLink
+  )
+{
+  LIST_ENTRY   *Link;
+  FAT_SUBTASK  *Subtask;
+
+  for (Link = Volume->InFlightSubtasks.ForwardLink; Link != &Volume->InFlightSubtasks; Link = Link->ForwardLink) {
+    Subtask = CR (Link, FAT_SUBTASK, VolumeLink, FAT_SUBTASK_SIGNATURE);
+    if (FatSubtaskOverlaps (Subtask, Write, Offset, BufferSize, Buffer)) {
+      return TRUE;
+    }
+  }
+
+  for (Link = Volume->DeferredSubtasks.ForwardLink; Link != DeferredLink; Link = Link->ForwardLink) {
+    Subtask = CR (Link, FAT_SUBTASK, VolumeLink, FAT_SUBTASK_SIGNATURE);
+    if (FatSubtaskOverlaps (Subtask, Write, Offset, BufferSize, Buffer)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+
+  Submit a non-blocking disk access to DiskIo2.
+
+  @param  Subtask               - The subtask to be submitted.
+
+  @retval EFI_SUCCESS           - The subtask was submitted, it may be freed already.
+  @return other                 - The subtask could not be submitted.
+
+**/
+STATIC
+EFI_STATUS
+FatSubmitSubtask (
+  IN FAT_SUBTASK  *Subtask
+  )
+{
+  EFI_DISK_IO2_PROTOCOL  *DiskIo2;
+
+  DiskIo2 = Subtask->Volume->DiskIo2;
+  if (Subtask->Write) {
+    return DiskIo2->WriteDiskEx (
+                      DiskIo2,
+                      Subtask->Volume->MediaId,
+                      Subtask->Offset,
+                      &Subtask->DiskIo2Token,
+                      Subtask->BufferSize,
+                      Subtask->Buffer
+                      );
+  }
+
+  return DiskIo2->ReadDiskEx (
+                    DiskIo2,
+                    Subtask->Volume->MediaId,
+                    Subtask->Offset,
+                    &Subtask->DiskIo2Token,
+                    Subtask->BufferSize,
+                    Subtask->Buffer
+                    );
+}
+
 /**
 
   Execute the task.
@@ -127,6 +263,7 @@ FatQueueTask (
   )
 {
   EFI_STATUS   Status;
+  FAT_VOLUME   *Volume;
   LIST_ENTRY   *Link;
   LIST_ENTRY   *NextLink;
   FAT_SUBTASK  *Subtask;
@@ -141,8 +278,27 @@ FatQueueTask (
     return EFI_SUCCESS;
   }
 
+  Volume = IFile->OFile->Volume;
+
   EfiAcquireLock (&FatTaskLock);
   InsertTailList (&IFile->Tasks, &Task->Link);
+  //
+  // Queue the subtasks on the volume. The subtasks that overlap an earlier
+  // access of any task are deferred until it completes, the others go to
+  // the disk at once, so that the accesses of different files, or of
+  // different parts of a file, are in flight together.
+  //
+  for (Link = GetFirstNode (&Task->Subtasks); !IsNull (&Task->Subtasks, Link); Link = GetNextNode (&Task->Subtasks, Link)) {
+    Subtask         = CR (Link, FAT_SUBTASK, Link, FAT_SUBTASK_SIGNATURE);
+    Subtask->Queued = TRUE;
+    if (FatIsAccessBlocked (Volume, Subtask->Write, Subtask->Offset, Subtask->BufferSize, Subtask->Buffer, &Volume->DeferredSubtasks)) {
+      Subtask->Deferred = TRUE;
+      InsertTailList (&Volume->DeferredSubtasks, &Subtask->VolumeLink);
+    } else {
+      InsertTailList (&Volume->InFlightSubtasks, &Subtask->VolumeLink);
+    }
+  }
+
   EfiReleaseLock (&FatTaskLock);
 
   Status = EFI_SUCCESS;
@@ -154,32 +310,20 @@ FatQueueTask (
   // they may check the validity of doubly-linked lists by traversing them. These APIs cannot
   // handle list elements being removed during the traverse.
   //
-  for ( Link = GetFirstNode (&Task->Subtasks), NextLink = GetNextNode (&Task->Subtasks, Link)
-        ; Link != &Task->Subtasks
-        ; Link = NextLink, NextLink = Link->ForwardLink
-        )
-  {
-    Subtask = CR (Link, FAT_SUBTASK, Link, FAT_SUBTASK_SIGNATURE);
-    if (Subtask->Write) {
-      Status = IFile->OFile->Volume->DiskIo2->WriteDiskEx (
-                                                IFile->OFile->Volume->DiskIo2,
-                                                IFile->OFile->Volume->MediaId,
-                                                Subtask->Offset,
-                                                &Subtask->DiskIo2Token,
-                                                Subtask->BufferSize,
-                                                Subtask->Buffer
-                                                );
-    } else {
-      Status = IFile->OFile->Volume->DiskIo2->ReadDiskEx (
-                                                IFile->OFile->Volume->DiskIo2,
-                                                IFile->OFile->Volume->MediaId,
-                                                Subtask->Offset,
-                                                &Subtask->DiskIo2Token,
-                                                Subtask->BufferSize,
-                                                Subtask->Buffer
-                                                );
+  // The deferred subtasks are not submitted before the loop ends, as DispatchEvent
+  // runs at the TPL of the volume lock.
+  //
+  // Task itself is freed with its last subtask, so the head of the list is
+  // not read once the loop reaches it.
+  //
+  for (Link = GetFirstNode (&Task->Subtasks); Link != &Task->Subtasks; Link = NextLink) {
+    NextLink = Link->ForwardLink;
+    Subtask  = CR (Link, FAT_SUBTASK, Link, FAT_SUBTASK_SIGNATURE);
+    if (Subtask->Deferred) {
+      continue;
     }
 
+    Status = FatSubmitSubtask (Subtask);
     if (EFI_ERROR (Status)) {
       break;
     }
@@ -188,7 +332,7 @@ FatQueueTask (
   if (EFI_ERROR (Status)) {
     EfiAcquireLock (&FatTaskLock);
     //
-    // Remove all the remaining subtasks when failure.
+    // Remove all the remaining subtasks, and the deferred ones, when failure.
     // We shouldn't remove all the tasks because the non-blocking requests have
     // been submitted and cannot be canceled.
     //
@@ -197,6 +341,16 @@ FatQueueTask (
       Link    = FatDestroySubtask (Subtask);
     }
 
+    Link = GetFirstNode (&Task->Subtasks);
+    while (!IsNull (&Task->Subtasks, Link)) {
+      Subtask = CR (Link, FAT_SUBTASK, Link, FAT_SUBTASK_SIGNATURE);
+      if (Subtask->Deferred) {
+        Link = FatDestroySubtask (Subtask);
+      } else {
+        Link = GetNextNode (&Task->Subtasks, Link);
+      }
+    }
+
     if (IsListEmpty (&Task->Subtasks)) {
       RemoveEntryList (&Task->Link);
       FreePool (Task);
@@ -209,6 +363,11 @@ FatQueueTask (
     }
 
     EfiReleaseLock (&FatTaskLock);
+
+    //
+    // Subtasks of other tasks may have waited for the ones removed
+    //
+    gBS->SignalEvent (Volume->DispatchEvent);
   }
 
   return Status;
@@ -257,6 +416,7 @@ FatOnAccessComplete (
   EFI_STATUS   Status;
   FAT_SUBTASK  *Subtask;
   FAT_TASK     *Task;
+  FAT_VOLUME   *Volume;
 
   //
   // Avoid someone in future breaks the below assumption.
@@ -265,6 +425,7 @@ FatOnAccessComplete (
 
   Subtask = (FAT_SUBTASK *)Context;
   Task    = Subtask->Task;
+  Volume  = Subtask->Volume;
   Status  = Subtask->DiskIo2Token.TransactionStatus;
 
   ASSERT (Task->Signature    == FAT_TASK_SIGNATURE);
@@ -293,6 +454,131 @@ FatOnAccessComplete (
     RemoveEntryList (&Task->Link);
     FreePool (Task);
   }
+
+  //
+  // The deferred subtasks are submitted at a lower TPL, as DiskIo2 requires
+  //
+  if (!IsListEmpty (&Volume->DeferredSubtasks)) {
+    gBS->SignalEvent (Volume->DispatchEvent);
+  }
+}
+
+/**
+
+  Submit the deferred subtasks of the volume that no longer overlap an
+  earlier access, in the order they were queued.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+STATIC
+VOID
+FatDispatchSubtasks (
+  IN FAT_VOLUME  *Volume
+  )
+{
+  EFI_STATUS   Status;
+  LIST_ENTRY   *Link;
+  FAT_SUBTASK  *Subtask;
+
+  do {
+    EfiAcquireLock (&FatTaskLock);
+    Subtask = NULL;
+    for (Link = Volume->DeferredSubtasks.ForwardLink; Link != &Volume->DeferredSubtasks; Link = Link->ForwardLink) {
+      Subtask = CR (Link, FAT_SUBTASK, VolumeLink, FAT_SUBTASK_SIGNATURE);
+      if (!FatIsAccessBlocked (Volume, Subtask->Write, Subtask->Offset, Subtask->BufferSize, Subtask->Buffer, Link)) {
+        break;
+      }
+
+      Subtask = NULL;
+    }
+
+    if (Subtask != NULL) {
+      RemoveEntryList (&Subtask->VolumeLink);
+      InsertTailList (&Volume->InFlightSubtasks, &Subtask->VolumeLink);
+      Subtask->Deferred = FALSE;
+    }
+
+    EfiReleaseLock (&FatTaskLock);
+
+    if (Subtask != NULL) {
+      Status = FatSubmitSubtask (Subtask);
+      if (EFI_ERROR (Status)) {
+        //
+        // Complete the subtask with the error, as DiskIo2 would have
+        //
+        EfiAcquireLock (&FatTaskLock);
+        Subtask->DiskIo2Token.TransactionStatus = Status;
+        FatOnAccessComplete (Subtask->DiskIo2Token.Event, Subtask);
+        EfiReleaseLock (&FatTaskLock);
+      }
+    }
+  } while (Subtask != NULL);
+}
+
+/**
+  Submit the deferred non-blocking disk accesses of the volume that no
+  longer overlap an earlier access.
+
+  @param  Event                 Event whose notification function is being invoked.
+  @param  Context               The pointer to the notification function's context,
+                                which is the FAT_VOLUME.
+
+**/
+VOID
+EFIAPI
+FatOnDispatchSubtasks (
+  IN  EFI_EVENT  Event,
+  IN  VOID       *Context
+  )
+{
+  FatDispatchSubtasks ((FAT_VOLUME *)Context);
+}
+
+/**
+
+  Wait for the non-blocking disk accesses queued on the volume that a
+  blocking disk access has to be ordered after: those that overlap it on
+  the disk and either of them writes the disk, or that overlap its buffer
+  and either of them writes the buffer.
+
+  @param  Volume                - FAT file system volume.
+  @param  Write                 - TRUE if the access writes the disk.
+  @param  Offset                - The starting byte offset on the disk.
+  @param  BufferSize            - Size of Buffer.
+  @param  Buffer                - The buffer of the access.
+
+**/
+VOID
+FatWaitNonblockingAccess (
+  IN FAT_VOLUME  *Volume,
+  IN BOOLEAN     Write,
+  IN UINT64      Offset,
+  IN UINTN       BufferSize,
+  IN VOID        *Buffer
+  )
+{
+  BOOLEAN  Blocked;
+
+  if (Volume->DispatchEvent == NULL) {
+    return;
+  }
+
+  for ( ; ;) {
+    EfiAcquireLock (&FatTaskLock);
+    Blocked = FatIsAccessBlocked (Volume, Write, Offset, BufferSize, Buffer, &Volume->DeferredSubtasks);
+    EfiReleaseLock (&FatTaskLock);
+    if (!Blocked) {
+      break;
+    }
+
+    //
+    // The caller may run at the TPL of DispatchEvent, so dispatch here,
+    // then let the accesses in flight complete
+    //
+    FatDispatchSubtasks (Volume);
+    CpuPause ();
+  }
 }
 
 /**
@@ -342,8 +628,9 @@ FatDiskIo (
       //
       if (Task == NULL) {
         //
-        // Blocking access
+        // Blocking access, after the non-blocking accesses it overlaps
         //
+        FatWaitNonblockingAccess (Volume, (BOOLEAN)(IoMode == WriteDisk), Offset, BufferSize, Buffer);
         DiskIo     = Volume->DiskIo;
         IoFunction = (IoMode == ReadDisk) ? DiskIo->ReadDisk : DiskIo->WriteDisk;
         Status     = IoFunction (DiskIo, Volume->MediaId, Offset, BufferSize, Buffer);
@@ -357,6 +644,7 @@ FatDiskIo (
         } else {
           Subtask->Signature  = FAT_SUBTASK_SIGNATURE;
           Subtask->Task       = Task;
+          Subtask->Volume     = Volume;
           Subtask->Write      = (BOOLEAN)(IoMode == WriteDisk);
           Subtask->Offset     = Offset;
           Subtask->Buffer     = Buffer;
@@ -461,13 +749,40 @@ FatFreeVolume (
   IN FAT_VOLUME  *Volume
   )
 {
+  BOOLEAN  Pending;
+
   //
-  // Free disk cache
+  // Wait for the non-blocking disk accesses, they may use the volume
+  // and the disk cache
+  //
+  if (Volume->DispatchEvent != NULL) {
+    for ( ; ;) {
+      FatDispatchSubtasks (Volume);
+      EfiAcquireLock (&FatTaskLock);
+      Pending = !IsListEmpty (&Volume->InFlightSubtasks) || !IsListEmpty (&Volume->DeferredSubtasks);
+      EfiReleaseLock (&FatTaskLock);
+      if (!Pending) {
+        break;
+      }
+
+      CpuPause ();
+    }
+
+    gBS->CloseEvent (Volume->DispatchEvent);
+  }
+
+  //
+  // Free disk cache, once the reads ahead into it are done
   //
   if (Volume->CacheBuffer != NULL) {
+    FatWaitCacheReadAhead (Volume);
     FreePool (Volume->CacheBuffer);
   }
 
+  if (Volume->FreeBitmap != NULL) {
+    FreePool (Volume->FreeBitmap);
+  }
+
   //
   // Free directory cache
   //
@@ -0,0 +1,382 @@
+/** @file
+  Host-based unit tests and benchmark for the directory entry hash tables of
+  the FAT driver.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <time.h>
+
+#include "../Fat.h"
+
+#include <Library/PrintLib.h>
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "FAT Directory Entry Hash Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define BENCHMARK_ENTRY_COUNT  100000
+#define SMALL_ENTRY_COUNT      20
+
+///
+/// The number of names compared by FatStriCmp()
+///
+STATIC UINT64  mNameCompares;
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+EFI_BOOT_SERVICES         *gBS = &mBootServices;
+
+/**
+  Computes the CRC32 of a buffer, as the boot service does.
+
+  @param  Data      The buffer.
+  @param  DataSize  The size of the buffer.
+  @param  Crc32     The CRC32 of the buffer.
+
+  @retval EFI_SUCCESS  The CRC32 was computed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCalculateCrc32 (
+  IN  VOID    *Data,
+  IN  UINTN   DataSize,
+  OUT UINT32  *Crc32
+  )
+{
+  *Crc32 = CalculateCrc32 (Data, DataSize);
+  return EFI_SUCCESS;
+}
+
+/**
+  Upper-cases the ASCII letters of a string, in place of the Unicode
+  collation protocol.
+
+  @param  String  The string to upper-case.
+
+**/
+VOID
+FatStrUpr (
+  IN OUT CHAR16  *String
+  )
+{
+  for ( ; *String != 0; String++) {
+    if ((*String >= L'a') && (*String <= L'z')) {
+      *String = (CHAR16)(*String - L'a' + L'A');
+    }
+  }
+}
+
+/**
+  Compares two strings ignoring the case of the ASCII letters, in place of
+  the Unicode collation protocol, and counts the comparisons.
+
+  @param  String1  The first string.
+  @param  String2  The second string.
+
+  @retval 0      The strings are the same.
+  @return other  The strings are different.
+
+**/
+INTN
+FatStriCmp (
+  IN CHAR16  *String1,
+  IN CHAR16  *String2
+  )
+{
+  CHAR16  Char1;
+  CHAR16  Char2;
+
+  mNameCompares++;
+  for ( ; ; String1++, String2++) {
+    Char1 = ((*String1 >= L'a') && (*String1 <= L'z')) ? (CHAR16)(*String1 - L'a' + L'A') : *String1;
+    Char2 = ((*String2 >= L'a') && (*String2 <= L'z')) ? (CHAR16)(*String2 - L'a' + L'A') : *String2;
+    if ((Char1 != Char2) || (Char1 == 0)) {
+      return (INTN)Char1 - (INTN)Char2;
+    }
+  }
+}
+
+/**
+  Creates the directory entries of a test directory and inserts them into
+  its hash tables.
+
+  @param  ODir        The directory, with initialized hash tables.
+  @param  EntryCount  The number of entries.
+
+  @return The entries, or NULL if they could not be allocated.
+
+**/
+STATIC
+FAT_DIRENT *
+CreateTestEntries (
+  IN FAT_ODIR  *ODir,
+  IN UINTN     EntryCount
+  )
+{
+  FAT_DIRENT  *DirEnts;
+  CHAR8       ShortName[FAT_NAME_LEN + 1];
+  UINTN       Index;
+
+  DirEnts = AllocateZeroPool (EntryCount * sizeof (FAT_DIRENT));
+  if (DirEnts == NULL) {
+    return NULL;
+  }
+
+  for (Index = 0; Index < EntryCount; Index++) {
+    DirEnts[Index].FileString = AllocatePool (32 * sizeof (CHAR16));
+    if (DirEnts[Index].FileString == NULL) {
+      return NULL;
+    }
+
+    UnicodeSPrint (DirEnts[Index].FileString, 32 * sizeof (CHAR16), L"CrashDump_%06d.log", Index);
+    AsciiSPrint (ShortName, sizeof (ShortName), "CRAS%04X%03d", Index & 0xFFFF, Index >> 16);
+    CopyMem (DirEnts[Index].Entry.FileName, ShortName, FAT_NAME_LEN);
+    FatInsertToHashTable (ODir, &DirEnts[Index]);
+  }
+
+  return DirEnts;
+}
+
+/**
+  Frees the entries and the hash tables of a test directory.
+
+  @param  ODir        The directory.
+  @param  DirEnts     The entries.
+  @param  EntryCount  The number of entries.
+
+**/
+STATIC
+VOID
+FreeTestEntries (
+  IN FAT_ODIR    *ODir,
+  IN FAT_DIRENT  *DirEnts,
+  IN UINTN       EntryCount
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < EntryCount; Index++) {
+    FreePool (DirEnts[Index].FileString);
+  }
+
+  FreePool (DirEnts);
+  FreePool (ODir->LongNameHashTable);
+  FreePool (ODir);
+}
+
+/**
+  Inserts 100k entries into a directory, looks each one up by its long name
+  in another case and by its short name, then deletes half of them.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             Every lookup found its entry.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A lookup failed.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+LargeDirectoryLookups (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  FAT_ODIR    *ODir;
+  FAT_DIRENT  *DirEnts;
+  FAT_DIRENT  *DirEnt;
+  CHAR16      Name[32];
+  UINTN       Index;
+  UINTN       Target;
+  UINT64      Compares;
+  clock_t     Start;
+  clock_t     Ticks;
+
+  ODir = AllocateZeroPool (sizeof (FAT_ODIR));
+  UT_ASSERT_NOT_NULL (ODir);
+  UT_ASSERT_NOT_EFI_ERROR (FatInitializeHashTable (ODir));
+
+  DirEnts = CreateTestEntries (ODir, BENCHMARK_ENTRY_COUNT);
+  UT_ASSERT_NOT_NULL (DirEnts);
+  UT_ASSERT_EQUAL (ODir->HashEntryCount, BENCHMARK_ENTRY_COUNT);
+  UT_ASSERT_EQUAL (ODir->HashTableSize, HASH_TABLE_MAX_SIZE);
+
+  Compares = mNameCompares;
+  Start    = clock ();
+  for (Index = 0; Index < BENCHMARK_ENTRY_COUNT; Index++) {
+    Target = (Index * 7919) % BENCHMARK_ENTRY_COUNT;
+    UnicodeSPrint (Name, sizeof (Name), L"CRASHDUMP_%06d.LOG", Target);
+    DirEnt = *FatLongNameHashSearch (ODir, Name);
+    UT_ASSERT_TRUE (DirEnt == &DirEnts[Target]);
+    DirEnt = *FatShortNameHashSearch (ODir, (CHAR8 *)DirEnts[Index].Entry.FileName);
+    UT_ASSERT_TRUE (DirEnt == &DirEnts[Index]);
+  }
+
+  Ticks    = clock () - Start;
+  Compares = mNameCompares - Compares;
+
+  UT_LOG_INFO (
+    "%d opens by name: %d ms, %d name compares per open, %d bytes of tables\n",
+    BENCHMARK_ENTRY_COUNT,
+    (INT32)((UINT64)Ticks * 1000 / CLOCKS_PER_SEC),
+    (INT32)DivU64x32 (Compares, BENCHMARK_ENTRY_COUNT),
+    (INT32)(ODir->HashTableSize * 2 * sizeof (FAT_DIRENT *))
+    );
+
+  //
+  // The saved hash values leave about one collation compare per lookup
+  //
+  UT_ASSERT_TRUE (Compares < 2 * BENCHMARK_ENTRY_COUNT);
+
+  for (Index = 0; Index < BENCHMARK_ENTRY_COUNT; Index += 2) {
+    FatDeleteFromHashTable (ODir, &DirEnts[Index]);
+  }
+
+  for (Index = 0; Index < BENCHMARK_ENTRY_COUNT; Index++) {
+    DirEnt = *FatLongNameHashSearch (ODir, DirEnts[Index].FileString);
+    UT_ASSERT_TRUE (DirEnt == (((Index & 1) != 0) ? &DirEnts[Index] : NULL));
+    DirEnt = *FatShortNameHashSearch (ODir, (CHAR8 *)DirEnts[Index].Entry.FileName);
+    UT_ASSERT_TRUE (DirEnt == (((Index & 1) != 0) ? &DirEnts[Index] : NULL));
+  }
+
+  UT_ASSERT_EQUAL (ODir->HashEntryCount, BENCHMARK_ENTRY_COUNT / 2);
+
+  FreeTestEntries (ODir, DirEnts, BENCHMARK_ENTRY_COUNT);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that the hash tables of a small directory stay small, and that
+  entries with the same long name are deleted one by one.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The tables are small and the lookups
+                                        are correct.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A check failed.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SmallDirectoryTables (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  FAT_ODIR    *ODir;
+  FAT_DIRENT  *DirEnts;
+  FAT_DIRENT  *DirEnt;
+
+  ODir = AllocateZeroPool (sizeof (FAT_ODIR));
+  UT_ASSERT_NOT_NULL (ODir);
+  UT_ASSERT_NOT_EFI_ERROR (FatInitializeHashTable (ODir));
+
+  DirEnts = CreateTestEntries (ODir, SMALL_ENTRY_COUNT);
+  UT_ASSERT_NOT_NULL (DirEnts);
+  UT_ASSERT_EQUAL (ODir->HashTableSize, HASH_TABLE_MIN_SIZE);
+
+  //
+  // A second entry with the name of the first one, as when a file is
+  // replaced, is found after it and unlinked by itself
+  //
+  StrCpyS (DirEnts[1].FileString, 32, DirEnts[0].FileString);
+  FatDeleteFromHashTable (ODir, &DirEnts[1]);
+  FatInsertToHashTable (ODir, &DirEnts[1]);
+
+  DirEnt = *FatLongNameHashSearch (ODir, L"crashdump_000000.LOG");
+  UT_ASSERT_TRUE ((DirEnt == &DirEnts[0]) || (DirEnt == &DirEnts[1]));
+  FatDeleteFromHashTable (ODir, DirEnt);
+  DirEnt = *FatLongNameHashSearch (ODir, L"crashdump_000000.LOG");
+  UT_ASSERT_TRUE ((DirEnt == &DirEnts[0]) || (DirEnt == &DirEnts[1]));
+  FatDeleteFromHashTable (ODir, DirEnt);
+  UT_ASSERT_TRUE (*FatLongNameHashSearch (ODir, L"crashdump_000000.LOG") == NULL);
+  UT_ASSERT_TRUE (*FatLongNameHashSearch (ODir, L"CrashDump_000002.log") == &DirEnts[2]);
+
+  FreeTestEntries (ODir, DirEnts, SMALL_ENTRY_COUNT);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the directory
+  entry hash tables and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      HashTests;
+
+  Framework                    = NULL;
+  mBootServices.CalculateCrc32 = TestCalculateCrc32;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&HashTests, Framework, "Directory Entry Hash Tests", "Fat.Hash", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Directory Entry Hash Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite--------Description------------------------------------------Name-------Function---------------Pre---Post---Context-----------
+  //
+  AddTestCase (HashTests, "100k entries are found by long and short name", "Large", LargeDirectoryLookups, NULL, NULL, NULL);
+  AddTestCase (HashTests, "Small directories keep the minimum tables", "Small", SmallDirectoryTables, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define DirentHashUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+DirentHashUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
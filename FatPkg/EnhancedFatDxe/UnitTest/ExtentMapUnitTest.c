@@ -0,0 +1,1062 @@
+/** @file
+  Host-based unit tests for the extent map of the cluster chains of open
+  files of the FAT driver, checked against running the cluster chain.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../Fat.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "FAT Extent Map Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_FAT_POS            SIZE_4KB
+#define TEST_CLUSTER_SIZE       512
+#define TEST_CLUSTER_ALIGNMENT  9
+#define TEST_MAX_CLUSTER        4000
+#define TEST_RUN_COUNT          100
+#define TEST_RUN_SPACING        16
+#define TEST_SEEK_COUNT         500
+
+///
+/// The disk, which holds the FATs only as the tests do not access the data
+///
+STATIC UINT8  *mDisk;
+
+///
+/// The volume of a test, its open file, and a twin of the file that is only
+/// seeked by running the cluster chain
+///
+STATIC FAT_VOLUME  *mVolume;
+STATIC FAT_OFILE   mOFile;
+STATIC FAT_OFILE   mTwin;
+
+///
+/// Globals of the driver modules the test does not link
+///
+EFI_LOCK           FatFsLock   = EFI_INITIALIZE_LOCK_VARIABLE (TPL_CALLBACK);
+EFI_LOCK           FatTaskLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
+EFI_BOOT_SERVICES  *gBS        = NULL;
+
+/**
+  Raises the task priority level to that of the lock and acquires it.
+
+  @param  Lock  The lock to acquire.
+
+**/
+VOID
+EFIAPI
+EfiAcquireLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockReleased);
+  Lock->Lock = EfiLockAcquired;
+}
+
+/**
+  Releases a lock.
+
+  @param  Lock  The lock to release.
+
+**/
+VOID
+EFIAPI
+EfiReleaseLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockAcquired);
+  Lock->Lock = EfiLockReleased;
+}
+
+/**
+  Returns the current task priority level.
+
+  @return TPL_CALLBACK while FatFsLock is held, TPL_APPLICATION otherwise.
+
+**/
+EFI_TPL
+EFIAPI
+EfiGetCurrentTpl (
+  VOID
+  )
+{
+  return (FatFsLock.Lock == EfiLockAcquired) ? TPL_CALLBACK : TPL_APPLICATION;
+}
+
+/**
+  Accesses the volume through the disk cache, or the disk in memory, as the
+  FatDiskIo() of the driver does.
+
+  @param  Volume      FAT file system volume.
+  @param  IoMode      The access mode.
+  @param  Offset      The starting byte offset to read from.
+  @param  BufferSize  Size of Buffer.
+  @param  Buffer      Buffer containing read data.
+  @param  Task        Point to task instance, not supported.
+
+  @retval EFI_SUCCESS           The operation is performed successfully.
+  @retval EFI_VOLUME_CORRUPTED  The access is out of the volume.
+
+**/
+EFI_STATUS
+FatDiskIo (
+  IN     FAT_VOLUME  *Volume,
+  IN     IO_MODE     IoMode,
+  IN     UINT64      Offset,
+  IN     UINTN       BufferSize,
+  IN OUT VOID        *Buffer,
+  IN     FAT_TASK    *Task
+  )
+{
+  ASSERT (Task == NULL);
+
+  if (Offset + BufferSize > Volume->VolumeSize) {
+    Volume->DiskError = TRUE;
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  if (CACHE_ENABLED (IoMode)) {
+    return FatAccessCache (Volume, CACHE_TYPE (IoMode), RAW_ACCESS (IoMode), Offset, BufferSize, Buffer, Task);
+  }
+
+  if (IoMode == ReadDisk) {
+    CopyMem (Buffer, mDisk + Offset, BufferSize);
+  } else {
+    CopyMem (mDisk + Offset, Buffer, BufferSize);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Waits for the non-blocking accesses that overlap an access, there are none.
+
+  @param  Volume      FAT file system volume.
+  @param  Write       TRUE for a write.
+  @param  Offset      The starting byte offset of the access.
+  @param  BufferSize  Size of the access.
+  @param  Buffer      Buffer of the access.
+
+**/
+VOID
+FatWaitNonblockingAccess (
+  IN FAT_VOLUME  *Volume,
+  IN BOOLEAN     Write,
+  IN UINT64      Offset,
+  IN UINTN       BufferSize,
+  IN VOID        *Buffer
+  )
+{
+}
+
+/**
+  Sets the dirty state of the volume, which the test does not track.
+
+  @param  Volume     FAT file system volume.
+  @param  IoMode     The access mode.
+  @param  DirtyValue Set the volume as dirty or not.
+
+  @retval EFI_SUCCESS  The dirty state is set.
+
+**/
+EFI_STATUS
+FatAccessVolumeDirty (
+  IN FAT_VOLUME  *Volume,
+  IN IO_MODE     IoMode,
+  IN VOID        *DirtyValue
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @param  Seed  The generator state.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  IN OUT UINT32  *Seed
+  )
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return (*Seed >> 8);
+}
+
+/**
+  Reads a FAT entry through the FAT cache.
+
+  @param  Index  The index of the FAT entry.
+
+  @return The value of the FAT entry, with FAT_CLUSTER_SPECIAL_EXT set for
+          the special values.
+
+**/
+STATIC
+UINTN
+GetTestFatEntry (
+  IN UINTN  Index
+  )
+{
+  UINT32  Value;
+
+  Value = 0;
+  FatDiskIo (mVolume, ReadFat, mVolume->FatPos + Index * sizeof (UINT32), sizeof (UINT32), &Value, NULL);
+  Value &= FAT_CLUSTER_MASK_FAT32;
+  return (Value >= FAT_CLUSTER_SPECIAL_FAT32) ? (Value | FAT_CLUSTER_SPECIAL_EXT) : Value;
+}
+
+/**
+  Writes a FAT entry through the FAT cache.
+
+  @param  Index  The index of the FAT entry.
+  @param  Value  The value of the FAT entry.
+
+**/
+STATIC
+VOID
+SetTestFatEntry (
+  IN UINTN   Index,
+  IN UINT32  Value
+  )
+{
+  FatDiskIo (mVolume, WriteFat, mVolume->FatPos + Index * sizeof (UINT32), sizeof (UINT32), &Value, NULL);
+}
+
+/**
+  Counts the free clusters in the FAT.
+
+  @return The number of free clusters.
+
+**/
+STATIC
+UINTN
+CountTestFreeClusters (
+  VOID
+  )
+{
+  UINTN  Index;
+  UINTN  Count;
+
+  Count = 0;
+  for (Index = FAT_MIN_CLUSTER; Index < mVolume->MaxCluster + 2; Index++) {
+    if (GetTestFatEntry (Index) == FAT_CLUSTER_FREE) {
+      Count++;
+    }
+  }
+
+  return Count;
+}
+
+/**
+  Creates an empty FAT32 volume, with the FAT cache, the free cluster
+  bitmap not built yet, and the volume lock held.
+
+  @param  MaxCluster  The number of data clusters.
+
+  @retval TRUE   The volume is created.
+  @retval FALSE  Out of resources.
+
+**/
+STATIC
+BOOLEAN
+CreateTestVolume (
+  IN UINTN  MaxCluster
+  )
+{
+  mVolume = AllocateZeroPool (sizeof (FAT_VOLUME));
+  if (mVolume == NULL) {
+    return FALSE;
+  }
+
+  mVolume->Signature        = FAT_VOLUME_SIGNATURE;
+  mVolume->FatType          = Fat32;
+  mVolume->FatEntrySize     = sizeof (UINT32);
+  mVolume->MaxCluster       = MaxCluster;
+  mVolume->NumFats          = 2;
+  mVolume->FatPos           = TEST_FAT_POS;
+  mVolume->FatSize          = ALIGN_VALUE ((MaxCluster + 2) * sizeof (UINT32), 512);
+  mVolume->RootPos          = mVolume->FatPos + mVolume->NumFats * mVolume->FatSize;
+  mVolume->FirstClusterPos  = mVolume->RootPos;
+  mVolume->VolumeSize       = mVolume->RootPos;
+  mVolume->ClusterSize      = TEST_CLUSTER_SIZE;
+  mVolume->ClusterAlignment = TEST_CLUSTER_ALIGNMENT;
+
+  mVolume->FatInfoSector.FreeInfo.NextCluster = FAT_MIN_CLUSTER;
+
+  mDisk = AllocateZeroPool ((UINTN)mVolume->VolumeSize);
+  if ((mDisk == NULL) || EFI_ERROR (FatInitializeDiskCache (mVolume))) {
+    return FALSE;
+  }
+
+  SetTestFatEntry (0, 0x0FFFFFF8);
+  SetTestFatEntry (1, 0x0FFFFFFF);
+
+  ZeroMem (&mOFile, sizeof (mOFile));
+  ZeroMem (&mTwin, sizeof (mTwin));
+  mOFile.Signature = FAT_OFILE_SIGNATURE;
+  mOFile.Volume    = mVolume;
+
+  EfiAcquireLock (&FatFsLock);
+  return TRUE;
+}
+
+/**
+  Frees the volume of a test and the extent map of its file.
+
+  @param[in]  Context  Unused.
+
+**/
+STATIC
+VOID
+EFIAPI
+FreeTestVolume (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  if (FatFsLock.Lock == EfiLockAcquired) {
+    EfiReleaseLock (&FatFsLock);
+  }
+
+  if (mOFile.Extents != NULL) {
+    FreePool (mOFile.Extents);
+  }
+
+  if (mVolume != NULL) {
+    if (mVolume->FreeBitmap != NULL) {
+      FreePool (mVolume->FreeBitmap);
+    }
+
+    if (mVolume->CacheBuffer != NULL) {
+      FreePool (mVolume->CacheBuffer);
+    }
+
+    FreePool (mVolume);
+  }
+
+  if (mDisk != NULL) {
+    FreePool (mDisk);
+  }
+
+  ZeroMem (&mOFile, sizeof (mOFile));
+  mVolume = NULL;
+  mDisk   = NULL;
+}
+
+/**
+  Chains clusters in the FAT and makes them the clusters of the open file.
+
+  @param  Clusters  The clusters of the file.
+  @param  Count     The number of clusters.
+  @param  FileSize  The size of the file, in its last cluster.
+
+**/
+STATIC
+VOID
+BuildTestChain (
+  IN UINTN  *Clusters,
+  IN UINTN  Count,
+  IN UINTN  FileSize
+  )
+{
+  UINTN  Index;
+
+  ASSERT ((FileSize + TEST_CLUSTER_SIZE - 1) / TEST_CLUSTER_SIZE == Count);
+
+  for (Index = 0; Index < Count; Index++) {
+    SetTestFatEntry (Clusters[Index], (Index + 1 < Count) ? (UINT32)Clusters[Index + 1] : 0x0FFFFFFF);
+  }
+
+  mOFile.FileCluster        = (Count != 0) ? Clusters[0] : FAT_CLUSTER_FREE;
+  mOFile.FileCurrentCluster = mOFile.FileCluster;
+  mOFile.FileLastCluster    = FAT_CLUSTER_FREE;
+  mOFile.FileSize           = FileSize;
+}
+
+/**
+  Builds a file of runs of random lengths, placed on the volume in a random
+  order, with free clusters between them.
+
+  @param  RunCount  The number of runs.
+  @param  Seed      The generator state.
+  @param  Runs      The first cluster of each run in the file.
+  @param  Lengths   The length of each run.
+
+  @return The number of clusters of the file.
+
+**/
+STATIC
+UINTN
+BuildFragmentedTestFile (
+  IN     UINTN   RunCount,
+  IN OUT UINT32  *Seed,
+  OUT    UINTN   *Runs,
+  OUT    UINTN   *Lengths
+  )
+{
+  UINTN  *Clusters;
+  UINTN  Count;
+  UINTN  Run;
+  UINTN  Index;
+  UINTN  Swap;
+
+  for (Run = 0; Run < RunCount; Run++) {
+    Runs[Run]    = FAT_MIN_CLUSTER + Run * TEST_RUN_SPACING;
+    Lengths[Run] = 1 + NextRandom (Seed) % (TEST_RUN_SPACING / 2);
+  }
+
+  for (Run = RunCount - 1; Run > 0; Run--) {
+    Index       = NextRandom (Seed) % (Run + 1);
+    Swap        = Runs[Run];
+    Runs[Run]   = Runs[Index];
+    Runs[Index] = Swap;
+  }
+
+  Clusters = AllocatePool (RunCount * TEST_RUN_SPACING * sizeof (UINTN));
+  ASSERT (Clusters != NULL);
+  Count = 0;
+  for (Run = 0; Run < RunCount; Run++) {
+    for (Index = 0; Index < Lengths[Run]; Index++) {
+      Clusters[Count++] = Runs[Run] + Index;
+    }
+  }
+
+  BuildTestChain (Clusters, Count, Count * TEST_CLUSTER_SIZE - NextRandom (Seed) % TEST_CLUSTER_SIZE);
+  FreePool (Clusters);
+  return Count;
+}
+
+/**
+  Checks the extent map of the open file against its cluster chain: the
+  extents follow each other in the file, adjacent runs are merged, and the
+  chain holds as many clusters as the file size needs.
+
+  @retval TRUE   The extent map matches the chain.
+  @retval FALSE  It does not.
+
+**/
+STATIC
+BOOLEAN
+IsTestExtentMapValid (
+  VOID
+  )
+{
+  FAT_EXTENT  *Extent;
+  UINTN       ExtentIndex;
+  UINTN       FileCluster;
+  UINTN       Cluster;
+  UINTN       Index;
+  UINTN       Count;
+
+  Cluster     = mOFile.FileCluster;
+  FileCluster = 0;
+  for (ExtentIndex = 0; ExtentIndex < mOFile.ExtentCount; ExtentIndex++) {
+    Extent = &mOFile.Extents[ExtentIndex];
+    if ((Extent->FileCluster != FileCluster) || (Extent->Count == 0)) {
+      return FALSE;
+    }
+
+    if ((ExtentIndex > 0) && (Extent[-1].Cluster + Extent[-1].Count == Extent->Cluster)) {
+      return FALSE;
+    }
+
+    for (Index = 0; Index < Extent->Count; Index++) {
+      if (Cluster != Extent->Cluster + Index) {
+        return FALSE;
+      }
+
+      Cluster = GetTestFatEntry (Cluster);
+    }
+
+    FileCluster += Extent->Count;
+  }
+
+  if (FileCluster != mOFile.MappedClusterCount) {
+    return FALSE;
+  }
+
+  Count   = 0;
+  Cluster = mOFile.FileCluster;
+  while ((Cluster != FAT_CLUSTER_FREE) && !FAT_END_OF_FAT_CHAIN (Cluster)) {
+    Count++;
+    Cluster = GetTestFatEntry (Cluster);
+  }
+
+  return (BOOLEAN)(Count == (mOFile.FileSize + TEST_CLUSTER_SIZE - 1) / TEST_CLUSTER_SIZE);
+}
+
+/**
+  Seeks the open file with its extent map and its twin by running the
+  cluster chain, and checks that they agree.
+
+  @param  Position  The file's position which will be accessed.
+  @param  PosLimit  The maximum length current reading/writing may access.
+
+  @retval TRUE   The two agree.
+  @retval FALSE  They do not.
+
+**/
+STATIC
+BOOLEAN
+IsTestPositionValid (
+  IN UINTN  Position,
+  IN UINTN  PosLimit
+  )
+{
+  if (mTwin.FileCluster != mOFile.FileCluster) {
+    mTwin.Volume             = mVolume;
+    mTwin.FileCluster        = mOFile.FileCluster;
+    mTwin.FileCurrentCluster = mOFile.FileCluster;
+    mTwin.Position           = 0;
+  }
+
+  if (EFI_ERROR (FatOFilePosition (&mOFile, Position, PosLimit)) ||
+      EFI_ERROR (FatWalkOFilePosition (&mTwin, Position, PosLimit)))
+  {
+    return FALSE;
+  }
+
+  //
+  // Past PosLimit, the extent map may know of more consecutive clusters
+  //
+  return (BOOLEAN)((mOFile.PosDisk == mTwin.PosDisk) &&
+                   (mOFile.Position == mTwin.Position) &&
+                   (mOFile.FileCurrentCluster == mTwin.FileCurrentCluster) &&
+                   (MIN (mOFile.PosRem, PosLimit) == MIN (mTwin.PosRem, PosLimit)));
+}
+
+/**
+  A contiguous chain is mapped as one extent, and seeks to the first and
+  last bytes of each cluster match running the chain.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The file is mapped as one extent.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ContiguousChainIsOneExtent (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Clusters[40];
+  UINTN  Index;
+
+  UT_ASSERT_TRUE (CreateTestVolume (TEST_MAX_CLUSTER));
+  for (Index = 0; Index < ARRAY_SIZE (Clusters); Index++) {
+    Clusters[Index] = 100 + Index;
+  }
+
+  BuildTestChain (Clusters, ARRAY_SIZE (Clusters), ARRAY_SIZE (Clusters) * TEST_CLUSTER_SIZE - 100);
+
+  //
+  // A short access maps only the clusters it needs
+  //
+  UT_ASSERT_TRUE (IsTestPositionValid (0, 1));
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 1);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, 1);
+
+  //
+  // A long access maps the run up to the file size
+  //
+  UT_ASSERT_TRUE (IsTestPositionValid (10, mOFile.FileSize - 10));
+  UT_ASSERT_EQUAL (mOFile.PosRem, ARRAY_SIZE (Clusters) * TEST_CLUSTER_SIZE - 10);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, ARRAY_SIZE (Clusters));
+
+  for (Index = 0; Index < ARRAY_SIZE (Clusters); Index++) {
+    UT_ASSERT_TRUE (IsTestPositionValid (Index * TEST_CLUSTER_SIZE, 1));
+    UT_ASSERT_TRUE (IsTestPositionValid (MIN ((Index + 1) * TEST_CLUSTER_SIZE, mOFile.FileSize) - 1, mOFile.FileSize));
+  }
+
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 1);
+  UT_ASSERT_EQUAL (mOFile.Extents[0].Cluster, 100);
+  UT_ASSERT_EQUAL (mOFile.Extents[0].Count, ARRAY_SIZE (Clusters));
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A fragmented chain is mapped as one extent per run, and seeks forward and
+  backward, at the run boundaries and at random, match running the chain.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The file is mapped run by run.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+FragmentedChainIsMappedByRun (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN   Runs[TEST_RUN_COUNT];
+  UINTN   Lengths[TEST_RUN_COUNT];
+  UINTN   Count;
+  UINTN   Run;
+  UINTN   Start;
+  UINTN   Position;
+  UINTN   Index;
+  UINT32  Seed;
+
+  Seed = 3;
+  UT_ASSERT_TRUE (CreateTestVolume (TEST_MAX_CLUSTER));
+  Count = BuildFragmentedTestFile (TEST_RUN_COUNT, &Seed, Runs, Lengths);
+
+  //
+  // Backward from the end, so the whole file is mapped by the first seek
+  //
+  Start = Count * TEST_CLUSTER_SIZE;
+  for (Run = TEST_RUN_COUNT; Run > 0; Run--) {
+    Start -= Lengths[Run - 1] * TEST_CLUSTER_SIZE;
+    UT_ASSERT_TRUE (IsTestPositionValid (Start, Lengths[Run - 1] * TEST_CLUSTER_SIZE));
+    UT_ASSERT_EQUAL (mOFile.PosRem, Lengths[Run - 1] * TEST_CLUSTER_SIZE);
+    if (Start > 0) {
+      UT_ASSERT_TRUE (IsTestPositionValid (Start - 1, SIZE_64KB));
+      UT_ASSERT_EQUAL (mOFile.PosRem, 1);
+    }
+  }
+
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, TEST_RUN_COUNT);
+  UT_ASSERT_TRUE (mOFile.MaxExtentCount >= TEST_RUN_COUNT);
+  for (Run = 0; Run < TEST_RUN_COUNT; Run++) {
+    UT_ASSERT_EQUAL (mOFile.Extents[Run].Cluster, Runs[Run]);
+    UT_ASSERT_EQUAL (mOFile.Extents[Run].Count, Lengths[Run]);
+  }
+
+  for (Index = 0; Index < TEST_SEEK_COUNT; Index++) {
+    Position = NextRandom (&Seed) % mOFile.FileSize;
+    UT_ASSERT_TRUE (IsTestPositionValid (Position, 1 + NextRandom (&Seed) % (mOFile.FileSize - Position)));
+  }
+
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Growing a file keeps its extent map complete if it covers the whole file,
+  merging a new run that follows the last extent, and leaves a partial map
+  as it is.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The extent map follows the growth.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It does not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+GrowExtendsTheMap (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN   Runs[8];
+  UINTN   Lengths[8];
+  UINTN   Count;
+  UINTN   ExtentCount;
+  UINTN   Position;
+  UINTN   Index;
+  UINT32  Seed;
+
+  Seed = 5;
+  UT_ASSERT_TRUE (CreateTestVolume (TEST_MAX_CLUSTER));
+
+  //
+  // A fully mapped fragmented file grows in place, into its last extent
+  //
+  Count = BuildFragmentedTestFile (ARRAY_SIZE (Runs), &Seed, Runs, Lengths);
+  UT_ASSERT_TRUE (IsTestPositionValid (mOFile.FileSize - 1, 1));
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Count);
+  ExtentCount = mOFile.ExtentCount;
+
+  UT_ASSERT_NOT_EFI_ERROR (FatGrowEof (&mOFile, (Count + 3) * TEST_CLUSTER_SIZE));
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Count + 3);
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, ExtentCount);
+  UT_ASSERT_EQUAL (mOFile.Extents[ExtentCount - 1].Count, Lengths[ARRAY_SIZE (Runs) - 1] + 3);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  //
+  // Growing past the free clusters after the last run, unless it is the
+  // last on the volume, adds extents
+  //
+  UT_ASSERT_NOT_EFI_ERROR (FatGrowEof (&mOFile, (Count + 3 + 2 * TEST_RUN_SPACING) * TEST_CLUSTER_SIZE));
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Count + 3 + 2 * TEST_RUN_SPACING);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  //
+  // A partial map is left partial, the grown clusters are mapped on seek
+  //
+  FreePool (mOFile.Extents);
+  mOFile.Extents            = NULL;
+  mOFile.ExtentCount        = 0;
+  mOFile.MaxExtentCount     = 0;
+  mOFile.MappedClusterCount = 0;
+  UT_ASSERT_TRUE (IsTestPositionValid (0, 1));
+  Count = mOFile.MappedClusterCount;
+  UT_ASSERT_NOT_EFI_ERROR (FatGrowEof (&mOFile, mOFile.FileSize + 20 * TEST_CLUSTER_SIZE));
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Count);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  for (Index = 0; Index < TEST_SEEK_COUNT; Index++) {
+    Position = NextRandom (&Seed) % mOFile.FileSize;
+    UT_ASSERT_TRUE (IsTestPositionValid (Position, 1 + NextRandom (&Seed) % (mOFile.FileSize - Position)));
+  }
+
+  UT_ASSERT_TRUE (IsTestPositionValid (mOFile.FileSize - 1, 1));
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, mOFile.FileSize / TEST_CLUSTER_SIZE);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+  UT_ASSERT_EQUAL (mVolume->FatInfoSector.FreeInfo.ClusterCount, CountTestFreeClusters ());
+
+  //
+  // An empty file grows into a map of one extent, on the volume freed by
+  // shrinking the file to zero
+  //
+  mOFile.FileSize = 0;
+  UT_ASSERT_NOT_EFI_ERROR (FatShrinkEof (&mOFile));
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 0);
+  UT_ASSERT_NOT_EFI_ERROR (FatGrowEof (&mOFile, 10 * TEST_CLUSTER_SIZE));
+  UT_ASSERT_EQUAL (mOFile.FileCluster, FAT_MIN_CLUSTER);
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 1);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, 10);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+  UT_ASSERT_TRUE (IsTestPositionValid (9 * TEST_CLUSTER_SIZE, 1));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Growing a file past the free clusters of the volume fails, and gives back
+  the clusters it allocated: the chain and the extent map are the ones the
+  file had.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The file is rolled back.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+FailedGrowRollsBack (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN       Runs[TEST_RUN_COUNT];
+  UINTN       Lengths[TEST_RUN_COUNT];
+  FAT_EXTENT  *Extents;
+  UINTN       ExtentCount;
+  UINTN       Count;
+  UINTN       FileSize;
+  UINTN       FreeCount;
+  UINT32      Seed;
+
+  Seed = 9;
+  UT_ASSERT_TRUE (CreateTestVolume (TEST_RUN_COUNT * TEST_RUN_SPACING));
+  Count    = BuildFragmentedTestFile (TEST_RUN_COUNT, &Seed, Runs, Lengths);
+  FileSize = mOFile.FileSize;
+  UT_ASSERT_TRUE (IsTestPositionValid (FileSize - 1, 1));
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Count);
+
+  ExtentCount = mOFile.ExtentCount;
+  Extents     = AllocateCopyPool (ExtentCount * sizeof (FAT_EXTENT), mOFile.Extents);
+  UT_ASSERT_NOT_NULL (Extents);
+  FreeCount = CountTestFreeClusters ();
+
+  //
+  // The file is on most of the volume, it can not grow by the free clusters
+  // plus one
+  //
+  UT_ASSERT_STATUS_EQUAL (FatGrowEof (&mOFile, FileSize + (FreeCount + 1) * TEST_CLUSTER_SIZE), EFI_VOLUME_FULL);
+  UT_ASSERT_EQUAL (mOFile.FileSize, FileSize);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Count);
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, ExtentCount);
+  UT_ASSERT_MEM_EQUAL (mOFile.Extents, Extents, ExtentCount * sizeof (FAT_EXTENT));
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+  UT_ASSERT_EQUAL (CountTestFreeClusters (), FreeCount);
+  UT_ASSERT_EQUAL (mVolume->FatInfoSector.FreeInfo.ClusterCount, FreeCount);
+  UT_ASSERT_TRUE (IsTestPositionValid (FileSize - 1, SIZE_64KB));
+
+  //
+  // An empty file that can not grow stays empty
+  //
+  mOFile.FileSize = 0;
+  UT_ASSERT_NOT_EFI_ERROR (FatShrinkEof (&mOFile));
+  FreeCount = CountTestFreeClusters ();
+  UT_ASSERT_STATUS_EQUAL (FatGrowEof (&mOFile, (FreeCount + 1) * TEST_CLUSTER_SIZE), EFI_VOLUME_FULL);
+  UT_ASSERT_EQUAL (mOFile.FileSize, 0);
+  UT_ASSERT_EQUAL (mOFile.FileCluster, FAT_CLUSTER_FREE);
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 0);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, 0);
+  UT_ASSERT_EQUAL (CountTestFreeClusters (), FreeCount);
+
+  //
+  // And then grows into all of the volume
+  //
+  UT_ASSERT_NOT_EFI_ERROR (FatGrowEof (&mOFile, FreeCount * TEST_CLUSTER_SIZE));
+  UT_ASSERT_EQUAL (CountTestFreeClusters (), 0);
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 1);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  FreePool (Extents);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Shrinking a file in the middle of an extent, at an extent boundary, past
+  the end of a partial map, and to zero, trims the extent map and frees the
+  clusters past the end.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The extent map follows the shrink.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It does not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ShrinkTrimsTheMap (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN   Runs[TEST_RUN_COUNT];
+  UINTN   Lengths[TEST_RUN_COUNT];
+  UINTN   Count;
+  UINTN   Run;
+  UINTN   Start;
+  UINTN   FreeCount;
+  UINT32  Seed;
+
+  Seed = 17;
+  UT_ASSERT_TRUE (CreateTestVolume (TEST_MAX_CLUSTER));
+  Count = BuildFragmentedTestFile (TEST_RUN_COUNT, &Seed, Runs, Lengths);
+  UT_ASSERT_TRUE (IsTestPositionValid (mOFile.FileSize - 1, 1));
+  FreeCount = CountTestFreeClusters ();
+
+  //
+  // In the middle of an extent: find a run of more than two clusters past
+  // the middle of the file, and keep its first cluster and some of the second
+  //
+  Start = 0;
+  for (Run = 0; (Run < TEST_RUN_COUNT / 2) || (Lengths[Run] < 3); Run++) {
+    Start += Lengths[Run];
+  }
+
+  mOFile.FileSize = (Start + 1) * TEST_CLUSTER_SIZE + 10;
+  UT_ASSERT_NOT_EFI_ERROR (FatShrinkEof (&mOFile));
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, Run + 1);
+  UT_ASSERT_EQUAL (mOFile.Extents[Run].Count, 2);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Start + 2);
+  UT_ASSERT_EQUAL (GetTestFatEntry (Runs[Run] + 1), (UINTN)FAT_CLUSTER_LAST);
+  UT_ASSERT_EQUAL (CountTestFreeClusters (), FreeCount + Count - (Start + 2));
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+  UT_ASSERT_TRUE (IsTestPositionValid (mOFile.FileSize - 1, SIZE_64KB));
+  UT_ASSERT_TRUE (IsTestPositionValid (Start * TEST_CLUSTER_SIZE, SIZE_64KB));
+  UT_ASSERT_EQUAL (mOFile.PosRem, 2 * TEST_CLUSTER_SIZE);
+
+  //
+  // At the end of the extent before
+  //
+  mOFile.FileSize = Start * TEST_CLUSTER_SIZE;
+  UT_ASSERT_NOT_EFI_ERROR (FatShrinkEof (&mOFile));
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, Run);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Start);
+  UT_ASSERT_EQUAL (CountTestFreeClusters (), FreeCount + Count - Start);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+  UT_ASSERT_TRUE (IsTestPositionValid (mOFile.FileSize - 1, SIZE_64KB));
+
+  //
+  // Past the end of a partial map, which is left as it is
+  //
+  mOFile.ExtentCount        = 1;
+  mOFile.MappedClusterCount = Lengths[0];
+  mOFile.FileSize           = (Start - 2) * TEST_CLUSTER_SIZE + 1;
+  UT_ASSERT_NOT_EFI_ERROR (FatShrinkEof (&mOFile));
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 1);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, Lengths[0]);
+  UT_ASSERT_EQUAL (CountTestFreeClusters (), FreeCount + Count - (Start - 1));
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+  UT_ASSERT_TRUE (IsTestPositionValid (mOFile.FileSize - 1, SIZE_64KB));
+
+  //
+  // To zero
+  //
+  mOFile.FileSize = 0;
+  UT_ASSERT_NOT_EFI_ERROR (FatShrinkEof (&mOFile));
+  UT_ASSERT_EQUAL (mOFile.FileCluster, FAT_CLUSTER_FREE);
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, 0);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, 0);
+  UT_ASSERT_EQUAL (CountTestFreeClusters (), FreeCount + Count);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A file of more runs than an extent map may hold is seeked past the end of
+  its map by running the cluster chain.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The seeks match running the chain.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They do not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+FullMapFallsBackToWalk (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN   *Clusters;
+  UINTN   Count;
+  UINTN   Index;
+  UINTN   Position;
+  UINT32  Seed;
+
+  Seed  = 23;
+  Count = FAT_EXTENT_MAP_MAX_COUNT + 100;
+  UT_ASSERT_TRUE (CreateTestVolume (2 * Count + 2));
+
+  //
+  // Every other cluster, so that each cluster is an extent
+  //
+  Clusters = AllocatePool (Count * sizeof (UINTN));
+  UT_ASSERT_NOT_NULL (Clusters);
+  for (Index = 0; Index < Count; Index++) {
+    Clusters[Index] = FAT_MIN_CLUSTER + 2 * Index;
+  }
+
+  BuildTestChain (Clusters, Count, Count * TEST_CLUSTER_SIZE);
+  FreePool (Clusters);
+
+  UT_ASSERT_TRUE (IsTestPositionValid (mOFile.FileSize - 1, 1));
+  UT_ASSERT_EQUAL (mOFile.ExtentCount, FAT_EXTENT_MAP_MAX_COUNT);
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, FAT_EXTENT_MAP_MAX_COUNT);
+
+  for (Index = 0; Index < TEST_SEEK_COUNT / 10; Index++) {
+    Position = NextRandom (&Seed) % mOFile.FileSize;
+    UT_ASSERT_TRUE (IsTestPositionValid (Position, 1 + NextRandom (&Seed) % (mOFile.FileSize - Position)));
+  }
+
+  for (Index = FAT_EXTENT_MAP_MAX_COUNT - 2; Index < Count; Index++) {
+    UT_ASSERT_TRUE (IsTestPositionValid (Index * TEST_CLUSTER_SIZE + Index % TEST_CLUSTER_SIZE, SIZE_4KB));
+  }
+
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  //
+  // Shrinking into the map makes it cover the whole file again
+  //
+  mOFile.FileSize = (FAT_EXTENT_MAP_MAX_COUNT - 50) * TEST_CLUSTER_SIZE;
+  UT_ASSERT_NOT_EFI_ERROR (FatShrinkEof (&mOFile));
+  UT_ASSERT_EQUAL (mOFile.MappedClusterCount, FAT_EXTENT_MAP_MAX_COUNT - 50);
+  UT_ASSERT_TRUE (IsTestExtentMapValid ());
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the extent
+  map and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      ExtentTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&ExtentTests, Framework, "Extent Map Tests", "Fat.ExtentMap", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Extent Map Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite-----------Description---------------------------------Name-------------Function----------------------Pre---Post------------Context
+  //
+  AddTestCase (ExtentTests, "Contiguous chain is one extent", "Contiguous", ContiguousChainIsOneExtent, NULL, FreeTestVolume, NULL);
+  AddTestCase (ExtentTests, "Fragmented chain is mapped by run", "Fragmented", FragmentedChainIsMappedByRun, NULL, FreeTestVolume, NULL);
+  AddTestCase (ExtentTests, "Grow extends the map", "Grow", GrowExtendsTheMap, NULL, FreeTestVolume, NULL);
+  AddTestCase (ExtentTests, "Failed grow rolls back", "GrowFailure", FailedGrowRollsBack, NULL, FreeTestVolume, NULL);
+  AddTestCase (ExtentTests, "Shrink trims the map", "Shrink", ShrinkTrimsTheMap, NULL, FreeTestVolume, NULL);
+  AddTestCase (ExtentTests, "Full map falls back to running the chain", "FullMap", FullMapFallsBackToWalk, NULL, FreeTestVolume, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define ExtentMapUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+ExtentMapUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -0,0 +1,437 @@
+/** @file
+  Host-based unit tests for the free cluster bitmap of the FAT driver, built
+  through the disk cache from FATs larger than a FAT cache page.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../Fat.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "FAT Free Cluster Bitmap Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_FAT_POS     SIZE_4KB
+#define TEST_DATA_SIZE   SIZE_1MB
+#define TEST_DIRTY_RUNS  64
+
+///
+/// The disk and the FAT the tests check the bitmap against
+///
+STATIC UINT8  *mDisk;
+STATIC UINT8  *mFat;
+
+///
+/// Globals of the driver modules the test does not link
+///
+EFI_LOCK           FatFsLock   = EFI_INITIALIZE_LOCK_VARIABLE (TPL_CALLBACK);
+EFI_LOCK           FatTaskLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
+EFI_BOOT_SERVICES  *gBS        = NULL;
+
+/**
+  Raises the task priority level to that of the lock and acquires it.
+
+  @param  Lock  The lock to acquire.
+
+**/
+VOID
+EFIAPI
+EfiAcquireLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockReleased);
+  Lock->Lock = EfiLockAcquired;
+}
+
+/**
+  Releases a lock.
+
+  @param  Lock  The lock to release.
+
+**/
+VOID
+EFIAPI
+EfiReleaseLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockAcquired);
+  Lock->Lock = EfiLockReleased;
+}
+
+/**
+  Returns the current task priority level.
+
+  @return TPL_CALLBACK while FatFsLock is held, TPL_APPLICATION otherwise.
+
+**/
+EFI_TPL
+EFIAPI
+EfiGetCurrentTpl (
+  VOID
+  )
+{
+  return (FatFsLock.Lock == EfiLockAcquired) ? TPL_CALLBACK : TPL_APPLICATION;
+}
+
+/**
+  Accesses the volume through the disk cache, or the disk in memory, as the
+  FatDiskIo() of the driver does.
+
+  @param  Volume      FAT file system volume.
+  @param  IoMode      The access mode.
+  @param  Offset      The starting byte offset to read from.
+  @param  BufferSize  Size of Buffer.
+  @param  Buffer      Buffer containing read data.
+  @param  Task        Point to task instance, not supported.
+
+  @retval EFI_SUCCESS           The operation is performed successfully.
+  @retval EFI_VOLUME_CORRUPTED  The access is out of the volume.
+
+**/
+EFI_STATUS
+FatDiskIo (
+  IN     FAT_VOLUME  *Volume,
+  IN     IO_MODE     IoMode,
+  IN     UINT64      Offset,
+  IN     UINTN       BufferSize,
+  IN OUT VOID        *Buffer,
+  IN     FAT_TASK    *Task
+  )
+{
+  ASSERT (Task == NULL);
+
+  if (Offset + BufferSize > Volume->VolumeSize) {
+    Volume->DiskError = TRUE;
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  if (CACHE_ENABLED (IoMode)) {
+    return FatAccessCache (Volume, CACHE_TYPE (IoMode), RAW_ACCESS (IoMode), Offset, BufferSize, Buffer, Task);
+  }
+
+  if (IoMode == ReadDisk) {
+    CopyMem (Buffer, mDisk + Offset, BufferSize);
+  } else {
+    CopyMem (mDisk + Offset, Buffer, BufferSize);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Waits for the non-blocking accesses that overlap an access, there are none.
+
+  @param  Volume      FAT file system volume.
+  @param  Write       TRUE for a write.
+  @param  Offset      The starting byte offset of the access.
+  @param  BufferSize  Size of the access.
+  @param  Buffer      Buffer of the access.
+
+**/
+VOID
+FatWaitNonblockingAccess (
+  IN FAT_VOLUME  *Volume,
+  IN BOOLEAN     Write,
+  IN UINT64      Offset,
+  IN UINTN       BufferSize,
+  IN VOID        *Buffer
+  )
+{
+}
+
+/**
+  Sets the dirty state of the volume, which the test does not track.
+
+  @param  Volume     FAT file system volume.
+  @param  IoMode     The access mode.
+  @param  DirtyValue Set the volume as dirty or not.
+
+  @retval EFI_SUCCESS  The dirty state is set.
+
+**/
+EFI_STATUS
+FatAccessVolumeDirty (
+  IN FAT_VOLUME  *Volume,
+  IN IO_MODE     IoMode,
+  IN VOID        *DirtyValue
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @param  Seed  The generator state.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  IN OUT UINT32  *Seed
+  )
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return (*Seed >> 8);
+}
+
+/**
+  Writes a FAT entry to the reference FAT, and to the disk or through the
+  FAT cache.
+
+  @param  Volume  FAT file system volume.
+  @param  Index   The index of the FAT entry.
+  @param  Value   The value of the FAT entry.
+  @param  Cached  TRUE to write the entry through the FAT cache, where it
+                  stays dirty.
+
+**/
+STATIC
+VOID
+SetTestFatEntry (
+  IN FAT_VOLUME  *Volume,
+  IN UINTN       Index,
+  IN UINT32      Value,
+  IN BOOLEAN     Cached
+  )
+{
+  UINT64  Offset;
+
+  Offset = Volume->FatPos + Index * Volume->FatEntrySize;
+  CopyMem (mFat + Index * Volume->FatEntrySize, &Value, Volume->FatEntrySize);
+  if (Cached) {
+    FatDiskIo (Volume, WriteFat, Offset, Volume->FatEntrySize, &Value, NULL);
+  } else {
+    CopyMem (mDisk + Offset, &Value, Volume->FatEntrySize);
+  }
+}
+
+/**
+  Checks whether a FAT entry of the reference FAT is free.
+
+  @param  Volume  FAT file system volume.
+  @param  Index   The index of the FAT entry.
+
+  @retval TRUE   The cluster is free.
+  @retval FALSE  The cluster is allocated.
+
+**/
+STATIC
+BOOLEAN
+IsTestClusterFree (
+  IN FAT_VOLUME  *Volume,
+  IN UINTN       Index
+  )
+{
+  UINT32  Value;
+
+  Value = 0;
+  CopyMem (&Value, mFat + Index * Volume->FatEntrySize, Volume->FatEntrySize);
+  if (Volume->FatType == Fat32) {
+    Value &= FAT_CLUSTER_MASK_FAT32;
+  }
+
+  return (BOOLEAN)(Value == FAT_CLUSTER_FREE);
+}
+
+/**
+  Builds a FAT16 or FAT32 volume whose FAT spans many FAT cache pages, with
+  random free clusters on the disk and dirty entries in the FAT cache, and
+  checks the free cluster bitmap against the FAT.
+
+  @param[in]  Context  The FAT type, Fat16 or Fat32.
+
+  @retval  UNIT_TEST_PASSED             The bitmap matches the FAT.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The bitmap does not match the FAT.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+FreeBitmapMatchesLargeFat (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  FAT_VOLUME  *Volume;
+  UINTN       Index;
+  UINTN       Run;
+  UINTN       Length;
+  UINTN       FreeCount;
+  UINT32      Value;
+  UINT32      Seed;
+  BOOLEAN     Free;
+  BOOLEAN     Bit;
+
+  Volume = AllocateZeroPool (sizeof (FAT_VOLUME));
+  UT_ASSERT_NOT_NULL (Volume);
+
+  Seed                 = 7;
+  Volume->Signature    = FAT_VOLUME_SIGNATURE;
+  Volume->FatType      = (FAT_VOLUME_TYPE)(UINTN)Context;
+  Volume->FatEntrySize = (Volume->FatType == Fat32) ? sizeof (UINT32) : sizeof (UINT16);
+  Volume->MaxCluster   = (Volume->FatType == Fat32) ? 150000 + 17 : 60000 + 5;
+  Volume->NumFats      = 2;
+  Volume->FatPos       = TEST_FAT_POS;
+  Volume->FatSize      = ALIGN_VALUE ((Volume->MaxCluster + 2) * Volume->FatEntrySize, 512);
+  Volume->RootPos      = Volume->FatPos + Volume->NumFats * Volume->FatSize;
+  Volume->VolumeSize   = Volume->RootPos + TEST_DATA_SIZE;
+
+  mDisk = AllocatePool ((UINTN)Volume->VolumeSize);
+  mFat  = AllocateZeroPool ((UINTN)Volume->FatSize);
+  UT_ASSERT_NOT_NULL (mDisk);
+  UT_ASSERT_NOT_NULL (mFat);
+  UT_ASSERT_NOT_EFI_ERROR (FatInitializeDiskCache (Volume));
+  UT_ASSERT_TRUE (Volume->FatSize > 2 * ((UINTN)1 << Volume->DiskCache[CacheFat].PageAlignment));
+
+  //
+  // The data area is allocated-looking garbage, so that reading it instead of
+  // the FAT shows in the bitmap
+  //
+  for (Index = 0; Index < Volume->VolumeSize; Index++) {
+    mDisk[Index] = (UINT8)(NextRandom (&Seed) | 1);
+  }
+
+  //
+  // Runs of free and allocated clusters, some with the reserved high bits of
+  // FAT32 entries set
+  //
+  Free = FALSE;
+  for (Index = 0; Index < Volume->MaxCluster + 2; Index += Length) {
+    Length = 1 + NextRandom (&Seed) % 300;
+    for (Run = Index; (Run < Index + Length) && (Run < Volume->MaxCluster + 2); Run++) {
+      Value = Free ? 0 : (UINT32)(Run + 1);
+      if ((Volume->FatType == Fat32) && (NextRandom (&Seed) % 5 == 0)) {
+        Value |= 0xF0000000;
+      }
+
+      SetTestFatEntry (Volume, Run, Value, FALSE);
+    }
+
+    Free = (BOOLEAN)!Free;
+  }
+
+  SetTestFatEntry (Volume, 0, 0x0FFFFFF8, FALSE);
+  SetTestFatEntry (Volume, 1, 0x0FFFFFFF, FALSE);
+
+  //
+  // Entries changed in the FAT cache and not flushed yet
+  //
+  for (Run = 0; Run < TEST_DIRTY_RUNS; Run++) {
+    Index = FAT_MIN_CLUSTER + NextRandom (&Seed) % Volume->MaxCluster;
+    SetTestFatEntry (Volume, Index, IsTestClusterFree (Volume, Index) ? 0xFFFF : 0, TRUE);
+  }
+
+  FatComputeFreeInfo (Volume);
+
+  UT_ASSERT_FALSE (Volume->DiskError);
+  UT_ASSERT_NOT_NULL (Volume->FreeBitmap);
+  UT_ASSERT_TRUE (Volume->FreeInfoValid);
+
+  FreeCount = 0;
+  for (Index = 0; Index < (Volume->MaxCluster + 2 + 63) / 64 * 64; Index++) {
+    Free = (BOOLEAN)((Index >= FAT_MIN_CLUSTER) && (Index < Volume->MaxCluster + 2) && IsTestClusterFree (Volume, Index));
+    Bit  = (BOOLEAN)((RShiftU64 (Volume->FreeBitmap[Index / 64], Index % 64) & 1) != 0);
+    UT_ASSERT_EQUAL (Bit, Free);
+    if (Free) {
+      FreeCount++;
+    }
+  }
+
+  UT_ASSERT_EQUAL (Volume->FatInfoSector.FreeInfo.ClusterCount, FreeCount);
+
+  FreePool (Volume->FreeBitmap);
+  FreePool (Volume->CacheBuffer);
+  FreePool (Volume);
+  FreePool (mDisk);
+  FreePool (mFat);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the free
+  cluster bitmap and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      BitmapTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&BitmapTests, Framework, "Free Cluster Bitmap Tests", "Fat.FreeBitmap", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Free Cluster Bitmap Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite----------Description------------------------------------------Name-------Function-------------------Pre---Post---Context-----------------
+  //
+  AddTestCase (BitmapTests, "FAT16 bitmap built through the FAT cache matches the FAT", "Fat16", FreeBitmapMatchesLargeFat, NULL, NULL, (UNIT_TEST_CONTEXT)Fat16);
+  AddTestCase (BitmapTests, "FAT32 bitmap built through the FAT cache matches the FAT", "Fat32", FreeBitmapMatchesLargeFat, NULL, NULL, (UNIT_TEST_CONTEXT)Fat32);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define FreeBitmapUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+FreeBitmapUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
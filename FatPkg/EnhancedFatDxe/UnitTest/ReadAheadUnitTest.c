@@ -0,0 +1,1075 @@
+/** @file
+  Host-based unit tests for the read-ahead of the data cache of the FAT
+  driver, with a simulated DiskIo2 whose reads complete when the test says.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../Fat.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "FAT Data Cache Read-Ahead Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_FAT_POS        SIZE_4KB
+#define TEST_FAT_SIZE       SIZE_64KB
+#define TEST_DATA_PAGES     256
+#define TEST_MAX_EVENTS     64
+#define TEST_MAX_REQUESTS   64
+#define TEST_ACCESS_OFFSET  100
+#define TEST_ACCESS_SIZE    SIZE_2KB
+
+///
+/// An event of the simulated boot services
+///
+typedef struct {
+  BOOLEAN             InUse;
+  BOOLEAN             Signaled;
+  EFI_TPL             NotifyTpl;
+  EFI_EVENT_NOTIFY    NotifyFunction;
+  VOID                *NotifyContext;
+} TEST_EVENT;
+
+///
+/// A DiskIo2 read of the simulated disk. The disk is read when the request
+/// is submitted, and the data lands in the buffer when it completes.
+///
+typedef struct {
+  UINT64                Offset;
+  UINTN                 BufferSize;
+  UINT8                 *Buffer;
+  UINT8                 *Data;
+  EFI_DISK_IO2_TOKEN    *Token;
+} TEST_REQUEST;
+
+///
+/// Globals of the driver modules the test does not link
+///
+EFI_LOCK           FatFsLock   = EFI_INITIALIZE_LOCK_VARIABLE (TPL_CALLBACK);
+EFI_LOCK           FatTaskLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
+EFI_BOOT_SERVICES  *gBS        = NULL;
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+STATIC EFI_TPL            mTpl;
+STATIC TEST_EVENT         mEvents[TEST_MAX_EVENTS];
+
+///
+/// The simulated disk, its reads in flight, and what the tests count
+///
+STATIC UINT8                  *mDisk;
+STATIC TEST_REQUEST           mRequests[TEST_MAX_REQUESTS];
+STATIC UINTN                  mRequestCount;
+STATIC UINTN                  mDiskReads;
+STATIC BOOLEAN                mTplViolation;
+STATIC BOOLEAN                mCompleteOnRelease;
+STATIC BOOLEAN                mFailSubmit;
+STATIC UINT32                 mSeed;
+STATIC EFI_DISK_IO2_PROTOCOL  mDiskIo2;
+STATIC EFI_BLOCK_IO_PROTOCOL  mBlockIo;
+
+STATIC FAT_VOLUME  *mVolume;
+STATIC DISK_CACHE  *mDataCache;
+STATIC UINTN       mPageSize;
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @param  Seed  The generator state.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  IN OUT UINT32  *Seed
+  )
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return (*Seed >> 8);
+}
+
+/**
+  Runs the notification functions of the signaled events above the current
+  task priority level, the highest first.
+
+**/
+STATIC
+VOID
+TestRunNotifies (
+  VOID
+  )
+{
+  TEST_EVENT  *Event;
+  UINTN       Index;
+  EFI_TPL     Tpl;
+
+  for ( ; ;) {
+    Event = NULL;
+    for (Index = 0; Index < TEST_MAX_EVENTS; Index++) {
+      if (mEvents[Index].InUse && mEvents[Index].Signaled && (mEvents[Index].NotifyFunction != NULL) &&
+          (mEvents[Index].NotifyTpl > mTpl) && ((Event == NULL) || (mEvents[Index].NotifyTpl > Event->NotifyTpl)))
+      {
+        Event = &mEvents[Index];
+      }
+    }
+
+    if (Event == NULL) {
+      return;
+    }
+
+    Event->Signaled = FALSE;
+    Tpl             = mTpl;
+    mTpl            = Event->NotifyTpl;
+    Event->NotifyFunction ((EFI_EVENT)Event, Event->NotifyContext);
+    mTpl = Tpl;
+  }
+}
+
+/**
+  Creates an event.
+
+  @param  Type            The type of event.
+  @param  NotifyTpl       The task priority level of the notification function.
+  @param  NotifyFunction  The notification function.
+  @param  NotifyContext   The context of the notification function.
+  @param  Event           The event created.
+
+  @retval EFI_SUCCESS           The event is created.
+  @retval EFI_OUT_OF_RESOURCES  There are too many events.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < TEST_MAX_EVENTS; Index++) {
+    if (!mEvents[Index].InUse) {
+      mEvents[Index].InUse          = TRUE;
+      mEvents[Index].Signaled       = FALSE;
+      mEvents[Index].NotifyTpl      = NotifyTpl;
+      mEvents[Index].NotifyFunction = NotifyFunction;
+      mEvents[Index].NotifyContext  = NotifyContext;
+      *Event                        = (EFI_EVENT)&mEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+/**
+  Closes an event.
+
+  @param  Event  The event to close.
+
+  @retval EFI_SUCCESS  The event is closed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ASSERT (((TEST_EVENT *)Event)->InUse);
+  ((TEST_EVENT *)Event)->InUse = FALSE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Signals an event, its notification function runs once the task priority
+  level allows it.
+
+  @param  Event  The event to signal.
+
+  @retval EFI_SUCCESS  The event is signaled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ASSERT (((TEST_EVENT *)Event)->InUse);
+  ((TEST_EVENT *)Event)->Signaled = TRUE;
+  TestRunNotifies ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Completes a DiskIo2 read of the simulated disk, and signals its token.
+  A failed read leaves garbage in its buffer.
+
+  @param  Index   The index of the request.
+  @param  Status  The status of the read.
+
+**/
+STATIC
+VOID
+TestCompleteRequest (
+  IN UINTN       Index,
+  IN EFI_STATUS  Status
+  )
+{
+  TEST_REQUEST  Request;
+
+  ASSERT (Index < mRequestCount);
+  Request          = mRequests[Index];
+  mRequests[Index] = mRequests[mRequestCount - 1];
+  mRequestCount--;
+
+  if (EFI_ERROR (Status)) {
+    SetMem (Request.Buffer, Request.BufferSize, 0xEE);
+  } else {
+    CopyMem (Request.Buffer, Request.Data, Request.BufferSize);
+  }
+
+  FreePool (Request.Data);
+  Request.Token->TransactionStatus = Status;
+  TestSignalEvent (Request.Token->Event);
+}
+
+/**
+  Completes all the DiskIo2 reads, the last submitted first.
+
+**/
+STATIC
+VOID
+TestCompleteAllRequests (
+  VOID
+  )
+{
+  while (mRequestCount > 0) {
+    TestCompleteRequest (mRequestCount - 1, EFI_SUCCESS);
+  }
+}
+
+/**
+  Fails all the DiskIo2 reads.
+
+**/
+STATIC
+VOID
+TestFailAllRequests (
+  VOID
+  )
+{
+  while (mRequestCount > 0) {
+    TestCompleteRequest (mRequestCount - 1, EFI_DEVICE_ERROR);
+  }
+}
+
+/**
+  Counts the pages of a set of the data cache that are being read.
+
+  @param  Set  The set of the data cache.
+
+  @return The number of pages of the set in the reads in flight.
+
+**/
+STATIC
+UINTN
+TestCountReadingPages (
+  IN UINTN  Set
+  )
+{
+  UINTN  Index;
+  UINTN  PageNo;
+  UINTN  Count;
+
+  Count = 0;
+  for (Index = 0; Index < mRequestCount; Index++) {
+    for (PageNo = (UINTN)((mRequests[Index].Offset - mVolume->RootPos) / mPageSize);
+         PageNo < (UINTN)((mRequests[Index].Offset - mVolume->RootPos + mRequests[Index].BufferSize) / mPageSize);
+         PageNo++)
+    {
+      if ((PageNo & mDataCache->SetMask) == Set) {
+        Count++;
+      }
+    }
+  }
+
+  return Count;
+}
+
+/**
+  Queues a DiskIo2 read on the simulated disk.
+
+  @param  This        The DiskIo2 protocol.
+  @param  MediaId     Unused.
+  @param  Offset      The offset on the disk.
+  @param  Token       The token of the read.
+  @param  BufferSize  The size of the read.
+  @param  Buffer      The buffer to read into.
+
+  @retval EFI_SUCCESS           The read is queued.
+  @retval EFI_DEVICE_ERROR      mFailSubmit is set.
+  @retval EFI_OUT_OF_RESOURCES  There are too many requests.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadDiskEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN     UINT32                 MediaId,
+  IN     UINT64                 Offset,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  )
+{
+  //
+  // DiskIo2 is called at TPL_CALLBACK or lower
+  //
+  if (mTpl > TPL_CALLBACK) {
+    mTplViolation = TRUE;
+  }
+
+  if (mFailSubmit) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  if (mRequestCount == TEST_MAX_REQUESTS) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  mRequests[mRequestCount].Data = AllocateCopyPool (BufferSize, mDisk + Offset);
+  if (mRequests[mRequestCount].Data == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  mRequests[mRequestCount].Offset     = Offset;
+  mRequests[mRequestCount].BufferSize = BufferSize;
+  mRequests[mRequestCount].Buffer     = Buffer;
+  mRequests[mRequestCount].Token      = Token;
+  mRequestCount++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Flushes the simulated disk, which has nothing to flush.
+
+  @param  This  The BlockIo protocol.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestFlushBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Raises the task priority level to that of the lock and acquires it.
+
+  @param  Lock  The lock to acquire.
+
+**/
+VOID
+EFIAPI
+EfiAcquireLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockReleased);
+  ASSERT (Lock->Tpl >= mTpl);
+  Lock->OwnerTpl = mTpl;
+  Lock->Lock     = EfiLockAcquired;
+  mTpl           = Lock->Tpl;
+}
+
+/**
+  Releases a lock and restores the task priority level. Below TPL_NOTIFY,
+  the simulated disk may complete a random read in flight first, if
+  mCompleteOnRelease is set.
+
+  @param  Lock  The lock to release.
+
+**/
+VOID
+EFIAPI
+EfiReleaseLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockAcquired);
+  Lock->Lock = EfiLockReleased;
+  mTpl       = Lock->OwnerTpl;
+
+  if (mCompleteOnRelease && (mTpl < TPL_NOTIFY) && (mRequestCount > 0) && (NextRandom (&mSeed) % 3 == 0)) {
+    TestCompleteRequest (NextRandom (&mSeed) % mRequestCount, EFI_SUCCESS);
+  }
+
+  TestRunNotifies ();
+}
+
+/**
+  Returns the current task priority level.
+
+  @return The current task priority level.
+
+**/
+EFI_TPL
+EFIAPI
+EfiGetCurrentTpl (
+  VOID
+  )
+{
+  return mTpl;
+}
+
+/**
+  Accesses the volume through the disk cache, or the disk in memory, as the
+  FatDiskIo() of the driver does for a blocking access.
+
+  @param  Volume      FAT file system volume.
+  @param  IoMode      The access mode.
+  @param  Offset      The starting byte offset to read from.
+  @param  BufferSize  Size of Buffer.
+  @param  Buffer      Buffer containing read data.
+  @param  Task        Point to task instance, not supported.
+
+  @retval EFI_SUCCESS           The operation is performed successfully.
+  @retval EFI_VOLUME_CORRUPTED  The access is out of the volume.
+
+**/
+EFI_STATUS
+FatDiskIo (
+  IN     FAT_VOLUME  *Volume,
+  IN     IO_MODE     IoMode,
+  IN     UINT64      Offset,
+  IN     UINTN       BufferSize,
+  IN OUT VOID        *Buffer,
+  IN     FAT_TASK    *Task
+  )
+{
+  ASSERT (Task == NULL);
+
+  if (Offset + BufferSize > Volume->VolumeSize) {
+    Volume->DiskError = TRUE;
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  if (CACHE_ENABLED (IoMode)) {
+    return FatAccessCache (Volume, CACHE_TYPE (IoMode), RAW_ACCESS (IoMode), Offset, BufferSize, Buffer, Task);
+  }
+
+  if (IoMode == ReadDisk) {
+    mDiskReads++;
+    CopyMem (Buffer, mDisk + Offset, BufferSize);
+  } else {
+    CopyMem (mDisk + Offset, Buffer, BufferSize);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Waits for the non-blocking accesses that overlap an access, there are none.
+
+  @param  Volume      FAT file system volume.
+  @param  Write       TRUE for a write.
+  @param  Offset      The starting byte offset of the access.
+  @param  BufferSize  Size of the access.
+  @param  Buffer      Buffer of the access.
+
+**/
+VOID
+FatWaitNonblockingAccess (
+  IN FAT_VOLUME  *Volume,
+  IN BOOLEAN     Write,
+  IN UINT64      Offset,
+  IN UINTN       BufferSize,
+  IN VOID        *Buffer
+  )
+{
+}
+
+/**
+  Sets up a FAT32 volume with DiskIo2, and its disk cache, on a simulated
+  disk whose data area is filled with a pattern.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The volume is set up.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The disk cache does not read ahead.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SetUpVolume (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  ZeroMem (&mBootServices, sizeof (mBootServices));
+  mBootServices.CreateEvent = TestCreateEvent;
+  mBootServices.CloseEvent  = TestCloseEvent;
+  mBootServices.SignalEvent = TestSignalEvent;
+  gBS                       = &mBootServices;
+
+  ZeroMem (mEvents, sizeof (mEvents));
+  mTpl               = TPL_APPLICATION;
+  mRequestCount      = 0;
+  mDiskReads         = 0;
+  mTplViolation      = FALSE;
+  mCompleteOnRelease = FALSE;
+  mFailSubmit        = FALSE;
+  mSeed              = 13;
+
+  ZeroMem (&mDiskIo2, sizeof (mDiskIo2));
+  mDiskIo2.ReadDiskEx = TestReadDiskEx;
+  ZeroMem (&mBlockIo, sizeof (mBlockIo));
+  mBlockIo.FlushBlocks = TestFlushBlocks;
+
+  mVolume = AllocateZeroPool (sizeof (FAT_VOLUME));
+  UT_ASSERT_NOT_NULL (mVolume);
+  mVolume->Signature    = FAT_VOLUME_SIGNATURE;
+  mVolume->DiskIo2      = &mDiskIo2;
+  mVolume->BlockIo      = &mBlockIo;
+  mVolume->FatType      = Fat32;
+  mVolume->FatEntrySize = sizeof (UINT32);
+  mVolume->NumFats      = 1;
+  mVolume->FatPos       = TEST_FAT_POS;
+  mVolume->FatSize      = TEST_FAT_SIZE;
+  mVolume->RootPos      = mVolume->FatPos + mVolume->FatSize;
+  UT_ASSERT_NOT_EFI_ERROR (FatInitializeDiskCache (mVolume));
+
+  mDataCache               = &mVolume->DiskCache[CacheData];
+  mPageSize                = (UINTN)1 << mDataCache->PageAlignment;
+  mVolume->VolumeSize      = mVolume->RootPos + TEST_DATA_PAGES * mPageSize;
+  mDataCache->LimitAddress = mVolume->VolumeSize;
+  UT_ASSERT_TRUE (mDataCache->ReadAheadPageCount > 1);
+  UT_ASSERT_TRUE (mDataCache->WayCount > 1);
+
+  mDisk = AllocatePool ((UINTN)mVolume->VolumeSize);
+  UT_ASSERT_NOT_NULL (mDisk);
+  for (Index = 0; Index < mVolume->VolumeSize; Index++) {
+    mDisk[Index] = (UINT8)(Index ^ (Index >> 8) ^ (Index >> 16));
+  }
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Waits for the reads ahead the test left in flight, and frees the volume.
+
+  @param[in]  Context  Unused.
+
+**/
+STATIC
+VOID
+EFIAPI
+TearDownVolume (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  if (FatFsLock.Lock == EfiLockAcquired) {
+    EfiReleaseLock (&FatFsLock);
+  }
+
+  if (mVolume != NULL) {
+    if (mVolume->CacheBuffer != NULL) {
+      TestCompleteAllRequests ();
+      FatWaitCacheReadAhead (mVolume);
+      FreePool (mVolume->CacheBuffer);
+    }
+
+    FreePool (mVolume);
+    mVolume = NULL;
+  }
+
+  if (mDisk != NULL) {
+    FreePool (mDisk);
+    mDisk = NULL;
+  }
+}
+
+/**
+  Reads part of a page of the data area with a blocking read through the
+  data cache, as the driver does with the volume lock held, and checks the
+  data read against the disk.
+
+  @param  PageNo  The page of the data area.
+  @param  Offset  The offset of the read in the page.
+  @param  Size    The size of the read.
+
+  @retval TRUE   The data read matches the disk.
+  @retval FALSE  It does not.
+
+**/
+STATIC
+BOOLEAN
+TestReadPage (
+  IN UINTN  PageNo,
+  IN UINTN  Offset,
+  IN UINTN  Size
+  )
+{
+  UINT8       *Buffer;
+  UINT64      Position;
+  EFI_STATUS  Status;
+  BOOLEAN     Match;
+
+  Buffer = AllocatePool (Size);
+  if (Buffer == NULL) {
+    return FALSE;
+  }
+
+  Position = mVolume->RootPos + PageNo * mPageSize + Offset;
+  EfiAcquireLock (&FatFsLock);
+  Status = FatDiskIo (mVolume, ReadData, Position, Size, Buffer, NULL);
+  EfiReleaseLock (&FatFsLock);
+
+  Match = (BOOLEAN)(!EFI_ERROR (Status) && (CompareMem (Buffer, mDisk + Position, Size) == 0));
+  FreePool (Buffer);
+  return Match;
+}
+
+/**
+  Writes part of a page of the data area through the data cache, as the
+  driver does with the volume lock held. The disk in memory is updated
+  with the data, as the access has to be seen when reading it back.
+
+  @param  PageNo  The page of the data area.
+  @param  Offset  The offset of the write in the page.
+  @param  Size    The size of the write.
+  @param  Value   The value written.
+  @param  Model   A copy of the disk to update as the disk is expected to be.
+
+  @retval TRUE   The write succeeded.
+  @retval FALSE  It failed.
+
+**/
+STATIC
+BOOLEAN
+TestWritePage (
+  IN UINTN  PageNo,
+  IN UINTN  Offset,
+  IN UINTN  Size,
+  IN UINT8  Value,
+  IN UINT8  *Model
+  )
+{
+  UINT8       *Buffer;
+  UINT64      Position;
+  EFI_STATUS  Status;
+
+  Buffer = AllocatePool (Size);
+  if (Buffer == NULL) {
+    return FALSE;
+  }
+
+  SetMem (Buffer, Size, Value);
+  Position = mVolume->RootPos + PageNo * mPageSize + Offset;
+  EfiAcquireLock (&FatFsLock);
+  Status = FatDiskIo (mVolume, WriteData, Position, Size, Buffer, NULL);
+  EfiReleaseLock (&FatFsLock);
+
+  SetMem (Model + Position, Size, Value);
+  FreePool (Buffer);
+  return (BOOLEAN)!EFI_ERROR (Status);
+}
+
+/**
+  Starts the read-ahead of the pages after a page, by reading the page
+  twice: the second read is sequential.
+
+  @param  PageNo  The page to read.
+
+  @retval TRUE   The reads returned the data on the disk.
+  @retval FALSE  They did not.
+
+**/
+STATIC
+BOOLEAN
+TestStartReadAhead (
+  IN UINTN  PageNo
+  )
+{
+  return (BOOLEAN)(TestReadPage (PageNo, 0, TEST_ACCESS_SIZE) &&
+                   TestReadPage (PageNo, TEST_ACCESS_SIZE, TEST_ACCESS_SIZE));
+}
+
+/**
+  Checks that no read ahead is left in flight and that their events are
+  closed.
+
+  @retval TRUE   The reads ahead are done.
+  @retval FALSE  They are not.
+
+**/
+STATIC
+BOOLEAN
+TestReadAheadDone (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < TEST_MAX_EVENTS; Index++) {
+    if (mEvents[Index].InUse) {
+      return FALSE;
+    }
+  }
+
+  return (BOOLEAN)((mRequestCount == 0) && (mDataCache->ReadAheadPending == 0));
+}
+
+/**
+  A sequential read reads the pages after it ahead with one DiskIo2 read,
+  and the following reads find them in the cache.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The pages are read ahead.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They are not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SequentialReadsAreReadAhead (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  PageNo;
+  UINTN  DiskReads;
+
+  UT_ASSERT_TRUE (TestReadPage (0, TEST_ACCESS_OFFSET, TEST_ACCESS_SIZE));
+  UT_ASSERT_EQUAL (mRequestCount, 1);
+  UT_ASSERT_EQUAL (mRequests[0].Offset, mVolume->RootPos + mPageSize);
+  UT_ASSERT_EQUAL (mRequests[0].BufferSize, mDataCache->ReadAheadPageCount * mPageSize);
+  UT_ASSERT_EQUAL (mDataCache->ReadAheadPending, 1);
+
+  TestCompleteAllRequests ();
+  UT_ASSERT_EQUAL (mDataCache->ReadAheadPending, 0);
+
+  DiskReads = mDiskReads;
+  for (PageNo = 1; PageNo <= mDataCache->ReadAheadPageCount; PageNo++) {
+    UT_ASSERT_TRUE (TestReadPage (PageNo, 0, TEST_ACCESS_SIZE));
+    UT_ASSERT_TRUE (TestReadPage (PageNo, TEST_ACCESS_SIZE, mPageSize - TEST_ACCESS_SIZE));
+    TestCompleteAllRequests ();
+  }
+
+  UT_ASSERT_EQUAL (mDiskReads, DiskReads);
+  UT_ASSERT_EQUAL (mDataCache->Counters.ReadAheadHits, mDataCache->ReadAheadPageCount);
+  UT_ASSERT_TRUE (TestReadAheadDone ());
+  UT_ASSERT_FALSE (mTplViolation);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A page written while its read-ahead is in flight keeps the data written,
+  whether the write goes through the cache page or to the disk.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The write wins.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The read-ahead overwrites it.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+WriteWinsOverReadAhead (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT8  *Model;
+
+  Model = AllocateCopyPool ((UINTN)mVolume->VolumeSize, mDisk);
+  UT_ASSERT_NOT_NULL (Model);
+
+  //
+  // A write of part of a page, into the cache page being read
+  //
+  UT_ASSERT_TRUE (TestReadPage (0, 0, TEST_ACCESS_SIZE));
+  UT_ASSERT_EQUAL (mRequestCount, 1);
+  mCompleteOnRelease = TRUE;
+  UT_ASSERT_TRUE (TestWritePage (2, TEST_ACCESS_OFFSET, TEST_ACCESS_SIZE, 0xA5, Model));
+  mCompleteOnRelease = FALSE;
+  UT_ASSERT_EQUAL (mRequestCount, 0);
+
+  //
+  // A write of a whole page, to the disk while the page is being read
+  //
+  UT_ASSERT_TRUE (TestStartReadAhead (4 * mDataCache->ReadAheadPageCount));
+  UT_ASSERT_TRUE (mRequestCount > 0);
+  mCompleteOnRelease = TRUE;
+  UT_ASSERT_TRUE (TestWritePage (4 * mDataCache->ReadAheadPageCount + 3, 0, mPageSize, 0x5A, Model));
+  mCompleteOnRelease = FALSE;
+  TestCompleteAllRequests ();
+
+  //
+  // The disk has the whole page written, the cache the partial one
+  //
+  CopyMem (mDisk + mVolume->RootPos + 2 * mPageSize, Model + mVolume->RootPos + 2 * mPageSize, mPageSize);
+  UT_ASSERT_MEM_EQUAL (mDisk, Model, (UINTN)mVolume->VolumeSize);
+  UT_ASSERT_TRUE (TestReadPage (2, 0, mPageSize));
+  UT_ASSERT_TRUE (TestReadPage (4 * mDataCache->ReadAheadPageCount + 3, TEST_ACCESS_OFFSET, TEST_ACCESS_SIZE));
+
+  //
+  // Flushing writes the partial page back
+  //
+  SetMem (mDisk + mVolume->RootPos + 2 * mPageSize, mPageSize, 0);
+  EfiAcquireLock (&FatFsLock);
+  UT_ASSERT_NOT_EFI_ERROR (FatVolumeFlushCache (mVolume, NULL));
+  EfiReleaseLock (&FatFsLock);
+  UT_ASSERT_MEM_EQUAL (mDisk, Model, (UINTN)mVolume->VolumeSize);
+
+  UT_ASSERT_TRUE (TestReadAheadDone ());
+  UT_ASSERT_FALSE (mTplViolation);
+  FreePool (Model);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The read-ahead never replaces a page that is being read, and a blocking
+  read that has to replace one waits for its read to complete first.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The page is replaced once read.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+EvictionWaitsForRead (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  SetCount;
+  UINTN  Window;
+  UINTN  Index;
+  UINTN  PageNo;
+
+  //
+  // Each window of read-ahead has a page in set 1, the pages read to start
+  // them are in set 0. Only the reads with a page of set 1 are left in
+  // flight, until all the ways of set 1 are being read.
+  //
+  SetCount = mDataCache->SetMask + 1;
+  for (Window = 0; Window < mDataCache->WayCount; Window++) {
+    UT_ASSERT_TRUE (TestStartReadAhead (Window * 2 * SetCount));
+    for (Index = mRequestCount; Index > 0; Index--) {
+      if ((UINTN)(mRequests[Index - 1].Offset - mVolume->RootPos) / mPageSize % SetCount != 1) {
+        TestCompleteRequest (Index - 1, EFI_SUCCESS);
+      }
+    }
+  }
+
+  UT_ASSERT_EQUAL (TestCountReadingPages (1), mDataCache->WayCount);
+
+  //
+  // A window whose first page is in set 1 reads nothing ahead
+  //
+  PageNo = mDataCache->WayCount * 2 * SetCount;
+  Index  = mRequestCount;
+  UT_ASSERT_TRUE (TestStartReadAhead (PageNo));
+  UT_ASSERT_EQUAL (mRequestCount, Index);
+
+  //
+  // A page of set 1 replaces a page being read, once it is read. The reads
+  // in flight land later in their own pages, not in the replacing one.
+  //
+  mCompleteOnRelease = TRUE;
+  UT_ASSERT_TRUE (TestReadPage (PageNo + SetCount + 1, TEST_ACCESS_OFFSET, TEST_ACCESS_SIZE));
+  mCompleteOnRelease = FALSE;
+  UT_ASSERT_TRUE (TestCountReadingPages (1) < mDataCache->WayCount);
+  TestCompleteAllRequests ();
+  Index = mDiskReads;
+  UT_ASSERT_TRUE (TestReadPage (PageNo + SetCount + 1, 0, mPageSize));
+  UT_ASSERT_EQUAL (mDiskReads, Index);
+
+  for (Window = 0; Window < mDataCache->WayCount; Window++) {
+    UT_ASSERT_TRUE (TestReadPage (Window * 2 * SetCount + 1, 0, mPageSize));
+    TestCompleteAllRequests ();
+  }
+
+  UT_ASSERT_TRUE (TestReadAheadDone ());
+  UT_ASSERT_FALSE (mTplViolation);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The pages of a read-ahead that fails, or can not be submitted, are read
+  again from the disk when they are accessed.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The pages are read again.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The data of the failed read is used.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+FailedReadAheadIsRetried (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  DiskReads;
+  UINTN  PageNo;
+
+  //
+  // The read fails after the pages are accessed
+  //
+  UT_ASSERT_TRUE (TestReadPage (0, 0, TEST_ACCESS_SIZE));
+  UT_ASSERT_EQUAL (mRequestCount, 1);
+  TestFailAllRequests ();
+  UT_ASSERT_EQUAL (mDataCache->ReadAheadPending, 0);
+
+  for (PageNo = 1; PageNo <= mDataCache->ReadAheadPageCount; PageNo++) {
+    DiskReads = mDiskReads;
+    UT_ASSERT_TRUE (TestReadPage (PageNo, TEST_ACCESS_OFFSET, TEST_ACCESS_SIZE));
+    UT_ASSERT_EQUAL (mDiskReads, DiskReads + 1);
+    TestCompleteAllRequests ();
+  }
+
+  UT_ASSERT_EQUAL (mDataCache->Counters.ReadAheadHits, 0);
+
+  //
+  // The read fails while a page is waited for
+  //
+  PageNo = 4 * mDataCache->ReadAheadPageCount;
+  UT_ASSERT_TRUE (TestStartReadAhead (PageNo));
+  UT_ASSERT_TRUE (mRequestCount > 0);
+  TestFailAllRequests ();
+  DiskReads = mDiskReads;
+  UT_ASSERT_TRUE (TestReadPage (PageNo + 1, 0, mPageSize));
+  UT_ASSERT_EQUAL (mDiskReads, DiskReads + 1);
+  TestCompleteAllRequests ();
+
+  //
+  // The read can not be submitted
+  //
+  PageNo      = 8 * mDataCache->ReadAheadPageCount;
+  mFailSubmit = TRUE;
+  UT_ASSERT_TRUE (TestStartReadAhead (PageNo));
+  mFailSubmit = FALSE;
+  UT_ASSERT_EQUAL (mRequestCount, 0);
+  UT_ASSERT_EQUAL (mDataCache->ReadAheadPending, 0);
+  DiskReads = mDiskReads;
+  UT_ASSERT_TRUE (TestReadPage (PageNo + 2, TEST_ACCESS_OFFSET, TEST_ACCESS_SIZE));
+  UT_ASSERT_EQUAL (mDiskReads, DiskReads + 1);
+  TestCompleteAllRequests ();
+
+  UT_ASSERT_TRUE (TestReadAheadDone ());
+  UT_ASSERT_FALSE (mTplViolation);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the
+  read-ahead of the data cache and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      ReadAheadTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&ReadAheadTests, Framework, "Data Cache Read-Ahead Tests", "Fat.ReadAhead", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Data Cache Read-Ahead Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite--------------Description-------------------------------------Name--------------Function-------------------Pre----------Post------------Context
+  //
+  AddTestCase (ReadAheadTests, "Sequential reads are read ahead", "Sequential", SequentialReadsAreReadAhead, SetUpVolume, TearDownVolume, NULL);
+  AddTestCase (ReadAheadTests, "Write wins over the read-ahead", "Write", WriteWinsOverReadAhead, SetUpVolume, TearDownVolume, NULL);
+  AddTestCase (ReadAheadTests, "Eviction waits for the read in flight", "Eviction", EvictionWaitsForRead, SetUpVolume, TearDownVolume, NULL);
+  AddTestCase (ReadAheadTests, "Failed read-ahead is retried", "ReadFailed", FailedReadAheadIsRetried, SetUpVolume, TearDownVolume, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define ReadAheadUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+ReadAheadUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -0,0 +1,1310 @@
+/** @file
+  Host-based unit tests for the ordering of the non-blocking disk accesses of
+  the FAT driver, with a simulated DiskIo2 that completes them out of order.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../Fat.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "FAT Non-blocking Access Order Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_DISK_SIZE        SIZE_64KB
+#define TEST_MAX_EVENTS       512
+#define TEST_MAX_REQUESTS     256
+#define TEST_RANDOM_ACCESSES  600
+#define TEST_MAX_PARTS        3
+#define TEST_MAX_PART_SIZE    SIZE_2KB
+
+///
+/// An event of the simulated boot services
+///
+typedef struct {
+  BOOLEAN             InUse;
+  BOOLEAN             Signaled;
+  EFI_TPL             NotifyTpl;
+  EFI_EVENT_NOTIFY    NotifyFunction;
+  VOID                *NotifyContext;
+} TEST_EVENT;
+
+///
+/// A DiskIo2 request of the simulated disk, done when it completes
+///
+typedef struct {
+  BOOLEAN               Write;
+  UINT64                Offset;
+  UINTN                 BufferSize;
+  UINT8                 *Buffer;
+  EFI_DISK_IO2_TOKEN    *Token;
+} TEST_REQUEST;
+
+///
+/// A non-blocking access of the tests, and what a read has to return
+///
+typedef struct {
+  EFI_FILE_IO_TOKEN    Token;
+  BOOLEAN              Write;
+  UINTN                Size;
+  UINT8                *Buffer;
+  UINT8                *Expected;
+} TEST_ACCESS;
+
+///
+/// Globals of the driver modules the test does not link
+///
+EFI_LOCK              FatFsLock   = EFI_INITIALIZE_LOCK_VARIABLE (TPL_CALLBACK);
+EFI_LOCK              FatTaskLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
+EFI_BOOT_SERVICES     *gBS        = NULL;
+EFI_RUNTIME_SERVICES  *gRT        = NULL;
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+STATIC EFI_TPL            mTpl;
+STATIC TEST_EVENT         mEvents[TEST_MAX_EVENTS];
+
+///
+/// The simulated disk, its requests in flight, and the ordering errors seen
+///
+STATIC UINT8                  mDisk[TEST_DISK_SIZE];
+STATIC TEST_REQUEST           mRequests[TEST_MAX_REQUESTS];
+STATIC UINTN                  mRequestCount;
+STATIC UINTN                  mMaxRequestCount;
+STATIC UINTN                  mConflicts;
+STATIC BOOLEAN                mTplViolation;
+STATIC BOOLEAN                mCompleteOnRelease;
+STATIC UINT32                 mSeed;
+STATIC EFI_DISK_IO_PROTOCOL   mDiskIo;
+STATIC EFI_DISK_IO2_PROTOCOL  mDiskIo2;
+
+///
+/// The volume and open file of the tests, and their accesses, which have to
+/// outlive a test that fails while they are queued
+///
+STATIC FAT_VOLUME   *mVolume;
+STATIC FAT_OFILE    mOFile;
+STATIC FAT_IFILE    mIFile;
+STATIC BOOLEAN      mDirCacheCleaned;
+STATIC TEST_ACCESS  mAccesses[4];
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @param  Seed  The generator state.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  IN OUT UINT32  *Seed
+  )
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return (*Seed >> 8);
+}
+
+/**
+  Runs the notification functions of the signaled events above the current
+  task priority level, the highest first.
+
+**/
+STATIC
+VOID
+TestRunNotifies (
+  VOID
+  )
+{
+  TEST_EVENT  *Event;
+  UINTN       Index;
+  EFI_TPL     Tpl;
+
+  for ( ; ;) {
+    Event = NULL;
+    for (Index = 0; Index < TEST_MAX_EVENTS; Index++) {
+      if (mEvents[Index].InUse && mEvents[Index].Signaled && (mEvents[Index].NotifyFunction != NULL) &&
+          (mEvents[Index].NotifyTpl > mTpl) && ((Event == NULL) || (mEvents[Index].NotifyTpl > Event->NotifyTpl)))
+      {
+        Event = &mEvents[Index];
+      }
+    }
+
+    if (Event == NULL) {
+      return;
+    }
+
+    Event->Signaled = FALSE;
+    Tpl             = mTpl;
+    mTpl            = Event->NotifyTpl;
+    Event->NotifyFunction ((EFI_EVENT)Event, Event->NotifyContext);
+    mTpl = Tpl;
+  }
+}
+
+/**
+  Creates an event.
+
+  @param  Type            The type of event.
+  @param  NotifyTpl       The task priority level of the notification function.
+  @param  NotifyFunction  The notification function.
+  @param  NotifyContext   The context of the notification function.
+  @param  Event           The event created.
+
+  @retval EFI_SUCCESS           The event is created.
+  @retval EFI_OUT_OF_RESOURCES  There are too many events.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < TEST_MAX_EVENTS; Index++) {
+    if (!mEvents[Index].InUse) {
+      mEvents[Index].InUse          = TRUE;
+      mEvents[Index].Signaled       = FALSE;
+      mEvents[Index].NotifyTpl      = NotifyTpl;
+      mEvents[Index].NotifyFunction = NotifyFunction;
+      mEvents[Index].NotifyContext  = NotifyContext;
+      *Event                        = (EFI_EVENT)&mEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+/**
+  Closes an event.
+
+  @param  Event  The event to close.
+
+  @retval EFI_SUCCESS  The event is closed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ASSERT (((TEST_EVENT *)Event)->InUse);
+  ((TEST_EVENT *)Event)->InUse = FALSE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Signals an event, its notification function runs once the task priority
+  level allows it.
+
+  @param  Event  The event to signal.
+
+  @retval EFI_SUCCESS  The event is signaled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ASSERT (((TEST_EVENT *)Event)->InUse);
+  ((TEST_EVENT *)Event)->Signaled = TRUE;
+  TestRunNotifies ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Checks whether an event is signaled.
+
+  @param  Event  The event.
+
+  @retval TRUE   The event is signaled.
+  @retval FALSE  It is not.
+
+**/
+STATIC
+BOOLEAN
+TestIsSignaled (
+  IN EFI_EVENT  Event
+  )
+{
+  return ((TEST_EVENT *)Event)->Signaled;
+}
+
+/**
+  Completes a DiskIo2 request of the simulated disk, and signals its token.
+
+  @param  Index  The index of the request.
+
+**/
+STATIC
+VOID
+TestCompleteRequest (
+  IN UINTN  Index
+  )
+{
+  TEST_REQUEST  Request;
+
+  ASSERT (Index < mRequestCount);
+  Request          = mRequests[Index];
+  mRequests[Index] = mRequests[mRequestCount - 1];
+  mRequestCount--;
+
+  if (Request.Write) {
+    CopyMem (mDisk + Request.Offset, Request.Buffer, Request.BufferSize);
+  } else {
+    CopyMem (Request.Buffer, mDisk + Request.Offset, Request.BufferSize);
+  }
+
+  Request.Token->TransactionStatus = EFI_SUCCESS;
+  TestSignalEvent (Request.Token->Event);
+}
+
+/**
+  Finds the DiskIo2 request of the simulated disk at an offset.
+
+  @param  Offset  The offset of the request.
+
+  @return The index of the request, or mRequestCount if there is none.
+
+**/
+STATIC
+UINTN
+TestFindRequest (
+  IN UINT64  Offset
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < mRequestCount; Index++) {
+    if (mRequests[Index].Offset == Offset) {
+      break;
+    }
+  }
+
+  return Index;
+}
+
+/**
+  Completes all the DiskIo2 requests, the last submitted first.
+
+**/
+STATIC
+VOID
+TestCompleteAllRequests (
+  VOID
+  )
+{
+  while (mRequestCount > 0) {
+    TestCompleteRequest (mRequestCount - 1);
+  }
+}
+
+/**
+  Counts the accesses of the simulated disk in flight that an access must
+  not run together with: they overlap on the disk and either writes it, or
+  they overlap in memory and either writes the memory.
+
+  @param  Write       TRUE if the access writes the disk.
+  @param  Offset      The offset of the access.
+  @param  BufferSize  The size of the access.
+  @param  Buffer      The buffer of the access.
+
+  @return The number of conflicting requests.
+
+**/
+STATIC
+UINTN
+TestCountConflicts (
+  IN BOOLEAN  Write,
+  IN UINT64   Offset,
+  IN UINTN    BufferSize,
+  IN UINT8    *Buffer
+  )
+{
+  UINTN         Index;
+  UINTN         Count;
+  TEST_REQUEST  *Request;
+
+  Count = 0;
+  for (Index = 0; Index < mRequestCount; Index++) {
+    Request = &mRequests[Index];
+    if ((Write || Request->Write) &&
+        (Offset < Request->Offset + Request->BufferSize) && (Request->Offset < Offset + BufferSize))
+    {
+      Count++;
+    } else if ((!Write || !Request->Write) &&
+               (Buffer < Request->Buffer + Request->BufferSize) && (Request->Buffer < Buffer + BufferSize))
+    {
+      Count++;
+    }
+  }
+
+  return Count;
+}
+
+/**
+  Queues a DiskIo2 request on the simulated disk.
+
+  @param  Write       TRUE to write the disk.
+  @param  Offset      The offset on the disk.
+  @param  Token       The token of the request.
+  @param  BufferSize  The size of the request.
+  @param  Buffer      The buffer of the request.
+
+  @retval EFI_SUCCESS           The request is queued.
+  @retval EFI_OUT_OF_RESOURCES  There are too many requests.
+
+**/
+STATIC
+EFI_STATUS
+TestSubmitRequest (
+  IN BOOLEAN             Write,
+  IN UINT64              Offset,
+  IN EFI_DISK_IO2_TOKEN  *Token,
+  IN UINTN               BufferSize,
+  IN VOID                *Buffer
+  )
+{
+  if (mRequestCount == TEST_MAX_REQUESTS) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // DiskIo2 is called at TPL_CALLBACK or lower
+  //
+  if (mTpl > TPL_CALLBACK) {
+    mTplViolation = TRUE;
+  }
+
+  mConflicts += TestCountConflicts (Write, Offset, BufferSize, Buffer);
+
+  mRequests[mRequestCount].Write      = Write;
+  mRequests[mRequestCount].Offset     = Offset;
+  mRequests[mRequestCount].BufferSize = BufferSize;
+  mRequests[mRequestCount].Buffer     = Buffer;
+  mRequests[mRequestCount].Token      = Token;
+  mRequestCount++;
+  mMaxRequestCount = MAX (mMaxRequestCount, mRequestCount);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Queues a DiskIo2 read on the simulated disk.
+
+  @param  This        The DiskIo2 protocol.
+  @param  MediaId     Unused.
+  @param  Offset      The offset on the disk.
+  @param  Token       The token of the read.
+  @param  BufferSize  The size of the read.
+  @param  Buffer      The buffer to read into.
+
+  @retval EFI_SUCCESS  The read is queued.
+  @return other        The read could not be queued.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadDiskEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN     UINT32                 MediaId,
+  IN     UINT64                 Offset,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  )
+{
+  return TestSubmitRequest (FALSE, Offset, Token, BufferSize, Buffer);
+}
+
+/**
+  Queues a DiskIo2 write on the simulated disk.
+
+  @param  This        The DiskIo2 protocol.
+  @param  MediaId     Unused.
+  @param  Offset      The offset on the disk.
+  @param  Token       The token of the write.
+  @param  BufferSize  The size of the write.
+  @param  Buffer      The buffer to write from.
+
+  @retval EFI_SUCCESS  The write is queued.
+  @return other        The write could not be queued.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestWriteDiskEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN     UINT32                 MediaId,
+  IN     UINT64                 Offset,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token,
+  IN     UINTN                  BufferSize,
+  IN     VOID                   *Buffer
+  )
+{
+  return TestSubmitRequest (TRUE, Offset, Token, BufferSize, Buffer);
+}
+
+/**
+  Reads the simulated disk at once.
+
+  @param  This        The DiskIo protocol.
+  @param  MediaId     Unused.
+  @param  Offset      The offset on the disk.
+  @param  BufferSize  The size of the read.
+  @param  Buffer      The buffer to read into.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadDisk (
+  IN  EFI_DISK_IO_PROTOCOL  *This,
+  IN  UINT32                MediaId,
+  IN  UINT64                Offset,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  mConflicts += TestCountConflicts (FALSE, Offset, BufferSize, Buffer);
+  CopyMem (Buffer, mDisk + Offset, BufferSize);
+  return EFI_SUCCESS;
+}
+
+/**
+  Writes the simulated disk at once.
+
+  @param  This        The DiskIo protocol.
+  @param  MediaId     Unused.
+  @param  Offset      The offset on the disk.
+  @param  BufferSize  The size of the write.
+  @param  Buffer      The buffer to write from.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestWriteDisk (
+  IN EFI_DISK_IO_PROTOCOL  *This,
+  IN UINT32                MediaId,
+  IN UINT64                Offset,
+  IN UINTN                 BufferSize,
+  IN VOID                  *Buffer
+  )
+{
+  mConflicts += TestCountConflicts (TRUE, Offset, BufferSize, Buffer);
+  CopyMem (mDisk + Offset, Buffer, BufferSize);
+  return EFI_SUCCESS;
+}
+
+/**
+  Raises the task priority level to that of the lock and acquires it.
+
+  @param  Lock  The lock to acquire.
+
+**/
+VOID
+EFIAPI
+EfiAcquireLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockReleased);
+  ASSERT (Lock->Tpl >= mTpl);
+  Lock->OwnerTpl = mTpl;
+  Lock->Lock     = EfiLockAcquired;
+  mTpl           = Lock->Tpl;
+}
+
+/**
+  Acquires a lock unless it is acquired already.
+
+  @param  Lock  The lock to acquire.
+
+  @retval EFI_SUCCESS        The lock is acquired.
+  @retval EFI_ACCESS_DENIED  The lock is acquired already.
+
+**/
+EFI_STATUS
+EFIAPI
+EfiAcquireLockOrFail (
+  IN EFI_LOCK  *Lock
+  )
+{
+  if (Lock->Lock == EfiLockAcquired) {
+    return EFI_ACCESS_DENIED;
+  }
+
+  EfiAcquireLock (Lock);
+  return EFI_SUCCESS;
+}
+
+/**
+  Releases a lock and restores the task priority level. Below TPL_NOTIFY,
+  the simulated disk may complete a random request in flight first, if
+  mCompleteOnRelease is set.
+
+  @param  Lock  The lock to release.
+
+**/
+VOID
+EFIAPI
+EfiReleaseLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockAcquired);
+  Lock->Lock = EfiLockReleased;
+  mTpl       = Lock->OwnerTpl;
+
+  if (mCompleteOnRelease && (mTpl < TPL_NOTIFY) && (mRequestCount > 0) && (NextRandom (&mSeed) % 3 == 0)) {
+    TestCompleteRequest (NextRandom (&mSeed) % mRequestCount);
+  }
+
+  TestRunNotifies ();
+}
+
+/**
+  Returns the current task priority level.
+
+  @return The current task priority level.
+
+**/
+EFI_TPL
+EFIAPI
+EfiGetCurrentTpl (
+  VOID
+  )
+{
+  return mTpl;
+}
+
+/**
+  Accesses the disk cache, which the tests do not use.
+
+  @param  Volume         FAT file system volume.
+  @param  CacheDataType  The type of cache.
+  @param  IoMode         Indicate the type of disk access.
+  @param  Offset         The starting byte offset to read from.
+  @param  BufferSize     Size of Buffer.
+  @param  Buffer         The buffer containing cache data.
+  @param  Task           Point to task instance.
+
+  @retval EFI_UNSUPPORTED  Always.
+
+**/
+EFI_STATUS
+FatAccessCache (
+  IN     FAT_VOLUME       *Volume,
+  IN     CACHE_DATA_TYPE  CacheDataType,
+  IN     IO_MODE          IoMode,
+  IN     UINT64           Offset,
+  IN     UINTN            BufferSize,
+  IN OUT UINT8            *Buffer,
+  IN     FAT_TASK         *Task
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Waits for the reads ahead into the disk cache, there are none.
+
+  @param  Volume  FAT file system volume.
+
+**/
+VOID
+FatWaitCacheReadAhead (
+  IN FAT_VOLUME  *Volume
+  )
+{
+}
+
+/**
+  Cleans up the directory cache, which the tests do not use.
+
+  @param  Volume  FAT file system volume.
+
+**/
+VOID
+FatCleanupODirCache (
+  IN FAT_VOLUME  *Volume
+  )
+{
+  mDirCacheCleaned = TRUE;
+}
+
+/**
+  Sets up a volume with DiskIo2 on a simulated disk, and an open file.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED  The volume is set up.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SetUpVolume (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  ZeroMem (&mBootServices, sizeof (mBootServices));
+  mBootServices.CreateEvent = TestCreateEvent;
+  mBootServices.CloseEvent  = TestCloseEvent;
+  mBootServices.SignalEvent = TestSignalEvent;
+  gBS                       = &mBootServices;
+
+  ZeroMem (mEvents, sizeof (mEvents));
+  mTpl               = TPL_APPLICATION;
+  mRequestCount      = 0;
+  mMaxRequestCount   = 0;
+  mConflicts         = 0;
+  mTplViolation      = FALSE;
+  mCompleteOnRelease = FALSE;
+  mDirCacheCleaned   = FALSE;
+  mSeed              = 11;
+
+  for (Index = 0; Index < TEST_DISK_SIZE; Index++) {
+    mDisk[Index] = (UINT8)(Index ^ (Index >> 8));
+  }
+
+  ZeroMem (&mDiskIo, sizeof (mDiskIo));
+  mDiskIo.ReadDisk  = TestReadDisk;
+  mDiskIo.WriteDisk = TestWriteDisk;
+  ZeroMem (&mDiskIo2, sizeof (mDiskIo2));
+  mDiskIo2.ReadDiskEx  = TestReadDiskEx;
+  mDiskIo2.WriteDiskEx = TestWriteDiskEx;
+
+  mVolume = AllocateZeroPool (sizeof (FAT_VOLUME));
+  UT_ASSERT_NOT_NULL (mVolume);
+  mVolume->Signature  = FAT_VOLUME_SIGNATURE;
+  mVolume->DiskIo     = &mDiskIo;
+  mVolume->DiskIo2    = &mDiskIo2;
+  mVolume->VolumeSize = TEST_DISK_SIZE;
+  InitializeListHead (&mVolume->InFlightSubtasks);
+  InitializeListHead (&mVolume->DeferredSubtasks);
+  UT_ASSERT_NOT_EFI_ERROR (
+    gBS->CreateEvent (EVT_NOTIFY_SIGNAL, TPL_CALLBACK, FatOnDispatchSubtasks, mVolume, &mVolume->DispatchEvent)
+    );
+
+  ZeroMem (&mOFile, sizeof (mOFile));
+  mOFile.Volume = mVolume;
+  ZeroMem (&mIFile, sizeof (mIFile));
+  mIFile.Signature = FAT_IFILE_SIGNATURE;
+  mIFile.OFile     = &mOFile;
+  InitializeListHead (&mIFile.Tasks);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Frees the volume if the test did not.
+
+  @param[in]  Context  Unused.
+
+**/
+STATIC
+VOID
+EFIAPI
+TearDownVolume (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  if (mVolume != NULL) {
+    //
+    // A test that failed may still hold the volume lock
+    //
+    if (FatFsLock.Lock == EfiLockReleased) {
+      FatAcquireLock ();
+    }
+
+    mCompleteOnRelease = TRUE;
+    FatFreeVolume (mVolume);
+    mVolume = NULL;
+    FatReleaseLock ();
+  }
+}
+
+/**
+  Counts the entries of a list.
+
+  @param  Head  The head of the list.
+
+  @return The number of entries.
+
+**/
+STATIC
+UINTN
+TestListLength (
+  IN LIST_ENTRY  *Head
+  )
+{
+  LIST_ENTRY  *Link;
+  UINTN       Count;
+
+  Count = 0;
+  for (Link = Head->ForwardLink; Link != Head; Link = Link->ForwardLink) {
+    Count++;
+  }
+
+  return Count;
+}
+
+/**
+  Queues a non-blocking access of the open file made of one or more parts,
+  as a read or write of the driver does with the volume lock held.
+
+  @param  Access     The access, Token, Write, Size and Buffer are set.
+  @param  PartCount  The number of parts.
+  @param  Offsets    The disk offsets of the parts, which split the buffer
+                     in equal parts.
+
+  @retval EFI_SUCCESS  The access is queued.
+  @return other        The access could not be queued.
+
+**/
+STATIC
+EFI_STATUS
+TestQueueAccess (
+  IN OUT TEST_ACCESS  *Access,
+  IN     UINTN        PartCount,
+  IN     UINT64       *Offsets
+  )
+{
+  EFI_STATUS  Status;
+  FAT_TASK    *Task;
+  UINTN       PartSize;
+  UINTN       Index;
+
+  Status = gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Access->Token.Event);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  FatAcquireLock ();
+  Task = FatCreateTask (&mIFile, &Access->Token);
+  if (Task == NULL) {
+    FatReleaseLock ();
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  PartSize = Access->Size / PartCount;
+  for (Index = 0; Index < PartCount; Index++) {
+    Status = FatDiskIo (
+               mVolume,
+               Access->Write ? WriteDisk : ReadDisk,
+               Offsets[Index],
+               PartSize,
+               Access->Buffer + Index * PartSize,
+               Task
+               );
+    ASSERT_EFI_ERROR (Status);
+  }
+
+  Status = FatQueueTask (&mIFile, Task);
+  FatReleaseLock ();
+  return Status;
+}
+
+/**
+  Queues a non-blocking access of one part, with a buffer filled with a value.
+
+  @param  Access  The access.
+  @param  Write   TRUE for a write.
+  @param  Offset  The disk offset of the access.
+  @param  Size    The size of the access.
+  @param  Value   The value to fill the buffer with.
+
+  @retval EFI_SUCCESS  The access is queued.
+  @return other        The access could not be queued.
+
+**/
+STATIC
+EFI_STATUS
+TestQueueSimpleAccess (
+  OUT TEST_ACCESS  *Access,
+  IN  BOOLEAN      Write,
+  IN  UINT64       Offset,
+  IN  UINTN        Size,
+  IN  UINT8        Value
+  )
+{
+  ZeroMem (Access, sizeof (*Access));
+  Access->Write  = Write;
+  Access->Size   = Size;
+  Access->Buffer = AllocatePool (Size);
+  if (Access->Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  SetMem (Access->Buffer, Size, Value);
+  return TestQueueAccess (Access, 1, &Offset);
+}
+
+/**
+  Checks that an access is complete, with success, and frees it.
+
+  @param  Access  The access.
+
+  @retval TRUE   The access completed with success.
+  @retval FALSE  It did not.
+
+**/
+STATIC
+BOOLEAN
+TestAccessDone (
+  IN OUT TEST_ACCESS  *Access
+  )
+{
+  BOOLEAN  Done;
+
+  Done = (BOOLEAN)(TestIsSignaled (Access->Token.Event) && !EFI_ERROR (Access->Token.Status));
+  if ((Access->Expected != NULL) && (CompareMem (Access->Buffer, Access->Expected, Access->Size) != 0)) {
+    Done = FALSE;
+  }
+
+  gBS->CloseEvent (Access->Token.Event);
+  FreePool (Access->Buffer);
+  if (Access->Expected != NULL) {
+    FreePool (Access->Expected);
+  }
+
+  ZeroMem (Access, sizeof (*Access));
+  return Done;
+}
+
+/**
+  A write that overlaps an earlier write in flight is deferred until that
+  write completes, while a write elsewhere goes to the disk at once and may
+  complete first.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The writes are ordered as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They are not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+OverlappingWriteIsDeferred (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_ACCESS  *First;
+  TEST_ACCESS  *Second;
+  TEST_ACCESS  *Elsewhere;
+  UINTN        Index;
+
+  First     = &mAccesses[0];
+  Second    = &mAccesses[1];
+  Elsewhere = &mAccesses[2];
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (First, TRUE, 0, SIZE_4KB, 0xA1));
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (Second, TRUE, SIZE_2KB, SIZE_4KB, 0xB2));
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (Elsewhere, TRUE, SIZE_16KB, SIZE_4KB, 0xC3));
+
+  UT_ASSERT_EQUAL (mRequestCount, 2);
+  UT_ASSERT_EQUAL (TestListLength (&mVolume->InFlightSubtasks), 2);
+  UT_ASSERT_EQUAL (TestListLength (&mVolume->DeferredSubtasks), 1);
+  UT_ASSERT_EQUAL (TestFindRequest (SIZE_2KB), mRequestCount);
+
+  //
+  // The later write elsewhere completes first, the overlapping one still waits
+  //
+  TestCompleteRequest (TestFindRequest (SIZE_16KB));
+  UT_ASSERT_TRUE (TestIsSignaled (Elsewhere->Token.Event));
+  UT_ASSERT_EQUAL (mRequestCount, 1);
+  UT_ASSERT_EQUAL (TestListLength (&mVolume->DeferredSubtasks), 1);
+
+  //
+  // The first write completes, then the second one goes to the disk
+  //
+  TestCompleteRequest (TestFindRequest (0));
+  UT_ASSERT_TRUE (TestIsSignaled (First->Token.Event));
+  UT_ASSERT_FALSE (TestIsSignaled (Second->Token.Event));
+  UT_ASSERT_EQUAL (mRequestCount, 1);
+  UT_ASSERT_EQUAL (TestFindRequest (SIZE_2KB), 0);
+  UT_ASSERT_TRUE (IsListEmpty (&mVolume->DeferredSubtasks));
+
+  TestCompleteRequest (0);
+  UT_ASSERT_TRUE (IsListEmpty (&mVolume->InFlightSubtasks));
+  UT_ASSERT_TRUE (IsListEmpty (&mIFile.Tasks));
+
+  for (Index = 0; Index < SIZE_2KB; Index++) {
+    UT_ASSERT_EQUAL (mDisk[Index], 0xA1);
+  }
+
+  for (Index = SIZE_2KB; Index < SIZE_2KB + SIZE_4KB; Index++) {
+    UT_ASSERT_EQUAL (mDisk[Index], 0xB2);
+  }
+
+  for (Index = SIZE_16KB; Index < SIZE_16KB + SIZE_4KB; Index++) {
+    UT_ASSERT_EQUAL (mDisk[Index], 0xC3);
+  }
+
+  UT_ASSERT_TRUE (TestAccessDone (First));
+  UT_ASSERT_TRUE (TestAccessDone (Second));
+  UT_ASSERT_TRUE (TestAccessDone (Elsewhere));
+  UT_ASSERT_EQUAL (mConflicts, 0);
+  UT_ASSERT_FALSE (mTplViolation);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Non-blocking and blocking reads queued after a write return the data
+  written, while a read elsewhere completes first.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The reads return the new data.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They do not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ReadAfterWriteSeesNewData (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_ACCESS  *Write;
+  TEST_ACCESS  *Read;
+  TEST_ACCESS  *Elsewhere;
+  UINT8        Buffer[SIZE_1KB];
+  UINTN        Index;
+
+  Write     = &mAccesses[0];
+  Read      = &mAccesses[1];
+  Elsewhere = &mAccesses[2];
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (Write, TRUE, SIZE_8KB, SIZE_4KB, 0x5A));
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (Read, FALSE, SIZE_8KB + SIZE_2KB, SIZE_4KB, 0));
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (Elsewhere, FALSE, SIZE_32KB, SIZE_4KB, 0));
+
+  Read->Expected = AllocatePool (SIZE_4KB);
+  UT_ASSERT_NOT_NULL (Read->Expected);
+  SetMem (Read->Expected, SIZE_2KB, 0x5A);
+  CopyMem (Read->Expected + SIZE_2KB, mDisk + SIZE_8KB + SIZE_4KB, SIZE_2KB);
+  Elsewhere->Expected = AllocateCopyPool (SIZE_4KB, mDisk + SIZE_32KB);
+  UT_ASSERT_NOT_NULL (Elsewhere->Expected);
+
+  UT_ASSERT_EQUAL (mRequestCount, 2);
+  UT_ASSERT_EQUAL (TestListLength (&mVolume->DeferredSubtasks), 1);
+
+  TestCompleteRequest (TestFindRequest (SIZE_32KB));
+  UT_ASSERT_TRUE (TestIsSignaled (Elsewhere->Token.Event));
+  UT_ASSERT_TRUE (TestAccessDone (Elsewhere));
+
+  //
+  // A blocking read with the volume lock held waits for the write, which the
+  // simulated disk completes while the read spins
+  //
+  mCompleteOnRelease = TRUE;
+  FatAcquireLock ();
+  UT_ASSERT_NOT_EFI_ERROR (FatDiskIo (mVolume, ReadDisk, SIZE_8KB + SIZE_1KB, sizeof (Buffer), Buffer, NULL));
+  FatReleaseLock ();
+  for (Index = 0; Index < sizeof (Buffer); Index++) {
+    UT_ASSERT_EQUAL (Buffer[Index], 0x5A);
+  }
+
+  TestCompleteAllRequests ();
+  UT_ASSERT_TRUE (IsListEmpty (&mVolume->InFlightSubtasks));
+  UT_ASSERT_TRUE (IsListEmpty (&mVolume->DeferredSubtasks));
+  UT_ASSERT_TRUE (TestAccessDone (Write));
+  UT_ASSERT_TRUE (TestAccessDone (Read));
+  UT_ASSERT_EQUAL (mConflicts, 0);
+  UT_ASSERT_FALSE (mTplViolation);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Freeing the volume waits for the accesses in flight and the deferred ones.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             All the accesses complete.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They do not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+FreeVolumeDrainsSubtasks (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_ACCESS  *Accesses;
+  UINTN        Index;
+
+  Accesses = mAccesses;
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (&Accesses[0], TRUE, 0, SIZE_4KB, 0x11));
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (&Accesses[1], TRUE, 0, SIZE_4KB, 0x22));
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (&Accesses[2], FALSE, SIZE_1KB, SIZE_1KB, 0));
+  UT_ASSERT_NOT_EFI_ERROR (TestQueueSimpleAccess (&Accesses[3], TRUE, SIZE_32KB, SIZE_4KB, 0x33));
+
+  Accesses[2].Expected = AllocatePool (SIZE_1KB);
+  UT_ASSERT_NOT_NULL (Accesses[2].Expected);
+  SetMem (Accesses[2].Expected, SIZE_1KB, 0x22);
+
+  UT_ASSERT_EQUAL (TestListLength (&mVolume->InFlightSubtasks), 2);
+  UT_ASSERT_EQUAL (TestListLength (&mVolume->DeferredSubtasks), 2);
+
+  //
+  // The volume is freed with the volume lock held, so the deferred accesses
+  // are not dispatched by the event
+  //
+  mCompleteOnRelease = TRUE;
+  FatAcquireLock ();
+  FatFreeVolume (mVolume);
+  mVolume = NULL;
+  FatReleaseLock ();
+
+  UT_ASSERT_EQUAL (mRequestCount, 0);
+  UT_ASSERT_TRUE (mDirCacheCleaned);
+  UT_ASSERT_TRUE (IsListEmpty (&mIFile.Tasks));
+  for (Index = 0; Index < ARRAY_SIZE (mAccesses); Index++) {
+    UT_ASSERT_TRUE (TestAccessDone (&Accesses[Index]));
+  }
+
+  for (Index = 0; Index < SIZE_4KB; Index++) {
+    UT_ASSERT_EQUAL (mDisk[Index], 0x22);
+    UT_ASSERT_EQUAL (mDisk[SIZE_32KB + Index], 0x33);
+  }
+
+  //
+  // Only the events of the tests are left, the subtask events and the
+  // dispatch event are closed
+  //
+  for (Index = 0; Index < TEST_MAX_EVENTS; Index++) {
+    UT_ASSERT_FALSE (mEvents[Index].InUse);
+  }
+
+  UT_ASSERT_EQUAL (mConflicts, 0);
+  UT_ASSERT_FALSE (mTplViolation);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Random reads and writes of one or more parts, blocking or not, completed
+  out of order, leave the disk and return the data that running them one at
+  a time in order would.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The accesses match the model.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They do not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RandomAccessesMatchModel (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_ACCESS  *Accesses;
+  UINT8        *Model;
+  UINT8        *Buffer;
+  UINT64       Offsets[TEST_MAX_PARTS];
+  UINTN        PartCount;
+  UINTN        PartSize;
+  UINTN        Count;
+  UINTN        Index;
+  UINTN        Part;
+  UINT32       Operation;
+
+  Accesses = AllocateZeroPool (TEST_RANDOM_ACCESSES * sizeof (TEST_ACCESS));
+  Model    = AllocateCopyPool (TEST_DISK_SIZE, mDisk);
+  Buffer   = AllocatePool (TEST_MAX_PART_SIZE);
+  UT_ASSERT_NOT_NULL (Accesses);
+  UT_ASSERT_NOT_NULL (Model);
+  UT_ASSERT_NOT_NULL (Buffer);
+
+  mCompleteOnRelease = TRUE;
+  Count              = 0;
+  for (Index = 0; Index < TEST_RANDOM_ACCESSES; Index++) {
+    Operation = NextRandom (&mSeed) % 6;
+    PartCount = 1 + NextRandom (&mSeed) % TEST_MAX_PARTS;
+    PartSize  = 1 + NextRandom (&mSeed) % TEST_MAX_PART_SIZE;
+    for (Part = 0; Part < PartCount; Part++) {
+      Offsets[Part] = NextRandom (&mSeed) % (TEST_DISK_SIZE - PartSize);
+    }
+
+    if (Operation < 4) {
+      //
+      // Non-blocking read or write, its parts are done in order
+      //
+      Accesses[Count].Write  = (BOOLEAN)(Operation >= 2);
+      Accesses[Count].Size   = PartCount * PartSize;
+      Accesses[Count].Buffer = AllocatePool (Accesses[Count].Size);
+      UT_ASSERT_NOT_NULL (Accesses[Count].Buffer);
+      if (Accesses[Count].Write) {
+        for (Part = 0; Part < Accesses[Count].Size; Part++) {
+          Accesses[Count].Buffer[Part] = (UINT8)NextRandom (&mSeed);
+        }
+
+        for (Part = 0; Part < PartCount; Part++) {
+          CopyMem (Model + Offsets[Part], Accesses[Count].Buffer + Part * PartSize, PartSize);
+        }
+      } else {
+        Accesses[Count].Expected = AllocatePool (Accesses[Count].Size);
+        UT_ASSERT_NOT_NULL (Accesses[Count].Expected);
+        for (Part = 0; Part < PartCount; Part++) {
+          CopyMem (Accesses[Count].Expected + Part * PartSize, Model + Offsets[Part], PartSize);
+        }
+      }
+
+      UT_ASSERT_NOT_EFI_ERROR (TestQueueAccess (&Accesses[Count], PartCount, Offsets));
+      Count++;
+    } else {
+      //
+      // Blocking read or write with the volume lock held
+      //
+      FatAcquireLock ();
+      if (Operation == 4) {
+        UT_ASSERT_NOT_EFI_ERROR (FatDiskIo (mVolume, ReadDisk, Offsets[0], PartSize, Buffer, NULL));
+        UT_ASSERT_MEM_EQUAL (Buffer, Model + Offsets[0], PartSize);
+      } else {
+        for (Part = 0; Part < PartSize; Part++) {
+          Buffer[Part] = (UINT8)NextRandom (&mSeed);
+        }
+
+        CopyMem (Model + Offsets[0], Buffer, PartSize);
+        UT_ASSERT_NOT_EFI_ERROR (FatDiskIo (mVolume, WriteDisk, Offsets[0], PartSize, Buffer, NULL));
+      }
+
+      FatReleaseLock ();
+    }
+  }
+
+  UT_ASSERT_TRUE (mMaxRequestCount > 8);
+
+  FatAcquireLock ();
+  FatFreeVolume (mVolume);
+  mVolume = NULL;
+  FatReleaseLock ();
+
+  for (Index = 0; Index < Count; Index++) {
+    UT_ASSERT_TRUE (TestAccessDone (&Accesses[Index]));
+  }
+
+  UT_ASSERT_MEM_EQUAL (mDisk, Model, TEST_DISK_SIZE);
+  UT_ASSERT_EQUAL (mConflicts, 0);
+  UT_ASSERT_FALSE (mTplViolation);
+
+  FreePool (Accesses);
+  FreePool (Model);
+  FreePool (Buffer);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the order of
+  the non-blocking disk accesses and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      OrderTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&OrderTests, Framework, "Non-blocking Access Order Tests", "Fat.SubtaskOrder", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Non-blocking Access Order Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite---------Description--------------------------------Name-----------Function--------------------Pre----------Post------------Context
+  //
+  AddTestCase (OrderTests, "Overlapping write is deferred", "Deferred", OverlappingWriteIsDeferred, SetUpVolume, TearDownVolume, NULL);
+  AddTestCase (OrderTests, "Read after write sees new data", "ReadAfterWrite", ReadAfterWriteSeesNewData, SetUpVolume, TearDownVolume, NULL);
+  AddTestCase (OrderTests, "Freeing the volume drains the subtasks", "FreeVolume", FreeVolumeDrainsSubtasks, SetUpVolume, TearDownVolume, NULL);
+  AddTestCase (OrderTests, "Random accesses match the model", "Random", RandomAccessesMatchModel, SetUpVolume, TearDownVolume, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define SubtaskOrderUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+SubtaskOrderUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
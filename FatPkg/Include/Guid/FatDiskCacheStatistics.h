@@ -0,0 +1,38 @@
+/** @file
+  Statistics of the disk cache of a FAT volume.
+
+  The FAT driver returns them from EFI_FILE_PROTOCOL.GetInfo() with this
+  GUID as the information type, for any file opened on the volume.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _FAT_DISK_CACHE_STATISTICS_H_
+#define _FAT_DISK_CACHE_STATISTICS_H_
+
+#define EDKII_FAT_DISK_CACHE_STATISTICS_GUID  {\
+  0xc852038a, 0x3742, 0x41d4, { 0x95, 0xc9, 0x99, 0x1c, 0x26, 0x90, 0xdb, 0x49 } \
+};
+
+typedef struct {
+  UINT64    Hits;           ///< Number of page accesses served by the cache.
+  UINT64    Misses;         ///< Number of page accesses that loaded the page from the disk.
+  UINT64    ReadAheadPages; ///< Number of pages loaded ahead of a sequential stream.
+  UINT64    ReadAheadHits;  ///< Number of pages loaded ahead that were accessed afterwards.
+  UINT64    WriteBacks;     ///< Number of disk writes of dirty pages.
+  UINT64    PagesWritten;   ///< Number of dirty pages written back.
+} FAT_DISK_CACHE_COUNTERS;
+
+typedef struct {
+  UINT32                     FatPageSize;   ///< Size of a page of the FAT cache, in bytes.
+  UINT32                     FatPageCount;  ///< Number of pages of the FAT cache.
+  UINT32                     DataPageSize;  ///< Size of a page of the data cache, in bytes.
+  UINT32                     DataPageCount; ///< Number of pages of the data cache.
+  FAT_DISK_CACHE_COUNTERS    Fat;           ///< Counters of the cache of the FAT.
+  FAT_DISK_CACHE_COUNTERS    Data;          ///< Counters of the cache of the directories and files.
+} FAT_DISK_CACHE_STATISTICS;
+
+extern EFI_GUID  gEdkiiFatDiskCacheStatisticsGuid;
+
+#endif
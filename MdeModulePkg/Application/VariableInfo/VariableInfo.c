@@ -19,12 +19,42 @@
 
 #include <Guid/VariableFormat.h>
 #include <Guid/SmmVariableCommon.h>
+#include <Guid/VariableReclaimStatistics.h>
 #include <Guid/PiSmmCommunicationRegionTable.h>
 #include <Protocol/MmCommunication2.h>
 #include <Protocol/SmmVariable.h>
 
 EFI_MM_COMMUNICATION2_PROTOCOL  *mMmCommunication2 = NULL;
 
+/**
+  This function prints the statistics of the reclaim of the non-volatile
+  variable store.
+
+  @param[in] Statistics    The reclaim statistics.
+
+**/
+VOID
+PrintReclaimStatistics (
+  IN VARIABLE_RECLAIM_STATISTICS  *Statistics
+  )
+{
+  Print (
+    L"Full reclaims: %d, incremental reclaims: %d\n",
+    Statistics->FullReclaimCount,
+    Statistics->IncrementalReclaimCount
+    );
+  Print (
+    L"Bytes written: %ld, bytes reclaimed: %ld\n",
+    Statistics->BytesWritten,
+    Statistics->BytesReclaimed
+    );
+  Print (
+    L"Stall time: %ld us, longest stall: %ld us\n",
+    DivU64x32 (Statistics->TotalStallTime, 1000),
+    DivU64x32 (Statistics->MaxStallTime, 1000)
+    );
+}
+
 /**
   This function get the variable statistics data from SMM variable driver.
 
@@ -80,6 +110,7 @@ PrintInfoFromSmm (
   )
 {
   EFI_STATUS                               Status;
+  EFI_STATUS                               ReclaimStatus;
   VARIABLE_INFO_ENTRY                      *VariableInfo;
   EFI_MM_COMMUNICATE_HEADER                *CommBuffer;
   UINTN                                    RealCommSize;
@@ -193,6 +224,18 @@ PrintInfoFromSmm (
     }
   } while (TRUE);
 
+  ZeroMem (CommBuffer, RealCommSize);
+  CopyGuid (&CommBuffer->HeaderGuid, &gEfiSmmVariableProtocolGuid);
+  CommSize                  = SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + sizeof (VARIABLE_RECLAIM_STATISTICS);
+  CommBuffer->MessageLength = CommSize - SMM_COMMUNICATE_HEADER_SIZE;
+  FunctionHeader            = (SMM_VARIABLE_COMMUNICATE_HEADER *)CommBuffer->Data;
+  FunctionHeader->Function  = SMM_VARIABLE_FUNCTION_GET_RECLAIM_STATISTICS;
+  ReclaimStatus             = mMmCommunication2->Communicate (mMmCommunication2, CommBuffer, CommBuffer, &CommSize);
+  if (!EFI_ERROR (ReclaimStatus) && !EFI_ERROR (FunctionHeader->ReturnStatus)) {
+    Print (L"SMM Driver Variable Reclaim:\n");
+    PrintReclaimStatistics ((VARIABLE_RECLAIM_STATISTICS *)FunctionHeader->Data);
+  }
+
   return Status;
 }
 
@@ -215,10 +258,11 @@ UefiMain (
   IN EFI_SYSTEM_TABLE  *SystemTable
   )
 {
-  EFI_STATUS           RuntimeDxeStatus;
-  EFI_STATUS           SmmStatus;
-  VARIABLE_INFO_ENTRY  *VariableInfo;
-  VARIABLE_INFO_ENTRY  *Entry;
+  EFI_STATUS                   RuntimeDxeStatus;
+  EFI_STATUS                   SmmStatus;
+  VARIABLE_INFO_ENTRY          *VariableInfo;
+  VARIABLE_INFO_ENTRY          *Entry;
+  VARIABLE_RECLAIM_STATISTICS  *ReclaimStatistics;
 
   RuntimeDxeStatus = EfiGetSystemConfigurationTable (&gEfiVariableGuid, (VOID **)&Entry);
   if (EFI_ERROR (RuntimeDxeStatus) || (Entry == NULL)) {
@@ -261,6 +305,13 @@ UefiMain (
 
       VariableInfo = VariableInfo->Next;
     } while (VariableInfo != NULL);
+
+    if (!EFI_ERROR (EfiGetSystemConfigurationTable (&gEdkiiVariableReclaimStatisticsGuid, (VOID **)&ReclaimStatistics)) &&
+        (ReclaimStatistics != NULL))
+    {
+      Print (L"Runtime DXE Driver Variable Reclaim:\n");
+      PrintReclaimStatistics (ReclaimStatistics);
+    }
   }
 
   SmmStatus = PrintInfoFromSmm ();
@@ -21,6 +21,14 @@ EFI_DRIVER_BINDING_PROTOCOL  gNvmExpressDriverBinding = {
   NULL
 };
 
+//
+// NVM Express Driver Binding Deferred Start Protocol Instance
+//
+EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  gNvmExpressDeferredStart = {
+  NvmExpressDeferredStartBegin,
+  NvmExpressDeferredStartPoll
+};
+
 //
 // NVM Express EFI Driver Supported EFI Version Protocol Instance
 //
@@ -879,6 +887,251 @@ Done:
   return Status;
 }
 
+/**
+  Allocate and initialize the private data of a controller, and the buffer of
+  its queues.
+
+  @param[in]  This                 A pointer to the EFI_DRIVER_BINDING_PROTOCOL instance.
+  @param[in]  Controller           The handle of the controller.
+  @param[in]  PciIo                The PCI I/O protocol of the controller.
+  @param[in]  ParentDevicePath     The device path of the controller.
+  @param[out] Private              Returns the private data of the controller.
+
+  @retval EFI_SUCCESS              The private data is allocated.
+  @retval Others                   The private data could not be allocated.
+
+**/
+EFI_STATUS
+NvmeAllocateController (
+  IN  EFI_DRIVER_BINDING_PROTOCOL   *This,
+  IN  EFI_HANDLE                    Controller,
+  IN  EFI_PCI_IO_PROTOCOL           *PciIo,
+  IN  EFI_DEVICE_PATH_PROTOCOL      *ParentDevicePath,
+  OUT NVME_CONTROLLER_PRIVATE_DATA  **Private
+  )
+{
+  EFI_STATUS                    Status;
+  NVME_CONTROLLER_PRIVATE_DATA  *NewPrivate;
+  EFI_PHYSICAL_ADDRESS          MappedAddr;
+  UINTN                         Bytes;
+
+  NewPrivate = AllocateZeroPool (sizeof (NVME_CONTROLLER_PRIVATE_DATA));
+
+  if (NewPrivate == NULL) {
+    DEBUG ((DEBUG_ERROR, "NvmExpressDriverBindingStart: allocating pool for Nvme Private Data failed!\n"));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NewPrivate->PciIo = PciIo;
+
+  //
+  // Save original PCI attributes
+  //
+  Status = PciIo->Attributes (
+                    PciIo,
+                    EfiPciIoAttributeOperationGet,
+                    0,
+                    &NewPrivate->PciAttributes
+                    );
+
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+
+  //
+  // Enable 64-bit DMA support in the PCI layer.
+  //
+  Status = PciIo->Attributes (
+                    PciIo,
+                    EfiPciIoAttributeOperationEnable,
+                    EFI_PCI_IO_ATTRIBUTE_DUAL_ADDRESS_CYCLE,
+                    NULL
+                    );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "NvmExpressDriverBindingStart: failed to enable 64-bit DMA (%r)\n", Status));
+  }
+
+  //
+  // 6 x 4kB aligned buffers will be carved out of this buffer.
+  // 1st 4kB boundary is the start of the admin submission queue.
+  // 2nd 4kB boundary is the start of the admin completion queue.
+  // 3rd 4kB boundary is the start of I/O submission queue #1.
+  // 4th 4kB boundary is the start of I/O completion queue #1.
+  // 5th 4kB boundary is the start of I/O submission queue #2.
+  // 6th 4kB boundary is the start of I/O completion queue #2.
+  //
+  // Allocate 6 pages of memory, then map it for bus master read and write.
+  //
+  Status = PciIo->AllocateBuffer (
+                    PciIo,
+                    AllocateAnyPages,
+                    EfiBootServicesData,
+                    6,
+                    (VOID **)&NewPrivate->Buffer,
+                    0
+                    );
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+
+  Bytes  = EFI_PAGES_TO_SIZE (6);
+  Status = PciIo->Map (
+                    PciIo,
+                    EfiPciIoOperationBusMasterCommonBuffer,
+                    NewPrivate->Buffer,
+                    &Bytes,
+                    &MappedAddr,
+                    &NewPrivate->Mapping
+                    );
+
+  if (!EFI_ERROR (Status) && (Bytes != EFI_PAGES_TO_SIZE (6))) {
+    Status = EFI_OUT_OF_RESOURCES;
+  }
+
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+
+  NewPrivate->BufferPciAddr = (UINT8 *)(UINTN)MappedAddr;
+
+  NewPrivate->Signature                 = NVME_CONTROLLER_PRIVATE_DATA_SIGNATURE;
+  NewPrivate->ControllerHandle          = Controller;
+  NewPrivate->ImageHandle               = This->DriverBindingHandle;
+  NewPrivate->DriverBindingHandle       = This->DriverBindingHandle;
+  NewPrivate->ParentDevicePath          = ParentDevicePath;
+  NewPrivate->Passthru.Mode             = &NewPrivate->PassThruMode;
+  NewPrivate->Passthru.PassThru         = NvmExpressPassThru;
+  NewPrivate->Passthru.GetNextNamespace = NvmExpressGetNextNamespace;
+  NewPrivate->Passthru.BuildDevicePath  = NvmExpressBuildDevicePath;
+  NewPrivate->Passthru.GetNamespace     = NvmExpressGetNamespace;
+  CopyMem (&NewPrivate->PassThruMode, &gEfiNvmExpressPassThruMode, sizeof (EFI_NVM_EXPRESS_PASS_THRU_MODE));
+  InitializeListHead (&NewPrivate->AsyncPassThruQueue);
+  InitializeListHead (&NewPrivate->UnsubmittedSubtasks);
+
+  *Private = NewPrivate;
+  return EFI_SUCCESS;
+
+Exit:
+  NvmeFreeController (NewPrivate);
+  return Status;
+}
+
+/**
+  Free the private data of a controller that could not be started.
+
+  @param[in]  Private              The private data of the controller.
+
+**/
+VOID
+NvmeFreeController (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  if (Private->Mapping != NULL) {
+    Private->PciIo->Unmap (Private->PciIo, Private->Mapping);
+  }
+
+  if (Private->Buffer != NULL) {
+    Private->PciIo->FreeBuffer (Private->PciIo, 6, Private->Buffer);
+  }
+
+  if (Private->ControllerData != NULL) {
+    FreePool (Private->ControllerData);
+  }
+
+  if (Private->TimerEvent != NULL) {
+    gBS->CloseEvent (Private->TimerEvent);
+  }
+
+  if (Private->ReadyTimeoutEvent != NULL) {
+    gBS->CloseEvent (Private->ReadyTimeoutEvent);
+  }
+
+  FreePool (Private);
+}
+
+/**
+  Start the asynchronous I/O completion monitor of an initialized controller,
+  and install its NVM Express Pass Thru protocol.
+
+  @param[in]  Private              The private data of the controller.
+
+  @retval EFI_SUCCESS              The controller is published.
+  @retval Others                   The controller could not be published.
+
+**/
+EFI_STATUS
+NvmePublishController (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+
+  //
+  // Start the asynchronous I/O completion monitor
+  //
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_NOTIFY,
+                  ProcessAsyncTaskList,
+                  Private,
+                  &Private->TimerEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->SetTimer (
+                  Private->TimerEvent,
+                  TimerPeriodic,
+                  NVME_HC_ASYNC_TIMER
+                  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->InstallMultipleProtocolInterfaces (
+                  &Private->ControllerHandle,
+                  &gEfiNvmExpressPassThruProtocolGuid,
+                  &Private->Passthru,
+                  NULL
+                  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  NvmeRegisterShutdownNotification ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Close the protocols opened by a start of the driver that failed.
+
+  @param[in]  This                 A pointer to the EFI_DRIVER_BINDING_PROTOCOL instance.
+  @param[in]  Controller           The handle of the controller.
+
+**/
+VOID
+NvmeCloseControllerProtocols (
+  IN EFI_DRIVER_BINDING_PROTOCOL  *This,
+  IN EFI_HANDLE                   Controller
+  )
+{
+  gBS->CloseProtocol (
+         Controller,
+         &gEfiPciIoProtocolGuid,
+         This->DriverBindingHandle,
+         Controller
+         );
+
+  gBS->CloseProtocol (
+         Controller,
+         &gEfiDevicePathProtocolGuid,
+         This->DriverBindingHandle,
+         Controller
+         );
+}
+
 /**
   Starts a device controller or a bus controller.
 
@@ -927,8 +1180,6 @@ NvmExpressDriverBindingStart (
   NVME_CONTROLLER_PRIVATE_DATA        *Private;
   EFI_DEVICE_PATH_PROTOCOL            *ParentDevicePath;
   UINT32                              NamespaceId;
-  EFI_PHYSICAL_ADDRESS                MappedAddr;
-  UINTN                               Bytes;
   EFI_NVM_EXPRESS_PASS_THRU_PROTOCOL  *Passthru;
 
   DEBUG ((DEBUG_INFO, "NvmExpressDriverBindingStart: start\n"));
@@ -966,134 +1217,20 @@ NvmExpressDriverBindingStart (
   // Check EFI_ALREADY_STARTED to reuse the original NVME_CONTROLLER_PRIVATE_DATA.
   //
   if (Status != EFI_ALREADY_STARTED) {
-    Private = AllocateZeroPool (sizeof (NVME_CONTROLLER_PRIVATE_DATA));
-
-    if (Private == NULL) {
-      DEBUG ((DEBUG_ERROR, "NvmExpressDriverBindingStart: allocating pool for Nvme Private Data failed!\n"));
-      Status = EFI_OUT_OF_RESOURCES;
-      goto Exit;
-    }
-
-    //
-    // Save original PCI attributes
-    //
-    Status = PciIo->Attributes (
-                      PciIo,
-                      EfiPciIoAttributeOperationGet,
-                      0,
-                      &Private->PciAttributes
-                      );
-
+    Status = NvmeAllocateController (This, Controller, PciIo, ParentDevicePath, &Private);
     if (EFI_ERROR (Status)) {
-      return Status;
-    }
-
-    //
-    // Enable 64-bit DMA support in the PCI layer.
-    //
-    Status = PciIo->Attributes (
-                      PciIo,
-                      EfiPciIoAttributeOperationEnable,
-                      EFI_PCI_IO_ATTRIBUTE_DUAL_ADDRESS_CYCLE,
-                      NULL
-                      );
-    if (EFI_ERROR (Status)) {
-      DEBUG ((DEBUG_WARN, "NvmExpressDriverBindingStart: failed to enable 64-bit DMA (%r)\n", Status));
-    }
-
-    //
-    // 6 x 4kB aligned buffers will be carved out of this buffer.
-    // 1st 4kB boundary is the start of the admin submission queue.
-    // 2nd 4kB boundary is the start of the admin completion queue.
-    // 3rd 4kB boundary is the start of I/O submission queue #1.
-    // 4th 4kB boundary is the start of I/O completion queue #1.
-    // 5th 4kB boundary is the start of I/O submission queue #2.
-    // 6th 4kB boundary is the start of I/O completion queue #2.
-    //
-    // Allocate 6 pages of memory, then map it for bus master read and write.
-    //
-    Status = PciIo->AllocateBuffer (
-                      PciIo,
-                      AllocateAnyPages,
-                      EfiBootServicesData,
-                      6,
-                      (VOID **)&Private->Buffer,
-                      0
-                      );
-    if (EFI_ERROR (Status)) {
-      goto Exit;
-    }
-
-    Bytes  = EFI_PAGES_TO_SIZE (6);
-    Status = PciIo->Map (
-                      PciIo,
-                      EfiPciIoOperationBusMasterCommonBuffer,
-                      Private->Buffer,
-                      &Bytes,
-                      &MappedAddr,
-                      &Private->Mapping
-                      );
-
-    if (EFI_ERROR (Status) || (Bytes != EFI_PAGES_TO_SIZE (6))) {
       goto Exit;
     }
 
-    Private->BufferPciAddr = (UINT8 *)(UINTN)MappedAddr;
-
-    Private->Signature                 = NVME_CONTROLLER_PRIVATE_DATA_SIGNATURE;
-    Private->ControllerHandle          = Controller;
-    Private->ImageHandle               = This->DriverBindingHandle;
-    Private->DriverBindingHandle       = This->DriverBindingHandle;
-    Private->PciIo                     = PciIo;
-    Private->ParentDevicePath          = ParentDevicePath;
-    Private->Passthru.Mode             = &Private->PassThruMode;
-    Private->Passthru.PassThru         = NvmExpressPassThru;
-    Private->Passthru.GetNextNamespace = NvmExpressGetNextNamespace;
-    Private->Passthru.BuildDevicePath  = NvmExpressBuildDevicePath;
-    Private->Passthru.GetNamespace     = NvmExpressGetNamespace;
-    CopyMem (&Private->PassThruMode, &gEfiNvmExpressPassThruMode, sizeof (EFI_NVM_EXPRESS_PASS_THRU_MODE));
-    InitializeListHead (&Private->AsyncPassThruQueue);
-    InitializeListHead (&Private->UnsubmittedSubtasks);
-
     Status = NvmeControllerInit (Private);
     if (EFI_ERROR (Status)) {
       goto Exit;
     }
 
-    //
-    // Start the asynchronous I/O completion monitor
-    //
-    Status = gBS->CreateEvent (
-                    EVT_TIMER | EVT_NOTIFY_SIGNAL,
-                    TPL_NOTIFY,
-                    ProcessAsyncTaskList,
-                    Private,
-                    &Private->TimerEvent
-                    );
-    if (EFI_ERROR (Status)) {
-      goto Exit;
-    }
-
-    Status = gBS->SetTimer (
-                    Private->TimerEvent,
-                    TimerPeriodic,
-                    NVME_HC_ASYNC_TIMER
-                    );
+    Status = NvmePublishController (Private);
     if (EFI_ERROR (Status)) {
       goto Exit;
     }
-
-    Status = gBS->InstallMultipleProtocolInterfaces (
-                    &Controller,
-                    &gEfiNvmExpressPassThruProtocolGuid,
-                    &Private->Passthru,
-                    NULL
-                    );
-    if (EFI_ERROR (Status)) {
-      goto Exit;
-    }
-
-    NvmeRegisterShutdownNotification ();
   } else {
     Status = gBS->OpenProtocol (
                     Controller,
@@ -1139,43 +1276,254 @@ NvmExpressDriverBindingStart (
   return EFI_SUCCESS;
 
 Exit:
-  if ((Private != NULL) && (Private->Mapping != NULL)) {
-    PciIo->Unmap (PciIo, Private->Mapping);
+  if (Private != NULL) {
+    NvmeFreeController (Private);
   }
 
-  if ((Private != NULL) && (Private->Buffer != NULL)) {
-    PciIo->FreeBuffer (PciIo, 6, Private->Buffer);
+  NvmeCloseControllerProtocols (This, Controller);
+
+  DEBUG ((DEBUG_INFO, "NvmExpressDriverBindingStart: end with %r\n", Status));
+
+  return Status;
+}
+
+/**
+  Arms the timeout of the current phase of a deferred start: Cap.To specifies
+  max delay time in 500ms increments for Csts.Rdy to clear after Cc.Enable is
+  cleared, and to set after Cc.Enable is set.
+
+  @param[in]  Private              The private data of the controller.
+
+  @retval EFI_SUCCESS              The timeout is armed.
+  @retval Others                   The timer event could not be created or set.
+
+**/
+EFI_STATUS
+NvmeStartReadyTimeout (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+  UINT8       Timeout;
+
+  //
+  // Use a new event, the previous one may have been signaled after the
+  // controller left its previous phase.
+  //
+  if (Private->ReadyTimeoutEvent != NULL) {
+    gBS->CloseEvent (Private->ReadyTimeoutEvent);
+    Private->ReadyTimeoutEvent = NULL;
   }
 
-  if ((Private != NULL) && (Private->ControllerData != NULL)) {
-    FreePool (Private->ControllerData);
+  Timeout = (Private->Cap.To == 0) ? 1 : Private->Cap.To;
+  Status  = gBS->CreateEvent (EVT_TIMER, TPL_CALLBACK, NULL, NULL, &Private->ReadyTimeoutEvent);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
+  return gBS->SetTimer (
+                Private->ReadyTimeoutEvent,
+                TimerRelative,
+                EFI_TIMER_PERIOD_MILLISECONDS (Timeout * 500)
+                );
+}
+
+/**
+  Begins to start the driver on a controller: disables the controller,
+  without waiting for it to become not ready.
+
+  Only the start that enumerates all the namespaces of a controller not
+  managed by the driver yet is deferred, the others are left to Start().
+
+  @param[in]  This                 The protocol instance.
+  @param[in]  Controller           The handle of the controller to start.
+  @param[in]  RemainingDevicePath  The remaining portion of the device path,
+                                   as passed to Start().
+  @param[out] Context              Returns the private data of the controller,
+                                   passed back to Poll().
+
+  @retval EFI_SUCCESS              The start has begun.
+  @retval EFI_UNSUPPORTED          The driver must be started with Start().
+  @retval Others                   The driver failed to start the device.
+
+**/
+EFI_STATUS
+EFIAPI
+NvmExpressDeferredStartBegin (
+  IN  EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  *This,
+  IN  EFI_HANDLE                                    Controller,
+  IN  EFI_DEVICE_PATH_PROTOCOL                      *RemainingDevicePath OPTIONAL,
+  OUT VOID                                          **Context
+  )
+{
+  EFI_STATUS                    Status;
+  EFI_PCI_IO_PROTOCOL           *PciIo;
+  NVME_CONTROLLER_PRIVATE_DATA  *Private;
+  EFI_DEVICE_PATH_PROTOCOL      *ParentDevicePath;
+
+  if (RemainingDevicePath != NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->OpenProtocol (
+                  Controller,
+                  &gEfiDevicePathProtocolGuid,
+                  (VOID **)&ParentDevicePath,
+                  gNvmExpressDriverBinding.DriverBindingHandle,
+                  Controller,
+                  EFI_OPEN_PROTOCOL_BY_DRIVER
+                  );
+  if (Status == EFI_ALREADY_STARTED) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->OpenProtocol (
+                  Controller,
+                  &gEfiPciIoProtocolGuid,
+                  (VOID **)&PciIo,
+                  gNvmExpressDriverBinding.DriverBindingHandle,
+                  Controller,
+                  EFI_OPEN_PROTOCOL_BY_DRIVER
+                  );
+  if (EFI_ERROR (Status)) {
+    gBS->CloseProtocol (
+           Controller,
+           &gEfiDevicePathProtocolGuid,
+           gNvmExpressDriverBinding.DriverBindingHandle,
+           Controller
+           );
+    return (Status == EFI_ALREADY_STARTED) ? EFI_UNSUPPORTED : Status;
+  }
+
+  Status = NvmeAllocateController (&gNvmExpressDriverBinding, Controller, PciIo, ParentDevicePath, &Private);
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+
+  Status = NvmeControllerInitBegin (Private);
+  if (!EFI_ERROR (Status)) {
+    Status = NvmeStartReadyTimeout (Private);
+  }
+
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+
+  *Context = Private;
+  return EFI_SUCCESS;
+
+Exit:
   if (Private != NULL) {
-    if (Private->TimerEvent != NULL) {
-      gBS->CloseEvent (Private->TimerEvent);
+    NvmeFreeController (Private);
+  }
+
+  NvmeCloseControllerProtocols (&gNvmExpressDriverBinding, Controller);
+
+  DEBUG ((DEBUG_INFO, "NvmExpressDeferredStartBegin: end with %r\n", Status));
+  return Status;
+}
+
+/**
+  Continues a start begun by NvmExpressDeferredStartBegin(): enables the
+  controller once it is disabled, then once it is ready identifies it, creates
+  its I/O queues, installs its NVM Express Pass Thru protocol and enumerates
+  its namespaces.
+
+  @param[in]  This                 The protocol instance.
+  @param[in]  Controller           The handle of the controller being started.
+  @param[in]  Context              The private data of the controller.
+
+  @retval EFI_NOT_READY            The controller is not disabled or not ready yet.
+  @retval EFI_SUCCESS              The device was started.
+  @retval Others                   The driver failed to start the device.
+
+**/
+EFI_STATUS
+EFIAPI
+NvmExpressDeferredStartPoll (
+  IN EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  *This,
+  IN EFI_HANDLE                                    Controller,
+  IN VOID                                          *Context
+  )
+{
+  EFI_STATUS                    Status;
+  NVME_CONTROLLER_PRIVATE_DATA  *Private;
+
+  Private = (NVME_CONTROLLER_PRIVATE_DATA *)Context;
+
+  if (!Private->Enabling) {
+    Status = NvmeCheckControllerDisabled (Private);
+    if (Status == EFI_NOT_READY) {
+      if (EFI_ERROR (gBS->CheckEvent (Private->ReadyTimeoutEvent))) {
+        return EFI_NOT_READY;
+      }
+
+      Status = EFI_DEVICE_ERROR;
+      REPORT_STATUS_CODE (
+        (EFI_ERROR_CODE | EFI_ERROR_MAJOR),
+        (EFI_IO_BUS_SCSI | EFI_IOB_EC_INTERFACE_ERROR)
+        );
+    }
+
+    DEBUG ((DEBUG_INFO, "NVMe controller is disabled with status [%r].\n", Status));
+
+    if (!EFI_ERROR (Status)) {
+      Status = NvmeControllerInitEnable (Private);
+    }
+
+    if (!EFI_ERROR (Status)) {
+      Status = NvmeStartReadyTimeout (Private);
     }
 
-    FreePool (Private);
+    if (EFI_ERROR (Status)) {
+      goto Exit;
+    }
+
+    Private->Enabling = TRUE;
   }
 
-  gBS->CloseProtocol (
-         Controller,
-         &gEfiPciIoProtocolGuid,
-         This->DriverBindingHandle,
-         Controller
-         );
+  Status = NvmeCheckControllerReady (Private);
+  if (Status == EFI_NOT_READY) {
+    if (EFI_ERROR (gBS->CheckEvent (Private->ReadyTimeoutEvent))) {
+      return EFI_NOT_READY;
+    }
 
-  gBS->CloseProtocol (
-         Controller,
-         &gEfiDevicePathProtocolGuid,
-         This->DriverBindingHandle,
-         Controller
-         );
+    Status = EFI_TIMEOUT;
+    REPORT_STATUS_CODE (
+      (EFI_ERROR_CODE | EFI_ERROR_MAJOR),
+      (EFI_IO_BUS_SCSI | EFI_IOB_EC_INTERFACE_ERROR)
+      );
+  }
 
-  DEBUG ((DEBUG_INFO, "NvmExpressDriverBindingStart: end with %r\n", Status));
+  DEBUG ((DEBUG_INFO, "NVMe controller is enabled with status [%r].\n", Status));
 
-  return Status;
+  gBS->CloseEvent (Private->ReadyTimeoutEvent);
+  Private->ReadyTimeoutEvent = NULL;
+
+  if (!EFI_ERROR (Status)) {
+    Status = NvmeControllerInitEnd (Private);
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Status = NvmePublishController (Private);
+  }
+
+Exit:
+  if (EFI_ERROR (Status)) {
+    NvmeFreeController (Private);
+    NvmeCloseControllerProtocols (&gNvmExpressDriverBinding, Controller);
+    DEBUG ((DEBUG_INFO, "NvmExpressDeferredStartPoll: end with %r\n", Status));
+    return Status;
+  }
+
+  DiscoverAllNamespaces (Private);
+
+  DEBUG ((DEBUG_INFO, "NvmExpressDeferredStartPoll: end successfully\n"));
+  return EFI_SUCCESS;
 }
 
 /**
@@ -1373,6 +1721,8 @@ NvmExpressUnload (
                   &gNvmExpressDriverBinding,
                   &gEfiDriverSupportedEfiVersionProtocolGuid,
                   &gNvmExpressDriverSupportedEfiVersion,
+                  &gEdkiiDriverBindingDeferredStartProtocolGuid,
+                  &gNvmExpressDeferredStart,
                   NULL
                   );
 
@@ -1459,13 +1809,17 @@ NvmExpressDriverEntry (
 
   //
   // Install EFI Driver Supported EFI Version Protocol required for
-  // EFI drivers that are on PCI and other plug in cards.
+  // EFI drivers that are on PCI and other plug in cards, and the Driver
+  // Binding Deferred Start Protocol so that the DXE core can overlap the
+  // time the controllers take to become ready.
   //
   gNvmExpressDriverSupportedEfiVersion.FirmwareVersion = 0x00020028;
   Status                                               = gBS->InstallMultipleProtocolInterfaces (
                                                                 &ImageHandle,
                                                                 &gEfiDriverSupportedEfiVersionProtocolGuid,
                                                                 &gNvmExpressDriverSupportedEfiVersion,
+                                                                &gEdkiiDriverBindingDeferredStartProtocolGuid,
+                                                                &gNvmExpressDeferredStart,
                                                                 NULL
                                                                 );
   ASSERT_EFI_ERROR (Status);
@@ -29,6 +29,7 @@
 #include <Protocol/DriverSupportedEfiVersion.h>
 #include <Protocol/StorageSecurityCommand.h>
 #include <Protocol/ResetNotification.h>
+#include <Protocol/DriverBindingDeferredStart.h>
 
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
@@ -48,10 +49,11 @@ typedef struct _NVME_DEVICE_PRIVATE_DATA      NVME_DEVICE_PRIVATE_DATA;
 #include "NvmExpressDiskInfo.h"
 #include "NvmExpressHci.h"
 
-extern EFI_DRIVER_BINDING_PROTOCOL                gNvmExpressDriverBinding;
-extern EFI_COMPONENT_NAME_PROTOCOL                gNvmExpressComponentName;
-extern EFI_COMPONENT_NAME2_PROTOCOL               gNvmExpressComponentName2;
-extern EFI_DRIVER_SUPPORTED_EFI_VERSION_PROTOCOL  gNvmExpressDriverSupportedEfiVersion;
+extern EFI_DRIVER_BINDING_PROTOCOL                   gNvmExpressDriverBinding;
+extern EFI_COMPONENT_NAME_PROTOCOL                   gNvmExpressComponentName;
+extern EFI_COMPONENT_NAME2_PROTOCOL                  gNvmExpressComponentName2;
+extern EFI_DRIVER_SUPPORTED_EFI_VERSION_PROTOCOL     gNvmExpressDriverSupportedEfiVersion;
+extern EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  gNvmExpressDeferredStart;
 
 #define PCI_CLASS_MASS_STORAGE_NVM  0x08                // mass storage sub-class non-volatile memory.
 #define PCI_IF_NVMHCI               0x02                // mass storage programming interface NVMHCI.
@@ -163,6 +165,14 @@ struct _NVME_CONTROLLER_PRIVATE_DATA {
   EFI_EVENT      TimerEvent;
   LIST_ENTRY     AsyncPassThruQueue;
   LIST_ENTRY     UnsubmittedSubtasks;
+
+  //
+  // During a deferred start, signaled when the controller fails to become not
+  // ready after it is disabled, then ready after it is enabled. Enabling is
+  // set once the controller is disabled and being enabled.
+  //
+  EFI_EVENT      ReadyTimeoutEvent;
+  BOOLEAN        Enabling;
 };
 
 #define NVME_CONTROLLER_PRIVATE_DATA_FROM_PASS_THRU(a) \
@@ -525,6 +535,67 @@ NvmExpressDriverBindingStart (
   IN EFI_DEVICE_PATH_PROTOCOL     *RemainingDevicePath
   );
 
+/**
+  Begins to start the driver on a controller: resets and enables the
+  controller, without waiting for it to become ready.
+
+  Only the start that enumerates all the namespaces of a controller not
+  managed by the driver yet is deferred, the others are left to Start().
+
+  @param[in]  This                 The protocol instance.
+  @param[in]  Controller           The handle of the controller to start.
+  @param[in]  RemainingDevicePath  The remaining portion of the device path,
+                                   as passed to Start().
+  @param[out] Context              Returns the private data of the controller,
+                                   passed back to Poll().
+
+  @retval EFI_SUCCESS              The start has begun.
+  @retval EFI_UNSUPPORTED          The driver must be started with Start().
+  @retval Others                   The driver failed to start the device.
+
+**/
+EFI_STATUS
+EFIAPI
+NvmExpressDeferredStartBegin (
+  IN  EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  *This,
+  IN  EFI_HANDLE                                    Controller,
+  IN  EFI_DEVICE_PATH_PROTOCOL                      *RemainingDevicePath OPTIONAL,
+  OUT VOID                                          **Context
+  );
+
+/**
+  Completes a start begun by NvmExpressDeferredStartBegin() once the
+  controller is ready: identifies the controller, creates its I/O queues,
+  installs its NVM Express Pass Thru protocol and enumerates its namespaces.
+
+  @param[in]  This                 The protocol instance.
+  @param[in]  Controller           The handle of the controller being started.
+  @param[in]  Context              The private data of the controller.
+
+  @retval EFI_NOT_READY            The controller is not ready yet.
+  @retval EFI_SUCCESS              The device was started.
+  @retval Others                   The driver failed to start the device.
+
+**/
+EFI_STATUS
+EFIAPI
+NvmExpressDeferredStartPoll (
+  IN EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  *This,
+  IN EFI_HANDLE                                    Controller,
+  IN VOID                                          *Context
+  );
+
+/**
+  Free the private data of a controller that could not be started.
+
+  @param[in]  Private              The private data of the controller.
+
+**/
+VOID
+NvmeFreeController (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  );
+
 /**
   Stops a device controller or a bus controller.
 
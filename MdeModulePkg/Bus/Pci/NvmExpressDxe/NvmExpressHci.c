@@ -301,7 +301,7 @@ WriteNvmeAdminCompletionQueueBaseAddress (
 }
 
 /**
-  Disable the Nvm Express controller.
+  Disable the Nvm Express controller, without waiting for it to become not ready.
 
   @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
 
@@ -315,10 +315,7 @@ NvmeDisableController (
   )
 {
   NVME_CC     Cc;
-  NVME_CSTS   Csts;
   EFI_STATUS  Status;
-  UINT32      Index;
-  UINT8       Timeout;
 
   //
   // Read Controller Configuration Register.
@@ -333,12 +330,53 @@ NvmeDisableController (
   //
   // Disable the controller.
   //
-  Status = WriteNvmeControllerConfiguration (Private, &Cc);
+  return WriteNvmeControllerConfiguration (Private, &Cc);
+}
+
+/**
+  Check if the Nvm Express controller is not ready any more after it was disabled.
+
+  @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @return EFI_SUCCESS      The controller is disabled.
+  @return EFI_NOT_READY    The controller is still ready.
+  @return EFI_DEVICE_ERROR Fail to read the controller status.
+
+**/
+EFI_STATUS
+NvmeCheckControllerDisabled (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  NVME_CSTS   Csts;
+  EFI_STATUS  Status;
 
+  Status = ReadNvmeControllerStatus (Private, &Csts);
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
+  return (Csts.Rdy == 0) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
+/**
+  Wait for the Nvm Express controller to become not ready after it was disabled.
+
+  @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @return EFI_SUCCESS      The controller is disabled.
+  @return EFI_DEVICE_ERROR Fail to disable the controller.
+
+**/
+EFI_STATUS
+NvmeWaitControllerDisabled (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Index;
+  UINT8       Timeout;
+
   //
   // Cap.To specifies max delay time in 500ms increments for Csts.Rdy to transition from 1 to 0 after
   // Cc.Enable transition from 1 to 0. Loop produces a 1 millisecond delay per itteration, up to 500 * Cap.To.
@@ -353,19 +391,18 @@ NvmeDisableController (
     gBS->Stall (1000);
 
     //
-    // Check if the controller is initialized
+    // Check if the controller is disabled
     //
-    Status = ReadNvmeControllerStatus (Private, &Csts);
-
-    if (EFI_ERROR (Status)) {
-      return Status;
-    }
-
-    if (Csts.Rdy == 0) {
+    Status = NvmeCheckControllerDisabled (Private);
+    if (Status != EFI_NOT_READY) {
       break;
     }
   }
 
+  if (EFI_ERROR (Status) && (Status != EFI_NOT_READY)) {
+    return Status;
+  }
+
   if (Index == 0) {
     Status = EFI_DEVICE_ERROR;
     REPORT_STATUS_CODE (
@@ -379,13 +416,12 @@ NvmeDisableController (
 }
 
 /**
-  Enable the Nvm Express controller.
+  Enable the Nvm Express controller, without waiting for it to become ready.
 
   @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
 
   @return EFI_SUCCESS      Successfully enable the controller.
   @return EFI_DEVICE_ERROR Fail to enable the controller.
-  @return EFI_TIMEOUT      Fail to enable the controller in given time slot.
 
 **/
 EFI_STATUS
@@ -393,11 +429,7 @@ NvmeEnableController (
   IN NVME_CONTROLLER_PRIVATE_DATA  *Private
   )
 {
-  NVME_CC     Cc;
-  NVME_CSTS   Csts;
-  EFI_STATUS  Status;
-  UINT32      Index;
-  UINT8       Timeout;
+  NVME_CC  Cc;
 
   //
   // Enable the controller.
@@ -408,11 +440,54 @@ NvmeEnableController (
   Cc.Iosqes = 6;
   Cc.Iocqes = 4;
 
-  Status = WriteNvmeControllerConfiguration (Private, &Cc);
+  return WriteNvmeControllerConfiguration (Private, &Cc);
+}
+
+/**
+  Check if the Nvm Express controller is ready after it was enabled.
+
+  @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @return EFI_SUCCESS      The controller is ready.
+  @return EFI_NOT_READY    The controller is not ready yet.
+  @return EFI_DEVICE_ERROR Fail to read the controller status.
+
+**/
+EFI_STATUS
+NvmeCheckControllerReady (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  NVME_CSTS   Csts;
+  EFI_STATUS  Status;
+
+  Status = ReadNvmeControllerStatus (Private, &Csts);
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
+  return (Csts.Rdy != 0) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
+/**
+  Wait for the Nvm Express controller to become ready after it was enabled.
+
+  @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @return EFI_SUCCESS      The controller is ready.
+  @return EFI_DEVICE_ERROR Fail to read the controller status.
+  @return EFI_TIMEOUT      The controller is not ready in given time slot.
+
+**/
+EFI_STATUS
+NvmeWaitControllerReady (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Index;
+  UINT8       Timeout;
+
   //
   // Cap.To specifies max delay time in 500ms increments for Csts.Rdy to set after
   // Cc.Enable. Loop produces a 1 millisecond delay per itteration, up to 500 * Cap.To.
@@ -429,17 +504,16 @@ NvmeEnableController (
     //
     // Check if the controller is initialized
     //
-    Status = ReadNvmeControllerStatus (Private, &Csts);
-
-    if (EFI_ERROR (Status)) {
-      return Status;
-    }
-
-    if (Csts.Rdy) {
+    Status = NvmeCheckControllerReady (Private);
+    if (Status != EFI_NOT_READY) {
       break;
     }
   }
 
+  if (EFI_ERROR (Status) && (Status != EFI_NOT_READY)) {
+    return Status;
+  }
+
   if (Index == 0) {
     Status = EFI_TIMEOUT;
     REPORT_STATUS_CODE (
@@ -705,27 +779,23 @@ NvmeCreateIoSubmissionQueue (
 }
 
 /**
-  Initialize the Nvm Express controller.
+  Begin to initialize the Nvm Express controller: enable it on PCI and disable
+  it, without waiting for it to become not ready.
 
   @param[in] Private                 The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
 
-  @retval EFI_SUCCESS                The NVM Express Controller is initialized successfully.
+  @retval EFI_SUCCESS                The NVM Express Controller is being disabled.
   @retval Others                     A device error occurred while initializing the controller.
 
 **/
 EFI_STATUS
-NvmeControllerInit (
+NvmeControllerInitBegin (
   IN NVME_CONTROLLER_PRIVATE_DATA  *Private
   )
 {
   EFI_STATUS           Status;
   EFI_PCI_IO_PROTOCOL  *PciIo;
   UINT64               Supports;
-  NVME_AQA             Aqa;
-  NVME_ASQ             Asq;
-  NVME_ACQ             Acq;
-  UINT8                Sn[21];
-  UINT8                Mn[41];
 
   //
   // Enable this controller.
@@ -785,11 +855,28 @@ NvmeControllerInit (
   Private->CqHdbl[2].Cqh = 0;
   Private->AsyncSqHead   = 0;
 
-  Status = NvmeDisableController (Private);
+  return NvmeDisableController (Private);
+}
 
-  if (EFI_ERROR (Status)) {
-    return Status;
-  }
+/**
+  Continue to initialize the Nvm Express controller once it is disabled: program
+  the admin queues and enable it, without waiting for it to become ready.
+
+  @param[in] Private                 The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @retval EFI_SUCCESS                The NVM Express Controller is being enabled.
+  @retval Others                     A device error occurred while initializing the controller.
+
+**/
+EFI_STATUS
+NvmeControllerInitEnable (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+  NVME_AQA    Aqa;
+  NVME_ASQ    Asq;
+  NVME_ACQ    Acq;
 
   //
   // set number of entries admin submission & completion queues.
@@ -863,10 +950,27 @@ NvmeControllerInit (
     return Status;
   }
 
-  Status = NvmeEnableController (Private);
-  if (EFI_ERROR (Status)) {
-    return Status;
-  }
+  return NvmeEnableController (Private);
+}
+
+/**
+  Complete the initialization of the Nvm Express controller once it is ready:
+  identify it and create the I/O queues.
+
+  @param[in] Private                 The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @retval EFI_SUCCESS                The NVM Express Controller is initialized successfully.
+  @retval Others                     A device error occurred while initializing the controller.
+
+**/
+EFI_STATUS
+NvmeControllerInitEnd (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+  UINT8       Sn[21];
+  UINT8       Mn[41];
 
   //
   // Allocate buffer for Identify Controller data
@@ -930,6 +1034,45 @@ NvmeControllerInit (
   return Status;
 }
 
+/**
+  Initialize the Nvm Express controller.
+
+  @param[in] Private                 The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @retval EFI_SUCCESS                The NVM Express Controller is initialized successfully.
+  @retval Others                     A device error occurred while initializing the controller.
+
+**/
+EFI_STATUS
+NvmeControllerInit (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = NvmeControllerInitBegin (Private);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = NvmeWaitControllerDisabled (Private);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = NvmeControllerInitEnable (Private);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = NvmeWaitControllerReady (Private);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return NvmeControllerInitEnd (Private);
+}
+
 /**
  This routine is called to properly shutdown the Nvm Express controller per NVMe spec.
 
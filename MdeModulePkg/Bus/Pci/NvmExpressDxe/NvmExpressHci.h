@@ -32,6 +32,81 @@ NvmeControllerInit (
   IN NVME_CONTROLLER_PRIVATE_DATA  *Private
   );
 
+/**
+  Begin to initialize the Nvm Express controller: enable it on PCI and disable
+  it, without waiting for it to become not ready.
+
+  @param[in] Private                 The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @retval EFI_SUCCESS                The NVM Express Controller is being disabled.
+  @retval Others                     A device error occurred while initializing the controller.
+
+**/
+EFI_STATUS
+NvmeControllerInitBegin (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  );
+
+/**
+  Check if the Nvm Express controller is not ready any more after it was disabled.
+
+  @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @return EFI_SUCCESS      The controller is disabled.
+  @return EFI_NOT_READY    The controller is still ready.
+  @return EFI_DEVICE_ERROR Fail to read the controller status.
+
+**/
+EFI_STATUS
+NvmeCheckControllerDisabled (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  );
+
+/**
+  Continue to initialize the Nvm Express controller once it is disabled: program
+  the admin queues and enable it, without waiting for it to become ready.
+
+  @param[in] Private                 The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @retval EFI_SUCCESS                The NVM Express Controller is being enabled.
+  @retval Others                     A device error occurred while initializing the controller.
+
+**/
+EFI_STATUS
+NvmeControllerInitEnable (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  );
+
+/**
+  Check if the Nvm Express controller is ready after it was enabled.
+
+  @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @return EFI_SUCCESS      The controller is ready.
+  @return EFI_NOT_READY    The controller is not ready yet.
+  @return EFI_DEVICE_ERROR Fail to read the controller status.
+
+**/
+EFI_STATUS
+NvmeCheckControllerReady (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  );
+
+/**
+  Complete the initialization of the Nvm Express controller once it is ready:
+  identify it and create the I/O queues.
+
+  @param[in] Private                 The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @retval EFI_SUCCESS                The NVM Express Controller is initialized successfully.
+  @retval Others                     A device error occurred while initializing the controller.
+
+**/
+EFI_STATUS
+NvmeControllerInitEnd (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  );
+
 /**
   Get identify controller data.
 
@@ -66,6 +66,44 @@ BOOLEAN  gDispatcherRunning = FALSE;
 EFI_EVENT  mFwVolEvent;
 VOID       *mFwVolEventRegistration;
 
+//
+// Reverse index from the protocols pushed by the Depex of the discovered
+// drivers to these drivers. Installing a protocol only marks the Depex of
+// the drivers that push it as stale, and a dispatcher pass only evaluates
+// the stale Depex instead of the Depex of every Dependent driver. Entries
+// are never removed, like the entries of mDiscoveredList. Protected by
+// mDispatcherLock.
+//
+#define DEPEX_PROTOCOL_HASH_BITS  6
+#define DEPEX_PROTOCOL_HASH_SIZE  (1 << DEPEX_PROTOCOL_HASH_BITS)
+
+typedef struct _DEPEX_PROTOCOL_DRIVER DEPEX_PROTOCOL_DRIVER;
+struct _DEPEX_PROTOCOL_DRIVER {
+  DEPEX_PROTOCOL_DRIVER    *Next;
+  EFI_CORE_DRIVER_ENTRY    *DriverEntry;
+};
+
+typedef struct _DEPEX_PROTOCOL DEPEX_PROTOCOL;
+struct _DEPEX_PROTOCOL {
+  DEPEX_PROTOCOL           *Next;
+  EFI_GUID                 ProtocolGuid;
+  DEPEX_PROTOCOL_DRIVER    *Drivers;
+};
+
+DEPEX_PROTOCOL  *mDepexProtocolHashTable[DEPEX_PROTOCOL_HASH_SIZE];
+
+//
+// Depex evaluation counters of all dispatcher passes
+//
+typedef struct {
+  UINTN    Passes;
+  UINTN    Evaluated;
+  UINTN    Skipped;
+  UINTN    Scheduled;
+} DISPATCHER_STATISTICS;
+
+DISPATCHER_STATISTICS  mDispatcherStatistics;
+
 //
 // List of file types supported by dispatcher
 //
@@ -219,6 +257,258 @@ CoreReleaseDispatcherLock (
   CoreReleaseLock (&mDispatcherLock);
 }
 
+/**
+  Computes the bucket of a protocol in the reverse index of the dispatcher.
+
+  @param  ProtocolGuid          The protocol.
+
+  @return The bucket of the protocol.
+
+**/
+STATIC
+UINTN
+CoreDepexProtocolHash (
+  IN EFI_GUID  *ProtocolGuid
+  )
+{
+  UINT32  Hash;
+
+  Hash = ReadUnaligned32 ((UINT32 *)ProtocolGuid) ^ ReadUnaligned32 ((UINT32 *)ProtocolGuid + 3);
+  return (Hash ^ (Hash >> 16)) & (DEPEX_PROTOCOL_HASH_SIZE - 1);
+}
+
+/**
+  Finds a protocol in the reverse index of the dispatcher. The caller must
+  hold mDispatcherLock.
+
+  @param  ProtocolGuid          The protocol to find.
+
+  @return The entry of the protocol, or NULL if no Depex pushes it.
+
+**/
+STATIC
+DEPEX_PROTOCOL *
+CoreFindDepexProtocol (
+  IN EFI_GUID  *ProtocolGuid
+  )
+{
+  DEPEX_PROTOCOL  *Protocol;
+
+  for (Protocol = mDepexProtocolHashTable[CoreDepexProtocolHash (ProtocolGuid)]; Protocol != NULL; Protocol = Protocol->Next) {
+    if (CompareGuid (&Protocol->ProtocolGuid, ProtocolGuid)) {
+      return Protocol;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Links a driver to a protocol of the reverse index, adding the protocol to
+  the index if needed.
+
+  @param  ProtocolGuid          The protocol pushed by the Depex of the driver.
+  @param  Reference             The link of the driver to the protocol.
+
+  @retval EFI_SUCCESS           The driver was linked to the protocol.
+  @retval EFI_OUT_OF_RESOURCES  The protocol could not be added to the index.
+
+**/
+STATIC
+EFI_STATUS
+CoreLinkDepexProtocol (
+  IN     EFI_GUID               *ProtocolGuid,
+  IN OUT DEPEX_PROTOCOL_DRIVER  *Reference
+  )
+{
+  DEPEX_PROTOCOL  *Protocol;
+  DEPEX_PROTOCOL  *NewProtocol;
+  UINTN           Hash;
+
+  NewProtocol = NULL;
+  while (TRUE) {
+    CoreAcquireDispatcherLock ();
+
+    Protocol = CoreFindDepexProtocol (ProtocolGuid);
+    if ((Protocol == NULL) && (NewProtocol != NULL)) {
+      Hash                          = CoreDepexProtocolHash (ProtocolGuid);
+      NewProtocol->Next             = mDepexProtocolHashTable[Hash];
+      mDepexProtocolHashTable[Hash] = NewProtocol;
+      Protocol                      = NewProtocol;
+      NewProtocol                   = NULL;
+    }
+
+    if (Protocol != NULL) {
+      Reference->Next   = Protocol->Drivers;
+      Protocol->Drivers = Reference;
+    }
+
+    CoreReleaseDispatcherLock ();
+
+    if (Protocol != NULL) {
+      break;
+    }
+
+    //
+    // The index can be updated from the FV notification while the dispatcher
+    // updates it, so the lookup is done again once the entry is allocated
+    //
+    NewProtocol = AllocatePool (sizeof (DEPEX_PROTOCOL));
+    if (NewProtocol == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    CopyGuid (&NewProtocol->ProtocolGuid, ProtocolGuid);
+    NewProtocol->Drivers = NULL;
+  }
+
+  if (NewProtocol != NULL) {
+    CoreFreePool (NewProtocol);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Precompiles the Depex of a driver by linking the driver to the protocols
+  pushed by its Depex in the reverse index of the dispatcher. If the Depex
+  cannot be indexed, it is evaluated on every dispatcher pass.
+
+  @param  DriverEntry           The driver whose Depex was read.
+
+**/
+STATIC
+VOID
+CoreIndexDepex (
+  IN OUT EFI_CORE_DRIVER_ENTRY  *DriverEntry
+  )
+{
+  UINT8                  *Iterator;
+  UINT8                  *End;
+  UINTN                  Count;
+  UINTN                  Index;
+  DEPEX_PROTOCOL_DRIVER  *References;
+  EFI_STATUS             Status;
+
+  DriverEntry->DepexIndexed = FALSE;
+  DriverEntry->DepexStale   = TRUE;
+
+  //
+  // Count the PUSH opcodes, leaving malformed expressions to the evaluator
+  //
+  Iterator = DriverEntry->Depex;
+  End      = Iterator + DriverEntry->DepexSize;
+  Count    = 0;
+  while (TRUE) {
+    if (Iterator >= End) {
+      return;
+    }
+
+    if (*Iterator == EFI_DEP_END) {
+      break;
+    }
+
+    switch (*Iterator) {
+      case EFI_DEP_PUSH:
+        Count++;
+      //
+      // Fall through
+      //
+      case EFI_DEP_BEFORE:
+      case EFI_DEP_AFTER:
+      case EFI_DEP_REPLACE_TRUE:
+        if ((UINTN)(End - Iterator) <= sizeof (EFI_GUID)) {
+          return;
+        }
+
+        Iterator += sizeof (EFI_GUID);
+        break;
+
+      case EFI_DEP_AND:
+      case EFI_DEP_OR:
+      case EFI_DEP_NOT:
+      case EFI_DEP_TRUE:
+      case EFI_DEP_FALSE:
+      case EFI_DEP_SOR:
+        break;
+
+      default:
+        return;
+    }
+
+    Iterator++;
+  }
+
+  References = NULL;
+  if (Count > 0) {
+    References = AllocatePool (Count * sizeof (DEPEX_PROTOCOL_DRIVER));
+    if (References == NULL) {
+      return;
+    }
+  }
+
+  Iterator = DriverEntry->Depex;
+  Index    = 0;
+  while (*Iterator != EFI_DEP_END) {
+    switch (*Iterator) {
+      case EFI_DEP_PUSH:
+        References[Index].DriverEntry = DriverEntry;
+        Status                        = CoreLinkDepexProtocol ((EFI_GUID *)(Iterator + 1), &References[Index]);
+        if (EFI_ERROR (Status)) {
+          //
+          // The references linked so far stay in the index, they only cause
+          // extra evaluations
+          //
+          return;
+        }
+
+        Index++;
+      //
+      // Fall through
+      //
+      case EFI_DEP_BEFORE:
+      case EFI_DEP_AFTER:
+      case EFI_DEP_REPLACE_TRUE:
+        Iterator += sizeof (EFI_GUID);
+        break;
+
+      default:
+        break;
+    }
+
+    Iterator++;
+  }
+
+  DriverEntry->DepexIndexed = TRUE;
+}
+
+/**
+  Marks the Depex of the drivers that push a protocol as stale, so that they
+  are evaluated again on the next dispatcher pass.
+
+  @param  Protocol              The protocol that was installed.
+
+**/
+VOID
+CoreDispatcherProtocolInstalled (
+  IN EFI_GUID  *Protocol
+  )
+{
+  DEPEX_PROTOCOL         *DepexProtocol;
+  DEPEX_PROTOCOL_DRIVER  *Reference;
+
+  CoreAcquireDispatcherLock ();
+
+  DepexProtocol = CoreFindDepexProtocol (Protocol);
+  if (DepexProtocol != NULL) {
+    for (Reference = DepexProtocol->Drivers; Reference != NULL; Reference = Reference->Next) {
+      Reference->DriverEntry->DepexStale = TRUE;
+    }
+  }
+
+  CoreReleaseDispatcherLock ();
+}
+
 /**
   Read Depex and pre-process the Depex for Before and After. If Section Extraction
   protocol returns an error via ReadSection defer the reading of the Depex.
@@ -269,6 +559,8 @@ CoreGetDepexSectionAndPreProccess (
       DriverEntry->Depex              = NULL;
       DriverEntry->Dependent          = TRUE;
       DriverEntry->DepexProtocolError = FALSE;
+      DriverEntry->DepexIndexed       = FALSE;
+      DriverEntry->DepexStale         = TRUE;
     }
   } else {
     //
@@ -276,6 +568,7 @@ CoreGetDepexSectionAndPreProccess (
     // Driver will be put in Dependent or Unrequested state
     //
     CorePreProcessDepex (DriverEntry);
+    CoreIndexDepex (DriverEntry);
     DriverEntry->DepexProtocolError = FALSE;
   }
 
@@ -321,6 +614,7 @@ CoreSchedule (
       CoreAcquireDispatcherLock ();
       DriverEntry->Unrequested = FALSE;
       DriverEntry->Dependent   = TRUE;
+      DriverEntry->DepexStale  = TRUE;
       CoreReleaseDispatcherLock ();
 
       DEBUG ((DEBUG_DISPATCH, "Schedule FFS(%g) - EFI_SUCCESS\n", DriverName));
@@ -407,6 +701,7 @@ CoreDispatcher (
   EFI_CORE_DRIVER_ENTRY  *DriverEntry;
   BOOLEAN                ReadyToRun;
   EFI_EVENT              DxeDispatchEvent;
+  DISPATCHER_STATISTICS  Pass;
 
   PERF_FUNCTION_BEGIN ();
 
@@ -538,8 +833,12 @@ CoreDispatcher (
     }
 
     //
-    // Search DriverList for items to place on Scheduled Queue
+    // Search DriverList for items to place on Scheduled Queue. Only the Depex
+    // that are stale are evaluated, the list is still walked in order so that
+    // drivers are scheduled in the order they were discovered.
     //
+    PERF_INMODULE_BEGIN ("DepexEval");
+    ZeroMem (&Pass, sizeof (Pass));
     ReadyToRun = FALSE;
     for (Link = mDiscoveredList.ForwardLink; Link != &mDiscoveredList; Link = Link->ForwardLink) {
       DriverEntry = CR (Link, EFI_CORE_DRIVER_ENTRY, Link, EFI_CORE_DRIVER_ENTRY_SIGNATURE);
@@ -552,9 +851,21 @@ CoreDispatcher (
       }
 
       if (DriverEntry->Dependent) {
+        if (DriverEntry->DepexIndexed && !DriverEntry->DepexStale) {
+          Pass.Skipped++;
+          continue;
+        }
+
+        //
+        // Clear the flag first, so that a protocol installed while the Depex
+        // is evaluated marks it stale again
+        //
+        DriverEntry->DepexStale = FALSE;
+        Pass.Evaluated++;
         if (CoreIsSchedulable (DriverEntry)) {
           CoreInsertOnScheduledQueueWhileProcessingBeforeAndAfter (DriverEntry);
           ReadyToRun = TRUE;
+          Pass.Scheduled++;
         }
       } else {
         if (DriverEntry->Unrequested) {
@@ -564,8 +875,32 @@ CoreDispatcher (
         }
       }
     }
+
+    PERF_INMODULE_END ("DepexEval");
+
+    mDispatcherStatistics.Passes++;
+    mDispatcherStatistics.Evaluated += Pass.Evaluated;
+    mDispatcherStatistics.Skipped   += Pass.Skipped;
+    mDispatcherStatistics.Scheduled += Pass.Scheduled;
+    DEBUG ((
+      DEBUG_DISPATCH,
+      "Dispatcher pass %u: %u Depex evaluated, %u skipped, %u drivers scheduled\n",
+      (UINT32)mDispatcherStatistics.Passes,
+      (UINT32)Pass.Evaluated,
+      (UINT32)Pass.Skipped,
+      (UINT32)Pass.Scheduled
+      ));
   } while (ReadyToRun);
 
+  DEBUG ((
+    DEBUG_DISPATCH,
+    "Dispatcher total: %u passes, %u Depex evaluated, %u skipped, %u drivers scheduled\n",
+    (UINT32)mDispatcherStatistics.Passes,
+    (UINT32)mDispatcherStatistics.Evaluated,
+    (UINT32)mDispatcherStatistics.Skipped,
+    (UINT32)mDispatcherStatistics.Scheduled
+    ));
+
   //
   // Close DXE dispatch Event
   //
@@ -0,0 +1,425 @@
+/** @file
+  Host-based unit tests for the red-black tree indexes over the DXE core
+  memory map.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../Mem/MemoryMapIndex.h"
+
+#define UNIT_TEST_APP_NAME     "DXE Core Memory Map Index Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_SLOT_COUNT  512
+#define TEST_ITERATIONS  20000
+
+//
+// Every slot owns a disjoint window of the address space, so that entries
+// never overlap.
+//
+#define TEST_SLOT_WINDOW  SIZE_1MB
+
+STATIC MEMORY_MAP  mEntries[TEST_SLOT_COUNT];
+STATIC BOOLEAN     mInIndex[TEST_SLOT_COUNT];
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @param  Seed  The generator state.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  IN OUT UINT32  *Seed
+  )
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return (*Seed >> 8);
+}
+
+/**
+  Checks the red-black and the size augmentation invariants of a subtree.
+
+  @param  Index                  The index.
+  @param  Node                   The root of the subtree.
+  @param  Low                    All start addresses must be at least Low.
+  @param  High                   All start addresses must be at most High.
+  @param  Count                  Incremented by the number of nodes.
+
+  @return The black height of the subtree, or -1 if an invariant is broken.
+
+**/
+STATIC
+INTN
+CheckSubtree (
+  IN     MEMORY_MAP_INDEX  *Index,
+  IN     MEMORY_MAP_NODE   *Node,
+  IN     UINT64            Low,
+  IN     UINT64            High,
+  IN OUT UINTN             *Count
+  )
+{
+  MEMORY_MAP  *Entry;
+  UINT64      MaxSize;
+  INTN        LeftHeight;
+  INTN        RightHeight;
+
+  if (Node == NULL) {
+    return 1;
+  }
+
+  (*Count)++;
+  Entry = (MEMORY_MAP *)((UINT8 *)Node - Index->NodeOffset);
+  if ((Entry->Start < Low) || (Entry->Start > High)) {
+    return -1;
+  }
+
+  if (Node->Red && ((Node->Left != NULL && Node->Left->Red) || (Node->Right != NULL && Node->Right->Red))) {
+    return -1;
+  }
+
+  if (((Node->Left != NULL) && (Node->Left->Parent != Node)) ||
+      ((Node->Right != NULL) && (Node->Right->Parent != Node)))
+  {
+    return -1;
+  }
+
+  MaxSize = Entry->End - Entry->Start + 1;
+  if ((Node->Left != NULL) && (Node->Left->MaxSize > MaxSize)) {
+    MaxSize = Node->Left->MaxSize;
+  }
+
+  if ((Node->Right != NULL) && (Node->Right->MaxSize > MaxSize)) {
+    MaxSize = Node->Right->MaxSize;
+  }
+
+  if (MaxSize != Node->MaxSize) {
+    return -1;
+  }
+
+  LeftHeight  = CheckSubtree (Index, Node->Left, Low, Entry->Start, Count);
+  RightHeight = CheckSubtree (Index, Node->Right, Entry->Start, High, Count);
+  if ((LeftHeight < 0) || (LeftHeight != RightHeight)) {
+    return -1;
+  }
+
+  return LeftHeight + (Node->Red ? 0 : 1);
+}
+
+/**
+  Checks all invariants of an index.
+
+  @param  Index                  The index.
+
+  @retval TRUE                   The index is consistent.
+  @retval FALSE                  An invariant is broken.
+
+**/
+STATIC
+BOOLEAN
+CheckIndex (
+  IN MEMORY_MAP_INDEX  *Index
+  )
+{
+  UINTN  Count;
+
+  Count = 0;
+  if ((Index->Root != NULL) && (Index->Root->Red || (Index->Root->Parent != NULL))) {
+    return FALSE;
+  }
+
+  if (CheckSubtree (Index, Index->Root, 0, MAX_UINT64, &Count) < 0) {
+    return FALSE;
+  }
+
+  return (BOOLEAN)(Count == Index->Count);
+}
+
+/**
+  Reference implementation of MemoryMapIndexFind().
+
+  @param  Address                The address to look up.
+
+  @return The expected descriptor.
+
+**/
+STATIC
+MEMORY_MAP *
+ReferenceFind (
+  IN UINT64  Address
+  )
+{
+  MEMORY_MAP  *Found;
+  UINTN       Slot;
+
+  Found = NULL;
+  for (Slot = 0; Slot < TEST_SLOT_COUNT; Slot++) {
+    if (mInIndex[Slot] && (mEntries[Slot].Start <= Address)) {
+      if ((Found == NULL) || (mEntries[Slot].Start > Found->Start)) {
+        Found = &mEntries[Slot];
+      }
+    }
+  }
+
+  return Found;
+}
+
+/**
+  Reference implementation of MemoryMapIndexFindBelow().
+
+  @param  Limit                  The descriptor must start below this address.
+  @param  MinSize                The minimum size of the descriptor range.
+
+  @return The expected descriptor.
+
+**/
+STATIC
+MEMORY_MAP *
+ReferenceFindBelow (
+  IN UINT64  Limit,
+  IN UINT64  MinSize
+  )
+{
+  MEMORY_MAP  *Found;
+  UINTN       Slot;
+
+  Found = NULL;
+  for (Slot = 0; Slot < TEST_SLOT_COUNT; Slot++) {
+    if (mInIndex[Slot] &&
+        (mEntries[Slot].Start < Limit) &&
+        (mEntries[Slot].End - mEntries[Slot].Start + 1 >= MinSize))
+    {
+      if ((Found == NULL) || (mEntries[Slot].Start > Found->Start)) {
+        Found = &mEntries[Slot];
+      }
+    }
+  }
+
+  return Found;
+}
+
+/**
+  Inserts, removes and shrinks random descriptors, and compares the lookups
+  against a linear scan after every step.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+RandomOperationsMatchLinearScan (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  MEMORY_MAP_INDEX  Index = MEMORY_MAP_INDEX_INIT (FreeNode);
+  UINT32            Seed;
+  UINTN             Iteration;
+  UINTN             Slot;
+  UINT64            Base;
+  UINT64            Pages;
+  UINT64            Address;
+  UINT64            MinSize;
+
+  ZeroMem (mEntries, sizeof (mEntries));
+  ZeroMem (mInIndex, sizeof (mInIndex));
+  Seed = 0x1234;
+
+  for (Iteration = 0; Iteration < TEST_ITERATIONS; Iteration++) {
+    Slot = NextRandom (&Seed) % TEST_SLOT_COUNT;
+    Base = (UINT64)Slot * TEST_SLOT_WINDOW;
+    if (!mInIndex[Slot]) {
+      Pages                 = 1 + NextRandom (&Seed) % (TEST_SLOT_WINDOW / EFI_PAGE_SIZE);
+      mEntries[Slot].Start  = Base;
+      mEntries[Slot].End    = Base + EFI_PAGES_TO_SIZE ((UINTN)Pages) - 1;
+      MemoryMapIndexInsert (&Index, &mEntries[Slot]);
+      mInIndex[Slot] = TRUE;
+    } else if ((NextRandom (&Seed) % 2 == 0) && (mEntries[Slot].End - mEntries[Slot].Start >= EFI_PAGE_SIZE)) {
+      //
+      // Clip one page from the start or the end
+      //
+      if (NextRandom (&Seed) % 2 == 0) {
+        mEntries[Slot].Start += EFI_PAGE_SIZE;
+      } else {
+        mEntries[Slot].End -= EFI_PAGE_SIZE;
+      }
+
+      MemoryMapIndexUpdate (&Index, &mEntries[Slot]);
+    } else {
+      MemoryMapIndexRemove (&Index, &mEntries[Slot]);
+      mInIndex[Slot] = FALSE;
+    }
+
+    UT_ASSERT_TRUE (CheckIndex (&Index));
+
+    Address = (UINT64)(NextRandom (&Seed) % TEST_SLOT_COUNT) * TEST_SLOT_WINDOW + EFI_PAGES_TO_SIZE (NextRandom (&Seed) % 256);
+    UT_ASSERT_TRUE (MemoryMapIndexFind (&Index, Address) == ReferenceFind (Address));
+
+    MinSize = EFI_PAGES_TO_SIZE (1 + NextRandom (&Seed) % 256);
+    UT_ASSERT_TRUE (MemoryMapIndexFindBelow (&Index, Address, MinSize) == ReferenceFindBelow (Address, MinSize));
+    UT_ASSERT_TRUE (MemoryMapIndexFindBelow (&Index, MAX_UINT64, MinSize) == ReferenceFindBelow (MAX_UINT64, MinSize));
+  }
+
+  for (Slot = 0; Slot < TEST_SLOT_COUNT; Slot++) {
+    if (mInIndex[Slot]) {
+      MemoryMapIndexRemove (&Index, &mEntries[Slot]);
+      mInIndex[Slot] = FALSE;
+    }
+  }
+
+  UT_ASSERT_TRUE (Index.Root == NULL);
+  UT_ASSERT_EQUAL (Index.Count, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A tree built from sorted insertions stays balanced.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+SortedInsertionsStayBalanced (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  MEMORY_MAP_INDEX  Index = MEMORY_MAP_INDEX_INIT (AddressNode);
+  MEMORY_MAP_NODE   *Node;
+  UINTN             Slot;
+  UINTN             Depth;
+
+  ZeroMem (mEntries, sizeof (mEntries));
+  for (Slot = 0; Slot < TEST_SLOT_COUNT; Slot++) {
+    mEntries[Slot].Start = (UINT64)Slot * TEST_SLOT_WINDOW;
+    mEntries[Slot].End   = mEntries[Slot].Start + EFI_PAGE_SIZE - 1;
+    MemoryMapIndexInsert (&Index, &mEntries[Slot]);
+  }
+
+  UT_ASSERT_TRUE (CheckIndex (&Index));
+
+  //
+  // The height of a red-black tree is at most 2 * log2 (n + 1)
+  //
+  Node  = Index.Root;
+  Depth = 0;
+  while (Node != NULL) {
+    Depth++;
+    Node = Node->Right;
+  }
+
+  UT_ASSERT_TRUE (Depth <= 2 * 10);
+
+  UT_ASSERT_TRUE (MemoryMapIndexFind (&Index, 0) == &mEntries[0]);
+  UT_ASSERT_TRUE (MemoryMapIndexFind (&Index, MAX_UINT64) == &mEntries[TEST_SLOT_COUNT - 1]);
+  UT_ASSERT_TRUE (MemoryMapIndexFindBelow (&Index, 0, 1) == NULL);
+  UT_ASSERT_TRUE (MemoryMapIndexFindBelow (&Index, MAX_UINT64, EFI_PAGE_SIZE + 1) == NULL);
+
+  for (Slot = 0; Slot < TEST_SLOT_COUNT; Slot++) {
+    MemoryMapIndexRemove (&Index, &mEntries[Slot]);
+    if (Slot % 64 == 0) {
+      UT_ASSERT_TRUE (CheckIndex (&Index));
+    }
+  }
+
+  UT_ASSERT_TRUE (Index.Root == NULL);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the memory map
+  index and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      IndexTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&IndexTests, Framework, "Memory Map Index Tests", "DxeCore.MemoryMapIndex", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Memory Map Index Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite---------Description---------------------------------Name------------Function---------------------------------Pre---Post---Context-----------
+  //
+  AddTestCase (IndexTests, "Random operations match a linear scan", "Random", RandomOperationsMatchLinearScan, NULL, NULL, NULL);
+  AddTestCase (IndexTests, "Sorted insertions stay balanced", "Sorted", SortedInsertionsStayBalanced, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define MemoryMapIndexUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+MemoryMapIndexUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
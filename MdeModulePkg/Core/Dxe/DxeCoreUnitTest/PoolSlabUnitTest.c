@@ -0,0 +1,507 @@
+/** @file
+  Host-based unit tests and allocation micro-benchmark for the DXE core
+  slab pool engine.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <time.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../Mem/PoolSlab.h"
+
+#define UNIT_TEST_APP_NAME     "DXE Core Pool Slab Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_SLAB_SIZE  SIZE_4KB
+
+//
+// Pool head and tail overhead added to every request by the DXE core, see
+// POOL_OVERHEAD in Pool.c.
+//
+#define TEST_POOL_OVERHEAD  (sizeof (UINTN) == sizeof (UINT64) ? 40 : 28)
+
+#define BENCHMARK_OBJECT_COUNT  4096
+#define BENCHMARK_ITERATIONS    400000
+
+//
+// Free-list bin sizes of the DXE core pool, see mPoolSizeTable in Pool.c.
+//
+STATIC CONST UINT16  mLegacyPoolSizeTable[] = {
+  128, 256, 384, 640, 1024
+};
+
+STATIC UINTN  mPagesAllocated;
+STATIC UINTN  mPagesFreed;
+
+/**
+  Slab page provider backed by the host heap.
+
+  @param  Context                Unused.
+  @param  SlabSize               Size and alignment of the slab.
+
+  @return The slab memory, or NULL.
+
+**/
+STATIC
+VOID *
+TestAllocatePages (
+  IN VOID   *Context,
+  IN UINTN  SlabSize
+  )
+{
+  mPagesAllocated++;
+  return AllocateAlignedPages (EFI_SIZE_TO_PAGES (SlabSize), SlabSize);
+}
+
+/**
+  Slab page release backed by the host heap.
+
+  @param  Context                Unused.
+  @param  Slab                   The slab memory.
+  @param  SlabSize               Size of the slab.
+
+**/
+STATIC
+VOID
+TestFreePages (
+  IN VOID   *Context,
+  IN VOID   *Slab,
+  IN UINTN  SlabSize
+  )
+{
+  mPagesFreed++;
+  FreeAlignedPages (Slab, EFI_SIZE_TO_PAGES (SlabSize));
+}
+
+/**
+  Simple deterministic pseudo random generator for the benchmark.
+
+  @param  Seed  The generator state.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  IN OUT UINT32  *Seed
+  )
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return (*Seed >> 8);
+}
+
+/**
+  Every size up to the largest slab block maps to the smallest class that
+  holds it, and larger sizes are rejected.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+SizeToClassIsTight (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  POOL_SLAB_CACHE  Cache;
+  UINTN            Size;
+  UINTN            ClassIndex;
+
+  PoolSlabInitialize (&Cache, TEST_SLAB_SIZE, TestAllocatePages, TestFreePages, NULL);
+
+  for (Size = 1; Size <= POOL_SLAB_MAX_BLOCK_SIZE; Size++) {
+    ClassIndex = PoolSlabSizeToClass (Size);
+    UT_ASSERT_TRUE (ClassIndex < POOL_SLAB_CLASS_COUNT);
+    UT_ASSERT_TRUE (PoolSlabClassSize (ClassIndex) >= Size);
+    if (ClassIndex > 0) {
+      UT_ASSERT_TRUE (PoolSlabClassSize (ClassIndex - 1) < Size);
+    }
+
+    UT_ASSERT_EQUAL (PoolSlabClassSize (ClassIndex) % 16, 0);
+  }
+
+  UT_ASSERT_EQUAL (PoolSlabSizeToClass (POOL_SLAB_MAX_BLOCK_SIZE + 1), POOL_SLAB_CLASS_COUNT);
+  UT_ASSERT_EQUAL (PoolSlabSizeToClass (MAX_UINTN), POOL_SLAB_CLASS_COUNT);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Blocks are distinct, aligned and owned by their slab, freed blocks are reused,
+  and empty slabs are returned to the page allocator.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+AllocateFreeReturnsSlabs (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  POOL_SLAB_CACHE  Cache;
+  UINTN            ClassIndex;
+  UINTN            BlockSize;
+  UINTN            Count;
+  UINTN            Index;
+  UINT8            **Blocks;
+  VOID             *Block;
+
+  mPagesAllocated = 0;
+  mPagesFreed     = 0;
+  PoolSlabInitialize (&Cache, TEST_SLAB_SIZE, TestAllocatePages, TestFreePages, NULL);
+
+  for (ClassIndex = 0; ClassIndex < POOL_SLAB_CLASS_COUNT; ClassIndex++) {
+    BlockSize = PoolSlabClassSize (ClassIndex);
+    Count     = 3 * ((TEST_SLAB_SIZE - POOL_SLAB_DATA_OFFSET) / BlockSize) + 1;
+    Blocks    = AllocateZeroPool (Count * sizeof (UINT8 *));
+    UT_ASSERT_NOT_NULL (Blocks);
+
+    for (Index = 0; Index < Count; Index++) {
+      Blocks[Index] = PoolSlabAllocate (&Cache, ClassIndex);
+      UT_ASSERT_NOT_NULL (Blocks[Index]);
+      UT_ASSERT_EQUAL ((UINTN)Blocks[Index] & 0xF, 0);
+      UT_ASSERT_EQUAL (PoolSlabBlockClass (&Cache, Blocks[Index]), ClassIndex);
+      SetMem (Blocks[Index], BlockSize, (UINT8)Index);
+    }
+
+    //
+    // Four slabs for this class, plus the empty slabs kept for the classes
+    // already tested.
+    //
+    UT_ASSERT_EQUAL (Cache.Statistics.SlabsInUse, 4 + ClassIndex * POOL_SLAB_EMPTY_RESERVE);
+
+    //
+    // No block was overwritten by a neighbour
+    //
+    for (Index = 0; Index < Count; Index++) {
+      UT_ASSERT_EQUAL (Blocks[Index][0], (UINT8)Index);
+      UT_ASSERT_EQUAL (Blocks[Index][BlockSize - 1], (UINT8)Index);
+    }
+
+    //
+    // A freed block is handed out again before any other
+    //
+    Block = Blocks[Count / 2];
+    PoolSlabFree (&Cache, Block);
+    UT_ASSERT_TRUE (PoolSlabAllocate (&Cache, ClassIndex) == Block);
+
+    for (Index = 0; Index < Count; Index++) {
+      PoolSlabFree (&Cache, Blocks[Index]);
+    }
+
+    UT_ASSERT_EQUAL (Cache.Statistics.BlocksInUse, 0);
+    UT_ASSERT_EQUAL (Cache.Statistics.SlabsInUse, (ClassIndex + 1) * POOL_SLAB_EMPTY_RESERVE);
+    FreePool (Blocks);
+  }
+
+  PoolSlabTrim (&Cache);
+  UT_ASSERT_EQUAL (Cache.Statistics.SlabsInUse, 0);
+  UT_ASSERT_EQUAL (mPagesAllocated, mPagesFreed);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Addresses that are not the start of a carved block are not recognized as
+  slab blocks.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+BlockClassRejectsForeignPointers (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  POOL_SLAB_CACHE  Cache;
+  UINT8            *Block;
+  UINT8            *Other;
+
+  PoolSlabInitialize (&Cache, TEST_SLAB_SIZE, TestAllocatePages, TestFreePages, NULL);
+
+  Block = PoolSlabAllocate (&Cache, 2);
+  UT_ASSERT_NOT_NULL (Block);
+  UT_ASSERT_EQUAL (PoolSlabBlockClass (&Cache, Block), 2);
+  UT_ASSERT_EQUAL (PoolSlabBlockClass (&Cache, Block + 8), POOL_SLAB_CLASS_COUNT);
+  UT_ASSERT_EQUAL (PoolSlabBlockClass (&Cache, Block + PoolSlabClassSize (2)), POOL_SLAB_CLASS_COUNT);
+
+  Other = AllocateAlignedPages (1, TEST_SLAB_SIZE);
+  UT_ASSERT_NOT_NULL (Other);
+  ZeroMem (Other, TEST_SLAB_SIZE);
+  UT_ASSERT_EQUAL (PoolSlabBlockClass (&Cache, Other + 64), POOL_SLAB_CLASS_COUNT);
+  FreeAlignedPages (Other, 1);
+
+  PoolSlabFree (&Cache, Block);
+  PoolSlabTrim (&Cache);
+  UT_ASSERT_EQUAL (Cache.Statistics.SlabsInUse, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Magazines hold at most POOL_SLAB_MAGAZINE_DEPTH blocks and move blocks to and
+  from the slabs in batches.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+MagazineRefillAndDrain (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  POOL_SLAB_CACHE     Cache;
+  POOL_SLAB_MAGAZINE  Magazine;
+  VOID                *Blocks[POOL_SLAB_MAGAZINE_DEPTH + 1];
+  UINTN               Index;
+
+  PoolSlabInitialize (&Cache, TEST_SLAB_SIZE, TestAllocatePages, TestFreePages, NULL);
+  ZeroMem (&Magazine, sizeof (Magazine));
+
+  //
+  // Nothing to refill from before a slab exists
+  //
+  UT_ASSERT_TRUE (PoolSlabMagazineGet (&Magazine) == NULL);
+  UT_ASSERT_EQUAL (PoolSlabMagazineRefill (&Cache, &Magazine, 4), 0);
+
+  Blocks[0] = PoolSlabAllocate (&Cache, 4);
+  UT_ASSERT_NOT_NULL (Blocks[0]);
+  UT_ASSERT_EQUAL (PoolSlabMagazineRefill (&Cache, &Magazine, 4), POOL_SLAB_MAGAZINE_BATCH);
+  UT_ASSERT_EQUAL (Magazine.Count, POOL_SLAB_MAGAZINE_BATCH);
+  UT_ASSERT_EQUAL (Cache.Statistics.BlocksInUse, POOL_SLAB_MAGAZINE_BATCH + 1);
+
+  for (Index = 1; Index <= POOL_SLAB_MAGAZINE_BATCH; Index++) {
+    Blocks[Index] = PoolSlabMagazineGet (&Magazine);
+    UT_ASSERT_NOT_NULL (Blocks[Index]);
+    UT_ASSERT_EQUAL (PoolSlabBlockClass (&Cache, Blocks[Index]), 4);
+  }
+
+  UT_ASSERT_TRUE (PoolSlabMagazineGet (&Magazine) == NULL);
+  UT_ASSERT_EQUAL (Magazine.Hits, POOL_SLAB_MAGAZINE_BATCH);
+  UT_ASSERT_EQUAL (Magazine.Misses, 2);
+
+  for (Index = POOL_SLAB_MAGAZINE_BATCH + 1; Index <= POOL_SLAB_MAGAZINE_DEPTH; Index++) {
+    Blocks[Index] = PoolSlabAllocate (&Cache, 4);
+    UT_ASSERT_NOT_NULL (Blocks[Index]);
+  }
+
+  for (Index = 0; Index < POOL_SLAB_MAGAZINE_DEPTH; Index++) {
+    UT_ASSERT_TRUE (PoolSlabMagazinePut (&Magazine, Blocks[Index], 4));
+  }
+
+  UT_ASSERT_FALSE (PoolSlabMagazinePut (&Magazine, Blocks[POOL_SLAB_MAGAZINE_DEPTH], 4));
+
+  UT_ASSERT_EQUAL (PoolSlabMagazineDrain (&Cache, &Magazine, POOL_SLAB_MAGAZINE_BATCH), POOL_SLAB_MAGAZINE_BATCH);
+  UT_ASSERT_EQUAL (Magazine.Count, POOL_SLAB_MAGAZINE_DEPTH - POOL_SLAB_MAGAZINE_BATCH);
+  PoolSlabFree (&Cache, Blocks[POOL_SLAB_MAGAZINE_DEPTH]);
+  UT_ASSERT_EQUAL (PoolSlabMagazineDrain (&Cache, &Magazine, MAX_UINTN), POOL_SLAB_MAGAZINE_DEPTH - POOL_SLAB_MAGAZINE_BATCH);
+  UT_ASSERT_EQUAL (Magazine.Count, 0);
+  UT_ASSERT_EQUAL (Cache.Statistics.BlocksInUse, 0);
+
+  PoolSlabTrim (&Cache);
+  UT_ASSERT_EQUAL (Cache.Statistics.SlabsInUse, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Allocation micro-benchmark. Keeps a working set of small pool blocks with
+  random sizes, and randomly replaces them. Reports the time per allocate and
+  free pair, and the memory used by the slabs compared to the free-list bin
+  rounding of the DXE core pool.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+AllocationBenchmark (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  POOL_SLAB_CACHE  *Cache;
+  VOID             **Blocks;
+  UINTN            *Sizes;
+  UINT32           Seed;
+  UINTN            Index;
+  UINTN            Iteration;
+  UINTN            Size;
+  UINTN            ClassIndex;
+  UINTN            Requested;
+  UINTN            LegacyBytes;
+  UINTN            LegacyIndex;
+  clock_t          Start;
+  clock_t          Ticks;
+
+  Cache  = AllocateZeroPool (sizeof (POOL_SLAB_CACHE));
+  Blocks = AllocateZeroPool (BENCHMARK_OBJECT_COUNT * sizeof (VOID *));
+  Sizes  = AllocateZeroPool (BENCHMARK_OBJECT_COUNT * sizeof (UINTN));
+  UT_ASSERT_NOT_NULL (Cache);
+  UT_ASSERT_NOT_NULL (Blocks);
+  UT_ASSERT_NOT_NULL (Sizes);
+
+  PoolSlabInitialize (Cache, TEST_SLAB_SIZE, TestAllocatePages, TestFreePages, NULL);
+  Seed = 0x5eed;
+
+  Start = clock ();
+  for (Iteration = 0; Iteration < BENCHMARK_ITERATIONS; Iteration++) {
+    Index = NextRandom (&Seed) % BENCHMARK_OBJECT_COUNT;
+    if (Blocks[Index] != NULL) {
+      PoolSlabFree (Cache, Blocks[Index]);
+    }
+
+    //
+    // Most DXE pool requests are small: device path nodes, protocol
+    // interfaces, HII strings.
+    //
+    Size          = ALIGN_VALUE (8 + NextRandom (&Seed) % 480, sizeof (UINTN)) + TEST_POOL_OVERHEAD;
+    ClassIndex    = PoolSlabSizeToClass (Size);
+    Blocks[Index] = PoolSlabAllocate (Cache, ClassIndex);
+    Sizes[Index]  = Size;
+    UT_ASSERT_NOT_NULL (Blocks[Index]);
+  }
+
+  Ticks = clock () - Start;
+
+  Requested   = 0;
+  LegacyBytes = 0;
+  for (Index = 0; Index < BENCHMARK_OBJECT_COUNT; Index++) {
+    Requested += Sizes[Index];
+    for (LegacyIndex = 0; mLegacyPoolSizeTable[LegacyIndex] < Sizes[Index]; LegacyIndex++) {
+    }
+
+    LegacyBytes += mLegacyPoolSizeTable[LegacyIndex];
+  }
+
+  UT_LOG_INFO (
+    "%d alloc/free pairs: %d ns per pair\n",
+    BENCHMARK_ITERATIONS,
+    (INT32)((UINT64)Ticks * 1000000000 / CLOCKS_PER_SEC / BENCHMARK_ITERATIONS)
+    );
+  UT_LOG_INFO (
+    "live bytes %d, slab bytes %d (%d%%), free-list bin bytes %d (%d%%)\n",
+    (INT32)Requested,
+    (INT32)(Cache->Statistics.SlabsInUse * TEST_SLAB_SIZE),
+    (INT32)(Cache->Statistics.SlabsInUse * TEST_SLAB_SIZE * 100 / Requested),
+    (INT32)LegacyBytes,
+    (INT32)(LegacyBytes * 100 / Requested)
+    );
+
+  for (Index = 0; Index < BENCHMARK_OBJECT_COUNT; Index++) {
+    PoolSlabFree (Cache, Blocks[Index]);
+  }
+
+  PoolSlabTrim (Cache);
+  UT_ASSERT_EQUAL (Cache->Statistics.SlabsInUse, 0);
+
+  FreePool (Sizes);
+  FreePool (Blocks);
+  FreePool (Cache);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the slab pool
+  engine and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      SlabTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&SlabTests, Framework, "Pool Slab Tests", "DxeCore.PoolSlab", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Pool Slab Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite--------Description---------------------------Name-------------Function--------------------------Pre---Post---Context-----------
+  //
+  AddTestCase (SlabTests, "Size to class mapping is tight", "SizeToClass", SizeToClassIsTight, NULL, NULL, NULL);
+  AddTestCase (SlabTests, "Allocate and free return slabs", "AllocateFree", AllocateFreeReturnsSlabs, NULL, NULL, NULL);
+  AddTestCase (SlabTests, "Foreign pointers are rejected", "BlockClass", BlockClassRejectsForeignPointers, NULL, NULL, NULL);
+  AddTestCase (SlabTests, "Magazine refill and drain", "Magazine", MagazineRefillAndDrain, NULL, NULL, NULL);
+  AddTestCase (SlabTests, "Allocation micro-benchmark", "Benchmark", AllocationBenchmark, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define PoolSlabUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+PoolSlabUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -0,0 +1,348 @@
+/** @file
+  Host-based unit tests for the hierarchical timing wheel of the DXE core
+  timer services.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../Event/TimerWheel.h"
+
+#define UNIT_TEST_APP_NAME     "DXE Core Timer Wheel Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_TIMER_COUNT  256
+#define TEST_ITERATIONS   20000
+
+STATIC TIMER_EVENT_INFO  mTimers[TEST_TIMER_COUNT];
+STATIC BOOLEAN           mQueued[TEST_TIMER_COUNT];
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @param  Seed  The generator state.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  IN OUT UINT32  *Seed
+  )
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return (*Seed >> 8);
+}
+
+/**
+  Returns a random delay, spread over all the levels of the wheel and beyond.
+
+  @param  Seed  The generator state.
+
+  @return The delay in units of 100ns.
+
+**/
+STATIC
+UINT64
+RandomDelay (
+  IN OUT UINT32  *Seed
+  )
+{
+  UINTN  Bits;
+
+  Bits = NextRandom (Seed) % 44;
+  return LShiftU64 (NextRandom (Seed), 8) & (LShiftU64 (1, Bits) - 1);
+}
+
+/**
+  Expires a wheel and checks the result against the queued timers.
+
+  @param  Wheel                  The wheel.
+  @param  SystemTime             The current time.
+
+  @retval TRUE                   The expired timers and the next trigger time
+                                 are the expected ones.
+  @retval FALSE                  The wheel returned a wrong result.
+
+**/
+STATIC
+BOOLEAN
+ExpireAndCheck (
+  IN OUT TIMER_WHEEL  *Wheel,
+  IN     UINT64       SystemTime
+  )
+{
+  LIST_ENTRY        Expired;
+  LIST_ENTRY        *Link;
+  TIMER_EVENT_INFO  *Timer;
+  UINT64            Previous;
+  UINT64            Earliest;
+  UINTN             Index;
+  UINTN             ExpiredCount;
+  UINTN             ExpectedCount;
+
+  ExpectedCount = 0;
+  for (Index = 0; Index < TEST_TIMER_COUNT; Index++) {
+    if (mQueued[Index] && (mTimers[Index].TriggerTime <= SystemTime)) {
+      ExpectedCount++;
+    }
+  }
+
+  InitializeListHead (&Expired);
+  TimerWheelExpire (Wheel, SystemTime, &Expired);
+
+  ExpiredCount = 0;
+  Previous     = 0;
+  while (!IsListEmpty (&Expired)) {
+    Link  = Expired.ForwardLink;
+    Timer = BASE_CR (Link, TIMER_EVENT_INFO, Link);
+    Index = Timer - mTimers;
+    RemoveEntryList (Link);
+    if (!mQueued[Index] || (Timer->TriggerTime > SystemTime) || (Timer->TriggerTime < Previous)) {
+      return FALSE;
+    }
+
+    mQueued[Index] = FALSE;
+    Previous       = Timer->TriggerTime;
+    ExpiredCount++;
+  }
+
+  if (ExpiredCount != ExpectedCount) {
+    return FALSE;
+  }
+
+  Earliest = MAX_UINT64;
+  for (Index = 0; Index < TEST_TIMER_COUNT; Index++) {
+    if (mQueued[Index]) {
+      Earliest = MIN (Earliest, mTimers[Index].TriggerTime);
+    }
+  }
+
+  return (BOOLEAN)(Wheel->NextTrigger == Earliest);
+}
+
+/**
+  Inserts, cancels and expires random timers, and checks that the wheel
+  expires exactly the timers a sorted list would, in the same order.
+
+  @param[in]  Context    [Optional] An optional parameter that enables:
+                         1) test-case reuse with varied parameters and
+                         2) test-case re-entry for Target tests that need a
+                         reboot.  This parameter is a VOID* and it is the
+                         responsibility of the test author to ensure that the
+                         contents are well understood by all test cases that may
+                         consume it.
+
+  @retval  UNIT_TEST_PASSED             The Unit test has completed and the test
+                                        case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+RandomOperationsMatchSortedList (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TIMER_WHEEL  Wheel;
+  UINT32       Seed;
+  UINTN        Iteration;
+  UINTN        Index;
+  UINT64       SystemTime;
+  UINT32       Operation;
+
+  ZeroMem (mQueued, sizeof (mQueued));
+  TimerWheelInitialize (&Wheel);
+  Seed       = 0x5eed;
+  SystemTime = 0;
+
+  for (Iteration = 0; Iteration < TEST_ITERATIONS; Iteration++) {
+    Index     = NextRandom (&Seed) % TEST_TIMER_COUNT;
+    Operation = NextRandom (&Seed) % 8;
+    if (Operation < 4) {
+      if (mQueued[Index]) {
+        TimerWheelRemove (&Wheel, &mTimers[Index]);
+      }
+
+      mTimers[Index].TriggerTime = SystemTime + RandomDelay (&Seed);
+      TimerWheelInsert (&Wheel, &mTimers[Index]);
+      mQueued[Index] = TRUE;
+    } else if (Operation < 5) {
+      if (mQueued[Index]) {
+        TimerWheelRemove (&Wheel, &mTimers[Index]);
+        UT_ASSERT_TRUE (mTimers[Index].Link.ForwardLink == NULL);
+        mQueued[Index] = FALSE;
+      }
+    } else {
+      //
+      // Advance by about a timer tick most of the time, and sometimes jump
+      //
+      if (Operation < 7) {
+        SystemTime += 100000 + NextRandom (&Seed) % 1000;
+      } else {
+        SystemTime += RandomDelay (&Seed);
+      }
+
+      UT_ASSERT_TRUE (ExpireAndCheck (&Wheel, SystemTime));
+    }
+  }
+
+  //
+  // Drain the wheel
+  //
+  UT_ASSERT_TRUE (ExpireAndCheck (&Wheel, MAX_UINT64 >> 4));
+  UT_ASSERT_EQUAL (Wheel.Count, 0);
+  UT_ASSERT_EQUAL (Wheel.NextTrigger, MAX_UINT64);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that timers that are further away than the span of the wheel are
+  kept until their trigger time, and then expire in order.
+
+  @param[in]  Context    [Optional] An optional parameter that enables:
+                         1) test-case reuse with varied parameters and
+                         2) test-case re-entry for Target tests that need a
+                         reboot.  This parameter is a VOID* and it is the
+                         responsibility of the test author to ensure that the
+                         contents are well understood by all test cases that may
+                         consume it.
+
+  @retval  UNIT_TEST_PASSED             The Unit test has completed and the test
+                                        case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+FarTimersExpireOnTime (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TIMER_WHEEL  Wheel;
+  UINTN        Index;
+  UINT64       Span;
+  UINT64       SystemTime;
+
+  ZeroMem (mQueued, sizeof (mQueued));
+  TimerWheelInitialize (&Wheel);
+
+  Span = LShiftU64 (1, TIMER_WHEEL_GRANULE_SHIFT + TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_SHIFT);
+  for (Index = 0; Index < 8; Index++) {
+    mTimers[Index].TriggerTime = MultU64x32 (Span, (UINT32)(8 - Index)) + Index;
+    TimerWheelInsert (&Wheel, &mTimers[Index]);
+    mQueued[Index] = TRUE;
+  }
+
+  UT_ASSERT_EQUAL (Wheel.NextTrigger, Span + 7);
+
+  for (SystemTime = 0; SystemTime < MultU64x32 (Span, 9); SystemTime += Span / 3) {
+    UT_ASSERT_TRUE (ExpireAndCheck (&Wheel, SystemTime));
+  }
+
+  UT_ASSERT_TRUE (ExpireAndCheck (&Wheel, MultU64x32 (Span, 9)));
+  UT_ASSERT_EQUAL (Wheel.Count, 0);
+
+  //
+  // From the last granule of a level 1 block, a timer 63 blocks and one
+  // granule away lands in the level 1 slot of the current block
+  //
+  SystemTime = MultU64x32 (Span, 9) + LShiftU64 (TIMER_WHEEL_SLOTS - 1, TIMER_WHEEL_GRANULE_SHIFT);
+  UT_ASSERT_TRUE (ExpireAndCheck (&Wheel, SystemTime));
+  mTimers[0].TriggerTime = SystemTime + LShiftU64 (63 * TIMER_WHEEL_SLOTS + 1, TIMER_WHEEL_GRANULE_SHIFT);
+  TimerWheelInsert (&Wheel, &mTimers[0]);
+  mQueued[0] = TRUE;
+  UT_ASSERT_TRUE (ExpireAndCheck (&Wheel, mTimers[0].TriggerTime));
+  UT_ASSERT_EQUAL (Wheel.Count, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the timing wheel and
+  run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      WheelTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&WheelTests, Framework, "Timer Wheel Tests", "DxeCore.TimerWheel", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Timer Wheel Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite---------Description---------------------------------Name------------Function---------------------------------Pre---Post---Context-----------
+  //
+  AddTestCase (WheelTests, "Random operations match a sorted list", "Random", RandomOperationsMatchSortedList, NULL, NULL, NULL);
+  AddTestCase (WheelTests, "Timers beyond the wheel span expire on time", "Far", FarTimersExpireOnTime, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define TimerWheelUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+TimerWheelUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -45,6 +45,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Protocol/HiiPackageList.h>
 #include <Protocol/SmmBase2.h>
 #include <Protocol/PeCoffImageEmulator.h>
+#include <Protocol/DriverBindingDeferredStart.h>
 #include <Guid/MemoryTypeInformation.h>
 #include <Guid/FirmwareFileSystem2.h>
 #include <Guid/FirmwareFileSystem3.h>
@@ -158,6 +159,16 @@ typedef struct {
   BOOLEAN                          Initialized;
   BOOLEAN                          DepexProtocolError;
 
+  //
+  // DepexIndexed is TRUE if every protocol pushed by the Depex is in the
+  // reverse index of the dispatcher. DepexStale is TRUE if the Depex has to
+  // be evaluated again, because one of these protocols was installed since
+  // the last evaluation. A Depex that is not indexed is evaluated on every
+  // dispatcher pass.
+  //
+  BOOLEAN                          DepexIndexed;
+  BOOLEAN                          DepexStale;
+
   EFI_HANDLE                       ImageHandle;
   BOOLEAN                          IsFvImage;
 } EFI_CORE_DRIVER_ENTRY;
@@ -495,6 +506,18 @@ CorePreProcessDepex (
   IN  EFI_CORE_DRIVER_ENTRY  *DriverEntry
   );
 
+/**
+  Marks the Depex of the drivers that push a protocol as stale, so that they
+  are evaluated again on the next dispatcher pass.
+
+  @param  Protocol              The protocol that was installed.
+
+**/
+VOID
+CoreDispatcherProtocolInstalled (
+  IN EFI_GUID  *Protocol
+  );
+
 /**
   Terminates all boot services.
 
@@ -948,6 +971,15 @@ CoreUnregisterProtocolNotify (
   IN EFI_EVENT  Event
   );
 
+/**
+  Reports the lookup statistics of the protocol and handle hash tables.
+
+**/
+VOID
+CoreDumpProtocolDatabaseStatistics (
+  VOID
+  );
+
 /**
   Locates the requested handle(s) and returns them in Buffer.
 
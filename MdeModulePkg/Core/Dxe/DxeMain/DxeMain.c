@@ -774,6 +774,10 @@ CoreExitBootServices (
 
   gMemoryMapTerminated = TRUE;
 
+  DEBUG_CODE_BEGIN ();
+  CoreDumpProtocolDatabaseStatistics ();
+  DEBUG_CODE_END ();
+
   //
   // Notify other drivers that we are exiting boot services.
   //
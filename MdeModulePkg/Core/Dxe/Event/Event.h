@@ -10,6 +10,8 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #ifndef __EVENT_H__
 #define __EVENT_H__
 
+#include "TimerWheel.h"
+
 #define VALID_TPL(a)  ((a) <= TPL_HIGH_LEVEL)
 extern  UINTN  gEventPending;
 
@@ -26,15 +28,6 @@ extern  UINTN  gEventPending;
 // EFI_EVENT
 //
 
-///
-/// Timer event information
-///
-typedef struct {
-  LIST_ENTRY    Link;
-  UINT64        TriggerTime;
-  UINT64        Period;
-} TIMER_EVENT_INFO;
-
 #define EVENT_SIGNATURE  SIGNATURE_32('e','v','n','t')
 typedef struct {
   UINTN                      Signature;
@@ -13,13 +13,28 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 // Internal data
 //
 
-LIST_ENTRY  mEfiTimerList       = INITIALIZE_LIST_HEAD_VARIABLE (mEfiTimerList);
-EFI_LOCK    mEfiTimerLock       = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL - 1);
-EFI_EVENT   mEfiCheckTimerEvent = NULL;
+TIMER_WHEEL  mEfiTimerWheel;
+EFI_LOCK     mEfiTimerLock       = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL - 1);
+EFI_EVENT    mEfiCheckTimerEvent = NULL;
 
 EFI_LOCK  mEfiSystemTimeLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL);
 UINT64    mEfiSystemTime     = 0;
 
+//
+// mEfiTimerBasePeriod    - The timer interrupt period programmed by the platform
+// mEfiTimerCurrentPeriod - The period the timer interrupt is programmed to, longer
+//                          than mEfiTimerBasePeriod while ticks are coalesced
+//
+UINT64  mEfiTimerBasePeriod    = 0;
+UINT64  mEfiTimerCurrentPeriod = 0;
+
+//
+// mEfiTimerCoalesced    - TRUE while mEfiTimerCurrentPeriod is longer than mEfiTimerBasePeriod
+// mEfiTimerTickBoundary - Set by a tick, cleared when the tick is processed by CoreCheckTimers()
+//
+BOOLEAN  mEfiTimerCoalesced    = FALSE;
+BOOLEAN  mEfiTimerTickBoundary = FALSE;
+
 //
 // Timer functions
 //
@@ -36,29 +51,12 @@ CoreInsertEventTimer (
   IN IEVENT  *Event
   )
 {
-  UINT64      TriggerTime;
-  LIST_ENTRY  *Link;
-  IEVENT      *Event2;
-
   ASSERT_LOCKED (&mEfiTimerLock);
 
   //
-  // Get the timer's trigger time
-  //
-  TriggerTime = Event->Timer.TriggerTime;
-
-  //
-  // Insert the timer into the timer database in assending sorted order
+  // Queue the timer in the timer wheel at its trigger time
   //
-  for (Link = mEfiTimerList.ForwardLink; Link != &mEfiTimerList; Link = Link->ForwardLink) {
-    Event2 = CR (Link, IEVENT, Timer.Link, EVENT_SIGNATURE);
-
-    if (Event2->Timer.TriggerTime > TriggerTime) {
-      break;
-    }
-  }
-
-  InsertTailList (Link, &Event->Timer.Link);
+  TimerWheelInsert (&mEfiTimerWheel, &Event->Timer);
 }
 
 /**
@@ -82,7 +80,73 @@ CoreCurrentSystemTime (
 }
 
 /**
-  Checks the sorted timer list against the current system time.
+  Coalesces the timer ticks while no timer event is due soon, by programming
+  the timer interrupt to a longer period, and restores the period programmed
+  by the platform when a timer event is due earlier.
+
+  The timer drivers restart the count of the period when it is programmed, and
+  only report the new period on the next tick. The time already elapsed in the
+  current period would be lost, so the period is only changed right after a
+  tick, when there is none.
+
+  @param  SystemTime             The current system time
+
+**/
+STATIC
+VOID
+CoreUpdateTimerPeriod (
+  IN UINT64  SystemTime
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      Period;
+  UINT64      Delay;
+
+  ASSERT_LOCKED (&mEfiTimerLock);
+
+  if ((PcdGet32 (PcdDxeTimerCoalescingMaxPeriod) == 0) || (gTimer == NULL)) {
+    return;
+  }
+
+  //
+  // Leave the timer alone if it is disabled, as on ExitBootServices()
+  //
+  Status = gTimer->GetTimerPeriod (gTimer, &Period);
+  if (EFI_ERROR (Status) || (Period == 0)) {
+    return;
+  }
+
+  //
+  // A period that was not programmed here comes from the platform
+  //
+  if (Period != mEfiTimerCurrentPeriod) {
+    mEfiTimerBasePeriod    = Period;
+    mEfiTimerCurrentPeriod = Period;
+  }
+
+  //
+  // Only coalesce ticks when the next timer event is at least two base
+  // periods away, and wake up for it on a base period boundary
+  //
+  Period = mEfiTimerBasePeriod;
+  Delay  = mEfiTimerWheel.NextTrigger - MIN (SystemTime, mEfiTimerWheel.NextTrigger);
+  if (Delay >= MultU64x32 (mEfiTimerBasePeriod, 2)) {
+    Period = MIN (Delay, PcdGet32 (PcdDxeTimerCoalescingMaxPeriod));
+    Period = MAX (Period - ModU64x32 (Period, (UINT32)mEfiTimerBasePeriod), mEfiTimerBasePeriod);
+  }
+
+  if (Period != mEfiTimerCurrentPeriod) {
+    Status = gTimer->SetTimerPeriod (gTimer, Period);
+    if (!EFI_ERROR (Status)) {
+      mEfiTimerCurrentPeriod = Period;
+    }
+  }
+
+  mEfiTimerCoalesced = (BOOLEAN)(mEfiTimerCurrentPeriod != mEfiTimerBasePeriod);
+}
+
+/**
+  Checks the timer wheel against the current system time.
   Signals any expired event timer.
 
   @param  CheckEvent             Not used
@@ -96,27 +160,32 @@ CoreCheckTimers (
   IN VOID       *Context
   )
 {
-  UINT64  SystemTime;
-  IEVENT  *Event;
+  UINT64      SystemTime;
+  BOOLEAN     TickBoundary;
+  IEVENT      *Event;
+  LIST_ENTRY  Expired;
 
   //
   // Check the timer database for expired timers
   //
   CoreAcquireLock (&mEfiTimerLock);
-  SystemTime = CoreCurrentSystemTime ();
+  CoreAcquireLock (&mEfiSystemTimeLock);
+  SystemTime            = mEfiSystemTime;
+  TickBoundary          = mEfiTimerTickBoundary;
+  mEfiTimerTickBoundary = FALSE;
+  CoreReleaseLock (&mEfiSystemTimeLock);
 
-  while (!IsListEmpty (&mEfiTimerList)) {
-    Event = CR (mEfiTimerList.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
+  //
+  // Collect all the expired timers at once, in trigger time order
+  //
+  InitializeListHead (&Expired);
+  TimerWheelExpire (&mEfiTimerWheel, SystemTime, &Expired);
 
-    //
-    // If this timer is not expired, then we're done
-    //
-    if (Event->Timer.TriggerTime > SystemTime) {
-      break;
-    }
+  while (!IsListEmpty (&Expired)) {
+    Event = CR (Expired.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
 
     //
-    // Remove this timer from the timer queue
+    // Remove this timer from the expired list
     //
 
     RemoveEntryList (&Event->Timer.Link);
@@ -151,6 +220,10 @@ CoreCheckTimers (
     }
   }
 
+  if (TickBoundary) {
+    CoreUpdateTimerPeriod (SystemTime);
+  }
+
   CoreReleaseLock (&mEfiTimerLock);
 }
 
@@ -165,6 +238,8 @@ CoreInitializeTimer (
 {
   EFI_STATUS  Status;
 
+  TimerWheelInitialize (&mEfiTimerWheel);
+
   Status = CoreCreateEventInternal (
              EVT_NOTIFY_SIGNAL,
              TPL_HIGH_LEVEL - 1,
@@ -189,8 +264,6 @@ CoreTimerTick (
   IN UINT64  Duration
   )
 {
-  IEVENT  *Event;
-
   //
   // Check runtiem flag in case there are ticks while exiting boot services
   //
@@ -202,15 +275,13 @@ CoreTimerTick (
   mEfiSystemTime += Duration;
 
   //
-  // If the head of the list is expired, fire the timer event
-  // to process it
+  // If the earliest timer is expired, fire the timer event
+  // to process it. While ticks are coalesced, fire it on every
+  // tick so the period is restored in time for an earlier timer.
   //
-  if (!IsListEmpty (&mEfiTimerList)) {
-    Event = CR (mEfiTimerList.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
-
-    if (Event->Timer.TriggerTime <= mEfiSystemTime) {
-      CoreSignalEvent (mEfiCheckTimerEvent);
-    }
+  if ((mEfiTimerWheel.NextTrigger <= mEfiSystemTime) || mEfiTimerCoalesced) {
+    mEfiTimerTickBoundary = TRUE;
+    CoreSignalEvent (mEfiCheckTimerEvent);
   }
 
   CoreReleaseLock (&mEfiSystemTimeLock);
@@ -240,6 +311,7 @@ CoreSetTimer (
   )
 {
   IEVENT  *Event;
+  UINT64  SystemTime;
 
   Event = UserEvent;
 
@@ -261,8 +333,7 @@ CoreSetTimer (
   // If the timer is queued to the timer database, remove it
   //
   if (Event->Timer.Link.ForwardLink != NULL) {
-    RemoveEntryList (&Event->Timer.Link);
-    Event->Timer.Link.ForwardLink = NULL;
+    TimerWheelRemove (&mEfiTimerWheel, &Event->Timer);
   }
 
   Event->Timer.TriggerTime = 0;
@@ -271,13 +342,26 @@ CoreSetTimer (
   if (Type != TimerCancel) {
     if (Type == TimerPeriodic) {
       if (TriggerTime == 0) {
-        gTimer->GetTimerPeriod (gTimer, &TriggerTime);
+        if (mEfiTimerBasePeriod != 0) {
+          TriggerTime = mEfiTimerBasePeriod;
+        } else {
+          gTimer->GetTimerPeriod (gTimer, &TriggerTime);
+        }
       }
 
       Event->Timer.Period = TriggerTime;
     }
 
-    Event->Timer.TriggerTime = CoreCurrentSystemTime () + TriggerTime;
+    //
+    // While ticks are coalesced, the system time may lag behind by up to the
+    // coalesced period, so the timer must not be measured from it
+    //
+    SystemTime = CoreCurrentSystemTime ();
+    if ((TriggerTime != 0) && (mEfiTimerCurrentPeriod > mEfiTimerBasePeriod)) {
+      SystemTime += mEfiTimerCurrentPeriod - mEfiTimerBasePeriod;
+    }
+
+    Event->Timer.TriggerTime = SystemTime + TriggerTime;
     CoreInsertEventTimer (Event);
 
     if (TriggerTime == 0) {
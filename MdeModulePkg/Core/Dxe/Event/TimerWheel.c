@@ -0,0 +1,373 @@
+/** @file
+  Hierarchical timing wheel that holds the pending DXE core timer events.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Library/DebugLib.h>
+
+#include "TimerWheel.h"
+
+#define TIMER_WHEEL_SLOT_MASK  (TIMER_WHEEL_SLOTS - 1)
+
+//
+// Number of granules covered by one slot of a level
+//
+#define TIMER_WHEEL_LEVEL_SPAN_SHIFT(Level)  ((Level) * TIMER_WHEEL_LEVEL_SHIFT)
+
+//
+// Number of granules covered by the whole wheel
+//
+#define TIMER_WHEEL_SPAN  LShiftU64 (1, TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_SHIFT)
+
+/**
+  Returns the timer that a wheel slot link belongs to.
+
+  @param  Link                   The link of the timer.
+
+  @return The timer.
+
+**/
+STATIC
+TIMER_EVENT_INFO *
+TimerFromLink (
+  IN LIST_ENTRY  *Link
+  )
+{
+  return BASE_CR (Link, TIMER_EVENT_INFO, Link);
+}
+
+/**
+  Queues a timer in the slot that covers its trigger time, relative to the
+  granule the wheel has been advanced to.
+
+  @param  Wheel                  The wheel.
+  @param  Timer                  The timer.
+
+**/
+STATIC
+VOID
+TimerWheelPlace (
+  IN OUT TIMER_WHEEL       *Wheel,
+  IN OUT TIMER_EVENT_INFO  *Timer
+  )
+{
+  UINT64  Granule;
+  UINT64  Delta;
+  UINTN   Level;
+  UINTN   Slot;
+
+  Granule = RShiftU64 (Timer->TriggerTime, TIMER_WHEEL_GRANULE_SHIFT);
+  if (Granule < Wheel->Granule) {
+    Granule = Wheel->Granule;
+  }
+
+  Delta = Granule - Wheel->Granule;
+  if (Delta >= TIMER_WHEEL_SPAN) {
+    Granule = Wheel->Granule + TIMER_WHEEL_SPAN - 1;
+    Delta   = TIMER_WHEEL_SPAN - 1;
+  }
+
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS - 1; Level++) {
+    if (RShiftU64 (Delta, TIMER_WHEEL_LEVEL_SPAN_SHIFT (Level + 1)) == 0) {
+      break;
+    }
+  }
+
+  Slot = (UINTN)RShiftU64 (Granule, TIMER_WHEEL_LEVEL_SPAN_SHIFT (Level)) & TIMER_WHEEL_SLOT_MASK;
+  InsertTailList (&Wheel->Slots[Level][Slot], &Timer->Link);
+}
+
+/**
+  Moves the timers of the higher level slots that start at the current
+  granule down the wheel.
+
+  @param  Wheel                  The wheel.
+
+**/
+STATIC
+VOID
+TimerWheelCascade (
+  IN OUT TIMER_WHEEL  *Wheel
+  )
+{
+  LIST_ENTRY  Pending;
+  LIST_ENTRY  *Slot;
+  LIST_ENTRY  *Link;
+  UINTN       Level;
+
+  //
+  // Cascade from the top, so that timers moved from a level can be moved
+  // again from the level below in the same pass
+  //
+  for (Level = TIMER_WHEEL_LEVELS - 1; Level > 0; Level--) {
+    if ((Wheel->Granule & (LShiftU64 (1, TIMER_WHEEL_LEVEL_SPAN_SHIFT (Level)) - 1)) != 0) {
+      continue;
+    }
+
+    Slot = &Wheel->Slots[Level][(UINTN)RShiftU64 (Wheel->Granule, TIMER_WHEEL_LEVEL_SPAN_SHIFT (Level)) & TIMER_WHEEL_SLOT_MASK];
+    if (IsListEmpty (Slot)) {
+      continue;
+    }
+
+    //
+    // Detach the slot first, as a timer parked beyond the span of the wheel
+    // can be placed into the same slot again
+    //
+    InitializeListHead (&Pending);
+    while (!IsListEmpty (Slot)) {
+      Link = Slot->ForwardLink;
+      RemoveEntryList (Link);
+      InsertTailList (&Pending, Link);
+    }
+
+    while (!IsListEmpty (&Pending)) {
+      Link = Pending.ForwardLink;
+      RemoveEntryList (Link);
+      TimerWheelPlace (Wheel, TimerFromLink (Link));
+    }
+  }
+}
+
+/**
+  Returns the next granule, after the current one, at which a slot of the
+  wheel has to be processed, either because it holds timers that expire or
+  because its timers have to be moved down the wheel.
+
+  @param  Wheel                  The wheel.
+
+  @return The granule, or MAX_UINT64 if the wheel holds no timer after the
+          current granule.
+
+**/
+STATIC
+UINT64
+TimerWheelNextGranule (
+  IN TIMER_WHEEL  *Wheel
+  )
+{
+  UINT64  Next;
+  UINT64  Block;
+  UINTN   Level;
+  UINTN   Index;
+
+  Next = MAX_UINT64;
+
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++) {
+    Block = RShiftU64 (Wheel->Granule, TIMER_WHEEL_LEVEL_SPAN_SHIFT (Level));
+    for (Index = 1; Index <= TIMER_WHEEL_SLOTS; Index++) {
+      if (!IsListEmpty (&Wheel->Slots[Level][(UINTN)(Block + Index) & TIMER_WHEEL_SLOT_MASK])) {
+        Next = MIN (Next, LShiftU64 (Block + Index, TIMER_WHEEL_LEVEL_SPAN_SHIFT (Level)));
+        break;
+      }
+    }
+  }
+
+  return Next;
+}
+
+/**
+  Computes the exact trigger time of the earliest timer of a wheel.
+
+  @param  Wheel                  The wheel.
+
+  @return The trigger time, or MAX_UINT64 if the wheel is empty.
+
+**/
+STATIC
+UINT64
+TimerWheelEarliestTrigger (
+  IN TIMER_WHEEL  *Wheel
+  )
+{
+  UINT64      Earliest;
+  UINT64      Block;
+  UINTN       Level;
+  UINTN       Index;
+  LIST_ENTRY  *Slot;
+  LIST_ENTRY  *Link;
+
+  Earliest = MAX_UINT64;
+  if (Wheel->Count == 0) {
+    return Earliest;
+  }
+
+  //
+  // The slots of a level are visited in time order, so only the first slot
+  // that holds timers has to be searched on every level. On the higher
+  // levels, the slot of the current block has already been moved down and
+  // only holds timers that are a full turn away.
+  //
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++) {
+    Block = RShiftU64 (Wheel->Granule, TIMER_WHEEL_LEVEL_SPAN_SHIFT (Level));
+    if (Level > 0) {
+      Block++;
+    }
+
+    for (Index = 0; Index < TIMER_WHEEL_SLOTS; Index++) {
+      Slot = &Wheel->Slots[Level][(UINTN)(Block + Index) & TIMER_WHEEL_SLOT_MASK];
+      if (!IsListEmpty (Slot)) {
+        for (Link = Slot->ForwardLink; Link != Slot; Link = Link->ForwardLink) {
+          Earliest = MIN (Earliest, TimerFromLink (Link)->TriggerTime);
+        }
+
+        break;
+      }
+    }
+  }
+
+  return Earliest;
+}
+
+/**
+  Initializes an empty timing wheel.
+
+  @param  Wheel                  The wheel.
+
+**/
+VOID
+TimerWheelInitialize (
+  OUT TIMER_WHEEL  *Wheel
+  )
+{
+  UINTN  Level;
+  UINTN  Slot;
+
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++) {
+    for (Slot = 0; Slot < TIMER_WHEEL_SLOTS; Slot++) {
+      InitializeListHead (&Wheel->Slots[Level][Slot]);
+    }
+  }
+
+  Wheel->Granule     = 0;
+  Wheel->Count       = 0;
+  Wheel->NextTrigger = MAX_UINT64;
+}
+
+/**
+  Queues a timer in a wheel at its trigger time.
+
+  @param  Wheel                  The wheel.
+  @param  Timer                  The timer. It must not be queued already.
+
+**/
+VOID
+TimerWheelInsert (
+  IN OUT TIMER_WHEEL       *Wheel,
+  IN OUT TIMER_EVENT_INFO  *Timer
+  )
+{
+  TimerWheelPlace (Wheel, Timer);
+  Wheel->Count++;
+
+  if (Timer->TriggerTime < Wheel->NextTrigger) {
+    Wheel->NextTrigger = Timer->TriggerTime;
+  }
+}
+
+/**
+  Removes a queued timer from a wheel.
+
+  @param  Wheel                  The wheel.
+  @param  Timer                  The timer. It must be queued in Wheel.
+
+**/
+VOID
+TimerWheelRemove (
+  IN OUT TIMER_WHEEL       *Wheel,
+  IN OUT TIMER_EVENT_INFO  *Timer
+  )
+{
+  ASSERT (Wheel->Count > 0);
+
+  RemoveEntryList (&Timer->Link);
+  Timer->Link.ForwardLink = NULL;
+  Wheel->Count--;
+
+  //
+  // NextTrigger is kept as a lower bound, a timer check that finds nothing
+  // to expire recomputes it
+  //
+  if (Wheel->Count == 0) {
+    Wheel->NextTrigger = MAX_UINT64;
+  }
+}
+
+/**
+  Advances a wheel to the current time and removes the expired timers.
+
+  @param  Wheel                  The wheel.
+  @param  SystemTime             The current time.
+  @param  Expired                An empty list that returns the timers whose
+                                 trigger time is not after SystemTime, in
+                                 ascending order of trigger time.
+
+**/
+VOID
+TimerWheelExpire (
+  IN OUT TIMER_WHEEL  *Wheel,
+  IN     UINT64       SystemTime,
+  IN OUT LIST_ENTRY   *Expired
+  )
+{
+  UINT64            Target;
+  UINT64            Next;
+  LIST_ENTRY        *Slot;
+  LIST_ENTRY        *Link;
+  LIST_ENTRY        *NextLink;
+  LIST_ENTRY        *Position;
+  TIMER_EVENT_INFO  *Timer;
+
+  Target = RShiftU64 (SystemTime, TIMER_WHEEL_GRANULE_SHIFT);
+  if (Target < Wheel->Granule) {
+    Target = Wheel->Granule;
+  }
+
+  while (TRUE) {
+    //
+    // All the timers in the level 0 slot of the current granule trigger
+    // within that granule
+    //
+    Slot = &Wheel->Slots[0][(UINTN)Wheel->Granule & TIMER_WHEEL_SLOT_MASK];
+    for (Link = Slot->ForwardLink; Link != Slot; Link = NextLink) {
+      NextLink = Link->ForwardLink;
+      Timer    = TimerFromLink (Link);
+      if (Timer->TriggerTime > SystemTime) {
+        continue;
+      }
+
+      RemoveEntryList (Link);
+      Wheel->Count--;
+
+      //
+      // Keep the expired list sorted, timers mostly expire in order
+      //
+      for (Position = Expired->BackLink; Position != Expired; Position = Position->BackLink) {
+        if (TimerFromLink (Position)->TriggerTime <= Timer->TriggerTime) {
+          break;
+        }
+      }
+
+      InsertHeadList (Position, Link);
+    }
+
+    if (Wheel->Granule >= Target) {
+      break;
+    }
+
+    //
+    // Skip the granules that have nothing to process
+    //
+    Next = TimerWheelNextGranule (Wheel);
+    if (Next > Target) {
+      Wheel->Granule = Target;
+      break;
+    }
+
+    Wheel->Granule = Next;
+    TimerWheelCascade (Wheel);
+  }
+
+  Wheel->NextTrigger = TimerWheelEarliestTrigger (Wheel);
+}
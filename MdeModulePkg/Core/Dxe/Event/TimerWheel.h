@@ -0,0 +1,111 @@
+/** @file
+  Hierarchical timing wheel that holds the pending DXE core timer events.
+
+  Time is divided in granules of 2^TIMER_WHEEL_GRANULE_SHIFT units of 100ns.
+  Level 0 of the wheel has one slot per granule for the next
+  TIMER_WHEEL_SLOTS granules, and every higher level has slots that are
+  TIMER_WHEEL_SLOTS times wider than the slots of the level below. A timer is
+  queued in the slot that covers its trigger time at the lowest level that
+  reaches that far, and is moved down one level when the wheel enters the
+  range of its slot. Inserting and removing a timer is O(1), and expiring
+  timers only visits the slots that hold timers.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <Uefi/UefiBaseType.h>
+
+#include <Library/BaseLib.h>
+
+///
+/// Timer event information
+///
+typedef struct {
+  LIST_ENTRY    Link;
+  UINT64        TriggerTime;
+  UINT64        Period;
+} TIMER_EVENT_INFO;
+
+//
+// A granule is 2^16 * 100ns, about 6.5ms. With 4 levels of 64 slots, the
+// wheel spans 2^40 * 100ns, about 30 hours. Timers that trigger later are
+// parked at the far end of the top level until they come in range.
+//
+#define TIMER_WHEEL_GRANULE_SHIFT  16
+#define TIMER_WHEEL_LEVEL_SHIFT    6
+#define TIMER_WHEEL_SLOTS          (1 << TIMER_WHEEL_LEVEL_SHIFT)
+#define TIMER_WHEEL_LEVELS         4
+
+typedef struct {
+  LIST_ENTRY    Slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+  //
+  // The granule the wheel has been advanced to.
+  //
+  UINT64        Granule;
+  UINTN         Count;
+  //
+  // A trigger time that no queued timer is earlier than, or MAX_UINT64 if
+  // no timer is queued. It is exact after TimerWheelExpire().
+  //
+  UINT64        NextTrigger;
+} TIMER_WHEEL;
+
+/**
+  Initializes an empty timing wheel.
+
+  @param  Wheel                  The wheel.
+
+**/
+VOID
+TimerWheelInitialize (
+  OUT TIMER_WHEEL  *Wheel
+  );
+
+/**
+  Queues a timer in a wheel at its trigger time.
+
+  @param  Wheel                  The wheel.
+  @param  Timer                  The timer. It must not be queued already.
+
+**/
+VOID
+TimerWheelInsert (
+  IN OUT TIMER_WHEEL       *Wheel,
+  IN OUT TIMER_EVENT_INFO  *Timer
+  );
+
+/**
+  Removes a queued timer from a wheel.
+
+  @param  Wheel                  The wheel.
+  @param  Timer                  The timer. It must be queued in Wheel.
+
+**/
+VOID
+TimerWheelRemove (
+  IN OUT TIMER_WHEEL       *Wheel,
+  IN OUT TIMER_EVENT_INFO  *Timer
+  );
+
+/**
+  Advances a wheel to the current time and removes the expired timers.
+
+  @param  Wheel                  The wheel.
+  @param  SystemTime             The current time.
+  @param  Expired                An empty list that returns the timers whose
+                                 trigger time is not after SystemTime, in
+                                 ascending order of trigger time.
+
+**/
+VOID
+TimerWheelExpire (
+  IN OUT TIMER_WHEEL  *Wheel,
+  IN     UINT64       SystemTime,
+  IN OUT LIST_ENTRY   *Expired
+  );
+
+#endif
@@ -13,6 +13,504 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 // Driver Support Functions
 //
 
+/**
+  Checks whether the user has permission to start UEFI device drivers on a
+  controller.
+
+  @param  ControllerHandle      The handle of the controller to which driver(s) are to be connected.
+  @param  RemainingDevicePath   A pointer to the device path that specifies a child of the
+                                controller specified by ControllerHandle.
+  @param  Recursive             Whether the connection is recursive.
+
+  @retval EFI_SUCCESS           The drivers can be started on the controller.
+  @retval EFI_SECURITY_VIOLATION
+                                The user has no permission to start UEFI device drivers on the device path
+                                associated with the ControllerHandle or specified by the RemainingDevicePath.
+
+**/
+STATIC
+EFI_STATUS
+CoreAuthenticateController (
+  IN  EFI_HANDLE                ControllerHandle,
+  IN  EFI_DEVICE_PATH_PROTOCOL  *RemainingDevicePath  OPTIONAL,
+  IN  BOOLEAN                   Recursive
+  )
+{
+  EFI_STATUS                Status;
+  UINTN                     HandleFilePathSize;
+  UINTN                     RemainingDevicePathSize;
+  EFI_DEVICE_PATH_PROTOCOL  *HandleFilePath;
+  EFI_DEVICE_PATH_PROTOCOL  *FilePath;
+  EFI_DEVICE_PATH_PROTOCOL  *TempFilePath;
+
+  if (gSecurity2 == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Check whether the user has permission to start UEFI device drivers.
+  //
+  Status = CoreHandleProtocol (ControllerHandle, &gEfiDevicePathProtocolGuid, (VOID **)&HandleFilePath);
+  if (EFI_ERROR (Status)) {
+    return EFI_SUCCESS;
+  }
+
+  ASSERT (HandleFilePath != NULL);
+  FilePath     = HandleFilePath;
+  TempFilePath = NULL;
+  if ((RemainingDevicePath != NULL) && !Recursive) {
+    HandleFilePathSize      = GetDevicePathSize (HandleFilePath) - sizeof (EFI_DEVICE_PATH_PROTOCOL);
+    RemainingDevicePathSize = GetDevicePathSize (RemainingDevicePath);
+    TempFilePath            = AllocateZeroPool (HandleFilePathSize + RemainingDevicePathSize);
+    ASSERT (TempFilePath != NULL);
+    CopyMem (TempFilePath, HandleFilePath, HandleFilePathSize);
+    CopyMem ((UINT8 *)TempFilePath + HandleFilePathSize, RemainingDevicePath, RemainingDevicePathSize);
+    FilePath = TempFilePath;
+  }
+
+  Status = gSecurity2->FileAuthentication (
+                         gSecurity2,
+                         FilePath,
+                         NULL,
+                         0,
+                         FALSE
+                         );
+  if (TempFilePath != NULL) {
+    FreePool (TempFilePath);
+  }
+
+  return Status;
+}
+
+/**
+  Returns the child handles that were created on a controller.
+
+  @param  ControllerHandle      The handle of the controller.
+  @param  ChildHandleBuffer     Returns a buffer of the child handles, allocated
+                                with AllocatePool().
+  @param  ChildHandleCount      Returns the number of child handles.
+
+  @retval EFI_SUCCESS           The child handles were returned.
+  @retval EFI_INVALID_PARAMETER ControllerHandle is not a valid handle.
+  @retval EFI_OUT_OF_RESOURCES  The buffer of child handles could not be
+                                allocated.
+
+**/
+STATIC
+EFI_STATUS
+CoreGetChildControllers (
+  IN  EFI_HANDLE  ControllerHandle,
+  OUT EFI_HANDLE  **ChildHandleBuffer,
+  OUT UINTN       *ChildHandleCount
+  )
+{
+  EFI_STATUS          Status;
+  IHANDLE             *Handle;
+  PROTOCOL_INTERFACE  *Prot;
+  LIST_ENTRY          *Link;
+  LIST_ENTRY          *ProtLink;
+  OPEN_PROTOCOL_DATA  *OpenData;
+  UINTN               Count;
+
+  Handle = ControllerHandle;
+
+  //
+  // Acquire the protocol lock on the handle database so the child handles can be collected
+  //
+  CoreAcquireProtocolLock ();
+
+  //
+  // Make sure the DriverBindingHandle is valid
+  //
+  Status = CoreValidateHandle (ControllerHandle);
+  if (EFI_ERROR (Status)) {
+    //
+    // Release the protocol lock on the handle database
+    //
+    CoreReleaseProtocolLock ();
+
+    return Status;
+  }
+
+  //
+  // Count ControllerHandle's children
+  //
+  for (Link = Handle->Protocols.ForwardLink, Count = 0; Link != &Handle->Protocols; Link = Link->ForwardLink) {
+    Prot = CR (Link, PROTOCOL_INTERFACE, Link, PROTOCOL_INTERFACE_SIGNATURE);
+    for (ProtLink = Prot->OpenList.ForwardLink;
+         ProtLink != &Prot->OpenList;
+         ProtLink = ProtLink->ForwardLink)
+    {
+      OpenData = CR (ProtLink, OPEN_PROTOCOL_DATA, Link, OPEN_PROTOCOL_DATA_SIGNATURE);
+      if ((OpenData->Attributes & EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) != 0) {
+        Count++;
+      }
+    }
+  }
+
+  //
+  // Allocate a handle buffer for ControllerHandle's children
+  //
+  *ChildHandleBuffer = AllocatePool (Count * sizeof (EFI_HANDLE));
+  if (*ChildHandleBuffer == NULL) {
+    CoreReleaseProtocolLock ();
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Fill in a handle buffer with ControllerHandle's children
+  //
+  for (Link = Handle->Protocols.ForwardLink, Count = 0; Link != &Handle->Protocols; Link = Link->ForwardLink) {
+    Prot = CR (Link, PROTOCOL_INTERFACE, Link, PROTOCOL_INTERFACE_SIGNATURE);
+    for (ProtLink = Prot->OpenList.ForwardLink;
+         ProtLink != &Prot->OpenList;
+         ProtLink = ProtLink->ForwardLink)
+    {
+      OpenData = CR (ProtLink, OPEN_PROTOCOL_DATA, Link, OPEN_PROTOCOL_DATA_SIGNATURE);
+      if ((OpenData->Attributes & EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) != 0) {
+        (*ChildHandleBuffer)[Count] = OpenData->ControllerHandle;
+        Count++;
+      }
+    }
+  }
+
+  *ChildHandleCount = Count;
+
+  //
+  // Release the protocol lock on the handle database
+  //
+  CoreReleaseProtocolLock ();
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Returns the device path of the PCI root port above a controller, that is
+  the device path of the controller up to its first PCI node. Controllers
+  behind distinct root ports are independent of each other.
+
+  @param  ControllerHandle      The handle of the controller.
+  @param  RootPortPath          Returns the device path of the controller.
+  @param  RootPortPathSize      Returns the size of the root port part of
+                                RootPortPath, or 0 if the controller is not
+                                behind a PCI root port.
+
+**/
+STATIC
+VOID
+CoreGetRootPortPath (
+  IN  EFI_HANDLE                ControllerHandle,
+  OUT EFI_DEVICE_PATH_PROTOCOL  **RootPortPath,
+  OUT UINTN                     *RootPortPathSize
+  )
+{
+  EFI_STATUS                Status;
+  EFI_DEVICE_PATH_PROTOCOL  *Node;
+
+  *RootPortPath     = NULL;
+  *RootPortPathSize = 0;
+
+  Status = CoreHandleProtocol (ControllerHandle, &gEfiDevicePathProtocolGuid, (VOID **)RootPortPath);
+  if (EFI_ERROR (Status) || (*RootPortPath == NULL)) {
+    return;
+  }
+
+  //
+  // PCI devices are described by an ACPI node of the root bridge followed by
+  // one PCI node per bridge on the way to the device
+  //
+  Node = *RootPortPath;
+  if (DevicePathType (Node) != ACPI_DEVICE_PATH) {
+    return;
+  }
+
+  for ( ; !IsDevicePathEnd (Node); Node = NextDevicePathNode (Node)) {
+    if ((DevicePathType (Node) == HARDWARE_DEVICE_PATH) && (DevicePathSubType (Node) == HW_PCI_DP)) {
+      *RootPortPathSize = (UINTN)NextDevicePathNode (Node) - (UINTN)*RootPortPath;
+      return;
+    }
+  }
+}
+
+/**
+  Begins a deferred start of a driver on a controller, if the driver produces
+  the Driver Binding Deferred Start protocol.
+
+  @param  DriverBinding         The driver whose Supported() function accepted
+                                ControllerHandle.
+  @param  ControllerHandle      The handle of the controller.
+  @param  RemainingDevicePath   A pointer to the device path that specifies a
+                                child of the controller.
+  @param  PendingStart          Returns the deferred start.
+
+  @retval EFI_SUCCESS           The deferred start was begun.
+  @retval EFI_UNSUPPORTED       The driver must be started with Start().
+  @retval Others                The deferred start could not be begun.
+
+**/
+STATIC
+EFI_STATUS
+CoreBeginDeferredStart (
+  IN     EFI_DRIVER_BINDING_PROTOCOL  *DriverBinding,
+  IN     EFI_HANDLE                   ControllerHandle,
+  IN     EFI_DEVICE_PATH_PROTOCOL     *RemainingDevicePath OPTIONAL,
+  IN OUT PENDING_DRIVER_START         *PendingStart
+  )
+{
+  EFI_STATUS                                    Status;
+  EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  *DeferredStart;
+
+  Status = CoreHandleProtocol (
+             DriverBinding->DriverBindingHandle,
+             &gEdkiiDriverBindingDeferredStartProtocolGuid,
+             (VOID **)&DeferredStart
+             );
+  if (EFI_ERROR (Status) || (DeferredStart == NULL)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  PERF_DRIVER_BINDING_START_BEGIN (DriverBinding->DriverBindingHandle, ControllerHandle);
+  Status = DeferredStart->Begin (
+                            DeferredStart,
+                            ControllerHandle,
+                            RemainingDevicePath,
+                            &PendingStart->Context
+                            );
+  if (EFI_ERROR (Status)) {
+    PERF_DRIVER_BINDING_START_END (DriverBinding->DriverBindingHandle, ControllerHandle);
+    return Status;
+  }
+
+  PendingStart->ControllerHandle = ControllerHandle;
+  PendingStart->DriverBinding    = DriverBinding;
+  PendingStart->DeferredStart    = DeferredStart;
+  return EFI_SUCCESS;
+}
+
+/**
+  Begins the deferred starts of drivers on a set of controllers, and polls
+  them until they are all completed. At most one deferred start is pending
+  per PCI root port at any time, so only the controllers of independent
+  subtrees are started together.
+
+  Controllers whose highest priority driver does not produce the Driver
+  Binding Deferred Start protocol are left untouched, to be connected with
+  Start() afterwards. The handles of the controllers whose deferred start
+  failed are replaced with NULL in HandleBuffer, so that the driver is not
+  started a second time with Start().
+
+  @param  HandleBuffer          The handles of the controllers.
+  @param  HandleCount           The number of handles in HandleBuffer.
+
+**/
+STATIC
+VOID
+CoreRunDeferredStarts (
+  IN EFI_HANDLE  *HandleBuffer,
+  IN UINTN       HandleCount
+  )
+{
+  EFI_STATUS            Status;
+  PENDING_DRIVER_START  *PendingStarts;
+  PENDING_DRIVER_START  *PendingStart;
+  UINTN                 PendingCount;
+  BOOLEAN               *Scheduled;
+  UINTN                 Remaining;
+  UINTN                 Index;
+  UINTN                 PendingIndex;
+  BOOLEAN               Completed;
+
+  PendingStarts = AllocateZeroPool (HandleCount * sizeof (PENDING_DRIVER_START));
+  Scheduled     = AllocateZeroPool (HandleCount * sizeof (BOOLEAN));
+  if ((PendingStarts == NULL) || (Scheduled == NULL)) {
+    goto Done;
+  }
+
+  PendingCount = 0;
+  Remaining    = HandleCount;
+  while ((Remaining > 0) || (PendingCount > 0)) {
+    //
+    // Begin the deferred start of every controller whose root port has no
+    // deferred start pending
+    //
+    for (Index = 0; Index < HandleCount; Index++) {
+      if (Scheduled[Index]) {
+        continue;
+      }
+
+      PendingStart = &PendingStarts[PendingCount];
+      CoreGetRootPortPath (HandleBuffer[Index], &PendingStart->RootPortPath, &PendingStart->RootPortPathSize);
+      for (PendingIndex = 0; PendingIndex < PendingCount; PendingIndex++) {
+        if ((PendingStarts[PendingIndex].RootPortPathSize == PendingStart->RootPortPathSize) &&
+            (CompareMem (PendingStarts[PendingIndex].RootPortPath, PendingStart->RootPortPath, PendingStart->RootPortPathSize) == 0))
+        {
+          break;
+        }
+      }
+
+      if ((PendingStart->RootPortPathSize != 0) && (PendingIndex < PendingCount)) {
+        continue;
+      }
+
+      Scheduled[Index] = TRUE;
+      Remaining--;
+
+      if (PendingStart->RootPortPathSize == 0) {
+        continue;
+      }
+
+      CoreAcquireProtocolLock ();
+      Status = CoreValidateHandle (HandleBuffer[Index]);
+      CoreReleaseProtocolLock ();
+      if (EFI_ERROR (Status)) {
+        continue;
+      }
+
+      Status = CoreAuthenticateController (HandleBuffer[Index], NULL, TRUE);
+      if (EFI_ERROR (Status)) {
+        continue;
+      }
+
+      do {
+        Status = CoreConnectSingleController (HandleBuffer[Index], NULL, NULL, PendingStart);
+      } while (Status == EFI_NOT_READY);
+
+      if (!EFI_ERROR (Status)) {
+        PendingStart->HandleIndex = Index;
+        PendingCount++;
+      } else if ((Status != EFI_UNSUPPORTED) && (Status != EFI_NOT_FOUND)) {
+        //
+        // Begin() failed as Start() would have, don't call Start() again
+        //
+        DEBUG ((DEBUG_ERROR, "Deferred start on controller %p: %r\n", HandleBuffer[Index], Status));
+        HandleBuffer[Index] = NULL;
+      }
+    }
+
+    //
+    // Poll the pending starts until at least one of them is completed, so
+    // that the next controller of its root port can be begun
+    //
+    Completed = FALSE;
+    while ((PendingCount > 0) && !Completed) {
+      for (PendingIndex = 0; PendingIndex < PendingCount; ) {
+        PendingStart = &PendingStarts[PendingIndex];
+        Status       = PendingStart->DeferredStart->Poll (
+                                                      PendingStart->DeferredStart,
+                                                      PendingStart->ControllerHandle,
+                                                      PendingStart->Context
+                                                      );
+        if (Status == EFI_NOT_READY) {
+          PendingIndex++;
+          continue;
+        }
+
+        PERF_DRIVER_BINDING_START_END (PendingStart->DriverBinding->DriverBindingHandle, PendingStart->ControllerHandle);
+        DEBUG ((
+          EFI_ERROR (Status) ? DEBUG_ERROR : DEBUG_VERBOSE,
+          "Deferred start of driver %p on controller %p: %r\n",
+          PendingStart->DriverBinding->DriverBindingHandle,
+          PendingStart->ControllerHandle,
+          Status
+          ));
+
+        if (EFI_ERROR (Status)) {
+          HandleBuffer[PendingStart->HandleIndex] = NULL;
+        }
+
+        PendingCount--;
+        CopyMem (PendingStart, &PendingStarts[PendingCount], sizeof (PENDING_DRIVER_START));
+        Completed = TRUE;
+      }
+
+      if (!Completed) {
+        CoreStall (DEFERRED_START_POLL_INTERVAL);
+      }
+    }
+  }
+
+Done:
+  if (PendingStarts != NULL) {
+    CoreFreePool (PendingStarts);
+  }
+
+  if (Scheduled != NULL) {
+    CoreFreePool (Scheduled);
+  }
+}
+
+/**
+  Connects all drivers to a set of controllers and to all the controllers
+  below them, one level of the controller trees at a time. The drivers that
+  produce the Driver Binding Deferred Start protocol are started on the
+  controllers of the level first, with the controllers of independent
+  subtrees being started together, then the controllers of the level are
+  connected as with a non-recursive ConnectController().
+
+  @param  HandleBuffer          The handles of the controllers, allocated
+                                with AllocatePool(). The buffer is freed.
+  @param  HandleCount           The number of handles in HandleBuffer.
+
+**/
+STATIC
+VOID
+CoreConnectControllersInParallel (
+  IN EFI_HANDLE  *HandleBuffer,
+  IN UINTN       HandleCount
+  )
+{
+  EFI_STATUS  Status;
+  EFI_HANDLE  *ChildHandleBuffer;
+  UINTN       ChildHandleCount;
+  EFI_HANDLE  *NextHandleBuffer;
+  UINTN       NextHandleCount;
+  EFI_HANDLE  *NewHandleBuffer;
+  UINTN       Index;
+
+  while (HandleCount > 0) {
+    CoreRunDeferredStarts (HandleBuffer, HandleCount);
+
+    NextHandleBuffer = NULL;
+    NextHandleCount  = 0;
+    for (Index = 0; Index < HandleCount; Index++) {
+      if (HandleBuffer[Index] == NULL) {
+        continue;
+      }
+
+      CoreConnectController (HandleBuffer[Index], NULL, NULL, FALSE);
+
+      Status = CoreGetChildControllers (HandleBuffer[Index], &ChildHandleBuffer, &ChildHandleCount);
+      if (EFI_ERROR (Status)) {
+        continue;
+      }
+
+      if (ChildHandleCount > 0) {
+        NewHandleBuffer = AllocatePool ((NextHandleCount + ChildHandleCount) * sizeof (EFI_HANDLE));
+        if (NewHandleBuffer != NULL) {
+          if (NextHandleBuffer != NULL) {
+            CopyMem (NewHandleBuffer, NextHandleBuffer, NextHandleCount * sizeof (EFI_HANDLE));
+            CoreFreePool (NextHandleBuffer);
+          }
+
+          CopyMem (&NewHandleBuffer[NextHandleCount], ChildHandleBuffer, ChildHandleCount * sizeof (EFI_HANDLE));
+          NextHandleBuffer = NewHandleBuffer;
+          NextHandleCount += ChildHandleCount;
+        }
+      }
+
+      CoreFreePool (ChildHandleBuffer);
+    }
+
+    CoreFreePool (HandleBuffer);
+    HandleBuffer = NextHandleBuffer;
+    HandleCount  = NextHandleCount;
+  }
+
+  if (HandleBuffer != NULL) {
+    CoreFreePool (HandleBuffer);
+  }
+}
+
 /**
   Connects one or more drivers to a controller.
 
@@ -50,20 +548,10 @@ CoreConnectController (
 {
   EFI_STATUS                Status;
   EFI_STATUS                ReturnStatus;
-  IHANDLE                   *Handle;
-  PROTOCOL_INTERFACE        *Prot;
-  LIST_ENTRY                *Link;
-  LIST_ENTRY                *ProtLink;
-  OPEN_PROTOCOL_DATA        *OpenData;
   EFI_DEVICE_PATH_PROTOCOL  *AlignedRemainingDevicePath;
   EFI_HANDLE                *ChildHandleBuffer;
   UINTN                     ChildHandleCount;
   UINTN                     Index;
-  UINTN                     HandleFilePathSize;
-  UINTN                     RemainingDevicePathSize;
-  EFI_DEVICE_PATH_PROTOCOL  *HandleFilePath;
-  EFI_DEVICE_PATH_PROTOCOL  *FilePath;
-  EFI_DEVICE_PATH_PROTOCOL  *TempFilePath;
 
   //
   // Make sure ControllerHandle is valid
@@ -78,44 +566,14 @@ CoreConnectController (
     return Status;
   }
 
-  if (gSecurity2 != NULL) {
-    //
-    // Check whether the user has permission to start UEFI device drivers.
-    //
-    Status = CoreHandleProtocol (ControllerHandle, &gEfiDevicePathProtocolGuid, (VOID **)&HandleFilePath);
-    if (!EFI_ERROR (Status)) {
-      ASSERT (HandleFilePath != NULL);
-      FilePath     = HandleFilePath;
-      TempFilePath = NULL;
-      if ((RemainingDevicePath != NULL) && !Recursive) {
-        HandleFilePathSize      = GetDevicePathSize (HandleFilePath) - sizeof (EFI_DEVICE_PATH_PROTOCOL);
-        RemainingDevicePathSize = GetDevicePathSize (RemainingDevicePath);
-        TempFilePath            = AllocateZeroPool (HandleFilePathSize + RemainingDevicePathSize);
-        ASSERT (TempFilePath != NULL);
-        CopyMem (TempFilePath, HandleFilePath, HandleFilePathSize);
-        CopyMem ((UINT8 *)TempFilePath + HandleFilePathSize, RemainingDevicePath, RemainingDevicePathSize);
-        FilePath = TempFilePath;
-      }
-
-      Status = gSecurity2->FileAuthentication (
-                             gSecurity2,
-                             FilePath,
-                             NULL,
-                             0,
-                             FALSE
-                             );
-      if (TempFilePath != NULL) {
-        FreePool (TempFilePath);
-      }
-
-      if (EFI_ERROR (Status)) {
-        return Status;
-      }
-    }
+  //
+  // Check whether the user has permission to start UEFI device drivers.
+  //
+  Status = CoreAuthenticateController (ControllerHandle, RemainingDevicePath, Recursive);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
-  Handle = ControllerHandle;
-
   //
   // Make a copy of RemainingDevicePath to guanatee it is aligned
   //
@@ -138,7 +596,8 @@ CoreConnectController (
     ReturnStatus = CoreConnectSingleController (
                      ControllerHandle,
                      DriverImageHandle,
-                     AlignedRemainingDevicePath
+                     AlignedRemainingDevicePath,
+                     NULL
                      );
   } while (ReturnStatus == EFI_NOT_READY);
 
@@ -154,70 +613,26 @@ CoreConnectController (
   //
   if (Recursive) {
     //
-    // Acquire the protocol lock on the handle database so the child handles can be collected
+    // Collect ControllerHandle's children
     //
-    CoreAcquireProtocolLock ();
+    Status = CoreGetChildControllers (ControllerHandle, &ChildHandleBuffer, &ChildHandleCount);
+    if (Status == EFI_OUT_OF_RESOURCES) {
+      return Status;
+    }
 
-    //
-    // Make sure the DriverBindingHandle is valid
-    //
-    Status = CoreValidateHandle (ControllerHandle);
     if (EFI_ERROR (Status)) {
-      //
-      // Release the protocol lock on the handle database
-      //
-      CoreReleaseProtocolLock ();
-
       return ReturnStatus;
     }
 
-    //
-    // Count ControllerHandle's children
-    //
-    for (Link = Handle->Protocols.ForwardLink, ChildHandleCount = 0; Link != &Handle->Protocols; Link = Link->ForwardLink) {
-      Prot = CR (Link, PROTOCOL_INTERFACE, Link, PROTOCOL_INTERFACE_SIGNATURE);
-      for (ProtLink = Prot->OpenList.ForwardLink;
-           ProtLink != &Prot->OpenList;
-           ProtLink = ProtLink->ForwardLink)
-      {
-        OpenData = CR (ProtLink, OPEN_PROTOCOL_DATA, Link, OPEN_PROTOCOL_DATA_SIGNATURE);
-        if ((OpenData->Attributes & EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) != 0) {
-          ChildHandleCount++;
-        }
-      }
-    }
-
-    //
-    // Allocate a handle buffer for ControllerHandle's children
-    //
-    ChildHandleBuffer = AllocatePool (ChildHandleCount * sizeof (EFI_HANDLE));
-    if (ChildHandleBuffer == NULL) {
-      CoreReleaseProtocolLock ();
-      return EFI_OUT_OF_RESOURCES;
-    }
-
-    //
-    // Fill in a handle buffer with ControllerHandle's children
-    //
-    for (Link = Handle->Protocols.ForwardLink, ChildHandleCount = 0; Link != &Handle->Protocols; Link = Link->ForwardLink) {
-      Prot = CR (Link, PROTOCOL_INTERFACE, Link, PROTOCOL_INTERFACE_SIGNATURE);
-      for (ProtLink = Prot->OpenList.ForwardLink;
-           ProtLink != &Prot->OpenList;
-           ProtLink = ProtLink->ForwardLink)
-      {
-        OpenData = CR (ProtLink, OPEN_PROTOCOL_DATA, Link, OPEN_PROTOCOL_DATA_SIGNATURE);
-        if ((OpenData->Attributes & EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) != 0) {
-          ChildHandleBuffer[ChildHandleCount] = OpenData->ControllerHandle;
-          ChildHandleCount++;
-        }
-      }
+    if (FeaturePcdGet (PcdDxeParallelConnectEnable)) {
+      //
+      // Connect the children level by level, overlapping the deferred starts
+      // of independent controllers. The handle buffer is freed.
+      //
+      CoreConnectControllersInParallel (ChildHandleBuffer, ChildHandleCount);
+      return ReturnStatus;
     }
 
-    //
-    // Release the protocol lock on the handle database
-    //
-    CoreReleaseProtocolLock ();
-
     //
     // Recursively connect each child handle
     //
@@ -380,20 +795,34 @@ AddSortedDriverBindingProtocol (
                                                 the device path that specifies a
                                                 child  of the controller
                                                 specified by ControllerHandle.
+  @param  PendingStart                          If not NULL, only the first
+                                                driver that supports
+                                                ControllerHandle is considered,
+                                                and it is only begun to be
+                                                started if it produces the
+                                                Driver Binding Deferred Start
+                                                protocol.
 
   @retval EFI_SUCCESS                           One or more drivers were
                                                 connected to ControllerHandle.
+                                                If PendingStart is not NULL,
+                                                a deferred start was begun and
+                                                PendingStart describes it.
   @retval EFI_OUT_OF_RESOURCES                  No enough system resources to
                                                 complete the request.
   @retval EFI_NOT_FOUND                         No drivers were connected to
                                                 ControllerHandle.
+  @retval EFI_UNSUPPORTED                       PendingStart is not NULL and
+                                                the driver must be started with
+                                                Start().
 
 **/
 EFI_STATUS
 CoreConnectSingleController (
   IN  EFI_HANDLE                ControllerHandle,
   IN  EFI_HANDLE                *ContextDriverImageHandles OPTIONAL,
-  IN  EFI_DEVICE_PATH_PROTOCOL  *RemainingDevicePath       OPTIONAL
+  IN  EFI_DEVICE_PATH_PROTOCOL  *RemainingDevicePath       OPTIONAL,
+  IN  OUT PENDING_DRIVER_START  *PendingStart              OPTIONAL
   )
 {
   EFI_STATUS                                 Status;
@@ -645,6 +1074,16 @@ CoreConnectSingleController (
           SortedDriverBindingProtocols[Index] = NULL;
           DriverFound                         = TRUE;
 
+          if (PendingStart != NULL) {
+            //
+            // Only begin a deferred start, the driver is started with Start()
+            // if it does not support it
+            //
+            Status = CoreBeginDeferredStart (DriverBinding, ControllerHandle, RemainingDevicePath, PendingStart);
+            CoreFreePool (SortedDriverBindingProtocols);
+            return Status;
+          }
+
           //
           // A driver was found that supports ControllerHandle, so attempt to start the driver
           // on ControllerHandle.
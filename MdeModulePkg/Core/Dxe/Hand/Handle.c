@@ -10,15 +10,34 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include "Handle.h"
 
 //
-// mProtocolDatabase     - A list of all protocols in the system.  (simple list for now)
+// Number of buckets of the protocol and handle hash tables, as a power of two
+//
+#define PROTOCOL_HASH_BITS  7
+#define HANDLE_HASH_BITS    9
+
+typedef struct {
+  UINT64    ProtocolLookups;
+  UINT64    ProtocolProbes;
+  UINT64    HandleLookups;
+  UINT64    HandleProbes;
+} PROTOCOL_DATABASE_STATISTICS;
+
+//
+// mProtocolDatabase     - A list of all protocols in the system.
+// mProtocolHashTable    - The protocols in mProtocolDatabase, hashed by GUID
 // gHandleList           - A list of all the handles in the system
+// mHandleHashTable      - The handles in gHandleList, hashed by address
 // gProtocolDatabaseLock - Lock to protect the mProtocolDatabase
 // gHandleDatabaseKey    -  The Key to show that the handle has been created/modified
 //
-LIST_ENTRY  mProtocolDatabase     = INITIALIZE_LIST_HEAD_VARIABLE (mProtocolDatabase);
-LIST_ENTRY  gHandleList           = INITIALIZE_LIST_HEAD_VARIABLE (gHandleList);
-EFI_LOCK    gProtocolDatabaseLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
-UINT64      gHandleDatabaseKey    = 0;
+LIST_ENTRY      mProtocolDatabase                          = INITIALIZE_LIST_HEAD_VARIABLE (mProtocolDatabase);
+PROTOCOL_ENTRY  *mProtocolHashTable[1 << PROTOCOL_HASH_BITS];
+LIST_ENTRY      gHandleList                                = INITIALIZE_LIST_HEAD_VARIABLE (gHandleList);
+IHANDLE         *mHandleHashTable[1 << HANDLE_HASH_BITS];
+EFI_LOCK        gProtocolDatabaseLock                      = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
+UINT64          gHandleDatabaseKey                         = 0;
+
+PROTOCOL_DATABASE_STATISTICS  mProtocolDatabaseStatistics;
 
 /**
   Acquire lock on gProtocolDatabaseLock.
@@ -44,6 +63,103 @@ CoreReleaseProtocolLock (
   CoreReleaseLock (&gProtocolDatabaseLock);
 }
 
+/**
+  Computes the bucket of a protocol GUID in mProtocolHashTable.
+
+  @param  Protocol               The ID of the protocol
+
+  @return The bucket index
+
+**/
+STATIC
+UINTN
+ProtocolHash (
+  IN CONST EFI_GUID  *Protocol
+  )
+{
+  UINT32  Hash;
+
+  Hash = ReadUnaligned32 ((CONST UINT32 *)Protocol) ^
+         ReadUnaligned32 ((CONST UINT32 *)Protocol + 1) ^
+         ReadUnaligned32 ((CONST UINT32 *)Protocol + 2) ^
+         ReadUnaligned32 ((CONST UINT32 *)Protocol + 3);
+
+  return (UINTN)((Hash * 0x9E3779B1U) >> (32 - PROTOCOL_HASH_BITS));
+}
+
+/**
+  Computes the bucket of a handle in mHandleHashTable.
+  The handle is not dereferenced.
+
+  @param  UserHandle             The handle
+
+  @return The bucket index
+
+**/
+STATIC
+UINTN
+HandleHash (
+  IN EFI_HANDLE  UserHandle
+  )
+{
+  UINT64  Address;
+  UINT32  Hash;
+
+  Address = (UINT64)(UINTN)UserHandle;
+  Hash    = (UINT32)(Address >> 3) ^ (UINT32)(Address >> 32);
+
+  return (UINTN)((Hash * 0x9E3779B1U) >> (32 - HANDLE_HASH_BITS));
+}
+
+/**
+  Adds a new handle to gHandleList and mHandleHashTable.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle to add
+
+**/
+STATIC
+VOID
+CoreInsertHandle (
+  IN IHANDLE  *Handle
+  )
+{
+  UINTN  Bucket;
+
+  InsertTailList (&gHandleList, &Handle->AllHandles);
+
+  Bucket                   = HandleHash (Handle);
+  Handle->HashNext         = mHandleHashTable[Bucket];
+  mHandleHashTable[Bucket] = Handle;
+}
+
+/**
+  Removes a handle from gHandleList and mHandleHashTable.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle to remove
+
+**/
+STATIC
+VOID
+CoreRemoveHandle (
+  IN IHANDLE  *Handle
+  )
+{
+  IHANDLE  **Link;
+
+  RemoveEntryList (&Handle->AllHandles);
+
+  for (Link = &mHandleHashTable[HandleHash (Handle)]; *Link != NULL; Link = &(*Link)->HashNext) {
+    if (*Link == Handle) {
+      *Link = Handle->HashNext;
+      break;
+    }
+  }
+
+  Handle->HashNext = NULL;
+}
+
 /**
   Check whether a handle is a valid EFI_HANDLE
   The gProtocolDatabaseLock must be owned
@@ -59,8 +175,7 @@ CoreValidateHandle (
   IN  EFI_HANDLE  UserHandle
   )
 {
-  IHANDLE     *Handle;
-  LIST_ENTRY  *Link;
+  IHANDLE  *Handle;
 
   if (UserHandle == NULL) {
     return EFI_INVALID_PARAMETER;
@@ -68,8 +183,13 @@ CoreValidateHandle (
 
   ASSERT_LOCKED (&gProtocolDatabaseLock);
 
-  for (Link = gHandleList.BackLink; Link != &gHandleList; Link = Link->BackLink) {
-    Handle = CR (Link, IHANDLE, AllHandles, EFI_HANDLE_SIGNATURE);
+  //
+  // Only compare addresses, UserHandle must not be dereferenced until it is
+  // known to be valid
+  //
+  mProtocolDatabaseStatistics.HandleLookups++;
+  for (Handle = mHandleHashTable[HandleHash (UserHandle)]; Handle != NULL; Handle = Handle->HashNext) {
+    mProtocolDatabaseStatistics.HandleProbes++;
     if (Handle == (IHANDLE *)UserHandle) {
       return EFI_SUCCESS;
     }
@@ -94,7 +214,7 @@ CoreFindProtocolEntry (
   IN BOOLEAN   Create
   )
 {
-  LIST_ENTRY      *Link;
+  UINTN           Bucket;
   PROTOCOL_ENTRY  *Item;
   PROTOCOL_ENTRY  *ProtEntry;
 
@@ -104,12 +224,11 @@ CoreFindProtocolEntry (
   // Search the database for the matching GUID
   //
 
+  mProtocolDatabaseStatistics.ProtocolLookups++;
+  Bucket    = ProtocolHash (Protocol);
   ProtEntry = NULL;
-  for (Link = mProtocolDatabase.ForwardLink;
-       Link != &mProtocolDatabase;
-       Link = Link->ForwardLink)
-  {
-    Item = CR (Link, PROTOCOL_ENTRY, AllEntries, PROTOCOL_ENTRY_SIGNATURE);
+  for (Item = mProtocolHashTable[Bucket]; Item != NULL; Item = Item->HashNext) {
+    mProtocolDatabaseStatistics.ProtocolProbes++;
     if (CompareGuid (&Item->ProtocolID, Protocol)) {
       //
       // This is the protocol entry
@@ -140,6 +259,8 @@ CoreFindProtocolEntry (
       // Add it to protocol database
       //
       InsertTailList (&mProtocolDatabase, &ProtEntry->AllEntries);
+      ProtEntry->HashNext        = mProtocolHashTable[Bucket];
+      mProtocolHashTable[Bucket] = ProtEntry;
     }
   }
 
@@ -408,7 +529,7 @@ CoreInstallProtocolInterfaceNotify (
     // Add this handle to the list global list of all handles
     // in the system
     //
-    InsertTailList (&gHandleList, &Handle->AllHandles);
+    CoreInsertHandle (Handle);
   } else {
     Status = CoreValidateHandle (Handle);
     if (EFI_ERROR (Status)) {
@@ -467,6 +588,11 @@ Done:
     // Return the new handle back to the caller
     //
     *UserHandle = Handle;
+
+    //
+    // Let the dispatcher evaluate the drivers that wait for this protocol
+    //
+    CoreDispatcherProtocolInstalled (Protocol);
   } else {
     //
     // There was an error, clean up
@@ -770,7 +896,7 @@ CoreUninstallProtocolInterface (
   //
   if (IsListEmpty (&Handle->Protocols)) {
     Handle->Signature = 0;
-    RemoveEntryList (&Handle->AllHandles);
+    CoreRemoveHandle (Handle);
     CoreFreePool (Handle);
   }
 
@@ -1561,3 +1687,67 @@ CoreConnectHandlesByKey (
 
   CoreFreePool (HandleBuffer);
 }
+
+/**
+  Reports how well the protocol and handle hash tables performed, with the
+  number of lookups, the average number of entries probed per lookup and the
+  longest hash chain.
+
+**/
+VOID
+CoreDumpProtocolDatabaseStatistics (
+  VOID
+  )
+{
+  UINTN           Index;
+  UINTN           Length;
+  UINTN           Protocols;
+  UINTN           Handles;
+  UINTN           MaxProtocolChain;
+  UINTN           MaxHandleChain;
+  PROTOCOL_ENTRY  *ProtEntry;
+  IHANDLE         *Handle;
+
+  Protocols        = 0;
+  MaxProtocolChain = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mProtocolHashTable); Index++) {
+    Length = 0;
+    for (ProtEntry = mProtocolHashTable[Index]; ProtEntry != NULL; ProtEntry = ProtEntry->HashNext) {
+      Length++;
+    }
+
+    Protocols       += Length;
+    MaxProtocolChain = MAX (MaxProtocolChain, Length);
+  }
+
+  Handles        = 0;
+  MaxHandleChain = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mHandleHashTable); Index++) {
+    Length = 0;
+    for (Handle = mHandleHashTable[Index]; Handle != NULL; Handle = Handle->HashNext) {
+      Length++;
+    }
+
+    Handles       += Length;
+    MaxHandleChain = MAX (MaxHandleChain, Length);
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "Protocol database: %u protocols in %u buckets (longest chain %u), %lu lookups, %lu probes\n",
+    (UINT32)Protocols,
+    (UINT32)ARRAY_SIZE (mProtocolHashTable),
+    (UINT32)MaxProtocolChain,
+    mProtocolDatabaseStatistics.ProtocolLookups,
+    mProtocolDatabaseStatistics.ProtocolProbes
+    ));
+  DEBUG ((
+    DEBUG_INFO,
+    "Handle database: %u handles in %u buckets (longest chain %u), %lu lookups, %lu probes\n",
+    (UINT32)Handles,
+    (UINT32)ARRAY_SIZE (mHandleHashTable),
+    (UINT32)MaxHandleChain,
+    mProtocolDatabaseStatistics.HandleLookups,
+    mProtocolDatabaseStatistics.HandleProbes
+    ));
+}
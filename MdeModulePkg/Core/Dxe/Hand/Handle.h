@@ -14,15 +14,17 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 ///
 /// IHANDLE - contains a list of protocol handles
 ///
-typedef struct {
-  UINTN         Signature;
+typedef struct _IHANDLE {
+  UINTN              Signature;
   /// All handles list of IHANDLE
-  LIST_ENTRY    AllHandles;
+  LIST_ENTRY         AllHandles;
   /// List of PROTOCOL_INTERFACE's for this handle
-  LIST_ENTRY    Protocols;
-  UINTN         LocateRequest;
+  LIST_ENTRY         Protocols;
+  UINTN              LocateRequest;
   /// The Handle Database Key value when this handle was last created or modified
-  UINT64        Key;
+  UINT64             Key;
+  /// Next handle in the same bucket of mHandleHashTable
+  struct _IHANDLE    *HashNext;
 } IHANDLE;
 
 #define ASSERT_IS_HANDLE(a)  ASSERT((a)->Signature == EFI_HANDLE_SIGNATURE)
@@ -34,16 +36,18 @@ typedef struct {
 /// database.  Each handler that supports this protocol is listed, along
 /// with a list of registered notifies.
 ///
-typedef struct {
-  UINTN         Signature;
+typedef struct _PROTOCOL_ENTRY {
+  UINTN                     Signature;
   /// Link Entry inserted to mProtocolDatabase
-  LIST_ENTRY    AllEntries;
+  LIST_ENTRY                AllEntries;
   /// ID of the protocol
-  EFI_GUID      ProtocolID;
+  EFI_GUID                  ProtocolID;
   /// All protocol interfaces
-  LIST_ENTRY    Protocols;
+  LIST_ENTRY                Protocols;
   /// Registerd notification handlers
-  LIST_ENTRY    Notify;
+  LIST_ENTRY                Notify;
+  /// Next protocol entry in the same bucket of mProtocolHashTable
+  struct _PROTOCOL_ENTRY    *HashNext;
 } PROTOCOL_ENTRY;
 
 #define PROTOCOL_INTERFACE_SIGNATURE  SIGNATURE_32('p','i','f','c')
@@ -161,6 +165,31 @@ CoreRemoveInterfaceFromProtocol (
   IN VOID      *Interface
   );
 
+//
+// Interval in microseconds between two polls of the pending deferred starts
+//
+#define DEFERRED_START_POLL_INTERVAL  100
+
+//
+// A driver start begun with the Driver Binding Deferred Start protocol and
+// not completed yet
+//
+typedef struct {
+  EFI_HANDLE                                      ControllerHandle;
+  ///
+  /// Index of ControllerHandle in the handles of the level being connected
+  ///
+  UINTN                                           HandleIndex;
+  EFI_DRIVER_BINDING_PROTOCOL                     *DriverBinding;
+  EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL    *DeferredStart;
+  VOID                                            *Context;
+  ///
+  /// Device path of the PCI root port above ControllerHandle
+  ///
+  EFI_DEVICE_PATH_PROTOCOL                        *RootPortPath;
+  UINTN                                           RootPortPathSize;
+} PENDING_DRIVER_START;
+
 /**
   Connects a controller to a driver.
 
@@ -173,20 +202,34 @@ CoreRemoveInterfaceFromProtocol (
                                                 the device path that specifies a
                                                 child  of the controller
                                                 specified by ControllerHandle.
+  @param  PendingStart                          If not NULL, only the first
+                                                driver that supports
+                                                ControllerHandle is considered,
+                                                and it is only begun to be
+                                                started if it produces the
+                                                Driver Binding Deferred Start
+                                                protocol.
 
   @retval EFI_SUCCESS                           One or more drivers were
                                                 connected to ControllerHandle.
+                                                If PendingStart is not NULL,
+                                                a deferred start was begun and
+                                                PendingStart describes it.
   @retval EFI_OUT_OF_RESOURCES                  No enough system resources to
                                                 complete the request.
   @retval EFI_NOT_FOUND                         No drivers were connected to
                                                 ControllerHandle.
+  @retval EFI_UNSUPPORTED                       PendingStart is not NULL and
+                                                the driver must be started with
+                                                Start().
 
 **/
 EFI_STATUS
 CoreConnectSingleController (
   IN  EFI_HANDLE                ControllerHandle,
   IN  EFI_HANDLE                *ContextDriverImageHandles OPTIONAL,
-  IN  EFI_DEVICE_PATH_PROTOCOL  *RemainingDevicePath       OPTIONAL
+  IN  EFI_DEVICE_PATH_PROTOCOL  *RemainingDevicePath       OPTIONAL,
+  IN  OUT PENDING_DRIVER_START  *PendingStart              OPTIONAL
   );
 
 /**
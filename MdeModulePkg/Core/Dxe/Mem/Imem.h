@@ -25,23 +25,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #define MEMORY_TYPE_OEM_RESERVED_MIN  0x70000000
 #define MEMORY_TYPE_OEM_RESERVED_MAX  0x7FFFFFFF
 
-//
-// MEMORY_MAP_ENTRY
-//
-
-#define MEMORY_MAP_SIGNATURE  SIGNATURE_32('m','m','a','p')
-typedef struct {
-  UINTN              Signature;
-  LIST_ENTRY         Link;
-  BOOLEAN            FromPages;
-
-  EFI_MEMORY_TYPE    Type;
-  UINT64             Start;
-  UINT64             End;
-
-  UINT64             VirtualStart;
-  UINT64             Attribute;
-} MEMORY_MAP;
+#include "MemoryMapIndex.h"
 
 //
 // Internal prototypes
@@ -0,0 +1,510 @@
+/** @file
+  Red-black tree indexes over the memory map descriptors.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "MemoryMapIndex.h"
+
+#include <Library/DebugLib.h>
+
+#define NODE_ENTRY(Index, Node) \
+  ((MEMORY_MAP *)((UINT8 *)(Node) - (Index)->NodeOffset))
+
+#define ENTRY_NODE(Index, Entry) \
+  ((MEMORY_MAP_NODE *)((UINT8 *)(Entry) + (Index)->NodeOffset))
+
+#define IS_RED(Node)  (((Node) != NULL) && (Node)->Red)
+
+/**
+  Recomputes the largest range size of a subtree from its children.
+
+  @param  Index                  The index.
+  @param  Node                   The root of the subtree.
+
+**/
+STATIC
+VOID
+UpdateMaxSize (
+  IN     MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP_NODE   *Node
+  )
+{
+  MEMORY_MAP  *Entry;
+  UINT64      MaxSize;
+
+  Entry   = NODE_ENTRY (Index, Node);
+  MaxSize = Entry->End - Entry->Start + 1;
+  if ((Node->Left != NULL) && (Node->Left->MaxSize > MaxSize)) {
+    MaxSize = Node->Left->MaxSize;
+  }
+
+  if ((Node->Right != NULL) && (Node->Right->MaxSize > MaxSize)) {
+    MaxSize = Node->Right->MaxSize;
+  }
+
+  Node->MaxSize = MaxSize;
+}
+
+/**
+  Recomputes the largest range size of a node and all its ancestors.
+
+  @param  Index                  The index.
+  @param  Node                   The node to start from, may be NULL.
+
+**/
+STATIC
+VOID
+PropagateMaxSize (
+  IN     MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP_NODE   *Node
+  )
+{
+  while (Node != NULL) {
+    UpdateMaxSize (Index, Node);
+    Node = Node->Parent;
+  }
+}
+
+/**
+  Replaces the link from the parent of Node to Node with a link to NewNode.
+
+  @param  Index                  The index.
+  @param  Node                   The node being replaced.
+  @param  NewNode                The replacement, may be NULL.
+
+**/
+STATIC
+VOID
+ReplaceChild (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN     MEMORY_MAP_NODE   *Node,
+  IN     MEMORY_MAP_NODE   *NewNode
+  )
+{
+  if (Node->Parent == NULL) {
+    Index->Root = NewNode;
+  } else if (Node->Parent->Left == Node) {
+    Node->Parent->Left = NewNode;
+  } else {
+    Node->Parent->Right = NewNode;
+  }
+
+  if (NewNode != NULL) {
+    NewNode->Parent = Node->Parent;
+  }
+}
+
+/**
+  Rotates a subtree to the left. The right child of Node becomes the root of
+  the subtree.
+
+  @param  Index                  The index.
+  @param  Node                   The root of the subtree.
+
+**/
+STATIC
+VOID
+RotateLeft (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP_NODE   *Node
+  )
+{
+  MEMORY_MAP_NODE  *Pivot;
+
+  Pivot       = Node->Right;
+  Node->Right = Pivot->Left;
+  if (Pivot->Left != NULL) {
+    Pivot->Left->Parent = Node;
+  }
+
+  ReplaceChild (Index, Node, Pivot);
+  Pivot->Left  = Node;
+  Node->Parent = Pivot;
+
+  UpdateMaxSize (Index, Node);
+  UpdateMaxSize (Index, Pivot);
+}
+
+/**
+  Rotates a subtree to the right. The left child of Node becomes the root of
+  the subtree.
+
+  @param  Index                  The index.
+  @param  Node                   The root of the subtree.
+
+**/
+STATIC
+VOID
+RotateRight (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP_NODE   *Node
+  )
+{
+  MEMORY_MAP_NODE  *Pivot;
+
+  Pivot      = Node->Left;
+  Node->Left = Pivot->Right;
+  if (Pivot->Right != NULL) {
+    Pivot->Right->Parent = Node;
+  }
+
+  ReplaceChild (Index, Node, Pivot);
+  Pivot->Right = Node;
+  Node->Parent = Pivot;
+
+  UpdateMaxSize (Index, Node);
+  UpdateMaxSize (Index, Pivot);
+}
+
+/**
+  Inserts a descriptor into an index.
+
+  @param  Index                  The index.
+  @param  Entry                  The descriptor to insert. It must not be in
+                                 the index already.
+
+**/
+VOID
+MemoryMapIndexInsert (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP        *Entry
+  )
+{
+  MEMORY_MAP_NODE  *Node;
+  MEMORY_MAP_NODE  *Parent;
+  MEMORY_MAP_NODE  *Uncle;
+  MEMORY_MAP_NODE  **Link;
+
+  Node   = ENTRY_NODE (Index, Entry);
+  Parent = NULL;
+  Link   = &Index->Root;
+  while (*Link != NULL) {
+    Parent = *Link;
+    if (Entry->Start < NODE_ENTRY (Index, Parent)->Start) {
+      Link = &Parent->Left;
+    } else {
+      Link = &Parent->Right;
+    }
+  }
+
+  Node->Parent = Parent;
+  Node->Left   = NULL;
+  Node->Right  = NULL;
+  Node->Red    = TRUE;
+  *Link        = Node;
+  PropagateMaxSize (Index, Node);
+  Index->Count++;
+
+  //
+  // Restore the red-black properties
+  //
+  while (IS_RED (Node->Parent)) {
+    Parent = Node->Parent;
+    if (Parent == Parent->Parent->Left) {
+      Uncle = Parent->Parent->Right;
+      if (IS_RED (Uncle)) {
+        Parent->Red         = FALSE;
+        Uncle->Red          = FALSE;
+        Parent->Parent->Red = TRUE;
+        Node                = Parent->Parent;
+        continue;
+      }
+
+      if (Node == Parent->Right) {
+        RotateLeft (Index, Parent);
+        Node   = Parent;
+        Parent = Node->Parent;
+      }
+
+      Parent->Red         = FALSE;
+      Parent->Parent->Red = TRUE;
+      RotateRight (Index, Parent->Parent);
+    } else {
+      Uncle = Parent->Parent->Left;
+      if (IS_RED (Uncle)) {
+        Parent->Red         = FALSE;
+        Uncle->Red          = FALSE;
+        Parent->Parent->Red = TRUE;
+        Node                = Parent->Parent;
+        continue;
+      }
+
+      if (Node == Parent->Left) {
+        RotateRight (Index, Parent);
+        Node   = Parent;
+        Parent = Node->Parent;
+      }
+
+      Parent->Red         = FALSE;
+      Parent->Parent->Red = TRUE;
+      RotateLeft (Index, Parent->Parent);
+    }
+  }
+
+  Index->Root->Red = FALSE;
+}
+
+/**
+  Removes a descriptor from an index.
+
+  @param  Index                  The index.
+  @param  Entry                  The descriptor to remove. It must be in the
+                                 index.
+
+**/
+VOID
+MemoryMapIndexRemove (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP        *Entry
+  )
+{
+  MEMORY_MAP_NODE  *Node;
+  MEMORY_MAP_NODE  *Successor;
+  MEMORY_MAP_NODE  *Child;
+  MEMORY_MAP_NODE  *Parent;
+  MEMORY_MAP_NODE  *Sibling;
+  BOOLEAN          RemovedRed;
+
+  ASSERT (Index->Count > 0);
+
+  Node = ENTRY_NODE (Index, Entry);
+  if (Node->Left == NULL) {
+    Child      = Node->Right;
+    Parent     = Node->Parent;
+    RemovedRed = Node->Red;
+    ReplaceChild (Index, Node, Child);
+  } else if (Node->Right == NULL) {
+    Child      = Node->Left;
+    Parent     = Node->Parent;
+    RemovedRed = Node->Red;
+    ReplaceChild (Index, Node, Child);
+  } else {
+    //
+    // Move the in-order successor into the place of the removed node
+    //
+    Successor = Node->Right;
+    while (Successor->Left != NULL) {
+      Successor = Successor->Left;
+    }
+
+    RemovedRed = Successor->Red;
+    Child      = Successor->Right;
+    if (Successor->Parent == Node) {
+      Parent = Successor;
+    } else {
+      Parent = Successor->Parent;
+      ReplaceChild (Index, Successor, Child);
+      Successor->Right         = Node->Right;
+      Successor->Right->Parent = Successor;
+    }
+
+    ReplaceChild (Index, Node, Successor);
+    Successor->Left         = Node->Left;
+    Successor->Left->Parent = Successor;
+    Successor->Red          = Node->Red;
+  }
+
+  PropagateMaxSize (Index, Parent);
+  Index->Count--;
+
+  Node->Parent = NULL;
+  Node->Left   = NULL;
+  Node->Right  = NULL;
+
+  if (RemovedRed) {
+    return;
+  }
+
+  //
+  // Restore the red-black properties. Child carries an extra black.
+  //
+  while ((Child != Index->Root) && !IS_RED (Child)) {
+    if (Child == Parent->Left) {
+      Sibling = Parent->Right;
+      if (Sibling->Red) {
+        Sibling->Red = FALSE;
+        Parent->Red  = TRUE;
+        RotateLeft (Index, Parent);
+        Sibling = Parent->Right;
+      }
+
+      if (!IS_RED (Sibling->Left) && !IS_RED (Sibling->Right)) {
+        Sibling->Red = TRUE;
+        Child        = Parent;
+        Parent       = Child->Parent;
+        continue;
+      }
+
+      if (!IS_RED (Sibling->Right)) {
+        Sibling->Left->Red = FALSE;
+        Sibling->Red       = TRUE;
+        RotateRight (Index, Sibling);
+        Sibling = Parent->Right;
+      }
+
+      Sibling->Red        = Parent->Red;
+      Parent->Red         = FALSE;
+      Sibling->Right->Red = FALSE;
+      RotateLeft (Index, Parent);
+    } else {
+      Sibling = Parent->Left;
+      if (Sibling->Red) {
+        Sibling->Red = FALSE;
+        Parent->Red  = TRUE;
+        RotateRight (Index, Parent);
+        Sibling = Parent->Left;
+      }
+
+      if (!IS_RED (Sibling->Left) && !IS_RED (Sibling->Right)) {
+        Sibling->Red = TRUE;
+        Child        = Parent;
+        Parent       = Child->Parent;
+        continue;
+      }
+
+      if (!IS_RED (Sibling->Left)) {
+        Sibling->Right->Red = FALSE;
+        Sibling->Red        = TRUE;
+        RotateLeft (Index, Sibling);
+        Sibling = Parent->Left;
+      }
+
+      Sibling->Red       = Parent->Red;
+      Parent->Red        = FALSE;
+      Sibling->Left->Red = FALSE;
+      RotateRight (Index, Parent);
+    }
+
+    Child = Index->Root;
+  }
+
+  if (Child != NULL) {
+    Child->Red = FALSE;
+  }
+}
+
+/**
+  Updates an index after the range of one of its descriptors was shrunk in
+  place. The new range must not cross the range of any other descriptor.
+
+  @param  Index                  The index.
+  @param  Entry                  The descriptor whose Start or End changed.
+
+**/
+VOID
+MemoryMapIndexUpdate (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP        *Entry
+  )
+{
+  //
+  // The order of the descriptors is unchanged, only the sizes need refreshing
+  //
+  PropagateMaxSize (Index, ENTRY_NODE (Index, Entry));
+}
+
+/**
+  Finds the descriptor with the highest start address not above Address.
+
+  @param  Index                  The index.
+  @param  Address                The address to look up.
+
+  @return The descriptor, or NULL if all descriptors start above Address.
+
+**/
+MEMORY_MAP *
+MemoryMapIndexFind (
+  IN MEMORY_MAP_INDEX  *Index,
+  IN UINT64            Address
+  )
+{
+  MEMORY_MAP_NODE  *Node;
+  MEMORY_MAP       *Entry;
+  MEMORY_MAP       *Found;
+
+  Found = NULL;
+  Node  = Index->Root;
+  while (Node != NULL) {
+    Entry = NODE_ENTRY (Index, Node);
+    if (Entry->Start <= Address) {
+      Found = Entry;
+      Node  = Node->Right;
+    } else {
+      Node = Node->Left;
+    }
+  }
+
+  return Found;
+}
+
+/**
+  Finds the descriptor with the highest start address below Limit whose range
+  is at least MinSize bytes long, in a subtree.
+
+  Subtrees without a large enough range are skipped, so only the subtrees
+  along the search path for Limit are visited in full depth.
+
+  @param  Index                  The index.
+  @param  Node                   The root of the subtree, may be NULL.
+  @param  Limit                  The descriptor must start below this address.
+  @param  MinSize                The minimum size of the descriptor range.
+
+  @return The descriptor, or NULL if none matches.
+
+**/
+STATIC
+MEMORY_MAP *
+FindBelow (
+  IN MEMORY_MAP_INDEX  *Index,
+  IN MEMORY_MAP_NODE   *Node,
+  IN UINT64            Limit,
+  IN UINT64            MinSize
+  )
+{
+  MEMORY_MAP  *Entry;
+  MEMORY_MAP  *Found;
+
+  while ((Node != NULL) && (Node->MaxSize >= MinSize)) {
+    Entry = NODE_ENTRY (Index, Node);
+    if (Entry->Start >= Limit) {
+      Node = Node->Left;
+      continue;
+    }
+
+    Found = FindBelow (Index, Node->Right, Limit, MinSize);
+    if (Found != NULL) {
+      return Found;
+    }
+
+    if (Entry->End - Entry->Start + 1 >= MinSize) {
+      return Entry;
+    }
+
+    Node = Node->Left;
+  }
+
+  return NULL;
+}
+
+/**
+  Finds the descriptor with the highest start address below Limit whose range
+  is at least MinSize bytes long.
+
+  @param  Index                  The index.
+  @param  Limit                  The descriptor must start below this address.
+  @param  MinSize                The minimum size of the descriptor range.
+
+  @return The descriptor, or NULL if none matches.
+
+**/
+MEMORY_MAP *
+MemoryMapIndexFindBelow (
+  IN MEMORY_MAP_INDEX  *Index,
+  IN UINT64            Limit,
+  IN UINT64            MinSize
+  )
+{
+  return FindBelow (Index, Index->Root, Limit, MinSize);
+}
@@ -0,0 +1,146 @@
+/** @file
+  Memory map descriptor and the balanced indexes kept over the memory map.
+
+  Every descriptor in the memory map is linked into an address index, a
+  red-black tree ordered by start address, so the descriptor that covers an
+  address and the neighbours of a range are found in O(log n). Descriptors of
+  free memory are also linked into a second tree that is augmented with the
+  size of the largest free range of each subtree, so the highest free range
+  that can hold a request is found without walking the whole map.
+
+  The tree nodes are embedded in the descriptors, so the indexes never
+  allocate memory. This matters as they are updated with the memory lock held,
+  while the memory map itself is being changed.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _MEMORY_MAP_INDEX_H_
+#define _MEMORY_MAP_INDEX_H_
+
+#include <Uefi/UefiBaseType.h>
+#include <Uefi/UefiMultiPhase.h>
+
+#include <Library/BaseLib.h>
+
+typedef struct _MEMORY_MAP_NODE MEMORY_MAP_NODE;
+struct _MEMORY_MAP_NODE {
+  MEMORY_MAP_NODE    *Parent;
+  MEMORY_MAP_NODE    *Left;
+  MEMORY_MAP_NODE    *Right;
+  //
+  // Size of the largest range in the subtree rooted at this node.
+  //
+  UINT64             MaxSize;
+  BOOLEAN            Red;
+};
+
+//
+// MEMORY_MAP_ENTRY
+//
+
+#define MEMORY_MAP_SIGNATURE  SIGNATURE_32('m','m','a','p')
+typedef struct {
+  UINTN              Signature;
+  LIST_ENTRY         Link;
+  BOOLEAN            FromPages;
+
+  EFI_MEMORY_TYPE    Type;
+  UINT64             Start;
+  UINT64             End;
+
+  UINT64             VirtualStart;
+  UINT64             Attribute;
+
+  MEMORY_MAP_NODE    AddressNode;
+  MEMORY_MAP_NODE    FreeNode;
+} MEMORY_MAP;
+
+typedef struct {
+  MEMORY_MAP_NODE    *Root;
+  //
+  // Offset of the MEMORY_MAP_NODE used by this index in MEMORY_MAP.
+  //
+  UINTN              NodeOffset;
+  UINTN              Count;
+} MEMORY_MAP_INDEX;
+
+#define MEMORY_MAP_INDEX_INIT(Node)  { NULL, OFFSET_OF (MEMORY_MAP, Node), 0 }
+
+/**
+  Inserts a descriptor into an index.
+
+  @param  Index                  The index.
+  @param  Entry                  The descriptor to insert. It must not be in
+                                 the index already.
+
+**/
+VOID
+MemoryMapIndexInsert (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP        *Entry
+  );
+
+/**
+  Removes a descriptor from an index.
+
+  @param  Index                  The index.
+  @param  Entry                  The descriptor to remove. It must be in the
+                                 index.
+
+**/
+VOID
+MemoryMapIndexRemove (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP        *Entry
+  );
+
+/**
+  Updates an index after the range of one of its descriptors was shrunk in
+  place. The new range must not cross the range of any other descriptor.
+
+  @param  Index                  The index.
+  @param  Entry                  The descriptor whose Start or End changed.
+
+**/
+VOID
+MemoryMapIndexUpdate (
+  IN OUT MEMORY_MAP_INDEX  *Index,
+  IN OUT MEMORY_MAP        *Entry
+  );
+
+/**
+  Finds the descriptor with the highest start address not above Address.
+
+  @param  Index                  The index.
+  @param  Address                The address to look up.
+
+  @return The descriptor, or NULL if all descriptors start above Address.
+
+**/
+MEMORY_MAP *
+MemoryMapIndexFind (
+  IN MEMORY_MAP_INDEX  *Index,
+  IN UINT64            Address
+  );
+
+/**
+  Finds the descriptor with the highest start address below Limit whose range
+  is at least MinSize bytes long.
+
+  @param  Index                  The index.
+  @param  Limit                  The descriptor must start below this address.
+  @param  MinSize                The minimum size of the descriptor range.
+
+  @return The descriptor, or NULL if none matches.
+
+**/
+MEMORY_MAP *
+MemoryMapIndexFindBelow (
+  IN MEMORY_MAP_INDEX  *Index,
+  IN UINT64            Limit,
+  IN UINT64            MinSize
+  );
+
+#endif
@@ -44,6 +44,13 @@ UINTN       mFreeMapStack = 0;
 ///
 LIST_ENTRY  mFreeMemoryMapEntryList           = INITIALIZE_LIST_HEAD_VARIABLE (mFreeMemoryMapEntryList);
 BOOLEAN     mMemoryTypeInformationInitialized = FALSE;
+///
+/// mMemoryMapIndex - all the descriptors of gMemoryMap, ordered by address
+/// mFreeMemoryMapIndex - the EfiConventionalMemory descriptors of gMemoryMap,
+/// ordered by address and augmented with the largest free range size
+///
+MEMORY_MAP_INDEX  mMemoryMapIndex     = MEMORY_MAP_INDEX_INIT (AddressNode);
+MEMORY_MAP_INDEX  mFreeMemoryMapIndex = MEMORY_MAP_INDEX_INIT (FreeNode);
 
 EFI_MEMORY_TYPE_STATISTICS  mMemoryTypeStatistics[EfiMaxMemoryType + 1] = {
   { 0, MAX_ALLOC_ADDRESS, 0, 0, EfiMaxMemoryType, TRUE,  FALSE },  // EfiReservedMemoryType
@@ -116,6 +123,87 @@ CoreReleaseMemoryLock (
   CoreReleaseLock (&gMemoryLock);
 }
 
+/**
+  Internal function.  Inserts a descriptor entry of gMemoryMap into the
+  memory map indexes.
+
+  @param  Entry                  The entry to insert
+
+**/
+STATIC
+VOID
+InsertMemoryMapIndex (
+  IN OUT MEMORY_MAP  *Entry
+  )
+{
+  MemoryMapIndexInsert (&mMemoryMapIndex, Entry);
+  if (Entry->Type == EfiConventionalMemory) {
+    MemoryMapIndexInsert (&mFreeMemoryMapIndex, Entry);
+  }
+}
+
+/**
+  Internal function.  Removes a descriptor entry of gMemoryMap from the
+  memory map indexes.
+
+  @param  Entry                  The entry to remove
+
+**/
+STATIC
+VOID
+RemoveMemoryMapIndex (
+  IN OUT MEMORY_MAP  *Entry
+  )
+{
+  MemoryMapIndexRemove (&mMemoryMapIndex, Entry);
+  if (Entry->Type == EfiConventionalMemory) {
+    MemoryMapIndexRemove (&mFreeMemoryMapIndex, Entry);
+  }
+}
+
+/**
+  Internal function.  Updates the memory map indexes after the range of a
+  descriptor entry has been clipped.
+
+  @param  Entry                  The clipped entry
+
+**/
+STATIC
+VOID
+UpdateMemoryMapIndex (
+  IN OUT MEMORY_MAP  *Entry
+  )
+{
+  MemoryMapIndexUpdate (&mMemoryMapIndex, Entry);
+  if (Entry->Type == EfiConventionalMemory) {
+    MemoryMapIndexUpdate (&mFreeMemoryMapIndex, Entry);
+  }
+}
+
+/**
+  Internal function.  Finds the descriptor entry that covers an address.
+
+  @param  Address                The page aligned address to look up
+
+  @return The entry covering Address, or NULL if Address is not in the map
+
+**/
+STATIC
+MEMORY_MAP *
+FindMemoryMapEntry (
+  IN UINT64  Address
+  )
+{
+  MEMORY_MAP  *Entry;
+
+  Entry = MemoryMapIndexFind (&mMemoryMapIndex, Address);
+  if ((Entry == NULL) || (Entry->End <= Address)) {
+    return NULL;
+  }
+
+  return Entry;
+}
+
 /**
   Internal function.  Removes a descriptor entry.
 
@@ -127,6 +215,7 @@ RemoveMemoryMapEntry (
   IN OUT MEMORY_MAP  *Entry
   )
 {
+  RemoveMemoryMapIndex (Entry);
   RemoveEntryList (&Entry->Link);
   Entry->Link.ForwardLink = NULL;
 
@@ -158,7 +247,6 @@ CoreAddRange (
   IN UINT64                Attribute
   )
 {
-  LIST_ENTRY  *Link;
   MEMORY_MAP  *Entry;
 
   ASSERT ((Start & EFI_PAGE_MASK) == 0);
@@ -206,24 +294,21 @@ CoreAddRange (
   // Two memory descriptors can only be merged if they have the same Type
   // and the same Attribute
   //
-
-  Link = gMemoryMap.ForwardLink;
-  while (Link != &gMemoryMap) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    Link  = Link->ForwardLink;
-
-    if (Entry->Type != Type) {
-      continue;
-    }
-
-    if (Entry->Attribute != Attribute) {
-      continue;
-    }
-
-    if (Entry->End + 1 == Start) {
+  if (Start != 0) {
+    Entry = MemoryMapIndexFind (&mMemoryMapIndex, Start - 1);
+    if ((Entry != NULL) && (Entry->End + 1 == Start) &&
+        (Entry->Type == Type) && (Entry->Attribute == Attribute))
+    {
       Start = Entry->Start;
       RemoveMemoryMapEntry (Entry);
-    } else if (Entry->Start == End + 1) {
+    }
+  }
+
+  if (End != MAX_UINT64) {
+    Entry = MemoryMapIndexFind (&mMemoryMapIndex, End + 1);
+    if ((Entry != NULL) && (Entry->Start == End + 1) &&
+        (Entry->Type == Type) && (Entry->Attribute == Attribute))
+    {
       End = Entry->End;
       RemoveMemoryMapEntry (Entry);
     }
@@ -241,6 +326,7 @@ CoreAddRange (
   mMapStack[mMapDepth].VirtualStart = 0;
   mMapStack[mMapDepth].Attribute    = Attribute;
   InsertTailList (&gMemoryMap, &mMapStack[mMapDepth].Link);
+  InsertMemoryMapIndex (&mMapStack[mMapDepth]);
 
   mMapDepth += 1;
   ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -347,6 +433,7 @@ CoreFreeMemoryMapStack (
       //
       // Move this entry to general memory
       //
+      RemoveMemoryMapIndex (&mMapStack[mMapDepth]);
       RemoveEntryList (&mMapStack[mMapDepth].Link);
       mMapStack[mMapDepth].Link.ForwardLink = NULL;
 
@@ -364,6 +451,7 @@ CoreFreeMemoryMapStack (
       }
 
       InsertTailList (Link2, &Entry->Link);
+      InsertMemoryMapIndex (Entry);
     } else {
       //
       // This item of mMapStack[mMapDepth] has already been dequeued from gMemoryMap list,
@@ -737,7 +825,6 @@ CoreConvertPagesEx (
   UINT64           RangeEnd;
   UINT64           Attribute;
   EFI_MEMORY_TYPE  MemType;
-  LIST_ENTRY       *Link;
   MEMORY_MAP       *Entry;
 
   Entry         = NULL;
@@ -762,15 +849,8 @@ CoreConvertPagesEx (
     //
     // Find the entry that the covers the range
     //
-    for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-      Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-
-      if ((Entry->Start <= Start) && (Entry->End > Start)) {
-        break;
-      }
-    }
-
-    if (Link == &gMemoryMap) {
+    Entry = FindMemoryMapEntry (Start);
+    if (Entry == NULL) {
       DEBUG ((DEBUG_ERROR | DEBUG_PAGE, "ConvertPages: failed to find range %lx - %lx\n", Start, End));
       return EFI_NOT_FOUND;
     }
@@ -856,11 +936,13 @@ CoreConvertPagesEx (
       // Clip start
       //
       Entry->Start = RangeEnd + 1;
+      UpdateMemoryMapIndex (Entry);
     } else if (Entry->End == RangeEnd) {
       //
       // Clip end
       //
       Entry->End = Start - 1;
+      UpdateMemoryMapIndex (Entry);
     } else {
       //
       // Pull it out of the center, clip current
@@ -882,9 +964,11 @@ CoreConvertPagesEx (
 
       Entry->End = Start - 1;
       ASSERT (Entry->Start < Entry->End);
+      UpdateMemoryMapIndex (Entry);
 
       Entry = &mMapStack[mMapDepth];
       InsertTailList (&gMemoryMap, &Entry->Link);
+      InsertMemoryMapIndex (Entry);
 
       mMapDepth += 1;
       ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -1036,7 +1120,6 @@ CoreFindFreePagesI (
   UINT64      DescStart;
   UINT64      DescEnd;
   UINT64      DescNumberOfBytes;
-  LIST_ENTRY  *Link;
   MEMORY_MAP  *Entry;
 
   if ((MaxAddress < EFI_PAGE_MASK) || (NumberOfPages == 0)) {
@@ -1067,24 +1150,25 @@ CoreFindFreePagesI (
   NumberOfBytes = LShiftU64 (NumberOfPages, EFI_PAGE_SHIFT);
   Target        = 0;
 
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-
-    //
-    // If it's not a free entry, don't bother with it
-    //
-    if (Entry->Type != EfiConventionalMemory) {
-      continue;
-    }
+  //
+  // Walk the free entries that start below MaxAddress and are large enough,
+  // from the highest address down. The first entry that fits is the highest
+  // possible match, so the walk stops there.
+  //
+  for (Entry = MemoryMapIndexFindBelow (&mFreeMemoryMapIndex, MaxAddress, NumberOfBytes);
+       Entry != NULL;
+       Entry = MemoryMapIndexFindBelow (&mFreeMemoryMapIndex, Entry->Start, NumberOfBytes))
+  {
+    ASSERT (Entry->Type == EfiConventionalMemory);
 
     DescStart = Entry->Start;
     DescEnd   = Entry->End;
 
     //
-    // If desc is past max allowed address or below min allowed address, skip it
+    // If desc is below min allowed address, so are all the remaining ones
     //
-    if ((DescStart >= MaxAddress) || (DescEnd < MinAddress)) {
-      continue;
+    if (DescEnd < MinAddress) {
+      break;
     }
 
     //
@@ -1109,29 +1193,26 @@ CoreFindFreePagesI (
 
     if (DescNumberOfBytes >= NumberOfBytes) {
       //
-      // If the start of the allocated range is below the min address allowed, skip it
+      // If the start of the allocated range is below the min address allowed,
+      // so is the start of the range in all the remaining entries
       //
       if ((DescEnd - NumberOfBytes + 1) < MinAddress) {
-        continue;
+        break;
       }
 
-      //
-      // If this is the best match so far remember it
-      //
-      if (DescEnd > Target) {
-        if (NeedGuard) {
-          DescEnd = AdjustMemoryS (
-                      DescEnd + 1 - DescNumberOfBytes,
-                      DescNumberOfBytes,
-                      NumberOfBytes
-                      );
-          if (DescEnd == 0) {
-            continue;
-          }
+      if (NeedGuard) {
+        DescEnd = AdjustMemoryS (
+                    DescEnd + 1 - DescNumberOfBytes,
+                    DescNumberOfBytes,
+                    NumberOfBytes
+                    );
+        if (DescEnd == 0) {
+          continue;
         }
-
-        Target = DescEnd;
       }
+
+      Target = DescEnd;
+      break;
     }
   }
 
@@ -1511,7 +1592,6 @@ CoreInternalFreePages (
   )
 {
   EFI_STATUS  Status;
-  LIST_ENTRY  *Link;
   MEMORY_MAP  *Entry;
   UINTN       Alignment;
   BOOLEAN     IsGuarded;
@@ -1525,15 +1605,8 @@ CoreInternalFreePages (
   // Find the entry that the covers the range
   //
   IsGuarded = FALSE;
-  Entry     = NULL;
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    if ((Entry->Start <= Memory) && (Entry->End > Memory)) {
-      break;
-    }
-  }
-
-  if (Link == &gMemoryMap) {
+  Entry     = FindMemoryMapEntry (Memory);
+  if (Entry == NULL) {
     Status = EFI_NOT_FOUND;
     goto Done;
   }
@@ -9,6 +9,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include "DxeMain.h"
 #include "Imem.h"
 #include "HeapGuard.h"
+#include "PoolSlab.h"
 
 STATIC EFI_LOCK  mPoolMemoryLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
 
@@ -21,6 +22,7 @@ typedef struct {
 
 #define POOL_HEAD_SIGNATURE      SIGNATURE_32('p','h','d','0')
 #define POOLPAGE_HEAD_SIGNATURE  SIGNATURE_32('p','h','d','1')
+#define POOLSLAB_HEAD_SIGNATURE  SIGNATURE_32('p','h','d','2')
 typedef struct {
   UINT32             Signature;
   UINT32             Reserved;
@@ -70,6 +72,7 @@ typedef struct {
   EFI_MEMORY_TYPE    MemoryType;
   LIST_ENTRY         FreeList[MAX_POOL_LIST];
   LIST_ENTRY         Link;
+  POOL_SLAB_CACHE    Slab;
 } POOL;
 
 //
@@ -82,6 +85,31 @@ POOL  mPoolHead[EfiMaxMemoryType];
 //
 LIST_ENTRY  mPoolHeadList = INITIALIZE_LIST_HEAD_VARIABLE (mPoolHeadList);
 
+//
+// Per-TPL free block caches for EfiBootServicesData slab blocks. Code running
+// at a given TPL can only be preempted by code running at a higher TPL, so
+// each cache is only ever touched by one execution context at a time and can
+// be used without taking mPoolMemoryLock.
+//
+#define POOL_SLAB_CACHE_LEVELS  3
+
+STATIC POOL_SLAB_MAGAZINE  mPoolSlabMagazine[POOL_SLAB_CACHE_LEVELS][POOL_SLAB_CLASS_COUNT];
+
+STATIC
+VOID *
+CorePoolSlabAllocatePages (
+  IN VOID   *Context,
+  IN UINTN  SlabSize
+  );
+
+STATIC
+VOID
+CorePoolSlabFreePages (
+  IN VOID   *Context,
+  IN VOID   *Slab,
+  IN UINTN  SlabSize
+  );
+
 /**
   Get pool size table index from the specified size.
 
@@ -107,6 +135,98 @@ GetPoolIndexFromSize (
   return MAX_POOL_LIST;
 }
 
+/**
+  Get the page allocation granularity of a pool memory type.
+
+  @param  MemoryType             The pool memory type.
+
+  @return The allocation granularity in bytes.
+
+**/
+STATIC
+UINTN
+GetPoolGranularity (
+  IN EFI_MEMORY_TYPE  MemoryType
+  )
+{
+  if ((MemoryType == EfiACPIReclaimMemory) ||
+      (MemoryType == EfiACPIMemoryNVS) ||
+      (MemoryType == EfiRuntimeServicesCode) ||
+      (MemoryType == EfiRuntimeServicesData))
+  {
+    return RUNTIME_PAGE_ALLOCATION_GRANULARITY;
+  }
+
+  return DEFAULT_PAGE_ALLOCATION_GRANULARITY;
+}
+
+/**
+  Get the per-TPL slab cache level usable by the caller.
+
+  @param  PoolType               Type of the pool.
+  @param  NeedGuard              Flag to indicate Guard page is needed or not
+
+  @return The cache level of the current TPL, or POOL_SLAB_CACHE_LEVELS if the
+          per-TPL caches cannot be used.
+
+**/
+STATIC
+UINTN
+GetPoolSlabCacheLevel (
+  IN EFI_MEMORY_TYPE  PoolType,
+  IN BOOLEAN          NeedGuard
+  )
+{
+  if (!FeaturePcdGet (PcdDxePoolSlabAllocatorEnable) ||
+      (PoolType != EfiBootServicesData) || NeedGuard ||
+      IsHeapGuardEnabled (GUARD_HEAP_TYPE_FREED))
+  {
+    return POOL_SLAB_CACHE_LEVELS;
+  }
+
+  switch (gEfiCurrentTpl) {
+    case TPL_APPLICATION:
+      return 0;
+    case TPL_CALLBACK:
+      return 1;
+    case TPL_NOTIFY:
+      return 2;
+    default:
+      return POOL_SLAB_CACHE_LEVELS;
+  }
+}
+
+/**
+  Initialize the pool head of a memory type.
+
+  @param  Pool                   The pool head to initialize.
+  @param  MemoryType             The memory type served by the pool.
+
+**/
+STATIC
+VOID
+CoreInitializePoolHead (
+  OUT POOL             *Pool,
+  IN  EFI_MEMORY_TYPE  MemoryType
+  )
+{
+  UINTN  Index;
+
+  Pool->Used       = 0;
+  Pool->MemoryType = MemoryType;
+  for (Index = 0; Index < MAX_POOL_LIST; Index++) {
+    InitializeListHead (&Pool->FreeList[Index]);
+  }
+
+  PoolSlabInitialize (
+    &Pool->Slab,
+    GetPoolGranularity (MemoryType),
+    CorePoolSlabAllocatePages,
+    CorePoolSlabFreePages,
+    Pool
+    );
+}
+
 /**
   Called to initialize the pool.
 
@@ -117,15 +237,10 @@ CoreInitializePool (
   )
 {
   UINTN  Type;
-  UINTN  Index;
 
   for (Type = 0; Type < EfiMaxMemoryType; Type++) {
-    mPoolHead[Type].Signature  = 0;
-    mPoolHead[Type].Used       = 0;
-    mPoolHead[Type].MemoryType = (EFI_MEMORY_TYPE)Type;
-    for (Index = 0; Index < MAX_POOL_LIST; Index++) {
-      InitializeListHead (&mPoolHead[Type].FreeList[Index]);
-    }
+    mPoolHead[Type].Signature = 0;
+    CoreInitializePoolHead (&mPoolHead[Type], (EFI_MEMORY_TYPE)Type);
   }
 }
 
@@ -144,7 +259,6 @@ LookupPoolHead (
 {
   LIST_ENTRY  *Link;
   POOL        *Pool;
-  UINTN       Index;
 
   if ((UINT32)MemoryType < EfiMaxMemoryType) {
     return &mPoolHead[MemoryType];
@@ -168,12 +282,8 @@ LookupPoolHead (
       return NULL;
     }
 
-    Pool->Signature  = POOL_SIGNATURE;
-    Pool->Used       = 0;
-    Pool->MemoryType = MemoryType;
-    for (Index = 0; Index < MAX_POOL_LIST; Index++) {
-      InitializeListHead (&Pool->FreeList[Index]);
-    }
+    Pool->Signature = POOL_SIGNATURE;
+    CoreInitializePoolHead (Pool, MemoryType);
 
     InsertHeadList (&mPoolHeadList, &Pool->Link);
 
@@ -183,6 +293,116 @@ LookupPoolHead (
   return NULL;
 }
 
+/**
+  Get the slab class of an allocated EfiBootServicesData slab block.
+
+  @param  Head                   The pool head of the block.
+
+  @return The slab class index, or POOL_SLAB_CLASS_COUNT if the block is not a
+          valid EfiBootServicesData slab block.
+
+**/
+STATIC
+UINTN
+GetPoolSlabClass (
+  IN POOL_HEAD  *Head
+  )
+{
+  POOL_TAIL  *Tail;
+
+  if ((Head->Signature != POOLSLAB_HEAD_SIGNATURE) ||
+      (Head->Type != EfiBootServicesData))
+  {
+    return POOL_SLAB_CLASS_COUNT;
+  }
+
+  Tail = HEAD_TO_TAIL (Head);
+  if ((Tail->Signature != POOL_TAIL_SIGNATURE) || (Tail->Size != Head->Size)) {
+    return POOL_SLAB_CLASS_COUNT;
+  }
+
+  return PoolSlabBlockClass (&mPoolHead[EfiBootServicesData].Slab, Head);
+}
+
+/**
+  Allocate an EfiBootServicesData slab block from the cache of the current TPL.
+  The caller does not need to hold the memory lock.
+
+  @param  Level                  The cache level of the current TPL.
+  @param  Size                   The amount of pool to allocate
+
+  @return The allocated pool, or NULL if the cache holds no block of that size.
+
+**/
+STATIC
+VOID *
+CoreAllocatePoolSlabCached (
+  IN UINTN  Level,
+  IN UINTN  Size
+  )
+{
+  POOL_HEAD  *Head;
+  POOL_TAIL  *Tail;
+  UINTN      ClassIndex;
+
+  Size       = ALIGN_VARIABLE (Size) + POOL_OVERHEAD;
+  ClassIndex = PoolSlabSizeToClass (Size);
+  if (ClassIndex >= POOL_SLAB_CLASS_COUNT) {
+    return NULL;
+  }
+
+  Head = PoolSlabMagazineGet (&mPoolSlabMagazine[Level][ClassIndex]);
+  if (Head == NULL) {
+    return NULL;
+  }
+
+  Head->Signature = POOLSLAB_HEAD_SIGNATURE;
+  Head->Size      = Size;
+  Head->Type      = EfiBootServicesData;
+
+  Tail            = HEAD_TO_TAIL (Head);
+  Tail->Signature = POOL_TAIL_SIGNATURE;
+  Tail->Size      = Size;
+
+  DEBUG_CLEAR_MEMORY (Head->Data, Size - POOL_OVERHEAD);
+  return Head->Data;
+}
+
+/**
+  Refill the cache of the current TPL after a cache miss, so that following
+  allocations of the same size do not need the memory lock.
+  Caller must have the memory lock held
+
+  @param  Level                  The cache level of the current TPL.
+  @param  Size                   The amount of pool that was allocated
+
+**/
+STATIC
+VOID
+CoreRefillPoolSlabCache (
+  IN UINTN  Level,
+  IN UINTN  Size
+  )
+{
+  POOL   *Pool;
+  UINTN  ClassIndex;
+  UINTN  Moved;
+
+  ASSERT_LOCKED (&mPoolMemoryLock);
+
+  ClassIndex = PoolSlabSizeToClass (ALIGN_VARIABLE (Size) + POOL_OVERHEAD);
+  if (ClassIndex >= POOL_SLAB_CLASS_COUNT) {
+    return;
+  }
+
+  //
+  // Blocks held by a cache are accounted as used by the pool
+  //
+  Pool        = &mPoolHead[EfiBootServicesData];
+  Moved       = PoolSlabMagazineRefill (&Pool->Slab, &mPoolSlabMagazine[Level][ClassIndex], ClassIndex);
+  Pool->Used += Moved * PoolSlabClassSize (ClassIndex);
+}
+
 /**
   Allocate pool of a particular type.
 
@@ -208,6 +428,7 @@ CoreInternalAllocatePool (
 {
   EFI_STATUS  Status;
   BOOLEAN     NeedGuard;
+  UINTN       Level;
 
   //
   // If it's not a valid type, fail it
@@ -234,6 +455,18 @@ CoreInternalAllocatePool (
 
   NeedGuard = IsPoolTypeToGuard (PoolType) && !mOnGuarding;
 
+  //
+  // Small EfiBootServicesData requests are served from the cache of the
+  // current TPL first, without taking the memory lock
+  //
+  Level = GetPoolSlabCacheLevel (PoolType, NeedGuard);
+  if (Level < POOL_SLAB_CACHE_LEVELS) {
+    *Buffer = CoreAllocatePoolSlabCached (Level, Size);
+    if (*Buffer != NULL) {
+      return EFI_SUCCESS;
+    }
+  }
+
   //
   // Acquire the memory lock and make the allocation
   //
@@ -243,6 +476,10 @@ CoreInternalAllocatePool (
   }
 
   *Buffer = CoreAllocatePoolI (PoolType, Size, NeedGuard);
+  if ((*Buffer != NULL) && (Level < POOL_SLAB_CACHE_LEVELS)) {
+    CoreRefillPoolSlabCache (Level, Size);
+  }
+
   CoreReleaseLock (&mPoolMemoryLock);
   return (*Buffer != NULL) ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
 }
@@ -367,6 +604,7 @@ CoreAllocatePoolI (
   UINTN      Granularity;
   BOOLEAN    HasPoolTail;
   BOOLEAN    PageAsPool;
+  UINTN      SlabClass;
 
   ASSERT_LOCKED (&mPoolMemoryLock);
 
@@ -402,7 +640,20 @@ CoreAllocatePoolI (
     return NULL;
   }
 
-  Head = NULL;
+  Head      = NULL;
+  SlabClass = POOL_SLAB_CLASS_COUNT;
+
+  //
+  // If slab allocation is enabled, small blocks come from the slab of their
+  // size class
+  //
+  if (FeaturePcdGet (PcdDxePoolSlabAllocatorEnable) && !NeedGuard && !PageAsPool) {
+    SlabClass = PoolSlabSizeToClass (Size);
+    if (SlabClass < POOL_SLAB_CLASS_COUNT) {
+      Head = PoolSlabAllocate (&Pool->Slab, SlabClass);
+      goto Done;
+    }
+  }
 
   //
   // If allocation is over max size, just allocate pages for the request
@@ -500,12 +751,20 @@ Done:
     //
     // Account the allocation
     //
-    Pool->Used += Size;
+    // Slab blocks are accounted by the size of their class, since that is
+    // what is returned to the slab when a per-TPL cache is drained
+    //
+    if (SlabClass < POOL_SLAB_CLASS_COUNT) {
+      Pool->Used     += PoolSlabClassSize (SlabClass);
+      Head->Signature = POOLSLAB_HEAD_SIGNATURE;
+    } else {
+      Pool->Used     += Size;
+      Head->Signature = (PageAsPool) ? POOLPAGE_HEAD_SIGNATURE : POOL_HEAD_SIGNATURE;
+    }
 
     //
     // If we have a pool buffer, fill in the header & tail info
     //
-    Head->Signature = (PageAsPool) ? POOLPAGE_HEAD_SIGNATURE : POOL_HEAD_SIGNATURE;
     Head->Size      = Size;
     Head->Type      = (EFI_MEMORY_TYPE)PoolType;
     Buffer          = Head->Data;
@@ -554,14 +813,54 @@ CoreInternalFreePool (
   OUT EFI_MEMORY_TYPE  *PoolType OPTIONAL
   )
 {
-  EFI_STATUS  Status;
+  EFI_STATUS          Status;
+  POOL                *Pool;
+  POOL_HEAD           *Head;
+  POOL_SLAB_MAGAZINE  *Magazine;
+  UINTN               Level;
+  UINTN               ClassIndex;
+  UINTN               Drained;
 
   if (Buffer == NULL) {
     return EFI_INVALID_PARAMETER;
   }
 
+  //
+  // Small EfiBootServicesData blocks go back to the cache of the current TPL
+  // first, without taking the memory lock
+  //
+  Magazine   = NULL;
+  ClassIndex = POOL_SLAB_CLASS_COUNT;
+  Level      = GetPoolSlabCacheLevel (EfiBootServicesData, FALSE);
+  if (Level < POOL_SLAB_CACHE_LEVELS) {
+    Head       = BASE_CR (Buffer, POOL_HEAD, Data);
+    ClassIndex = GetPoolSlabClass (Head);
+    if (ClassIndex < POOL_SLAB_CLASS_COUNT) {
+      Magazine = &mPoolSlabMagazine[Level][ClassIndex];
+      if (Magazine->Count < POOL_SLAB_MAGAZINE_DEPTH) {
+        if (PoolType != NULL) {
+          *PoolType = EfiBootServicesData;
+        }
+
+        DEBUG_CLEAR_MEMORY (Head, Head->Size);
+        PoolSlabMagazinePut (Magazine, Head, ClassIndex);
+        return EFI_SUCCESS;
+      }
+    }
+  }
+
   CoreAcquireLock (&mPoolMemoryLock);
   Status = CoreFreePoolI (Buffer, PoolType);
+  if (!EFI_ERROR (Status) && (Magazine != NULL)) {
+    //
+    // The cache was full, give half of it back to the slabs while the lock
+    // is held
+    //
+    Pool        = &mPoolHead[EfiBootServicesData];
+    Drained     = PoolSlabMagazineDrain (&Pool->Slab, Magazine, POOL_SLAB_MAGAZINE_BATCH);
+    Pool->Used -= Drained * PoolSlabClassSize (ClassIndex);
+  }
+
   CoreReleaseLock (&mPoolMemoryLock);
   return Status;
 }
@@ -665,6 +964,51 @@ CoreFreePoolPagesWithGuard (
   }
 }
 
+/**
+  Internal function.  Allocates the pages of a new slab for the slab engine.
+
+  @param  Context                The pool the slab belongs to
+  @param  SlabSize               The size of the slab, equal to the allocation
+                                 granularity of the pool memory type
+
+  @return The allocated memory, or NULL
+
+**/
+STATIC
+VOID *
+CorePoolSlabAllocatePages (
+  IN VOID   *Context,
+  IN UINTN  SlabSize
+  )
+{
+  POOL  *Pool;
+
+  Pool = (POOL *)Context;
+  return CoreAllocatePoolPagesI (Pool->MemoryType, EFI_SIZE_TO_PAGES (SlabSize), SlabSize, FALSE);
+}
+
+/**
+  Internal function.  Frees the pages of an empty slab for the slab engine.
+
+  @param  Context                The pool the slab belongs to
+  @param  Slab                   The base address of the slab
+  @param  SlabSize               The size of the slab
+
+**/
+STATIC
+VOID
+CorePoolSlabFreePages (
+  IN VOID   *Context,
+  IN VOID   *Slab,
+  IN UINTN  SlabSize
+  )
+{
+  POOL  *Pool;
+
+  Pool = (POOL *)Context;
+  CoreFreePoolPagesI (Pool->MemoryType, (EFI_PHYSICAL_ADDRESS)(UINTN)Slab, EFI_SIZE_TO_PAGES (SlabSize));
+}
+
 /**
   Internal function to free a pool entry.
   Caller must have the memory lock held
@@ -696,6 +1040,7 @@ CoreFreePoolI (
   BOOLEAN    IsGuarded;
   BOOLEAN    HasPoolTail;
   BOOLEAN    PageAsPool;
+  UINTN      SlabClass;
 
   ASSERT (Buffer != NULL);
   //
@@ -705,11 +1050,13 @@ CoreFreePoolI (
   ASSERT (Head != NULL);
 
   if ((Head->Signature != POOL_HEAD_SIGNATURE) &&
-      (Head->Signature != POOLPAGE_HEAD_SIGNATURE))
+      (Head->Signature != POOLPAGE_HEAD_SIGNATURE) &&
+      (Head->Signature != POOLSLAB_HEAD_SIGNATURE))
   {
     ASSERT (
       Head->Signature == POOL_HEAD_SIGNATURE ||
-      Head->Signature == POOLPAGE_HEAD_SIGNATURE
+      Head->Signature == POOLPAGE_HEAD_SIGNATURE ||
+      Head->Signature == POOLSLAB_HEAD_SIGNATURE
       );
     return EFI_INVALID_PARAMETER;
   }
@@ -750,7 +1097,19 @@ CoreFreePoolI (
     return EFI_INVALID_PARAMETER;
   }
 
-  Pool->Used -= Size;
+  SlabClass = POOL_SLAB_CLASS_COUNT;
+  if (Head->Signature == POOLSLAB_HEAD_SIGNATURE) {
+    SlabClass = PoolSlabBlockClass (&Pool->Slab, Head);
+    ASSERT (SlabClass < POOL_SLAB_CLASS_COUNT);
+    if (SlabClass >= POOL_SLAB_CLASS_COUNT) {
+      return EFI_INVALID_PARAMETER;
+    }
+
+    Pool->Used -= PoolSlabClassSize (SlabClass);
+  } else {
+    Pool->Used -= Size;
+  }
+
   DEBUG ((DEBUG_POOL, "FreePool: %p (len %lx) %,ld\n", Head->Data, (UINT64)(Head->Size - POOL_OVERHEAD), (UINT64)Pool->Used));
 
   if ((Head->Type == EfiACPIReclaimMemory) ||
@@ -773,11 +1132,15 @@ CoreFreePoolI (
   Index = SIZE_TO_LIST (Size);
   DEBUG_CLEAR_MEMORY (Head, Size);
 
-  //
-  // If it's not on the list, it must be pool pages
-  //
-  if ((Index >= SIZE_TO_LIST (Granularity)) || IsGuarded || PageAsPool) {
+  if (SlabClass < POOL_SLAB_CLASS_COUNT) {
+    //
+    // Return the block to its slab, which goes back to free memory once it
+    // is empty
+    //
+    PoolSlabFree (&Pool->Slab, Head);
+  } else if ((Index >= SIZE_TO_LIST (Granularity)) || IsGuarded || PageAsPool) {
     //
+    // If it's not on the list, it must be pool pages.
     // Return the memory pages back to free memory
     //
     NoPages  = EFI_SIZE_TO_PAGES (Size) + EFI_SIZE_TO_PAGES (Granularity) - 1;
@@ -863,6 +1226,7 @@ CoreFreePoolI (
   // list entry for that memory type
   //
   if (((UINT32)Pool->MemoryType >= MEMORY_TYPE_OEM_RESERVED_MIN) && (Pool->Used == 0)) {
+    PoolSlabTrim (&Pool->Slab);
     RemoveEntryList (&Pool->Link);
     CoreFreePoolI (Pool, NULL);
   }
@@ -0,0 +1,516 @@
+/** @file
+  Size-class slab engine used by the DXE core pool allocator.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "PoolSlab.h"
+
+//
+// Block sizes of the slab classes. Each size is the largest multiple of 16
+// bytes that fits a given number of blocks into a 4 KB slab, so that the space
+// lost at the end of a slab stays small.
+//
+STATIC CONST UINT16  mPoolSlabClassSize[POOL_SLAB_CLASS_COUNT] = {
+  32, 48, 64, 80, 96, 112, 128, 160, 192, 240, 288, 336, 400, 448, 496, 576, 672, 800, 1008
+};
+
+//
+// Maps a block size, in 16 byte units rounded up, to its size class.
+//
+STATIC UINT8    mPoolSlabSizeToClass[POOL_SLAB_MAX_BLOCK_SIZE / 16 + 1];
+STATIC BOOLEAN  mPoolSlabSizeToClassReady = FALSE;
+
+/**
+  Initializes a slab cache.
+
+  @param  Cache                  The slab cache to initialize.
+  @param  SlabSize               Size of each slab, a power of two of at least
+                                 one page.
+  @param  AllocatePages          Function used to get new slabs.
+  @param  FreePages              Function used to return empty slabs.
+  @param  Context                Context passed to AllocatePages and FreePages.
+
+**/
+VOID
+PoolSlabInitialize (
+  OUT POOL_SLAB_CACHE           *Cache,
+  IN  UINTN                     SlabSize,
+  IN  POOL_SLAB_ALLOCATE_PAGES  AllocatePages,
+  IN  POOL_SLAB_FREE_PAGES      FreePages,
+  IN  VOID                      *Context
+  )
+{
+  UINTN  Index;
+  UINTN  ClassIndex;
+
+  ASSERT ((SlabSize & (SlabSize - 1)) == 0);
+  ASSERT (SlabSize - POOL_SLAB_DATA_OFFSET >= POOL_SLAB_MAX_BLOCK_SIZE);
+
+  if (!mPoolSlabSizeToClassReady) {
+    ClassIndex = 0;
+    for (Index = 0; Index < ARRAY_SIZE (mPoolSlabSizeToClass); Index++) {
+      while (mPoolSlabClassSize[ClassIndex] < Index * 16) {
+        ClassIndex++;
+      }
+
+      mPoolSlabSizeToClass[Index] = (UINT8)ClassIndex;
+    }
+
+    mPoolSlabSizeToClassReady = TRUE;
+  }
+
+  Cache->SlabSize      = SlabSize;
+  Cache->Context       = Context;
+  Cache->AllocatePages = AllocatePages;
+  Cache->FreePages     = FreePages;
+  for (Index = 0; Index < POOL_SLAB_CLASS_COUNT; Index++) {
+    InitializeListHead (&Cache->Class[Index].PartialList);
+    Cache->Class[Index].EmptyCount = 0;
+  }
+
+  Cache->Statistics.SlabsAllocated  = 0;
+  Cache->Statistics.SlabsFreed      = 0;
+  Cache->Statistics.SlabsInUse      = 0;
+  Cache->Statistics.BlocksAllocated = 0;
+  Cache->Statistics.BlocksFreed     = 0;
+  Cache->Statistics.BlocksInUse     = 0;
+}
+
+/**
+  Gets the size class serving blocks of the specified size.
+
+  @param  Size                   Size of the block, including pool overhead.
+
+  @return The size class index, or POOL_SLAB_CLASS_COUNT if the block is too
+          large to be served from a slab.
+
+**/
+UINTN
+PoolSlabSizeToClass (
+  IN UINTN  Size
+  )
+{
+  if ((Size > POOL_SLAB_MAX_BLOCK_SIZE) || !mPoolSlabSizeToClassReady) {
+    return POOL_SLAB_CLASS_COUNT;
+  }
+
+  return mPoolSlabSizeToClass[(Size + 15) / 16];
+}
+
+/**
+  Gets the block size of a size class.
+
+  @param  ClassIndex             The size class index.
+
+  @return The size of the blocks in that class.
+
+**/
+UINTN
+PoolSlabClassSize (
+  IN UINTN  ClassIndex
+  )
+{
+  ASSERT (ClassIndex < POOL_SLAB_CLASS_COUNT);
+  return mPoolSlabClassSize[ClassIndex];
+}
+
+/**
+  Gets the slab holding a block.
+
+  @param  Cache                  The slab cache.
+  @param  Block                  The block.
+
+  @return The slab header.
+
+**/
+STATIC
+POOL_SLAB *
+PoolSlabFromBlock (
+  IN POOL_SLAB_CACHE  *Cache,
+  IN VOID             *Block
+  )
+{
+  return (POOL_SLAB *)((UINTN)Block & ~(Cache->SlabSize - 1));
+}
+
+/**
+  Gets a new slab for a size class from the page allocator.
+
+  @param  Cache                  The slab cache.
+  @param  ClassIndex             The size class index.
+
+  @return The new slab, or NULL.
+
+**/
+STATIC
+POOL_SLAB *
+PoolSlabCreate (
+  IN OUT POOL_SLAB_CACHE  *Cache,
+  IN     UINTN            ClassIndex
+  )
+{
+  POOL_SLAB  *Slab;
+
+  Slab = Cache->AllocatePages (Cache->Context, Cache->SlabSize);
+  if (Slab == NULL) {
+    return NULL;
+  }
+
+  ASSERT (((UINTN)Slab & (Cache->SlabSize - 1)) == 0);
+
+  Slab->Signature  = POOL_SLAB_SIGNATURE;
+  Slab->ClassIndex = (UINT16)ClassIndex;
+  Slab->InUse      = 0;
+  Slab->Capacity   = (UINT16)((Cache->SlabSize - POOL_SLAB_DATA_OFFSET) / mPoolSlabClassSize[ClassIndex]);
+  Slab->Carved     = 0;
+  Slab->Reserved   = 0;
+  Slab->FreeList   = NULL;
+
+  Cache->Statistics.SlabsAllocated++;
+  Cache->Statistics.SlabsInUse++;
+  return Slab;
+}
+
+/**
+  Returns a slab to the page allocator.
+
+  @param  Cache                  The slab cache.
+  @param  Slab                   The empty slab, already off the partial list.
+
+**/
+STATIC
+VOID
+PoolSlabDestroy (
+  IN OUT POOL_SLAB_CACHE  *Cache,
+  IN     POOL_SLAB        *Slab
+  )
+{
+  ASSERT (Slab->InUse == 0);
+
+  Slab->Signature = 0;
+  Cache->FreePages (Cache->Context, Slab, Cache->SlabSize);
+
+  Cache->Statistics.SlabsFreed++;
+  Cache->Statistics.SlabsInUse--;
+}
+
+/**
+  Allocates one block of a size class.
+
+  @param  Cache                  The slab cache.
+  @param  ClassIndex             The size class index.
+
+  @return The block, or NULL if no slab could be allocated.
+
+**/
+VOID *
+PoolSlabAllocate (
+  IN OUT POOL_SLAB_CACHE  *Cache,
+  IN     UINTN            ClassIndex
+  )
+{
+  POOL_SLAB_CLASS  *Class;
+  POOL_SLAB        *Slab;
+  VOID             *Block;
+
+  ASSERT (ClassIndex < POOL_SLAB_CLASS_COUNT);
+  Class = &Cache->Class[ClassIndex];
+
+  if (IsListEmpty (&Class->PartialList)) {
+    Slab = PoolSlabCreate (Cache, ClassIndex);
+    if (Slab == NULL) {
+      return NULL;
+    }
+
+    InsertHeadList (&Class->PartialList, &Slab->Link);
+  } else {
+    Slab = BASE_CR (Class->PartialList.ForwardLink, POOL_SLAB, Link);
+    ASSERT (Slab->Signature == POOL_SLAB_SIGNATURE);
+    if (Slab->InUse == 0) {
+      ASSERT (Class->EmptyCount > 0);
+      Class->EmptyCount--;
+    }
+  }
+
+  //
+  // Reuse a freed block first, then carve the untouched tail of the slab, so
+  // a new slab does not have to be threaded onto its free list up front.
+  //
+  if (Slab->FreeList != NULL) {
+    ASSERT (Slab->FreeList->Signature == POOL_SLAB_FREE_SIGNATURE);
+    Block          = Slab->FreeList;
+    Slab->FreeList = Slab->FreeList->Next;
+  } else {
+    ASSERT (Slab->Carved < Slab->Capacity);
+    Block = (UINT8 *)Slab + POOL_SLAB_DATA_OFFSET + (UINTN)Slab->Carved * mPoolSlabClassSize[ClassIndex];
+    Slab->Carved++;
+  }
+
+  Slab->InUse++;
+  if (Slab->InUse == Slab->Capacity) {
+    RemoveEntryList (&Slab->Link);
+    InitializeListHead (&Slab->Link);
+  }
+
+  Cache->Statistics.BlocksAllocated++;
+  Cache->Statistics.BlocksInUse++;
+  return Block;
+}
+
+/**
+  Gets the size class of a block served by a slab cache.
+
+  @param  Cache                  The slab cache.
+  @param  Block                  The block to look up.
+
+  @return The size class index, or POOL_SLAB_CLASS_COUNT if Block does not
+          belong to a slab of this cache.
+
+**/
+UINTN
+PoolSlabBlockClass (
+  IN POOL_SLAB_CACHE  *Cache,
+  IN VOID             *Block
+  )
+{
+  POOL_SLAB  *Slab;
+  UINTN      Offset;
+
+  Slab = PoolSlabFromBlock (Cache, Block);
+  if ((Slab->Signature != POOL_SLAB_SIGNATURE) || (Slab->ClassIndex >= POOL_SLAB_CLASS_COUNT)) {
+    return POOL_SLAB_CLASS_COUNT;
+  }
+
+  Offset = (UINTN)Block - (UINTN)Slab;
+  if ((Offset < POOL_SLAB_DATA_OFFSET) ||
+      (((Offset - POOL_SLAB_DATA_OFFSET) % mPoolSlabClassSize[Slab->ClassIndex]) != 0) ||
+      ((Offset - POOL_SLAB_DATA_OFFSET) / mPoolSlabClassSize[Slab->ClassIndex] >= Slab->Carved))
+  {
+    return POOL_SLAB_CLASS_COUNT;
+  }
+
+  return Slab->ClassIndex;
+}
+
+/**
+  Returns one block to its slab. The slab is given back to the page allocator
+  when it becomes empty and enough empty slabs are already kept.
+
+  @param  Cache                  The slab cache.
+  @param  Block                  The block to free.
+
+**/
+VOID
+PoolSlabFree (
+  IN OUT POOL_SLAB_CACHE  *Cache,
+  IN     VOID             *Block
+  )
+{
+  POOL_SLAB        *Slab;
+  POOL_SLAB_CLASS  *Class;
+  POOL_SLAB_FREE   *Free;
+
+  Slab = PoolSlabFromBlock (Cache, Block);
+  ASSERT (Slab->Signature == POOL_SLAB_SIGNATURE);
+  ASSERT (Slab->InUse > 0);
+  Class = &Cache->Class[Slab->ClassIndex];
+
+  if (Slab->InUse == Slab->Capacity) {
+    InsertHeadList (&Class->PartialList, &Slab->Link);
+  }
+
+  Free             = (POOL_SLAB_FREE *)Block;
+  Free->Signature  = POOL_SLAB_FREE_SIGNATURE;
+  Free->ClassIndex = Slab->ClassIndex;
+  Free->Next       = Slab->FreeList;
+  Slab->FreeList   = Free;
+  Slab->InUse--;
+
+  Cache->Statistics.BlocksFreed++;
+  Cache->Statistics.BlocksInUse--;
+
+  if (Slab->InUse == 0) {
+    RemoveEntryList (&Slab->Link);
+    if (Class->EmptyCount >= POOL_SLAB_EMPTY_RESERVE) {
+      PoolSlabDestroy (Cache, Slab);
+    } else {
+      //
+      // Keep one empty slab around so that a caller allocating and freeing
+      // a single block does not bounce a slab in and out of the page
+      // allocator.
+      //
+      InsertTailList (&Class->PartialList, &Slab->Link);
+      Class->EmptyCount++;
+    }
+  }
+}
+
+/**
+  Returns every empty slab kept by the cache to the page allocator.
+
+  @param  Cache                  The slab cache.
+
+**/
+VOID
+PoolSlabTrim (
+  IN OUT POOL_SLAB_CACHE  *Cache
+  )
+{
+  UINTN       Index;
+  LIST_ENTRY  *Link;
+  LIST_ENTRY  *NextLink;
+  POOL_SLAB   *Slab;
+
+  for (Index = 0; Index < POOL_SLAB_CLASS_COUNT; Index++) {
+    Link = Cache->Class[Index].PartialList.ForwardLink;
+    while (Link != &Cache->Class[Index].PartialList) {
+      NextLink = Link->ForwardLink;
+      Slab     = BASE_CR (Link, POOL_SLAB, Link);
+      if (Slab->InUse == 0) {
+        RemoveEntryList (&Slab->Link);
+        PoolSlabDestroy (Cache, Slab);
+        Cache->Class[Index].EmptyCount--;
+      }
+
+      Link = NextLink;
+    }
+
+    ASSERT (Cache->Class[Index].EmptyCount == 0);
+  }
+}
+
+/**
+  Pops one block from a magazine. Does not need the cache lock.
+
+  @param  Magazine               The magazine.
+
+  @return The block, or NULL if the magazine is empty.
+
+**/
+VOID *
+PoolSlabMagazineGet (
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine
+  )
+{
+  POOL_SLAB_FREE  *Free;
+
+  Free = Magazine->Head;
+  if (Free == NULL) {
+    Magazine->Misses++;
+    return NULL;
+  }
+
+  ASSERT (Free->Signature == POOL_SLAB_FREE_SIGNATURE);
+  Magazine->Head = Free->Next;
+  Magazine->Count--;
+  Magazine->Hits++;
+  return Free;
+}
+
+/**
+  Pushes one block onto a magazine. Does not need the cache lock.
+
+  @param  Magazine               The magazine.
+  @param  Block                  The block to push.
+  @param  ClassIndex             The size class of Block.
+
+  @retval TRUE                   Block was pushed.
+  @retval FALSE                  The magazine is full.
+
+**/
+BOOLEAN
+PoolSlabMagazinePut (
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine,
+  IN     VOID                *Block,
+  IN     UINTN               ClassIndex
+  )
+{
+  POOL_SLAB_FREE  *Free;
+
+  if (Magazine->Count >= POOL_SLAB_MAGAZINE_DEPTH) {
+    return FALSE;
+  }
+
+  Free             = (POOL_SLAB_FREE *)Block;
+  Free->Signature  = POOL_SLAB_FREE_SIGNATURE;
+  Free->ClassIndex = (UINT32)ClassIndex;
+  Free->Next       = Magazine->Head;
+  Magazine->Head   = Free;
+  Magazine->Count++;
+  return TRUE;
+}
+
+/**
+  Moves up to POOL_SLAB_MAGAZINE_BATCH blocks from the slabs to a magazine.
+  The caller must hold the cache lock.
+
+  @param  Cache                  The slab cache.
+  @param  Magazine               The magazine to fill.
+  @param  ClassIndex             The size class of the magazine.
+
+  @return The number of blocks moved.
+
+**/
+UINTN
+PoolSlabMagazineRefill (
+  IN OUT POOL_SLAB_CACHE     *Cache,
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine,
+  IN     UINTN               ClassIndex
+  )
+{
+  UINTN  Moved;
+  VOID   *Block;
+
+  for (Moved = 0; Moved < POOL_SLAB_MAGAZINE_BATCH; Moved++) {
+    if (Magazine->Count >= POOL_SLAB_MAGAZINE_DEPTH) {
+      break;
+    }
+
+    //
+    // Only take blocks that are already backed by a slab, never grow the
+    // cache just to fill a magazine.
+    //
+    if (IsListEmpty (&Cache->Class[ClassIndex].PartialList)) {
+      break;
+    }
+
+    Block = PoolSlabAllocate (Cache, ClassIndex);
+    ASSERT (Block != NULL);
+    PoolSlabMagazinePut (Magazine, Block, ClassIndex);
+  }
+
+  return Moved;
+}
+
+/**
+  Moves up to Count blocks from a magazine back to their slabs.
+  The caller must hold the cache lock.
+
+  @param  Cache                  The slab cache.
+  @param  Magazine               The magazine to drain.
+  @param  Count                  The maximum number of blocks to move.
+
+  @return The number of blocks moved.
+
+**/
+UINTN
+PoolSlabMagazineDrain (
+  IN OUT POOL_SLAB_CACHE     *Cache,
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine,
+  IN     UINTN               Count
+  )
+{
+  UINTN           Moved;
+  POOL_SLAB_FREE  *Free;
+
+  for (Moved = 0; (Moved < Count) && (Magazine->Head != NULL); Moved++) {
+    Free           = Magazine->Head;
+    Magazine->Head = Free->Next;
+    Magazine->Count--;
+    PoolSlabFree (Cache, Free);
+  }
+
+  return Moved;
+}
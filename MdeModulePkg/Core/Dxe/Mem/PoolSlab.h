@@ -0,0 +1,312 @@
+/** @file
+  Size-class slab engine used by the DXE core pool allocator.
+
+  Small pool blocks are carved out of page-backed slabs. Every slab is one
+  allocation granule in size, is aligned on its own size and only holds
+  blocks of a single size class, so the owning slab of any block is found by
+  masking the block address. Allocation and free are O(1).
+
+  The engine keeps no lock of its own. POOL_SLAB_CACHE operations must be
+  serialized by the caller, while a POOL_SLAB_MAGAZINE may be used without a
+  lock by the single execution level that owns it.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _POOL_SLAB_H_
+#define _POOL_SLAB_H_
+
+#include <Uefi/UefiBaseType.h>
+
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+
+//
+// Number of size classes, and the largest block (including the pool head and
+// tail) that is served from a slab.
+//
+#define POOL_SLAB_CLASS_COUNT     19
+#define POOL_SLAB_MAX_BLOCK_SIZE  1008
+
+//
+// Number of slabs per size class that are kept when they become empty,
+// instead of being returned to the page allocator right away.
+//
+#define POOL_SLAB_EMPTY_RESERVE  1
+
+//
+// Maximum number of blocks held by one magazine, and the number of blocks
+// moved between a magazine and the slabs in one batch.
+//
+#define POOL_SLAB_MAGAZINE_DEPTH  16
+#define POOL_SLAB_MAGAZINE_BATCH  (POOL_SLAB_MAGAZINE_DEPTH / 2)
+
+#define POOL_SLAB_FREE_SIGNATURE  SIGNATURE_32('p','s','f','r')
+typedef struct _POOL_SLAB_FREE POOL_SLAB_FREE;
+struct _POOL_SLAB_FREE {
+  UINT32            Signature;
+  UINT32            ClassIndex;
+  POOL_SLAB_FREE    *Next;
+};
+
+#define POOL_SLAB_SIGNATURE  SIGNATURE_32('p','s','l','b')
+typedef struct {
+  UINT32            Signature;
+  UINT16            ClassIndex;
+  UINT16            InUse;
+  UINT16            Capacity;
+  UINT16            Carved;
+  UINT32            Reserved;
+  POOL_SLAB_FREE    *FreeList;
+  LIST_ENTRY        Link;
+} POOL_SLAB;
+
+//
+// Offset of the first block in a slab.
+//
+#define POOL_SLAB_DATA_OFFSET  ALIGN_VALUE (sizeof (POOL_SLAB), 16)
+
+typedef struct {
+  //
+  // Slabs with at least one free block. Slabs that turn partial are inserted
+  // at the head, slabs that turn empty are moved to the tail, so allocations
+  // keep filling the busiest slabs.
+  //
+  LIST_ENTRY    PartialList;
+  UINTN         EmptyCount;
+} POOL_SLAB_CLASS;
+
+typedef struct {
+  UINTN    SlabsAllocated;
+  UINTN    SlabsFreed;
+  UINTN    SlabsInUse;
+  UINTN    BlocksAllocated;
+  UINTN    BlocksFreed;
+  UINTN    BlocksInUse;
+} POOL_SLAB_STATISTICS;
+
+/**
+  Allocates one slab.
+
+  @param  Context                The context registered with PoolSlabInitialize().
+  @param  SlabSize               Size of the slab. The returned memory must be
+                                 aligned on this size.
+
+  @return The slab memory, or NULL.
+
+**/
+typedef
+VOID *
+(*POOL_SLAB_ALLOCATE_PAGES) (
+  IN VOID   *Context,
+  IN UINTN  SlabSize
+  );
+
+/**
+  Frees one slab.
+
+  @param  Context                The context registered with PoolSlabInitialize().
+  @param  Slab                   The slab memory to free.
+  @param  SlabSize               Size of the slab.
+
+**/
+typedef
+VOID
+(*POOL_SLAB_FREE_PAGES) (
+  IN VOID   *Context,
+  IN VOID   *Slab,
+  IN UINTN  SlabSize
+  );
+
+typedef struct {
+  UINTN                       SlabSize;
+  VOID                        *Context;
+  POOL_SLAB_ALLOCATE_PAGES    AllocatePages;
+  POOL_SLAB_FREE_PAGES        FreePages;
+  POOL_SLAB_CLASS             Class[POOL_SLAB_CLASS_COUNT];
+  POOL_SLAB_STATISTICS        Statistics;
+} POOL_SLAB_CACHE;
+
+//
+// Small stack of free blocks of one size class. A magazine is owned by one
+// execution level and is only touched by code running at that level.
+//
+typedef struct {
+  POOL_SLAB_FREE    *Head;
+  UINTN             Count;
+  UINTN             Hits;
+  UINTN             Misses;
+} POOL_SLAB_MAGAZINE;
+
+/**
+  Initializes a slab cache.
+
+  @param  Cache                  The slab cache to initialize.
+  @param  SlabSize               Size of each slab, a power of two of at least
+                                 one page.
+  @param  AllocatePages          Function used to get new slabs.
+  @param  FreePages              Function used to return empty slabs.
+  @param  Context                Context passed to AllocatePages and FreePages.
+
+**/
+VOID
+PoolSlabInitialize (
+  OUT POOL_SLAB_CACHE           *Cache,
+  IN  UINTN                     SlabSize,
+  IN  POOL_SLAB_ALLOCATE_PAGES  AllocatePages,
+  IN  POOL_SLAB_FREE_PAGES      FreePages,
+  IN  VOID                      *Context
+  );
+
+/**
+  Gets the size class serving blocks of the specified size.
+
+  @param  Size                   Size of the block, including pool overhead.
+
+  @return The size class index, or POOL_SLAB_CLASS_COUNT if the block is too
+          large to be served from a slab.
+
+**/
+UINTN
+PoolSlabSizeToClass (
+  IN UINTN  Size
+  );
+
+/**
+  Gets the block size of a size class.
+
+  @param  ClassIndex             The size class index.
+
+  @return The size of the blocks in that class.
+
+**/
+UINTN
+PoolSlabClassSize (
+  IN UINTN  ClassIndex
+  );
+
+/**
+  Allocates one block of a size class.
+
+  @param  Cache                  The slab cache.
+  @param  ClassIndex             The size class index.
+
+  @return The block, or NULL if no slab could be allocated.
+
+**/
+VOID *
+PoolSlabAllocate (
+  IN OUT POOL_SLAB_CACHE  *Cache,
+  IN     UINTN            ClassIndex
+  );
+
+/**
+  Gets the size class of a block served by a slab cache.
+
+  @param  Cache                  The slab cache.
+  @param  Block                  The block to look up.
+
+  @return The size class index, or POOL_SLAB_CLASS_COUNT if Block does not
+          belong to a slab of this cache.
+
+**/
+UINTN
+PoolSlabBlockClass (
+  IN POOL_SLAB_CACHE  *Cache,
+  IN VOID             *Block
+  );
+
+/**
+  Returns one block to its slab. The slab is given back to the page allocator
+  when it becomes empty and enough empty slabs are already kept.
+
+  @param  Cache                  The slab cache.
+  @param  Block                  The block to free.
+
+**/
+VOID
+PoolSlabFree (
+  IN OUT POOL_SLAB_CACHE  *Cache,
+  IN     VOID             *Block
+  );
+
+/**
+  Returns every empty slab kept by the cache to the page allocator.
+
+  @param  Cache                  The slab cache.
+
+**/
+VOID
+PoolSlabTrim (
+  IN OUT POOL_SLAB_CACHE  *Cache
+  );
+
+/**
+  Pops one block from a magazine. Does not need the cache lock.
+
+  @param  Magazine               The magazine.
+
+  @return The block, or NULL if the magazine is empty.
+
+**/
+VOID *
+PoolSlabMagazineGet (
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine
+  );
+
+/**
+  Pushes one block onto a magazine. Does not need the cache lock.
+
+  @param  Magazine               The magazine.
+  @param  Block                  The block to push.
+  @param  ClassIndex             The size class of Block.
+
+  @retval TRUE                   Block was pushed.
+  @retval FALSE                  The magazine is full.
+
+**/
+BOOLEAN
+PoolSlabMagazinePut (
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine,
+  IN     VOID                *Block,
+  IN     UINTN               ClassIndex
+  );
+
+/**
+  Moves up to POOL_SLAB_MAGAZINE_BATCH blocks from the slabs to a magazine.
+  The caller must hold the cache lock.
+
+  @param  Cache                  The slab cache.
+  @param  Magazine               The magazine to fill.
+  @param  ClassIndex             The size class of the magazine.
+
+  @return The number of blocks moved.
+
+**/
+UINTN
+PoolSlabMagazineRefill (
+  IN OUT POOL_SLAB_CACHE     *Cache,
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine,
+  IN     UINTN               ClassIndex
+  );
+
+/**
+  Moves up to Count blocks from a magazine back to their slabs.
+  The caller must hold the cache lock.
+
+  @param  Cache                  The slab cache.
+  @param  Magazine               The magazine to drain.
+  @param  Count                  The maximum number of blocks to move.
+
+  @return The number of blocks moved.
+
+**/
+UINTN
+PoolSlabMagazineDrain (
+  IN OUT POOL_SLAB_CACHE     *Cache,
+  IN OUT POOL_SLAB_MAGAZINE  *Magazine,
+  IN     UINTN               Count
+  );
+
+#endif
@@ -77,6 +77,17 @@ typedef struct {
 // The payload for this function is SMM_VARIABLE_COMMUNICATE_GET_RUNTIME_CACHE_INFO
 //
 #define SMM_VARIABLE_FUNCTION_GET_RUNTIME_CACHE_INFO  14
+//
+// The payload for this function is VARIABLE_RECLAIM_STATISTICS.
+//
+#define SMM_VARIABLE_FUNCTION_GET_RECLAIM_STATISTICS  15
+//
+// The payload for this function is SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION.
+// It is sent after SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE_CONTEXT, by the runtime
+// DXE drivers that derive data from the runtime caches. MM implementations without it return
+// EFI_UNSUPPORTED.
+//
+#define SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE_GENERATION  16
 
 ///
 /// Size of SMM communicate header, without including the payload.
@@ -140,6 +151,14 @@ typedef struct {
   VARIABLE_STORE_HEADER    *RuntimeVolatileCache;
 } SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_CONTEXT;
 
+typedef struct {
+  //
+  // Incremented each time a runtime cache is rewritten rather than appended
+  // to, which invalidates what the runtime DXE driver derived from it.
+  //
+  UINT32    *Generation;
+} SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION;
+
 typedef struct {
   UINTN      TotalHobStorageSize;
   UINTN      TotalNvStorageSize;
@@ -0,0 +1,32 @@
+/** @file
+  Statistics of the reclaim of the non-volatile variable store.
+
+  When PcdVariableCollectStatistics is TRUE, the variable driver counts the
+  writes reclaim makes to the non-volatile variable store and how long they
+  stall the variable services. The runtime DXE variable driver publishes them
+  in the EFI system table with this GUID; the SMM variable driver returns them
+  with SMM_VARIABLE_FUNCTION_GET_RECLAIM_STATISTICS.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _VARIABLE_RECLAIM_STATISTICS_H_
+#define _VARIABLE_RECLAIM_STATISTICS_H_
+
+#define EDKII_VARIABLE_RECLAIM_STATISTICS_GUID  {\
+  0x91a96238, 0xcfdc, 0x4b41, { 0x9c, 0xa1, 0xf4, 0x2c, 0x1a, 0xff, 0xd0, 0x84 } \
+};
+
+typedef struct {
+  UINT32    FullReclaimCount;        ///< Number of reclaims that rewrote the whole store.
+  UINT32    IncrementalReclaimCount; ///< Number of reclaims that rewrote the end of the store.
+  UINT64    BytesWritten;            ///< Number of bytes of the store written by reclaim.
+  UINT64    BytesReclaimed;          ///< Number of bytes of deleted variables dropped by reclaim.
+  UINT64    TotalStallTime;          ///< Time spent in reclaim, in nanoseconds.
+  UINT64    MaxStallTime;            ///< Time spent in the longest reclaim, in nanoseconds.
+} VARIABLE_RECLAIM_STATISTICS;
+
+extern EFI_GUID  gEdkiiVariableReclaimStatisticsGuid;
+
+#endif
@@ -0,0 +1,63 @@
+/** @file
+  EDKII Disk I/O Block Cache Statistics Protocol.
+
+  The Disk I/O driver installs this protocol with the Disk I/O protocol on the
+  handles of the devices whose blocks it caches. It returns the geometry and
+  the counters of the block cache of the device.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL_H__
+#define __EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL_H__
+
+#define EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL_GUID \
+  { \
+    0xeb9a2408, 0x0061, 0x4b2f, { 0xb1, 0x35, 0x6d, 0x22, 0x4b, 0x82, 0xe6, 0xa1 } \
+  }
+
+typedef struct _EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL;
+
+typedef struct {
+  UINT32    BlockSize;      ///< Size of a cached block, in bytes.
+  UINT32    BlockCount;     ///< Number of blocks the cache holds.
+  UINT64    Hits;           ///< Number of reads served from the cache.
+  UINT64    Misses;         ///< Number of reads that went to the device.
+  UINT64    Fills;          ///< Number of blocks copied into the cache.
+  UINT64    Invalidations;  ///< Number of cached blocks dropped by writes.
+  UINT64    Flushes;        ///< Number of media changes that emptied the cache.
+  UINT64    MergedReads;    ///< Number of unaligned reads done with one transfer.
+  UINT64    PendingWrites;  ///< Number of writes in flight.
+} EDKII_DISK_IO_BLOCK_CACHE_STATISTICS;
+
+/**
+  Return the statistics of the block cache of a device.
+
+  @param[in]  This        A pointer to the
+                          EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL
+                          instance.
+  @param[out] Statistics  A pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS             The statistics are returned.
+  @retval EFI_INVALID_PARAMETER   Statistics is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_DISK_IO_GET_BLOCK_CACHE_STATISTICS)(
+  IN  EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_DISK_IO_BLOCK_CACHE_STATISTICS           *Statistics
+  );
+
+///
+/// The EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL returns the counters of
+/// the block cache of the Disk I/O driver.
+///
+struct _EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL {
+  EDKII_DISK_IO_GET_BLOCK_CACHE_STATISTICS    GetStatistics;
+};
+
+extern EFI_GUID  gEdkiiDiskIoBlockCacheStatisticsProtocolGuid;
+
+#endif
@@ -0,0 +1,92 @@
+/** @file
+  Driver Binding Deferred Start protocol.
+
+  A UEFI driver installs this protocol on the handle of its Driver Binding
+  protocol to declare that its Start() function can be split into a short
+  Begin() call, which programs the controller and returns without waiting for
+  it, and repeated Poll() calls that complete the start once the controller is
+  ready. The DXE core may then start the driver on controllers of independent
+  subtrees, such as the devices behind distinct PCI root ports, and overlap the
+  time these controllers take to become ready.
+
+  Begin() followed by Poll() until it stops returning EFI_NOT_READY must have
+  the same result as a single call to Start() of the Driver Binding protocol.
+  Drivers that do not produce this protocol are always started with Start().
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __DRIVER_BINDING_DEFERRED_START_H__
+#define __DRIVER_BINDING_DEFERRED_START_H__
+
+#include <Protocol/DevicePath.h>
+
+#define EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL_GUID \
+  { \
+    0x316747d0, 0xfe71, 0x4667, { 0x8e, 0x8b, 0xde, 0x89, 0xb9, 0x52, 0x42, 0xe6 } \
+  }
+
+typedef struct _EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL;
+
+/**
+  Begins to start the driver on a controller, without waiting for the
+  controller to become ready.
+
+  It is only called for a controller that the Supported() function of the
+  driver has just accepted.
+
+  @param[in]  This                 The protocol instance.
+  @param[in]  ControllerHandle     The handle of the controller to start.
+  @param[in]  RemainingDevicePath  The remaining portion of the device path,
+                                   as passed to Start().
+  @param[out] Context              Returns the driver context of this start,
+                                   passed back to Poll().
+
+  @retval EFI_SUCCESS              The start has begun, Poll() must be called
+                                   until it completes.
+  @retval EFI_UNSUPPORTED          This start can't be deferred. Nothing was
+                                   changed, and Start() is called instead.
+  @retval Others                   The driver could not be started, as Start()
+                                   would have returned. Start() is not called.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_DRIVER_BINDING_DEFERRED_START_BEGIN)(
+  IN  EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  *This,
+  IN  EFI_HANDLE                                    ControllerHandle,
+  IN  EFI_DEVICE_PATH_PROTOCOL                      *RemainingDevicePath OPTIONAL,
+  OUT VOID                                          **Context
+  );
+
+/**
+  Makes progress on a start begun by Begin(). It must not stall for the
+  controller, and is called again as long as it returns EFI_NOT_READY.
+  The driver releases Context when it returns any other status.
+
+  @param[in]  This                 The protocol instance.
+  @param[in]  ControllerHandle     The handle of the controller being started.
+  @param[in]  Context              The context returned by Begin().
+
+  @retval EFI_NOT_READY            The controller is not ready yet.
+  @retval Others                   The start completed, with the status that
+                                   Start() would have returned.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_DRIVER_BINDING_DEFERRED_START_POLL)(
+  IN EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL  *This,
+  IN EFI_HANDLE                                    ControllerHandle,
+  IN VOID                                          *Context
+  );
+
+struct _EDKII_DRIVER_BINDING_DEFERRED_START_PROTOCOL {
+  EDKII_DRIVER_BINDING_DEFERRED_START_BEGIN    Begin;
+  EDKII_DRIVER_BINDING_DEFERRED_START_POLL     Poll;
+};
+
+extern EFI_GUID  gEdkiiDriverBindingDeferredStartProtocolGuid;
+
+#endif
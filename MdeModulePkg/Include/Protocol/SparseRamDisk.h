@@ -0,0 +1,163 @@
+/** @file
+  EDKII Sparse RAM Disk Protocol.
+
+  The protocol registers RAM disks whose storage is not a contiguous range of
+  memory supplied by the caller. The RAM disk driver allocates the storage in
+  chunks on first write. Chunks that were never written are either read as
+  zeros or obtained on demand from a caller-provided chunk source, which lets
+  a RAM disk be served from a compressed image or from an image that is still
+  being downloaded.
+
+  A sparse RAM disk is not a range of memory, so its device path ends with a
+  vendor-defined media node, EDKII_SPARSE_RAM_DISK_DEVICE_PATH, instead of a
+  RAM disk node. RAM disks registered by this protocol are unregistered
+  through EFI_RAM_DISK_PROTOCOL.Unregister() with that device path.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __EDKII_SPARSE_RAM_DISK_PROTOCOL_H__
+#define __EDKII_SPARSE_RAM_DISK_PROTOCOL_H__
+
+#include <Protocol/DevicePath.h>
+
+#define EDKII_SPARSE_RAM_DISK_PROTOCOL_GUID \
+  { \
+    0xdefc7002, 0xf5c2, 0x4996, { 0xb7, 0x96, 0xd4, 0xc0, 0x15, 0x70, 0xe6, 0xd7 } \
+  }
+
+#define EDKII_SPARSE_RAM_DISK_DEVICE_PATH_GUID \
+  { \
+    0x6545d036, 0xac1f, 0x4ed8, { 0xb0, 0x1e, 0x28, 0xb7, 0x92, 0x98, 0x21, 0xdc } \
+  }
+
+#pragma pack(1)
+
+///
+/// The last node of the device path of a sparse RAM disk. Header.Header.Type
+/// is MEDIA_DEVICE_PATH, Header.Header.SubType is MEDIA_VENDOR_DP and
+/// Header.Guid is EDKII_SPARSE_RAM_DISK_DEVICE_PATH_GUID.
+///
+typedef struct {
+  VENDOR_DEVICE_PATH    Header;
+  ///
+  /// The size of the RAM disk in bytes.
+  ///
+  UINT64                Size;
+  ///
+  /// The type of the RAM disk, as in MEDIA_RAM_DISK_DEVICE_PATH.
+  ///
+  EFI_GUID              TypeGuid;
+  ///
+  /// A number that identifies the RAM disk among the sparse RAM disks
+  /// registered since boot.
+  ///
+  UINT32                Id;
+} EDKII_SPARSE_RAM_DISK_DEVICE_PATH;
+
+#pragma pack()
+
+typedef struct _EDKII_RAM_DISK_CHUNK_SOURCE     EDKII_RAM_DISK_CHUNK_SOURCE;
+typedef struct _EDKII_SPARSE_RAM_DISK_PROTOCOL  EDKII_SPARSE_RAM_DISK_PROTOCOL;
+
+/**
+  Produce the content of one chunk of a sparse RAM disk.
+
+  The RAM disk driver calls this function at TPL_CALLBACK when a chunk that
+  has never been written is read, or is partially written. If the content of
+  the chunk is not available yet, the function returns EFI_NOT_READY and the
+  RAM disk driver calls it again after a short delay. A source that depends
+  on a transport, such as a network download, should make progress on the
+  transport within each call, because timer events at TPL_CALLBACK are not
+  dispatched while the RAM disk driver waits.
+
+  @param[in]  This           A pointer to the EDKII_RAM_DISK_CHUNK_SOURCE
+                             instance.
+  @param[in]  ChunkIndex     The index of the chunk. The chunk covers the
+                             bytes from ChunkIndex * ChunkSize of the RAM disk.
+  @param[out] Buffer         The buffer of ChunkSize bytes to receive the
+                             chunk content. For the last chunk of the RAM
+                             disk, bytes beyond the end of the RAM disk are
+                             ignored.
+
+  @retval EFI_SUCCESS             The chunk content is returned in Buffer.
+  @retval EFI_NOT_FOUND           The chunk contains only zeros. Buffer is not
+                                  touched.
+  @retval EFI_NOT_READY           The chunk content is not available yet.
+  @retval Others                  The chunk content cannot be produced.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_RAM_DISK_READ_CHUNK)(
+  IN  EDKII_RAM_DISK_CHUNK_SOURCE  *This,
+  IN  UINT64                       ChunkIndex,
+  OUT VOID                         *Buffer
+  );
+
+///
+/// The producer of the initial content of a sparse RAM disk.
+///
+struct _EDKII_RAM_DISK_CHUNK_SOURCE {
+  ///
+  /// The size in bytes of a chunk. It must be a power of two and not smaller
+  /// than 512.
+  ///
+  UINT32                       ChunkSize;
+  EDKII_RAM_DISK_READ_CHUNK    ReadChunk;
+};
+
+/**
+  Register a sparse RAM disk with specified size and type.
+
+  @param[in]  RamDiskSize    The size of registered RAM disk.
+  @param[in]  RamDiskType    The type of registered RAM disk. The GUID can be
+                             any of the values defined in section 9.3.6.9, or a
+                             vendor defined GUID.
+  @param[in]  Source         The producer of the initial content of the RAM
+                             disk. If Source is NULL, the RAM disk initially
+                             reads as zeros. The caller must keep Source valid
+                             until the RAM disk is unregistered.
+  @param[in]  ParentDevicePath
+                             Pointer to the parent device path. If there is no
+                             parent device path then ParentDevicePath is NULL.
+  @param[out] DevicePath     On return, points to a pointer to the device path
+                             of the RAM disk device, which ends with an
+                             EDKII_SPARSE_RAM_DISK_DEVICE_PATH node. The
+                             buffer is allocated with the boot service
+                             AllocatePool().
+
+  @retval EFI_SUCCESS             The RAM disk is registered successfully.
+  @retval EFI_INVALID_PARAMETER   DevicePath or RamDiskType is NULL.
+                                  RamDiskSize is 0.
+                                  The ChunkSize or ReadChunk of Source is not
+                                  valid.
+  @retval EFI_ALREADY_STARTED     A Device Path Protocol instance to be created
+                                  is already present in the handle database.
+  @retval EFI_OUT_OF_RESOURCES    The RAM disk register operation fails due to
+                                  resource limitation.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_SPARSE_RAM_DISK_REGISTER)(
+  IN UINT64                       RamDiskSize,
+  IN EFI_GUID                     *RamDiskType,
+  IN EDKII_RAM_DISK_CHUNK_SOURCE  *Source            OPTIONAL,
+  IN EFI_DEVICE_PATH              *ParentDevicePath  OPTIONAL,
+  OUT EFI_DEVICE_PATH_PROTOCOL    **DevicePath
+  );
+
+///
+/// EDKII_SPARSE_RAM_DISK_PROTOCOL registers RAM disks whose storage is
+/// allocated by the RAM disk driver on demand.
+///
+struct _EDKII_SPARSE_RAM_DISK_PROTOCOL {
+  EDKII_SPARSE_RAM_DISK_REGISTER    Register;
+};
+
+extern EFI_GUID  gEdkiiSparseRamDiskProtocolGuid;
+extern EFI_GUID  gEdkiiSparseRamDiskDevicePathGuid;
+
+#endif
@@ -45,6 +45,9 @@ DISK_IO_PRIVATE_DATA  gDiskIoPrivateDataTemplate = {
     DiskIo2ReadDiskEx,
     DiskIo2WriteDiskEx,
     DiskIo2FlushDiskEx
+  },
+  {
+    DiskIoGetBlockCacheStatistics
   }
 };
 
@@ -186,6 +189,12 @@ DiskIoDriverBindingStart (
     goto ErrorExit;
   }
 
+  //
+  // The block cache is optional, the device is accessed without it when it
+  // cannot be allocated.
+  //
+  Instance->BlockCache = DiskIoCreateBlockCache (Instance->BlockIo->Media, PcdGet32 (PcdDiskIoBlockCacheSize));
+
   //
   // Install protocol interfaces for the Disk IO device.
   //
@@ -207,6 +216,18 @@ DiskIoDriverBindingStart (
                     );
   }
 
+  if (!EFI_ERROR (Status) && (Instance->BlockCache != NULL)) {
+    //
+    // The statistics are informational, the device is accessed without them
+    //
+    gBS->InstallProtocolInterface (
+           &ControllerHandle,
+           &gEdkiiDiskIoBlockCacheStatisticsProtocolGuid,
+           EFI_NATIVE_INTERFACE,
+           &Instance->BlockCacheStatistics
+           );
+  }
+
 ErrorExit:
   if (EFI_ERROR (Status)) {
     if ((Instance != NULL) && (Instance->SharedWorkingBuffer != NULL)) {
@@ -216,6 +237,10 @@ ErrorExit:
         );
     }
 
+    if ((Instance != NULL) && (Instance->BlockCache != NULL)) {
+      DiskIoFreeBlockCache (Instance->BlockCache);
+    }
+
     if (Instance != NULL) {
       FreePool (Instance);
     }
@@ -330,6 +355,15 @@ DiskIoDriverBindingStop (
       EFI_SIZE_TO_PAGES (PcdGet32 (PcdDiskIoDataBufferBlockNum) * Instance->BlockIo->Media->BlockSize)
       );
 
+    if (Instance->BlockCache != NULL) {
+      gBS->UninstallProtocolInterface (
+             ControllerHandle,
+             &gEdkiiDiskIoBlockCacheStatisticsProtocolGuid,
+             &Instance->BlockCacheStatistics
+             );
+      DiskIoFreeBlockCache (Instance->BlockCache);
+    }
+
     Status = gBS->CloseProtocol (
                     ControllerHandle,
                     &gEfiBlockIoProtocolGuid,
@@ -353,6 +387,28 @@ DiskIoDriverBindingStop (
   return Status;
 }
 
+/**
+  Get the number of bytes a subtask transfers from or to the device.
+
+  @param Subtask      Subtask.
+  @param BlockSize    The block size of the device.
+
+  @return The size of the blocks that hold the data of the subtask.
+**/
+STATIC
+UINTN
+DiskIoSubtaskTransferSize (
+  IN DISK_IO_SUBTASK  *Subtask,
+  IN UINT32           BlockSize
+  )
+{
+  if (Subtask->Length == 0) {
+    return 0;
+  }
+
+  return ALIGN_VALUE (Subtask->Offset + Subtask->Length, BlockSize);
+}
+
 /**
   Destroy the sub task.
 
@@ -382,9 +438,7 @@ DiskIoDestroySubtask (
     if (Subtask->WorkingBuffer != NULL) {
       FreeAlignedPages (
         Subtask->WorkingBuffer,
-        Subtask->Length < Instance->BlockIo->Media->BlockSize
-        ? EFI_SIZE_TO_PAGES (Instance->BlockIo->Media->BlockSize)
-        : EFI_SIZE_TO_PAGES (Subtask->Length)
+        EFI_SIZE_TO_PAGES (DiskIoSubtaskTransferSize (Subtask, Instance->BlockIo->Media->BlockSize))
         );
     }
 
@@ -425,6 +479,10 @@ DiskIo2OnReadWriteComplete (
   ASSERT (Instance->Signature == DISK_IO_PRIVATE_DATA_SIGNATURE);
   ASSERT (Task->Signature     == DISK_IO2_TASK_SIGNATURE);
 
+  if (Subtask->Write && (Instance->BlockCache != NULL)) {
+    DiskIoBlockCacheUpdatePendingWrites (Instance->BlockCache, FALSE);
+  }
+
   if ((Subtask->WorkingBuffer != NULL) && !EFI_ERROR (TransactionStatus) &&
       (Task->Token != NULL) && !Subtask->Write
       )
@@ -555,6 +613,7 @@ DiskIoCreateSubtaskList (
   UINT8            *BufferPtr;
   UINTN            Length;
   UINTN            DataBufferSize;
+  UINT64           BlockCount;
   DISK_IO_SUBTASK  *Subtask;
   VOID             *WorkingBuffer;
   LIST_ENTRY       *Link;
@@ -583,6 +642,35 @@ DiskIoCreateSubtaskList (
     return TRUE;
   }
 
+  //
+  // Merge the UnderRun, Middle and OverRun parts of a short unaligned read
+  // into one transfer through a working buffer, instead of up to three.
+  //
+  BlockCount = DivU64x32 (UnderRun + BufferSize + BlockSize - 1, BlockSize);
+  if (!Write && ((UnderRun != 0) || ((BufferSize % BlockSize) != 0)) &&
+      (BlockCount > 1) && (BlockCount <= PcdGet32 (PcdDiskIoDataBufferBlockNum)))
+  {
+    if (Blocking) {
+      WorkingBuffer = SharedWorkingBuffer;
+    } else {
+      WorkingBuffer = AllocateAlignedPages (EFI_SIZE_TO_PAGES ((UINTN)BlockCount * BlockSize), IoAlign);
+    }
+
+    if (WorkingBuffer != NULL) {
+      Subtask = DiskIoCreateSubtask (FALSE, Lba, UnderRun, BufferSize, WorkingBuffer, BufferPtr, Blocking);
+      if (Subtask == NULL) {
+        if (!Blocking) {
+          FreeAlignedPages (WorkingBuffer, EFI_SIZE_TO_PAGES ((UINTN)BlockCount * BlockSize));
+        }
+
+        goto Done;
+      }
+
+      InsertTailList (Subtasks, &Subtask->Link);
+      return TRUE;
+    }
+  }
+
   if (UnderRun != 0) {
     Length = MIN (BlockSize - UnderRun, BufferSize);
     if (Blocking) {
@@ -850,6 +938,11 @@ DiskIo2ReadWriteDisk (
   BOOLEAN                 Blocking;
   BOOLEAN                 SubtaskBlocking;
   LIST_ENTRY              *SubtasksPtr;
+  DISK_IO_BLOCK_CACHE     *Cache;
+  BOOLEAN                 CacheUsable;
+  BOOLEAN                 CacheFill;
+  UINTN                   TransferSize;
+  UINT8                   *TransferBuffer;
 
   Task     = NULL;
   BlockIo  = Instance->BlockIo;
@@ -857,6 +950,32 @@ DiskIo2ReadWriteDisk (
   Media    = BlockIo->Media;
   Status   = EFI_SUCCESS;
   Blocking = (BOOLEAN)((Token == NULL) || (Token->Event == NULL));
+  Cache    = Instance->BlockCache;
+
+  CacheUsable = FALSE;
+  if (Cache != NULL) {
+    OldTpl      = gBS->RaiseTPL (TPL_CALLBACK);
+    CacheUsable = (BOOLEAN)(DiskIoBlockCacheCheckMedia (Cache, Media) && (MediaId == Media->MediaId));
+    if (Write) {
+      //
+      // Count the write as pending before its blocks are dropped, and drop
+      // them before it is submitted, so that no read returns them or fills
+      // them again from the device until it completes
+      //
+      DiskIoBlockCacheUpdatePendingWrites (Cache, TRUE);
+      DiskIoBlockCacheInvalidate (Cache, Offset, BufferSize);
+    } else if (CacheUsable && DiskIoBlockCacheRead (Cache, Offset, BufferSize, Buffer)) {
+      gBS->RestoreTPL (OldTpl);
+      if (!Blocking) {
+        Token->TransactionStatus = EFI_SUCCESS;
+        gBS->SignalEvent (Token->Event);
+      }
+
+      return EFI_SUCCESS;
+    }
+
+    gBS->RestoreTPL (OldTpl);
+  }
 
   if (Blocking) {
     //
@@ -870,6 +989,10 @@ DiskIo2ReadWriteDisk (
     DiskIo2RemoveCompletedTask (Instance);
     Task = AllocatePool (sizeof (DISK_IO2_TASK));
     if (Task == NULL) {
+      if (Write && (Cache != NULL)) {
+        DiskIoBlockCacheUpdatePendingWrites (Cache, FALSE);
+      }
+
       return EFI_OUT_OF_RESOURCES;
     }
 
@@ -891,6 +1014,10 @@ DiskIo2ReadWriteDisk (
       FreePool (Task);
     }
 
+    if (Write && (Cache != NULL)) {
+      DiskIoBlockCacheUpdatePendingWrites (Cache, FALSE);
+    }
+
     return EFI_OUT_OF_RESOURCES;
   }
 
@@ -905,8 +1032,11 @@ DiskIo2ReadWriteDisk (
     Subtask         = CR (Link, DISK_IO_SUBTASK, Link, DISK_IO_SUBTASK_SIGNATURE);
     Subtask->Task   = Task;
     SubtaskBlocking = Subtask->Blocking;
+    TransferSize    = DiskIoSubtaskTransferSize (Subtask, Media->BlockSize);
+    TransferBuffer  = (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer;
 
-    ASSERT ((Subtask->Length % Media->BlockSize == 0) || (Subtask->Length < Media->BlockSize));
+    ASSERT ((Subtask->Offset == 0) || (Subtask->WorkingBuffer != NULL) || (Subtask->Length == 0));
+    ASSERT ((Subtask->WorkingBuffer != NULL) || (Subtask->Length % Media->BlockSize == 0));
 
     if (Subtask->Write) {
       //
@@ -924,31 +1054,56 @@ DiskIo2ReadWriteDisk (
                             BlockIo,
                             MediaId,
                             Subtask->Lba,
-                            (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
-                            (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
+                            TransferSize,
+                            TransferBuffer
                             );
       } else {
+        //
+        // The reads do not fill the block cache while the write is in flight
+        //
+        if (Cache != NULL) {
+          DiskIoBlockCacheUpdatePendingWrites (Cache, TRUE);
+        }
+
         Status = BlockIo2->WriteBlocksEx (
                              BlockIo2,
                              MediaId,
                              Subtask->Lba,
                              &Subtask->BlockIo2Token,
-                             (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
-                             (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
+                             TransferSize,
+                             TransferBuffer
                              );
+        if (EFI_ERROR (Status) && (Cache != NULL)) {
+          DiskIoBlockCacheUpdatePendingWrites (Cache, FALSE);
+        }
       }
     } else {
       //
       // Read
       //
+      if ((Cache != NULL) && (TransferSize > Media->BlockSize) && (Subtask->WorkingBuffer != NULL)) {
+        Cache->MergedReads++;
+      }
+
       if (SubtaskBlocking) {
-        Status = BlockIo->ReadBlocks (
-                            BlockIo,
-                            MediaId,
-                            Subtask->Lba,
-                            (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
-                            (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
-                            );
+        //
+        // Only the blocks of read requests fill the block cache, the reads of a
+        // read-modify-write return the blocks before the write. No write may be
+        // in flight during the read, and none is submitted before it completes
+        // at TPL_CALLBACK.
+        //
+        CacheFill = (BOOLEAN)(CacheUsable && !Write && (Cache->PendingWrites == 0));
+        Status    = BlockIo->ReadBlocks (
+                               BlockIo,
+                               MediaId,
+                               Subtask->Lba,
+                               TransferSize,
+                               TransferBuffer
+                               );
+        if (!EFI_ERROR (Status) && CacheFill) {
+          DiskIoBlockCacheFill (Cache, Subtask->Lba, TransferSize, TransferBuffer);
+        }
+
         if (!EFI_ERROR (Status) && (Subtask->WorkingBuffer != NULL)) {
           CopyMem (Subtask->Buffer, Subtask->WorkingBuffer + Subtask->Offset, Subtask->Length);
         }
@@ -958,8 +1113,8 @@ DiskIo2ReadWriteDisk (
                              MediaId,
                              Subtask->Lba,
                              &Subtask->BlockIo2Token,
-                             (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
-                             (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
+                             TransferSize,
+                             TransferBuffer
                              );
       }
     }
@@ -979,6 +1134,14 @@ DiskIo2ReadWriteDisk (
 
   gBS->RaiseTPL (TPL_NOTIFY);
 
+  //
+  // The non-blocking subtasks of the write hold their own counts until they
+  // complete
+  //
+  if (Write && (Cache != NULL)) {
+    DiskIoBlockCacheUpdatePendingWrites (Cache, FALSE);
+  }
+
   //
   // Remove all the remaining subtasks when failure.
   // We shouldn't remove all the tasks because the non-blocking requests have been submitted and cannot be canceled.
@@ -16,6 +16,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Protocol/ComponentName.h>
 #include <Protocol/DriverBinding.h>
 #include <Protocol/DiskIo.h>
+#include <Protocol/DiskIoBlockCacheStatistics.h>
 #include <Library/DebugLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/UefiLib.h>
@@ -24,22 +25,70 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 
+//
+// Reads larger than this are not kept in the block cache, so that bulk file
+// reads do not evict the file system metadata.
+//
+#define DISK_IO_CACHE_MAX_FILL_SIZE  SIZE_64KB
+
+typedef struct _DISK_IO_CACHE_BLOCK DISK_IO_CACHE_BLOCK;
+
+struct _DISK_IO_CACHE_BLOCK {
+  LIST_ENTRY             LruLink;         ///< Linked in LruList, most recently used first
+  DISK_IO_CACHE_BLOCK    *HashNext;       ///< Next block of the same hash bucket
+  UINT64                 Lba;
+  BOOLEAN                Valid;
+  UINT8                  *Data;
+};
+
+typedef struct {
+  UINT32                 BlockSize;
+  UINT32                 MediaId;
+  UINT32                 BlockCount;      ///< Number of blocks the cache holds
+  UINT32                 BucketCount;     ///< Number of hash buckets, a power of 2
+  DISK_IO_CACHE_BLOCK    *Blocks;
+  DISK_IO_CACHE_BLOCK    **Buckets;
+  UINT8                  *Data;           ///< BlockCount blocks of BlockSize bytes
+  LIST_ENTRY             LruList;         ///< All the blocks, the invalid ones at the tail
+  //
+  // Number of write requests being processed, plus the number of their
+  // non-blocking subtasks in flight. Reads do not fill the cache while a
+  // write may change the blocks they return. Updated at TPL_NOTIFY, since
+  // the subtasks complete at that level.
+  //
+  UINTN                  PendingWrites;
+  //
+  // Counters, returned by EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL
+  //
+  UINT64                 Hits;            ///< Reads served from the cache
+  UINT64                 Misses;          ///< Reads that went to the device
+  UINT64                 Fills;           ///< Blocks copied into the cache
+  UINT64                 Invalidations;   ///< Blocks dropped by writes
+  UINT64                 Flushes;         ///< Media changes that emptied the cache
+  UINT64                 MergedReads;     ///< Unaligned reads done with one transfer
+} DISK_IO_BLOCK_CACHE;
+
 #define DISK_IO_PRIVATE_DATA_SIGNATURE  SIGNATURE_32 ('d', 's', 'k', 'I')
 typedef struct {
-  UINT32                    Signature;
+  UINT32                                           Signature;
 
-  EFI_DISK_IO_PROTOCOL      DiskIo;
-  EFI_DISK_IO2_PROTOCOL     DiskIo2;
-  EFI_BLOCK_IO_PROTOCOL     *BlockIo;
-  EFI_BLOCK_IO2_PROTOCOL    *BlockIo2;
+  EFI_DISK_IO_PROTOCOL                             DiskIo;
+  EFI_DISK_IO2_PROTOCOL                            DiskIo2;
+  EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL    BlockCacheStatistics; ///< Installed when BlockCache is not NULL
+  EFI_BLOCK_IO_PROTOCOL                            *BlockIo;
+  EFI_BLOCK_IO2_PROTOCOL                           *BlockIo2;
 
-  UINT8                     *SharedWorkingBuffer;
+  UINT8                                            *SharedWorkingBuffer;
 
-  EFI_LOCK                  TaskQueueLock;
-  LIST_ENTRY                TaskQueue;
+  EFI_LOCK                                         TaskQueueLock;
+  LIST_ENTRY                                       TaskQueue;
+
+  DISK_IO_BLOCK_CACHE                              *BlockCache;          ///< NULL when the block cache is disabled
 } DISK_IO_PRIVATE_DATA;
 #define DISK_IO_PRIVATE_DATA_FROM_DISK_IO(a)   CR (a, DISK_IO_PRIVATE_DATA, DiskIo,  DISK_IO_PRIVATE_DATA_SIGNATURE)
 #define DISK_IO_PRIVATE_DATA_FROM_DISK_IO2(a)  CR (a, DISK_IO_PRIVATE_DATA, DiskIo2, DISK_IO_PRIVATE_DATA_SIGNATURE)
+#define DISK_IO_PRIVATE_DATA_FROM_BLOCK_CACHE_STATISTICS(a) \
+  CR (a, DISK_IO_PRIVATE_DATA, BlockCacheStatistics, DISK_IO_PRIVATE_DATA_SIGNATURE)
 
 #define DISK_IO2_TASK_SIGNATURE  SIGNATURE_32 ('d', 'i', 'a', 't')
 typedef struct {
@@ -82,6 +131,136 @@ typedef struct {
   EFI_BLOCK_IO2_TOKEN    BlockIo2Token;
 } DISK_IO_SUBTASK;
 
+//
+// Block cache, accessed at TPL_CALLBACK
+//
+
+/**
+  Create the block cache of a device.
+
+  The cache is only created for devices that are not logical partitions: the
+  partitions read and write the disk through its Disk I/O protocol, so that
+  one cache of the disk serves all of them and is invalidated by their writes.
+
+  @param Media      The media of the device.
+  @param CacheSize  The size of the cache in bytes, 0 disables it.
+
+  @return The block cache, or NULL if the device is not cached.
+**/
+DISK_IO_BLOCK_CACHE *
+DiskIoCreateBlockCache (
+  IN EFI_BLOCK_IO_MEDIA  *Media,
+  IN UINT32              CacheSize
+  );
+
+/**
+  Free the block cache of a device, and report its counters.
+
+  @param Cache  The block cache.
+**/
+VOID
+DiskIoFreeBlockCache (
+  IN DISK_IO_BLOCK_CACHE  *Cache
+  );
+
+/**
+  Empty the block cache if the media of the device changed since the
+  blocks were read.
+
+  @param Cache  The block cache.
+  @param Media  The media of the device.
+
+  @retval TRUE   The media is present, the cache can be used.
+  @retval FALSE  There is no media in the device.
+**/
+BOOLEAN
+DiskIoBlockCacheCheckMedia (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN EFI_BLOCK_IO_MEDIA   *Media
+  );
+
+/**
+  Read bytes from the block cache, if all the blocks they span are cached.
+
+  @param Cache       The block cache.
+  @param Offset      The starting byte offset on the device.
+  @param BufferSize  The number of bytes to read.
+  @param Buffer      The buffer to receive the data.
+
+  @retval TRUE   The data was read from the cache.
+  @retval FALSE  At least one of the blocks is not cached, Buffer is not changed.
+**/
+BOOLEAN
+DiskIoBlockCacheRead (
+  IN  DISK_IO_BLOCK_CACHE  *Cache,
+  IN  UINT64               Offset,
+  IN  UINTN                BufferSize,
+  OUT UINT8                *Buffer
+  );
+
+/**
+  Copy blocks read from the device into the block cache.
+
+  No write may have been in flight while the blocks were read, the caller
+  checks PendingWrites before the read.
+
+  @param Cache       The block cache.
+  @param Lba         The first block read.
+  @param BufferSize  The number of bytes read, a multiple of the block size.
+  @param Buffer      The data read.
+**/
+VOID
+DiskIoBlockCacheFill (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN UINT64               Lba,
+  IN UINTN                BufferSize,
+  IN UINT8                *Buffer
+  );
+
+/**
+  Drop the cached blocks that a write changes.
+
+  @param Cache       The block cache.
+  @param Offset      The starting byte offset on the device.
+  @param BufferSize  The number of bytes written.
+**/
+VOID
+DiskIoBlockCacheInvalidate (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN UINT64               Offset,
+  IN UINTN                BufferSize
+  );
+
+/**
+  Count a write that starts or ends in PendingWrites, at TPL_NOTIFY.
+
+  @param Cache    The block cache.
+  @param Pending  TRUE when the write starts, FALSE when it ends.
+**/
+VOID
+DiskIoBlockCacheUpdatePendingWrites (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN BOOLEAN              Pending
+  );
+
+/**
+  Return the statistics of the block cache of a device.
+
+  @param[in]  This        A pointer to the
+                          EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL
+                          instance.
+  @param[out] Statistics  A pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS             The statistics are returned.
+  @retval EFI_INVALID_PARAMETER   Statistics is NULL.
+**/
+EFI_STATUS
+EFIAPI
+DiskIoGetBlockCacheStatistics (
+  IN  EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_DISK_IO_BLOCK_CACHE_STATISTICS           *Statistics
+  );
+
 //
 // Global Variables
 //
@@ -0,0 +1,472 @@
+/** @file
+  Block cache of the DiskIo driver.
+
+  The cache keeps the blocks that blocking reads returned, so that the
+  partition drivers, the file systems and the boot manager do not read the
+  same partition tables, superblocks and directories from the device again.
+  The least recently used block is replaced. Writes drop the blocks they
+  change, and a new MediaId empties the cache.
+
+  The cache is only accessed at TPL_CALLBACK, where the DiskIo requests are
+  submitted, so that it needs no lock.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "DiskIo.h"
+
+/**
+  Get the hash bucket of a block.
+
+  @param Cache  The block cache.
+  @param Lba    The block.
+
+  @return The pointer to the first block of the bucket.
+**/
+STATIC
+DISK_IO_CACHE_BLOCK **
+DiskIoBlockCacheBucket (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN UINT64               Lba
+  )
+{
+  //
+  // Spread the neighbouring blocks over the buckets, with the golden ratio
+  //
+  return &Cache->Buckets[(UINTN)RShiftU64 (MultU64x64 (Lba, 0x9E3779B97F4A7C15ULL), 32) & (Cache->BucketCount - 1)];
+}
+
+/**
+  Find a block in the cache.
+
+  @param Cache  The block cache.
+  @param Lba    The block to find.
+
+  @return The cached block, or NULL if it is not cached.
+**/
+STATIC
+DISK_IO_CACHE_BLOCK *
+DiskIoBlockCacheLookup (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN UINT64               Lba
+  )
+{
+  DISK_IO_CACHE_BLOCK  *Block;
+
+  for (Block = *DiskIoBlockCacheBucket (Cache, Lba); Block != NULL; Block = Block->HashNext) {
+    if (Block->Lba == Lba) {
+      return Block;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Drop a block from the cache, and make it the first to be replaced.
+
+  @param Cache  The block cache.
+  @param Block  The cached block.
+**/
+STATIC
+VOID
+DiskIoBlockCacheDrop (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN DISK_IO_CACHE_BLOCK  *Block
+  )
+{
+  DISK_IO_CACHE_BLOCK  **Previous;
+
+  ASSERT (Block->Valid);
+  for (Previous = DiskIoBlockCacheBucket (Cache, Block->Lba); *Previous != Block; Previous = &(*Previous)->HashNext) {
+    ASSERT (*Previous != NULL);
+  }
+
+  *Previous    = Block->HashNext;
+  Block->Valid = FALSE;
+  RemoveEntryList (&Block->LruLink);
+  InsertTailList (&Cache->LruList, &Block->LruLink);
+}
+
+/**
+  Create the block cache of a device.
+
+  The cache is only created for devices that are not logical partitions: the
+  partitions read and write the disk through its Disk I/O protocol, so that
+  one cache of the disk serves all of them and is invalidated by their writes.
+
+  @param Media      The media of the device.
+  @param CacheSize  The size of the cache in bytes, 0 disables it.
+
+  @return The block cache, or NULL if the device is not cached.
+**/
+DISK_IO_BLOCK_CACHE *
+DiskIoCreateBlockCache (
+  IN EFI_BLOCK_IO_MEDIA  *Media,
+  IN UINT32              CacheSize
+  )
+{
+  DISK_IO_BLOCK_CACHE  *Cache;
+  UINT32               BlockCount;
+  UINT32               Index;
+
+  if ((CacheSize == 0) || Media->LogicalPartition || (Media->BlockSize == 0)) {
+    return NULL;
+  }
+
+  BlockCount = CacheSize / Media->BlockSize;
+  if (BlockCount == 0) {
+    return NULL;
+  }
+
+  Cache = AllocateZeroPool (sizeof (DISK_IO_BLOCK_CACHE));
+  if (Cache == NULL) {
+    return NULL;
+  }
+
+  Cache->BlockSize   = Media->BlockSize;
+  Cache->MediaId     = Media->MediaId;
+  Cache->BlockCount  = BlockCount;
+  Cache->BucketCount = (UINT32)GetPowerOfTwo32 (BlockCount);
+  if (Cache->BucketCount < BlockCount) {
+    Cache->BucketCount <<= 1;
+  }
+
+  Cache->Blocks  = AllocateZeroPool (BlockCount * sizeof (DISK_IO_CACHE_BLOCK));
+  Cache->Buckets = AllocateZeroPool (Cache->BucketCount * sizeof (DISK_IO_CACHE_BLOCK *));
+  Cache->Data    = AllocatePool (BlockCount * Media->BlockSize);
+  if ((Cache->Blocks == NULL) || (Cache->Buckets == NULL) || (Cache->Data == NULL)) {
+    DiskIoFreeBlockCache (Cache);
+    return NULL;
+  }
+
+  InitializeListHead (&Cache->LruList);
+  for (Index = 0; Index < BlockCount; Index++) {
+    Cache->Blocks[Index].Data = Cache->Data + Index * Media->BlockSize;
+    InsertTailList (&Cache->LruList, &Cache->Blocks[Index].LruLink);
+  }
+
+  return Cache;
+}
+
+/**
+  Free the block cache of a device, and report its counters.
+
+  @param Cache  The block cache.
+**/
+VOID
+DiskIoFreeBlockCache (
+  IN DISK_IO_BLOCK_CACHE  *Cache
+  )
+{
+  DEBUG ((
+    DEBUG_INFO,
+    "DiskIo: Block cache hits/misses/fills/invalidations/flushes/merged reads = %ld/%ld/%ld/%ld/%ld/%ld\n",
+    Cache->Hits,
+    Cache->Misses,
+    Cache->Fills,
+    Cache->Invalidations,
+    Cache->Flushes,
+    Cache->MergedReads
+    ));
+
+  if (Cache->Blocks != NULL) {
+    FreePool (Cache->Blocks);
+  }
+
+  if (Cache->Buckets != NULL) {
+    FreePool (Cache->Buckets);
+  }
+
+  if (Cache->Data != NULL) {
+    FreePool (Cache->Data);
+  }
+
+  FreePool (Cache);
+}
+
+/**
+  Empty the block cache if the media of the device changed since the
+  blocks were read.
+
+  @param Cache  The block cache.
+  @param Media  The media of the device.
+
+  @retval TRUE   The media is present, the cache can be used.
+  @retval FALSE  There is no media in the device.
+**/
+BOOLEAN
+DiskIoBlockCacheCheckMedia (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN EFI_BLOCK_IO_MEDIA   *Media
+  )
+{
+  LIST_ENTRY           *Link;
+  DISK_IO_CACHE_BLOCK  *Block;
+
+  if (Media->MediaPresent && (Cache->MediaId == Media->MediaId)) {
+    //
+    // The cached blocks do not fit a new block size, the cache is not used
+    //
+    return (BOOLEAN)(Cache->BlockSize == Media->BlockSize);
+  }
+
+  //
+  // The valid blocks are at the head of the LRU list
+  //
+  Link = GetFirstNode (&Cache->LruList);
+  if (BASE_CR (Link, DISK_IO_CACHE_BLOCK, LruLink)->Valid) {
+    for ( ; !IsNull (&Cache->LruList, Link); Link = GetNextNode (&Cache->LruList, Link)) {
+      Block = BASE_CR (Link, DISK_IO_CACHE_BLOCK, LruLink);
+      if (!Block->Valid) {
+        break;
+      }
+
+      Block->Valid = FALSE;
+    }
+
+    ZeroMem (Cache->Buckets, Cache->BucketCount * sizeof (DISK_IO_CACHE_BLOCK *));
+    Cache->Flushes++;
+  }
+
+  if (!Media->MediaPresent) {
+    return FALSE;
+  }
+
+  Cache->MediaId = Media->MediaId;
+  return (BOOLEAN)(Cache->BlockSize == Media->BlockSize);
+}
+
+/**
+  Read bytes from the block cache, if all the blocks they span are cached.
+
+  @param Cache       The block cache.
+  @param Offset      The starting byte offset on the device.
+  @param BufferSize  The number of bytes to read.
+  @param Buffer      The buffer to receive the data.
+
+  @retval TRUE   The data was read from the cache.
+  @retval FALSE  At least one of the blocks is not cached, Buffer is not changed.
+**/
+BOOLEAN
+DiskIoBlockCacheRead (
+  IN  DISK_IO_BLOCK_CACHE  *Cache,
+  IN  UINT64               Offset,
+  IN  UINTN                BufferSize,
+  OUT UINT8                *Buffer
+  )
+{
+  UINT64               Lba;
+  UINT64               LastLba;
+  UINT32               BlockOffset;
+  UINTN                Length;
+  DISK_IO_CACHE_BLOCK  *Block;
+
+  if ((BufferSize == 0) || (BufferSize > DISK_IO_CACHE_MAX_FILL_SIZE)) {
+    return FALSE;
+  }
+
+  Lba     = DivU64x32 (Offset, Cache->BlockSize);
+  LastLba = DivU64x32 (Offset + BufferSize - 1, Cache->BlockSize);
+  for ( ; Lba <= LastLba; Lba++) {
+    if (DiskIoBlockCacheLookup (Cache, Lba) == NULL) {
+      Cache->Misses++;
+      return FALSE;
+    }
+  }
+
+  Lba = DivU64x32Remainder (Offset, Cache->BlockSize, &BlockOffset);
+  for ( ; BufferSize != 0; Lba++) {
+    Block  = DiskIoBlockCacheLookup (Cache, Lba);
+    Length = MIN (BufferSize, Cache->BlockSize - BlockOffset);
+    CopyMem (Buffer, Block->Data + BlockOffset, Length);
+    RemoveEntryList (&Block->LruLink);
+    InsertHeadList (&Cache->LruList, &Block->LruLink);
+
+    Buffer     += Length;
+    BufferSize -= Length;
+    BlockOffset = 0;
+  }
+
+  Cache->Hits++;
+  return TRUE;
+}
+
+/**
+  Copy blocks read from the device into the block cache.
+
+  No write may have been in flight while the blocks were read, the caller
+  checks PendingWrites before the read.
+
+  @param Cache       The block cache.
+  @param Lba         The first block read.
+  @param BufferSize  The number of bytes read, a multiple of the block size.
+  @param Buffer      The data read.
+**/
+VOID
+DiskIoBlockCacheFill (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN UINT64               Lba,
+  IN UINTN                BufferSize,
+  IN UINT8                *Buffer
+  )
+{
+  DISK_IO_CACHE_BLOCK  *Block;
+  DISK_IO_CACHE_BLOCK  **Bucket;
+
+  ASSERT (BufferSize % Cache->BlockSize == 0);
+  if (BufferSize > DISK_IO_CACHE_MAX_FILL_SIZE) {
+    return;
+  }
+
+  for ( ; BufferSize != 0; Lba++, Buffer += Cache->BlockSize, BufferSize -= Cache->BlockSize) {
+    Block = DiskIoBlockCacheLookup (Cache, Lba);
+    if (Block == NULL) {
+      //
+      // Replace the least recently used block
+      //
+      Block = BASE_CR (GetPreviousNode (&Cache->LruList, &Cache->LruList), DISK_IO_CACHE_BLOCK, LruLink);
+      if (Block->Valid) {
+        DiskIoBlockCacheDrop (Cache, Block);
+      }
+
+      Bucket          = DiskIoBlockCacheBucket (Cache, Lba);
+      Block->Lba      = Lba;
+      Block->Valid    = TRUE;
+      Block->HashNext = *Bucket;
+      *Bucket         = Block;
+    }
+
+    CopyMem (Block->Data, Buffer, Cache->BlockSize);
+    RemoveEntryList (&Block->LruLink);
+    InsertHeadList (&Cache->LruList, &Block->LruLink);
+    Cache->Fills++;
+  }
+}
+
+/**
+  Drop the cached blocks that a write changes.
+
+  @param Cache       The block cache.
+  @param Offset      The starting byte offset on the device.
+  @param BufferSize  The number of bytes written.
+**/
+VOID
+DiskIoBlockCacheInvalidate (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN UINT64               Offset,
+  IN UINTN                BufferSize
+  )
+{
+  UINT64               Lba;
+  UINT64               LastLba;
+  LIST_ENTRY           *Link;
+  LIST_ENTRY           *NextLink;
+  DISK_IO_CACHE_BLOCK  *Block;
+
+  if (BufferSize == 0) {
+    return;
+  }
+
+  Lba     = DivU64x32 (Offset, Cache->BlockSize);
+  LastLba = DivU64x32 (Offset + BufferSize - 1, Cache->BlockSize);
+  if (LastLba - Lba < Cache->BlockCount) {
+    for ( ; Lba <= LastLba; Lba++) {
+      Block = DiskIoBlockCacheLookup (Cache, Lba);
+      if (Block != NULL) {
+        DiskIoBlockCacheDrop (Cache, Block);
+        Cache->Invalidations++;
+      }
+    }
+
+    return;
+  }
+
+  //
+  // A large write is checked against the cached blocks instead
+  //
+  for (Link = GetFirstNode (&Cache->LruList); !IsNull (&Cache->LruList, Link); Link = NextLink) {
+    NextLink = GetNextNode (&Cache->LruList, Link);
+    Block    = BASE_CR (Link, DISK_IO_CACHE_BLOCK, LruLink);
+    if (!Block->Valid) {
+      break;
+    }
+
+    if ((Block->Lba >= Lba) && (Block->Lba <= LastLba)) {
+      DiskIoBlockCacheDrop (Cache, Block);
+      Cache->Invalidations++;
+    }
+  }
+}
+
+/**
+  Count a write that starts or ends in PendingWrites, at TPL_NOTIFY.
+
+  @param Cache    The block cache.
+  @param Pending  TRUE when the write starts, FALSE when it ends.
+**/
+VOID
+DiskIoBlockCacheUpdatePendingWrites (
+  IN DISK_IO_BLOCK_CACHE  *Cache,
+  IN BOOLEAN              Pending
+  )
+{
+  EFI_TPL  OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (Pending) {
+    Cache->PendingWrites++;
+  } else {
+    ASSERT (Cache->PendingWrites > 0);
+    Cache->PendingWrites--;
+  }
+
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Return the statistics of the block cache of a device.
+
+  @param[in]  This        A pointer to the
+                          EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL
+                          instance.
+  @param[out] Statistics  A pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS             The statistics are returned.
+  @retval EFI_INVALID_PARAMETER   Statistics is NULL.
+**/
+EFI_STATUS
+EFIAPI
+DiskIoGetBlockCacheStatistics (
+  IN  EDKII_DISK_IO_BLOCK_CACHE_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_DISK_IO_BLOCK_CACHE_STATISTICS           *Statistics
+  )
+{
+  DISK_IO_BLOCK_CACHE  *Cache;
+  EFI_TPL              OldTpl;
+
+  if (Statistics == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Cache = DISK_IO_PRIVATE_DATA_FROM_BLOCK_CACHE_STATISTICS (This)->BlockCache;
+  ASSERT (Cache != NULL);
+
+  //
+  // The counters change at TPL_CALLBACK and at TPL_NOTIFY
+  //
+  OldTpl                    = gBS->RaiseTPL (TPL_NOTIFY);
+  Statistics->BlockSize     = Cache->BlockSize;
+  Statistics->BlockCount    = Cache->BlockCount;
+  Statistics->Hits          = Cache->Hits;
+  Statistics->Misses        = Cache->Misses;
+  Statistics->Fills         = Cache->Fills;
+  Statistics->Invalidations = Cache->Invalidations;
+  Statistics->Flushes       = Cache->Flushes;
+  Statistics->MergedReads   = Cache->MergedReads;
+  Statistics->PendingWrites = Cache->PendingWrites;
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
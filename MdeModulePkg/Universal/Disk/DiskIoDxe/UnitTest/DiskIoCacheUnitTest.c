@@ -0,0 +1,1110 @@
+/** @file
+  Host-based unit tests for the block cache of the Disk I/O driver, with
+  blocking and non-blocking reads and writes on a simulated Block I/O 2 device
+  that completes its requests out of order.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../DiskIo.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "Disk I/O Block Cache Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_BLOCK_SIZE      512
+#define TEST_BLOCK_COUNT     2048
+#define TEST_DISK_SIZE       (TEST_BLOCK_SIZE * TEST_BLOCK_COUNT)
+#define TEST_IO_ALIGN        8
+#define TEST_CACHE_SIZE      SIZE_16KB
+#define TEST_MAX_REQUESTS    1024
+#define TEST_MAX_OPERATIONS  256
+#define TEST_ITERATIONS      10000
+
+typedef struct {
+  LIST_ENTRY          Link;
+  EFI_TPL             Tpl;
+  EFI_EVENT_NOTIFY    NotifyFunction;
+  VOID                *NotifyContext;
+  BOOLEAN             Signaled;
+} TEST_EVENT;
+
+///
+/// A request submitted to the device and not completed yet
+///
+typedef struct {
+  BOOLEAN                Write;
+  EFI_LBA                Lba;
+  UINTN                  BufferSize;
+  UINT8                  *Buffer;
+  EFI_BLOCK_IO2_TOKEN    *Token;
+} TEST_REQUEST;
+
+///
+/// A non-blocking Disk I/O 2 access of the test
+///
+typedef struct {
+  EFI_DISK_IO2_TOKEN    Token;
+  BOOLEAN               Write;
+  BOOLEAN               Done;
+  UINT64                Offset;
+  UINTN                 BufferSize;
+  UINT8                 *Allocation;
+  UINT8                 *Buffer;
+  UINT8                 *Expected;  ///< Disk content to read, NULL for a write
+} TEST_OPERATION;
+
+///
+/// Globals and functions of the driver that its header does not declare
+///
+extern DISK_IO_PRIVATE_DATA  gDiskIoPrivateDataTemplate;
+
+EFI_COMPONENT_NAME_PROTOCOL   gDiskIoComponentName;
+EFI_COMPONENT_NAME2_PROTOCOL  gDiskIoComponentName2;
+
+///
+/// Boot services of the simulated firmware
+///
+STATIC EFI_TPL            mTpl = TPL_APPLICATION;
+STATIC LIST_ENTRY         mEvents = INITIALIZE_LIST_HEAD_VARIABLE (mEvents);
+STATIC EFI_BOOT_SERVICES  mBootServices;
+EFI_BOOT_SERVICES         *gBS = &mBootServices;
+
+///
+/// The simulated device, and the content the disk must have
+///
+STATIC UINT8               mDisk[TEST_DISK_SIZE];
+STATIC UINT8               mModel[TEST_DISK_SIZE];
+STATIC EFI_BLOCK_IO_MEDIA  mMedia;
+STATIC TEST_REQUEST        mRequests[TEST_MAX_REQUESTS];
+STATIC UINTN               mRequestCount;
+STATIC UINT32              mSeed;
+
+///
+/// The event signaled when the next write raises the TPL
+///
+STATIC EFI_EVENT  mRaceEvent;
+STATIC BOOLEAN    mRaceArmed;
+
+STATIC TEST_OPERATION  mOperations[TEST_MAX_OPERATIONS];
+STATIC UINTN           mOperationCount;
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  VOID
+  )
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return (mSeed >> 8);
+}
+
+/**
+  Dispatches the signaled events whose TPL is above the current TPL, the
+  highest TPL first.
+
+**/
+STATIC
+VOID
+DispatchEvents (
+  VOID
+  )
+{
+  LIST_ENTRY  *Link;
+  TEST_EVENT  *Event;
+  TEST_EVENT  *Next;
+  EFI_TPL     SavedTpl;
+
+  for ( ; ;) {
+    Next = NULL;
+    for (Link = GetFirstNode (&mEvents); !IsNull (&mEvents, Link); Link = GetNextNode (&mEvents, Link)) {
+      Event = BASE_CR (Link, TEST_EVENT, Link);
+      if (Event->Signaled && (Event->NotifyFunction != NULL) && (Event->Tpl > mTpl) &&
+          ((Next == NULL) || (Event->Tpl > Next->Tpl)))
+      {
+        Next = Event;
+      }
+    }
+
+    if (Next == NULL) {
+      return;
+    }
+
+    Next->Signaled = FALSE;
+    SavedTpl       = mTpl;
+    mTpl           = Next->Tpl;
+    Next->NotifyFunction (Next, Next->NotifyContext);
+    mTpl = SavedTpl;
+  }
+}
+
+/**
+  Completes some of the requests of the device, in random order.
+
+  @param  All  TRUE to complete all of them.
+
+**/
+STATIC
+VOID
+CompleteRequests (
+  IN BOOLEAN  All
+  )
+{
+  UINTN         Index;
+  TEST_REQUEST  Request;
+
+  while ((mRequestCount > 0) && (All || (NextRandom () % 3 != 0))) {
+    Index            = NextRandom () % mRequestCount;
+    Request          = mRequests[Index];
+    mRequests[Index] = mRequests[--mRequestCount];
+    if (Request.Write) {
+      CopyMem (mDisk + MultU64x32 (Request.Lba, TEST_BLOCK_SIZE), Request.Buffer, Request.BufferSize);
+    } else {
+      CopyMem (Request.Buffer, mDisk + MultU64x32 (Request.Lba, TEST_BLOCK_SIZE), Request.BufferSize);
+    }
+
+    Request.Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Request.Token->Event);
+  }
+}
+
+/**
+  Raises the task priority level, and signals the race event when a write
+  is armed to race with it.
+
+  @param  NewTpl  The new task priority level.
+
+  @return The previous task priority level.
+
+**/
+STATIC
+EFI_TPL
+EFIAPI
+TestRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  EFI_TPL  OldTpl;
+
+  OldTpl = mTpl;
+  ASSERT (NewTpl >= OldTpl);
+  mTpl = NewTpl;
+  if (mRaceArmed && (OldTpl < TPL_CALLBACK)) {
+    mRaceArmed = FALSE;
+    gBS->SignalEvent (mRaceEvent);
+  }
+
+  return OldTpl;
+}
+
+/**
+  Restores the task priority level, lets the device complete requests and
+  dispatches the events.
+
+  @param  OldTpl  The task priority level to restore.
+
+**/
+STATIC
+VOID
+EFIAPI
+TestRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+  ASSERT (OldTpl <= mTpl);
+  mTpl = OldTpl;
+  if ((mTpl < TPL_NOTIFY) && (NextRandom () % 2 == 0)) {
+    CompleteRequests (FALSE);
+  }
+
+  DispatchEvents ();
+}
+
+/**
+  Creates an event.
+
+  @param  Type            The type of event.
+  @param  NotifyTpl       The task priority level of the notification.
+  @param  NotifyFunction  The notification function, NULL for none.
+  @param  NotifyContext   The context of the notification function.
+  @param  Event           The new event.
+
+  @retval EFI_SUCCESS           The event is created.
+  @retval EFI_OUT_OF_RESOURCES  The event cannot be allocated.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  TEST_EVENT  *NewEvent;
+
+  NewEvent = AllocateZeroPool (sizeof (TEST_EVENT));
+  if (NewEvent == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NewEvent->Tpl            = NotifyTpl;
+  NewEvent->NotifyFunction = NotifyFunction;
+  NewEvent->NotifyContext  = NotifyContext;
+  InsertTailList (&mEvents, &NewEvent->Link);
+  *Event = NewEvent;
+  return EFI_SUCCESS;
+}
+
+/**
+  Closes an event.
+
+  @param  Event  The event to close.
+
+  @retval EFI_SUCCESS  The event is closed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  RemoveEntryList (&((TEST_EVENT *)Event)->Link);
+  FreePool (Event);
+  return EFI_SUCCESS;
+}
+
+/**
+  Signals an event, and dispatches it if its TPL is above the current TPL.
+
+  @param  Event  The event to signal.
+
+  @retval EFI_SUCCESS  The event is signaled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((TEST_EVENT *)Event)->Signaled = TRUE;
+  DispatchEvents ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Installs a protocol interface, the test does not track the handles.
+
+  @param  Handle         The handle to install the protocol on.
+  @param  Protocol       The GUID of the protocol.
+  @param  InterfaceType  The interface type.
+  @param  Interface      The interface.
+
+  @retval EFI_SUCCESS  The protocol is installed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestInstallProtocolInterface (
+  IN OUT EFI_HANDLE          *Handle,
+  IN     EFI_GUID            *Protocol,
+  IN     EFI_INTERFACE_TYPE  InterfaceType,
+  IN     VOID                *Interface
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Initializes a lock.
+
+  @param  Lock      The lock to initialize.
+  @param  Priority  The task priority level of the lock.
+
+  @return The lock.
+
+**/
+EFI_LOCK *
+EFIAPI
+EfiInitializeLock (
+  IN OUT EFI_LOCK  *Lock,
+  IN     EFI_TPL   Priority
+  )
+{
+  Lock->Tpl      = Priority;
+  Lock->OwnerTpl = TPL_APPLICATION;
+  Lock->Lock     = EfiLockReleased;
+  return Lock;
+}
+
+/**
+  Raises the task priority level to that of the lock and acquires it.
+
+  @param  Lock  The lock to acquire.
+
+**/
+VOID
+EFIAPI
+EfiAcquireLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockReleased);
+  Lock->OwnerTpl = gBS->RaiseTPL (Lock->Tpl);
+  Lock->Lock     = EfiLockAcquired;
+}
+
+/**
+  Releases a lock and restores the task priority level.
+
+  @param  Lock  The lock to release.
+
+**/
+VOID
+EFIAPI
+EfiReleaseLock (
+  IN EFI_LOCK  *Lock
+  )
+{
+  ASSERT (Lock->Lock == EfiLockAcquired);
+  Lock->Lock = EfiLockReleased;
+  gBS->RestoreTPL (Lock->OwnerTpl);
+}
+
+/**
+  Installs the driver binding and component name protocols, which the test
+  does not use.
+
+  @param  ImageHandle          The image handle of the driver.
+  @param  SystemTable          The EFI System Table.
+  @param  DriverBinding        The driver binding protocol.
+  @param  DriverBindingHandle  The handle to install the protocols on.
+  @param  ComponentName        The component name protocol.
+  @param  ComponentName2       The component name 2 protocol.
+
+  @retval EFI_SUCCESS  The protocols are installed.
+
+**/
+EFI_STATUS
+EFIAPI
+EfiLibInstallDriverBindingComponentName2 (
+  IN CONST EFI_HANDLE                    ImageHandle,
+  IN CONST EFI_SYSTEM_TABLE              *SystemTable,
+  IN EFI_DRIVER_BINDING_PROTOCOL         *DriverBinding,
+  IN EFI_HANDLE                          DriverBindingHandle,
+  IN CONST EFI_COMPONENT_NAME_PROTOCOL   *ComponentName   OPTIONAL,
+  IN CONST EFI_COMPONENT_NAME2_PROTOCOL  *ComponentName2  OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Checks a request to the device.
+
+  @param  MediaId     The media ID of the request.
+  @param  Lba         The first block of the request.
+  @param  BufferSize  The size of the request.
+  @param  Buffer      The buffer of the request.
+
+  @retval EFI_SUCCESS         The request is valid.
+  @retval EFI_MEDIA_CHANGED   The media changed.
+
+**/
+STATIC
+EFI_STATUS
+CheckRequest (
+  IN UINT32   MediaId,
+  IN EFI_LBA  Lba,
+  IN UINTN    BufferSize,
+  IN VOID     *Buffer
+  )
+{
+  ASSERT (mTpl <= TPL_CALLBACK);
+  ASSERT (BufferSize % TEST_BLOCK_SIZE == 0);
+  ASSERT ((BufferSize == 0) || ((UINTN)Buffer % TEST_IO_ALIGN == 0));
+  ASSERT (Lba + BufferSize / TEST_BLOCK_SIZE <= TEST_BLOCK_COUNT);
+
+  if (MediaId != mMedia.MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Reads blocks of the device.
+
+  @param  This        The Block I/O protocol.
+  @param  MediaId     The media ID of the request.
+  @param  Lba         The first block to read.
+  @param  BufferSize  The size of the read.
+  @param  Buffer      The buffer to receive the data.
+
+  @retval EFI_SUCCESS         The data is read.
+  @retval EFI_MEDIA_CHANGED   The media changed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL  *This,
+  IN  UINT32                 MediaId,
+  IN  EFI_LBA                Lba,
+  IN  UINTN                  BufferSize,
+  OUT VOID                   *Buffer
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = CheckRequest (MediaId, Lba, BufferSize, Buffer);
+  if (!EFI_ERROR (Status)) {
+    CopyMem (Buffer, mDisk + MultU64x32 (Lba, TEST_BLOCK_SIZE), BufferSize);
+  }
+
+  return Status;
+}
+
+/**
+  Writes blocks of the device.
+
+  @param  This        The Block I/O protocol.
+  @param  MediaId     The media ID of the request.
+  @param  Lba         The first block to write.
+  @param  BufferSize  The size of the write.
+  @param  Buffer      The data to write.
+
+  @retval EFI_SUCCESS         The data is written.
+  @retval EFI_MEDIA_CHANGED   The media changed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestWriteBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This,
+  IN UINT32                 MediaId,
+  IN EFI_LBA                Lba,
+  IN UINTN                  BufferSize,
+  IN VOID                   *Buffer
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = CheckRequest (MediaId, Lba, BufferSize, Buffer);
+  if (!EFI_ERROR (Status)) {
+    CopyMem (mDisk + MultU64x32 (Lba, TEST_BLOCK_SIZE), Buffer, BufferSize);
+  }
+
+  return Status;
+}
+
+/**
+  Queues a non-blocking request to the device.
+
+  @param  Write       TRUE for a write.
+  @param  MediaId     The media ID of the request.
+  @param  Lba         The first block of the request.
+  @param  Token       The token of the request.
+  @param  BufferSize  The size of the request.
+  @param  Buffer      The buffer of the request.
+
+  @retval EFI_SUCCESS         The request is queued.
+  @retval EFI_MEDIA_CHANGED   The media changed.
+
+**/
+STATIC
+EFI_STATUS
+QueueRequest (
+  IN BOOLEAN              Write,
+  IN UINT32               MediaId,
+  IN EFI_LBA              Lba,
+  IN EFI_BLOCK_IO2_TOKEN  *Token,
+  IN UINTN                BufferSize,
+  IN VOID                 *Buffer
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = CheckRequest (MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  ASSERT (mRequestCount < TEST_MAX_REQUESTS);
+  mRequests[mRequestCount].Write      = Write;
+  mRequests[mRequestCount].Lba        = Lba;
+  mRequests[mRequestCount].BufferSize = BufferSize;
+  mRequests[mRequestCount].Buffer     = Buffer;
+  mRequests[mRequestCount].Token      = Token;
+  mRequestCount++;
+
+  if (NextRandom () % 4 == 0) {
+    CompleteRequests (FALSE);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Reads blocks of the device without blocking.
+
+  @param  This        The Block I/O 2 protocol.
+  @param  MediaId     The media ID of the request.
+  @param  Lba         The first block to read.
+  @param  Token       The token of the request.
+  @param  BufferSize  The size of the read.
+  @param  Buffer      The buffer to receive the data.
+
+  @retval EFI_SUCCESS         The read is queued.
+  @retval EFI_MEDIA_CHANGED   The media changed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  OUT    VOID                    *Buffer
+  )
+{
+  return QueueRequest (FALSE, MediaId, Lba, Token, BufferSize, Buffer);
+}
+
+/**
+  Writes blocks of the device without blocking.
+
+  @param  This        The Block I/O 2 protocol.
+  @param  MediaId     The media ID of the request.
+  @param  Lba         The first block to write.
+  @param  Token       The token of the request.
+  @param  BufferSize  The size of the write.
+  @param  Buffer      The data to write.
+
+  @retval EFI_SUCCESS         The write is queued.
+  @retval EFI_MEDIA_CHANGED   The media changed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  IN     VOID                    *Buffer
+  )
+{
+  return QueueRequest (TRUE, MediaId, Lba, Token, BufferSize, Buffer);
+}
+
+STATIC EFI_BLOCK_IO_PROTOCOL   mBlockIo;
+STATIC EFI_BLOCK_IO2_PROTOCOL  mBlockIo2;
+
+/**
+  Creates a Disk I/O instance with a block cache on the simulated device,
+  whose disk and model are filled with the same random data.
+
+  @return The Disk I/O instance, or NULL if it cannot be allocated.
+
+**/
+STATIC
+DISK_IO_PRIVATE_DATA *
+CreateTestInstance (
+  VOID
+  )
+{
+  DISK_IO_PRIVATE_DATA  *Instance;
+  UINTN                 Index;
+
+  mBootServices.RaiseTPL                 = TestRaiseTpl;
+  mBootServices.RestoreTPL               = TestRestoreTpl;
+  mBootServices.CreateEvent              = TestCreateEvent;
+  mBootServices.CloseEvent               = TestCloseEvent;
+  mBootServices.SignalEvent              = TestSignalEvent;
+  mBootServices.InstallProtocolInterface = TestInstallProtocolInterface;
+
+  mMedia.MediaId          = 1;
+  mMedia.MediaPresent     = TRUE;
+  mMedia.BlockSize        = TEST_BLOCK_SIZE;
+  mMedia.IoAlign          = TEST_IO_ALIGN;
+  mMedia.LastBlock        = TEST_BLOCK_COUNT - 1;
+  mBlockIo.Media          = &mMedia;
+  mBlockIo.ReadBlocks     = TestReadBlocks;
+  mBlockIo.WriteBlocks    = TestWriteBlocks;
+  mBlockIo2.Media         = &mMedia;
+  mBlockIo2.ReadBlocksEx  = TestReadBlocksEx;
+  mBlockIo2.WriteBlocksEx = TestWriteBlocksEx;
+  mRequestCount           = 0;
+  mOperationCount         = 0;
+
+  for (Index = 0; Index < TEST_DISK_SIZE; Index++) {
+    mDisk[Index]  = (UINT8)NextRandom ();
+    mModel[Index] = mDisk[Index];
+  }
+
+  Instance = AllocateCopyPool (sizeof (DISK_IO_PRIVATE_DATA), &gDiskIoPrivateDataTemplate);
+  if (Instance == NULL) {
+    return NULL;
+  }
+
+  Instance->BlockIo  = &mBlockIo;
+  Instance->BlockIo2 = &mBlockIo2;
+  InitializeListHead (&Instance->TaskQueue);
+  EfiInitializeLock (&Instance->TaskQueueLock, TPL_NOTIFY);
+  Instance->SharedWorkingBuffer = AllocateAlignedPages (
+                                    EFI_SIZE_TO_PAGES (PcdGet32 (PcdDiskIoDataBufferBlockNum) * TEST_BLOCK_SIZE),
+                                    TEST_IO_ALIGN
+                                    );
+  Instance->BlockCache = DiskIoCreateBlockCache (&mMedia, TEST_CACHE_SIZE);
+  if ((Instance->SharedWorkingBuffer == NULL) || (Instance->BlockCache == NULL)) {
+    return NULL;
+  }
+
+  return Instance;
+}
+
+/**
+  Frees a Disk I/O instance created by CreateTestInstance().
+
+  @param  Instance  The Disk I/O instance.
+
+**/
+STATIC
+VOID
+FreeTestInstance (
+  IN DISK_IO_PRIVATE_DATA  *Instance
+  )
+{
+  FreeAlignedPages (
+    Instance->SharedWorkingBuffer,
+    EFI_SIZE_TO_PAGES (PcdGet32 (PcdDiskIoDataBufferBlockNum) * TEST_BLOCK_SIZE)
+    );
+  DiskIoFreeBlockCache (Instance->BlockCache);
+  FreePool (Instance);
+}
+
+/**
+  Retires the completed non-blocking operations, and checks the data they
+  read.
+
+  @param  Offset      The starting byte offset of the next access.
+  @param  BufferSize  The size of the next access.
+  @param  Write       TRUE if the next access is a write.
+
+  @retval TRUE   An operation in flight accesses blocks of the next access,
+                 and one of them writes.
+  @retval FALSE  The next access can be submitted.
+
+**/
+STATIC
+BOOLEAN
+RetireOperations (
+  IN UINT64   Offset,
+  IN UINTN    BufferSize,
+  IN BOOLEAN  Write
+  )
+{
+  UINTN           Index;
+  TEST_OPERATION  *Operation;
+  BOOLEAN         Overlap;
+
+  Overlap = FALSE;
+  for (Index = 0; Index < mOperationCount; Index++) {
+    Operation = &mOperations[Index];
+    if (Operation->Done) {
+      continue;
+    }
+
+    if (((TEST_EVENT *)Operation->Token.Event)->Signaled) {
+      ASSERT_EFI_ERROR (Operation->Token.TransactionStatus);
+      if (Operation->Expected != NULL) {
+        ASSERT (CompareMem (Operation->Buffer, Operation->Expected, Operation->BufferSize) == 0);
+        FreePool (Operation->Expected);
+      }
+
+      gBS->CloseEvent (Operation->Token.Event);
+      FreePool (Operation->Allocation);
+      Operation->Done = TRUE;
+      continue;
+    }
+
+    if ((Write || Operation->Write) &&
+        (DivU64x32 (Offset, TEST_BLOCK_SIZE) <= DivU64x32 (Operation->Offset + Operation->BufferSize, TEST_BLOCK_SIZE)) &&
+        (DivU64x32 (Operation->Offset, TEST_BLOCK_SIZE) <= DivU64x32 (Offset + BufferSize, TEST_BLOCK_SIZE)))
+    {
+      Overlap = TRUE;
+    }
+  }
+
+  return Overlap;
+}
+
+/**
+  Waits until the device completed all the non-blocking operations.
+
+**/
+STATIC
+VOID
+DrainOperations (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  CompleteRequests (TRUE);
+  DispatchEvents ();
+  RetireOperations (0, 0, FALSE);
+  for (Index = 0; Index < mOperationCount; Index++) {
+    ASSERT (mOperations[Index].Done);
+  }
+
+  mOperationCount = 0;
+}
+
+/**
+  Reads and writes random ranges of the device, blocking and non-blocking,
+  through the block cache, and checks the data read and the disk content
+  against a model of the disk. Then checks the statistics of the cache.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The data matches the model.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The data does not match the model.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RandomAccessesMatchDisk (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  DISK_IO_PRIVATE_DATA                  *Instance;
+  EDKII_DISK_IO_BLOCK_CACHE_STATISTICS  Statistics;
+  TEST_OPERATION                        *Operation;
+  UINTN                                 Iteration;
+  UINTN                                 Kind;
+  UINTN                                 Index;
+  UINT64                                Offset;
+  UINTN                                 BufferSize;
+  UINT8                                 *Allocation;
+  UINT8                                 *Buffer;
+  BOOLEAN                               Write;
+  EFI_STATUS                            Status;
+
+  mSeed    = 1;
+  Instance = CreateTestInstance ();
+  UT_ASSERT_NOT_NULL (Instance);
+
+  for (Iteration = 0; Iteration < TEST_ITERATIONS; Iteration++) {
+    Kind       = NextRandom () % 10;
+    Write      = (BOOLEAN)(Kind >= 6);
+    BufferSize = (NextRandom () % 4 != 0) ? NextRandom () % 2048 : NextRandom () % 9000;
+    if (NextRandom () % 8 == 0) {
+      BufferSize = (1 + NextRandom () % 4) * TEST_BLOCK_SIZE;
+    }
+
+    //
+    // Mostly small accesses to the first blocks, as file system metadata
+    //
+    Offset = (NextRandom () % 4 != 0) ? NextRandom () % (64 * TEST_BLOCK_SIZE) : NextRandom () % (TEST_DISK_SIZE - BufferSize);
+    if (NextRandom () % 4 == 0) {
+      Offset &= ~(UINT64)(TEST_BLOCK_SIZE - 1);
+    }
+
+    Offset = MIN (Offset, TEST_DISK_SIZE - BufferSize);
+
+    while (RetireOperations (Offset, BufferSize, Write)) {
+      CompleteRequests (FALSE);
+      DispatchEvents ();
+    }
+
+    if ((Kind == 9) && (NextRandom () % 50 == 0)) {
+      //
+      // New media, the cache must be emptied
+      //
+      DrainOperations ();
+      mMedia.MediaId++;
+      for (Index = 0; Index < TEST_DISK_SIZE; Index++) {
+        mDisk[Index]  = (UINT8)NextRandom ();
+        mModel[Index] = mDisk[Index];
+      }
+
+      continue;
+    }
+
+    Allocation = AllocatePool (BufferSize + TEST_IO_ALIGN + 1);
+    UT_ASSERT_NOT_NULL (Allocation);
+    Buffer = Allocation + NextRandom () % (TEST_IO_ALIGN + 1);
+    if (Write) {
+      for (Index = 0; Index < BufferSize; Index++) {
+        Buffer[Index] = (UINT8)NextRandom ();
+      }
+
+      CopyMem (mModel + Offset, Buffer, BufferSize);
+    }
+
+    if ((Kind % 2 == 0) || (Kind == 3)) {
+      if (Write) {
+        Status = Instance->DiskIo.WriteDisk (&Instance->DiskIo, mMedia.MediaId, Offset, BufferSize, Buffer);
+        UT_ASSERT_NOT_EFI_ERROR (Status);
+      } else {
+        Status = Instance->DiskIo.ReadDisk (&Instance->DiskIo, mMedia.MediaId, Offset, BufferSize, Buffer);
+        UT_ASSERT_NOT_EFI_ERROR (Status);
+        UT_ASSERT_MEM_EQUAL (Buffer, mModel + Offset, BufferSize);
+      }
+
+      FreePool (Allocation);
+      continue;
+    }
+
+    if (mOperationCount == TEST_MAX_OPERATIONS) {
+      DrainOperations ();
+    }
+
+    Operation                          = &mOperations[mOperationCount++];
+    Operation->Write                   = Write;
+    Operation->Done                    = FALSE;
+    Operation->Offset                  = Offset;
+    Operation->BufferSize              = BufferSize;
+    Operation->Allocation              = Allocation;
+    Operation->Buffer                  = Buffer;
+    Operation->Expected                = NULL;
+    Operation->Token.TransactionStatus = EFI_NOT_READY;
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operation->Token.Event));
+    if (Write) {
+      Status = Instance->DiskIo2.WriteDiskEx (&Instance->DiskIo2, mMedia.MediaId, Offset, &Operation->Token, BufferSize, Buffer);
+    } else {
+      Operation->Expected = AllocateCopyPool (BufferSize + 1, mModel + Offset);
+      UT_ASSERT_NOT_NULL (Operation->Expected);
+      Status = Instance->DiskIo2.ReadDiskEx (&Instance->DiskIo2, mMedia.MediaId, Offset, &Operation->Token, BufferSize, Buffer);
+    }
+
+    UT_ASSERT_NOT_EFI_ERROR (Status);
+  }
+
+  DrainOperations ();
+  UT_ASSERT_MEM_EQUAL (mDisk, mModel, TEST_DISK_SIZE);
+
+  UT_ASSERT_STATUS_EQUAL (
+    Instance->BlockCacheStatistics.GetStatistics (&Instance->BlockCacheStatistics, NULL),
+    EFI_INVALID_PARAMETER
+    );
+  UT_ASSERT_NOT_EFI_ERROR (Instance->BlockCacheStatistics.GetStatistics (&Instance->BlockCacheStatistics, &Statistics));
+  UT_LOG_INFO (
+    "hits %ld misses %ld fills %ld invalidations %ld flushes %ld merged reads %ld\n",
+    Statistics.Hits,
+    Statistics.Misses,
+    Statistics.Fills,
+    Statistics.Invalidations,
+    Statistics.Flushes,
+    Statistics.MergedReads
+    );
+  UT_ASSERT_EQUAL (Statistics.BlockSize, TEST_BLOCK_SIZE);
+  UT_ASSERT_EQUAL (Statistics.BlockCount, TEST_CACHE_SIZE / TEST_BLOCK_SIZE);
+  UT_ASSERT_TRUE (Statistics.Hits > 0);
+  UT_ASSERT_TRUE (Statistics.Fills > 0);
+  UT_ASSERT_TRUE (Statistics.Invalidations > 0);
+  UT_ASSERT_TRUE (Statistics.Flushes > 0);
+  UT_ASSERT_EQUAL (Statistics.PendingWrites, 0);
+
+  FreeTestInstance (Instance);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Reads the block of a racing write at TPL_CALLBACK, after the write dropped
+  it from the cache and before the write is submitted to the device.
+
+  @param  Event    The race event.
+  @param  Context  The Disk I/O instance.
+
+**/
+STATIC
+VOID
+EFIAPI
+ReadRacingBlock (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  DISK_IO_PRIVATE_DATA  *Instance;
+  UINT8                 Buffer[TEST_BLOCK_SIZE];
+
+  Instance = Context;
+  Instance->DiskIo.ReadDisk (&Instance->DiskIo, mMedia.MediaId, 0, sizeof (Buffer), Buffer);
+}
+
+/**
+  Writes a cached block while a read at TPL_CALLBACK reads it from the device
+  before the write reaches it, and checks that the block cache does not keep
+  the data of the read.
+
+  @param[in]  Context  TRUE for a non-blocking write.
+
+  @retval  UNIT_TEST_PASSED             The block is read back as written.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The cache returned the data before the
+                                        write.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RacingReadDoesNotFillCache (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  DISK_IO_PRIVATE_DATA                  *Instance;
+  EDKII_DISK_IO_BLOCK_CACHE_STATISTICS  Statistics;
+  EFI_DISK_IO2_TOKEN                    Token;
+  UINT8                                 Buffer[TEST_BLOCK_SIZE];
+  UINTN                                 Index;
+
+  mSeed    = 2;
+  Instance = CreateTestInstance ();
+  UT_ASSERT_NOT_NULL (Instance);
+  UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (EVT_NOTIFY_SIGNAL, TPL_CALLBACK, ReadRacingBlock, Instance, &mRaceEvent));
+
+  UT_ASSERT_NOT_EFI_ERROR (Instance->DiskIo.ReadDisk (&Instance->DiskIo, mMedia.MediaId, 0, sizeof (Buffer), Buffer));
+  UT_ASSERT_MEM_EQUAL (Buffer, mModel, sizeof (Buffer));
+
+  for (Index = 0; Index < sizeof (Buffer); Index++) {
+    Buffer[Index] = (UINT8)~mModel[Index];
+  }
+
+  CopyMem (mModel, Buffer, sizeof (Buffer));
+  mRaceArmed = TRUE;
+  if ((BOOLEAN)(UINTN)Context) {
+    Token.TransactionStatus = EFI_NOT_READY;
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Token.Event));
+    UT_ASSERT_NOT_EFI_ERROR (Instance->DiskIo2.WriteDiskEx (&Instance->DiskIo2, mMedia.MediaId, 0, &Token, sizeof (Buffer), Buffer));
+    CompleteRequests (TRUE);
+    UT_ASSERT_TRUE (((TEST_EVENT *)Token.Event)->Signaled);
+    UT_ASSERT_NOT_EFI_ERROR (Token.TransactionStatus);
+    gBS->CloseEvent (Token.Event);
+  } else {
+    UT_ASSERT_NOT_EFI_ERROR (Instance->DiskIo.WriteDisk (&Instance->DiskIo, mMedia.MediaId, 0, sizeof (Buffer), Buffer));
+  }
+
+  UT_ASSERT_FALSE (mRaceArmed);
+  UT_ASSERT_MEM_EQUAL (mDisk, mModel, sizeof (Buffer));
+
+  ZeroMem (Buffer, sizeof (Buffer));
+  UT_ASSERT_NOT_EFI_ERROR (Instance->DiskIo.ReadDisk (&Instance->DiskIo, mMedia.MediaId, 0, sizeof (Buffer), Buffer));
+  UT_ASSERT_MEM_EQUAL (Buffer, mModel, sizeof (Buffer));
+
+  UT_ASSERT_NOT_EFI_ERROR (Instance->BlockCacheStatistics.GetStatistics (&Instance->BlockCacheStatistics, &Statistics));
+  UT_ASSERT_EQUAL (Statistics.PendingWrites, 0);
+
+  gBS->CloseEvent (mRaceEvent);
+  FreeTestInstance (Instance);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the block
+  cache of the Disk I/O driver and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      CacheTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&CacheTests, Framework, "Disk I/O Block Cache Tests", "DiskIo.BlockCache", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Disk I/O Block Cache Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite---------Description--------------------------------------------Name-------------Function--------------------Pre---Post---Context------------
+  //
+  AddTestCase (CacheTests, "Random accesses match the disk", "RandomAccesses", RandomAccessesMatchDisk, NULL, NULL, NULL);
+  AddTestCase (CacheTests, "Read racing a blocking write does not fill", "RaceBlocking", RacingReadDoesNotFillCache, NULL, NULL, (UNIT_TEST_CONTEXT)FALSE);
+  AddTestCase (CacheTests, "Read racing a non-blocking write does not fill", "RaceNonBlocking", RacingReadDoesNotFillCache, NULL, NULL, (UNIT_TEST_CONTEXT)TRUE);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define DiskIoCacheUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+DiskIoCacheUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
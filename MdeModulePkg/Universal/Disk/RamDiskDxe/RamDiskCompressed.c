@@ -0,0 +1,297 @@
+/** @file
+  The chunk source of a RAM disk created from a compressed RAM disk image.
+
+  A compressed RAM disk image starts with a RAM_DISK_COMPRESSED_IMAGE_HEADER,
+  followed by a RAM_DISK_COMPRESSED_CHUNK for each chunk of the RAM disk,
+  followed by the chunks. Each chunk is compressed on its own with the UEFI
+  compression algorithm, so that a sparse RAM disk only decompresses the
+  chunks that are read. BaseTools/Scripts/CompressRamDiskImage.py creates
+  such an image from a disk image.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "RamDiskImpl.h"
+
+typedef struct {
+  UINTN                          Signature;
+  EDKII_RAM_DISK_CHUNK_SOURCE    Source;
+  UINT8                          *Image;
+  UINT64                         DiskSize;
+  UINT64                         ChunkCount;
+  RAM_DISK_COMPRESSED_CHUNK      *Chunks;
+  VOID                           *Scratch;
+} RAM_DISK_COMPRESSED_SOURCE;
+
+#define RAM_DISK_COMPRESSED_SOURCE_SIGNATURE  SIGNATURE_32 ('R', 'D', 'C', 'S')
+#define RAM_DISK_COMPRESSED_SOURCE_FROM_THIS(a) \
+  CR (a, RAM_DISK_COMPRESSED_SOURCE, Source, RAM_DISK_COMPRESSED_SOURCE_SIGNATURE)
+
+/**
+  Get the size of the content of a chunk.
+
+  @param[in] Private         The chunk source of the image.
+  @param[in] ChunkIndex      The index of the chunk.
+
+  @return The size of the chunk, which is smaller than ChunkSize for the last
+          chunk of a RAM disk whose size is not a multiple of ChunkSize.
+
+**/
+STATIC
+UINT32
+RamDiskCompressedChunkLength (
+  IN RAM_DISK_COMPRESSED_SOURCE  *Private,
+  IN UINT64                      ChunkIndex
+  )
+{
+  UINT64  Offset;
+
+  Offset = MultU64x32 (ChunkIndex, Private->Source.ChunkSize);
+  return (UINT32)MIN (Private->DiskSize - Offset, Private->Source.ChunkSize);
+}
+
+/**
+  Decompress one chunk of a compressed RAM disk image.
+
+  @param[in]  This           A pointer to the EDKII_RAM_DISK_CHUNK_SOURCE
+                             instance.
+  @param[in]  ChunkIndex     The index of the chunk.
+  @param[out] Buffer         The buffer of ChunkSize bytes to receive the
+                             chunk content.
+
+  @retval EFI_SUCCESS             The chunk content is returned in Buffer.
+  @retval EFI_NOT_FOUND           The chunk contains only zeros.
+  @retval EFI_INVALID_PARAMETER   ChunkIndex is beyond the end of the image.
+  @retval Others                  The chunk cannot be decompressed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+RamDiskCompressedReadChunk (
+  IN  EDKII_RAM_DISK_CHUNK_SOURCE  *This,
+  IN  UINT64                       ChunkIndex,
+  OUT VOID                         *Buffer
+  )
+{
+  RAM_DISK_COMPRESSED_SOURCE  *Private;
+  RAM_DISK_COMPRESSED_CHUNK   *Chunk;
+
+  Private = RAM_DISK_COMPRESSED_SOURCE_FROM_THIS (This);
+  if (ChunkIndex >= Private->ChunkCount) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Chunk = &Private->Chunks[ChunkIndex];
+  if (Chunk->Size == 0) {
+    return EFI_NOT_FOUND;
+  }
+
+  return UefiDecompress (
+           Private->Image + Chunk->Offset,
+           Buffer,
+           Private->Scratch
+           );
+}
+
+/**
+  Check whether a buffer starts with the header of a compressed RAM disk
+  image.
+
+  @param[in] Image           The buffer to check.
+  @param[in] ImageSize       The size of the buffer in bytes.
+
+  @retval TRUE               The buffer is a compressed RAM disk image.
+  @retval FALSE              The buffer is not a compressed RAM disk image.
+
+**/
+BOOLEAN
+RamDiskIsCompressedImage (
+  IN CONST VOID  *Image,
+  IN UINTN       ImageSize
+  )
+{
+  return (BOOLEAN)(ImageSize >= sizeof (RAM_DISK_COMPRESSED_IMAGE_HEADER) &&
+                   ReadUnaligned64 (Image) == RAM_DISK_COMPRESSED_IMAGE_SIGNATURE);
+}
+
+/**
+  Create a chunk source that produces the content of a compressed RAM disk
+  image.
+
+  The whole image is checked here, so that a read of the RAM disk only fails
+  if a chunk does not decompress.
+
+  @param[in]  Image          The compressed RAM disk image, allocated from
+                             pool. On success, the chunk source owns it.
+  @param[in]  ImageSize      The size of the image in bytes.
+  @param[out] Source         On return, points to the chunk source.
+  @param[out] DiskSize       On return, the size of the RAM disk in bytes.
+
+  @retval EFI_SUCCESS             The chunk source is created.
+  @retval EFI_VOLUME_CORRUPTED    The image is not a valid compressed RAM disk
+                                  image.
+  @retval EFI_OUT_OF_RESOURCES    No memory to create the chunk source.
+
+**/
+EFI_STATUS
+RamDiskOpenCompressedImage (
+  IN  VOID                         *Image,
+  IN  UINTN                        ImageSize,
+  OUT EDKII_RAM_DISK_CHUNK_SOURCE  **Source,
+  OUT UINT64                       *DiskSize
+  )
+{
+  EFI_STATUS                        Status;
+  RAM_DISK_COMPRESSED_IMAGE_HEADER  *Header;
+  RAM_DISK_COMPRESSED_SOURCE        *Private;
+  RAM_DISK_COMPRESSED_CHUNK         *Chunk;
+  UINT64                            ChunkCount;
+  UINT64                            Index;
+  UINT32                            DestinationSize;
+  UINT32                            ScratchSize;
+  UINT32                            MaxScratchSize;
+
+  if (!RamDiskIsCompressedImage (Image, ImageSize)) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  Header = Image;
+  if ((Header->Version != RAM_DISK_COMPRESSED_IMAGE_VERSION) ||
+      (Header->ChunkSize < RAM_DISK_DEFAULT_BLOCK_SIZE) ||
+      ((Header->ChunkSize & (Header->ChunkSize - 1)) != 0) ||
+      (Header->DiskSize == 0) ||
+      (Header->DiskSize > MAX_UINT64 - Header->ChunkSize + 1))
+  {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  ChunkCount = DivU64x32 (Header->DiskSize + Header->ChunkSize - 1, Header->ChunkSize);
+  if (ChunkCount > (ImageSize - sizeof (*Header)) / sizeof (RAM_DISK_COMPRESSED_CHUNK)) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  Private = AllocateZeroPool (sizeof (RAM_DISK_COMPRESSED_SOURCE));
+  if (Private == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Private->Signature        = RAM_DISK_COMPRESSED_SOURCE_SIGNATURE;
+  Private->Source.ChunkSize = Header->ChunkSize;
+  Private->Source.ReadChunk = RamDiskCompressedReadChunk;
+  Private->Image            = Image;
+  Private->DiskSize         = Header->DiskSize;
+  Private->ChunkCount       = ChunkCount;
+  Private->Chunks           = (RAM_DISK_COMPRESSED_CHUNK *)(Header + 1);
+
+  MaxScratchSize = 0;
+  for (Index = 0; Index < ChunkCount; Index++) {
+    Chunk = &Private->Chunks[Index];
+    if (Chunk->Size == 0) {
+      continue;
+    }
+
+    if ((Chunk->Offset > ImageSize) || (Chunk->Size > ImageSize - Chunk->Offset)) {
+      Status = EFI_VOLUME_CORRUPTED;
+      goto ErrorExit;
+    }
+
+    Status = UefiDecompressGetInfo (
+               Private->Image + Chunk->Offset,
+               Chunk->Size,
+               &DestinationSize,
+               &ScratchSize
+               );
+    if (EFI_ERROR (Status) ||
+        (DestinationSize != RamDiskCompressedChunkLength (Private, Index)))
+    {
+      Status = EFI_VOLUME_CORRUPTED;
+      goto ErrorExit;
+    }
+
+    MaxScratchSize = MAX (MaxScratchSize, ScratchSize);
+  }
+
+  if (MaxScratchSize != 0) {
+    Private->Scratch = AllocatePool (MaxScratchSize);
+    if (Private->Scratch == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+      goto ErrorExit;
+    }
+  }
+
+  *Source   = &Private->Source;
+  *DiskSize = Private->DiskSize;
+  return EFI_SUCCESS;
+
+ErrorExit:
+  DEBUG ((DEBUG_ERROR, "%a: chunk %Lu - %r\n", __func__, Index, Status));
+  FreePool (Private);
+  return Status;
+}
+
+/**
+  Decompress all the chunks of a compressed RAM disk image.
+
+  @param[in]  Source         The chunk source of the image.
+  @param[out] Buffer         The buffer to receive the RAM disk content, as
+                             large as the RAM disk.
+
+  @retval EFI_SUCCESS             The RAM disk content is in Buffer.
+  @retval Others                  A chunk cannot be decompressed.
+
+**/
+EFI_STATUS
+RamDiskExpandCompressedImage (
+  IN  EDKII_RAM_DISK_CHUNK_SOURCE  *Source,
+  OUT VOID                         *Buffer
+  )
+{
+  EFI_STATUS                  Status;
+  RAM_DISK_COMPRESSED_SOURCE  *Private;
+  UINT64                      Index;
+  UINT8                       *Chunk;
+
+  Private = RAM_DISK_COMPRESSED_SOURCE_FROM_THIS (Source);
+  Chunk   = Buffer;
+  for (Index = 0; Index < Private->ChunkCount; Index++) {
+    //
+    // The image was checked to decompress each chunk to its exact length, so
+    // the last chunk does not overrun Buffer.
+    //
+    Status = RamDiskCompressedReadChunk (Source, Index, Chunk);
+    if (Status == EFI_NOT_FOUND) {
+      ZeroMem (Chunk, RamDiskCompressedChunkLength (Private, Index));
+    } else if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Chunk += Source->ChunkSize;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Free a chunk source created by RamDiskOpenCompressedImage() and the image
+  it owns.
+
+  @param[in] Source          The chunk source of the image.
+
+**/
+VOID
+RamDiskCloseCompressedImage (
+  IN EDKII_RAM_DISK_CHUNK_SOURCE  *Source
+  )
+{
+  RAM_DISK_COMPRESSED_SOURCE  *Private;
+
+  Private = RAM_DISK_COMPRESSED_SOURCE_FROM_THIS (Source);
+  if (Private->Scratch != NULL) {
+    FreePool (Private->Scratch);
+  }
+
+  FreePool (Private->Image);
+  FreePool (Private);
+}
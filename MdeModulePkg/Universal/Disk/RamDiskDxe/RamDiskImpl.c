@@ -183,11 +183,16 @@ UnregisterAllRamDisks (
         //
         // If a RAM disk is created within HII, then the RamDiskDxe driver
         // driver is responsible for freeing the allocated memory for the
-        // RAM disk.
+        // RAM disk, or the compressed image of a sparse RAM disk.
         //
-        FreePool ((VOID *)(UINTN)PrivateData->StartingAddr);
+        if (PrivateData->Sparse == NULL) {
+          FreePool ((VOID *)(UINTN)PrivateData->StartingAddr);
+        } else if (PrivateData->Sparse->Source != NULL) {
+          RamDiskCloseCompressedImage (PrivateData->Sparse->Source);
+        }
       }
 
+      RamDiskFreeSparse (PrivateData);
       FreePool (PrivateData->DevicePath);
       FreePool (PrivateData);
     }
@@ -273,10 +278,147 @@ RamDiskRouteConfig (
   return EFI_NOT_FOUND;
 }
 
+/**
+  Register the RAM disk created within RamDiskDxe driver HII from a
+  compressed RAM disk image.
+
+  A RAM disk in boot services data memory is a sparse RAM disk, which
+  decompresses a chunk of the image when the chunk is first read. A RAM disk
+  in reserved memory is described to the OS, so the whole image is
+  decompressed into it.
+
+  @param[in] Image           The compressed RAM disk image, allocated from
+                             pool. It is freed by this function, or when the
+                             RAM disk is unregistered.
+  @param[in] ImageSize       The size of the image in bytes.
+  @param[in] MemoryType      Type of memory to be used to create RAM Disk.
+
+  @retval EFI_SUCCESS             RAM disk is created and registered.
+  @retval EFI_VOLUME_CORRUPTED    The image is not a valid compressed RAM disk
+                                  image.
+  @retval EFI_OUT_OF_RESOURCES    Not enough storage is available to match the
+                                  size required.
+
+**/
+STATIC
+EFI_STATUS
+HiiCreateCompressedRamDisk (
+  IN VOID   *Image,
+  IN UINTN  ImageSize,
+  IN UINT8  MemoryType
+  )
+{
+  EFI_STATUS                   Status;
+  EDKII_RAM_DISK_CHUNK_SOURCE  *Source;
+  UINT64                       Size;
+  VOID                         *Buffer;
+  EFI_INPUT_KEY                Key;
+  EFI_DEVICE_PATH_PROTOCOL     *DevicePath;
+  RAM_DISK_PRIVATE_DATA        *PrivateData;
+
+  Status = RamDiskOpenCompressedImage (Image, ImageSize, &Source, &Size);
+  if (EFI_ERROR (Status)) {
+    FreePool (Image);
+    do {
+      CreatePopUp (
+        EFI_LIGHTGRAY | EFI_BACKGROUND_BLUE,
+        &Key,
+        L"",
+        L"The compressed RAM disk image is corrupted!",
+        L"Press ENTER to continue ...",
+        L"",
+        NULL
+        );
+    } while (Key.UnicodeChar != CHAR_CARRIAGE_RETURN);
+
+    return Status;
+  }
+
+  if (MemoryType == RAM_DISK_BOOT_SERVICE_DATA_MEMORY) {
+    Status = RamDiskRegisterSparse (
+               Size,
+               &gEfiVirtualDiskGuid,
+               Source,
+               NULL,
+               &DevicePath
+               );
+    if (EFI_ERROR (Status)) {
+      RamDiskCloseCompressedImage (Source);
+    }
+  } else {
+    Buffer = NULL;
+    if (Size <= MAX_UINTN) {
+      Buffer = AllocateReservedPool ((UINTN)Size);
+    }
+
+    if (Buffer == NULL) {
+      RamDiskCloseCompressedImage (Source);
+      do {
+        CreatePopUp (
+          EFI_LIGHTGRAY | EFI_BACKGROUND_BLUE,
+          &Key,
+          L"",
+          L"Not enough memory to create the RAM disk!",
+          L"Press ENTER to continue ...",
+          L"",
+          NULL
+          );
+      } while (Key.UnicodeChar != CHAR_CARRIAGE_RETURN);
+
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = RamDiskExpandCompressedImage (Source, Buffer);
+    RamDiskCloseCompressedImage (Source);
+    if (!EFI_ERROR (Status)) {
+      Status = RamDiskRegister (
+                 (UINT64)(UINTN)Buffer,
+                 Size,
+                 &gEfiVirtualDiskGuid,
+                 NULL,
+                 &DevicePath
+                 );
+    }
+
+    if (EFI_ERROR (Status)) {
+      FreePool (Buffer);
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    do {
+      CreatePopUp (
+        EFI_LIGHTGRAY | EFI_BACKGROUND_BLUE,
+        &Key,
+        L"",
+        L"Fail to register the newly created RAM disk!",
+        L"Press ENTER to continue ...",
+        L"",
+        NULL
+        );
+    } while (Key.UnicodeChar != CHAR_CARRIAGE_RETURN);
+
+    return Status;
+  }
+
+  //
+  // The memory of the RAM disk, or the compressed image of the sparse RAM
+  // disk, is freed when the RAM disk is unregistered.
+  //
+  PrivateData               = RAM_DISK_PRIVATE_FROM_THIS (RegisteredRamDisks.BackLink);
+  PrivateData->CreateMethod = RamDiskCreateHii;
+
+  return EFI_SUCCESS;
+}
+
 /**
   Allocate memory and register the RAM disk created within RamDiskDxe
   driver HII.
 
+  A file that is a compressed RAM disk image, as created by
+  BaseTools/Scripts/CompressRamDiskImage.py, is decompressed into the RAM
+  disk.
+
   @param[in] Size            If creating raw, size of the RAM disk to create.
                              If creating from file, zero.
   @param[in] FileHandle      If creating raw, NULL. If creating from file, the
@@ -406,6 +548,10 @@ HiiCreateRamDisk (
 
       return EFI_DEVICE_ERROR;
     }
+
+    if (RamDiskIsCompressedImage (StartingAddr, BufferSize)) {
+      return HiiCreateCompressedRamDisk (StartingAddr, BufferSize, MemoryType);
+    }
   }
 
   //
@@ -512,14 +658,24 @@ UpdateMainForm (
     PrivateData->CheckBoxChecked = FALSE;
     String                       = RamDiskStr;
 
-    UnicodeSPrint (
-      String,
-      sizeof (RamDiskStr),
-      L"  RAM Disk %d: [0x%lx, 0x%lx]\n",
-      Index,
-      PrivateData->StartingAddr,
-      PrivateData->StartingAddr + PrivateData->Size - 1
-      );
+    if (PrivateData->Sparse != NULL) {
+      UnicodeSPrint (
+        String,
+        sizeof (RamDiskStr),
+        L"  RAM Disk %d: sparse, 0x%lx bytes\n",
+        Index,
+        PrivateData->Size
+        );
+    } else {
+      UnicodeSPrint (
+        String,
+        sizeof (RamDiskStr),
+        L"  RAM Disk %d: [0x%lx, 0x%lx]\n",
+        Index,
+        PrivateData->StartingAddr,
+        PrivateData->StartingAddr + PrivateData->Size - 1
+        );
+    }
 
     StringId = HiiSetString (ConfigPrivate->HiiHandle, 0, RamDiskStr, NULL);
     ASSERT (StringId != 0);
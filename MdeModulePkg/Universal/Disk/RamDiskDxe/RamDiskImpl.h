@@ -10,7 +10,7 @@
 #ifndef _RAM_DISK_IMPL_H_
 #define _RAM_DISK_IMPL_H_
 
-#include <Uefi.h>
+#include <PiDxe.h>
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
@@ -25,7 +25,9 @@
 #include <Library/PrintLib.h>
 #include <Library/PcdLib.h>
 #include <Library/DxeServicesLib.h>
+#include <Library/UefiDecompressLib.h>
 #include <Protocol/RamDisk.h>
+#include <Protocol/SparseRamDisk.h>
 #include <Protocol/BlockIo.h>
 #include <Protocol/BlockIo2.h>
 #include <Protocol/HiiConfigAccess.h>
@@ -48,6 +50,45 @@
 //
 #define RAM_DISK_DEFAULT_BLOCK_SIZE  512
 
+//
+// Chunk size of a sparse RAM disk without chunk source
+//
+#define RAM_DISK_SPARSE_CHUNK_SIZE  SIZE_64KB
+
+//
+// Number of chunks from the chunk source that a sparse RAM disk keeps for
+// reads
+//
+#define RAM_DISK_CHUNK_CACHE_SIZE  8
+
+//
+// How long a read waits for a chunk that the chunk source has not produced
+// yet, in microseconds, and the longest delay between two attempts
+//
+#define RAM_DISK_CHUNK_WAIT_TIMEOUT    (60 * 1000 * 1000)
+#define RAM_DISK_CHUNK_WAIT_MAX_STALL  (10 * 1000)
+
+//
+// Compressed RAM disk image, see RamDiskCompressed.c
+//
+#define RAM_DISK_COMPRESSED_IMAGE_SIGNATURE  SIGNATURE_64 ('R', 'D', 'C', 'O', 'M', 'P', 'R', 'S')
+#define RAM_DISK_COMPRESSED_IMAGE_VERSION    1
+
+#pragma pack(1)
+typedef struct {
+  UINT64    Signature;
+  UINT32    Version;
+  UINT32    ChunkSize;
+  UINT64    DiskSize;
+} RAM_DISK_COMPRESSED_IMAGE_HEADER;
+
+typedef struct {
+  UINT64    Offset;                   // From the start of the image
+  UINT32    Size;                     // 0 if the chunk contains only zeros
+  UINT32    Reserved;
+} RAM_DISK_COMPRESSED_CHUNK;
+#pragma pack()
+
 //
 // RamDiskDxe driver maintains a list of registered RAM disks.
 //
@@ -67,6 +108,30 @@ typedef enum _RAM_DISK_CREATE_METHOD {
   RamDiskCreateHii
 } RAM_DISK_CREATE_METHOD;
 
+//
+// A chunk obtained from the chunk source of a sparse RAM disk.
+//
+typedef struct {
+  UINT64    ChunkIndex;               // MAX_UINT64 if the entry is not used
+  UINT64    LastUse;
+  VOID      *Buffer;
+} RAM_DISK_CHUNK_CACHE_ENTRY;
+
+//
+// The storage of a sparse RAM disk. Chunks[] holds the chunks that have been
+// written, which belong to the RAM disk until it is unregistered. The other
+// chunks read as zeros, or as produced by Source.
+//
+typedef struct {
+  EDKII_RAM_DISK_CHUNK_SOURCE    *Source;
+  UINT32                         ChunkSize;
+  UINT64                         ChunkCount;
+  VOID                           **Chunks;
+  RAM_DISK_CHUNK_CACHE_ENTRY     Cache[RAM_DISK_CHUNK_CACHE_SIZE];
+  UINT64                         UseCount;
+  UINT32                         Id;
+} RAM_DISK_SPARSE_DATA;
+
 //
 // RamDiskDxe driver maintains a list of registered RAM disks.
 // The struct contains the list entry and the information of each RAM
@@ -91,6 +156,13 @@ typedef struct {
   EFI_QUESTION_ID             CheckBoxId;
   BOOLEAN                     CheckBoxChecked;
 
+  //
+  // NULL if the RAM disk is the memory at StartingAddr. Otherwise
+  // StartingAddr is 0 and the device path of the RAM disk ends with an
+  // EDKII_SPARSE_RAM_DISK_DEVICE_PATH node.
+  //
+  RAM_DISK_SPARSE_DATA        *Sparse;
+
   LIST_ENTRY                  ThisInstance;
 } RAM_DISK_PRIVATE_DATA;
 
@@ -99,6 +171,11 @@ typedef struct {
 #define RAM_DISK_PRIVATE_FROM_BLKIO2(a)  CR (a, RAM_DISK_PRIVATE_DATA, BlockIo2, RAM_DISK_PRIVATE_DATA_SIGNATURE)
 #define RAM_DISK_PRIVATE_FROM_THIS(a)    CR (a, RAM_DISK_PRIVATE_DATA, ThisInstance, RAM_DISK_PRIVATE_DATA_SIGNATURE)
 
+//
+// Template of the private data of a newly registered RAM disk.
+//
+extern RAM_DISK_PRIVATE_DATA  mRamDiskPrivateDataTemplate;
+
 ///
 /// RAM disk HII-related definitions and declarations
 ///
@@ -169,6 +246,208 @@ RamDiskRegister (
   OUT EFI_DEVICE_PATH_PROTOCOL  **DevicePath
   );
 
+/**
+  Register a sparse RAM disk with specified size and type.
+
+  @param[in]  RamDiskSize    The size of registered RAM disk.
+  @param[in]  RamDiskType    The type of registered RAM disk. The GUID can be
+                             any of the values defined in section 9.3.6.9, or a
+                             vendor defined GUID.
+  @param[in]  Source         The producer of the initial content of the RAM
+                             disk. If Source is NULL, the RAM disk initially
+                             reads as zeros.
+  @param[in]  ParentDevicePath
+                             Pointer to the parent device path. If there is no
+                             parent device path then ParentDevicePath is NULL.
+  @param[out] DevicePath     On return, points to a pointer to the device path
+                             of the RAM disk device, which ends with an
+                             EDKII_SPARSE_RAM_DISK_DEVICE_PATH node.
+
+  @retval EFI_SUCCESS             The RAM disk is registered successfully.
+  @retval EFI_INVALID_PARAMETER   DevicePath or RamDiskType is NULL.
+                                  RamDiskSize is 0.
+                                  The ChunkSize or ReadChunk of Source is not
+                                  valid.
+  @retval EFI_ALREADY_STARTED     A Device Path Protocol instance to be created
+                                  is already present in the handle database.
+  @retval EFI_OUT_OF_RESOURCES    The RAM disk register operation fails due to
+                                  resource limitation.
+
+**/
+EFI_STATUS
+EFIAPI
+RamDiskRegisterSparse (
+  IN UINT64                       RamDiskSize,
+  IN EFI_GUID                     *RamDiskType,
+  IN EDKII_RAM_DISK_CHUNK_SOURCE  *Source            OPTIONAL,
+  IN EFI_DEVICE_PATH              *ParentDevicePath  OPTIONAL,
+  OUT EFI_DEVICE_PATH_PROTOCOL    **DevicePath
+  );
+
+/**
+  Create the device path of a RAM disk and install the RAM disk on a new
+  handle.
+
+  @param[in]  PrivateData    Points to RAM disk private data. StartingAddr,
+                             Size, TypeGuid and Sparse are set.
+  @param[in]  ParentDevicePath
+                             Pointer to the parent device path. If there is no
+                             parent device path then ParentDevicePath is NULL.
+  @param[out] DevicePath     On return, points to a pointer to the device path
+                             of the RAM disk device.
+
+  @retval EFI_SUCCESS             The RAM disk is installed, PrivateData
+                                  belongs to the registered RAM disk list.
+  @retval EFI_ALREADY_STARTED     A Device Path Protocol instance to be created
+                                  is already present in the handle database.
+  @retval EFI_OUT_OF_RESOURCES    The RAM disk register operation fails due to
+                                  resource limitation.
+  @retval Others                  The protocols cannot be installed.
+
+**/
+EFI_STATUS
+RamDiskInstall (
+  IN  RAM_DISK_PRIVATE_DATA     *PrivateData,
+  IN  EFI_DEVICE_PATH           *ParentDevicePath     OPTIONAL,
+  OUT EFI_DEVICE_PATH_PROTOCOL  **DevicePath
+  );
+
+/**
+  Initialize the device node of a sparse RAM disk.
+
+  @param[in]      PrivateData     Points to RAM disk private data.
+  @param[in, out] SparseDevNode   Points to the sparse RAM disk device node.
+
+**/
+VOID
+RamDiskInitSparseDeviceNode (
+  IN     RAM_DISK_PRIVATE_DATA              *PrivateData,
+  IN OUT EDKII_SPARSE_RAM_DISK_DEVICE_PATH  *SparseDevNode
+  );
+
+/**
+  Free the storage of a sparse RAM disk. Nothing is done for other RAM disks.
+
+  @param[in] PrivateData     Points to RAM disk private data.
+
+**/
+VOID
+RamDiskFreeSparse (
+  IN RAM_DISK_PRIVATE_DATA  *PrivateData
+  );
+
+/**
+  Read from a sparse RAM disk.
+
+  @param[in]  PrivateData    Points to RAM disk private data.
+  @param[in]  Offset         The byte offset on the RAM disk to read from.
+  @param[in]  BufferSize     The number of bytes to read.
+  @param[out] Buffer         The buffer to receive the data.
+
+  @retval EFI_SUCCESS             The data is read.
+  @retval EFI_DEVICE_ERROR        The chunk source failed or timed out.
+  @retval EFI_OUT_OF_RESOURCES    No memory to keep a chunk from the source.
+
+**/
+EFI_STATUS
+RamDiskSparseRead (
+  IN  RAM_DISK_PRIVATE_DATA  *PrivateData,
+  IN  UINT64                 Offset,
+  IN  UINTN                  BufferSize,
+  OUT VOID                   *Buffer
+  );
+
+/**
+  Write to a sparse RAM disk.
+
+  @param[in] PrivateData     Points to RAM disk private data.
+  @param[in] Offset          The byte offset on the RAM disk to write to.
+  @param[in] BufferSize      The number of bytes to write.
+  @param[in] Buffer          The data to write.
+
+  @retval EFI_SUCCESS             The data is written.
+  @retval EFI_DEVICE_ERROR        The chunk source failed or timed out.
+  @retval EFI_OUT_OF_RESOURCES    No memory to allocate a chunk.
+
+**/
+EFI_STATUS
+RamDiskSparseWrite (
+  IN RAM_DISK_PRIVATE_DATA  *PrivateData,
+  IN UINT64                 Offset,
+  IN UINTN                  BufferSize,
+  IN VOID                   *Buffer
+  );
+
+/**
+  Check whether a buffer starts with the header of a compressed RAM disk
+  image.
+
+  @param[in] Image           The buffer to check.
+  @param[in] ImageSize       The size of the buffer in bytes.
+
+  @retval TRUE               The buffer is a compressed RAM disk image.
+  @retval FALSE              The buffer is not a compressed RAM disk image.
+
+**/
+BOOLEAN
+RamDiskIsCompressedImage (
+  IN CONST VOID  *Image,
+  IN UINTN       ImageSize
+  );
+
+/**
+  Create a chunk source that produces the content of a compressed RAM disk
+  image.
+
+  @param[in]  Image          The compressed RAM disk image, allocated from
+                             pool. On success, the chunk source owns it.
+  @param[in]  ImageSize      The size of the image in bytes.
+  @param[out] Source         On return, points to the chunk source.
+  @param[out] DiskSize       On return, the size of the RAM disk in bytes.
+
+  @retval EFI_SUCCESS             The chunk source is created.
+  @retval EFI_VOLUME_CORRUPTED    The image is not a valid compressed RAM disk
+                                  image.
+  @retval EFI_OUT_OF_RESOURCES    No memory to create the chunk source.
+
+**/
+EFI_STATUS
+RamDiskOpenCompressedImage (
+  IN  VOID                         *Image,
+  IN  UINTN                        ImageSize,
+  OUT EDKII_RAM_DISK_CHUNK_SOURCE  **Source,
+  OUT UINT64                       *DiskSize
+  );
+
+/**
+  Decompress all the chunks of a compressed RAM disk image.
+
+  @param[in]  Source         The chunk source of the image.
+  @param[out] Buffer         The buffer to receive the RAM disk content, as
+                             large as the RAM disk.
+
+  @retval EFI_SUCCESS             The RAM disk content is in Buffer.
+  @retval Others                  A chunk cannot be decompressed.
+
+**/
+EFI_STATUS
+RamDiskExpandCompressedImage (
+  IN  EDKII_RAM_DISK_CHUNK_SOURCE  *Source,
+  OUT VOID                         *Buffer
+  );
+
+/**
+  Free a chunk source created by RamDiskOpenCompressedImage() and the image
+  it owns.
+
+  @param[in] Source          The chunk source of the image.
+
+**/
+VOID
+RamDiskCloseCompressedImage (
+  IN EDKII_RAM_DISK_CHUNK_SOURCE  *Source
+  );
+
 /**
   Unregister a RAM disk specified by DevicePath.
 
@@ -150,6 +150,13 @@ RamDiskPublishNfit (
   UINT8    Checksum;
   BOOLEAN  MemoryFound;
 
+  //
+  // A sparse RAM disk is not a range of memory that the OS can be told about.
+  //
+  if (PrivateData->Sparse != NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
   //
   // Get the EFI memory map.
   //
@@ -598,12 +605,8 @@ RamDiskRegister (
   OUT EFI_DEVICE_PATH_PROTOCOL  **DevicePath
   )
 {
-  EFI_STATUS                  Status;
-  RAM_DISK_PRIVATE_DATA       *PrivateData;
-  RAM_DISK_PRIVATE_DATA       *RegisteredPrivateData;
-  MEDIA_RAM_DISK_DEVICE_PATH  *RamDiskDevNode;
-  UINTN                       DevicePathSize;
-  LIST_ENTRY                  *Entry;
+  EFI_STATUS             Status;
+  RAM_DISK_PRIVATE_DATA  *PrivateData;
 
   if ((0 == RamDiskSize) || (NULL == RamDiskType) || (NULL == DevicePath)) {
     return EFI_INVALID_PARAMETER;
@@ -618,8 +621,6 @@ RamDiskRegister (
     return EFI_INVALID_PARAMETER;
   }
 
-  RamDiskDevNode = NULL;
-
   //
   // Create a new RAM disk instance and initialize its private data
   //
@@ -634,26 +635,77 @@ RamDiskRegister (
   PrivateData->StartingAddr = RamDiskBase;
   PrivateData->Size         = RamDiskSize;
   CopyGuid (&PrivateData->TypeGuid, RamDiskType);
+
+  Status = RamDiskInstall (PrivateData, ParentDevicePath, DevicePath);
+  if (EFI_ERROR (Status)) {
+    FreePool (PrivateData);
+  }
+
+  return Status;
+}
+
+/**
+  Create the device path of a RAM disk and install the RAM disk on a new
+  handle.
+
+  @param[in]  PrivateData    Points to RAM disk private data. StartingAddr,
+                             Size, TypeGuid and Sparse are set.
+  @param[in]  ParentDevicePath
+                             Pointer to the parent device path. If there is no
+                             parent device path then ParentDevicePath is NULL.
+  @param[out] DevicePath     On return, points to a pointer to the device path
+                             of the RAM disk device.
+
+  @retval EFI_SUCCESS             The RAM disk is installed, PrivateData
+                                  belongs to the registered RAM disk list.
+  @retval EFI_ALREADY_STARTED     A Device Path Protocol instance to be created
+                                  is already present in the handle database.
+  @retval EFI_OUT_OF_RESOURCES    The RAM disk register operation fails due to
+                                  resource limitation.
+  @retval Others                  The protocols cannot be installed.
+
+**/
+EFI_STATUS
+RamDiskInstall (
+  IN  RAM_DISK_PRIVATE_DATA     *PrivateData,
+  IN  EFI_DEVICE_PATH           *ParentDevicePath     OPTIONAL,
+  OUT EFI_DEVICE_PATH_PROTOCOL  **DevicePath
+  )
+{
+  EFI_STATUS                         Status;
+  RAM_DISK_PRIVATE_DATA              *RegisteredPrivateData;
+  MEDIA_RAM_DISK_DEVICE_PATH         *RamDiskDevNode;
+  EDKII_SPARSE_RAM_DISK_DEVICE_PATH  SparseDevNode;
+  EFI_DEVICE_PATH_PROTOCOL           *DevNode;
+  UINTN                              DevicePathSize;
+  LIST_ENTRY                         *Entry;
+
   InitializeListHead (&PrivateData->ThisInstance);
 
   //
-  // Generate device path information for the registered RAM disk
+  // Generate device path information for the registered RAM disk. A sparse
+  // RAM disk is not a range of memory, so it gets a vendor-defined node
+  // instead of a RAM disk node.
   //
-  RamDiskDevNode = AllocateCopyPool (
-                     sizeof (MEDIA_RAM_DISK_DEVICE_PATH),
-                     &mRamDiskDeviceNodeTemplate
-                     );
-  if (NULL == RamDiskDevNode) {
-    Status = EFI_OUT_OF_RESOURCES;
-    goto ErrorExit;
-  }
+  RamDiskDevNode = NULL;
+  if (PrivateData->Sparse != NULL) {
+    RamDiskInitSparseDeviceNode (PrivateData, &SparseDevNode);
+    DevNode = (EFI_DEVICE_PATH_PROTOCOL *)&SparseDevNode;
+  } else {
+    RamDiskDevNode = AllocateCopyPool (
+                       sizeof (MEDIA_RAM_DISK_DEVICE_PATH),
+                       &mRamDiskDeviceNodeTemplate
+                       );
+    if (NULL == RamDiskDevNode) {
+      Status = EFI_OUT_OF_RESOURCES;
+      goto ErrorExit;
+    }
 
-  RamDiskInitDeviceNode (PrivateData, RamDiskDevNode);
+    RamDiskInitDeviceNode (PrivateData, RamDiskDevNode);
+    DevNode = (EFI_DEVICE_PATH_PROTOCOL *)RamDiskDevNode;
+  }
 
-  *DevicePath = AppendDevicePathNode (
-                  ParentDevicePath,
-                  (EFI_DEVICE_PATH_PROTOCOL *)RamDiskDevNode
-                  );
+  *DevicePath = AppendDevicePathNode (ParentDevicePath, DevNode);
   if (NULL == *DevicePath) {
     Status = EFI_OUT_OF_RESOURCES;
     goto ErrorExit;
@@ -718,7 +770,9 @@ RamDiskRegister (
 
   gBS->ConnectController (PrivateData->Handle, NULL, NULL, TRUE);
 
-  FreePool (RamDiskDevNode);
+  if (RamDiskDevNode != NULL) {
+    FreePool (RamDiskDevNode);
+  }
 
   if ((mAcpiTableProtocol != NULL) && (mAcpiSdtProtocol != NULL)) {
     RamDiskPublishNfit (PrivateData);
@@ -731,12 +785,9 @@ ErrorExit:
     FreePool (RamDiskDevNode);
   }
 
-  if (PrivateData != NULL) {
-    if (PrivateData->DevicePath) {
-      FreePool (PrivateData->DevicePath);
-    }
-
-    FreePool (PrivateData);
+  if (PrivateData->DevicePath != NULL) {
+    FreePool (PrivateData->DevicePath);
+    PrivateData->DevicePath = NULL;
   }
 
   return Status;
@@ -763,23 +814,27 @@ RamDiskUnregister (
   IN  EFI_DEVICE_PATH_PROTOCOL  *DevicePath
   )
 {
-  LIST_ENTRY                  *Entry;
-  LIST_ENTRY                  *NextEntry;
-  BOOLEAN                     Found;
-  UINT64                      StartingAddr;
-  UINT64                      EndingAddr;
-  EFI_DEVICE_PATH_PROTOCOL    *Header;
-  MEDIA_RAM_DISK_DEVICE_PATH  *RamDiskDevNode;
-  RAM_DISK_PRIVATE_DATA       *PrivateData;
+  LIST_ENTRY                         *Entry;
+  LIST_ENTRY                         *NextEntry;
+  BOOLEAN                            Found;
+  BOOLEAN                            Match;
+  UINT64                             StartingAddr;
+  UINT64                             EndingAddr;
+  EFI_DEVICE_PATH_PROTOCOL           *Header;
+  MEDIA_RAM_DISK_DEVICE_PATH         *RamDiskDevNode;
+  EDKII_SPARSE_RAM_DISK_DEVICE_PATH  *SparseDevNode;
+  RAM_DISK_PRIVATE_DATA              *PrivateData;
 
   if (NULL == DevicePath) {
     return EFI_INVALID_PARAMETER;
   }
 
   //
-  // Locate the RAM disk device node.
+  // Locate the RAM disk device node, or the device node of a sparse RAM
+  // disk.
   //
   RamDiskDevNode = NULL;
+  SparseDevNode  = NULL;
   Header         = DevicePath;
   do {
     //
@@ -793,16 +848,30 @@ RamDiskUnregister (
       break;
     }
 
+    if ((MEDIA_DEVICE_PATH == Header->Type) &&
+        (MEDIA_VENDOR_DP == Header->SubType) &&
+        (DevicePathNodeLength (Header) == sizeof (EDKII_SPARSE_RAM_DISK_DEVICE_PATH)) &&
+        CompareGuid (&((VENDOR_DEVICE_PATH *)Header)->Guid, &gEdkiiSparseRamDiskDevicePathGuid))
+    {
+      SparseDevNode = (EDKII_SPARSE_RAM_DISK_DEVICE_PATH *)Header;
+
+      break;
+    }
+
     Header = NextDevicePathNode (Header);
   } while ((Header->Type != END_DEVICE_PATH_TYPE));
 
-  if (NULL == RamDiskDevNode) {
+  if ((NULL == RamDiskDevNode) && (NULL == SparseDevNode)) {
     return EFI_UNSUPPORTED;
   }
 
   Found        = FALSE;
-  StartingAddr = ReadUnaligned64 ((UINT64 *)&(RamDiskDevNode->StartingAddr[0]));
-  EndingAddr   = ReadUnaligned64 ((UINT64 *)&(RamDiskDevNode->EndingAddr[0]));
+  StartingAddr = 0;
+  EndingAddr   = 0;
+  if (RamDiskDevNode != NULL) {
+    StartingAddr = ReadUnaligned64 ((UINT64 *)&(RamDiskDevNode->StartingAddr[0]));
+    EndingAddr   = ReadUnaligned64 ((UINT64 *)&(RamDiskDevNode->EndingAddr[0]));
+  }
 
   if (!IsListEmpty (&RegisteredRamDisks)) {
     BASE_LIST_FOR_EACH_SAFE (Entry, NextEntry, &RegisteredRamDisks) {
@@ -810,12 +879,22 @@ RamDiskUnregister (
 
       //
       // Unregister the RAM disk given by its starting address, ending address
-      // and type guid.
+      // and type guid, or the sparse RAM disk given by its Id, size and type
+      // guid.
       //
-      if ((StartingAddr == PrivateData->StartingAddr) &&
-          (EndingAddr == PrivateData->StartingAddr + PrivateData->Size - 1) &&
-          (CompareGuid (&RamDiskDevNode->TypeGuid, &PrivateData->TypeGuid)))
-      {
+      if (RamDiskDevNode != NULL) {
+        Match = (BOOLEAN)((PrivateData->Sparse == NULL) &&
+                          (StartingAddr == PrivateData->StartingAddr) &&
+                          (EndingAddr == PrivateData->StartingAddr + PrivateData->Size - 1) &&
+                          CompareGuid (&RamDiskDevNode->TypeGuid, &PrivateData->TypeGuid));
+      } else {
+        Match = (BOOLEAN)((PrivateData->Sparse != NULL) &&
+                          (SparseDevNode->Id == PrivateData->Sparse->Id) &&
+                          (SparseDevNode->Size == PrivateData->Size) &&
+                          CompareGuid (&SparseDevNode->TypeGuid, &PrivateData->TypeGuid));
+      }
+
+      if (Match) {
         //
         // Remove the content for this RAM disk in NFIT.
         //
@@ -843,11 +922,16 @@ RamDiskUnregister (
           //
           // If a RAM disk is created within HII, then the RamDiskDxe driver
           // driver is responsible for freeing the allocated memory for the
-          // RAM disk.
+          // RAM disk, or the compressed image of a sparse RAM disk.
           //
-          FreePool ((VOID *)(UINTN)PrivateData->StartingAddr);
+          if (PrivateData->Sparse == NULL) {
+            FreePool ((VOID *)(UINTN)PrivateData->StartingAddr);
+          } else if (PrivateData->Sparse->Source != NULL) {
+            RamDiskCloseCompressedImage (PrivateData->Sparse->Source);
+          }
         }
 
+        RamDiskFreeSparse (PrivateData);
         FreePool (PrivateData->DevicePath);
         FreePool (PrivateData);
         Found = TRUE;
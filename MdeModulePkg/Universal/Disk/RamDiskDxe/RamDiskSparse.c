@@ -0,0 +1,530 @@
+/** @file
+  The realization of EDKII_SPARSE_RAM_DISK_PROTOCOL.
+
+  A sparse RAM disk is split in chunks. A chunk gets memory when it is written
+  for the first time, so that a large RAM disk only costs the memory of the
+  data that has been written to it. A chunk that has never been written reads
+  as zeros, or as produced by the chunk source of the RAM disk. The chunks
+  from the chunk source are kept in a small cache, so that the source, which
+  may have to decompress or download them, is not asked for the same chunk
+  by each read of a few blocks.
+
+  The storage of a sparse RAM disk is accessed at TPL_CALLBACK so that the
+  chunk table and the cache need no lock.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "RamDiskImpl.h"
+
+EDKII_SPARSE_RAM_DISK_DEVICE_PATH  mSparseRamDiskDeviceNodeTemplate = {
+  {
+    {
+      MEDIA_DEVICE_PATH,
+      MEDIA_VENDOR_DP,
+      {
+        (UINT8)(sizeof (EDKII_SPARSE_RAM_DISK_DEVICE_PATH)),
+        (UINT8)((sizeof (EDKII_SPARSE_RAM_DISK_DEVICE_PATH)) >> 8)
+      }
+    },
+    EDKII_SPARSE_RAM_DISK_DEVICE_PATH_GUID
+  }
+};
+
+//
+// The Id of the next sparse RAM disk, which makes its device path unique.
+//
+UINT32  mSparseRamDiskNextId = 0;
+
+/**
+  Ask the chunk source of a sparse RAM disk for a chunk, waiting while the
+  chunk is not ready.
+
+  @param[in]  Sparse         Points to the storage of the sparse RAM disk.
+  @param[in]  ChunkIndex     The index of the chunk.
+  @param[out] Buffer         The buffer of ChunkSize bytes to receive the chunk.
+
+  @retval EFI_SUCCESS             The chunk is in Buffer.
+  @retval EFI_DEVICE_ERROR        The chunk source failed or timed out.
+
+**/
+STATIC
+EFI_STATUS
+RamDiskFetchChunk (
+  IN  RAM_DISK_SPARSE_DATA  *Sparse,
+  IN  UINT64                ChunkIndex,
+  OUT VOID                  *Buffer
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Waited;
+  UINTN       Delay;
+
+  Waited = 0;
+  Delay  = 1;
+  for ( ; ;) {
+    Status = Sparse->Source->ReadChunk (Sparse->Source, ChunkIndex, Buffer);
+    if (Status == EFI_NOT_FOUND) {
+      ZeroMem (Buffer, Sparse->ChunkSize);
+      return EFI_SUCCESS;
+    }
+
+    if (Status != EFI_NOT_READY) {
+      break;
+    }
+
+    if (Waited >= RAM_DISK_CHUNK_WAIT_TIMEOUT) {
+      Status = EFI_TIMEOUT;
+      break;
+    }
+
+    gBS->Stall (Delay);
+    Waited += Delay;
+    Delay   = MIN (Delay * 2, RAM_DISK_CHUNK_WAIT_MAX_STALL);
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: chunk %Lu - %r\n", __func__, ChunkIndex, Status));
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Find a chunk from the chunk source in the cache of a sparse RAM disk.
+
+  @param[in] Sparse          Points to the storage of the sparse RAM disk.
+  @param[in] ChunkIndex      The index of the chunk.
+
+  @return The cache entry of the chunk, or NULL if the chunk is not cached.
+
+**/
+STATIC
+RAM_DISK_CHUNK_CACHE_ENTRY *
+RamDiskLookupChunk (
+  IN RAM_DISK_SPARSE_DATA  *Sparse,
+  IN UINT64                ChunkIndex
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < RAM_DISK_CHUNK_CACHE_SIZE; Index++) {
+    if (Sparse->Cache[Index].ChunkIndex == ChunkIndex) {
+      return &Sparse->Cache[Index];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Get a chunk from the chunk source of a sparse RAM disk through the cache.
+  The least recently used chunk is replaced on a miss.
+
+  @param[in]  Sparse         Points to the storage of the sparse RAM disk.
+  @param[in]  ChunkIndex     The index of the chunk.
+  @param[out] Chunk          On return, points to the cached chunk.
+
+  @retval EFI_SUCCESS             The chunk is returned.
+  @retval EFI_DEVICE_ERROR        The chunk source failed or timed out.
+  @retval EFI_OUT_OF_RESOURCES    No memory for the cache entry.
+
+**/
+STATIC
+EFI_STATUS
+RamDiskCacheChunk (
+  IN  RAM_DISK_SPARSE_DATA  *Sparse,
+  IN  UINT64                ChunkIndex,
+  OUT VOID                  **Chunk
+  )
+{
+  EFI_STATUS                  Status;
+  RAM_DISK_CHUNK_CACHE_ENTRY  *Entry;
+  UINTN                       Index;
+
+  Entry = RamDiskLookupChunk (Sparse, ChunkIndex);
+  if (Entry == NULL) {
+    Entry = &Sparse->Cache[0];
+    for (Index = 1; Index < RAM_DISK_CHUNK_CACHE_SIZE; Index++) {
+      if (Sparse->Cache[Index].LastUse < Entry->LastUse) {
+        Entry = &Sparse->Cache[Index];
+      }
+    }
+
+    if (Entry->Buffer == NULL) {
+      Entry->Buffer = AllocatePool (Sparse->ChunkSize);
+      if (Entry->Buffer == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+      }
+    }
+
+    Entry->ChunkIndex = MAX_UINT64;
+    Entry->LastUse    = 0;
+    Status            = RamDiskFetchChunk (Sparse, ChunkIndex, Entry->Buffer);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Entry->ChunkIndex = ChunkIndex;
+  }
+
+  Entry->LastUse = ++Sparse->UseCount;
+  *Chunk         = Entry->Buffer;
+  return EFI_SUCCESS;
+}
+
+/**
+  Allocate the memory of a chunk of a sparse RAM disk before it is written.
+
+  @param[in] Sparse          Points to the storage of the sparse RAM disk.
+  @param[in] ChunkIndex      The index of the chunk.
+  @param[in] Fill            TRUE if the chunk is partially written, and its
+                             current content must be kept.
+
+  @retval EFI_SUCCESS             Sparse->Chunks[ChunkIndex] is allocated.
+  @retval EFI_DEVICE_ERROR        The chunk source failed or timed out.
+  @retval EFI_OUT_OF_RESOURCES    No memory for the chunk.
+
+**/
+STATIC
+EFI_STATUS
+RamDiskAllocateChunk (
+  IN RAM_DISK_SPARSE_DATA  *Sparse,
+  IN UINT64                ChunkIndex,
+  IN BOOLEAN               Fill
+  )
+{
+  EFI_STATUS                  Status;
+  RAM_DISK_CHUNK_CACHE_ENTRY  *Entry;
+  VOID                        *Chunk;
+
+  Chunk = NULL;
+  Entry = NULL;
+  if (Sparse->Source != NULL) {
+    Entry = RamDiskLookupChunk (Sparse, ChunkIndex);
+  }
+
+  if (Entry != NULL) {
+    //
+    // The RAM disk takes over the buffer of the cached chunk, which has the
+    // content from the chunk source already.
+    //
+    Chunk             = Entry->Buffer;
+    Entry->Buffer     = NULL;
+    Entry->ChunkIndex = MAX_UINT64;
+    Entry->LastUse    = 0;
+  }
+
+  if (Chunk == NULL) {
+    Chunk = AllocatePool (Sparse->ChunkSize);
+    if (Chunk == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    if (Fill) {
+      if (Sparse->Source == NULL) {
+        ZeroMem (Chunk, Sparse->ChunkSize);
+      } else {
+        Status = RamDiskFetchChunk (Sparse, ChunkIndex, Chunk);
+        if (EFI_ERROR (Status)) {
+          FreePool (Chunk);
+          return Status;
+        }
+      }
+    }
+  }
+
+  Sparse->Chunks[ChunkIndex] = Chunk;
+  return EFI_SUCCESS;
+}
+
+/**
+  Read from a sparse RAM disk.
+
+  @param[in]  PrivateData    Points to RAM disk private data.
+  @param[in]  Offset         The byte offset on the RAM disk to read from.
+  @param[in]  BufferSize     The number of bytes to read.
+  @param[out] Buffer         The buffer to receive the data.
+
+  @retval EFI_SUCCESS             The data is read.
+  @retval EFI_DEVICE_ERROR        The chunk source failed or timed out.
+  @retval EFI_OUT_OF_RESOURCES    No memory to keep a chunk from the source.
+
+**/
+EFI_STATUS
+RamDiskSparseRead (
+  IN  RAM_DISK_PRIVATE_DATA  *PrivateData,
+  IN  UINT64                 Offset,
+  IN  UINTN                  BufferSize,
+  OUT VOID                   *Buffer
+  )
+{
+  EFI_STATUS            Status;
+  RAM_DISK_SPARSE_DATA  *Sparse;
+  EFI_TPL               OldTpl;
+  UINT64                ChunkIndex;
+  UINT32                ChunkOffset;
+  UINTN                 Length;
+  VOID                  *Chunk;
+  UINT8                 *Destination;
+
+  Sparse      = PrivateData->Sparse;
+  Destination = Buffer;
+  Status      = EFI_SUCCESS;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  while (BufferSize > 0) {
+    ChunkIndex = DivU64x32Remainder (Offset, Sparse->ChunkSize, &ChunkOffset);
+    Length     = MIN (BufferSize, Sparse->ChunkSize - ChunkOffset);
+
+    Chunk = Sparse->Chunks[ChunkIndex];
+    if ((Chunk == NULL) && (Sparse->Source != NULL)) {
+      Status = RamDiskCacheChunk (Sparse, ChunkIndex, &Chunk);
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+    }
+
+    if (Chunk == NULL) {
+      ZeroMem (Destination, Length);
+    } else {
+      CopyMem (Destination, (UINT8 *)Chunk + ChunkOffset, Length);
+    }
+
+    Destination += Length;
+    Offset      += Length;
+    BufferSize  -= Length;
+  }
+
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Write to a sparse RAM disk.
+
+  @param[in] PrivateData     Points to RAM disk private data.
+  @param[in] Offset          The byte offset on the RAM disk to write to.
+  @param[in] BufferSize      The number of bytes to write.
+  @param[in] Buffer          The data to write.
+
+  @retval EFI_SUCCESS             The data is written.
+  @retval EFI_DEVICE_ERROR        The chunk source failed or timed out.
+  @retval EFI_OUT_OF_RESOURCES    No memory to allocate a chunk.
+
+**/
+EFI_STATUS
+RamDiskSparseWrite (
+  IN RAM_DISK_PRIVATE_DATA  *PrivateData,
+  IN UINT64                 Offset,
+  IN UINTN                  BufferSize,
+  IN VOID                   *Buffer
+  )
+{
+  EFI_STATUS            Status;
+  RAM_DISK_SPARSE_DATA  *Sparse;
+  EFI_TPL               OldTpl;
+  UINT64                ChunkIndex;
+  UINT32                ChunkOffset;
+  UINTN                 Length;
+  UINT8                 *Source;
+
+  Sparse = PrivateData->Sparse;
+  Source = Buffer;
+  Status = EFI_SUCCESS;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  while (BufferSize > 0) {
+    ChunkIndex = DivU64x32Remainder (Offset, Sparse->ChunkSize, &ChunkOffset);
+    Length     = MIN (BufferSize, Sparse->ChunkSize - ChunkOffset);
+
+    if (Sparse->Chunks[ChunkIndex] == NULL) {
+      Status = RamDiskAllocateChunk (
+                 Sparse,
+                 ChunkIndex,
+                 (BOOLEAN)(Length != Sparse->ChunkSize)
+                 );
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+    }
+
+    CopyMem ((UINT8 *)Sparse->Chunks[ChunkIndex] + ChunkOffset, Source, Length);
+
+    Source     += Length;
+    Offset     += Length;
+    BufferSize -= Length;
+  }
+
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Initialize the device node of a sparse RAM disk.
+
+  @param[in]      PrivateData     Points to RAM disk private data.
+  @param[in, out] SparseDevNode   Points to the sparse RAM disk device node.
+
+**/
+VOID
+RamDiskInitSparseDeviceNode (
+  IN     RAM_DISK_PRIVATE_DATA              *PrivateData,
+  IN OUT EDKII_SPARSE_RAM_DISK_DEVICE_PATH  *SparseDevNode
+  )
+{
+  CopyMem (SparseDevNode, &mSparseRamDiskDeviceNodeTemplate, sizeof (*SparseDevNode));
+  SparseDevNode->Size = PrivateData->Size;
+  CopyGuid (&SparseDevNode->TypeGuid, &PrivateData->TypeGuid);
+  SparseDevNode->Id = PrivateData->Sparse->Id;
+}
+
+/**
+  Free the storage of a sparse RAM disk. Nothing is done for other RAM disks.
+
+  @param[in] PrivateData     Points to RAM disk private data.
+
+**/
+VOID
+RamDiskFreeSparse (
+  IN RAM_DISK_PRIVATE_DATA  *PrivateData
+  )
+{
+  RAM_DISK_SPARSE_DATA  *Sparse;
+  UINT64                Index;
+
+  Sparse = PrivateData->Sparse;
+  if (Sparse == NULL) {
+    return;
+  }
+
+  for (Index = 0; Index < Sparse->ChunkCount; Index++) {
+    if (Sparse->Chunks[Index] != NULL) {
+      FreePool (Sparse->Chunks[Index]);
+    }
+  }
+
+  for (Index = 0; Index < RAM_DISK_CHUNK_CACHE_SIZE; Index++) {
+    if (Sparse->Cache[Index].Buffer != NULL) {
+      FreePool (Sparse->Cache[Index].Buffer);
+    }
+  }
+
+  FreePool (Sparse->Chunks);
+  FreePool (Sparse);
+  PrivateData->Sparse = NULL;
+}
+
+/**
+  Register a sparse RAM disk with specified size and type.
+
+  @param[in]  RamDiskSize    The size of registered RAM disk.
+  @param[in]  RamDiskType    The type of registered RAM disk. The GUID can be
+                             any of the values defined in section 9.3.6.9, or a
+                             vendor defined GUID.
+  @param[in]  Source         The producer of the initial content of the RAM
+                             disk. If Source is NULL, the RAM disk initially
+                             reads as zeros.
+  @param[in]  ParentDevicePath
+                             Pointer to the parent device path. If there is no
+                             parent device path then ParentDevicePath is NULL.
+  @param[out] DevicePath     On return, points to a pointer to the device path
+                             of the RAM disk device, which ends with an
+                             EDKII_SPARSE_RAM_DISK_DEVICE_PATH node.
+
+  @retval EFI_SUCCESS             The RAM disk is registered successfully.
+  @retval EFI_INVALID_PARAMETER   DevicePath or RamDiskType is NULL.
+                                  RamDiskSize is 0.
+                                  The ChunkSize or ReadChunk of Source is not
+                                  valid.
+  @retval EFI_ALREADY_STARTED     A Device Path Protocol instance to be created
+                                  is already present in the handle database.
+  @retval EFI_OUT_OF_RESOURCES    The RAM disk register operation fails due to
+                                  resource limitation.
+
+**/
+EFI_STATUS
+EFIAPI
+RamDiskRegisterSparse (
+  IN UINT64                       RamDiskSize,
+  IN EFI_GUID                     *RamDiskType,
+  IN EDKII_RAM_DISK_CHUNK_SOURCE  *Source            OPTIONAL,
+  IN EFI_DEVICE_PATH              *ParentDevicePath  OPTIONAL,
+  OUT EFI_DEVICE_PATH_PROTOCOL    **DevicePath
+  )
+{
+  EFI_STATUS             Status;
+  RAM_DISK_PRIVATE_DATA  *PrivateData;
+  RAM_DISK_SPARSE_DATA   *Sparse;
+  UINT32                 ChunkSize;
+  UINT64                 ChunkCount;
+  UINTN                  Index;
+
+  if ((0 == RamDiskSize) || (NULL == RamDiskType) || (NULL == DevicePath)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ChunkSize = RAM_DISK_SPARSE_CHUNK_SIZE;
+  if (Source != NULL) {
+    if ((Source->ReadChunk == NULL) ||
+        (Source->ChunkSize < RAM_DISK_DEFAULT_BLOCK_SIZE) ||
+        ((Source->ChunkSize & (Source->ChunkSize - 1)) != 0))
+    {
+      return EFI_INVALID_PARAMETER;
+    }
+
+    ChunkSize = Source->ChunkSize;
+  }
+
+  if (RamDiskSize > MAX_UINT64 - ChunkSize + 1) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ChunkCount = DivU64x32 (RamDiskSize + ChunkSize - 1, ChunkSize);
+  if (ChunkCount > MAX_UINTN / sizeof (VOID *)) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Sparse = AllocateZeroPool (sizeof (RAM_DISK_SPARSE_DATA));
+  if (Sparse == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Sparse->Source     = Source;
+  Sparse->ChunkSize  = ChunkSize;
+  Sparse->ChunkCount = ChunkCount;
+  Sparse->Id         = mSparseRamDiskNextId++;
+  for (Index = 0; Index < RAM_DISK_CHUNK_CACHE_SIZE; Index++) {
+    Sparse->Cache[Index].ChunkIndex = MAX_UINT64;
+  }
+
+  Sparse->Chunks = AllocateZeroPool ((UINTN)ChunkCount * sizeof (VOID *));
+  if (Sparse->Chunks == NULL) {
+    FreePool (Sparse);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  PrivateData = AllocateCopyPool (
+                  sizeof (RAM_DISK_PRIVATE_DATA),
+                  &mRamDiskPrivateDataTemplate
+                  );
+  if (NULL == PrivateData) {
+    FreePool (Sparse->Chunks);
+    FreePool (Sparse);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  PrivateData->Size   = RamDiskSize;
+  PrivateData->Sparse = Sparse;
+  CopyGuid (&PrivateData->TypeGuid, RamDiskType);
+
+  Status = RamDiskInstall (PrivateData, ParentDevicePath, DevicePath);
+  if (EFI_ERROR (Status)) {
+    RamDiskFreeSparse (PrivateData);
+    FreePool (PrivateData);
+  }
+
+  return Status;
+}
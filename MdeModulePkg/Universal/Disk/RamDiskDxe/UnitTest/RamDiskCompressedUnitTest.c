@@ -0,0 +1,335 @@
+/** @file
+  Host-based unit tests for the chunk source of RAM disks created from a
+  compressed RAM disk image.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../RamDiskImpl.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "RAM Disk Compressed Image Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_CHUNK_SIZE  512
+#define TEST_DISK_SIZE   (2 * TEST_CHUNK_SIZE + 256)
+
+//
+// BaseTools/Scripts/CompressRamDiskImage.py -c 512 of the disk built by
+// FillDisk(): a chunk of data, a chunk of zeros and a 256-byte last chunk.
+//
+STATIC CONST UINT8  mImage[] = {
+  0x52, 0x44, 0x43, 0x4f, 0x4d, 0x50, 0x52, 0x53, 0x01, 0x00, 0x00, 0x00,
+  0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x48, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x02, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x56, 0x02, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x06, 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x01, 0xc0, 0x64, 0x03,
+  0x80, 0x32, 0xa0, 0x38, 0x57, 0x41, 0xdc, 0x82, 0xba, 0x86, 0xd9, 0xb1,
+  0x5d, 0x07, 0x72, 0x0a, 0xea, 0x1b, 0x65, 0x9b, 0x30, 0x2b, 0xa5, 0xa9,
+  0xac, 0x2b, 0xab, 0x59, 0x0c, 0x57, 0x4b, 0x53, 0x58, 0x57, 0x5b, 0x6c,
+  0x70, 0x36, 0xcc, 0x2b, 0xa0, 0xee, 0x41, 0x5d, 0x43, 0x6c, 0xc2, 0xba,
+  0x0e, 0xe4, 0xb5, 0x35, 0x85, 0x75, 0x6b, 0x2d, 0x98, 0xae, 0x96, 0xa6,
+  0xb0, 0xae, 0xad, 0x64, 0x05, 0x75, 0xe0, 0xc2, 0x36, 0x8e, 0xbb, 0x71,
+  0x2f, 0xf0, 0x50, 0xd1, 0x24, 0x23, 0xf8, 0x72, 0xb2, 0xe6, 0x67, 0x0d,
+  0xd0, 0x75, 0xe9, 0x92, 0x56, 0x57, 0xdb, 0xdd, 0x26, 0xf1, 0xe1, 0xfa,
+  0x56, 0x2d, 0xcb, 0xfa, 0xfd, 0x34, 0x1a, 0xea, 0x80, 0xc5, 0x3d, 0xbf,
+  0xc0, 0x43, 0x00, 0xcb, 0x71, 0x8b, 0x99, 0x9d, 0x01, 0xd5, 0xd3, 0xd6,
+  0x58, 0xdb, 0x80, 0xd6, 0x7b, 0x15, 0xfc, 0x72, 0x74, 0x59, 0x6b, 0x35,
+  0xd3, 0xda, 0xec, 0x85, 0x3c, 0x41, 0x8c, 0x8a, 0x1f, 0xbe, 0xe2, 0x94,
+  0x96, 0x94, 0x9e, 0x33, 0x33, 0xd8, 0x39, 0x56, 0x7a, 0xc2, 0xb5, 0x35,
+  0xd5, 0xb6, 0x02, 0x90, 0x1f, 0xbf, 0xdd, 0xa3, 0x9b, 0xac, 0x03, 0x16,
+  0xf4, 0xed, 0x06, 0xfc, 0x03, 0x8f, 0xe1, 0x4b, 0x15, 0x9e, 0x01, 0xa5,
+  0xee, 0x59, 0xd2, 0xa2, 0xbe, 0xc1, 0xb5, 0xb8, 0x50, 0xc3, 0xe1, 0x8b,
+  0x8e, 0xdb, 0x55, 0x96, 0x77, 0xdf, 0x70, 0x2d, 0xb9, 0xc6, 0x22, 0x2c,
+  0x76, 0xee, 0x13, 0x92, 0x5c, 0x8c, 0x97, 0x57, 0xa9, 0x44, 0x62, 0x70,
+  0x06, 0x8e, 0xa6, 0xfa, 0xfe, 0xd4, 0x06, 0xaf, 0xcc, 0xb1, 0xb6, 0xb8,
+  0x0d, 0xf7, 0x72, 0xdc, 0xe7, 0x10, 0x03, 0x2f, 0xcc, 0x2d, 0xc4, 0x27,
+  0x46, 0x6c, 0xd1, 0x89, 0xae, 0xef, 0x69, 0x1a, 0x0c, 0x25, 0x37, 0x29,
+  0xfb, 0xdf, 0x25, 0xf8, 0xd8, 0x9b, 0x0d, 0xb4, 0xbf, 0x0c, 0xdf, 0x5d,
+  0x9c, 0x9b, 0xc7, 0x45, 0xc3, 0xc0, 0x8c, 0x01, 0xc7, 0x46, 0xd1, 0xcf,
+  0x9a, 0x01, 0xa4, 0xa8, 0x3d, 0x85, 0x7a, 0x03, 0x61, 0xed, 0xc6, 0x55,
+  0xb0, 0x03, 0x19, 0xbc, 0x84, 0xdf, 0x8e, 0x70, 0x73, 0x77, 0x7a, 0x17,
+  0x37, 0xd0, 0xa0, 0xa2, 0x25, 0x20, 0x56, 0x57, 0x95, 0xe0, 0x51, 0x79,
+  0x7e, 0x86, 0xa9, 0x17, 0x6e, 0xcf, 0xec, 0xd1, 0xae, 0xbf, 0xa3, 0xcf,
+  0x8e, 0xb7, 0x28, 0x06, 0x3e, 0x29, 0xc1, 0xc5, 0xdc, 0x06, 0x73, 0xa6,
+  0x74, 0x94, 0x90, 0x0e, 0xef, 0xc3, 0x79, 0x82, 0x84, 0x06, 0xd3, 0xf2,
+  0xcf, 0xfd, 0xa5, 0x90, 0xa9, 0x8a, 0xd5, 0xfb, 0xdd, 0xd0, 0xf8, 0x77,
+  0x41, 0x0f, 0x62, 0xb6, 0xdd, 0x29, 0xaa, 0x19, 0xf9, 0x32, 0x44, 0xf9,
+  0x65, 0xae, 0xed, 0x30, 0x2f, 0x51, 0x55, 0x20, 0xb0, 0x4a, 0x03, 0xfe,
+  0x7e, 0xf2, 0x31, 0x18, 0x80, 0xc8, 0x44, 0xc2, 0xba, 0x37, 0x80, 0xe6,
+  0xf9, 0xb4, 0x26, 0xe4, 0xc0, 0x6a, 0x7c, 0x98, 0x7d, 0xf4, 0xd5, 0xd6,
+  0x27, 0xea, 0x12, 0x6a, 0x7f, 0x73, 0xb4, 0x17, 0x65, 0x2a, 0xc5, 0xf5,
+  0x70, 0x08, 0x0d, 0x80, 0x79, 0x7c, 0x13, 0xb3, 0x75, 0xeb, 0x1d, 0x31,
+  0x3b, 0xc8, 0xe3, 0xcb, 0x91, 0x90, 0x01, 0xa7, 0xb9, 0xae, 0xaf, 0x3e,
+  0x03, 0x67, 0xf3, 0x68, 0xbb, 0x2c, 0x07, 0x19, 0xc1, 0x1b, 0x04, 0xf2,
+  0x03, 0x3b, 0xd9, 0x39, 0xd1, 0x99, 0x98, 0x2b, 0x22, 0x44, 0xa7, 0x97,
+  0xc4, 0x9e, 0xda, 0xc9, 0x2d, 0x4a, 0x3a, 0x4f, 0xfe, 0x9e, 0x7e, 0x6e,
+  0x62, 0xec, 0x9f, 0x5a, 0xb8, 0xc8, 0x58, 0x17, 0xe1, 0x2f, 0x8f, 0x0e,
+  0x42, 0x00, 0x7c, 0xfe, 0x74, 0xc4, 0xa4, 0x88, 0x0d, 0x45, 0xc5, 0xa5,
+  0x95, 0x68, 0x0f, 0x53, 0xf5, 0x9e, 0xcb, 0x30, 0x06, 0x00, 0x20, 0x00,
+  0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x1b, 0x40, 0x0b, 0x47, 0xc9,
+  0x0b, 0x40, 0xc3, 0xfc, 0x00, 0x57, 0x40, 0x2a, 0x96, 0xc6, 0xb9, 0xe1,
+  0x08, 0xca, 0x62, 0x46, 0x94, 0xad, 0xaf, 0x8c, 0xeb, 0x7c, 0xef, 0xbf,
+  0x20, 0x00,
+};
+
+STATIC UINT8  mDisk[TEST_DISK_SIZE];
+
+/**
+  Build the disk that mImage was created from.
+**/
+STATIC
+VOID
+FillDisk (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < TEST_CHUNK_SIZE; Index++) {
+    mDisk[Index] = (UINT8)((Index * 7) ^ (Index >> 3));
+  }
+
+  ZeroMem (&mDisk[TEST_CHUNK_SIZE], TEST_CHUNK_SIZE);
+  for (Index = 0; Index < 256; Index++) {
+    mDisk[2 * TEST_CHUNK_SIZE + Index] = (UINT8)('A' + Index % 26);
+  }
+}
+
+/**
+  Open a copy of mImage after a change of one of its fields.
+
+  @param[in]  Offset     The offset of the field to change.
+  @param[in]  Value      The new value of the 32-bit field.
+  @param[in]  ImageSize  The size of the image to open.
+  @param[out] Source     On success, the chunk source.
+
+  @return The status of RamDiskOpenCompressedImage().
+**/
+STATIC
+EFI_STATUS
+OpenPatchedImage (
+  IN  UINTN                        Offset,
+  IN  UINT32                       Value,
+  IN  UINTN                        ImageSize,
+  OUT EDKII_RAM_DISK_CHUNK_SOURCE  **Source
+  )
+{
+  UINT8       *Image;
+  UINT64      DiskSize;
+  EFI_STATUS  Status;
+
+  Image = AllocateCopyPool (sizeof (mImage), mImage);
+  if (Image == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  WriteUnaligned32 ((UINT32 *)(Image + Offset), Value);
+  Status = RamDiskOpenCompressedImage (Image, ImageSize, Source, &DiskSize);
+  if (EFI_ERROR (Status)) {
+    FreePool (Image);
+  }
+
+  return Status;
+}
+
+/**
+  Read the chunks of a compressed image one by one and all at once.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The chunks match the disk.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A chunk does not match the disk.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ChunksMatchDisk (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EDKII_RAM_DISK_CHUNK_SOURCE  *Source;
+  UINT8                        *Image;
+  UINT64                       DiskSize;
+  UINT8                        Chunk[TEST_CHUNK_SIZE];
+  UINT8                        Disk[TEST_DISK_SIZE];
+
+  FillDisk ();
+  UT_ASSERT_TRUE (RamDiskIsCompressedImage (mImage, sizeof (mImage)));
+  UT_ASSERT_FALSE (RamDiskIsCompressedImage (mDisk, sizeof (mDisk)));
+  UT_ASSERT_FALSE (RamDiskIsCompressedImage (mImage, sizeof (RAM_DISK_COMPRESSED_IMAGE_HEADER) - 1));
+
+  Image = AllocateCopyPool (sizeof (mImage), mImage);
+  UT_ASSERT_NOT_NULL (Image);
+  UT_ASSERT_NOT_EFI_ERROR (RamDiskOpenCompressedImage (Image, sizeof (mImage), &Source, &DiskSize));
+  UT_ASSERT_EQUAL (DiskSize, TEST_DISK_SIZE);
+  UT_ASSERT_EQUAL (Source->ChunkSize, TEST_CHUNK_SIZE);
+
+  SetMem (Chunk, sizeof (Chunk), 0xAA);
+  UT_ASSERT_NOT_EFI_ERROR (Source->ReadChunk (Source, 0, Chunk));
+  UT_ASSERT_MEM_EQUAL (Chunk, mDisk, TEST_CHUNK_SIZE);
+
+  UT_ASSERT_STATUS_EQUAL (Source->ReadChunk (Source, 1, Chunk), EFI_NOT_FOUND);
+
+  SetMem (Chunk, sizeof (Chunk), 0xAA);
+  UT_ASSERT_NOT_EFI_ERROR (Source->ReadChunk (Source, 2, Chunk));
+  UT_ASSERT_MEM_EQUAL (Chunk, &mDisk[2 * TEST_CHUNK_SIZE], 256);
+
+  UT_ASSERT_STATUS_EQUAL (Source->ReadChunk (Source, 3, Chunk), EFI_INVALID_PARAMETER);
+
+  SetMem (Disk, sizeof (Disk), 0xAA);
+  UT_ASSERT_NOT_EFI_ERROR (RamDiskExpandCompressedImage (Source, Disk));
+  UT_ASSERT_MEM_EQUAL (Disk, mDisk, TEST_DISK_SIZE);
+
+  RamDiskCloseCompressedImage (Source);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Check that images with a bad header, chunk table or chunk are rejected
+  when they are opened.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The images are rejected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  An image is accepted.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CorruptedImagesAreRejected (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EDKII_RAM_DISK_CHUNK_SOURCE  *Source;
+  UINTN                        Version;
+  UINTN                        ChunkSize;
+  UINTN                        DiskSize;
+  UINTN                        Chunk0;
+  UINTN                        Chunk2;
+
+  Version   = OFFSET_OF (RAM_DISK_COMPRESSED_IMAGE_HEADER, Version);
+  ChunkSize = OFFSET_OF (RAM_DISK_COMPRESSED_IMAGE_HEADER, ChunkSize);
+  DiskSize  = OFFSET_OF (RAM_DISK_COMPRESSED_IMAGE_HEADER, DiskSize);
+  Chunk0    = sizeof (RAM_DISK_COMPRESSED_IMAGE_HEADER);
+  Chunk2    = Chunk0 + 2 * sizeof (RAM_DISK_COMPRESSED_CHUNK);
+
+  //
+  // The unchanged image opens.
+  //
+  UT_ASSERT_NOT_EFI_ERROR (OpenPatchedImage (Version, RAM_DISK_COMPRESSED_IMAGE_VERSION, sizeof (mImage), &Source));
+  RamDiskCloseCompressedImage (Source);
+
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (Version, 2, sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (ChunkSize, 256, sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (ChunkSize, 768, sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (DiskSize, 0, sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+
+  //
+  // The last chunk does not decompress to the end of the disk.
+  //
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (DiskSize, TEST_DISK_SIZE + 1, sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+
+  //
+  // The chunk table does not fit in the image.
+  //
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (DiskSize, 0x10000, sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+
+  //
+  // A chunk is beyond the end of the image, or the image is truncated.
+  //
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (Chunk0, sizeof (mImage), sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (Chunk2, MAX_UINT32, sizeof (mImage), &Source), EFI_VOLUME_CORRUPTED);
+  UT_ASSERT_STATUS_EQUAL (OpenPatchedImage (Version, RAM_DISK_COMPRESSED_IMAGE_VERSION, sizeof (mImage) - 1, &Source), EFI_VOLUME_CORRUPTED);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the chunk
+  source of compressed RAM disk images and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      CompressedTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&CompressedTests, Framework, "RAM Disk Compressed Image Tests", "RamDisk.Compressed", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for RAM Disk Compressed Image Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite--------------Description-----------------------------Name-------------Function--------------------Pre---Post---Context
+  //
+  AddTestCase (CompressedTests, "Chunks of an image match the disk", "Chunks", ChunksMatchDisk, NULL, NULL, NULL);
+  AddTestCase (CompressedTests, "Corrupted images are rejected", "Corrupted", CorruptedImagesAreRejected, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define RamDiskCompressedUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+RamDiskCompressedUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
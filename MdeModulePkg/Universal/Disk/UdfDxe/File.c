@@ -239,6 +239,7 @@ UdfOpen (
     sizeof (PRIVATE_UDF_FILE_DATA)
     );
   CopyMem ((VOID *)&NewPrivFileData->File, &File, sizeof (UDF_FILE_INFO));
+  ZeroMem ((VOID *)&NewPrivFileData->ExtentTable, sizeof (UDF_FILE_EXTENT_TABLE));
 
   NewPrivFileData->IsRootDirectory = FALSE;
 
@@ -382,6 +383,7 @@ UdfRead (
                DiskIo,
                Volume,
                Parent,
+               &PrivFileData->ExtentTable,
                PrivFileData->FileSize,
                &PrivFileData->FilePosition,
                Buffer,
@@ -570,6 +572,8 @@ UdfClose (
     if (PrivFileData->ReadDirInfo.DirectoryData != NULL) {
       FreePool (PrivFileData->ReadDirInfo.DirectoryData);
     }
+
+    FreeFileExtentTable (&PrivFileData->ExtentTable);
   }
 
   FreePool ((VOID *)PrivFileData);
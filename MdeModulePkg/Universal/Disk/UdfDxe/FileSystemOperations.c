@@ -1053,6 +1053,68 @@ GrowUpBufferToNextAd (
   return EFI_SUCCESS;
 }
 
+/**
+  Append an extent of recorded data to the extent table of a file, merging it
+  into the last extent if it follows that extent on the disk.
+
+  @param[in, out] ExtentTable     The extent table of the file.
+  @param[in]      FileOffset      Offset of the extent in the file.
+  @param[in]      DiskOffset      Byte offset of the extent on the disk.
+  @param[in]      Length          Length of the extent.
+
+  @retval EFI_SUCCESS             The extent was added.
+  @retval EFI_OUT_OF_RESOURCES    The table cannot grow due to lack of
+                                  resources.
+
+**/
+EFI_STATUS
+AddFileExtent (
+  IN OUT  UDF_FILE_EXTENT_TABLE  *ExtentTable,
+  IN      UINT64                 FileOffset,
+  IN      UINT64                 DiskOffset,
+  IN      UINT64                 Length
+  )
+{
+  UDF_FILE_EXTENT  *Extent;
+  UINTN            MaxExtents;
+
+  if (Length == 0) {
+    return EFI_SUCCESS;
+  }
+
+  if (ExtentTable->ExtentCount > 0) {
+    Extent = &ExtentTable->Extents[ExtentTable->ExtentCount - 1];
+    if ((Extent->FileOffset + Extent->Length == FileOffset) &&
+        (Extent->DiskOffset + Extent->Length == DiskOffset))
+    {
+      Extent->Length += Length;
+      return EFI_SUCCESS;
+    }
+  }
+
+  if (ExtentTable->ExtentCount == ExtentTable->MaxExtents) {
+    MaxExtents = MAX (ExtentTable->MaxExtents * 2, 8);
+    Extent     = ReallocatePool (
+                   ExtentTable->MaxExtents * sizeof (UDF_FILE_EXTENT),
+                   MaxExtents * sizeof (UDF_FILE_EXTENT),
+                   ExtentTable->Extents
+                   );
+    if (Extent == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    ExtentTable->Extents    = Extent;
+    ExtentTable->MaxExtents = MaxExtents;
+  }
+
+  Extent             = &ExtentTable->Extents[ExtentTable->ExtentCount++];
+  Extent->FileOffset = FileOffset;
+  Extent->DiskOffset = DiskOffset;
+  Extent->Length     = Length;
+
+  return EFI_SUCCESS;
+}
+
 /**
   Read data or size of either a File Entry or an Extended File Entry.
 
@@ -1116,9 +1178,10 @@ ReadFile (
   switch (ReadFileInfo->Flags) {
     case ReadFileGetFileSize:
     case ReadFileAllocateAndRead:
+    case ReadFileGetExtents:
       //
       // Initialise ReadFileInfo structure for either getting file size, or
-      // reading file's recorded data.
+      // reading file's recorded data, or collecting file's extents.
       //
       ReadFileInfo->ReadLength = 0;
       ReadFileInfo->FileData   = NULL;
@@ -1270,6 +1333,19 @@ ReadFile (
 
         switch (ReadFileInfo->Flags) {
           case ReadFileGetFileSize:
+            ReadFileInfo->ReadLength += ExtentLength;
+            break;
+          case ReadFileGetExtents:
+            Status = AddFileExtent (
+                       ReadFileInfo->ExtentTable,
+                       ReadFileInfo->ReadLength,
+                       MultU64x32 (Lsn, LogicalBlockSize),
+                       ExtentLength
+                       );
+            if (EFI_ERROR (Status)) {
+              goto Done;
+            }
+
             ReadFileInfo->ReadLength += ExtentLength;
             break;
           case ReadFileAllocateAndRead:
@@ -2407,6 +2483,24 @@ CleanupFileInformation (
   ZeroMem ((VOID *)File, sizeof (UDF_FILE_INFO));
 }
 
+/**
+  Free the extent table of a file.
+
+  @param[in, out] ExtentTable   The extent table to free.
+
+**/
+VOID
+FreeFileExtentTable (
+  IN OUT UDF_FILE_EXTENT_TABLE  *ExtentTable
+  )
+{
+  if (ExtentTable->Extents != NULL) {
+    FreePool (ExtentTable->Extents);
+  }
+
+  ZeroMem ((VOID *)ExtentTable, sizeof (UDF_FILE_EXTENT_TABLE));
+}
+
 /**
   Find a file from its absolute path on an UDF volume.
 
@@ -2848,6 +2942,110 @@ Out_Free:
   return Status;
 }
 
+/**
+  Read file data through the extent table of the file. Each run of data that
+  is contiguous on the disk is read with a single DiskIo request.
+
+  @param[in]      BlockIo       BlockIo interface.
+  @param[in]      DiskIo        DiskIo interface.
+  @param[in]      ExtentTable   The extent table of the file.
+  @param[in]      FileSize      Size of the file.
+  @param[in, out] FilePosition  File position.
+  @param[in, out] Buffer        File data.
+  @param[in, out] BufferSize    Read size.
+
+  @retval EFI_SUCCESS          File data read.
+  @retval EFI_NO_MEDIA         The device has no media.
+  @retval EFI_DEVICE_ERROR     The device reported an error.
+  @retval EFI_VOLUME_CORRUPTED The extents do not cover the file.
+
+**/
+EFI_STATUS
+ReadFileExtents (
+  IN      EFI_BLOCK_IO_PROTOCOL  *BlockIo,
+  IN      EFI_DISK_IO_PROTOCOL   *DiskIo,
+  IN      UDF_FILE_EXTENT_TABLE  *ExtentTable,
+  IN      UINT64                 FileSize,
+  IN OUT  UINT64                 *FilePosition,
+  IN OUT  VOID                   *Buffer,
+  IN OUT  UINT64                 *BufferSize
+  )
+{
+  EFI_STATUS       Status;
+  UDF_FILE_EXTENT  *Extent;
+  UINTN            Low;
+  UINTN            High;
+  UINTN            Middle;
+  UINT64           Position;
+  UINT64           BytesLeft;
+  UINT64           Offset;
+  UINT64           DataLength;
+  UINT8            *Data;
+
+  if (*BufferSize > FileSize - *FilePosition) {
+    //
+    // About to read beyond the EOF -- truncate it.
+    //
+    *BufferSize = FileSize - *FilePosition;
+  }
+
+  Position  = *FilePosition;
+  BytesLeft = *BufferSize;
+  Data      = Buffer;
+  if (BytesLeft == 0) {
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Find the last extent that starts at or before Position.
+  //
+  Low  = 0;
+  High = ExtentTable->ExtentCount;
+  while (High - Low > 1) {
+    Middle = Low + (High - Low) / 2;
+    if (ExtentTable->Extents[Middle].FileOffset <= Position) {
+      Low = Middle;
+    } else {
+      High = Middle;
+    }
+  }
+
+  for ( ; BytesLeft > 0; Low++) {
+    if (Low >= ExtentTable->ExtentCount) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    Extent = &ExtentTable->Extents[Low];
+    if ((Position < Extent->FileOffset) ||
+        (Position >= Extent->FileOffset + Extent->Length))
+    {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    Offset     = Position - Extent->FileOffset;
+    DataLength = MIN (Extent->Length - Offset, BytesLeft);
+
+    Status = DiskIo->ReadDisk (
+                       DiskIo,
+                       BlockIo->Media->MediaId,
+                       Extent->DiskOffset + Offset,
+                       (UINTN)DataLength,
+                       Data
+                       );
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Data      += DataLength;
+    Position  += DataLength;
+    BytesLeft -= DataLength;
+  }
+
+  *FilePosition = Position;
+
+  return EFI_SUCCESS;
+}
+
 /**
   Seek a file and read its data into memory on an UDF volume.
 
@@ -2855,6 +3053,9 @@ Out_Free:
   @param[in]      DiskIo        DiskIo interface.
   @param[in]      Volume        UDF volume information structure.
   @param[in]      File          File information structure.
+  @param[in, out] ExtentTable   The extent table of the file. It is built on
+                                the first read of the file, and freed with
+                                FreeFileExtentTable().
   @param[in]      FileSize      Size of the file.
   @param[in, out] FilePosition  File position.
   @param[in, out] Buffer        File data.
@@ -2875,14 +3076,53 @@ ReadFileData (
   IN      EFI_DISK_IO_PROTOCOL   *DiskIo,
   IN      UDF_VOLUME_INFO        *Volume,
   IN      UDF_FILE_INFO          *File,
+  IN OUT  UDF_FILE_EXTENT_TABLE  *ExtentTable,
   IN      UINT64                 FileSize,
   IN OUT  UINT64                 *FilePosition,
   IN OUT  VOID                   *Buffer,
   IN OUT  UINT64                 *BufferSize
   )
 {
-  EFI_STATUS          Status;
-  UDF_READ_FILE_INFO  ReadFileInfo;
+  EFI_STATUS              Status;
+  UDF_READ_FILE_INFO      ReadFileInfo;
+  UDF_FE_RECORDING_FLAGS  RecordingFlags;
+
+  RecordingFlags = GET_FE_RECORDING_FLAGS (File->FileEntry);
+  if ((RecordingFlags == LongAdsSequence) ||
+      (RecordingFlags == ShortAdsSequence))
+  {
+    //
+    // Decode the Allocation Descriptors once, rather than walking them from
+    // the start for each read.
+    //
+    if (ExtentTable->Extents == NULL) {
+      ReadFileInfo.Flags       = ReadFileGetExtents;
+      ReadFileInfo.ExtentTable = ExtentTable;
+
+      Status = ReadFile (
+                 BlockIo,
+                 DiskIo,
+                 Volume,
+                 &File->FileIdentifierDesc->Icb,
+                 File->FileEntry,
+                 &ReadFileInfo
+                 );
+      if (EFI_ERROR (Status)) {
+        FreeFileExtentTable (ExtentTable);
+        return Status;
+      }
+    }
+
+    return ReadFileExtents (
+             BlockIo,
+             DiskIo,
+             ExtentTable,
+             FileSize,
+             FilePosition,
+             Buffer,
+             BufferSize
+             );
+  }
 
   ReadFileInfo.Flags        = ReadFileSeekAndRead;
   ReadFileInfo.FilePosition = *FilePosition;
@@ -134,15 +134,38 @@ typedef enum {
   ReadFileGetFileSize,
   ReadFileAllocateAndRead,
   ReadFileSeekAndRead,
+  ReadFileGetExtents,
 } UDF_READ_FILE_FLAGS;
 
+//
+// A run of recorded file data. FileOffset is the offset of the run in the
+// file, DiskOffset the byte offset of the run on the disk.
+//
+typedef struct {
+  UINT64    FileOffset;
+  UINT64    DiskOffset;
+  UINT64    Length;
+} UDF_FILE_EXTENT;
+
+//
+// The recorded extents of a file in file order, decoded once from its
+// Allocation Descriptors. Extents that follow each other on the disk are
+// merged.
+//
+typedef struct {
+  UDF_FILE_EXTENT    *Extents;
+  UINTN              ExtentCount;
+  UINTN              MaxExtents;
+} UDF_FILE_EXTENT_TABLE;
+
 typedef struct {
-  VOID                   *FileData;
-  UDF_READ_FILE_FLAGS    Flags;
-  UINT64                 FileDataSize;
-  UINT64                 FilePosition;
-  UINT64                 FileSize;
-  UINT64                 ReadLength;
+  VOID                     *FileData;
+  UDF_READ_FILE_FLAGS      Flags;
+  UINT64                   FileDataSize;
+  UINT64                   FilePosition;
+  UINT64                   FileSize;
+  UINT64                   ReadLength;
+  UDF_FILE_EXTENT_TABLE    *ExtentTable;
 } UDF_READ_FILE_INFO;
 
 #pragma pack(1)
@@ -353,6 +376,7 @@ typedef struct {
   CHAR16                             FileName[UDF_FILENAME_LENGTH];
   UINT64                             FileSize;
   UINT64                             FilePosition;
+  UDF_FILE_EXTENT_TABLE              ExtentTable;
 } PRIVATE_UDF_FILE_DATA;
 
 #define PRIVATE_UDF_SIMPLE_FS_DATA_SIGNATURE  SIGNATURE_32 ('U', 'd', 'f', 's')
@@ -841,6 +865,17 @@ CleanupFileInformation (
   IN UDF_FILE_INFO  *File
   );
 
+/**
+  Free the extent table of a file.
+
+  @param[in, out] ExtentTable   The extent table to free.
+
+**/
+VOID
+FreeFileExtentTable (
+  IN OUT UDF_FILE_EXTENT_TABLE  *ExtentTable
+  );
+
 /**
   Find a file from its absolute path on an UDF volume.
 
@@ -961,6 +996,9 @@ GetVolumeSize (
   @param[in]      DiskIo        DiskIo interface.
   @param[in]      Volume        UDF volume information structure.
   @param[in]      File          File information structure.
+  @param[in, out] ExtentTable   The extent table of the file. It is built on
+                                the first read of the file, and freed with
+                                FreeFileExtentTable().
   @param[in]      FileSize      Size of the file.
   @param[in, out] FilePosition  File position.
   @param[in, out] Buffer        File data.
@@ -981,6 +1019,7 @@ ReadFileData (
   IN      EFI_DISK_IO_PROTOCOL   *DiskIo,
   IN      UDF_VOLUME_INFO        *Volume,
   IN      UDF_FILE_INFO          *File,
+  IN OUT  UDF_FILE_EXTENT_TABLE  *ExtentTable,
   IN      UINT64                 FileSize,
   IN OUT  UINT64                 *FilePosition,
   IN OUT  VOID                   *Buffer,
@@ -0,0 +1,500 @@
+/** @file
+  Host-based unit tests for the extent table the UDF driver reads files
+  through, on a simulated disk.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../Udf.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "UDF Extent Table Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_BLOCK_SIZE       512
+#define TEST_DISK_SIZE        SIZE_64KB
+#define TEST_PARTITION_START  16
+#define TEST_FILE_ENTRY_SIZE  TEST_BLOCK_SIZE
+
+///
+/// An Allocation Descriptor of the test file
+///
+typedef struct {
+  UINT32    Block;      ///< Logical block in the partition
+  UINT32    Length;     ///< Length in bytes
+  BOOLEAN   Recorded;
+} TEST_AD;
+
+///
+/// Functions of the driver that its header does not declare
+///
+EFI_STATUS
+AddFileExtent (
+  IN OUT  UDF_FILE_EXTENT_TABLE  *ExtentTable,
+  IN      UINT64                 FileOffset,
+  IN      UINT64                 DiskOffset,
+  IN      UINT64                 Length
+  );
+
+EFI_BOOT_SERVICES  *gBS = NULL;
+
+///
+/// The test file: contiguous Allocation Descriptors merge, the unrecorded
+/// one is not part of the file, and the last one ends in a partial block.
+///
+STATIC CONST TEST_AD  mTestAds[] = {
+  { 10, 3 * TEST_BLOCK_SIZE, TRUE  },
+  { 13, 2 * TEST_BLOCK_SIZE, TRUE  },
+  { 20, 1 * TEST_BLOCK_SIZE, FALSE },
+  { 30, 4 * TEST_BLOCK_SIZE, TRUE  },
+  { 34, 1 * TEST_BLOCK_SIZE, TRUE  },
+  { 50, 700,                 TRUE  },
+};
+
+///
+/// The extents the Allocation Descriptors of the test file decode to
+///
+STATIC CONST UDF_FILE_EXTENT  mTestExtents[] = {
+  { 0,                    (TEST_PARTITION_START + 10) * TEST_BLOCK_SIZE, 5 * TEST_BLOCK_SIZE },
+  { 5 * TEST_BLOCK_SIZE,  (TEST_PARTITION_START + 30) * TEST_BLOCK_SIZE, 5 * TEST_BLOCK_SIZE },
+  { 10 * TEST_BLOCK_SIZE, (TEST_PARTITION_START + 50) * TEST_BLOCK_SIZE, 700                 },
+};
+
+///
+/// The simulated disk and volume, and the test file with its data
+///
+STATIC UINT8                           mDisk[TEST_DISK_SIZE];
+STATIC UINTN                           mDiskReads;
+STATIC EFI_BLOCK_IO_MEDIA              mMedia;
+STATIC EFI_BLOCK_IO_PROTOCOL           mBlockIo;
+STATIC EFI_DISK_IO_PROTOCOL            mDiskIo;
+STATIC UDF_VOLUME_INFO                 mVolume;
+STATIC UINT8                           mFileEntry[TEST_FILE_ENTRY_SIZE];
+STATIC UDF_FILE_IDENTIFIER_DESCRIPTOR  mFileIdentifierDesc;
+STATIC UDF_FILE_INFO                   mFile;
+STATIC UINT8                           mFileData[TEST_DISK_SIZE];
+STATIC UINT64                          mFileSize;
+STATIC UDF_FILE_EXTENT_TABLE           mExtentTable;
+
+/**
+  Reads the simulated disk.
+
+  @param  This        The DiskIo protocol.
+  @param  MediaId     Unused.
+  @param  Offset      The offset on the disk.
+  @param  BufferSize  The size of the read.
+  @param  Buffer      The buffer to read into.
+
+  @retval EFI_SUCCESS       The data is read.
+  @retval EFI_DEVICE_ERROR  The read is beyond the disk.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadDisk (
+  IN  EFI_DISK_IO_PROTOCOL  *This,
+  IN  UINT32                MediaId,
+  IN  UINT64                Offset,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  if ((Offset > TEST_DISK_SIZE) || (BufferSize > TEST_DISK_SIZE - Offset)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  mDiskReads++;
+  CopyMem (Buffer, mDisk + Offset, BufferSize);
+  return EFI_SUCCESS;
+}
+
+/**
+  Sets up the simulated volume and the File Entry of the test file, with
+  Short Allocation Descriptors.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED  The volume is set up.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SetUpTestFile (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UDF_FILE_ENTRY                   *FileEntry;
+  UDF_SHORT_ALLOCATION_DESCRIPTOR  *ShortAd;
+  UINTN                            Index;
+
+  for (Index = 0; Index < TEST_DISK_SIZE; Index++) {
+    mDisk[Index] = (UINT8)(Index ^ (Index >> 8));
+  }
+
+  mDiskReads       = 0;
+  mMedia.BlockSize = TEST_BLOCK_SIZE;
+  mBlockIo.Media   = &mMedia;
+  mDiskIo.ReadDisk = TestReadDisk;
+
+  ZeroMem (&mVolume, sizeof (mVolume));
+  mVolume.LogicalVolDesc.DomainIdentifier.Suffix.Domain.UdfRevision = 0x0102;
+  mVolume.LogicalVolDesc.LogicalBlockSize                           = TEST_BLOCK_SIZE;
+  mVolume.PartitionDesc.PartitionStartingLocation                   = TEST_PARTITION_START;
+  mVolume.FileEntrySize                                             = TEST_FILE_ENTRY_SIZE;
+
+  ZeroMem (mFileEntry, sizeof (mFileEntry));
+  FileEntry                                = (UDF_FILE_ENTRY *)mFileEntry;
+  FileEntry->DescriptorTag.TagIdentifier   = UdfFileEntry;
+  FileEntry->IcbTag.Flags                  = ShortAdsSequence;
+  FileEntry->LengthOfAllocationDescriptors = (UINT32)(ARRAY_SIZE (mTestAds) * sizeof (UDF_SHORT_ALLOCATION_DESCRIPTOR));
+
+  ShortAd   = (UDF_SHORT_ALLOCATION_DESCRIPTOR *)FileEntry->Data;
+  mFileSize = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mTestAds); Index++) {
+    ShortAd[Index].ExtentLength   = mTestAds[Index].Length;
+    ShortAd[Index].ExtentPosition = mTestAds[Index].Block;
+    if (!mTestAds[Index].Recorded) {
+      ShortAd[Index].ExtentLength |= (UINT32)ExtentNotRecordedButAllocated << 30;
+      continue;
+    }
+
+    CopyMem (
+      mFileData + mFileSize,
+      mDisk + (TEST_PARTITION_START + mTestAds[Index].Block) * TEST_BLOCK_SIZE,
+      mTestAds[Index].Length
+      );
+    mFileSize += mTestAds[Index].Length;
+  }
+
+  ZeroMem (&mFileIdentifierDesc, sizeof (mFileIdentifierDesc));
+  mFile.FileEntry          = mFileEntry;
+  mFile.FileIdentifierDesc = &mFileIdentifierDesc;
+  ZeroMem (&mExtentTable, sizeof (mExtentTable));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Frees the extent table of the test file.
+
+  @param[in]  Context  Unused.
+
+**/
+STATIC
+VOID
+EFIAPI
+TearDownTestFile (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  FreeFileExtentTable (&mExtentTable);
+}
+
+/**
+  Reads the test file through its extent table, and checks the data read
+  and the number of disk reads.
+
+  @param  Position     The position of the read in the file.
+  @param  Size         The size of the read.
+  @param  ExtentCount  The number of extents the read is expected to span.
+
+  @retval TRUE   The read returned the file data with one disk read per
+                 extent.
+  @retval FALSE  It did not.
+
+**/
+STATIC
+BOOLEAN
+TestReadFile (
+  IN UINT64  Position,
+  IN UINT64  Size,
+  IN UINTN   ExtentCount
+  )
+{
+  STATIC UINT8  Buffer[TEST_DISK_SIZE];
+  EFI_STATUS    Status;
+  UINT64        FilePosition;
+  UINT64        BufferSize;
+  UINT64        Expected;
+
+  Expected     = MIN (Size, mFileSize - Position);
+  FilePosition = Position;
+  BufferSize   = Size;
+  mDiskReads   = 0;
+  SetMem (Buffer, sizeof (Buffer), 0xEE);
+  Status = ReadFileData (
+             &mBlockIo,
+             &mDiskIo,
+             &mVolume,
+             &mFile,
+             &mExtentTable,
+             mFileSize,
+             &FilePosition,
+             Buffer,
+             &BufferSize
+             );
+
+  return (BOOLEAN)(!EFI_ERROR (Status) &&
+                   (BufferSize == Expected) &&
+                   (FilePosition == Position + Expected) &&
+                   (mDiskReads == ExtentCount) &&
+                   (CompareMem (Buffer, mFileData + Position, (UINTN)Expected) == 0));
+}
+
+/**
+  Extents that follow each other in the file and on the disk merge, other
+  ones are appended, and the table grows past its initial size.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The extents are merged.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They are not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+AdjacentExtentsAreMerged (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  UT_ASSERT_NOT_EFI_ERROR (AddFileExtent (&mExtentTable, 0, SIZE_4KB, TEST_BLOCK_SIZE));
+  UT_ASSERT_NOT_EFI_ERROR (AddFileExtent (&mExtentTable, TEST_BLOCK_SIZE, SIZE_4KB + TEST_BLOCK_SIZE, 2 * TEST_BLOCK_SIZE));
+  UT_ASSERT_NOT_EFI_ERROR (AddFileExtent (&mExtentTable, 3 * TEST_BLOCK_SIZE, SIZE_8KB, 0));
+  UT_ASSERT_EQUAL (mExtentTable.ExtentCount, 1);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[0].FileOffset, 0);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[0].DiskOffset, SIZE_4KB);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[0].Length, 3 * TEST_BLOCK_SIZE);
+
+  //
+  // Contiguous in the file only, then on the disk only
+  //
+  UT_ASSERT_NOT_EFI_ERROR (AddFileExtent (&mExtentTable, 3 * TEST_BLOCK_SIZE, SIZE_8KB, TEST_BLOCK_SIZE));
+  UT_ASSERT_NOT_EFI_ERROR (AddFileExtent (&mExtentTable, 5 * TEST_BLOCK_SIZE, SIZE_8KB + TEST_BLOCK_SIZE, TEST_BLOCK_SIZE));
+  UT_ASSERT_EQUAL (mExtentTable.ExtentCount, 3);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[1].Length, TEST_BLOCK_SIZE);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[2].FileOffset, 5 * TEST_BLOCK_SIZE);
+
+  //
+  // Each of these is apart from the previous one on the disk
+  //
+  for (Index = 0; Index < 20; Index++) {
+    UT_ASSERT_NOT_EFI_ERROR (
+      AddFileExtent (&mExtentTable, (6 + Index) * TEST_BLOCK_SIZE, SIZE_16KB + Index * 2 * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE)
+      );
+  }
+
+  UT_ASSERT_EQUAL (mExtentTable.ExtentCount, 23);
+  UT_ASSERT_TRUE (mExtentTable.MaxExtents >= mExtentTable.ExtentCount);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[0].Length, 3 * TEST_BLOCK_SIZE);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[22].FileOffset, 25 * TEST_BLOCK_SIZE);
+  UT_ASSERT_EQUAL (mExtentTable.Extents[22].DiskOffset, SIZE_16KB + 38 * TEST_BLOCK_SIZE);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The Allocation Descriptors of a file decode to its merged extents, and
+  reads on both sides of each extent boundary and in the last partial block
+  are served with one disk read per extent.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The reads return the file data.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They do not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ReadsAtExtentBoundaries (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN   Index;
+  UINT64  Boundary;
+
+  UT_ASSERT_TRUE (TestReadFile (0, 1, 1));
+  UT_ASSERT_EQUAL (mExtentTable.ExtentCount, ARRAY_SIZE (mTestExtents));
+  UT_ASSERT_MEM_EQUAL (mExtentTable.Extents, mTestExtents, sizeof (mTestExtents));
+
+  for (Index = 1; Index < ARRAY_SIZE (mTestExtents); Index++) {
+    Boundary = mTestExtents[Index].FileOffset;
+    UT_ASSERT_TRUE (TestReadFile (Boundary - 1, 1, 1));
+    UT_ASSERT_TRUE (TestReadFile (Boundary, 1, 1));
+    UT_ASSERT_TRUE (TestReadFile (Boundary - 1, 2, 2));
+    UT_ASSERT_TRUE (TestReadFile (mTestExtents[Index - 1].FileOffset, mTestExtents[Index - 1].Length, 1));
+  }
+
+  //
+  // The last block of the file is partial, reads stop at the end of file
+  //
+  UT_ASSERT_TRUE (TestReadFile (mFileSize - 1, 1, 1));
+  UT_ASSERT_TRUE (TestReadFile (mFileSize - TEST_BLOCK_SIZE / 4, TEST_BLOCK_SIZE, 1));
+  UT_ASSERT_TRUE (TestReadFile (mFileSize, TEST_BLOCK_SIZE, 0));
+  UT_ASSERT_TRUE (TestReadFile (0, mFileSize + TEST_BLOCK_SIZE, ARRAY_SIZE (mTestExtents)));
+  UT_ASSERT_TRUE (TestReadFile (1, mFileSize - 2, ARRAY_SIZE (mTestExtents)));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The extent table is freed and built again, a table that does not cover
+  the file is reported as corrupted, and a table that fails to build is
+  freed.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The table is freed.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ExtentTableIsFreed (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT8                           Buffer[TEST_BLOCK_SIZE];
+  UINT64                          FilePosition;
+  UINT64                          BufferSize;
+  UDF_FILE_ENTRY                  *FileEntry;
+  UDF_LONG_ALLOCATION_DESCRIPTOR  *LongAd;
+
+  UT_ASSERT_TRUE (TestReadFile (0, mFileSize, ARRAY_SIZE (mTestExtents)));
+  FreeFileExtentTable (&mExtentTable);
+  UT_ASSERT_TRUE (mExtentTable.Extents == NULL);
+  UT_ASSERT_EQUAL (mExtentTable.ExtentCount, 0);
+  UT_ASSERT_EQUAL (mExtentTable.MaxExtents, 0);
+  FreeFileExtentTable (&mExtentTable);
+
+  UT_ASSERT_TRUE (TestReadFile (mTestExtents[1].FileOffset, 1, 1));
+  UT_ASSERT_MEM_EQUAL (mExtentTable.Extents, mTestExtents, sizeof (mTestExtents));
+
+  //
+  // A read past the last extent
+  //
+  FilePosition = mFileSize;
+  BufferSize   = sizeof (Buffer);
+  UT_ASSERT_STATUS_EQUAL (
+    ReadFileData (&mBlockIo, &mDiskIo, &mVolume, &mFile, &mExtentTable, mFileSize + 1, &FilePosition, Buffer, &BufferSize),
+    EFI_VOLUME_CORRUPTED
+    );
+  FreeFileExtentTable (&mExtentTable);
+
+  //
+  // The second Long Allocation Descriptor is in a partition the volume does
+  // not have, after the table is allocated for the first one
+  //
+  FileEntry                                = (UDF_FILE_ENTRY *)mFileEntry;
+  FileEntry->IcbTag.Flags                  = LongAdsSequence;
+  FileEntry->LengthOfAllocationDescriptors = 2 * sizeof (UDF_LONG_ALLOCATION_DESCRIPTOR);
+  LongAd                                   = (UDF_LONG_ALLOCATION_DESCRIPTOR *)FileEntry->Data;
+  ZeroMem (LongAd, FileEntry->LengthOfAllocationDescriptors);
+  LongAd[0].ExtentLength                            = TEST_BLOCK_SIZE;
+  LongAd[0].ExtentLocation.LogicalBlockNumber       = 10;
+  LongAd[1].ExtentLength                            = TEST_BLOCK_SIZE;
+  LongAd[1].ExtentLocation.LogicalBlockNumber       = 20;
+  LongAd[1].ExtentLocation.PartitionReferenceNumber = 1;
+
+  FilePosition = 0;
+  BufferSize   = sizeof (Buffer);
+  UT_ASSERT_TRUE (
+    EFI_ERROR (ReadFileData (&mBlockIo, &mDiskIo, &mVolume, &mFile, &mExtentTable, 2 * TEST_BLOCK_SIZE, &FilePosition, Buffer, &BufferSize))
+    );
+  UT_ASSERT_TRUE (mExtentTable.Extents == NULL);
+  UT_ASSERT_EQUAL (mExtentTable.ExtentCount, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the extent
+  table of the UDF driver and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      ExtentTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&ExtentTests, Framework, "UDF Extent Table Tests", "Udf.Extent", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for UDF Extent Table Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite-----------Description---------------------------Name--------------Function------------------Pre------------Post--------------Context
+  //
+  AddTestCase (ExtentTests, "Adjacent extents are merged", "Merge", AdjacentExtentsAreMerged, SetUpTestFile, TearDownTestFile, NULL);
+  AddTestCase (ExtentTests, "Reads at extent boundaries", "Boundaries", ReadsAtExtentBoundaries, SetUpTestFile, TearDownTestFile, NULL);
+  AddTestCase (ExtentTests, "Extent table is freed", "Free", ExtentTableIsFreed, SetUpTestFile, TearDownTestFile, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define UdfExtentUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+UdfExtentUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -8,6 +8,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 **/
 
 #include "Variable.h"
+#include "VariableParsing.h"
 
 /**
   Gets LBA of block and offset by given address.
@@ -85,15 +86,183 @@ GetLbaAndOffsetByAddress (
   return EFI_ABORTED;
 }
 
+/**
+  Gets the layout of the blocks of the non-volatile variable store.
+
+  @param  VariableBase   Base address of the variable store.
+  @param  BlockOffset    Pointer to the offset of the variable store in its
+                         first block for output.
+  @param  BlockSize      Pointer to the size of the blocks for output.
+
+  @retval EFI_SUCCESS    The layout was returned.
+  @retval EFI_NOT_FOUND  Fail to find FVB handle by address.
+  @retval EFI_ABORTED    Fail to find valid LBA and offset.
+
+**/
+EFI_STATUS
+GetVariableStoreBlockInfo (
+  IN  EFI_PHYSICAL_ADDRESS  VariableBase,
+  OUT UINTN                 *BlockOffset,
+  OUT UINTN                 *BlockSize
+  )
+{
+  EFI_STATUS                          Status;
+  EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  *Fvb;
+  EFI_LBA                             VarLba;
+  UINTN                               NumberOfBlocks;
+
+  Status = GetFvbInfoByAddress (VariableBase, NULL, &Fvb);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = GetLbaAndOffsetByAddress (VariableBase, &VarLba, BlockOffset);
+  if (EFI_ERROR (Status)) {
+    return EFI_ABORTED;
+  }
+
+  Status = Fvb->GetBlockSize (Fvb, VarLba, BlockSize, &NumberOfBlocks);
+  if (EFI_ERROR (Status) || (*BlockSize == 0)) {
+    return EFI_ABORTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Chooses the first variable an incremental reclaim rewrites.
+
+  The variables before it are kept in place as they are, deleted ones
+  included, so that the blocks they fill are neither erased nor written. Of
+  the choices that free at least MinimumFreeSize bytes, the one that rewrites
+  the blocks holding the most deleted variables per byte written is taken.
+
+  @param[in] VariableStoreHeader          Pointer to the variable store header.
+  @param[in] BlockOffset                  Offset of the variable store in its first block.
+  @param[in] BlockSize                    Size of the blocks of the variable store.
+  @param[in] UpdatingVariable             Variable that reclaim drops, or NULL.
+  @param[in] UpdatingInDeletedTransition  Variable in delete transition that reclaim drops, or NULL.
+  @param[in] MinimumFreeSize              Size the variables must leave free after reclaim.
+  @param[in] AuthFormat                   TRUE indicates authenticated variables are used.
+                                          FALSE indicates authenticated variables are not used.
+
+  @return Offset of the first variable to rewrite from the start of the store,
+          or 0 if the whole store has to be rewritten.
+
+**/
+UINTN
+GetReclaimRewriteOffset (
+  IN VARIABLE_STORE_HEADER  *VariableStoreHeader,
+  IN UINTN                  BlockOffset,
+  IN UINTN                  BlockSize,
+  IN VARIABLE_HEADER        *UpdatingVariable OPTIONAL,
+  IN VARIABLE_HEADER        *UpdatingInDeletedTransition OPTIONAL,
+  IN UINTN                  MinimumFreeSize,
+  IN BOOLEAN                AuthFormat
+  )
+{
+  VARIABLE_HEADER  *Variable;
+  VARIABLE_HEADER  *NextVariable;
+  VARIABLE_HEADER  *LastKept;
+  UINTN            DeletedSize;
+  UINTN            DeletedBefore;
+  UINTN            NeededSize;
+  UINTN            FreeSize;
+  UINTN            UsedSize;
+  UINTN            Offset;
+  UINTN            WriteOffset;
+  UINTN            BestOffset;
+  UINT64           BestDensity;
+  UINT64           Density;
+
+  //
+  // The variables dropped by reclaim: the deleted ones and the updating ones.
+  //
+  DeletedSize = 0;
+  Variable    = GetStartPointer (VariableStoreHeader);
+  while (IsValidVariableHeader (Variable, GetEndPointer (VariableStoreHeader))) {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+    if (((Variable->State != VAR_ADDED) && (Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) ||
+        (Variable == UpdatingVariable) || (Variable == UpdatingInDeletedTransition))
+    {
+      DeletedSize += (UINTN)NextVariable - (UINTN)Variable;
+    }
+
+    Variable = NextVariable;
+  }
+
+  UsedSize = (UINTN)Variable - (UINTN)VariableStoreHeader;
+  FreeSize = (UINTN)GetEndPointer (VariableStoreHeader) - (UINTN)Variable;
+  if (FreeSize + DeletedSize < MinimumFreeSize) {
+    return 0;
+  }
+
+  NeededSize = (FreeSize >= MinimumFreeSize) ? 0 : MinimumFreeSize - FreeSize;
+
+  //
+  // The updating variables have to be rewritten, so that the choices end at
+  // the first of them.
+  //
+  LastKept = (VARIABLE_HEADER *)GetEndPointer (VariableStoreHeader);
+  if ((UpdatingVariable != NULL) && (UpdatingVariable < LastKept)) {
+    LastKept = UpdatingVariable;
+  }
+
+  if ((UpdatingInDeletedTransition != NULL) && (UpdatingInDeletedTransition < LastKept)) {
+    LastKept = UpdatingInDeletedTransition;
+  }
+
+  BestOffset    = 0;
+  BestDensity   = 0;
+  DeletedBefore = 0;
+  Variable      = GetStartPointer (VariableStoreHeader);
+  while (IsValidVariableHeader (Variable, GetEndPointer (VariableStoreHeader)) &&
+         (Variable <= LastKept) &&
+         (DeletedSize - DeletedBefore >= NeededSize))
+  {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+
+    //
+    // The rewrite starts at the block that holds the start of the variable,
+    // and ends at the end of the variables.
+    //
+    Offset      = (UINTN)Variable - (UINTN)VariableStoreHeader;
+    WriteOffset = ((Offset + BlockOffset) / BlockSize) * BlockSize;
+    if (WriteOffset > BlockOffset) {
+      Density = DivU64x64Remainder (
+                  LShiftU64 (DeletedSize - DeletedBefore, 32),
+                  UsedSize - (WriteOffset - BlockOffset),
+                  NULL
+                  );
+      if (Density > BestDensity) {
+        BestDensity = Density;
+        BestOffset  = Offset;
+      }
+    }
+
+    if (((Variable->State != VAR_ADDED) && (Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) ||
+        (Variable == UpdatingVariable) || (Variable == UpdatingInDeletedTransition))
+    {
+      DeletedBefore += (UINTN)NextVariable - (UINTN)Variable;
+    }
+
+    Variable = NextVariable;
+  }
+
+  return BestOffset;
+}
+
 /**
   Writes a buffer to variable storage space, in the working block.
 
-  This function writes a buffer to variable storage space into a firmware
-  volume block device. The destination is specified by parameter
+  This function writes a range of a buffer to variable storage space into a
+  firmware volume block device. The destination is specified by parameter
   VariableBase. Fault Tolerant Write protocol is used for writing.
 
   @param  VariableBase   Base address of variable to write
   @param  VariableBuffer Point to the variable data buffer.
+  @param  Offset         Offset of the range to write from the start of the store.
+  @param  Length         Length of the range to write.
 
   @retval EFI_SUCCESS    The function completed successfully.
   @retval EFI_NOT_FOUND  Fail to locate Fault Tolerant Write protocol.
@@ -103,14 +272,15 @@ GetLbaAndOffsetByAddress (
 EFI_STATUS
 FtwVariableSpace (
   IN EFI_PHYSICAL_ADDRESS   VariableBase,
-  IN VARIABLE_STORE_HEADER  *VariableBuffer
+  IN VARIABLE_STORE_HEADER  *VariableBuffer,
+  IN UINTN                  Offset,
+  IN UINTN                  Length
   )
 {
   EFI_STATUS                         Status;
   EFI_HANDLE                         FvbHandle;
   EFI_LBA                            VarLba;
   UINTN                              VarOffset;
-  UINTN                              FtwBufferSize;
   EFI_FAULT_TOLERANT_WRITE_PROTOCOL  *FtwProtocol;
 
   //
@@ -132,25 +302,25 @@ FtwVariableSpace (
   //
   // Get LBA and Offset by address.
   //
-  Status = GetLbaAndOffsetByAddress (VariableBase, &VarLba, &VarOffset);
+  Status = GetLbaAndOffsetByAddress (VariableBase + Offset, &VarLba, &VarOffset);
   if (EFI_ERROR (Status)) {
     return EFI_ABORTED;
   }
 
-  FtwBufferSize = ((VARIABLE_STORE_HEADER *)((UINTN)VariableBase))->Size;
-  ASSERT (FtwBufferSize == VariableBuffer->Size);
+  ASSERT (((VARIABLE_STORE_HEADER *)((UINTN)VariableBase))->Size == VariableBuffer->Size);
+  ASSERT (Offset + Length <= VariableBuffer->Size);
 
   //
   // FTW write record.
   //
   Status = FtwProtocol->Write (
                           FtwProtocol,
-                          VarLba,                // LBA
-                          VarOffset,             // Offset
-                          FtwBufferSize,         // NumBytes
-                          NULL,                  // PrivateData NULL
-                          FvbHandle,             // Fvb Handle
-                          (VOID *)VariableBuffer // write buffer
+                          VarLba,                                // LBA
+                          VarOffset,                             // Offset
+                          Length,                                // NumBytes
+                          NULL,                                  // PrivateData NULL
+                          FvbHandle,                             // Fvb Handle
+                          (VOID *)((UINT8 *)VariableBuffer + Offset) // write buffer
                           );
 
   return Status;
@@ -0,0 +1,592 @@
+/** @file
+  This is a host-based unit test for the hash index of the variable stores.
+
+  It checks that FindVariableEx() with the index returns what walking the
+  store returns, while the store is updated and reclaimed, in both variable
+  formats, and measures the time of both lookups.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <time.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../VariableParsing.h"
+#include "../VariableIndex.h"
+
+#define UNIT_TEST_NAME     "Variable Store Hash Index Unit Test"
+#define UNIT_TEST_VERSION  "1.0"
+
+#define TEST_STORE_SIZE       SIZE_256KB
+#define TEST_NAME_COUNT       400
+#define TEST_OPERATION_COUNT  4000
+#define BENCHMARK_LOOKUPS     100000
+
+//
+// Test GUID 1 {3B8E6F54-0B43-4C9A-9E0D-6E1B7A2F5C11}
+//
+EFI_GUID  mTestGuid1 = {
+  0x3b8e6f54, 0x0b43, 0x4c9a, { 0x9e, 0x0d, 0x6e, 0x1b, 0x7a, 0x2f, 0x5c, 0x11 }
+};
+
+//
+// Test GUID 2 {A4C51D02-77E9-4F3B-8B6A-1D9C0E5F2A73}
+//
+EFI_GUID  mTestGuid2 = {
+  0xa4c51d02, 0x77e9, 0x4f3b, { 0x8b, 0x6a, 0x1d, 0x9c, 0x0e, 0x5f, 0x2a, 0x73 }
+};
+
+//
+// Whether AtRuntime() reports runtime to the code under test
+//
+BOOLEAN  mAtRuntime;
+
+//
+// State of the pseudo-random generator
+//
+UINT32  mSeed;
+
+/**
+  Return TRUE if ExitBootServices () has been called.
+
+  @retval TRUE If ExitBootServices () has been called.
+**/
+BOOLEAN
+AtRuntime (
+  VOID
+  )
+{
+  return mAtRuntime;
+}
+
+/**
+  Returns the next pseudo-random number.
+
+  @return A pseudo-random number.
+**/
+STATIC
+UINT32
+NextRandom (
+  VOID
+  )
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return mSeed >> 8;
+}
+
+/**
+  Builds the name of a test variable.
+
+  @param[out] Name    Buffer of 10 characters for the name.
+  @param[in]  Number  Number of the variable.
+**/
+STATIC
+VOID
+BuildName (
+  OUT CHAR16  *Name,
+  IN  UINTN   Number
+  )
+{
+  UINTN  Digit;
+
+  Name[0] = L'T';
+  Name[1] = L'e';
+  Name[2] = L's';
+  Name[3] = L't';
+  for (Digit = 0; Digit < 4; Digit++) {
+    Name[4 + Digit] = L"0123456789ABCDEF"[(Number >> (12 - 4 * Digit)) & 0xF];
+  }
+
+  //
+  // Vary the length of the names
+  //
+  Name[8] = (Number % 3 == 0) ? L'x' : 0;
+  Name[9] = 0;
+}
+
+/**
+  Formats an empty variable store.
+
+  @param[out] Store        The variable store.
+  @param[in]  AuthFormat   TRUE to use authenticated variables.
+**/
+STATIC
+VOID
+FormatStore (
+  OUT VARIABLE_STORE_HEADER  *Store,
+  IN  BOOLEAN                AuthFormat
+  )
+{
+  SetMem (Store, TEST_STORE_SIZE, 0xFF);
+  CopyGuid (&Store->Signature, AuthFormat ? &gEfiAuthenticatedVariableGuid : &gEfiVariableGuid);
+  Store->Size      = TEST_STORE_SIZE;
+  Store->Format    = VARIABLE_STORE_FORMATTED;
+  Store->State     = VARIABLE_STORE_HEALTHY;
+  Store->Reserved  = 0;
+  Store->Reserved1 = 0;
+}
+
+/**
+  Returns the first free byte of a variable store.
+
+  @param[in] Store        The variable store.
+  @param[in] AuthFormat   TRUE to use authenticated variables.
+
+  @return The first free byte of the store.
+**/
+STATIC
+VARIABLE_HEADER *
+EndOfVariables (
+  IN VARIABLE_STORE_HEADER  *Store,
+  IN BOOLEAN                AuthFormat
+  )
+{
+  VARIABLE_HEADER  *Variable;
+
+  Variable = GetStartPointer (Store);
+  while (IsValidVariableHeader (Variable, GetEndPointer (Store))) {
+    Variable = GetNextVariablePtr (Variable, AuthFormat);
+  }
+
+  return Variable;
+}
+
+/**
+  Appends a variable to a variable store.
+
+  @param[in] Store        The variable store.
+  @param[in] Name         Name of the variable.
+  @param[in] Guid         Vendor GUID of the variable.
+  @param[in] Attributes   Attributes of the variable.
+  @param[in] AuthFormat   TRUE to use authenticated variables.
+
+  @return The header of the variable, or NULL if the store is full.
+**/
+STATIC
+VARIABLE_HEADER *
+AppendVariable (
+  IN VARIABLE_STORE_HEADER  *Store,
+  IN CHAR16                 *Name,
+  IN EFI_GUID               *Guid,
+  IN UINT32                 Attributes,
+  IN BOOLEAN                AuthFormat
+  )
+{
+  VARIABLE_HEADER  *Variable;
+  UINTN            DataSize;
+
+  DataSize = 1 + NextRandom () % 64;
+  Variable = EndOfVariables (Store, AuthFormat);
+  if ((UINTN)Variable + GetVariableHeaderSize (AuthFormat) + StrSize (Name) + DataSize + 8 > (UINTN)GetEndPointer (Store)) {
+    return NULL;
+  }
+
+  ZeroMem (Variable, GetVariableHeaderSize (AuthFormat));
+  Variable->StartId    = VARIABLE_DATA;
+  Variable->State      = VAR_ADDED;
+  Variable->Attributes = Attributes;
+  SetNameSizeOfVariable (Variable, StrSize (Name), AuthFormat);
+  SetDataSizeOfVariable (Variable, DataSize, AuthFormat);
+  CopyGuid (GetVendorGuidPtr (Variable, AuthFormat), Guid);
+  CopyMem (GetVariableNamePtr (Variable, AuthFormat), Name, StrSize (Name));
+  SetMem (GetVariableDataPtr (Variable, AuthFormat), DataSize, (UINT8)DataSize);
+  return Variable;
+}
+
+/**
+  Keeps the variables of a store that are not deleted, as reclaim does.
+
+  @param[in] Store        The variable store.
+  @param[in] AuthFormat   TRUE to use authenticated variables.
+**/
+STATIC
+VOID
+ReclaimStore (
+  IN VARIABLE_STORE_HEADER  *Store,
+  IN BOOLEAN                AuthFormat
+  )
+{
+  UINT8            *Buffer;
+  UINT8            *CurrPtr;
+  VARIABLE_HEADER  *Variable;
+  VARIABLE_HEADER  *NextVariable;
+
+  Buffer = AllocatePool (TEST_STORE_SIZE);
+  ASSERT (Buffer != NULL);
+  CurrPtr = Buffer;
+
+  Variable = GetStartPointer (Store);
+  while (IsValidVariableHeader (Variable, GetEndPointer (Store))) {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+    if ((Variable->State == VAR_ADDED) || (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) {
+      CopyMem (CurrPtr, Variable, (UINTN)NextVariable - (UINTN)Variable);
+      CurrPtr += (UINTN)NextVariable - (UINTN)Variable;
+    }
+
+    Variable = NextVariable;
+  }
+
+  Variable = GetStartPointer (Store);
+  SetMem (Variable, (UINTN)GetEndPointer (Store) - (UINTN)Variable, 0xFF);
+  CopyMem (Variable, Buffer, CurrPtr - Buffer);
+  FreePool (Buffer);
+
+  VariableIndexInvalidate (Store);
+}
+
+/**
+  Finds a variable by walking the store, as FindVariableEx() did before the
+  index.
+
+  @param[in]      VariableName    Name of the variable to be found.
+  @param[in]      VendorGuid      Vendor GUID to be found.
+  @param[in]      IgnoreRtCheck   Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                  check at runtime when searching variable.
+  @param[in, out] PtrTrack        Variable Track Pointer structure.
+  @param[in]      AuthFormat      TRUE to use authenticated variables.
+
+  @retval EFI_SUCCESS     Variable found successfully.
+  @retval EFI_NOT_FOUND   Variable not found.
+**/
+STATIC
+EFI_STATUS
+WalkStore (
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN     BOOLEAN                 AuthFormat
+  )
+{
+  VARIABLE_HEADER  *InDeletedVariable;
+
+  PtrTrack->InDeletedTransitionPtr = NULL;
+  InDeletedVariable                = NULL;
+
+  for (PtrTrack->CurrPtr = PtrTrack->StartPtr;
+       IsValidVariableHeader (PtrTrack->CurrPtr, PtrTrack->EndPtr);
+       PtrTrack->CurrPtr = GetNextVariablePtr (PtrTrack->CurrPtr, AuthFormat))
+  {
+    if (((PtrTrack->CurrPtr->State == VAR_ADDED) || (PtrTrack->CurrPtr->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) &&
+        (IgnoreRtCheck || !AtRuntime () || ((PtrTrack->CurrPtr->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) != 0)) &&
+        CompareGuid (VendorGuid, GetVendorGuidPtr (PtrTrack->CurrPtr, AuthFormat)) &&
+        (CompareMem (VariableName, GetVariableNamePtr (PtrTrack->CurrPtr, AuthFormat), NameSizeOfVariable (PtrTrack->CurrPtr, AuthFormat)) == 0))
+    {
+      if (PtrTrack->CurrPtr->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+        InDeletedVariable = PtrTrack->CurrPtr;
+      } else {
+        PtrTrack->InDeletedTransitionPtr = InDeletedVariable;
+        return EFI_SUCCESS;
+      }
+    }
+  }
+
+  PtrTrack->CurrPtr = InDeletedVariable;
+  return (PtrTrack->CurrPtr == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
+/**
+  Checks that FindVariableEx() finds every test variable where walking the
+  store finds it.
+
+  @param[in] Store        The variable store.
+  @param[in] AuthFormat   TRUE to use authenticated variables.
+
+  @retval TRUE   The lookups match.
+  @retval FALSE  A lookup does not match.
+**/
+STATIC
+BOOLEAN
+LookupsMatch (
+  IN VARIABLE_STORE_HEADER  *Store,
+  IN BOOLEAN                AuthFormat
+  )
+{
+  UINTN                   Number;
+  UINTN                   GuidIndex;
+  UINTN                   RtCheck;
+  CHAR16                  Name[10];
+  EFI_GUID                *Guid;
+  VARIABLE_POINTER_TRACK  Indexed;
+  VARIABLE_POINTER_TRACK  Walked;
+  EFI_STATUS              IndexedStatus;
+  EFI_STATUS              WalkedStatus;
+
+  for (Number = 0; Number < TEST_NAME_COUNT + 10; Number++) {
+    BuildName (Name, Number);
+    for (GuidIndex = 0; GuidIndex < 2; GuidIndex++) {
+      Guid = (GuidIndex == 0) ? &mTestGuid1 : &mTestGuid2;
+      for (RtCheck = 0; RtCheck < 2; RtCheck++) {
+        ZeroMem (&Indexed, sizeof (Indexed));
+        Indexed.StartPtr = GetStartPointer (Store);
+        Indexed.EndPtr   = GetEndPointer (Store);
+        CopyMem (&Walked, &Indexed, sizeof (Walked));
+
+        IndexedStatus = FindVariableEx (Name, Guid, (BOOLEAN)(RtCheck == 0), &Indexed, AuthFormat);
+        WalkedStatus  = WalkStore (Name, Guid, (BOOLEAN)(RtCheck == 0), &Walked, AuthFormat);
+        if ((IndexedStatus != WalkedStatus) ||
+            (Indexed.CurrPtr != Walked.CurrPtr) ||
+            (Indexed.InDeletedTransitionPtr != Walked.InDeletedTransitionPtr))
+        {
+          return FALSE;
+        }
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+/**
+  Updates random test variables the way the variable driver does: adds,
+  deletes, and replaces them through the IN_DELETED_TRANSITION state, which
+  is sometimes left set as after a power failure. Reclaims the store when it
+  is full, and checks the lookups after each batch of updates.
+
+  @param[in]  Context  TRUE to use authenticated variables.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+IndexMatchesWalk (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  BOOLEAN                 AuthFormat;
+  VARIABLE_STORE_HEADER   *Store;
+  UINTN                   Operation;
+  UINTN                   Reclaims;
+  CHAR16                  Name[10];
+  EFI_GUID                *Guid;
+  UINT32                  Attributes;
+  VARIABLE_POINTER_TRACK  PtrTrack;
+  VARIABLE_HEADER         *NewVariable;
+
+  AuthFormat = (BOOLEAN)(UINTN)Context;
+  mSeed      = 1;
+  mAtRuntime = FALSE;
+  Reclaims   = 0;
+
+  Store = AllocatePool (TEST_STORE_SIZE);
+  UT_ASSERT_NOT_NULL (Store);
+  FormatStore (Store, AuthFormat);
+  ZeroMem (mVariableStoreIndex, sizeof (mVariableStoreIndex));
+  UT_ASSERT_NOT_EFI_ERROR (VariableIndexCreate (Store));
+
+  for (Operation = 0; Operation < TEST_OPERATION_COUNT; Operation++) {
+    BuildName (Name, NextRandom () % TEST_NAME_COUNT);
+    Guid       = (NextRandom () % 4 == 0) ? &mTestGuid2 : &mTestGuid1;
+    Attributes = EFI_VARIABLE_BOOTSERVICE_ACCESS | ((NextRandom () % 2 == 0) ? EFI_VARIABLE_RUNTIME_ACCESS : 0);
+
+    ZeroMem (&PtrTrack, sizeof (PtrTrack));
+    PtrTrack.StartPtr = GetStartPointer (Store);
+    PtrTrack.EndPtr   = GetEndPointer (Store);
+    if (EFI_ERROR (WalkStore (Name, Guid, TRUE, &PtrTrack, AuthFormat))) {
+      PtrTrack.CurrPtr = NULL;
+    }
+
+    if ((PtrTrack.CurrPtr != NULL) && (NextRandom () % 4 == 0)) {
+      PtrTrack.CurrPtr->State &= VAR_DELETED;
+    } else {
+      if (PtrTrack.CurrPtr != NULL) {
+        PtrTrack.CurrPtr->State &= VAR_IN_DELETED_TRANSITION;
+      }
+
+      NewVariable = AppendVariable (Store, Name, Guid, Attributes, AuthFormat);
+      if (NewVariable == NULL) {
+        if (PtrTrack.CurrPtr != NULL) {
+          PtrTrack.CurrPtr->State |= (UINT8) ~VAR_IN_DELETED_TRANSITION;
+        }
+
+        ReclaimStore (Store, AuthFormat);
+        Reclaims++;
+        continue;
+      }
+
+      if ((PtrTrack.CurrPtr != NULL) && (NextRandom () % 8 != 0)) {
+        PtrTrack.CurrPtr->State &= VAR_DELETED;
+      }
+    }
+
+    if (Operation % 64 == 0) {
+      //
+      // Index the new variables before runtime, where the index cannot grow
+      //
+      UT_ASSERT_TRUE (LookupsMatch (Store, AuthFormat));
+      mAtRuntime = TRUE;
+      UT_ASSERT_TRUE (LookupsMatch (Store, AuthFormat));
+      mAtRuntime = FALSE;
+    }
+  }
+
+  UT_ASSERT_TRUE (LookupsMatch (Store, AuthFormat));
+  UT_ASSERT_TRUE (Reclaims > 0);
+  UT_ASSERT_FALSE (mVariableStoreIndex[0].Incomplete);
+
+  //
+  // An index that cannot grow at runtime falls back to the walk
+  //
+  ReclaimStore (Store, AuthFormat);
+  FreePool (mVariableStoreIndex[0].Entries);
+  ZeroMem (mVariableStoreIndex, sizeof (mVariableStoreIndex));
+  UT_ASSERT_NOT_EFI_ERROR (VariableIndexCreate (Store));
+  mAtRuntime = TRUE;
+  while (AppendVariable (Store, L"Filler", &mTestGuid2, EFI_VARIABLE_RUNTIME_ACCESS, AuthFormat) != NULL) {
+  }
+
+  UT_ASSERT_TRUE (LookupsMatch (Store, AuthFormat));
+  UT_ASSERT_TRUE (mVariableStoreIndex[0].Incomplete);
+  mAtRuntime = FALSE;
+
+  FreePool (mVariableStoreIndex[0].Entries);
+  ZeroMem (mVariableStoreIndex, sizeof (mVariableStoreIndex));
+  FreePool (Store);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Measures the time of looking variables up by walking the store and with
+  the index, in a store of TEST_NAME_COUNT variables.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+LookupBenchmark (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_STORE_HEADER   *Store;
+  UINTN                   Number;
+  UINTN                   Pass;
+  UINTN                   Lookup;
+  CHAR16                  Name[10];
+  VARIABLE_POINTER_TRACK  PtrTrack;
+  EFI_STATUS              Status;
+  clock_t                 Start;
+  clock_t                 Ticks[2];
+
+  mSeed      = 1;
+  mAtRuntime = FALSE;
+
+  Store = AllocatePool (TEST_STORE_SIZE);
+  UT_ASSERT_NOT_NULL (Store);
+  FormatStore (Store, TRUE);
+  for (Number = 0; Number < TEST_NAME_COUNT; Number++) {
+    BuildName (Name, Number);
+    UT_ASSERT_NOT_NULL (AppendVariable (Store, Name, &mTestGuid1, EFI_VARIABLE_BOOTSERVICE_ACCESS, TRUE));
+  }
+
+  ZeroMem (mVariableStoreIndex, sizeof (mVariableStoreIndex));
+  UT_ASSERT_NOT_EFI_ERROR (VariableIndexCreate (Store));
+
+  for (Pass = 0; Pass < 2; Pass++) {
+    Start = clock ();
+    for (Lookup = 0; Lookup < BENCHMARK_LOOKUPS; Lookup++) {
+      BuildName (Name, Lookup % TEST_NAME_COUNT);
+      PtrTrack.StartPtr = GetStartPointer (Store);
+      PtrTrack.EndPtr   = GetEndPointer (Store);
+      if (Pass == 0) {
+        Status = WalkStore (Name, &mTestGuid1, FALSE, &PtrTrack, TRUE);
+      } else {
+        Status = FindVariableEx (Name, &mTestGuid1, FALSE, &PtrTrack, TRUE);
+      }
+
+      UT_ASSERT_NOT_EFI_ERROR (Status);
+    }
+
+    Ticks[Pass] = clock () - Start;
+  }
+
+  UT_LOG_INFO (
+    "Walk: %d ms, index: %d ms\n",
+    (INT32)((UINT64)Ticks[0] * 1000 / CLOCKS_PER_SEC),
+    (INT32)((UINT64)Ticks[1] * 1000 / CLOCKS_PER_SEC)
+    );
+
+  FreePool (mVariableStoreIndex[0].Entries);
+  ZeroMem (mVariableStoreIndex, sizeof (mVariableStoreIndex));
+  FreePool (Store);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Main entry point to the unit test.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      IndexTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_NAME, UNIT_TEST_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_NAME, gEfiCallerBaseName, UNIT_TEST_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&IndexTests, Framework, "Variable Store Hash Index", "VariableIndex", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for VariableIndex\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  AddTestCase (IndexTests, "Index matches the walk with normal variables", "Normal", IndexMatchesWalk, NULL, NULL, (UNIT_TEST_CONTEXT)(UINTN)FALSE);
+  AddTestCase (IndexTests, "Index matches the walk with authenticated variables", "Auth", IndexMatchesWalk, NULL, NULL, (UNIT_TEST_CONTEXT)(UINTN)TRUE);
+  AddTestCase (IndexTests, "Lookup time", "Benchmark", LookupBenchmark, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+**/
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  return UnitTestingEntry ();
+}
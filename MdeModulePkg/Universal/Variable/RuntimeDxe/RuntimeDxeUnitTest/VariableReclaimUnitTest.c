@@ -0,0 +1,431 @@
+/** @file
+  This is a host-based unit test for the choice of the variables that an
+  incremental reclaim of the non-volatile variable store rewrites.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../VariableParsing.h"
+
+#define UNIT_TEST_NAME     "Variable Incremental Reclaim Unit Test"
+#define UNIT_TEST_VERSION  "1.0"
+
+#define TEST_STORE_SIZE   SIZE_64KB
+#define TEST_BLOCK_SIZE   SIZE_4KB
+#define TEST_ITERATIONS   200
+
+//
+// Test GUID {5D0B7E4A-2C61-4F8E-A3B9-7E14C0D25F68}
+//
+EFI_GUID  mTestGuid = {
+  0x5d0b7e4a, 0x2c61, 0x4f8e, { 0xa3, 0xb9, 0x7e, 0x14, 0xc0, 0xd2, 0x5f, 0x68 }
+};
+
+//
+// State of the pseudo-random generator
+//
+UINT32  mSeed;
+
+/**
+  Return TRUE if ExitBootServices () has been called.
+
+  @retval TRUE If ExitBootServices () has been called.
+**/
+BOOLEAN
+AtRuntime (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+/**
+  Retrieve the FVB protocol interface by HANDLE.
+
+  @param[in]  Address       The Flash address.
+  @param[out] FvbHandle     In output, if it is not NULL, it points to the proper FVB handle.
+  @param[out] FvbProtocol   In output, if it is not NULL, it points to the proper FVB protocol.
+
+  @retval EFI_NOT_FOUND     The tests do not write the variable store.
+**/
+EFI_STATUS
+GetFvbInfoByAddress (
+  IN  EFI_PHYSICAL_ADDRESS                Address,
+  OUT EFI_HANDLE                          *FvbHandle OPTIONAL,
+  OUT EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  **FvbProtocol OPTIONAL
+  )
+{
+  return EFI_NOT_FOUND;
+}
+
+/**
+  Retrieve the Fault Tolerent Write protocol interface.
+
+  @param[out] FtwProtocol       The interface of Ftw protocol
+
+  @retval EFI_NOT_FOUND         The tests do not write the variable store.
+**/
+EFI_STATUS
+GetFtwProtocol (
+  OUT VOID  **FtwProtocol
+  )
+{
+  return EFI_NOT_FOUND;
+}
+
+/**
+  Returns the next pseudo-random number.
+
+  @return A pseudo-random number.
+**/
+STATIC
+UINT32
+NextRandom (
+  VOID
+  )
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return mSeed >> 8;
+}
+
+/**
+  Formats an empty authenticated variable store.
+
+  @param[out] Store   The variable store.
+**/
+STATIC
+VOID
+FormatStore (
+  OUT VARIABLE_STORE_HEADER  *Store
+  )
+{
+  SetMem (Store, TEST_STORE_SIZE, 0xFF);
+  CopyGuid (&Store->Signature, &gEfiAuthenticatedVariableGuid);
+  Store->Size      = TEST_STORE_SIZE;
+  Store->Format    = VARIABLE_STORE_FORMATTED;
+  Store->State     = VARIABLE_STORE_HEALTHY;
+  Store->Reserved  = 0;
+  Store->Reserved1 = 0;
+}
+
+/**
+  Appends a variable with random data size to a variable store.
+
+  @param[in] Store   The variable store.
+  @param[in] State   State of the variable.
+
+  @return The header of the variable, or NULL if the store is full.
+**/
+STATIC
+VARIABLE_HEADER *
+AppendVariable (
+  IN VARIABLE_STORE_HEADER  *Store,
+  IN UINT8                  State
+  )
+{
+  VARIABLE_HEADER  *Variable;
+  UINTN            DataSize;
+
+  DataSize = 1 + NextRandom () % 512;
+  Variable = GetStartPointer (Store);
+  while (IsValidVariableHeader (Variable, GetEndPointer (Store))) {
+    Variable = GetNextVariablePtr (Variable, TRUE);
+  }
+
+  if ((UINTN)Variable + GetVariableHeaderSize (TRUE) + sizeof (L"Var") + DataSize + 8 > (UINTN)GetEndPointer (Store)) {
+    return NULL;
+  }
+
+  ZeroMem (Variable, GetVariableHeaderSize (TRUE));
+  Variable->StartId    = VARIABLE_DATA;
+  Variable->State      = State;
+  Variable->Attributes = EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS;
+  SetNameSizeOfVariable (Variable, sizeof (L"Var"), TRUE);
+  SetDataSizeOfVariable (Variable, DataSize, TRUE);
+  CopyGuid (GetVendorGuidPtr (Variable, TRUE), &mTestGuid);
+  CopyMem (GetVariableNamePtr (Variable, TRUE), L"Var", sizeof (L"Var"));
+  return Variable;
+}
+
+/**
+  Returns whether reclaim drops a variable.
+
+  @param[in] Variable   The variable.
+  @param[in] Updating   The variable being updated, or NULL.
+
+  @retval TRUE   Reclaim drops the variable.
+  @retval FALSE  Reclaim keeps the variable.
+**/
+STATIC
+BOOLEAN
+IsDropped (
+  IN VARIABLE_HEADER  *Variable,
+  IN VARIABLE_HEADER  *Updating
+  )
+{
+  return (BOOLEAN)((Variable == Updating) ||
+                   ((Variable->State != VAR_ADDED) && (Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED))));
+}
+
+/**
+  Checks the variable GetReclaimRewriteOffset() chooses against every
+  choice, in stores with a random layout of deleted variables.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+RewriteOffsetIsBest (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_STORE_HEADER  *Store;
+  UINTN                  Iteration;
+  UINTN                  BlockOffset;
+  UINTN                  DeletedPercent;
+  UINTN                  MinimumFreeSize;
+  UINTN                  UsedSize;
+  UINTN                  FreeSize;
+  UINTN                  Offset;
+  UINTN                  WriteOffset;
+  UINTN                  Freed;
+  UINTN                  Incremental;
+  UINT64                 Density;
+  UINT64                 BestDensity;
+  UINTN                  BestOffset;
+  VARIABLE_HEADER        *Variable;
+  VARIABLE_HEADER        *Candidate;
+  VARIABLE_HEADER        *Updating;
+
+  Store = AllocatePool (TEST_STORE_SIZE);
+  UT_ASSERT_NOT_NULL (Store);
+
+  mSeed       = 1;
+  Incremental = 0;
+  for (Iteration = 0; Iteration < TEST_ITERATIONS; Iteration++) {
+    //
+    // The variables at the start of the store are rarely deleted, the ones at
+    // the end often, as in a store where a few variables are updated.
+    //
+    FormatStore (Store);
+    Updating = NULL;
+    while (TRUE) {
+      Variable = GetStartPointer (Store);
+      while (IsValidVariableHeader (Variable, GetEndPointer (Store))) {
+        Variable = GetNextVariablePtr (Variable, TRUE);
+      }
+
+      DeletedPercent = 5 + 90 * ((UINTN)Variable - (UINTN)Store) / TEST_STORE_SIZE;
+      Variable       = AppendVariable (Store, (NextRandom () % 100 < DeletedPercent) ? (VAR_ADDED & VAR_DELETED) : VAR_ADDED);
+      if (Variable == NULL) {
+        break;
+      }
+
+      if ((Variable->State == VAR_ADDED) && (NextRandom () % 16 == 0)) {
+        Updating = Variable;
+      }
+    }
+
+    BlockOffset     = (NextRandom () % 2 == 0) ? 0 : 0x48;
+    MinimumFreeSize = NextRandom () % (TEST_STORE_SIZE / 4);
+    Offset          = GetReclaimRewriteOffset (Store, BlockOffset, TEST_BLOCK_SIZE, Updating, NULL, MinimumFreeSize, TRUE);
+
+    //
+    // Try every variable as the first one to rewrite.
+    //
+    Variable = GetStartPointer (Store);
+    while (IsValidVariableHeader (Variable, GetEndPointer (Store))) {
+      Variable = GetNextVariablePtr (Variable, TRUE);
+    }
+
+    UsedSize    = (UINTN)Variable - (UINTN)Store;
+    FreeSize    = TEST_STORE_SIZE - UsedSize;
+    BestDensity = 0;
+    BestOffset  = 0;
+    Candidate   = GetStartPointer (Store);
+    while (IsValidVariableHeader (Candidate, GetEndPointer (Store))) {
+      Freed    = 0;
+      Variable = Candidate;
+      while (IsValidVariableHeader (Variable, GetEndPointer (Store))) {
+        if (IsDropped (Variable, Updating)) {
+          Freed += (UINTN)GetNextVariablePtr (Variable, TRUE) - (UINTN)Variable;
+        }
+
+        Variable = GetNextVariablePtr (Variable, TRUE);
+      }
+
+      WriteOffset = (((UINTN)Candidate - (UINTN)Store + BlockOffset) / TEST_BLOCK_SIZE) * TEST_BLOCK_SIZE;
+      if ((Freed + FreeSize >= MinimumFreeSize) &&
+          ((Updating == NULL) || (Candidate <= Updating)) &&
+          (WriteOffset > BlockOffset))
+      {
+        Density = DivU64x64Remainder (LShiftU64 (Freed, 32), UsedSize - (WriteOffset - BlockOffset), NULL);
+        if (Density > BestDensity) {
+          BestDensity = Density;
+          BestOffset  = (UINTN)Candidate - (UINTN)Store;
+        }
+      }
+
+      Candidate = GetNextVariablePtr (Candidate, TRUE);
+    }
+
+    UT_ASSERT_EQUAL (Offset, BestOffset);
+    if (Offset != 0) {
+      Incremental++;
+    }
+  }
+
+  //
+  // Most stores are reclaimed incrementally
+  //
+  UT_ASSERT_TRUE (Incremental > TEST_ITERATIONS / 2);
+
+  FreePool (Store);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that the whole store is rewritten when rewriting its end does not
+  free enough space.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+WholeStoreRewrite (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  VARIABLE_STORE_HEADER  *Store;
+  VARIABLE_HEADER        *First;
+  VARIABLE_HEADER        *Variable;
+  UINTN                  Count;
+
+  Store = AllocatePool (TEST_STORE_SIZE);
+  UT_ASSERT_NOT_NULL (Store);
+  mSeed = 7;
+
+  //
+  // A store without deleted variables cannot be reclaimed incrementally.
+  //
+  FormatStore (Store);
+  while (AppendVariable (Store, VAR_ADDED) != NULL) {
+  }
+
+  UT_ASSERT_EQUAL (GetReclaimRewriteOffset (Store, 0, TEST_BLOCK_SIZE, NULL, NULL, 1, TRUE), 0);
+
+  //
+  // Nor one whose deleted variables are all in its first block.
+  //
+  FormatStore (Store);
+  AppendVariable (Store, VAR_ADDED & VAR_DELETED);
+  while (AppendVariable (Store, VAR_ADDED) != NULL) {
+  }
+
+  UT_ASSERT_EQUAL (GetReclaimRewriteOffset (Store, 0, TEST_BLOCK_SIZE, NULL, NULL, 1, TRUE), 0);
+
+  //
+  // Nor one where the updated variable is in the first block.
+  //
+  FormatStore (Store);
+  First = AppendVariable (Store, VAR_ADDED);
+  Count = 0;
+  while ((Variable = AppendVariable (Store, VAR_ADDED)) != NULL) {
+    if (Count++ % 2 == 0) {
+      Variable->State &= VAR_DELETED;
+    }
+  }
+
+  UT_ASSERT_NOT_EQUAL (GetReclaimRewriteOffset (Store, 0, TEST_BLOCK_SIZE, NULL, NULL, 1, TRUE), 0);
+  UT_ASSERT_EQUAL (GetReclaimRewriteOffset (Store, 0, TEST_BLOCK_SIZE, First, NULL, 1, TRUE), 0);
+  UT_ASSERT_EQUAL (GetReclaimRewriteOffset (Store, 0, TEST_BLOCK_SIZE, NULL, First, 1, TRUE), 0);
+
+  //
+  // Nor one that does not free enough space even when it is all rewritten.
+  //
+  UT_ASSERT_EQUAL (GetReclaimRewriteOffset (Store, 0, TEST_BLOCK_SIZE, NULL, NULL, TEST_STORE_SIZE, TRUE), 0);
+
+  FreePool (Store);
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Main entry point to the unit test.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      ReclaimTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_NAME, UNIT_TEST_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_NAME, gEfiCallerBaseName, UNIT_TEST_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&ReclaimTests, Framework, "Variable Incremental Reclaim", "VariableReclaim", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for VariableReclaim\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  AddTestCase (ReclaimTests, "Rewrite the blocks with the most deleted variables", "Best", RewriteOffsetIsBest, NULL, NULL, NULL);
+  AddTestCase (ReclaimTests, "Rewrite the whole store when needed", "Whole", WholeStoreRewrite, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+**/
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  return UnitTestingEntry ();
+}
@@ -29,6 +29,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include "VariableNonVolatile.h"
 #include "VariableParsing.h"
 #include "VariableRuntimeCache.h"
+#include "VariableIndex.h"
 
 VARIABLE_MODULE_GLOBAL  *mVariableModuleGlobal;
 
@@ -48,6 +49,11 @@ EFI_FIRMWARE_VOLUME_HEADER  *mNvFvHeaderCache = NULL;
 ///
 VARIABLE_INFO_ENTRY  *gVariableInfo = NULL;
 
+///
+/// The statistics of the reclaim of the non-volatile variable store.
+///
+VARIABLE_RECLAIM_STATISTICS  mVariableReclaimStatistics;
+
 ///
 /// The flag to indicate whether the platform has left the DXE phase of execution.
 ///
@@ -508,23 +514,33 @@ InitializeVariableQuota (
   @param[in, out] UpdatingPtrTrack        Pointer to updating variable pointer track structure.
   @param[in]      NewVariable             Pointer to new variable.
   @param[in]      NewVariableSize         New variable size.
+  @param[in]      RewriteOffset           Offset of the first variable to rewrite from the start
+                                          of the non-volatile variable store, or 0 to rewrite the
+                                          whole store. The variables before it are kept as they are.
+  @param[in]      BlockOffset             Offset of the variable store in its first block.
+  @param[in]      BlockSize               Size of the blocks of the variable store.
 
   @return EFI_SUCCESS                  Reclaim operation has finished successfully.
   @return EFI_OUT_OF_RESOURCES         No enough memory resources or variable space.
   @return Others                       Unexpect error happened during reclaim operation.
 
 **/
+STATIC
 EFI_STATUS
-Reclaim (
+ReclaimVariableStore (
   IN     EFI_PHYSICAL_ADDRESS    VariableBase,
   OUT    UINTN                   *LastVariableOffset,
   IN     BOOLEAN                 IsVolatile,
   IN OUT VARIABLE_POINTER_TRACK  *UpdatingPtrTrack,
   IN     VARIABLE_HEADER         *NewVariable,
-  IN     UINTN                   NewVariableSize
+  IN     UINTN                   NewVariableSize,
+  IN     UINTN                   RewriteOffset,
+  IN     UINTN                   BlockOffset,
+  IN     UINTN                   BlockSize
   )
 {
   VARIABLE_HEADER        *Variable;
+  VARIABLE_HEADER        *FirstVariable;
   VARIABLE_HEADER        *AddedVariable;
   VARIABLE_HEADER        *NextVariable;
   VARIABLE_HEADER        *NextAddedVariable;
@@ -545,6 +561,9 @@ Reclaim (
   VARIABLE_HEADER        *UpdatingVariable;
   VARIABLE_HEADER        *UpdatingInDeletedTransition;
   BOOLEAN                AuthFormat;
+  UINTN                  UsedSize;
+  UINTN                  WriteOffset;
+  UINTN                  WriteSize;
 
   AuthFormat                  = mVariableModuleGlobal->VariableGlobal.AuthFormat;
   UpdatingVariable            = NULL;
@@ -614,10 +633,37 @@ Reclaim (
   CopyMem (ValidBuffer, VariableStoreHeader, sizeof (VARIABLE_STORE_HEADER));
   CurrPtr = (UINT8 *)GetStartPointer ((VARIABLE_STORE_HEADER *)ValidBuffer);
 
+  //
+  // Keep the variables before RewriteOffset in place, deleted ones included.
+  //
+  FirstVariable = GetStartPointer (VariableStoreHeader);
+  if (RewriteOffset != 0) {
+    Variable      = FirstVariable;
+    FirstVariable = (VARIABLE_HEADER *)((UINTN)VariableBase + RewriteOffset);
+    while (Variable < FirstVariable) {
+      NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+      VariableSize = (UINTN)NextVariable - (UINTN)Variable;
+      if ((Variable->Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) == EFI_VARIABLE_HARDWARE_ERROR_RECORD) {
+        HwErrVariableTotalSize += VariableSize;
+      } else {
+        CommonVariableTotalSize += VariableSize;
+        if (IsUserVariable (Variable)) {
+          CommonUserVariableTotalSize += VariableSize;
+        }
+      }
+
+      Variable = NextVariable;
+    }
+
+    VariableSize = (UINTN)FirstVariable - (UINTN)GetStartPointer (VariableStoreHeader);
+    CopyMem (CurrPtr, GetStartPointer (VariableStoreHeader), VariableSize);
+    CurrPtr += VariableSize;
+  }
+
   //
   // Reinstall all ADDED variables as long as they are not identical to Updating Variable.
   //
-  Variable = GetStartPointer (VariableStoreHeader);
+  Variable = FirstVariable;
   while (IsValidVariableHeader (Variable, GetEndPointer (VariableStoreHeader))) {
     NextVariable = GetNextVariablePtr (Variable, AuthFormat);
     if ((Variable != UpdatingVariable) && (Variable->State == VAR_ADDED)) {
@@ -637,10 +683,12 @@ Reclaim (
     Variable = NextVariable;
   }
 
+  UsedSize = (UINTN)Variable - (UINTN)VariableBase;
+
   //
   // Reinstall all in delete transition variables.
   //
-  Variable = GetStartPointer (VariableStoreHeader);
+  Variable = FirstVariable;
   while (IsValidVariableHeader (Variable, GetEndPointer (VariableStoreHeader))) {
     NextVariable = GetNextVariablePtr (Variable, AuthFormat);
     if ((Variable != UpdatingVariable) && (Variable != UpdatingInDeletedTransition) && (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) {
@@ -655,7 +703,8 @@ Reclaim (
       while (IsValidVariableHeader (AddedVariable, GetEndPointer ((VARIABLE_STORE_HEADER *)ValidBuffer))) {
         NextAddedVariable = GetNextVariablePtr (AddedVariable, AuthFormat);
         NameSize          = NameSizeOfVariable (AddedVariable, AuthFormat);
-        if (CompareGuid (
+        if ((AddedVariable->State == VAR_ADDED) &&
+            CompareGuid (
               GetVendorGuidPtr (AddedVariable, AuthFormat),
               GetVendorGuidPtr (Variable, AuthFormat)
               ) && (NameSize == NameSizeOfVariable (Variable, AuthFormat)))
@@ -756,13 +805,38 @@ Reclaim (
     Status = EFI_SUCCESS;
   } else {
     //
-    // If non-volatile variable store, perform FTW here.
+    // If non-volatile variable store, perform FTW here. An incremental reclaim
+    // writes the blocks from the one that holds the first variable it rewrites
+    // to the end of the variables.
     //
+    if (RewriteOffset == 0) {
+      WriteOffset = 0;
+      WriteSize   = VariableStoreHeader->Size;
+    } else {
+      WriteOffset = ((RewriteOffset + BlockOffset) / BlockSize) * BlockSize - BlockOffset;
+      WriteSize   = MAX (UsedSize, (UINTN)CurrPtr - (UINTN)ValidBuffer);
+      WriteSize   = ((WriteSize + BlockOffset + BlockSize - 1) / BlockSize) * BlockSize - BlockOffset;
+      WriteSize   = MIN (WriteSize, VariableStoreHeader->Size) - WriteOffset;
+    }
+
     Status = FtwVariableSpace (
                VariableBase,
-               (VARIABLE_STORE_HEADER *)ValidBuffer
+               (VARIABLE_STORE_HEADER *)ValidBuffer,
+               WriteOffset,
+               WriteSize
                );
     if (!EFI_ERROR (Status)) {
+      if (FeaturePcdGet (PcdVariableCollectStatistics)) {
+        if (RewriteOffset == 0) {
+          mVariableReclaimStatistics.FullReclaimCount++;
+        } else {
+          mVariableReclaimStatistics.IncrementalReclaimCount++;
+        }
+
+        mVariableReclaimStatistics.BytesWritten   += WriteSize;
+        mVariableReclaimStatistics.BytesReclaimed += UsedSize + ((NewVariable != NULL) ? NewVariableSize : 0) - ((UINTN)CurrPtr - (UINTN)ValidBuffer);
+      }
+
       *LastVariableOffset                                = (UINTN)CurrPtr - (UINTN)ValidBuffer;
       mVariableModuleGlobal->HwErrVariableTotalSize      = HwErrVariableTotalSize;
       mVariableModuleGlobal->CommonVariableTotalSize     = CommonVariableTotalSize;
@@ -794,6 +868,7 @@ Reclaim (
 Done:
   DoneStatus = EFI_SUCCESS;
   if (IsVolatile || mVariableModuleGlobal->VariableGlobal.EmuNvMode) {
+    VariableIndexInvalidate (VariableStoreHeader);
     DoneStatus = SynchronizeRuntimeVariableCache (
                    &mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext.VariableRuntimeVolatileCache,
                    0,
@@ -806,6 +881,7 @@ Done:
     // For NV variable reclaim, we use mNvVariableCache as the buffer, so copy the data back.
     //
     CopyMem (mNvVariableCache, (UINT8 *)(UINTN)VariableBase, VariableStoreHeader->Size);
+    VariableIndexInvalidate (mNvVariableCache);
     DoneStatus = SynchronizeRuntimeVariableCache (
                    &mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext.VariableRuntimeNvCache,
                    0,
@@ -821,6 +897,128 @@ Done:
   return Status;
 }
 
+/**
+
+  Variable store garbage collection and reclaim operation.
+
+  If PcdVariableIncrementalReclaim is TRUE, the non-volatile variable store is
+  only rewritten from the variable GetReclaimRewriteOffset() chooses, when the
+  variables before it can stay as they are.
+
+  @param[in]      VariableBase            Base address of variable store.
+  @param[out]     LastVariableOffset      Offset of last variable.
+  @param[in]      IsVolatile              The variable store is volatile or not;
+                                          if it is non-volatile, need FTW.
+  @param[in, out] UpdatingPtrTrack        Pointer to updating variable pointer track structure.
+  @param[in]      NewVariable             Pointer to new variable.
+  @param[in]      NewVariableSize         New variable size.
+
+  @return EFI_SUCCESS                  Reclaim operation has finished successfully.
+  @return EFI_OUT_OF_RESOURCES         No enough memory resources or variable space.
+  @return Others                       Unexpect error happened during reclaim operation.
+
+**/
+EFI_STATUS
+Reclaim (
+  IN     EFI_PHYSICAL_ADDRESS    VariableBase,
+  OUT    UINTN                   *LastVariableOffset,
+  IN     BOOLEAN                 IsVolatile,
+  IN OUT VARIABLE_POINTER_TRACK  *UpdatingPtrTrack,
+  IN     VARIABLE_HEADER         *NewVariable,
+  IN     UINTN                   NewVariableSize
+  )
+{
+  EFI_STATUS             Status;
+  VARIABLE_STORE_HEADER  *VariableStoreHeader;
+  UINTN                  RewriteOffset;
+  UINTN                  BlockOffset;
+  UINTN                  BlockSize;
+  UINTN                  MinimumFreeSize;
+  UINTN                  Index;
+  UINT64                 StartTick;
+  UINT64                 EndTick;
+  UINT64                 CounterStart;
+  UINT64                 CounterEnd;
+  UINT64                 StallTime;
+
+  if (IsVolatile || mVariableModuleGlobal->VariableGlobal.EmuNvMode) {
+    return ReclaimVariableStore (VariableBase, LastVariableOffset, IsVolatile, UpdatingPtrTrack, NewVariable, NewVariableSize, 0, 0, 0);
+  }
+
+  StartTick = 0;
+  if (FeaturePcdGet (PcdVariableCollectStatistics)) {
+    StartTick = GetPerformanceCounter ();
+  }
+
+  VariableStoreHeader = (VARIABLE_STORE_HEADER *)((UINTN)VariableBase);
+  RewriteOffset       = 0;
+  BlockOffset         = 0;
+  BlockSize           = 0;
+  if (PcdGetBool (PcdVariableIncrementalReclaim) &&
+      !EFI_ERROR (GetVariableStoreBlockInfo (VariableBase, &BlockOffset, &BlockSize)))
+  {
+    //
+    // Only the whole store is rewritten after the free area was found dirty.
+    //
+    for (Index = mVariableModuleGlobal->NonVolatileLastVariableOffset; Index < mNvVariableCache->Size; Index++) {
+      if (((UINT8 *)mNvVariableCache)[Index] != 0xff) {
+        break;
+      }
+    }
+
+    if (Index == mNvVariableCache->Size) {
+      //
+      // Leave room for the largest variable, and for the free space watermark.
+      //
+      MinimumFreeSize = MAX (mVariableModuleGlobal->MaxVariableSize, mVariableModuleGlobal->MaxAuthVariableSize);
+      MinimumFreeSize = MAX (MinimumFreeSize, VariableStoreHeader->Size / 100 * PcdGet8 (PcdVariableReclaimFreeSpaceWatermark));
+      if (NewVariable != NULL) {
+        MinimumFreeSize += NewVariableSize;
+      }
+
+      RewriteOffset = GetReclaimRewriteOffset (
+                        VariableStoreHeader,
+                        BlockOffset,
+                        BlockSize,
+                        (UpdatingPtrTrack != NULL) ? UpdatingPtrTrack->CurrPtr : NULL,
+                        (UpdatingPtrTrack != NULL) ? UpdatingPtrTrack->InDeletedTransitionPtr : NULL,
+                        MinimumFreeSize,
+                        mVariableModuleGlobal->VariableGlobal.AuthFormat
+                        );
+    }
+  }
+
+  if (RewriteOffset != 0) {
+    Status = ReclaimVariableStore (VariableBase, LastVariableOffset, IsVolatile, UpdatingPtrTrack, NewVariable, NewVariableSize, RewriteOffset, BlockOffset, BlockSize);
+    if (Status == EFI_OUT_OF_RESOURCES) {
+      //
+      // The deleted variables the incremental reclaim drops are not enough for
+      // the quotas of the new variable, rewrite the whole store.
+      //
+      RewriteOffset = 0;
+    }
+  }
+
+  if (RewriteOffset == 0) {
+    Status = ReclaimVariableStore (VariableBase, LastVariableOffset, IsVolatile, UpdatingPtrTrack, NewVariable, NewVariableSize, 0, 0, 0);
+  }
+
+  if (FeaturePcdGet (PcdVariableCollectStatistics)) {
+    EndTick = GetPerformanceCounter ();
+    GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+    if (CounterStart > CounterEnd) {
+      StallTime = GetTimeInNanoSecond (StartTick - EndTick);
+    } else {
+      StallTime = GetTimeInNanoSecond (EndTick - StartTick);
+    }
+
+    mVariableReclaimStatistics.TotalStallTime += StallTime;
+    mVariableReclaimStatistics.MaxStallTime    = MAX (mVariableReclaimStatistics.MaxStallTime, StallTime);
+  }
+
+  return Status;
+}
+
 /**
   Finds variable in storage blocks of volatile and non-volatile storage areas.
 
@@ -3215,6 +3413,7 @@ ReclaimForOS (
   EFI_STATUS      Status;
   UINTN           RemainingCommonRuntimeVariableSpace;
   UINTN           RemainingHwErrVariableSpace;
+  UINTN           FreeVariableSpace;
   STATIC BOOLEAN  Reclaimed;
 
   //
@@ -3235,6 +3434,7 @@ ReclaimForOS (
   }
 
   RemainingHwErrVariableSpace = PcdGet32 (PcdHwErrStorageSize) - mVariableModuleGlobal->HwErrVariableTotalSize;
+  FreeVariableSpace           = mNvVariableCache->Size - mVariableModuleGlobal->NonVolatileLastVariableOffset;
 
   //
   // Check if the free area is below a threshold.
@@ -3242,7 +3442,8 @@ ReclaimForOS (
   if (((RemainingCommonRuntimeVariableSpace < mVariableModuleGlobal->MaxVariableSize) ||
        (RemainingCommonRuntimeVariableSpace < mVariableModuleGlobal->MaxAuthVariableSize)) ||
       ((PcdGet32 (PcdHwErrStorageSize) != 0) &&
-       (RemainingHwErrVariableSpace < PcdGet32 (PcdMaxHardwareErrorVariableSize))))
+       (RemainingHwErrVariableSpace < PcdGet32 (PcdMaxHardwareErrorVariableSize))) ||
+      (FreeVariableSpace < mNvVariableCache->Size / 100 * PcdGet8 (PcdVariableReclaimFreeSpaceWatermark)))
   {
     Status = Reclaim (
                mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase,
@@ -3805,6 +4006,19 @@ VariableCommonInitialize (
   VolatileVariableStore->Reserved  = 0;
   VolatileVariableStore->Reserved1 = 0;
 
+  //
+  // Index the variable stores by name and GUID. Lookups walk a store
+  // without index, so failing to create one is not fatal.
+  //
+  Status = VariableIndexCreate (VolatileVariableStore);
+  if (!EFI_ERROR (Status)) {
+    Status = VariableIndexCreate (mNvVariableCache);
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "Variable driver will walk the variable stores: %r\n", Status));
+  }
+
   return EFI_SUCCESS;
 }
 
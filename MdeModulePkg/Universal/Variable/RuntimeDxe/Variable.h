@@ -31,12 +31,14 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Library/MemoryAllocationLib.h>
 #include <Library/AuthVariableLib.h>
 #include <Library/VarCheckLib.h>
+#include <Library/TimerLib.h>
 #include <Guid/GlobalVariable.h>
 #include <Guid/EventGroup.h>
 #include <Guid/VariableFormat.h>
 #include <Guid/SystemNvDataGuid.h>
 #include <Guid/FaultTolerantWrite.h>
 #include <Guid/VarErrorFlag.h>
+#include <Guid/VariableReclaimStatistics.h>
 
 #include "PrivilegePolymorphic.h"
 
@@ -74,6 +76,7 @@ typedef struct {
   BOOLEAN                   *ReadLock;
   BOOLEAN                   *PendingUpdate;
   BOOLEAN                   *HobFlushComplete;
+  UINT32                    *Generation;
   VARIABLE_RUNTIME_CACHE    VariableRuntimeHobCache;
   VARIABLE_RUNTIME_CACHE    VariableRuntimeNvCache;
   VARIABLE_RUNTIME_CACHE    VariableRuntimeVolatileCache;
@@ -142,12 +145,14 @@ FlushHobVariableToFlash (
 /**
   Writes a buffer to variable storage space, in the working block.
 
-  This function writes a buffer to variable storage space into a firmware
-  volume block device. The destination is specified by the parameter
+  This function writes a range of a buffer to variable storage space into a
+  firmware volume block device. The destination is specified by the parameter
   VariableBase. Fault Tolerant Write protocol is used for writing.
 
   @param  VariableBase   Base address of the variable to write.
   @param  VariableBuffer Point to the variable data buffer.
+  @param  Offset         Offset of the range to write from the start of the store.
+  @param  Length         Length of the range to write.
 
   @retval EFI_SUCCESS    The function completed successfully.
   @retval EFI_NOT_FOUND  Fail to locate Fault Tolerant Write protocol.
@@ -157,7 +162,61 @@ FlushHobVariableToFlash (
 EFI_STATUS
 FtwVariableSpace (
   IN EFI_PHYSICAL_ADDRESS   VariableBase,
-  IN VARIABLE_STORE_HEADER  *VariableBuffer
+  IN VARIABLE_STORE_HEADER  *VariableBuffer,
+  IN UINTN                  Offset,
+  IN UINTN                  Length
+  );
+
+/**
+  Gets the layout of the blocks of the non-volatile variable store.
+
+  @param  VariableBase   Base address of the variable store.
+  @param  BlockOffset    Pointer to the offset of the variable store in its
+                         first block for output.
+  @param  BlockSize      Pointer to the size of the blocks for output.
+
+  @retval EFI_SUCCESS    The layout was returned.
+  @retval EFI_NOT_FOUND  Fail to find FVB handle by address.
+  @retval EFI_ABORTED    Fail to find valid LBA and offset.
+
+**/
+EFI_STATUS
+GetVariableStoreBlockInfo (
+  IN  EFI_PHYSICAL_ADDRESS  VariableBase,
+  OUT UINTN                 *BlockOffset,
+  OUT UINTN                 *BlockSize
+  );
+
+/**
+  Chooses the first variable an incremental reclaim rewrites.
+
+  The variables before it are kept in place as they are, deleted ones
+  included, so that the blocks they fill are neither erased nor written. Of
+  the choices that free at least MinimumFreeSize bytes, the one that rewrites
+  the blocks holding the most deleted variables per byte written is taken.
+
+  @param[in] VariableStoreHeader          Pointer to the variable store header.
+  @param[in] BlockOffset                  Offset of the variable store in its first block.
+  @param[in] BlockSize                    Size of the blocks of the variable store.
+  @param[in] UpdatingVariable             Variable that reclaim drops, or NULL.
+  @param[in] UpdatingInDeletedTransition  Variable in delete transition that reclaim drops, or NULL.
+  @param[in] MinimumFreeSize              Size the variables must leave free after reclaim.
+  @param[in] AuthFormat                   TRUE indicates authenticated variables are used.
+                                          FALSE indicates authenticated variables are not used.
+
+  @return Offset of the first variable to rewrite from the start of the store,
+          or 0 if the whole store has to be rewritten.
+
+**/
+UINTN
+GetReclaimRewriteOffset (
+  IN VARIABLE_STORE_HEADER  *VariableStoreHeader,
+  IN UINTN                  BlockOffset,
+  IN UINTN                  BlockSize,
+  IN VARIABLE_HEADER        *UpdatingVariable OPTIONAL,
+  IN VARIABLE_HEADER        *UpdatingInDeletedTransition OPTIONAL,
+  IN UINTN                  MinimumFreeSize,
+  IN BOOLEAN                AuthFormat
   );
 
 /**
@@ -690,6 +749,7 @@ extern VARIABLE_MODULE_GLOBAL      *mVariableModuleGlobal;
 extern EFI_FIRMWARE_VOLUME_HEADER  *mNvFvHeaderCache;
 extern VARIABLE_STORE_HEADER       *mNvVariableCache;
 extern VARIABLE_INFO_ENTRY         *gVariableInfo;
+extern VARIABLE_RECLAIM_STATISTICS  mVariableReclaimStatistics;
 extern BOOLEAN                     mEndOfDxe;
 extern VAR_CHECK_REQUEST_SOURCE    mRequestSource;
 
@@ -0,0 +1,413 @@
+/** @file
+  The hash index of the variable stores shared by the variable modules.
+
+  Entries are added for every variable header found past the indexed part of
+  the store, whatever its state, as the state of a variable changes in place.
+  The state is checked at lookup time. Headers are only ever appended to a
+  store, until reclaim rewrites it and the index is rebuilt.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "VariableIndex.h"
+#include "VariableParsing.h"
+
+//
+// Capacity of an index when it is first filled
+//
+#define VARIABLE_INDEX_MIN_ENTRIES  64
+
+VARIABLE_STORE_INDEX  mVariableStoreIndex[VARIABLE_INDEX_MAX_STORES];
+
+/**
+  Computes the FNV-1a hash of the GUID and the name of a variable.
+
+  @param[in] VendorGuid     Vendor GUID of the variable.
+  @param[in] VariableName   Name of the variable.
+  @param[in] NameSize       Size of the name in bytes, with its terminator.
+
+  @return The hash of the variable.
+
+**/
+STATIC
+UINT32
+VariableIndexHash (
+  IN CONST EFI_GUID  *VendorGuid,
+  IN CONST VOID      *VariableName,
+  IN UINTN           NameSize
+  )
+{
+  CONST UINT8  *Byte;
+  UINT32       Hash;
+  UINTN        Index;
+
+  Hash = 0x811C9DC5;
+  Byte = (CONST UINT8 *)VendorGuid;
+  for (Index = 0; Index < sizeof (EFI_GUID); Index++) {
+    Hash = (Hash ^ Byte[Index]) * 0x01000193;
+  }
+
+  Byte = VariableName;
+  for (Index = 0; Index < NameSize; Index++) {
+    Hash = (Hash ^ Byte[Index]) * 0x01000193;
+  }
+
+  return Hash;
+}
+
+/**
+  Returns the buckets of an index.
+
+  @param[in] Index  The index.
+
+  @return The buckets of the index.
+
+**/
+STATIC
+UINT32 *
+VariableIndexBuckets (
+  IN VARIABLE_STORE_INDEX  *Index
+  )
+{
+  return (UINT32 *)(Index->Entries + Index->Capacity);
+}
+
+/**
+  Doubles the capacity of an index. Indexes only grow before runtime, as
+  memory cannot be allocated at runtime.
+
+  @param[in, out] Index  The index.
+
+  @retval TRUE   The index has grown.
+  @retval FALSE  The index could not grow.
+
+**/
+STATIC
+BOOLEAN
+VariableIndexGrow (
+  IN OUT VARIABLE_STORE_INDEX  *Index
+  )
+{
+  VARIABLE_INDEX_ENTRY  *Entries;
+  UINT32                *Buckets;
+  UINT32                *Bucket;
+  UINT32                Capacity;
+  UINT32                EntryIndex;
+
+  if (AtRuntime ()) {
+    return FALSE;
+  }
+
+  Capacity = (Index->Capacity == 0) ? VARIABLE_INDEX_MIN_ENTRIES : Index->Capacity * 2;
+  Entries  = AllocateRuntimePool (Capacity * (sizeof (VARIABLE_INDEX_ENTRY) + sizeof (UINT32)));
+  if (Entries == NULL) {
+    return FALSE;
+  }
+
+  Buckets = (UINT32 *)(Entries + Capacity);
+  ZeroMem (Buckets, Capacity * sizeof (UINT32));
+  for (EntryIndex = 0; EntryIndex < Index->Count; EntryIndex++) {
+    Bucket                     = &Buckets[Index->Entries[EntryIndex].Hash & (Capacity - 1)];
+    Entries[EntryIndex].Hash   = Index->Entries[EntryIndex].Hash;
+    Entries[EntryIndex].Offset = Index->Entries[EntryIndex].Offset;
+    Entries[EntryIndex].Next   = *Bucket;
+    *Bucket                    = EntryIndex + 1;
+  }
+
+  if (Index->Entries != NULL) {
+    FreePool (Index->Entries);
+  }
+
+  Index->Entries  = Entries;
+  Index->Capacity = Capacity;
+  return TRUE;
+}
+
+/**
+  Indexes the variables appended to a store since the last lookup.
+
+  @param[in, out] Index        The index of the store.
+  @param[in]      AuthFormat   TRUE indicates authenticated variables are used.
+                               FALSE indicates authenticated variables are not used.
+
+  @retval TRUE   Every variable of the store is indexed.
+  @retval FALSE  The index is incomplete.
+
+**/
+STATIC
+BOOLEAN
+VariableIndexUpdate (
+  IN OUT VARIABLE_STORE_INDEX  *Index,
+  IN     BOOLEAN               AuthFormat
+  )
+{
+  VARIABLE_HEADER       *StartPtr;
+  VARIABLE_HEADER       *EndPtr;
+  VARIABLE_HEADER       *Variable;
+  CHAR16                *Name;
+  UINTN                 NameSize;
+  VARIABLE_INDEX_ENTRY  *Entry;
+  UINT32                *Bucket;
+
+  if (Index->Incomplete) {
+    return FALSE;
+  }
+
+  StartPtr = GetStartPointer (Index->Store);
+  EndPtr   = GetEndPointer (Index->Store);
+  Variable = (VARIABLE_HEADER *)((UINTN)StartPtr + Index->IndexedSize);
+  while (IsValidVariableHeader (Variable, EndPtr)) {
+    //
+    // The lookup hashes the name up to its terminator, which is only the
+    // name FindVariableEx() compares if it ends with the terminator.
+    //
+    Name     = GetVariableNamePtr (Variable, AuthFormat);
+    NameSize = NameSizeOfVariable (Variable, AuthFormat);
+    if ((NameSize < sizeof (CHAR16)) || ((NameSize & 1) != 0) ||
+        ((UINTN)Name > (UINTN)EndPtr) || (NameSize > (UINTN)EndPtr - (UINTN)Name) ||
+        (ReadUnaligned16 ((UINT16 *)((UINTN)Name + NameSize - sizeof (CHAR16))) != 0))
+    {
+      Index->Incomplete = TRUE;
+      return FALSE;
+    }
+
+    if ((Index->Count == Index->Capacity) && !VariableIndexGrow (Index)) {
+      Index->Incomplete = TRUE;
+      return FALSE;
+    }
+
+    Entry         = &Index->Entries[Index->Count];
+    Entry->Hash   = VariableIndexHash (GetVendorGuidPtr (Variable, AuthFormat), Name, NameSize);
+    Entry->Offset = (UINT32)((UINTN)Variable - (UINTN)StartPtr);
+    Bucket        = &VariableIndexBuckets (Index)[Entry->Hash & (Index->Capacity - 1)];
+    Entry->Next   = *Bucket;
+    Index->Count++;
+    *Bucket = Index->Count;
+
+    Variable           = GetNextVariablePtr (Variable, AuthFormat);
+    Index->IndexedSize = (UINTN)Variable - (UINTN)StartPtr;
+  }
+
+  return TRUE;
+}
+
+/**
+  Creates the hash index of a variable store.
+
+  The index is filled by the first lookup in the store.
+
+  @param[in] Store  Pointer to the variable store header.
+
+  @retval EFI_SUCCESS            The index was created.
+  @retval EFI_OUT_OF_RESOURCES   There is no room for another index, or the
+                                 index could not be allocated.
+
+**/
+EFI_STATUS
+VariableIndexCreate (
+  IN VARIABLE_STORE_HEADER  *Store
+  )
+{
+  UINTN                 Slot;
+  VARIABLE_STORE_INDEX  *Index;
+
+  Index = NULL;
+  for (Slot = 0; Slot < VARIABLE_INDEX_MAX_STORES; Slot++) {
+    if (mVariableStoreIndex[Slot].Store == Store) {
+      return EFI_SUCCESS;
+    }
+
+    if ((Index == NULL) && (mVariableStoreIndex[Slot].Store == NULL)) {
+      Index = &mVariableStoreIndex[Slot];
+    }
+  }
+
+  if (Index == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ZeroMem (Index, sizeof (*Index));
+  if (!VariableIndexGrow (Index)) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Index->Store = Store;
+  return EFI_SUCCESS;
+}
+
+/**
+  Drops the entries of the hash index of a variable store, after the store
+  was rewritten by reclaim. The index is rebuilt by the next lookup.
+
+  @param[in] Store  Pointer to the variable store header, or NULL for all the
+                    variable stores.
+
+**/
+VOID
+VariableIndexInvalidate (
+  IN VARIABLE_STORE_HEADER  *Store OPTIONAL
+  )
+{
+  UINTN                 Slot;
+  VARIABLE_STORE_INDEX  *Index;
+
+  for (Slot = 0; Slot < VARIABLE_INDEX_MAX_STORES; Slot++) {
+    Index = &mVariableStoreIndex[Slot];
+    if ((Index->Store == NULL) || ((Store != NULL) && (Index->Store != Store))) {
+      continue;
+    }
+
+    ZeroMem (VariableIndexBuckets (Index), Index->Capacity * sizeof (UINT32));
+    Index->Count       = 0;
+    Index->IndexedSize = 0;
+    Index->Incomplete  = FALSE;
+  }
+}
+
+/**
+  Checks whether a variable header is the variable FindVariableEx() looks
+  for, apart from its state.
+
+  @param[in] Variable        Pointer to the variable header.
+  @param[in] VariableName    Name of the variable to be found.
+  @param[in] VendorGuid      Vendor GUID to be found.
+  @param[in] IgnoreRtCheck   Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                             check at runtime when searching variable.
+  @param[in] AuthFormat      TRUE indicates authenticated variables are used.
+                             FALSE indicates authenticated variables are not used.
+
+  @retval TRUE   The variable matches.
+  @retval FALSE  The variable does not match.
+
+**/
+STATIC
+BOOLEAN
+VariableIndexMatch (
+  IN VARIABLE_HEADER  *Variable,
+  IN CHAR16           *VariableName,
+  IN EFI_GUID         *VendorGuid,
+  IN BOOLEAN          IgnoreRtCheck,
+  IN BOOLEAN          AuthFormat
+  )
+{
+  if ((Variable->State != VAR_ADDED) && (Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) {
+    return FALSE;
+  }
+
+  if (!IgnoreRtCheck && AtRuntime () && ((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) {
+    return FALSE;
+  }
+
+  return (BOOLEAN)(CompareGuid (VendorGuid, GetVendorGuidPtr (Variable, AuthFormat)) &&
+                   (CompareMem (VariableName, GetVariableNamePtr (Variable, AuthFormat), NameSizeOfVariable (Variable, AuthFormat)) == 0));
+}
+
+/**
+  Finds a variable with the hash index of the store it is searched in.
+
+  The result is the one of walking the store from PtrTrack->StartPtr to
+  PtrTrack->EndPtr, as FindVariableEx() does.
+
+  @param[in]       VariableName        Name of the variable to be found.
+  @param[in]       VendorGuid          Vendor GUID to be found.
+  @param[in]       IgnoreRtCheck       Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                       check at runtime when searching variable.
+  @param[in, out]  PtrTrack            Variable Track Pointer structure that contains Variable Information.
+  @param[in]       AuthFormat          TRUE indicates authenticated variables are used.
+                                       FALSE indicates authenticated variables are not used.
+
+  @retval          EFI_SUCCESS         Variable found successfully.
+  @retval          EFI_NOT_FOUND       Variable not found.
+  @retval          EFI_UNSUPPORTED     The store is not indexed, the index is
+                                       incomplete, or VariableName is empty.
+                                       The store has to be walked.
+
+**/
+EFI_STATUS
+VariableIndexFindVariable (
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN     BOOLEAN                 AuthFormat
+  )
+{
+  UINTN                 Slot;
+  VARIABLE_STORE_INDEX  *Index;
+  UINTN                 NameSize;
+  UINT32                Hash;
+  UINT32                EntryIndex;
+  VARIABLE_INDEX_ENTRY  *Entry;
+  VARIABLE_HEADER       *Variable;
+  VARIABLE_HEADER       *AddedVariable;
+  VARIABLE_HEADER       *InDeletedVariable;
+
+  if (VariableName[0] == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Index = NULL;
+  for (Slot = 0; Slot < VARIABLE_INDEX_MAX_STORES; Slot++) {
+    if ((mVariableStoreIndex[Slot].Store != NULL) &&
+        (GetStartPointer (mVariableStoreIndex[Slot].Store) == PtrTrack->StartPtr) &&
+        (GetEndPointer (mVariableStoreIndex[Slot].Store) == PtrTrack->EndPtr))
+    {
+      Index = &mVariableStoreIndex[Slot];
+      break;
+    }
+  }
+
+  if ((Index == NULL) || !VariableIndexUpdate (Index, AuthFormat)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  NameSize = sizeof (CHAR16);
+  while (VariableName[NameSize / sizeof (CHAR16) - 1] != 0) {
+    NameSize += sizeof (CHAR16);
+  }
+
+  Hash = VariableIndexHash (VendorGuid, VariableName, NameSize);
+
+  //
+  // The walk returns the first ADDED variable, with the last IN_DELETED_TRANSITION
+  // one before it. Without ADDED variable, it returns the last IN_DELETED_TRANSITION
+  // one. The entries of a bucket are not in store order, so compare their offsets.
+  //
+  AddedVariable = NULL;
+  for (EntryIndex = VariableIndexBuckets (Index)[Hash & (Index->Capacity - 1)]; EntryIndex != 0; EntryIndex = Entry->Next) {
+    Entry    = &Index->Entries[EntryIndex - 1];
+    Variable = (VARIABLE_HEADER *)((UINTN)PtrTrack->StartPtr + Entry->Offset);
+    if ((Entry->Hash == Hash) &&
+        (Variable->State == VAR_ADDED) &&
+        ((AddedVariable == NULL) || (Variable < AddedVariable)) &&
+        VariableIndexMatch (Variable, VariableName, VendorGuid, IgnoreRtCheck, AuthFormat))
+    {
+      AddedVariable = Variable;
+    }
+  }
+
+  InDeletedVariable = NULL;
+  for (EntryIndex = VariableIndexBuckets (Index)[Hash & (Index->Capacity - 1)]; EntryIndex != 0; EntryIndex = Entry->Next) {
+    Entry    = &Index->Entries[EntryIndex - 1];
+    Variable = (VARIABLE_HEADER *)((UINTN)PtrTrack->StartPtr + Entry->Offset);
+    if ((Entry->Hash == Hash) &&
+        (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) &&
+        ((AddedVariable == NULL) || (Variable < AddedVariable)) &&
+        ((InDeletedVariable == NULL) || (Variable > InDeletedVariable)) &&
+        VariableIndexMatch (Variable, VariableName, VendorGuid, IgnoreRtCheck, AuthFormat))
+    {
+      InDeletedVariable = Variable;
+    }
+  }
+
+  if (AddedVariable != NULL) {
+    PtrTrack->CurrPtr                = AddedVariable;
+    PtrTrack->InDeletedTransitionPtr = InDeletedVariable;
+    return EFI_SUCCESS;
+  }
+
+  PtrTrack->CurrPtr                = InDeletedVariable;
+  PtrTrack->InDeletedTransitionPtr = NULL;
+  return (InDeletedVariable == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/** @file
+  The hash index of the variable stores shared by the variable modules.
+
+  The index maps the name and GUID of a variable to the offsets of the
+  variable headers that carry them, so that FindVariableEx() does not walk
+  the whole store. It only lives in memory: the stores keep their format.
+
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _VARIABLE_INDEX_H_
+#define _VARIABLE_INDEX_H_
+
+#include "Variable.h"
+
+///
+/// The number of stores a module indexes: the volatile and the non-volatile
+/// store, or their runtime caches.
+///
+#define VARIABLE_INDEX_MAX_STORES  2
+
+typedef struct {
+  UINT32    Hash;
+  //
+  // Offset of the variable header from the start of the variables.
+  //
+  UINT32    Offset;
+  //
+  // Index + 1 of the next entry in the same bucket, 0 ends the chain.
+  //
+  UINT32    Next;
+} VARIABLE_INDEX_ENTRY;
+
+typedef struct {
+  VARIABLE_STORE_HEADER    *Store;
+  //
+  // Entries[Capacity] is followed by the UINT32 Buckets[Capacity], so that
+  // the index is one allocation. Capacity is a power of 2.
+  //
+  VARIABLE_INDEX_ENTRY     *Entries;
+  UINT32                   Capacity;
+  UINT32                   Count;
+  //
+  // Size of the variables from the start of the store that are indexed.
+  // Variables appended after them are indexed by the next lookup.
+  //
+  UINTN                    IndexedSize;
+  //
+  // The index misses a variable: it was full and could not grow, or a
+  // header could not be indexed. Lookups walk the store until the index is
+  // rebuilt.
+  //
+  BOOLEAN                  Incomplete;
+} VARIABLE_STORE_INDEX;
+
+extern VARIABLE_STORE_INDEX  mVariableStoreIndex[VARIABLE_INDEX_MAX_STORES];
+
+/**
+  Creates the hash index of a variable store.
+
+  The index is filled by the first lookup in the store.
+
+  @param[in] Store  Pointer to the variable store header.
+
+  @retval EFI_SUCCESS            The index was created.
+  @retval EFI_OUT_OF_RESOURCES   There is no room for another index, or the
+                                 index could not be allocated.
+
+**/
+EFI_STATUS
+VariableIndexCreate (
+  IN VARIABLE_STORE_HEADER  *Store
+  );
+
+/**
+  Drops the entries of the hash index of a variable store, after the store
+  was rewritten by reclaim. The index is rebuilt by the next lookup.
+
+  @param[in] Store  Pointer to the variable store header, or NULL for all the
+                    variable stores.
+
+**/
+VOID
+VariableIndexInvalidate (
+  IN VARIABLE_STORE_HEADER  *Store OPTIONAL
+  );
+
+/**
+  Finds a variable with the hash index of the store it is searched in.
+
+  The result is the one of walking the store from PtrTrack->StartPtr to
+  PtrTrack->EndPtr, as FindVariableEx() does.
+
+  @param[in]       VariableName        Name of the variable to be found.
+  @param[in]       VendorGuid          Vendor GUID to be found.
+  @param[in]       IgnoreRtCheck       Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                       check at runtime when searching variable.
+  @param[in, out]  PtrTrack            Variable Track Pointer structure that contains Variable Information.
+  @param[in]       AuthFormat          TRUE indicates authenticated variables are used.
+                                       FALSE indicates authenticated variables are not used.
+
+  @retval          EFI_SUCCESS         Variable found successfully.
+  @retval          EFI_NOT_FOUND       Variable not found.
+  @retval          EFI_UNSUPPORTED     The store is not indexed, the index is
+                                       incomplete, or VariableName is empty.
+                                       The store has to be walked.
+
+**/
+EFI_STATUS
+VariableIndexFindVariable (
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN     BOOLEAN                 AuthFormat
+  );
+
+#endif
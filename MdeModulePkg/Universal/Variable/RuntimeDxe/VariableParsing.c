@@ -8,6 +8,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 **/
 
 #include "VariableParsing.h"
+#include "VariableIndex.h"
 
 /**
 
@@ -468,11 +469,20 @@ FindVariableEx (
   IN     BOOLEAN                 AuthFormat
   )
 {
+  EFI_STATUS       Status;
   VARIABLE_HEADER  *InDeletedVariable;
   VOID             *Point;
 
   PtrTrack->InDeletedTransitionPtr = NULL;
 
+  //
+  // Look the variable up in the hash index of the store, if it has one.
+  //
+  Status = VariableIndexFindVariable (VariableName, VendorGuid, IgnoreRtCheck, PtrTrack, AuthFormat);
+  if (Status != EFI_UNSUPPORTED) {
+    return Status;
+  }
+
   //
   // Find the variable by walk through HOB, volatile and non-volatile variable store.
   //
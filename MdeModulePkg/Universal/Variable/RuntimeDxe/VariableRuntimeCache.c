@@ -31,6 +31,7 @@ FlushPendingRuntimeVariableCacheUpdates (
   )
 {
   VARIABLE_RUNTIME_CACHE_CONTEXT  *VariableRuntimeCacheContext;
+  BOOLEAN                         Rewrite;
 
   VariableRuntimeCacheContext = &mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext;
 
@@ -42,6 +43,15 @@ FlushPendingRuntimeVariableCacheUpdates (
   }
 
   if (*(VariableRuntimeCacheContext->PendingUpdate)) {
+    //
+    // Only reclaim and initialization update a store from its header, other
+    // updates append a variable or change the state of one.
+    //
+    Rewrite = (BOOLEAN)(((VariableRuntimeCacheContext->VariableRuntimeNvCache.PendingUpdateOffset == 0) &&
+                         (VariableRuntimeCacheContext->VariableRuntimeNvCache.PendingUpdateLength != 0)) ||
+                        ((VariableRuntimeCacheContext->VariableRuntimeVolatileCache.PendingUpdateOffset == 0) &&
+                         (VariableRuntimeCacheContext->VariableRuntimeVolatileCache.PendingUpdateLength != 0)));
+
     if ((VariableRuntimeCacheContext->VariableRuntimeHobCache.Store != NULL) &&
         (mVariableModuleGlobal->VariableGlobal.HobVariableBase > 0))
     {
@@ -88,6 +98,10 @@ FlushPendingRuntimeVariableCacheUpdates (
     VariableRuntimeCacheContext->VariableRuntimeVolatileCache.PendingUpdateLength = 0;
     VariableRuntimeCacheContext->VariableRuntimeVolatileCache.PendingUpdateOffset = 0;
     *(VariableRuntimeCacheContext->PendingUpdate)                                 = FALSE;
+
+    if (Rewrite && (VariableRuntimeCacheContext->Generation != NULL)) {
+      (*(VariableRuntimeCacheContext->Generation))++;
+    }
   }
 
   return EFI_SUCCESS;
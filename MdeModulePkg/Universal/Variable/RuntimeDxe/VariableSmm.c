@@ -459,23 +459,24 @@ SmmVariableHandler (
   IN OUT UINTN       *CommBufferSize
   )
 {
-  EFI_STATUS                                               Status;
-  SMM_VARIABLE_COMMUNICATE_HEADER                          *SmmVariableFunctionHeader;
-  SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE                 *SmmVariableHeader;
-  SMM_VARIABLE_COMMUNICATE_GET_NEXT_VARIABLE_NAME          *GetNextVariableName;
-  SMM_VARIABLE_COMMUNICATE_QUERY_VARIABLE_INFO             *QueryVariableInfo;
-  SMM_VARIABLE_COMMUNICATE_GET_PAYLOAD_SIZE                *GetPayloadSize;
-  SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_CONTEXT  *RuntimeVariableCacheContext;
-  SMM_VARIABLE_COMMUNICATE_GET_RUNTIME_CACHE_INFO          *GetRuntimeCacheInfo;
-  SMM_VARIABLE_COMMUNICATE_LOCK_VARIABLE                   *VariableToLock;
-  SMM_VARIABLE_COMMUNICATE_VAR_CHECK_VARIABLE_PROPERTY     *CommVariableProperty;
-  VARIABLE_INFO_ENTRY                                      *VariableInfo;
-  VARIABLE_RUNTIME_CACHE_CONTEXT                           *VariableCacheContext;
-  VARIABLE_STORE_HEADER                                    *VariableCache;
-  UINTN                                                    InfoSize;
-  UINTN                                                    NameBufferSize;
-  UINTN                                                    CommBufferPayloadSize;
-  UINTN                                                    TempCommBufferSize;
+  EFI_STATUS                                                  Status;
+  SMM_VARIABLE_COMMUNICATE_HEADER                             *SmmVariableFunctionHeader;
+  SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE                    *SmmVariableHeader;
+  SMM_VARIABLE_COMMUNICATE_GET_NEXT_VARIABLE_NAME             *GetNextVariableName;
+  SMM_VARIABLE_COMMUNICATE_QUERY_VARIABLE_INFO                *QueryVariableInfo;
+  SMM_VARIABLE_COMMUNICATE_GET_PAYLOAD_SIZE                   *GetPayloadSize;
+  SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_CONTEXT     *RuntimeVariableCacheContext;
+  SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION  *RuntimeVariableCacheGeneration;
+  SMM_VARIABLE_COMMUNICATE_GET_RUNTIME_CACHE_INFO             *GetRuntimeCacheInfo;
+  SMM_VARIABLE_COMMUNICATE_LOCK_VARIABLE                      *VariableToLock;
+  SMM_VARIABLE_COMMUNICATE_VAR_CHECK_VARIABLE_PROPERTY        *CommVariableProperty;
+  VARIABLE_INFO_ENTRY                                         *VariableInfo;
+  VARIABLE_RUNTIME_CACHE_CONTEXT                              *VariableCacheContext;
+  VARIABLE_STORE_HEADER                                       *VariableCache;
+  UINTN                                                       InfoSize;
+  UINTN                                                       NameBufferSize;
+  UINTN                                                       CommBufferPayloadSize;
+  UINTN                                                       TempCommBufferSize;
 
   //
   // If input is invalid, stop processing this SMI
@@ -931,6 +932,7 @@ SmmVariableHandler (
       VariableCacheContext->PendingUpdate                      = RuntimeVariableCacheContext->PendingUpdate;
       VariableCacheContext->ReadLock                           = RuntimeVariableCacheContext->ReadLock;
       VariableCacheContext->HobFlushComplete                   = RuntimeVariableCacheContext->HobFlushComplete;
+      VariableCacheContext->Generation                         = NULL;
 
       // Set up the intial pending request since the RT cache needs to be in sync with SMM cache
       VariableCacheContext->VariableRuntimeHobCache.PendingUpdateOffset = 0;
@@ -959,6 +961,43 @@ SmmVariableHandler (
 
       Status = EFI_SUCCESS;
       break;
+    case SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE_GENERATION:
+      if (CommBufferPayloadSize < sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION)) {
+        DEBUG ((DEBUG_ERROR, "InitRuntimeVariableCacheGeneration: SMM communication buffer size invalid!\n"));
+        Status = EFI_ACCESS_DENIED;
+        goto EXIT;
+      }
+
+      if (mEndOfDxe) {
+        DEBUG ((DEBUG_ERROR, "InitRuntimeVariableCacheGeneration: Cannot init generation after end of DXE!\n"));
+        Status = EFI_ACCESS_DENIED;
+        goto EXIT;
+      }
+
+      VariableCacheContext = &mVariableModuleGlobal->VariableGlobal.VariableRuntimeCacheContext;
+      if (VariableCacheContext->PendingUpdate == NULL) {
+        DEBUG ((DEBUG_ERROR, "InitRuntimeVariableCacheGeneration: Runtime cache context is not initialized!\n"));
+        Status = EFI_NOT_READY;
+        goto EXIT;
+      }
+
+      CopyMem (mVariableBufferPayload, SmmVariableFunctionHeader->Data, sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION));
+      RuntimeVariableCacheGeneration = (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION *)mVariableBufferPayload;
+
+      if ((RuntimeVariableCacheGeneration->Generation == NULL) ||
+          !VariableSmmIsBufferOutsideSmmValid (
+             (UINTN)RuntimeVariableCacheGeneration->Generation,
+             sizeof (*(RuntimeVariableCacheGeneration->Generation))
+             ))
+      {
+        DEBUG ((DEBUG_ERROR, "InitRuntimeVariableCacheGeneration: Runtime cache generation buffer is NULL, in SMRAM or overflow!\n"));
+        Status = EFI_ACCESS_DENIED;
+        goto EXIT;
+      }
+
+      VariableCacheContext->Generation = RuntimeVariableCacheGeneration->Generation;
+      Status                           = EFI_SUCCESS;
+      break;
     case SMM_VARIABLE_FUNCTION_SYNC_RUNTIME_CACHE:
       Status = FlushPendingRuntimeVariableCacheUpdates ();
       break;
@@ -986,6 +1025,21 @@ SmmVariableHandler (
       Status = EFI_SUCCESS;
       break;
 
+    case SMM_VARIABLE_FUNCTION_GET_RECLAIM_STATISTICS:
+      if (!FeaturePcdGet (PcdVariableCollectStatistics)) {
+        Status = EFI_UNSUPPORTED;
+        break;
+      }
+
+      if (CommBufferPayloadSize < sizeof (VARIABLE_RECLAIM_STATISTICS)) {
+        DEBUG ((DEBUG_ERROR, "GetReclaimStatistics: SMM communication buffer size invalid!\n"));
+        return EFI_SUCCESS;
+      }
+
+      CopyMem (SmmVariableFunctionHeader->Data, &mVariableReclaimStatistics, sizeof (VARIABLE_RECLAIM_STATISTICS));
+      Status = EFI_SUCCESS;
+      break;
+
     default:
       Status = EFI_UNSUPPORTED;
   }
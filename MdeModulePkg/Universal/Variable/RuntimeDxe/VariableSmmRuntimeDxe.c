@@ -42,6 +42,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 
 #include "PrivilegePolymorphic.h"
 #include "VariableParsing.h"
+#include "VariableIndex.h"
 
 EFI_HANDLE                      mHandle                              = NULL;
 EFI_SMM_VARIABLE_PROTOCOL       *mSmmVariable                        = NULL;
@@ -58,6 +59,8 @@ UINTN                           mVariableRuntimeHobCacheBufferSize;
 UINTN                           mVariableRuntimeNvCacheBufferSize;
 UINTN                           mVariableRuntimeVolatileCacheBufferSize;
 UINTN                           mVariableBufferPayloadSize;
+UINT32                          mVariableRuntimeCacheGeneration;
+UINT32                          mVariableRuntimeCacheIndexGeneration;
 BOOLEAN                         mVariableRuntimeCachePendingUpdate;
 BOOLEAN                         mVariableRuntimeCacheReadLock;
 BOOLEAN                         mVariableAuthFormat;
@@ -588,6 +591,28 @@ CheckForRuntimeCacheSync (
   }
 }
 
+/**
+  Drops the hash indexes of the runtime caches if SMM rewrote a cache since
+  they were built, e.g. to reclaim it. The indexes are rebuilt by the next
+  lookups.
+
+  The runtime cache read lock must be held, so that SMM does not rewrite a
+  cache between the check and the lookups.
+
+**/
+VOID
+CheckForRuntimeCacheRewrite (
+  VOID
+  )
+{
+  ASSERT (mVariableRuntimeCacheReadLock);
+
+  if (mVariableRuntimeCacheIndexGeneration != mVariableRuntimeCacheGeneration) {
+    VariableIndexInvalidate (NULL);
+    mVariableRuntimeCacheIndexGeneration = mVariableRuntimeCacheGeneration;
+  }
+}
+
 /**
   Finds the given variable in a runtime cache variable store.
 
@@ -639,6 +664,7 @@ FindVariableInRuntimeCache (
 
   mVariableRuntimeCacheReadLock = TRUE;
   CheckForRuntimeCacheSync ();
+  CheckForRuntimeCacheRewrite ();
 
   if (!mVariableRuntimeCachePendingUpdate) {
     //
@@ -907,6 +933,7 @@ GetNextVariableNameInRuntimeCache (
   CheckForRuntimeCacheSync ();
 
   mVariableRuntimeCacheReadLock = TRUE;
+  CheckForRuntimeCacheRewrite ();
   if (!mVariableRuntimeCachePendingUpdate) {
     //
     // 0: Volatile, 1: HOB, 2: Non-Volatile.
@@ -1356,11 +1383,18 @@ VariableAddressChangeEvent (
   IN VOID       *Context
   )
 {
+  UINTN  Index;
+
   EfiConvertPointer (0x0, (VOID **)&mVariableBuffer);
   EfiConvertPointer (0x0, (VOID **)&mMmCommunication2);
   EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableRuntimeHobCacheBuffer);
   EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableRuntimeNvCacheBuffer);
   EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableRuntimeVolatileCacheBuffer);
+
+  for (Index = 0; Index < VARIABLE_INDEX_MAX_STORES; Index++) {
+    EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableStoreIndex[Index].Store);
+    EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableStoreIndex[Index].Entries);
+  }
 }
 
 /**
@@ -1619,6 +1653,85 @@ Done:
   return Status;
 }
 
+/**
+  Sends the runtime cache generation counter to SMM.
+
+  SMM increments the counter each time it rewrites a runtime cache, which
+  invalidates the hash indexes of the runtime caches. The counter is sent in
+  its own request, after the runtime cache context, so that the layout of the
+  context is shared with MM implementations that do not maintain it.
+
+  @retval EFI_SUCCESS               The counter was sent to SMM.
+  @retval EFI_UNSUPPORTED           SMM does not maintain the counter.
+  @retval EFI_OUT_OF_RESOURCES      The memory resources needed for a CommBuffer are not available.
+  @retval Others                    The counter could not be sent to SMM.
+
+**/
+EFI_STATUS
+SendRuntimeVariableCacheGenerationToSmm (
+  VOID
+  )
+{
+  EFI_STATUS                                                  Status;
+  SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION  *SmmRuntimeVarCacheGeneration;
+  EFI_MM_COMMUNICATE_HEADER                                   *SmmCommunicateHeader;
+  SMM_VARIABLE_COMMUNICATE_HEADER                             *SmmVariableFunctionHeader;
+  UINTN                                                       CommSize;
+  UINT8                                                       *CommBuffer;
+
+  CommBuffer = mVariableBuffer;
+
+  if (CommBuffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  AcquireLockOnlyAtBootTime (&mVariableServicesLock);
+
+  //
+  // Init the communicate buffer. The buffer data size is:
+  // SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION);
+  //
+  CommSize = SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION);
+  ZeroMem (CommBuffer, CommSize);
+
+  SmmCommunicateHeader = (EFI_MM_COMMUNICATE_HEADER *)CommBuffer;
+  CopyGuid (&SmmCommunicateHeader->HeaderGuid, &gEfiSmmVariableProtocolGuid);
+  SmmCommunicateHeader->MessageLength = SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION);
+
+  SmmVariableFunctionHeader                = (SMM_VARIABLE_COMMUNICATE_HEADER *)SmmCommunicateHeader->Data;
+  SmmVariableFunctionHeader->Function      = SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE_GENERATION;
+  SmmVariableFunctionHeader->ReturnStatus  = EFI_UNSUPPORTED;
+  SmmRuntimeVarCacheGeneration             = (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE_GENERATION *)SmmVariableFunctionHeader->Data;
+  SmmRuntimeVarCacheGeneration->Generation = &mVariableRuntimeCacheGeneration;
+
+  //
+  // Request to unblock this region to be accessible from inside MM environment
+  //
+  Status = MmUnblockMemoryRequest (
+             (EFI_PHYSICAL_ADDRESS)ALIGN_VALUE ((UINTN)SmmRuntimeVarCacheGeneration->Generation - EFI_PAGE_SIZE + 1, EFI_PAGE_SIZE),
+             EFI_SIZE_TO_PAGES (sizeof (mVariableRuntimeCacheGeneration))
+             );
+  if ((Status != EFI_UNSUPPORTED) && EFI_ERROR (Status)) {
+    goto Done;
+  }
+
+  //
+  // Send data to SMM.
+  //
+  Status = mMmCommunication2->Communicate (mMmCommunication2, CommBuffer, CommBuffer, &CommSize);
+  ASSERT_EFI_ERROR (Status);
+  if (CommSize <= SMM_VARIABLE_COMMUNICATE_HEADER_SIZE) {
+    Status = EFI_BAD_BUFFER_SIZE;
+    goto Done;
+  }
+
+  Status = SmmVariableFunctionHeader->ReturnStatus;
+
+Done:
+  ReleaseLockOnlyAtBootTime (&mVariableServicesLock);
+  return Status;
+}
+
 /**
   Initialize variable service and install Variable Architectural protocol.
 
@@ -1634,6 +1747,7 @@ SmmVariableReady (
   )
 {
   EFI_STATUS  Status;
+  EFI_STATUS  IndexStatus;
 
   Status = gBS->LocateProtocol (&gEfiSmmVariableProtocolGuid, NULL, (VOID **)&mSmmVariable);
   if (EFI_ERROR (Status)) {
@@ -1677,7 +1791,20 @@ SmmVariableReady (
           if (!EFI_ERROR (Status)) {
             Status = SendRuntimeVariableCacheContextToSmm ();
             if (!EFI_ERROR (Status)) {
+              //
+              // Index the runtime caches by name and GUID, if SMM reports
+              // when it rewrites them. Lookups walk a cache without index, so
+              // failing to create one is not fatal.
+              //
+              IndexStatus = SendRuntimeVariableCacheGenerationToSmm ();
               SyncRuntimeCache ();
+
+              if (EFI_ERROR (IndexStatus) ||
+                  EFI_ERROR (VariableIndexCreate (mVariableRuntimeVolatileCacheBuffer)) ||
+                  EFI_ERROR (VariableIndexCreate (mVariableRuntimeNvCacheBuffer)))
+              {
+                DEBUG ((DEBUG_WARN, "Variable driver will walk the runtime caches.\n"));
+              }
             }
           }
         }
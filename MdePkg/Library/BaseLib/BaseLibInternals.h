@@ -553,6 +553,29 @@ InternalAsciiHexCharToUintn (
   IN      CHAR8  Char
   );
 
+/**
+  Folds the longest prefix of a buffer that the processor can checksum with
+  dedicated instructions into a CRC32.
+
+  @param  Crc     On input, the CRC32 of the data that precedes Buffer, before
+                  its final inversion. On output, the CRC32 including the
+                  prefix of Buffer that was processed, before its final
+                  inversion.
+  @param  Buffer  The pointer to the buffer.
+  @param  Length  The size, in bytes, of Buffer.
+
+  @return The number of bytes of Buffer folded into Crc, 0 if the processor
+          does not accelerate the computation.
+
+**/
+UINTN
+EFIAPI
+InternalCrc32Accelerated (
+  IN OUT  UINT32      *Crc,
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length
+  );
+
 //
 // Ia32 and x64 specific functions
 //
@@ -850,6 +873,30 @@ InternalX86RdRand64  (
   OUT     UINT64  *Rand
   );
 
+  #if defined (MDE_CPU_X64)
+
+/**
+  Folds a buffer into a CRC32 with the PCLMULQDQ instruction.
+
+  @param  Crc     The CRC32 of the data that precedes Buffer, before its final
+                  inversion.
+  @param  Buffer  The pointer to the buffer.
+  @param  Length  The size, in bytes, of Buffer. It must be a multiple of 16
+                  and at least 64.
+
+  @return The CRC32 including Buffer, before its final inversion.
+
+**/
+UINT32
+EFIAPI
+InternalCrc32Pclmul (
+  IN      UINT32      Crc,
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length
+  );
+
+  #endif
+
 #else
 
 #endif
@@ -0,0 +1,34 @@
+/** @file
+  CRC32 acceleration for the processors without dedicated instructions.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "BaseLibInternals.h"
+
+/**
+  Folds the longest prefix of a buffer that the processor can checksum with
+  dedicated instructions into a CRC32.
+
+  @param  Crc     On input, the CRC32 of the data that precedes Buffer, before
+                  its final inversion. On output, the CRC32 including the
+                  prefix of Buffer that was processed, before its final
+                  inversion.
+  @param  Buffer  The pointer to the buffer.
+  @param  Length  The size, in bytes, of Buffer.
+
+  @return The number of bytes of Buffer folded into Crc, 0 if the processor
+          does not accelerate the computation.
+
+**/
+UINTN
+EFIAPI
+InternalCrc32Accelerated (
+  IN OUT  UINT32      *Crc,
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length
+  )
+{
+  return 0;
+}
@@ -8,6 +8,328 @@
 
 #include "BaseLibInternals.h"
 
+//
+// Partitions of at most this many elements are sorted by insertion
+//
+#define QUICK_SORT_INSERTION_THRESHOLD  16
+
+typedef struct {
+  UINTN                ElementSize;
+  BASE_SORT_COMPARE    CompareFunction;
+  VOID                 *BufferOneElement;
+  //
+  // Size of the integer type the elements are swapped as, or 0 if they are
+  // swapped through BufferOneElement
+  //
+  UINTN                SwapSize;
+} QUICK_SORT_CONTEXT;
+
+/**
+  Returns a pointer to an element of a buffer.
+
+  @param[in] Context   The sort context.
+  @param[in] Base      The first element of the buffer.
+  @param[in] Index     The index of the element.
+
+  @return The pointer to the element.
+**/
+STATIC
+UINT8 *
+QuickSortElement (
+  IN CONST QUICK_SORT_CONTEXT  *Context,
+  IN       UINT8               *Base,
+  IN       UINTN               Index
+  )
+{
+  return Base + Index * Context->ElementSize;
+}
+
+/**
+  Swaps two elements.
+
+  @param[in]      Context   The sort context.
+  @param[in, out] Left      The first element.
+  @param[in, out] Right     The second element.
+**/
+STATIC
+VOID
+QuickSortSwap (
+  IN     CONST QUICK_SORT_CONTEXT  *Context,
+  IN OUT UINT8                     *Left,
+  IN OUT UINT8                     *Right
+  )
+{
+  UINT32  Value32;
+  UINT64  Value64;
+
+  if (Left == Right) {
+    return;
+  }
+
+  switch (Context->SwapSize) {
+    case sizeof (UINT32):
+      Value32          = *(UINT32 *)Left;
+      *(UINT32 *)Left  = *(UINT32 *)Right;
+      *(UINT32 *)Right = Value32;
+      break;
+
+    case sizeof (UINT64):
+      Value64          = *(UINT64 *)Left;
+      *(UINT64 *)Left  = *(UINT64 *)Right;
+      *(UINT64 *)Right = Value64;
+      break;
+
+    default:
+      CopyMem (Context->BufferOneElement, Left, Context->ElementSize);
+      CopyMem (Left, Right, Context->ElementSize);
+      CopyMem (Right, Context->BufferOneElement, Context->ElementSize);
+      break;
+  }
+}
+
+/**
+  Compares two elements with the compare function of the caller.
+
+  @param[in] Context   The sort context.
+  @param[in] Left      The first element.
+  @param[in] Right     The second element.
+
+  @return The result of the compare function.
+**/
+STATIC
+INTN
+QuickSortCompare (
+  IN CONST QUICK_SORT_CONTEXT  *Context,
+  IN       UINT8               *Left,
+  IN       UINT8               *Right
+  )
+{
+  return Context->CompareFunction (Left, Right);
+}
+
+/**
+  Sorts a small buffer by insertion. Elements are moved by swapping
+  neighbours, so that the compare function only sees elements of the buffer.
+
+  @param[in]      Context   The sort context.
+  @param[in, out] Base      The first element of the buffer.
+  @param[in]      Count     The number of elements in the buffer.
+**/
+STATIC
+VOID
+QuickSortInsertion (
+  IN     CONST QUICK_SORT_CONTEXT  *Context,
+  IN OUT UINT8                     *Base,
+  IN     UINTN                     Count
+  )
+{
+  UINTN  Index;
+  UINT8  *Element;
+  UINT8  *Previous;
+
+  for (Index = 1; Index < Count; Index++) {
+    Element = QuickSortElement (Context, Base, Index);
+    while (Element > Base) {
+      Previous = Element - Context->ElementSize;
+      if (QuickSortCompare (Context, Previous, Element) <= 0) {
+        break;
+      }
+
+      QuickSortSwap (Context, Previous, Element);
+      Element = Previous;
+    }
+  }
+}
+
+/**
+  Moves an element of a binary max-heap down until the heap is ordered.
+
+  @param[in]      Context   The sort context.
+  @param[in, out] Base      The first element of the heap.
+  @param[in]      Root      The index of the element to move down.
+  @param[in]      Count     The number of elements in the heap.
+**/
+STATIC
+VOID
+QuickSortSiftDown (
+  IN     CONST QUICK_SORT_CONTEXT  *Context,
+  IN OUT UINT8                     *Base,
+  IN     UINTN                     Root,
+  IN     UINTN                     Count
+  )
+{
+  UINTN  Child;
+
+  while (Root < Count / 2) {
+    Child = 2 * Root + 1;
+    if ((Child + 1 < Count) &&
+        (QuickSortCompare (Context, QuickSortElement (Context, Base, Child), QuickSortElement (Context, Base, Child + 1)) < 0))
+    {
+      Child++;
+    }
+
+    if (QuickSortCompare (Context, QuickSortElement (Context, Base, Root), QuickSortElement (Context, Base, Child)) >= 0) {
+      return;
+    }
+
+    QuickSortSwap (Context, QuickSortElement (Context, Base, Root), QuickSortElement (Context, Base, Child));
+    Root = Child;
+  }
+}
+
+/**
+  Sorts a buffer with heapsort. It is the fallback for the partitions that
+  quicksort keeps splitting unevenly.
+
+  @param[in]      Context   The sort context.
+  @param[in, out] Base      The first element of the buffer.
+  @param[in]      Count     The number of elements in the buffer.
+**/
+STATIC
+VOID
+QuickSortHeap (
+  IN     CONST QUICK_SORT_CONTEXT  *Context,
+  IN OUT UINT8                     *Base,
+  IN     UINTN                     Count
+  )
+{
+  UINTN  Index;
+
+  for (Index = Count / 2; Index > 0; Index--) {
+    QuickSortSiftDown (Context, Base, Index - 1, Count);
+  }
+
+  for (Index = Count - 1; Index > 0; Index--) {
+    QuickSortSwap (Context, Base, QuickSortElement (Context, Base, Index));
+    QuickSortSiftDown (Context, Base, 0, Index);
+  }
+}
+
+/**
+  Partitions a buffer around the median of its first, middle and last
+  elements.
+
+  @param[in]      Context   The sort context.
+  @param[in, out] Base      The first element of the buffer.
+  @param[in]      Count     The number of elements in the buffer, more than
+                            QUICK_SORT_INSERTION_THRESHOLD.
+
+  @return The index of the pivot. The elements before it are not greater than
+          the pivot, and the elements after it are not less than the pivot.
+**/
+STATIC
+UINTN
+QuickSortPartition (
+  IN     CONST QUICK_SORT_CONTEXT  *Context,
+  IN OUT UINT8                     *Base,
+  IN     UINTN                     Count
+  )
+{
+  UINT8  *First;
+  UINT8  *Middle;
+  UINT8  *Last;
+  UINT8  *Pivot;
+  UINTN  Left;
+  UINTN  Right;
+
+  //
+  // Order the first, middle and last elements. The first and last elements
+  // then stop the scans below, and sorted or reversed input is split evenly.
+  //
+  First  = Base;
+  Middle = QuickSortElement (Context, Base, Count / 2);
+  Last   = QuickSortElement (Context, Base, Count - 1);
+  if (QuickSortCompare (Context, Middle, First) < 0) {
+    QuickSortSwap (Context, First, Middle);
+  }
+
+  if (QuickSortCompare (Context, Last, Middle) < 0) {
+    QuickSortSwap (Context, Middle, Last);
+    if (QuickSortCompare (Context, Middle, First) < 0) {
+      QuickSortSwap (Context, First, Middle);
+    }
+  }
+
+  //
+  // Keep the pivot next to the last element while partitioning
+  //
+  Pivot = QuickSortElement (Context, Base, Count - 2);
+  QuickSortSwap (Context, Middle, Pivot);
+
+  //
+  // Both scans stop on elements equal to the pivot, so that runs of equal
+  // elements are split evenly too. The bounds only matter for compare
+  // functions that are not consistent.
+  //
+  Left  = 0;
+  Right = Count - 2;
+  while (TRUE) {
+    do {
+      Left++;
+    } while (Left < Count - 2 && QuickSortCompare (Context, QuickSortElement (Context, Base, Left), Pivot) < 0);
+
+    do {
+      Right--;
+    } while (Right > 0 && QuickSortCompare (Context, Pivot, QuickSortElement (Context, Base, Right)) < 0);
+
+    if (Left >= Right) {
+      break;
+    }
+
+    QuickSortSwap (Context, QuickSortElement (Context, Base, Left), QuickSortElement (Context, Base, Right));
+  }
+
+  QuickSortSwap (Context, QuickSortElement (Context, Base, Left), Pivot);
+  return Left;
+}
+
+/**
+  Sorts a buffer with introsort: quicksort, falling back to heapsort once
+  the partitions get too deep, and insertion sort for small partitions.
+
+  @param[in]      Context      The sort context.
+  @param[in, out] Base         The first element of the buffer.
+  @param[in]      Count        The number of elements in the buffer.
+  @param[in]      DepthLimit   The number of partitioning levels left before
+                               falling back to heapsort.
+**/
+STATIC
+VOID
+QuickSortWorker (
+  IN     CONST QUICK_SORT_CONTEXT  *Context,
+  IN OUT UINT8                     *Base,
+  IN     UINTN                     Count,
+  IN     UINTN                     DepthLimit
+  )
+{
+  UINTN  PivotIndex;
+
+  while (Count > QUICK_SORT_INSERTION_THRESHOLD) {
+    if (DepthLimit == 0) {
+      QuickSortHeap (Context, Base, Count);
+      return;
+    }
+
+    DepthLimit--;
+    PivotIndex = QuickSortPartition (Context, Base, Count);
+
+    //
+    // Recurse into the smaller side and loop on the larger one, so that the
+    // stack depth stays logarithmic
+    //
+    if (PivotIndex < Count - PivotIndex - 1) {
+      QuickSortWorker (Context, Base, PivotIndex, DepthLimit);
+      Base   = QuickSortElement (Context, Base, PivotIndex + 1);
+      Count -= PivotIndex + 1;
+    } else {
+      QuickSortWorker (Context, QuickSortElement (Context, Base, PivotIndex + 1), Count - PivotIndex - 1, DepthLimit);
+      Count = PivotIndex;
+    }
+  }
+
+  QuickSortInsertion (Context, Base, Count);
+}
+
 /**
   This function is identical to perform QuickSort,
   except that is uses the pre-allocated buffer so the in place sorting does not need to
@@ -41,9 +363,7 @@ QuickSort (
   OUT VOID                    *BufferOneElement
   )
 {
-  VOID   *Pivot;
-  UINTN  LoopCount;
-  UINTN  NextSwapLocation;
+  QUICK_SORT_CONTEXT  Context;
 
   ASSERT (BufferToSort     != NULL);
   ASSERT (CompareFunction  != NULL);
@@ -54,64 +374,24 @@ QuickSort (
     return;
   }
 
-  NextSwapLocation = 0;
+  Context.ElementSize      = ElementSize;
+  Context.CompareFunction  = CompareFunction;
+  Context.BufferOneElement = BufferOneElement;
 
   //
-  // pick a pivot (we choose last element)
+  // Swap 4 and 8-byte elements, which include pointers, as integers when
+  // they are naturally aligned
   //
-  Pivot = ((UINT8 *)BufferToSort + ((Count - 1) * ElementSize));
-
-  //
-  // Now get the pivot such that all on "left" are below it
-  // and everything "right" are above it
-  //
-  for (LoopCount = 0; LoopCount < Count -1; LoopCount++) {
-    //
-    // if the element is less than or equal to the pivot
-    //
-    if (CompareFunction ((VOID *)((UINT8 *)BufferToSort + ((LoopCount) * ElementSize)), Pivot) <= 0) {
-      //
-      // swap
-      //
-      CopyMem (BufferOneElement, (UINT8 *)BufferToSort + (NextSwapLocation * ElementSize), ElementSize);
-      CopyMem ((UINT8 *)BufferToSort + (NextSwapLocation * ElementSize), (UINT8 *)BufferToSort + ((LoopCount) * ElementSize), ElementSize);
-      CopyMem ((UINT8 *)BufferToSort + ((LoopCount)*ElementSize), BufferOneElement, ElementSize);
-
-      //
-      // increment NextSwapLocation
-      //
-      NextSwapLocation++;
-    }
+  Context.SwapSize = 0;
+  if (((ElementSize == sizeof (UINT32)) || (ElementSize == sizeof (UINT64))) &&
+      (((UINTN)BufferToSort & (ElementSize - 1)) == 0))
+  {
+    Context.SwapSize = ElementSize;
   }
 
   //
-  // swap pivot to it's final position (NextSwapLocation)
-  //
-  CopyMem (BufferOneElement, Pivot, ElementSize);
-  CopyMem (Pivot, (UINT8 *)BufferToSort + (NextSwapLocation * ElementSize), ElementSize);
-  CopyMem ((UINT8 *)BufferToSort + (NextSwapLocation * ElementSize), BufferOneElement, ElementSize);
-
-  //
-  // Now recurse on 2 partial lists.  neither of these will have the 'pivot' element
-  // IE list is sorted left half, pivot element, sorted right half...
+  // Partitions still larger than the threshold after 2 * log2 (Count) levels
+  // are only seen with degenerate inputs, sort them with heapsort
   //
-  if (NextSwapLocation >= 2) {
-    QuickSort (
-      BufferToSort,
-      NextSwapLocation,
-      ElementSize,
-      CompareFunction,
-      BufferOneElement
-      );
-  }
-
-  if ((Count - NextSwapLocation - 1) >= 2) {
-    QuickSort (
-      (UINT8 *)BufferToSort + (NextSwapLocation + 1) * ElementSize,
-      Count - NextSwapLocation - 1,
-      ElementSize,
-      CompareFunction,
-      BufferOneElement
-      );
-  }
+  QuickSortWorker (&Context, BufferToSort, Count, 2 * (UINTN)HighBitSet64 (Count));
 }
@@ -0,0 +1,60 @@
+/** @file
+  CRC32 acceleration with the PCLMULQDQ instruction.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "BaseLibInternals.h"
+
+//
+// The PCLMULQDQ support is queried with CPUID on every call, as BaseLib
+// cannot cache it in a global variable. CPUID can cost a VM exit, so only
+// buffers that are large enough to amortize it take the accelerated path.
+//
+#define CRC32_PCLMUL_MIN_LENGTH  SIZE_4KB
+
+/**
+  Folds the longest prefix of a buffer that the processor can checksum with
+  dedicated instructions into a CRC32.
+
+  @param  Crc     On input, the CRC32 of the data that precedes Buffer, before
+                  its final inversion. On output, the CRC32 including the
+                  prefix of Buffer that was processed, before its final
+                  inversion.
+  @param  Buffer  The pointer to the buffer.
+  @param  Length  The size, in bytes, of Buffer.
+
+  @return The number of bytes of Buffer folded into Crc, 0 if the processor
+          does not accelerate the computation.
+
+**/
+UINTN
+EFIAPI
+InternalCrc32Accelerated (
+  IN OUT  UINT32      *Crc,
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length
+  )
+{
+  UINT32  RegEcx;
+
+  if (Length < CRC32_PCLMUL_MIN_LENGTH) {
+    return 0;
+  }
+
+  //
+  // CPUID.01h:ECX.PCLMULQDQ[bit 1]
+  //
+  AsmCpuid (0x01, NULL, NULL, &RegEcx, NULL);
+  if ((RegEcx & BIT1) == 0) {
+    return 0;
+  }
+
+  //
+  // The instruction folds 16 bytes at a time, the caller handles the tail
+  //
+  Length = Length & ~(UINTN)(16 - 1);
+  *Crc   = InternalCrc32Pclmul (*Crc, Buffer, Length);
+  return Length;
+}
@@ -0,0 +1,401 @@
+/** @file
+  Host-based unit tests and throughput benchmark of CalculateCrc32() in
+  BaseLib.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <time.h>
+#include <cmocka.h>
+#if defined (__GNUC__)
+  #include <cpuid.h>
+#elif defined (_MSC_VER)
+  #include <intrin.h>
+#endif
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+#include <Library/UnitTestHostBaseLib.h>
+
+#define UNIT_TEST_APP_NAME     "BaseLib CRC32 Unit Test Application"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_SMALL_MAX_LENGTH  600
+#define TEST_LARGE_LENGTH      (SIZE_2MB + SIZE_4KB + 27)
+#define BENCHMARK_LENGTH       SIZE_16MB
+#define BENCHMARK_ITERATIONS   8
+
+//
+// Table of the original byte-at-a-time implementation, used as reference
+//
+UINT32  mReferenceTable[256];
+
+//
+// Whether the CPUID hook reports PCLMULQDQ support to BaseLib
+//
+BOOLEAN  mReportPclmul;
+
+/**
+  Computes a CRC32 one byte at a time, like CalculateCrc32() did before it
+  was optimized.
+
+  @param  Buffer  The pointer to the buffer.
+  @param  Length  The size, in bytes, of Buffer.
+
+  @return The CRC32 of Buffer.
+
+**/
+STATIC
+UINT32
+ReferenceCrc32 (
+  IN CONST UINT8  *Buffer,
+  IN UINTN        Length
+  )
+{
+  UINT32  Crc;
+
+  Crc = 0xffffffff;
+  while (Length > 0) {
+    Crc = (Crc >> 8) ^ mReferenceTable[(UINT8)Crc ^ *Buffer];
+    Buffer++;
+    Length--;
+  }
+
+  return Crc ^ 0xffffffff;
+}
+
+/**
+  Fills a buffer with pseudo-random bytes.
+
+  @param  Buffer  The pointer to the buffer.
+  @param  Length  The size, in bytes, of Buffer.
+
+**/
+STATIC
+VOID
+FillBuffer (
+  OUT UINT8  *Buffer,
+  IN  UINTN  Length
+  )
+{
+  UINT32  Seed;
+
+  Seed = 0x12345678;
+  while (Length > 0) {
+    Seed    = Seed * 1103515245 + 12345;
+    *Buffer = (UINT8)(Seed >> 16);
+    Buffer++;
+    Length--;
+  }
+}
+
+/**
+  Returns whether the host processor supports PCLMULQDQ.
+
+  @retval TRUE   The host processor supports PCLMULQDQ.
+  @retval FALSE  The host processor does not support PCLMULQDQ, or this test
+                 cannot query it.
+
+**/
+STATIC
+BOOLEAN
+HostSupportsPclmul (
+  VOID
+  )
+{
+ #if defined (MDE_CPU_X64) && defined (__GNUC__)
+  unsigned int  RegEax;
+  unsigned int  RegEbx;
+  unsigned int  RegEcx;
+  unsigned int  RegEdx;
+
+  return __get_cpuid (1, &RegEax, &RegEbx, &RegEcx, &RegEdx) && ((RegEcx & BIT1) != 0);
+ #elif defined (MDE_CPU_X64) && defined (_MSC_VER)
+  int  Registers[4];
+
+  __cpuid (Registers, 1);
+  return (Registers[2] & BIT1) != 0;
+ #else
+  return FALSE;
+ #endif
+}
+
+#if defined (MDE_CPU_IA32) || defined (MDE_CPU_X64)
+
+/**
+  CPUID hook of the host BaseLib that reports PCLMULQDQ support as selected
+  by mReportPclmul, and nothing else.
+
+  @param  Index  The 32-bit value to load into EAX prior to invoking the CPUID
+                 instruction.
+  @param  Eax    The pointer to the 32-bit EAX value returned by the CPUID
+                 instruction. This is an optional parameter that may be NULL.
+  @param  Ebx    The pointer to the 32-bit EBX value returned by the CPUID
+                 instruction. This is an optional parameter that may be NULL.
+  @param  Ecx    The pointer to the 32-bit ECX value returned by the CPUID
+                 instruction. This is an optional parameter that may be NULL.
+  @param  Edx    The pointer to the 32-bit EDX value returned by the CPUID
+                 instruction. This is an optional parameter that may be NULL.
+
+  @return Index.
+
+**/
+UINT32
+EFIAPI
+Crc32TestAsmCpuid (
+  IN      UINT32  Index,
+  OUT     UINT32  *Eax   OPTIONAL,
+  OUT     UINT32  *Ebx   OPTIONAL,
+  OUT     UINT32  *Ecx   OPTIONAL,
+  OUT     UINT32  *Edx   OPTIONAL
+  )
+{
+  if (Eax != NULL) {
+    *Eax = 0;
+  }
+
+  if (Ebx != NULL) {
+    *Ebx = 0;
+  }
+
+  if (Ecx != NULL) {
+    *Ecx = (Index == 1 && mReportPclmul) ? BIT1 : 0;
+  }
+
+  if (Edx != NULL) {
+    *Edx = 0;
+  }
+
+  return Index;
+}
+
+#endif
+
+/**
+  Checks CalculateCrc32() against the check value of the CRC32 (ITU-T V.42)
+  and against the empty buffer.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+KnownValues (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UT_ASSERT_EQUAL (CalculateCrc32 ("123456789", 9), 0xCBF43926);
+  UT_ASSERT_EQUAL (CalculateCrc32 ("", 0), 0);
+  UT_ASSERT_EQUAL (CalculateCrc32 ("a", 1), 0xE8B7BE43);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks CalculateCrc32() against the byte-at-a-time implementation on every
+  length up to TEST_SMALL_MAX_LENGTH at every alignment, and on a large
+  buffer that does not end on a 16-byte boundary.
+
+  @param[in]  Context  Whether the PCLMULQDQ path is enabled.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+  @retval  UNIT_TEST_SKIPPED            The host cannot run the PCLMULQDQ path.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+MatchesReference (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT8  *Buffer;
+  UINTN  Offset;
+  UINTN  Length;
+
+  mReportPclmul = (BOOLEAN)(UINTN)Context;
+  if (mReportPclmul && !HostSupportsPclmul ()) {
+    return UNIT_TEST_SKIPPED;
+  }
+
+  Buffer = AllocatePool (TEST_LARGE_LENGTH + 8);
+  UT_ASSERT_NOT_NULL (Buffer);
+  FillBuffer (Buffer, TEST_LARGE_LENGTH + 8);
+
+  for (Offset = 0; Offset < 8; Offset++) {
+    for (Length = 0; Length <= TEST_SMALL_MAX_LENGTH; Length++) {
+      UT_ASSERT_EQUAL (CalculateCrc32 (Buffer + Offset, Length), ReferenceCrc32 (Buffer + Offset, Length));
+    }
+
+    UT_ASSERT_EQUAL (CalculateCrc32 (Buffer + Offset, TEST_LARGE_LENGTH), ReferenceCrc32 (Buffer + Offset, TEST_LARGE_LENGTH));
+  }
+
+  //
+  // Lengths around the threshold and the block sizes of the PCLMULQDQ path
+  //
+  for (Length = SIZE_4KB - 80; Length <= SIZE_4KB + 80; Length++) {
+    UT_ASSERT_EQUAL (CalculateCrc32 (Buffer + 3, Length), ReferenceCrc32 (Buffer + 3, Length));
+  }
+
+  FreePool (Buffer);
+  mReportPclmul = FALSE;
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Measures the throughput of the byte-at-a-time reference, of the slice-by-8
+  implementation and, if the host supports it, of the PCLMULQDQ path on a
+  multi-megabyte buffer.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+ThroughputBenchmark (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT8    *Buffer;
+  UINTN    Pass;
+  UINTN    Iteration;
+  UINT32   Expected;
+  UINT32   Crc;
+  clock_t  Start;
+  clock_t  Ticks;
+  UINT64   Bytes;
+
+  STATIC CONST CHAR8  *Names[] = { "byte-at-a-time", "slice-by-8", "PCLMULQDQ" };
+
+  Buffer = AllocatePool (BENCHMARK_LENGTH);
+  UT_ASSERT_NOT_NULL (Buffer);
+  FillBuffer (Buffer, BENCHMARK_LENGTH);
+
+  Expected = ReferenceCrc32 (Buffer, BENCHMARK_LENGTH);
+  Bytes    = (UINT64)BENCHMARK_LENGTH * BENCHMARK_ITERATIONS;
+
+  for (Pass = 0; Pass < ARRAY_SIZE (Names); Pass++) {
+    if ((Pass == 2) && !HostSupportsPclmul ()) {
+      UT_LOG_INFO ("%a: not supported by the host\n", Names[Pass]);
+      break;
+    }
+
+    mReportPclmul = (BOOLEAN)(Pass == 2);
+
+    Crc   = 0;
+    Start = clock ();
+    for (Iteration = 0; Iteration < BENCHMARK_ITERATIONS; Iteration++) {
+      Crc = (Pass == 0) ? ReferenceCrc32 (Buffer, BENCHMARK_LENGTH) : CalculateCrc32 (Buffer, BENCHMARK_LENGTH);
+    }
+
+    Ticks = clock () - Start;
+    UT_ASSERT_EQUAL (Crc, Expected);
+
+    if (Ticks == 0) {
+      Ticks = 1;
+    }
+
+    UT_LOG_INFO (
+      "%a: %d MB/s\n",
+      Names[Pass],
+      (INT32)(Bytes * CLOCKS_PER_SEC / Ticks / SIZE_1MB)
+      );
+  }
+
+  FreePool (Buffer);
+  mReportPclmul = FALSE;
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the CRC32
+  implementation of BaseLib and run the unit tests.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      Crc32Tests;
+  UINT32                      Index;
+  UINT32                      Bit;
+  UINT32                      Crc;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  for (Index = 0; Index < 256; Index++) {
+    Crc = Index;
+    for (Bit = 0; Bit < 8; Bit++) {
+      Crc = (Crc >> 1) ^ (((Crc & 1) != 0) ? 0xEDB88320 : 0);
+    }
+
+    mReferenceTable[Index] = Crc;
+  }
+
+ #if defined (MDE_CPU_IA32) || defined (MDE_CPU_X64)
+  gUnitTestHostBaseLib.X86->AsmCpuid = Crc32TestAsmCpuid;
+ #endif
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&Crc32Tests, Framework, "CalculateCrc32", "BaseLib.Crc32", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for CalculateCrc32 Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  AddTestCase (Crc32Tests, "Known CRC32 values", "KnownValues", KnownValues, NULL, NULL, NULL);
+  AddTestCase (Crc32Tests, "Slice-by-8 matches the reference", "SliceBy8", MatchesReference, NULL, NULL, (UNIT_TEST_CONTEXT)(UINTN)FALSE);
+  AddTestCase (Crc32Tests, "PCLMULQDQ matches the reference", "Pclmul", MatchesReference, NULL, NULL, (UNIT_TEST_CONTEXT)(UINTN)TRUE);
+  AddTestCase (Crc32Tests, "Throughput on a 16 MB buffer", "Benchmark", ThroughputBenchmark, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+**/
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  return UnitTestingEntry ();
+}
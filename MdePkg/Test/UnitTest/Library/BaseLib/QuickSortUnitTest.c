@@ -0,0 +1,446 @@
+/** @file
+  Host-based unit tests and benchmark of QuickSort() in BaseLib.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <time.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "BaseLib QuickSort Unit Test Application"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_MAX_ELEMENT_SIZE  24
+#define BENCHMARK_COUNT        1000000
+
+typedef enum {
+  PatternRandom,
+  PatternSorted,
+  PatternReversed,
+  PatternEqual,
+  PatternFewDistinct,
+  PatternOrganPipe,
+  PatternSawTooth,
+  PatternMax
+} TEST_PATTERN;
+
+typedef struct {
+  UINTN      ElementSize;
+  BOOLEAN    Misaligned;
+} TEST_LAYOUT;
+
+//
+// Element sizes taking the 4 and 8-byte swap paths, misaligned so that they
+// do not, and generic sizes
+//
+STATIC CONST TEST_LAYOUT  mLayouts[] = {
+  { 1,                      FALSE },
+  { sizeof (UINT32),        FALSE },
+  { sizeof (UINT32),        TRUE  },
+  { sizeof (UINT64),        FALSE },
+  { sizeof (UINT64),        TRUE  },
+  { 12,                     FALSE },
+  { TEST_MAX_ELEMENT_SIZE,  FALSE }
+};
+
+STATIC CONST UINTN  mCounts[] = { 0, 1, 2, 3, 15, 16, 17, 18, 100, 1000, 10007 };
+
+//
+// Size of the key at the start of the elements compared by CompareKeys()
+//
+UINTN  mKeySize;
+
+//
+// Number of calls to CompareKeys()
+//
+UINT64  mCompareCount;
+
+//
+// State of the pseudo-random generator
+//
+UINT32  mSeed;
+
+/**
+  Returns the next pseudo-random number.
+
+  @return A pseudo-random number.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  VOID
+  )
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return mSeed >> 8;
+}
+
+/**
+  Reads the key at the start of an element.
+
+  @param[in] Element  The element.
+
+  @return The key of the element.
+
+**/
+STATIC
+UINT32
+ReadKey (
+  IN CONST VOID  *Element
+  )
+{
+  UINT32  Key;
+
+  Key = 0;
+  CopyMem (&Key, Element, MIN (mKeySize, sizeof (Key)));
+  return Key;
+}
+
+/**
+  Compares the keys of two elements and counts the comparisons.
+
+  @param[in] Buffer1  The first element.
+  @param[in] Buffer2  The second element.
+
+  @retval  0  The keys are equal.
+  @retval <0  The first key is less than the second key.
+  @retval >0  The first key is greater than the second key.
+
+**/
+INTN
+EFIAPI
+CompareKeys (
+  IN CONST VOID  *Buffer1,
+  IN CONST VOID  *Buffer2
+  )
+{
+  UINT32  Key1;
+  UINT32  Key2;
+
+  mCompareCount++;
+  Key1 = ReadKey (Buffer1);
+  Key2 = ReadKey (Buffer2);
+  if (Key1 < Key2) {
+    return -1;
+  }
+
+  return (Key1 > Key2) ? 1 : 0;
+}
+
+/**
+  Computes a hash of an element that does not depend on its position, so
+  that the sum over a buffer only changes if the elements change.
+
+  @param[in] Element      The element.
+  @param[in] ElementSize  The size of the element.
+
+  @return The hash of the element.
+
+**/
+STATIC
+UINT64
+HashElement (
+  IN CONST UINT8  *Element,
+  IN UINTN        ElementSize
+  )
+{
+  UINT64  Hash;
+
+  Hash = 0xCBF29CE484222325ull;
+  while (ElementSize > 0) {
+    Hash ^= *Element;
+    Hash *= 0x100000001B3ull;
+    Element++;
+    ElementSize--;
+  }
+
+  return Hash;
+}
+
+/**
+  Fills a buffer with elements whose keys follow a pattern, and whose other
+  bytes are unique to each element.
+
+  @param[out] Buffer       The buffer.
+  @param[in]  Count        The number of elements.
+  @param[in]  ElementSize  The size of an element.
+  @param[in]  Pattern      The pattern of the keys.
+
+**/
+STATIC
+VOID
+FillElements (
+  OUT UINT8         *Buffer,
+  IN  UINTN         Count,
+  IN  UINTN         ElementSize,
+  IN  TEST_PATTERN  Pattern
+  )
+{
+  UINTN   Index;
+  UINTN   Byte;
+  UINT32  Key;
+
+  for (Index = 0; Index < Count; Index++) {
+    switch (Pattern) {
+      case PatternRandom:
+        Key = NextRandom ();
+        break;
+      case PatternSorted:
+        Key = (UINT32)Index;
+        break;
+      case PatternReversed:
+        Key = (UINT32)(Count - Index);
+        break;
+      case PatternEqual:
+        Key = 7;
+        break;
+      case PatternFewDistinct:
+        Key = NextRandom () % 4;
+        break;
+      case PatternOrganPipe:
+        Key = (UINT32)((Index < Count / 2) ? Index : Count - Index);
+        break;
+      default:
+        Key = (UINT32)(Index % 32);
+        break;
+    }
+
+    CopyMem (Buffer, &Key, MIN (ElementSize, sizeof (Key)));
+    for (Byte = sizeof (Key); Byte < ElementSize; Byte++) {
+      Buffer[Byte] = (UINT8)(Index >> (8 * (Byte % sizeof (UINT32))));
+    }
+
+    Buffer += ElementSize;
+  }
+}
+
+/**
+  Sorts every pattern of keys for every element count and layout, and checks
+  that the result is ordered and holds the same elements as the input.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+SortsAllPatterns (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT8         *Allocation;
+  UINT8         *Buffer;
+  UINT8         OneElement[TEST_MAX_ELEMENT_SIZE];
+  UINTN         Layout;
+  UINTN         CountIndex;
+  UINTN         Count;
+  UINTN         ElementSize;
+  TEST_PATTERN  Pattern;
+  UINTN         Index;
+  UINT64        HashBefore;
+  UINT64        HashAfter;
+
+  Allocation = AllocatePool (mCounts[ARRAY_SIZE (mCounts) - 1] * TEST_MAX_ELEMENT_SIZE + sizeof (UINT64));
+  UT_ASSERT_NOT_NULL (Allocation);
+
+  mSeed = 1;
+  for (Layout = 0; Layout < ARRAY_SIZE (mLayouts); Layout++) {
+    ElementSize = mLayouts[Layout].ElementSize;
+    mKeySize    = ElementSize;
+    Buffer      = ALIGN_POINTER (Allocation, sizeof (UINT64));
+    if (mLayouts[Layout].Misaligned) {
+      Buffer++;
+    }
+
+    for (CountIndex = 0; CountIndex < ARRAY_SIZE (mCounts); CountIndex++) {
+      Count = mCounts[CountIndex];
+      for (Pattern = PatternRandom; Pattern < PatternMax; Pattern++) {
+        FillElements (Buffer, Count, ElementSize, Pattern);
+        HashBefore = 0;
+        for (Index = 0; Index < Count; Index++) {
+          HashBefore += HashElement (Buffer + Index * ElementSize, ElementSize);
+        }
+
+        QuickSort (Buffer, Count, ElementSize, CompareKeys, OneElement);
+
+        HashAfter = 0;
+        for (Index = 0; Index < Count; Index++) {
+          HashAfter += HashElement (Buffer + Index * ElementSize, ElementSize);
+          if (Index > 0) {
+            UT_ASSERT_TRUE (CompareKeys (Buffer + (Index - 1) * ElementSize, Buffer + Index * ElementSize) <= 0);
+          }
+        }
+
+        UT_ASSERT_EQUAL (HashAfter, HashBefore);
+      }
+    }
+  }
+
+  FreePool (Allocation);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that no pattern of keys makes QuickSort() compare elements more than
+  4 * Count * log2 (Count) times, the bound of partitioning down to the depth
+  limit and then heapsorting. The previous implementation compared sorted and
+  equal keys Count * Count / 2 times.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+ComparisonsAreBounded (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT64        *Buffer;
+  UINT64        OneElement;
+  UINTN         Count;
+  UINT64        Limit;
+  TEST_PATTERN  Pattern;
+
+  Count  = 100000;
+  Limit  = 4 * (UINT64)Count * (UINT64)(HighBitSet64 (Count) + 1);
+  Buffer = AllocatePool (Count * sizeof (UINT64));
+  UT_ASSERT_NOT_NULL (Buffer);
+
+  mSeed    = 1;
+  mKeySize = sizeof (UINT64);
+  for (Pattern = PatternRandom; Pattern < PatternMax; Pattern++) {
+    FillElements ((UINT8 *)Buffer, Count, sizeof (UINT64), Pattern);
+    mCompareCount = 0;
+    QuickSort (Buffer, Count, sizeof (UINT64), CompareKeys, &OneElement);
+    UT_LOG_INFO ("Pattern %d: %d comparisons\n", Pattern, (INT32)mCompareCount);
+    UT_ASSERT_TRUE (mCompareCount <= Limit);
+  }
+
+  FreePool (Buffer);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Measures the time QuickSort() takes to sort a million pointer-sized
+  elements with random and with sorted keys.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+SortBenchmark (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN         *Buffer;
+  UINTN         OneElement;
+  TEST_PATTERN  Pattern;
+  clock_t       Start;
+  clock_t       Ticks;
+
+  Buffer = AllocatePool (BENCHMARK_COUNT * sizeof (UINTN));
+  UT_ASSERT_NOT_NULL (Buffer);
+
+  mSeed    = 1;
+  mKeySize = sizeof (UINTN);
+  for (Pattern = PatternRandom; Pattern <= PatternSorted; Pattern++) {
+    FillElements ((UINT8 *)Buffer, BENCHMARK_COUNT, sizeof (UINTN), Pattern);
+    Start = clock ();
+    QuickSort (Buffer, BENCHMARK_COUNT, sizeof (UINTN), CompareKeys, &OneElement);
+    Ticks = clock () - Start;
+
+    UT_LOG_INFO (
+      "%a keys: %d ms\n",
+      (Pattern == PatternRandom) ? "Random" : "Sorted",
+      (INT32)((UINT64)Ticks * 1000 / CLOCKS_PER_SEC)
+      );
+  }
+
+  FreePool (Buffer);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for QuickSort()
+  in BaseLib and run the unit tests.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      QuickSortTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&QuickSortTests, Framework, "QuickSort", "BaseLib.QuickSort", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for QuickSort Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  AddTestCase (QuickSortTests, "Sorts every pattern, count and element size", "Patterns", SortsAllPatterns, NULL, NULL, NULL);
+  AddTestCase (QuickSortTests, "Comparisons stay within O(n log n)", "Comparisons", ComparisonsAreBounded, NULL, NULL, NULL);
+  AddTestCase (QuickSortTests, "Time to sort a million elements", "Benchmark", SortBenchmark, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+**/
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  return UnitTestingEntry ();
+}
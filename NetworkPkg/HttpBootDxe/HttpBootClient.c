@@ -597,17 +597,19 @@ HttpBootHttpIoCallback (
 }
 
 /**
-  Create a HttpIo instance for the file download.
+  Create and configure a HttpIo instance for the file download.
 
   @param[in]    Private        The pointer to the driver's private data.
+  @param[out]   HttpIo         The HttpIo instance to initialize.
 
   @retval EFI_SUCCESS          Successfully created.
   @retval Others               Failed to create HttpIo.
 
 **/
 EFI_STATUS
-HttpBootCreateHttpIo (
-  IN     HTTP_BOOT_PRIVATE_DATA  *Private
+HttpBootInitHttpIo (
+  IN     HTTP_BOOT_PRIVATE_DATA  *Private,
+  OUT    HTTP_IO                 *HttpIo
   )
 {
   HTTP_IO_CONFIG_DATA  ConfigData;
@@ -643,8 +645,29 @@ HttpBootCreateHttpIo (
              &ConfigData,
              HttpBootHttpIoCallback,
              (VOID *)Private,
-             &Private->HttpIo
+             HttpIo
              );
+
+  return Status;
+}
+
+/**
+  Create a HttpIo instance for the file download.
+
+  @param[in]    Private        The pointer to the driver's private data.
+
+  @retval EFI_SUCCESS          Successfully created.
+  @retval Others               Failed to create HttpIo.
+
+**/
+EFI_STATUS
+HttpBootCreateHttpIo (
+  IN     HTTP_BOOT_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = HttpBootInitHttpIo (Private, &Private->HttpIo);
   if (EFI_ERROR (Status)) {
     return Status;
   }
@@ -653,6 +676,93 @@ HttpBootCreateHttpIo (
   return EFI_SUCCESS;
 }
 
+/**
+  Build the HTTP headers needed to download the boot file:
+    Host
+    Accept
+    User-Agent
+
+  @param[in]    Private          The pointer to the driver's private data.
+  @param[in]    MaxHeaderCount   The number of headers to make room for, at least 3.
+  @param[out]   HttpIoHeader     The headers built.
+
+  @retval EFI_SUCCESS            The headers are built.
+  @retval Others                 Failed to build the headers.
+
+**/
+EFI_STATUS
+HttpBootCreateRequestHeader (
+  IN     HTTP_BOOT_PRIVATE_DATA  *Private,
+  IN     UINTN                   MaxHeaderCount,
+  OUT    HTTP_IO_HEADER          **HttpIoHeader
+  )
+{
+  EFI_STATUS      Status;
+  HTTP_IO_HEADER  *Header;
+  CHAR8           *HostName;
+
+  ASSERT (MaxHeaderCount >= 3);
+
+  Header = HttpIoCreateHeader (MaxHeaderCount);
+  if (Header == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Add HTTP header field 1: Host
+  //
+  HostName = NULL;
+  Status   = HttpUrlGetHostName (
+               Private->BootFileUri,
+               Private->BootFileUriParser,
+               &HostName
+               );
+  if (EFI_ERROR (Status)) {
+    goto ON_ERROR;
+  }
+
+  Status = HttpIoSetHeader (
+             Header,
+             HTTP_HEADER_HOST,
+             HostName
+             );
+  FreePool (HostName);
+  if (EFI_ERROR (Status)) {
+    goto ON_ERROR;
+  }
+
+  //
+  // Add HTTP header field 2: Accept
+  //
+  Status = HttpIoSetHeader (
+             Header,
+             HTTP_HEADER_ACCEPT,
+             "*/*"
+             );
+  if (EFI_ERROR (Status)) {
+    goto ON_ERROR;
+  }
+
+  //
+  // Add HTTP header field 3: User-Agent
+  //
+  Status = HttpIoSetHeader (
+             Header,
+             HTTP_HEADER_USER_AGENT,
+             HTTP_USER_AGENT_EFI_HTTP_BOOT
+             );
+  if (EFI_ERROR (Status)) {
+    goto ON_ERROR;
+  }
+
+  *HttpIoHeader = Header;
+  return EFI_SUCCESS;
+
+ON_ERROR:
+  HttpIoFreeHeader (Header);
+  return Status;
+}
+
 /**
   Release all the resource of a cache item.
 
@@ -936,7 +1046,7 @@ HttpBootGetBootFile (
 {
   EFI_STATUS               Status;
   EFI_HTTP_STATUS_CODE     StatusCode;
-  CHAR8                    *HostName;
+  EFI_HTTP_HEADER          *HttpHeader;
   EFI_HTTP_REQUEST_DATA    *RequestData;
   HTTP_IO_RESPONSE_DATA    *ResponseData;
   HTTP_IO_RESPONSE_DATA    ResponseBody;
@@ -1010,57 +1120,9 @@ HttpBootGetBootFile (
   //       Accept
   //       User-Agent
   //
-  HttpIoHeader = HttpIoCreateHeader (3);
-  if (HttpIoHeader == NULL) {
-    Status = EFI_OUT_OF_RESOURCES;
-    goto ERROR_2;
-  }
-
-  //
-  // Add HTTP header field 1: Host
-  //
-  HostName = NULL;
-  Status   = HttpUrlGetHostName (
-               Private->BootFileUri,
-               Private->BootFileUriParser,
-               &HostName
-               );
-  if (EFI_ERROR (Status)) {
-    goto ERROR_3;
-  }
-
-  Status = HttpIoSetHeader (
-             HttpIoHeader,
-             HTTP_HEADER_HOST,
-             HostName
-             );
-  FreePool (HostName);
-  if (EFI_ERROR (Status)) {
-    goto ERROR_3;
-  }
-
-  //
-  // Add HTTP header field 2: Accept
-  //
-  Status = HttpIoSetHeader (
-             HttpIoHeader,
-             HTTP_HEADER_ACCEPT,
-             "*/*"
-             );
+  Status = HttpBootCreateRequestHeader (Private, 3, &HttpIoHeader);
   if (EFI_ERROR (Status)) {
-    goto ERROR_3;
-  }
-
-  //
-  // Add HTTP header field 3: User-Agent
-  //
-  Status = HttpIoSetHeader (
-             HttpIoHeader,
-             HTTP_HEADER_USER_AGENT,
-             HTTP_USER_AGENT_EFI_HTTP_BOOT
-             );
-  if (EFI_ERROR (Status)) {
-    goto ERROR_3;
+    goto ERROR_2;
   }
 
   //
@@ -1140,6 +1202,19 @@ HttpBootGetBootFile (
     goto ERROR_5;
   }
 
+  //
+  // Record whether the server accepts byte range requests for the file,
+  // so that it can then be downloaded over several connections.
+  //
+  if (HeaderOnly) {
+    HttpHeader = HttpFindHeader (
+                   ResponseData->HeaderCount,
+                   ResponseData->Headers,
+                   HTTP_HEADER_ACCEPT_RANGES
+                   );
+    Private->AcceptRanges = (BOOLEAN)((HttpHeader != NULL) && (AsciiStriCmp (HttpHeader->FieldValue, "bytes") == 0));
+  }
+
   //
   // 3.2 Cache the response header.
   //
@@ -1350,3 +1425,622 @@ ERROR_1:
 
   return Status;
 }
+
+/**
+  Parse the value of a Content-Range header of a partial response.
+
+  @param[in]    Value          The value of the Content-Range header.
+  @param[out]   First          The offset of the first byte in the response.
+  @param[out]   Last           The offset of the last byte in the response.
+
+  @retval EFI_SUCCESS          The value is parsed.
+  @retval EFI_PROTOCOL_ERROR   The value isn't a valid byte range.
+
+**/
+EFI_STATUS
+HttpBootParseContentRange (
+  IN     CHAR8  *Value,
+  OUT    UINTN  *First,
+  OUT    UINTN  *Last
+  )
+{
+  CHAR8  *End;
+
+  //
+  // Content-Range: bytes <first>-<last>/<length>
+  //
+  if (AsciiStrnCmp (Value, "bytes ", 6) != 0) {
+    return EFI_PROTOCOL_ERROR;
+  }
+
+  if (RETURN_ERROR (AsciiStrDecimalToUintnS (Value + 6, &End, First)) || (*End != '-')) {
+    return EFI_PROTOCOL_ERROR;
+  }
+
+  if (RETURN_ERROR (AsciiStrDecimalToUintnS (End + 1, &End, Last)) || (*End != '/') || (*Last < *First)) {
+    return EFI_PROTOCOL_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Find the next range of the boot file to request, the first one that is
+  neither received nor in flight.
+
+  @param[in]    Download       The parallel download.
+
+  @return The range to request, or NULL if there is none left.
+
+**/
+HTTP_BOOT_RANGE *
+HttpBootNextRange (
+  IN     HTTP_BOOT_RANGE_DOWNLOAD  *Download
+  )
+{
+  HTTP_BOOT_RANGE  *Range;
+  UINTN            Index;
+
+  for (Index = 0; Index < Download->RangeCount; Index++) {
+    Range = &Download->Ranges[Index];
+    if (!Range->InFlight && (Range->Received < Range->Length)) {
+      return Range;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Cancel the pending tokens of a connection and destroy its HttpIo.
+
+  @param[in, out]  Connection    The connection to destroy.
+
+**/
+VOID
+HttpBootDestroyConnection (
+  IN OUT HTTP_BOOT_CONNECTION  *Connection
+  )
+{
+  HTTP_IO  *HttpIo;
+
+  if (!Connection->Created) {
+    return;
+  }
+
+  HttpIo = &Connection->HttpIo;
+  gBS->SetTimer (HttpIo->TimeoutEvent, TimerCancel, 0);
+  HttpIo->Http->Cancel (HttpIo->Http, NULL);
+
+  //
+  // Run the DPCs queued by the cancelled tokens before their events are closed.
+  //
+  DispatchDpc ();
+
+  HttpIoDestroyIo (HttpIo);
+  Connection->Created = FALSE;
+  Connection->State   = HttpBootConnectionIdle;
+  Connection->Range   = NULL;
+}
+
+/**
+  Request the part of a range not received yet over a connection, and start
+  the timer of the request.
+
+  @param[in]       Download      The parallel download.
+  @param[in, out]  Connection    The connection to send the request over.
+  @param[in, out]  Range         The range to request.
+
+  @retval EFI_SUCCESS            The request is queued.
+  @retval Others                 Failed to queue the request.
+
+**/
+EFI_STATUS
+HttpBootSendRangeRequest (
+  IN     HTTP_BOOT_RANGE_DOWNLOAD  *Download,
+  IN OUT HTTP_BOOT_CONNECTION      *Connection,
+  IN OUT HTTP_BOOT_RANGE           *Range
+  )
+{
+  EFI_STATUS  Status;
+  HTTP_IO     *HttpIo;
+  CHAR8       Value[HTTP_BOOT_RANGE_VALUE_SIZE];
+
+  Range->InFlight   = TRUE;
+  Connection->Range = Range;
+  Connection->State = HttpBootConnectionRequest;
+
+  AsciiSPrint (
+    Value,
+    sizeof (Value),
+    "bytes=%Lu-%Lu",
+    (UINT64)(Range->Offset + Range->Received),
+    (UINT64)(Range->Offset + Range->Length - 1)
+    );
+  Status = HttpIoSetHeader (Connection->Header, HTTP_HEADER_RANGE, Value);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  HttpIo                                 = &Connection->HttpIo;
+  HttpIo->ReqToken.Status                = EFI_NOT_READY;
+  HttpIo->ReqToken.Message->Data.Request = &Download->RequestData;
+  HttpIo->ReqToken.Message->HeaderCount  = Connection->Header->HeaderCount;
+  HttpIo->ReqToken.Message->Headers      = Connection->Header->Headers;
+  HttpIo->ReqToken.Message->BodyLength   = 0;
+  HttpIo->ReqToken.Message->Body         = NULL;
+  HttpIo->IsTxDone                       = FALSE;
+
+  Status = gBS->SetTimer (HttpIo->TimeoutEvent, TimerRelative, HttpIo->Timeout * TICKS_PER_MS);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = HttpIo->Http->Request (HttpIo->Http, &HttpIo->ReqToken);
+  if (EFI_ERROR (Status)) {
+    gBS->SetTimer (HttpIo->TimeoutEvent, TimerCancel, 0);
+  }
+
+  return Status;
+}
+
+/**
+  Queue the response token of a connection, to receive the response header
+  or the next part of the range body, and start the response timer.
+
+  @param[in]       Download      The parallel download.
+  @param[in, out]  Connection    The connection to receive from.
+
+  @retval EFI_SUCCESS            The response token is queued.
+  @retval Others                 Failed to queue the response token.
+
+**/
+EFI_STATUS
+HttpBootRecvRange (
+  IN     HTTP_BOOT_RANGE_DOWNLOAD  *Download,
+  IN OUT HTTP_BOOT_CONNECTION      *Connection
+  )
+{
+  EFI_STATUS        Status;
+  HTTP_IO           *HttpIo;
+  HTTP_BOOT_RANGE   *Range;
+  EFI_HTTP_MESSAGE  *Message;
+
+  HttpIo  = &Connection->HttpIo;
+  Range   = Connection->Range;
+  Message = HttpIo->RspToken.Message;
+
+  HttpIo->RspToken.Status = EFI_NOT_READY;
+  Message->HeaderCount    = 0;
+  Message->Headers        = NULL;
+  if (Connection->State == HttpBootConnectionHeader) {
+    Message->Data.Response = &Connection->Response;
+    Message->BodyLength    = 0;
+    Message->Body          = NULL;
+  } else {
+    Message->Data.Response = NULL;
+    Message->BodyLength    = Range->Length - Range->Received;
+    Message->Body          = Download->Buffer + Range->Offset + Range->Received;
+  }
+
+  HttpIo->IsRxDone = FALSE;
+
+  Status = gBS->SetTimer (HttpIo->TimeoutEvent, TimerRelative, HttpIo->Timeout * TICKS_PER_MS);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = HttpIo->Http->Response (HttpIo->Http, &HttpIo->RspToken);
+  if (EFI_ERROR (Status)) {
+    gBS->SetTimer (HttpIo->TimeoutEvent, TimerCancel, 0);
+  }
+
+  return Status;
+}
+
+/**
+  Poll a connection, and move its range on once the pending token is done.
+
+  A response to a range must be "206 Partial Content" for exactly the bytes
+  requested. A "200 OK" before any "206 Partial Content" means that the server
+  ignores ranges, and stops the parallel download with EFI_UNSUPPORTED in
+  Download->Status, so that the caller falls back to a single stream. Neither
+  the request nor any body byte has been passed to the HTTP boot callback at
+  that point, so the callback sees them once. The request of the file is
+  reported with the first "206 Partial Content". After that, a "200 OK" only
+  fails the range. An error returned by the HTTP boot callback stops the
+  parallel download with that error.
+
+  @param[in, out]  Download      The parallel download.
+  @param[in, out]  Connection    The connection to poll.
+
+  @retval EFI_SUCCESS            The connection is waiting or made progress.
+  @retval Others                 The range failed over this connection.
+
+**/
+EFI_STATUS
+HttpBootPollConnection (
+  IN OUT HTTP_BOOT_RANGE_DOWNLOAD  *Download,
+  IN OUT HTTP_BOOT_CONNECTION      *Connection
+  )
+{
+  EFI_STATUS                       Status;
+  HTTP_IO                          *HttpIo;
+  HTTP_BOOT_RANGE                  *Range;
+  EFI_HTTP_MESSAGE                 *Message;
+  EFI_HTTP_MESSAGE                 RequestMessage;
+  EFI_HTTP_HEADER                  *Header;
+  EFI_HTTP_BOOT_CALLBACK_PROTOCOL  *HttpBootCallback;
+  UINTN                            First;
+  UINTN                            Last;
+
+  HttpIo = &Connection->HttpIo;
+  Range  = Connection->Range;
+
+  HttpIo->Http->Poll (HttpIo->Http);
+
+  if (Connection->State == HttpBootConnectionRequest) {
+    if (!HttpIo->IsTxDone) {
+      if (!EFI_ERROR (gBS->CheckEvent (HttpIo->TimeoutEvent))) {
+        return EFI_TIMEOUT;
+      }
+
+      return EFI_SUCCESS;
+    }
+
+    gBS->SetTimer (HttpIo->TimeoutEvent, TimerCancel, 0);
+    if (EFI_ERROR (HttpIo->ReqToken.Status)) {
+      return HttpIo->ReqToken.Status;
+    }
+
+    Connection->State = HttpBootConnectionHeader;
+    return HttpBootRecvRange (Download, Connection);
+  }
+
+  if (!HttpIo->IsRxDone) {
+    if (!EFI_ERROR (gBS->CheckEvent (HttpIo->TimeoutEvent))) {
+      return EFI_TIMEOUT;
+    }
+
+    return EFI_SUCCESS;
+  }
+
+  gBS->SetTimer (HttpIo->TimeoutEvent, TimerCancel, 0);
+  Message = HttpIo->RspToken.Message;
+  Status  = HttpIo->RspToken.Status;
+
+  if (Connection->State == HttpBootConnectionHeader) {
+    if (!EFI_ERROR (Status)) {
+      if (Connection->Response.StatusCode == HTTP_STATUS_200_OK) {
+        if (Download->RangesAccepted) {
+          Status = EFI_HTTP_ERROR;
+        } else {
+          Download->Status = EFI_UNSUPPORTED;
+        }
+      } else if (Connection->Response.StatusCode != HTTP_STATUS_206_PARTIAL_CONTENT) {
+        Status = EFI_HTTP_ERROR;
+      } else {
+        Header = HttpFindHeader (Message->HeaderCount, Message->Headers, HTTP_HEADER_CONTENT_RANGE);
+        if ((Header == NULL) ||
+            EFI_ERROR (HttpBootParseContentRange (Header->FieldValue, &First, &Last)) ||
+            (First != Range->Offset + Range->Received) ||
+            (Last != Range->Offset + Range->Length - 1))
+        {
+          Status = EFI_PROTOCOL_ERROR;
+        } else if (!Download->RangesAccepted) {
+          //
+          // The server serves ranges, the download can't fall back any more.
+          // Report the request of the file once, rather than the request of
+          // each range.
+          //
+          Download->RangesAccepted = TRUE;
+
+          ZeroMem (&RequestMessage, sizeof (EFI_HTTP_MESSAGE));
+          RequestMessage.Data.Request = &Download->RequestData;
+          RequestMessage.HeaderCount  = Connection->Header->HeaderCount;
+          RequestMessage.Headers      = Connection->Header->Headers;
+          Download->Status            = HttpBootHttpIoCallback (HttpIoRequest, &RequestMessage, Download->Private);
+        }
+      }
+    }
+
+    if (Message->Headers != NULL) {
+      HttpFreeHeaderFields (Message->Headers, Message->HeaderCount);
+      Message->Headers = NULL;
+    }
+
+    if (EFI_ERROR (Status) || EFI_ERROR (Download->Status)) {
+      return Status;
+    }
+
+    Connection->State = HttpBootConnectionBody;
+    return HttpBootRecvRange (Download, Connection);
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // The body is received in place, report it to the callback.
+  //
+  HttpBootCallback = Download->Private->HttpBootCallback;
+  if ((HttpBootCallback != NULL) && (Message->BodyLength != 0)) {
+    Status = HttpBootCallback->Callback (
+                                 HttpBootCallback,
+                                 HttpBootHttpEntityBody,
+                                 TRUE,
+                                 (UINT32)Message->BodyLength,
+                                 Message->Body
+                                 );
+    if (EFI_ERROR (Status)) {
+      Download->Status = Status;
+      return EFI_SUCCESS;
+    }
+  }
+
+  Range->Received += Message->BodyLength;
+  if (Range->Received < Range->Length) {
+    return HttpBootRecvRange (Download, Connection);
+  }
+
+  //
+  // The range is complete, the connection is free for the next one.
+  //
+  Range->InFlight   = FALSE;
+  Connection->Range = NULL;
+  Connection->State = HttpBootConnectionIdle;
+  Download->RangesDone++;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Put back the range of a failed connection to be requested again from
+  where it stopped, and replace the connection with a new one.
+
+  @param[in, out]  Download      The parallel download.
+  @param[in, out]  Connection    The failed connection.
+  @param[in]       Status        The error of the connection.
+
+  @retval EFI_SUCCESS            The range will be requested again.
+  @retval Others                 The range failed too many times.
+
+**/
+EFI_STATUS
+HttpBootFailRange (
+  IN OUT HTTP_BOOT_RANGE_DOWNLOAD  *Download,
+  IN OUT HTTP_BOOT_CONNECTION      *Connection,
+  IN     EFI_STATUS                Status
+  )
+{
+  HTTP_BOOT_RANGE  *Range;
+
+  Range = Connection->Range;
+  ASSERT (Range != NULL);
+
+  DEBUG (
+    (DEBUG_WARN,
+     "HttpBootFailRange: Range at %Lu failed after %Lu bytes, %r.\n",
+     (UINT64)Range->Offset,
+     (UINT64)Range->Received,
+     Status)
+    );
+
+  Range->InFlight = FALSE;
+  Range->Retries++;
+  Download->Retries++;
+
+  HttpBootDestroyConnection (Connection);
+  if (!EFI_ERROR (HttpBootInitHttpIo (Download->Private, &Connection->HttpIo))) {
+    Connection->Created = TRUE;
+  }
+
+  if (Range->Retries > HTTP_BOOT_RANGE_RETRY_MAX) {
+    return Status;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  This function downloads the boot file into Buffer with several byte range
+  requests in parallel, each over its own HTTP connection. Every range is
+  received in place in Buffer, and a range whose connection fails is
+  requested again, over a new connection, from where it stopped.
+
+  It is only used if the server advertised "Accept-Ranges: bytes" in the
+  response to the HEAD request that gave the size of the file, and
+  PcdHttpBootDownloadConnections allows more than one connection. Small
+  files are downloaded over a single connection as before.
+
+  @param[in]       Private         The pointer to the driver's private data.
+  @param[in, out]  BufferSize      On input the size of Buffer in bytes. On output with a return
+                                   code of EFI_SUCCESS, the amount of data transferred to
+                                   Buffer. On output with a return code of EFI_BUFFER_TOO_SMALL,
+                                   the size of Buffer required to retrieve the requested file.
+  @param[out]      Buffer          The memory buffer to transfer the file to.
+  @param[out]      ImageType       The image type of the downloaded file.
+
+  @retval EFI_SUCCESS              The file was loaded.
+  @retval EFI_UNSUPPORTED          The file can't be downloaded in parallel, the caller
+                                   should download it with HttpBootGetBootFile().
+  @retval EFI_BUFFER_TOO_SMALL     The BufferSize is too small to hold the file.
+                                   BufferSize has been updated with the size needed.
+  @retval EFI_OUT_OF_RESOURCES     Could not allocate needed resources.
+  @retval Others                   A range failed too many times, or the download was
+                                   cancelled by the HTTP boot callback.
+
+**/
+EFI_STATUS
+HttpBootGetBootFileParallel (
+  IN     HTTP_BOOT_PRIVATE_DATA  *Private,
+  IN OUT UINTN                   *BufferSize,
+  OUT UINT8                      *Buffer,
+  OUT HTTP_BOOT_IMAGE_TYPE       *ImageType
+  )
+{
+  EFI_STATUS                Status;
+  HTTP_BOOT_RANGE_DOWNLOAD  Download;
+  HTTP_BOOT_CONNECTION      *Connection;
+  HTTP_BOOT_RANGE           *Range;
+  UINTN                     FileSize;
+  UINTN                     RangeSize;
+  UINTN                     UrlSize;
+  UINTN                     Active;
+  UINTN                     Index;
+
+  ASSERT (Private != NULL);
+  ASSERT ((BufferSize != NULL) && (ImageType != NULL));
+
+  FileSize = Private->BootFileSize;
+  if (!Private->AcceptRanges ||
+      (PcdGet8 (PcdHttpBootDownloadConnections) < 2) ||
+      (FileSize < 2 * HTTP_BOOT_RANGE_SIZE_MIN))
+  {
+    return EFI_UNSUPPORTED;
+  }
+
+  if ((*BufferSize < FileSize) || (Buffer == NULL)) {
+    *BufferSize = FileSize;
+    *ImageType  = Private->ImageType;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  ZeroMem (&Download, sizeof (HTTP_BOOT_RANGE_DOWNLOAD));
+  Download.Private = Private;
+  Download.Buffer  = Buffer;
+
+  //
+  // Split the file in a few ranges for each connection, so that the faster
+  // connections take over the ranges left by the slower ones.
+  //
+  Download.ConnectionCount = PcdGet8 (PcdHttpBootDownloadConnections);
+  RangeSize                = FileSize / (Download.ConnectionCount * HTTP_BOOT_RANGES_PER_CONNECTION);
+  RangeSize                = MAX (ALIGN_VALUE (RangeSize, SIZE_64KB), HTTP_BOOT_RANGE_SIZE_MIN);
+  Download.RangeCount      = (FileSize + RangeSize - 1) / RangeSize;
+  Download.ConnectionCount = MIN (Download.ConnectionCount, Download.RangeCount);
+
+  Download.Ranges      = AllocateZeroPool (Download.RangeCount * sizeof (HTTP_BOOT_RANGE));
+  Download.Connections = AllocateZeroPool (Download.ConnectionCount * sizeof (HTTP_BOOT_CONNECTION));
+  UrlSize              = AsciiStrSize (Private->BootFileUri);
+  Download.RequestData.Url = AllocatePool (UrlSize * sizeof (CHAR16));
+  if ((Download.Ranges == NULL) || (Download.Connections == NULL) || (Download.RequestData.Url == NULL)) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto ON_EXIT;
+  }
+
+  AsciiStrToUnicodeStrS (Private->BootFileUri, Download.RequestData.Url, UrlSize);
+  Download.RequestData.Method = HttpMethodGet;
+
+  for (Index = 0; Index < Download.RangeCount; Index++) {
+    Range         = &Download.Ranges[Index];
+    Range->Offset = Index * RangeSize;
+    Range->Length = MIN (RangeSize, FileSize - Range->Offset);
+  }
+
+  //
+  // Open the connections, 4 headers are needed for each request:
+  //   Host
+  //   Accept
+  //   User-Agent
+  //   Range
+  // The file is downloaded over a single connection if they can't be opened.
+  //
+  for (Index = 0; Index < Download.ConnectionCount; Index++) {
+    Connection = &Download.Connections[Index];
+    Status     = HttpBootCreateRequestHeader (Private, 4, &Connection->Header);
+    if (EFI_ERROR (Status)) {
+      goto ON_EXIT;
+    }
+
+    Status = HttpBootInitHttpIo (Private, &Connection->HttpIo);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "HttpBootGetBootFileParallel: Failed to create connection %d, %r.\n", (UINT32)Index, Status));
+      Status = EFI_UNSUPPORTED;
+      goto ON_EXIT;
+    }
+
+    Connection->Created = TRUE;
+  }
+
+  //
+  // Give each idle connection the next range, and poll the busy ones, until
+  // all the ranges are received.
+  //
+  while ((Download.RangesDone < Download.RangeCount) && !EFI_ERROR (Download.Status)) {
+    Active = 0;
+    for (Index = 0; (Index < Download.ConnectionCount) && !EFI_ERROR (Download.Status); Index++) {
+      Connection = &Download.Connections[Index];
+      if (!Connection->Created) {
+        continue;
+      }
+
+      Active++;
+      if (Connection->State == HttpBootConnectionIdle) {
+        Range = HttpBootNextRange (&Download);
+        if (Range == NULL) {
+          continue;
+        }
+
+        Status = HttpBootSendRangeRequest (&Download, Connection, Range);
+      } else {
+        Status = HttpBootPollConnection (&Download, Connection);
+      }
+
+      if (EFI_ERROR (Status) && !EFI_ERROR (Download.Status)) {
+        Download.Status = HttpBootFailRange (&Download, Connection, Status);
+      }
+    }
+
+    if ((Active == 0) && !EFI_ERROR (Download.Status)) {
+      Download.Status = EFI_DEVICE_ERROR;
+    }
+  }
+
+  Status = Download.Status;
+  if (!EFI_ERROR (Status)) {
+    *BufferSize = FileSize;
+    *ImageType  = Private->ImageType;
+  } else if ((Status == EFI_UNSUPPORTED) && Download.RangesAccepted) {
+    //
+    // Only a "200 OK" to the first range asks the caller to fall back to a
+    // single stream. The HTTP boot callback has seen the request and some of
+    // the body by now, an EFI_UNSUPPORTED from it aborts the download.
+    //
+    Status = EFI_ABORTED;
+  }
+
+  DEBUG (
+    (DEBUG_INFO,
+     "HttpBootGetBootFileParallel: %Lu bytes in %d ranges over %d connections, %d retries, %r.\n",
+     (UINT64)FileSize,
+     (UINT32)Download.RangeCount,
+     (UINT32)Download.ConnectionCount,
+     (UINT32)Download.Retries,
+     Status)
+    );
+
+ON_EXIT:
+  if (Download.Connections != NULL) {
+    for (Index = 0; Index < Download.ConnectionCount; Index++) {
+      Connection = &Download.Connections[Index];
+      HttpBootDestroyConnection (Connection);
+      if (Connection->Header != NULL) {
+        HttpIoFreeHeader (Connection->Header);
+      }
+    }
+
+    FreePool (Download.Connections);
+  }
+
+  if (Download.Ranges != NULL) {
+    FreePool (Download.Ranges);
+  }
+
+  if (Download.RequestData.Url != NULL) {
+    FreePool (Download.RequestData.Url);
+  }
+
+  return Status;
+}
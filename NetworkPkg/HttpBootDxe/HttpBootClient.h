@@ -13,6 +13,20 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #define HTTP_BOOT_BLOCK_SIZE           1500
 #define HTTP_USER_AGENT_EFI_HTTP_BOOT  "UefiHttpBoot/1.0"
 
+#define HTTP_HEADER_RANGE          "Range"
+#define HTTP_HEADER_CONTENT_RANGE  "Content-Range"
+
+//
+// The parallel download splits the boot file in about
+// HTTP_BOOT_RANGES_PER_CONNECTION ranges per connection, of at least
+// HTTP_BOOT_RANGE_SIZE_MIN bytes. A failed range is requested again
+// up to HTTP_BOOT_RANGE_RETRY_MAX times.
+//
+#define HTTP_BOOT_RANGES_PER_CONNECTION  4
+#define HTTP_BOOT_RANGE_SIZE_MIN         SIZE_1MB
+#define HTTP_BOOT_RANGE_RETRY_MAX        3
+#define HTTP_BOOT_RANGE_VALUE_SIZE       sizeof ("bytes=18446744073709551615-18446744073709551615")
+
 //
 // Record the data length and start address of a data block.
 //
@@ -57,6 +71,64 @@ typedef struct {
   HTTP_BOOT_PRIVATE_DATA     *Private;
 } HTTP_BOOT_CALLBACK_DATA;
 
+//
+// A byte range of the boot file in the parallel download.
+//
+typedef struct {
+  UINTN      Offset;
+  UINTN      Length;
+  UINTN      Received;                    // Bytes received in place in the buffer
+  UINTN      Retries;
+  BOOLEAN    InFlight;                    // Requested over a connection
+} HTTP_BOOT_RANGE;
+
+typedef enum {
+  HttpBootConnectionIdle,
+  HttpBootConnectionRequest,              // Waiting for the request to be sent
+  HttpBootConnectionHeader,               // Waiting for the response header
+  HttpBootConnectionBody                  // Waiting for the range body
+} HTTP_BOOT_CONNECTION_STATE;
+
+//
+// A connection of the parallel download, requesting one range at a time.
+//
+typedef struct {
+  HTTP_IO                       HttpIo;
+  BOOLEAN                       Created;
+  HTTP_BOOT_CONNECTION_STATE    State;
+  HTTP_BOOT_RANGE               *Range;
+  HTTP_IO_HEADER                *Header;
+  EFI_HTTP_RESPONSE_DATA        Response;
+} HTTP_BOOT_CONNECTION;
+
+//
+// State of the parallel download.
+//
+typedef struct {
+  HTTP_BOOT_PRIVATE_DATA    *Private;
+  UINT8                     *Buffer;
+  EFI_HTTP_REQUEST_DATA     RequestData;
+
+  HTTP_BOOT_RANGE           *Ranges;
+  UINTN                     RangeCount;
+  UINTN                     RangesDone;
+  UINTN                     Retries;
+
+  HTTP_BOOT_CONNECTION      *Connections;
+  UINTN                     ConnectionCount;
+
+  //
+  // Set by the first "206 Partial Content" response. Only then are body bytes
+  // received, so the download can no longer fall back to a single stream.
+  //
+  BOOLEAN                   RangesAccepted;
+
+  //
+  // Set to stop the whole download.
+  //
+  EFI_STATUS                Status;
+} HTTP_BOOT_RANGE_DOWNLOAD;
+
 /**
   Discover all the boot information for boot file.
 
@@ -118,6 +190,54 @@ HttpBootGetBootFile (
   OUT HTTP_BOOT_IMAGE_TYPE       *ImageType
   );
 
+/**
+  This function downloads the boot file into Buffer with several byte range
+  requests in parallel, each over its own HTTP connection.
+
+  @param[in]       Private         The pointer to the driver's private data.
+  @param[in, out]  BufferSize      On input the size of Buffer in bytes. On output with a return
+                                   code of EFI_SUCCESS, the amount of data transferred to
+                                   Buffer. On output with a return code of EFI_BUFFER_TOO_SMALL,
+                                   the size of Buffer required to retrieve the requested file.
+  @param[out]      Buffer          The memory buffer to transfer the file to.
+  @param[out]      ImageType       The image type of the downloaded file.
+
+  @retval EFI_SUCCESS              The file was loaded.
+  @retval EFI_UNSUPPORTED          The file can't be downloaded in parallel, the caller
+                                   should download it with HttpBootGetBootFile().
+  @retval EFI_BUFFER_TOO_SMALL     The BufferSize is too small to hold the file.
+                                   BufferSize has been updated with the size needed.
+  @retval EFI_OUT_OF_RESOURCES     Could not allocate needed resources.
+  @retval Others                   A range failed too many times, or the download was
+                                   cancelled by the HTTP boot callback.
+
+**/
+EFI_STATUS
+HttpBootGetBootFileParallel (
+  IN     HTTP_BOOT_PRIVATE_DATA  *Private,
+  IN OUT UINTN                   *BufferSize,
+  OUT UINT8                      *Buffer,
+  OUT HTTP_BOOT_IMAGE_TYPE       *ImageType
+  );
+
+/**
+  Parse the value of a Content-Range header of a partial response.
+
+  @param[in]    Value          The value of the Content-Range header.
+  @param[out]   First          The offset of the first byte in the response.
+  @param[out]   Last           The offset of the last byte in the response.
+
+  @retval EFI_SUCCESS          The value is parsed.
+  @retval EFI_PROTOCOL_ERROR   The value isn't a valid byte range.
+
+**/
+EFI_STATUS
+HttpBootParseContentRange (
+  IN     CHAR8  *Value,
+  OUT    UINTN  *First,
+  OUT    UINTN  *Last
+  );
+
 /**
   Clean up all cached data.
 
@@ -363,9 +363,11 @@ HttpBootLoadFile (
     if (EFI_ERROR (Status) && (Status != EFI_BUFFER_TOO_SMALL)) {
       //
       // Failed to get file size by HEAD method, may be trunked encoding, try HTTP GET method.
+      // The file is cached by this GET, it is not downloaded again in ranges.
       //
       ASSERT (Private->BootFileSize == 0);
-      Status = HttpBootGetBootFile (
+      Private->AcceptRanges = FALSE;
+      Status                = HttpBootGetBootFile (
                  Private,
                  FALSE,
                  &Private->BootFileSize,
@@ -387,15 +389,24 @@ HttpBootLoadFile (
   }
 
   //
-  // Load the boot file into Buffer
+  // Load the boot file into Buffer, over several connections if the server
+  // accepts range requests.
   //
-  Status = HttpBootGetBootFile (
+  Status = HttpBootGetBootFileParallel (
              Private,
-             FALSE,
              BufferSize,
              Buffer,
              ImageType
              );
+  if (Status == EFI_UNSUPPORTED) {
+    Status = HttpBootGetBootFile (
+               Private,
+               FALSE,
+               BufferSize,
+               Buffer,
+               ImageType
+               );
+  }
 
 ON_EXIT:
   HttpBootUninstallCallback (Private);
@@ -460,6 +471,7 @@ HttpBootStop (
   Private->BootFileUri       = NULL;
   Private->BootFileUriParser = NULL;
   Private->BootFileSize      = 0;
+  Private->AcceptRanges      = FALSE;
   Private->SelectIndex       = 0;
   Private->SelectProxyType   = HttpOfferTypeMax;
 
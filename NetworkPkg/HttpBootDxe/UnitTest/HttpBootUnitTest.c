@@ -0,0 +1,1182 @@
+/** @file
+  Host-based unit tests for the parallel range download of the HTTP boot
+  driver, with the ranges served by a fake HTTP protocol.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../HttpBootDxe.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "HTTP Boot Range Download Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_BOOT_FILE_URI  "http://boot.example.com/boot.efi"
+
+//
+// 20 MB split in 4 ranges per connection, aligned to 64 KB, is 16 ranges of
+// 1344 KB, the last one partial.
+//
+#define TEST_FILE_SIZE    (20 * SIZE_1MB + 12345)
+#define TEST_RANGE_SIZE   (1344 * SIZE_1KB)
+#define TEST_RANGE_COUNT  16
+
+//
+// The fake server returns at most TEST_CHUNK_SIZE bytes of body per response
+// token, and a timer expires after TEST_TIMEOUT_POLLS polls of its connection.
+//
+#define TEST_CHUNK_SIZE     SIZE_256KB
+#define TEST_TIMEOUT_POLLS  8
+
+#define TEST_MAX_REQUESTS  128
+
+//
+// What the fake server does with a range request.
+//
+typedef enum {
+  TestServe,          ///< Serve the range.
+  TestReset,          ///< Reset the connection after the first chunk of the body.
+  TestHang,           ///< Never answer.
+  TestBadRange,       ///< Answer with a Content-Range other than the one requested.
+  TestOk              ///< Ignore the range, answer "200 OK".
+} TEST_FAULT;
+
+typedef struct {
+  UINTN    First;
+  UINTN    Last;
+} TEST_REQUEST;
+
+//
+// A fake HTTP connection. Its timeout event is the connection itself.
+//
+typedef struct {
+  EFI_HTTP_PROTOCOL    Http;
+  HTTP_IO              *HttpIo;
+  BOOLEAN              RequestQueued;
+  EFI_HTTP_TOKEN       *ResponseToken;
+  TEST_FAULT           Fault;
+  UINTN                Position;
+  UINTN                End;
+  UINTN                Chunks;
+  BOOLEAN              TimerArmed;
+  UINTN                TimerPolls;
+} TEST_CONNECTION;
+
+#define TEST_CONNECTION_FROM_HTTP(a)  BASE_CR (a, TEST_CONNECTION, Http)
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+EFI_BOOT_SERVICES         *gBS = &mBootServices;
+
+STATIC HTTP_BOOT_PRIVATE_DATA           mPrivate;
+STATIC HTTP_BOOT_VIRTUAL_NIC            mNic;
+STATIC EFI_HTTP_BOOT_CALLBACK_PROTOCOL  mCallback;
+
+STATIC UINT8  *mFile;
+STATIC UINT8  *mBuffer;
+STATIC UINTN  mBufferSize;
+STATIC UINTN  mFileSize;
+
+//
+// The fault of each request, and the ranges requested.
+//
+STATIC TEST_FAULT    mFaults[TEST_MAX_REQUESTS];
+STATIC TEST_REQUEST  mRequests[TEST_MAX_REQUESTS];
+STATIC UINTN         mRequestCount;
+
+STATIC UINTN  mConnectionsCreated;
+STATIC UINTN  mConnectionsLive;
+
+//
+// What the HTTP boot callback was told.
+//
+STATIC UINTN       mCallbackRequests;
+STATIC UINTN       mCallbackBodyBytes;
+STATIC BOOLEAN     mCallbackBodyMismatch;
+STATIC UINTN       mCallbackFailAfter;
+STATIC EFI_STATUS  mCallbackFailStatus;
+
+/**
+  There is no DPC queued by the fake HTTP protocol.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+EFI_STATUS
+EFIAPI
+DispatchDpc (
+  VOID
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Arm or cancel the timeout of a fake connection.
+
+  @param[in]  Event        The fake connection.
+  @param[in]  Type         The type of timer.
+  @param[in]  TriggerTime  Unused, the timer expires after TEST_TIMEOUT_POLLS polls.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  TEST_CONNECTION  *Connection;
+
+  Connection             = (TEST_CONNECTION *)Event;
+  Connection->TimerArmed = (BOOLEAN)(Type != TimerCancel);
+  Connection->TimerPolls = 0;
+  return EFI_SUCCESS;
+}
+
+/**
+  Check whether the timeout of a fake connection expired.
+
+  @param[in]  Event  The fake connection.
+
+  @retval EFI_SUCCESS    The timer expired.
+  @retval EFI_NOT_READY  It did not.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  TEST_CONNECTION  *Connection;
+
+  Connection = (TEST_CONNECTION *)Event;
+  if (Connection->TimerArmed && (Connection->TimerPolls >= TEST_TIMEOUT_POLLS)) {
+    return EFI_SUCCESS;
+  }
+
+  return EFI_NOT_READY;
+}
+
+/**
+  Log a range request and pick its fault.
+
+  @param[in]  This   The fake HTTP protocol.
+  @param[in]  Token  The request token.
+
+  @retval EFI_SUCCESS            The request is queued.
+  @retval EFI_INVALID_PARAMETER  The request is not a GET with a valid Range header.
+  @retval EFI_OUT_OF_RESOURCES   Too many requests.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestHttpRequest (
+  IN EFI_HTTP_PROTOCOL  *This,
+  IN EFI_HTTP_TOKEN     *Token
+  )
+{
+  TEST_CONNECTION  *Connection;
+  EFI_HTTP_HEADER  *Header;
+  CHAR8            *End;
+  UINTN            First;
+  UINTN            Last;
+
+  Connection = TEST_CONNECTION_FROM_HTTP (This);
+  if (mRequestCount == TEST_MAX_REQUESTS) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Range: bytes=<first>-<last>
+  //
+  Header = HttpFindHeader (Token->Message->HeaderCount, Token->Message->Headers, HTTP_HEADER_RANGE);
+  if ((Token->Message->Data.Request->Method != HttpMethodGet) ||
+      (Header == NULL) ||
+      (AsciiStrnCmp (Header->FieldValue, "bytes=", 6) != 0) ||
+      RETURN_ERROR (AsciiStrDecimalToUintnS (Header->FieldValue + 6, &End, &First)) ||
+      (*End != '-') ||
+      RETURN_ERROR (AsciiStrDecimalToUintnS (End + 1, &End, &Last)) ||
+      (Last < First) || (Last >= mFileSize))
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  mRequests[mRequestCount].First = First;
+  mRequests[mRequestCount].Last  = Last;
+
+  Connection->Fault         = mFaults[mRequestCount];
+  Connection->Position      = First;
+  Connection->End           = Last + 1;
+  Connection->Chunks        = 0;
+  Connection->RequestQueued = TRUE;
+  Token->Status             = EFI_SUCCESS;
+  mRequestCount++;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Queue a response token.
+
+  @param[in]  This   The fake HTTP protocol.
+  @param[in]  Token  The response token.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestHttpResponse (
+  IN EFI_HTTP_PROTOCOL  *This,
+  IN EFI_HTTP_TOKEN     *Token
+  )
+{
+  TEST_CONNECTION_FROM_HTTP (This)->ResponseToken = Token;
+  return EFI_SUCCESS;
+}
+
+/**
+  Drop the pending tokens.
+
+  @param[in]  This   The fake HTTP protocol.
+  @param[in]  Token  Unused, all the tokens are dropped.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestHttpCancel (
+  IN EFI_HTTP_PROTOCOL  *This,
+  IN EFI_HTTP_TOKEN     *Token
+  )
+{
+  TEST_CONNECTION  *Connection;
+
+  Connection                = TEST_CONNECTION_FROM_HTTP (This);
+  Connection->RequestQueued = FALSE;
+  Connection->ResponseToken = NULL;
+  return EFI_SUCCESS;
+}
+
+/**
+  Add a header to a response.
+
+  @param[in, out]  Message  The response.
+  @param[in]       Name     The name of the header.
+  @param[in]       Value    The value of the header.
+
+**/
+STATIC
+VOID
+TestAddHeader (
+  IN OUT EFI_HTTP_MESSAGE  *Message,
+  IN     CHAR8             *Name,
+  IN     CHAR8             *Value
+  )
+{
+  EFI_HTTP_HEADER  *Header;
+
+  Header             = &Message->Headers[Message->HeaderCount++];
+  Header->FieldName  = AllocateCopyPool (AsciiStrSize (Name), Name);
+  Header->FieldValue = AllocateCopyPool (AsciiStrSize (Value), Value);
+}
+
+/**
+  Complete the pending token of a fake connection, if its fault allows it.
+
+  @param[in]  This  The fake HTTP protocol.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestHttpPoll (
+  IN EFI_HTTP_PROTOCOL  *This
+  )
+{
+  TEST_CONNECTION   *Connection;
+  EFI_HTTP_TOKEN    *Token;
+  EFI_HTTP_MESSAGE  *Message;
+  CHAR8             Value[HTTP_BOOT_RANGE_VALUE_SIZE];
+  UINTN             Length;
+  UINTN             Shift;
+
+  Connection = TEST_CONNECTION_FROM_HTTP (This);
+  if (Connection->TimerArmed) {
+    Connection->TimerPolls++;
+  }
+
+  if (Connection->RequestQueued) {
+    Connection->RequestQueued    = FALSE;
+    Connection->HttpIo->IsTxDone = TRUE;
+    return EFI_SUCCESS;
+  }
+
+  Token = Connection->ResponseToken;
+  if ((Token == NULL) || (Connection->Fault == TestHang)) {
+    return EFI_SUCCESS;
+  }
+
+  Connection->ResponseToken = NULL;
+  Message                   = Token->Message;
+  Token->Status             = EFI_SUCCESS;
+
+  if (Message->Data.Response != NULL) {
+    Message->HeaderCount = 0;
+    Message->Headers     = AllocateZeroPool (2 * sizeof (EFI_HTTP_HEADER));
+    if (Connection->Fault == TestOk) {
+      Message->Data.Response->StatusCode = HTTP_STATUS_200_OK;
+      AsciiSPrint (Value, sizeof (Value), "%Lu", (UINT64)mFileSize);
+      TestAddHeader (Message, HTTP_HEADER_CONTENT_LENGTH, Value);
+    } else {
+      Shift                              = (Connection->Fault == TestBadRange) ? 1 : 0;
+      Message->Data.Response->StatusCode = HTTP_STATUS_206_PARTIAL_CONTENT;
+      AsciiSPrint (Value, sizeof (Value), "%Lu", (UINT64)(Connection->End - Connection->Position));
+      TestAddHeader (Message, HTTP_HEADER_CONTENT_LENGTH, Value);
+      AsciiSPrint (
+        Value,
+        sizeof (Value),
+        "bytes %Lu-%Lu/%Lu",
+        (UINT64)(Connection->Position + Shift),
+        (UINT64)(Connection->End - 1),
+        (UINT64)mFileSize
+        );
+      TestAddHeader (Message, HTTP_HEADER_CONTENT_RANGE, Value);
+    }
+  } else if ((Connection->Fault == TestReset) && (Connection->Chunks > 0)) {
+    Message->BodyLength = 0;
+    Token->Status       = EFI_CONNECTION_RESET;
+  } else {
+    Length = MIN (Message->BodyLength, TEST_CHUNK_SIZE);
+    Length = MIN (Length, Connection->End - Connection->Position);
+    CopyMem (Message->Body, mFile + Connection->Position, Length);
+    Message->BodyLength   = Length;
+    Connection->Position += Length;
+    Connection->Chunks++;
+  }
+
+  Connection->HttpIo->IsRxDone = TRUE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Create a fake connection.
+
+  @param[in]   Image       Unused.
+  @param[in]   Controller  Unused.
+  @param[in]   IpVersion   Unused.
+  @param[in]   ConfigData  Unused.
+  @param[in]   Callback    The callback of the HttpIo.
+  @param[in]   Context     The context of the callback.
+  @param[out]  HttpIo      The HttpIo of the connection.
+
+  @retval EFI_SUCCESS           The connection is created.
+  @retval EFI_OUT_OF_RESOURCES  Out of memory.
+
+**/
+EFI_STATUS
+HttpIoCreateIo (
+  IN EFI_HANDLE           Image,
+  IN EFI_HANDLE           Controller,
+  IN UINT8                IpVersion,
+  IN HTTP_IO_CONFIG_DATA  *ConfigData,
+  IN HTTP_IO_CALLBACK     Callback,
+  IN VOID                 *Context,
+  OUT HTTP_IO             *HttpIo
+  )
+{
+  TEST_CONNECTION  *Connection;
+
+  Connection = AllocateZeroPool (sizeof (TEST_CONNECTION));
+  if (Connection == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Connection->Http.Request  = TestHttpRequest;
+  Connection->Http.Response = TestHttpResponse;
+  Connection->Http.Cancel   = TestHttpCancel;
+  Connection->Http.Poll     = TestHttpPoll;
+  Connection->HttpIo        = HttpIo;
+
+  ZeroMem (HttpIo, sizeof (HTTP_IO));
+  HttpIo->Http             = &Connection->Http;
+  HttpIo->Callback         = Callback;
+  HttpIo->Context          = Context;
+  HttpIo->ReqToken.Message = &HttpIo->ReqMessage;
+  HttpIo->RspToken.Message = &HttpIo->RspMessage;
+  HttpIo->TimeoutEvent     = (EFI_EVENT)Connection;
+  HttpIo->Timeout          = PcdGet32 (PcdHttpIoTimeout);
+
+  mConnectionsCreated++;
+  mConnectionsLive++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Destroy a fake connection.
+
+  @param[in]  HttpIo  The HttpIo of the connection.
+
+**/
+VOID
+HttpIoDestroyIo (
+  IN HTTP_IO  *HttpIo
+  )
+{
+  if (HttpIo->Http != NULL) {
+    FreePool (TEST_CONNECTION_FROM_HTTP (HttpIo->Http));
+    HttpIo->Http = NULL;
+    mConnectionsLive--;
+  }
+}
+
+//
+// The driver and library functions below are only used by the single stream
+// download and the boot discovery, which are not tested here.
+//
+
+EFI_STATUS
+HttpIoSendRequest (
+  IN  HTTP_IO                *HttpIo,
+  IN  EFI_HTTP_REQUEST_DATA  *Request       OPTIONAL,
+  IN  UINTN                  HeaderCount,
+  IN  EFI_HTTP_HEADER        *Headers       OPTIONAL,
+  IN  UINTN                  BodyLength,
+  IN  VOID                   *Body          OPTIONAL
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpIoRecvResponse (
+  IN      HTTP_IO                *HttpIo,
+  IN      BOOLEAN                RecvMsgHeader,
+  OUT     HTTP_IO_RESPONSE_DATA  *ResponseData
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpBootCheckImageType (
+  IN      CHAR8              *Uri,
+  IN      VOID               *UriParser,
+  IN      UINTN              HeaderCount,
+  IN      EFI_HTTP_HEADER    *Headers,
+  OUT  HTTP_BOOT_IMAGE_TYPE  *ImageType
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpBootCheckUriScheme (
+  IN      CHAR8  *Uri
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpBootDhcp (
+  IN HTTP_BOOT_PRIVATE_DATA  *Private
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpBootDns (
+  IN     HTTP_BOOT_PRIVATE_DATA  *Private,
+  IN     CHAR16                  *HostName,
+  OUT EFI_IPv6_ADDRESS           *IpAddress
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+VOID
+HttpBootPrintErrorMessage (
+  EFI_HTTP_STATUS_CODE  StatusCode
+  )
+{
+}
+
+EFI_STATUS
+HttpBootRegisterIp4Dns (
+  IN HTTP_BOOT_PRIVATE_DATA  *Private,
+  IN UINTN                   DataLength,
+  IN VOID                    *DnsServerData
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpBootSetIp6Address (
+  IN HTTP_BOOT_PRIVATE_DATA  *Private
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpBootSetIp6Dns (
+  IN HTTP_BOOT_PRIVATE_DATA  *Private,
+  IN UINTN                   DataLength,
+  IN VOID                    *DnsServerData
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HttpBootSetIp6Gateway (
+  IN HTTP_BOOT_PRIVATE_DATA  *Private
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_DEVICE_PATH_PROTOCOL *
+EFIAPI
+AppendDevicePathNode (
+  IN CONST EFI_DEVICE_PATH_PROTOCOL  *DevicePath      OPTIONAL,
+  IN CONST EFI_DEVICE_PATH_PROTOCOL  *DevicePathNode  OPTIONAL
+  )
+{
+  return NULL;
+}
+
+UINT16
+EFIAPI
+SetDevicePathNodeLength (
+  IN OUT VOID  *Node,
+  IN UINTN     Length
+  )
+{
+  return 0;
+}
+
+UINTN
+EFIAPI
+AsciiPrint (
+  IN CONST CHAR8  *Format,
+  ...
+  )
+{
+  return 0;
+}
+
+EFI_STATUS
+EFIAPI
+NetLibAsciiStrToIp4 (
+  IN CONST CHAR8             *String,
+  OUT      EFI_IPv4_ADDRESS  *Ip4Address
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+EFIAPI
+NetLibAsciiStrToIp6 (
+  IN CONST CHAR8             *String,
+  OUT      EFI_IPv6_ADDRESS  *Ip6Address
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Count the requests and the body bytes reported, check that every body byte
+  is reported from its place in the download buffer, and fail once
+  mCallbackFailAfter body bytes are reported if it is set.
+
+  @param[in]  This          The HTTP boot callback protocol.
+  @param[in]  DataType      The type of the data.
+  @param[in]  Received      TRUE for received data.
+  @param[in]  DataLength    The length of the data.
+  @param[in]  Data          The data.
+
+  @retval EFI_SUCCESS  Go on with the download.
+  @retval Others       Abort the download.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestHttpBootCallback (
+  IN EFI_HTTP_BOOT_CALLBACK_PROTOCOL   *This,
+  IN EFI_HTTP_BOOT_CALLBACK_DATA_TYPE  DataType,
+  IN BOOLEAN                           Received,
+  IN UINT32                            DataLength,
+  IN VOID                              *Data     OPTIONAL
+  )
+{
+  EFI_HTTP_MESSAGE  *Message;
+  UINT8             *Body;
+
+  if (DataType == HttpBootHttpRequest) {
+    Message = (EFI_HTTP_MESSAGE *)Data;
+    if (Received || (Message->Data.Request->Method != HttpMethodGet)) {
+      return EFI_INVALID_PARAMETER;
+    }
+
+    mCallbackRequests++;
+  } else if (DataType == HttpBootHttpEntityBody) {
+    Body = (UINT8 *)Data;
+    if ((Body < mBuffer) || (Body + DataLength > mBuffer + mFileSize) ||
+        (CompareMem (Body, mFile + (Body - mBuffer), DataLength) != 0))
+    {
+      mCallbackBodyMismatch = TRUE;
+    }
+
+    mCallbackBodyBytes += DataLength;
+    if ((mCallbackFailAfter != 0) && (mCallbackBodyBytes > mCallbackFailAfter)) {
+      return mCallbackFailStatus;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up a boot file of TEST_FILE_SIZE bytes served with ranges, and a
+  fake server that serves every request.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED  The boot file is set up.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SetUpDownload (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  mFile   = AllocatePool (TEST_FILE_SIZE);
+  mBuffer = AllocatePool (TEST_FILE_SIZE);
+  UT_ASSERT_NOT_NULL (mFile);
+  UT_ASSERT_NOT_NULL (mBuffer);
+  for (Index = 0; Index < TEST_FILE_SIZE; Index++) {
+    mFile[Index] = (UINT8)(Index ^ (Index >> 11));
+  }
+
+  SetMem (mBuffer, TEST_FILE_SIZE, 0xCC);
+  mBufferSize = TEST_FILE_SIZE;
+  mFileSize   = TEST_FILE_SIZE;
+
+  ZeroMem (&mPrivate, sizeof (mPrivate));
+  mPrivate.BootFileUri      = TEST_BOOT_FILE_URI;
+  mPrivate.BootFileSize     = TEST_FILE_SIZE;
+  mPrivate.AcceptRanges     = TRUE;
+  mPrivate.ImageType        = ImageTypeEfi;
+  mPrivate.Ip4Nic           = &mNic;
+  mPrivate.HttpBootCallback = &mCallback;
+  mCallback.Callback        = TestHttpBootCallback;
+  UT_ASSERT_NOT_EFI_ERROR (
+    HttpParseUrl (mPrivate.BootFileUri, (UINT32)AsciiStrLen (mPrivate.BootFileUri), FALSE, &mPrivate.BootFileUriParser)
+    );
+
+  ZeroMem (mFaults, sizeof (mFaults));
+  ZeroMem (mRequests, sizeof (mRequests));
+  mRequestCount         = 0;
+  mConnectionsCreated   = 0;
+  mConnectionsLive      = 0;
+  mCallbackRequests     = 0;
+  mCallbackBodyBytes    = 0;
+  mCallbackBodyMismatch = FALSE;
+  mCallbackFailAfter    = 0;
+  mCallbackFailStatus   = EFI_SUCCESS;
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Free the boot file.
+
+  @param[in]  Context  Unused.
+
+**/
+STATIC
+VOID
+EFIAPI
+TearDownDownload (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  if (mPrivate.BootFileUriParser != NULL) {
+    HttpUrlFreeParser (mPrivate.BootFileUriParser);
+    mPrivate.BootFileUriParser = NULL;
+  }
+
+  if (mFile != NULL) {
+    FreePool (mFile);
+    mFile = NULL;
+  }
+
+  if (mBuffer != NULL) {
+    FreePool (mBuffer);
+    mBuffer = NULL;
+  }
+}
+
+/**
+  Download the boot file in parallel.
+
+  @return The status of HttpBootGetBootFileParallel().
+
+**/
+STATIC
+EFI_STATUS
+TestDownload (
+  VOID
+  )
+{
+  HTTP_BOOT_IMAGE_TYPE  ImageType;
+
+  ImageType = ImageTypeMax;
+  return HttpBootGetBootFileParallel (&mPrivate, &mBufferSize, mBuffer, &ImageType);
+}
+
+/**
+  Find a request after a given one for the given bytes.
+
+  @param[in]  After  The index of the request to search after.
+  @param[in]  First  The first byte requested.
+  @param[in]  Last   The last byte requested.
+
+  @retval TRUE   Such a request is found.
+  @retval FALSE  It is not.
+
+**/
+STATIC
+BOOLEAN
+TestIsRequestedAfter (
+  IN UINTN  After,
+  IN UINTN  First,
+  IN UINTN  Last
+  )
+{
+  UINTN  Index;
+
+  for (Index = After + 1; Index < mRequestCount; Index++) {
+    if ((mRequests[Index].First == First) && (mRequests[Index].Last == Last)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+  Content-Range values are parsed, and the invalid ones rejected.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The values are parsed as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They are not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ContentRangeIsParsed (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  First;
+  UINTN  Last;
+
+  UT_ASSERT_NOT_EFI_ERROR (HttpBootParseContentRange ("bytes 0-1048575/20983865", &First, &Last));
+  UT_ASSERT_EQUAL (First, 0);
+  UT_ASSERT_EQUAL (Last, 1048575);
+
+  UT_ASSERT_NOT_EFI_ERROR (HttpBootParseContentRange ("bytes 20971520-20983864/*", &First, &Last));
+  UT_ASSERT_EQUAL (First, 20971520);
+  UT_ASSERT_EQUAL (Last, 20983864);
+
+  UT_ASSERT_NOT_EFI_ERROR (HttpBootParseContentRange ("bytes 7-7/8", &First, &Last));
+  UT_ASSERT_EQUAL (First, 7);
+  UT_ASSERT_EQUAL (Last, 7);
+
+  UT_ASSERT_STATUS_EQUAL (HttpBootParseContentRange ("bytes=0-99/100", &First, &Last), EFI_PROTOCOL_ERROR);
+  UT_ASSERT_STATUS_EQUAL (HttpBootParseContentRange ("items 0-99/100", &First, &Last), EFI_PROTOCOL_ERROR);
+  UT_ASSERT_STATUS_EQUAL (HttpBootParseContentRange ("bytes */100", &First, &Last), EFI_PROTOCOL_ERROR);
+  UT_ASSERT_STATUS_EQUAL (HttpBootParseContentRange ("bytes 0-99", &First, &Last), EFI_PROTOCOL_ERROR);
+  UT_ASSERT_STATUS_EQUAL (HttpBootParseContentRange ("bytes 0+99/100", &First, &Last), EFI_PROTOCOL_ERROR);
+  UT_ASSERT_STATUS_EQUAL (HttpBootParseContentRange ("bytes 100-99/100", &First, &Last), EFI_PROTOCOL_ERROR);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The file is split in ranges aligned to 64 KB that are requested in order
+  over all the connections, and reassembled in place.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The file is downloaded as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RangesCoverTheFile (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  UT_ASSERT_NOT_EFI_ERROR (TestDownload ());
+  UT_ASSERT_EQUAL (mBufferSize, TEST_FILE_SIZE);
+  UT_ASSERT_MEM_EQUAL (mBuffer, mFile, TEST_FILE_SIZE);
+
+  UT_ASSERT_EQUAL (mRequestCount, TEST_RANGE_COUNT);
+  for (Index = 0; Index < TEST_RANGE_COUNT; Index++) {
+    UT_ASSERT_EQUAL (mRequests[Index].First, Index * TEST_RANGE_SIZE);
+    UT_ASSERT_EQUAL (mRequests[Index].Last, MIN ((Index + 1) * TEST_RANGE_SIZE, TEST_FILE_SIZE) - 1);
+  }
+
+  UT_ASSERT_EQUAL (mConnectionsCreated, PcdGet8 (PcdHttpBootDownloadConnections));
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+
+  //
+  // The request of the file is reported once, and each body byte once.
+  //
+  UT_ASSERT_EQUAL (mCallbackRequests, 1);
+  UT_ASSERT_EQUAL (mCallbackBodyBytes, TEST_FILE_SIZE);
+  UT_ASSERT_FALSE (mCallbackBodyMismatch);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Files that are too small or not served with ranges, and buffers that are
+  too small, are left to the single stream download.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The download is declined as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SmallFilesAreNotSplit (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  mPrivate.AcceptRanges = FALSE;
+  UT_ASSERT_STATUS_EQUAL (TestDownload (), EFI_UNSUPPORTED);
+
+  mPrivate.AcceptRanges = TRUE;
+  mPrivate.BootFileSize = 2 * HTTP_BOOT_RANGE_SIZE_MIN - 1;
+  UT_ASSERT_STATUS_EQUAL (TestDownload (), EFI_UNSUPPORTED);
+  UT_ASSERT_EQUAL (mConnectionsCreated, 0);
+
+  mPrivate.BootFileSize = TEST_FILE_SIZE;
+  mBufferSize           = TEST_FILE_SIZE - 1;
+  UT_ASSERT_STATUS_EQUAL (TestDownload (), EFI_BUFFER_TOO_SMALL);
+  UT_ASSERT_EQUAL (mBufferSize, TEST_FILE_SIZE);
+  UT_ASSERT_EQUAL (mConnectionsCreated, 0);
+  UT_ASSERT_EQUAL (mCallbackRequests, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A range whose connection is reset is requested again, over a new connection,
+  from where it stopped, and a range answered with the wrong Content-Range is
+  requested again whole.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The ranges are retried as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They are not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+FailedRangeIsResumed (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  mFaults[2] = TestReset;
+  mFaults[5] = TestBadRange;
+
+  UT_ASSERT_NOT_EFI_ERROR (TestDownload ());
+  UT_ASSERT_MEM_EQUAL (mBuffer, mFile, TEST_FILE_SIZE);
+
+  UT_ASSERT_EQUAL (mRequestCount, TEST_RANGE_COUNT + 2);
+  UT_ASSERT_TRUE (TestIsRequestedAfter (2, mRequests[2].First + TEST_CHUNK_SIZE, mRequests[2].Last));
+  UT_ASSERT_TRUE (TestIsRequestedAfter (5, mRequests[5].First, mRequests[5].Last));
+
+  UT_ASSERT_EQUAL (mConnectionsCreated, PcdGet8 (PcdHttpBootDownloadConnections) + 2);
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+
+  //
+  // The bytes received before the reset are not reported again.
+  //
+  UT_ASSERT_EQUAL (mCallbackRequests, 1);
+  UT_ASSERT_EQUAL (mCallbackBodyBytes, TEST_FILE_SIZE);
+  UT_ASSERT_FALSE (mCallbackBodyMismatch);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A range that keeps failing fails the download once it is out of retries.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The download fails as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It does not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RetriesAreLimited (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < TEST_MAX_REQUESTS; Index++) {
+    mFaults[Index] = TestReset;
+  }
+
+  UT_ASSERT_STATUS_EQUAL (TestDownload (), EFI_CONNECTION_RESET);
+  UT_ASSERT_TRUE (mRequestCount > HTTP_BOOT_RANGE_RETRY_MAX);
+  UT_ASSERT_TRUE (mRequestCount < TEST_MAX_REQUESTS);
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A range that is never answered times out and is requested again.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The range is retried as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+HungRangeTimesOut (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  mFaults[1] = TestHang;
+
+  UT_ASSERT_NOT_EFI_ERROR (TestDownload ());
+  UT_ASSERT_MEM_EQUAL (mBuffer, mFile, TEST_FILE_SIZE);
+
+  UT_ASSERT_EQUAL (mRequestCount, TEST_RANGE_COUNT + 1);
+  UT_ASSERT_TRUE (TestIsRequestedAfter (1, mRequests[1].First, mRequests[1].Last));
+  UT_ASSERT_EQUAL (mConnectionsCreated, PcdGet8 (PcdHttpBootDownloadConnections) + 1);
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+  UT_ASSERT_EQUAL (mCallbackBodyBytes, TEST_FILE_SIZE);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A server that answers the first range with "200 OK" sends the caller back
+  to the single stream download, with nothing reported to the callback, so
+  that it sees the request once. After the first "206 Partial Content", a
+  "200 OK" only fails its range.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The download falls back as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It does not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+OkFallsBackToSingleStream (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < TEST_MAX_REQUESTS; Index++) {
+    mFaults[Index] = TestOk;
+  }
+
+  UT_ASSERT_STATUS_EQUAL (TestDownload (), EFI_UNSUPPORTED);
+  UT_ASSERT_EQUAL (mCallbackRequests, 0);
+  UT_ASSERT_EQUAL (mCallbackBodyBytes, 0);
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+
+  //
+  // The first range is accepted before the seventh is answered.
+  //
+  ZeroMem (mFaults, sizeof (mFaults));
+  mFaults[6]          = TestOk;
+  mRequestCount       = 0;
+  mConnectionsCreated = 0;
+
+  UT_ASSERT_NOT_EFI_ERROR (TestDownload ());
+  UT_ASSERT_MEM_EQUAL (mBuffer, mFile, TEST_FILE_SIZE);
+  UT_ASSERT_TRUE (TestIsRequestedAfter (6, mRequests[6].First, mRequests[6].Last));
+  UT_ASSERT_EQUAL (mCallbackRequests, 1);
+  UT_ASSERT_EQUAL (mCallbackBodyBytes, TEST_FILE_SIZE);
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  An error from the callback stops the download, and an EFI_UNSUPPORTED from
+  it once ranges are accepted does not ask for the single stream download.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The download stops as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It does not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CallbackStopsTheDownload (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  mCallbackFailAfter  = 3 * SIZE_1MB;
+  mCallbackFailStatus = EFI_ABORTED;
+  UT_ASSERT_STATUS_EQUAL (TestDownload (), EFI_ABORTED);
+  UT_ASSERT_EQUAL (mCallbackRequests, 1);
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+
+  mCallbackRequests   = 0;
+  mCallbackBodyBytes  = 0;
+  mCallbackFailStatus = EFI_UNSUPPORTED;
+  UT_ASSERT_STATUS_EQUAL (TestDownload (), EFI_ABORTED);
+  UT_ASSERT_EQUAL (mCallbackRequests, 1);
+  UT_ASSERT_EQUAL (mConnectionsLive, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the parallel
+  range download, and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      RangeTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  mBootServices.SetTimer   = TestSetTimer;
+  mBootServices.CheckEvent = TestCheckEvent;
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&RangeTests, Framework, "HTTP Boot Range Download Tests", "HttpBoot.Range", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for HTTP Boot Range Download Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite---------Description-----------------------------------------Name----------------Function-------------------Pre------------Post--------------Context
+  //
+  AddTestCase (RangeTests, "Content-Range is parsed", "ContentRange", ContentRangeIsParsed, NULL, NULL, NULL);
+  AddTestCase (RangeTests, "Ranges cover the file", "Split", RangesCoverTheFile, SetUpDownload, TearDownDownload, NULL);
+  AddTestCase (RangeTests, "Small files are not split", "Small", SmallFilesAreNotSplit, SetUpDownload, TearDownDownload, NULL);
+  AddTestCase (RangeTests, "Failed range is resumed", "Retry", FailedRangeIsResumed, SetUpDownload, TearDownDownload, NULL);
+  AddTestCase (RangeTests, "Retries are limited", "RetryMax", RetriesAreLimited, SetUpDownload, TearDownDownload, NULL);
+  AddTestCase (RangeTests, "Hung range times out", "Timeout", HungRangeTimesOut, SetUpDownload, TearDownDownload, NULL);
+  AddTestCase (RangeTests, "200 OK falls back to a single stream", "Fallback", OkFallsBackToSingleStream, SetUpDownload, TearDownDownload, NULL);
+  AddTestCase (RangeTests, "Callback stops the download", "Callback", CallbackStopsTheDownload, SetUpDownload, TearDownDownload, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define HttpBootUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+HttpBootUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -87,24 +87,6 @@ AsciiStrCaseStr (
   return NULL;
 }
 
-/**
-  The callback function to free the net buffer list.
-
-  @param[in]  Arg The opaque parameter.
-
-**/
-VOID
-EFIAPI
-FreeNbufList (
-  IN VOID  *Arg
-  )
-{
-  ASSERT (Arg != NULL);
-
-  NetbufFreeList ((LIST_ENTRY *)Arg);
-  FreePool (Arg);
-}
-
 /**
   Check whether the Url is from Https.
 
@@ -996,8 +978,8 @@ ON_EXIT:
 
 /**
   Receive one TLS PDU. An TLS PDU contains an TLS record header and its
-  corresponding record data. These two parts will be put into two blocks of buffers in the
-  net buffer.
+  corresponding record data. Both are received into one block of the net
+  buffer, so that the record can be processed in place.
 
   @param[in, out]      HttpInstance    Pointer to HTTP_PROTOCOL structure.
   @param[out]          Pdu             The received TLS PDU.
@@ -1019,8 +1001,6 @@ TlsReceiveOnePdu (
 {
   EFI_STATUS  Status;
 
-  LIST_ENTRY  *NbufList;
-
   UINT32  Len;
 
   NET_BUF            *PduHdr;
@@ -1029,17 +1009,9 @@ TlsReceiveOnePdu (
 
   NET_BUF  *DataSeg;
 
-  NbufList = NULL;
-  PduHdr   = NULL;
-  Header   = NULL;
-  DataSeg  = NULL;
-
-  NbufList = AllocatePool (sizeof (LIST_ENTRY));
-  if (NbufList == NULL) {
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  InitializeListHead (NbufList);
+  PduHdr  = NULL;
+  Header  = NULL;
+  DataSeg = NULL;
 
   //
   // Allocate buffer to receive one TLS header.
@@ -1047,8 +1019,7 @@ TlsReceiveOnePdu (
   Len    = TLS_RECORD_HEADER_LENGTH;
   PduHdr = NetbufAlloc (Len);
   if (PduHdr == NULL) {
-    Status = EFI_OUT_OF_RESOURCES;
-    goto ON_EXIT;
+    return EFI_OUT_OF_RESOURCES;
   }
 
   Header = NetbufAllocSpace (PduHdr, Len, NET_BUF_TAIL);
@@ -1066,18 +1037,16 @@ TlsReceiveOnePdu (
   }
 
   RecordHeader = *(TLS_RECORD_HEADER *)Header;
-  if (((RecordHeader.ContentType == TlsContentTypeHandshake) ||
-       (RecordHeader.ContentType == TlsContentTypeAlert) ||
-       (RecordHeader.ContentType == TlsContentTypeChangeCipherSpec) ||
-       (RecordHeader.ContentType == TlsContentTypeApplicationData)) &&
-      (RecordHeader.Version.Major == 0x03) && /// Major versions are same.
-      ((RecordHeader.Version.Minor == TLS10_PROTOCOL_VERSION_MINOR) ||
-       (RecordHeader.Version.Minor == TLS11_PROTOCOL_VERSION_MINOR) ||
-       (RecordHeader.Version.Minor == TLS12_PROTOCOL_VERSION_MINOR))
-      )
+  if (!(((RecordHeader.ContentType == TlsContentTypeHandshake) ||
+         (RecordHeader.ContentType == TlsContentTypeAlert) ||
+         (RecordHeader.ContentType == TlsContentTypeChangeCipherSpec) ||
+         (RecordHeader.ContentType == TlsContentTypeApplicationData)) &&
+        (RecordHeader.Version.Major == 0x03) && /// Major versions are same.
+        ((RecordHeader.Version.Minor == TLS10_PROTOCOL_VERSION_MINOR) ||
+         (RecordHeader.Version.Minor == TLS11_PROTOCOL_VERSION_MINOR) ||
+         (RecordHeader.Version.Minor == TLS12_PROTOCOL_VERSION_MINOR))
+        ))
   {
-    InsertTailList (NbufList, &PduHdr->List);
-  } else {
     Status = EFI_PROTOCOL_ERROR;
     goto ON_EXIT;
   }
@@ -1087,18 +1056,22 @@ TlsReceiveOnePdu (
     //
     // No TLS payload.
     //
-    goto FORM_PDU;
+    *Pdu   = PduHdr;
+    PduHdr = NULL;
+    goto ON_EXIT;
   }
 
   //
-  // Allocate buffer to receive one TLS payload.
+  // Allocate buffer to receive one TLS payload, with room ahead of
+  // it for the header.
   //
-  DataSeg = NetbufAlloc (Len);
+  DataSeg = NetbufAlloc (TLS_RECORD_HEADER_LENGTH + Len);
   if (DataSeg == NULL) {
     Status = EFI_OUT_OF_RESOURCES;
     goto ON_EXIT;
   }
 
+  NetbufReserve (DataSeg, TLS_RECORD_HEADER_LENGTH);
   NetbufAllocSpace (DataSeg, Len, NET_BUF_TAIL);
 
   //
@@ -1109,24 +1082,23 @@ TlsReceiveOnePdu (
     goto ON_EXIT;
   }
 
-  InsertTailList (NbufList, &DataSeg->List);
+  CopyMem (
+    NetbufAllocSpace (DataSeg, TLS_RECORD_HEADER_LENGTH, NET_BUF_HEAD),
+    Header,
+    TLS_RECORD_HEADER_LENGTH
+    );
 
-FORM_PDU:
-  //
-  // Form the PDU from a list of PDU.
-  //
-  *Pdu = NetbufFromBufList (NbufList, 0, 0, FreeNbufList, NbufList);
-  if (*Pdu == NULL) {
-    Status = EFI_OUT_OF_RESOURCES;
-  }
+  *Pdu    = DataSeg;
+  DataSeg = NULL;
 
 ON_EXIT:
 
-  if (EFI_ERROR (Status)) {
-    //
-    // Free the Nbufs in this NbufList and the NbufList itself.
-    //
-    FreeNbufList (NbufList);
+  if (PduHdr != NULL) {
+    NetbufFree (PduHdr);
+  }
+
+  if (DataSeg != NULL) {
+    NetbufFree (DataSeg);
   }
 
   return Status;
@@ -1564,6 +1536,15 @@ TlsProcessMessage (
     goto ON_EXIT;
   }
 
+  //
+  // A single fragment is handed over to the caller as it is.
+  //
+  if (FragmentCount == 1) {
+    Fragment->Len  = FragmentTable[0].FragmentLength;
+    Fragment->Bulk = FragmentTable[0].FragmentBuffer;
+    goto ON_EXIT;
+  }
+
   //
   // Calculate the size according to FragmentTable.
   //
@@ -1574,7 +1555,7 @@ TlsProcessMessage (
   //
   // Allocate buffer for processed data.
   //
-  Buffer = AllocateZeroPool (BufferSize);
+  Buffer = AllocatePool (BufferSize);
   if (Buffer == NULL) {
     Status = EFI_OUT_OF_RESOURCES;
     goto ON_EXIT;
@@ -1675,17 +1656,12 @@ HttpsReceive (
     return Status;
   }
 
+  //
+  // The record is in one block of the Pdu, process it in place.
+  //
+  ASSERT (Pdu->BlockOpNum == 1);
   BufferInSize = Pdu->TotalSize;
-  BufferIn     = AllocateZeroPool (BufferInSize);
-  if (BufferIn == NULL) {
-    Status = EFI_OUT_OF_RESOURCES;
-    NetbufFree (Pdu);
-    return Status;
-  }
-
-  NetbufCopy (Pdu, 0, (UINT32)BufferInSize, BufferIn);
-
-  NetbufFree (Pdu);
+  BufferIn     = NetbufGetByte (Pdu, 0, NULL);
 
   //
   // Handle Receive data.
@@ -1710,7 +1686,7 @@ HttpsReceive (
                &TempFragment
                );
 
-    FreePool (BufferIn);
+    NetbufFree (Pdu);
 
     if (EFI_ERROR (Status)) {
       if (Status == EFI_ABORTED) {
@@ -1786,19 +1762,14 @@ HttpsReceive (
     //
     ASSERT (((TLS_RECORD_HEADER *)(TempFragment.Bulk))->ContentType == TlsContentTypeApplicationData);
 
-    BufferInSize = ((TLS_RECORD_HEADER *)(TempFragment.Bulk))->Length;
-    BufferIn     = AllocateZeroPool (BufferInSize);
-    if (BufferIn == NULL) {
-      Status = EFI_OUT_OF_RESOURCES;
-      return Status;
-    }
-
-    CopyMem (BufferIn, TempFragment.Bulk + TLS_RECORD_HEADER_LENGTH, BufferInSize);
-
     //
-    // Free the buffer in TempFragment.
+    // Move the plain text over the record header, the caller
+    // frees the buffer of TempFragment.
     //
-    FreePool (TempFragment.Bulk);
+    BufferInSize = ((TLS_RECORD_HEADER *)(TempFragment.Bulk))->Length;
+    BufferIn     = TempFragment.Bulk;
+
+    CopyMem (BufferIn, BufferIn + TLS_RECORD_HEADER_LENGTH, BufferInSize);
   } else if ((RecordHeader.ContentType == TlsContentTypeAlert) &&
              (RecordHeader.Version.Major == 0x03) &&
              ((RecordHeader.Version.Minor == TLS10_PROTOCOL_VERSION_MINOR) ||
@@ -1809,7 +1780,7 @@ HttpsReceive (
     BufferOutSize = DEF_BUF_LEN;
     BufferOut     = AllocateZeroPool (BufferOutSize);
     if (BufferOut == NULL) {
-      FreePool (BufferIn);
+      NetbufFree (Pdu);
       Status = EFI_OUT_OF_RESOURCES;
       return Status;
     }
@@ -1825,7 +1796,7 @@ HttpsReceive (
       FreePool (BufferOut);
       BufferOut = AllocateZeroPool (BufferOutSize);
       if (BufferOut == NULL) {
-        FreePool (BufferIn);
+        NetbufFree (Pdu);
         Status = EFI_OUT_OF_RESOURCES;
         return Status;
       }
@@ -1839,7 +1810,7 @@ HttpsReceive (
                                     );
     }
 
-    FreePool (BufferIn);
+    NetbufFree (Pdu);
 
     if (EFI_ERROR (Status)) {
       FreePool (BufferOut);
@@ -1912,6 +1883,15 @@ HttpsReceive (
 
     BufferIn     = NULL;
     BufferInSize = 0;
+  } else {
+    //
+    // Hand the other records up as they are.
+    //
+    BufferIn = AllocateCopyPool (BufferInSize, BufferIn);
+    NetbufFree (Pdu);
+    if (BufferIn == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
   }
 
   Fragment->Bulk = BufferIn;
@@ -0,0 +1,65 @@
+/** @file
+  EDKII MNP Statistics Protocol.
+
+  The MNP driver installs this protocol on the handle of each network device it
+  manages. It returns the receive counters of the device, which are reset each
+  time the simple network of the device is started.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef EDKII_MNP_STATISTICS_H_
+#define EDKII_MNP_STATISTICS_H_
+
+#define EDKII_MNP_STATISTICS_PROTOCOL_GUID \
+  { \
+    0x0e9cea53, 0x3fd3, 0x4599, {0x83, 0xed, 0xd4, 0x23, 0x8a, 0x45, 0xdc, 0x66} \
+  }
+
+typedef struct _EDKII_MNP_STATISTICS_PROTOCOL EDKII_MNP_STATISTICS_PROTOCOL;
+
+typedef struct {
+  UINT64     RxFrames;              ///< Frames received from the simple network.
+  UINT64     RxPolls;               ///< Polls receiving at least one frame.
+  UINT32     RxPollMax;             ///< The most frames received by one poll.
+  UINT32     RxNoBuffer;            ///< Receive attempts without a free buffer.
+  UINT32     RxErrors;              ///< Frames failing the size check.
+  UINT32     RxDropped;             ///< Frames dropped from full or timed-out
+                                    ///< receive queues of the MNP children.
+  UINT64     SnpRxDropped;          ///< Frames dropped by the simple network, or
+                                    ///< MAX_UINT64 if it does not count them.
+  UINT64     PollInterval;          ///< The current system poll interval, in
+                                    ///< 100ns units.
+  BOOLEAN    WaitForPacketSignaled; ///< TRUE if the WaitForPacket event of the
+                                    ///< simple network was seen signaled.
+} EDKII_MNP_STATISTICS;
+
+/**
+  Return the receive statistics of a network device.
+
+  @param[in]  This        A pointer to the EDKII_MNP_STATISTICS_PROTOCOL
+                          instance.
+  @param[out] Statistics  A pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS             The statistics are returned.
+  @retval EFI_INVALID_PARAMETER   This or Statistics is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_MNP_GET_STATISTICS)(
+  IN  EDKII_MNP_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_MNP_STATISTICS           *Statistics
+  );
+
+///
+/// The EDKII_MNP_STATISTICS_PROTOCOL returns the receive counters of a network
+/// device.
+///
+struct _EDKII_MNP_STATISTICS_PROTOCOL {
+  EDKII_MNP_GET_STATISTICS    GetStatistics;
+};
+
+extern EFI_GUID  gEdkiiMnpStatisticsProtocolGuid;
+
+#endif
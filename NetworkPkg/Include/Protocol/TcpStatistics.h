@@ -0,0 +1,74 @@
+/** @file
+  EDKII TCP Statistics Protocol.
+
+  The TCP driver installs this protocol with the EFI TCPv4 or TCPv6 Protocol on
+  the handle of each TCP child. It returns the throughput, congestion control
+  and receive buffer counters of the connection of the child.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef EDKII_TCP_STATISTICS_H_
+#define EDKII_TCP_STATISTICS_H_
+
+#define EDKII_TCP_STATISTICS_PROTOCOL_GUID \
+  { \
+    0x2b0c7a5e, 0x8f3d, 0x4c61, {0x9a, 0x17, 0xd4, 0x6e, 0x0b, 0x52, 0xc3, 0x8f} \
+  }
+
+typedef struct _EDKII_TCP_STATISTICS_PROTOCOL EDKII_TCP_STATISTICS_PROTOCOL;
+
+///
+/// Congestion control algorithms, the values of PcdTcpCongestionControl.
+///
+#define EDKII_TCP_CONGESTION_NEWRENO  0
+#define EDKII_TCP_CONGESTION_CUBIC    1
+
+typedef struct {
+  UINT64     BytesSent;               ///< Bytes sent and acknowledged by the peer.
+  UINT64     BytesReceived;           ///< Bytes received in sequence.
+  UINT32     Duration;                ///< Milliseconds from the establishment of the
+                                      ///< connection to now, or to its close.
+  UINT32     CongestionWindow;        ///< The congestion window, in bytes.
+  UINT32     MaxCongestionWindow;     ///< The largest congestion window, in bytes.
+  UINT32     SlowStartThreshold;      ///< The slow start threshold, in bytes.
+  UINT32     SmoothedRtt;             ///< The smoothed round-trip time, in milliseconds.
+  UINT32     Retransmissions;         ///< Number of segments retransmitted.
+  UINT32     CongestionEvents;        ///< Number of congestion events.
+  UINT32     ReceiveBufferSize;       ///< The size of the receive buffer, in bytes.
+  UINT8      CongestionControl;       ///< The algorithm, such as EDKII_TCP_CONGESTION_CUBIC.
+  UINT8      SendWindowScale;         ///< The window scale of the peer.
+  UINT8      ReceiveWindowScale;      ///< The window scale advertised to the peer.
+  BOOLEAN    ReceiveBufferAutoTuning; ///< TRUE if the receive buffer grows with the
+                                      ///< bandwidth-delay product.
+} EDKII_TCP_STATISTICS;
+
+/**
+  Return the statistics of the connection of a TCP child.
+
+  @param[in]  This        A pointer to the EDKII_TCP_STATISTICS_PROTOCOL
+                          instance.
+  @param[out] Statistics  A pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS             The statistics are returned.
+  @retval EFI_INVALID_PARAMETER   Statistics is NULL.
+  @retval EFI_NOT_STARTED         The TCP child has no connection.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_TCP_GET_STATISTICS)(
+  IN  EDKII_TCP_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_TCP_STATISTICS           *Statistics
+  );
+
+///
+/// The EDKII_TCP_STATISTICS_PROTOCOL returns the counters of a TCP connection.
+///
+struct _EDKII_TCP_STATISTICS_PROTOCOL {
+  EDKII_TCP_GET_STATISTICS    GetStatistics;
+};
+
+extern EFI_GUID  gEdkiiTcpStatisticsProtocolGuid;
+
+#endif
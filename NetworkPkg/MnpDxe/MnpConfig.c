@@ -435,6 +435,7 @@ MnpInitializeDeviceData (
   // Copy the MNP Protocol interfaces from the template.
   //
   CopyMem (&MnpDeviceData->VlanConfig, &mVlanConfigProtocolTemplate, sizeof (EFI_VLAN_CONFIG_PROTOCOL));
+  MnpDeviceData->Statistics.GetStatistics = MnpGetStatistics;
 
   //
   // Open the Simple Network protocol.
@@ -1131,6 +1132,106 @@ MnpStartSnp (
   return Status;
 }
 
+/**
+  Return the receive statistics of the mnp device, and the number of frames
+  Snp dropped if it keeps the statistics.
+
+  @param[in]  This              Pointer to the EDKII_MNP_STATISTICS_PROTOCOL
+                                instance.
+  @param[out] Statistics        Pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS           The statistics are returned.
+  @retval EFI_INVALID_PARAMETER This or Statistics is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+MnpGetStatistics (
+  IN  EDKII_MNP_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_MNP_STATISTICS           *Statistics
+  )
+{
+  MNP_DEVICE_DATA              *MnpDeviceData;
+  EFI_SIMPLE_NETWORK_PROTOCOL  *Snp;
+  EFI_NETWORK_STATISTICS       SnpStatistics;
+  UINTN                        StatisticsSize;
+  EFI_STATUS                   Status;
+  EFI_TPL                      OldTpl;
+
+  if ((This == NULL) || (Statistics == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  MnpDeviceData = MNP_DEVICE_DATA_FROM_STATISTICS (This);
+
+  //
+  // The counters are updated by the system poll, at TPL_CALLBACK.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  Statistics->RxFrames              = MnpDeviceData->StatRxPackets;
+  Statistics->RxPolls               = MnpDeviceData->StatRxPolls;
+  Statistics->RxPollMax             = MnpDeviceData->StatRxPollMax;
+  Statistics->RxNoBuffer            = MnpDeviceData->StatRxNoBuffer;
+  Statistics->RxErrors              = MnpDeviceData->StatRxErrors;
+  Statistics->RxDropped             = MnpDeviceData->StatRxDropped;
+  Statistics->PollInterval          = MnpDeviceData->PollInterval;
+  Statistics->WaitForPacketSignaled = MnpDeviceData->WaitForPacketSignaled;
+
+  //
+  // The statistics not kept by Snp are set to all ones.
+  //
+  Snp                      = MnpDeviceData->Snp;
+  StatisticsSize           = sizeof (SnpStatistics);
+  Statistics->SnpRxDropped = MAX_UINT64;
+  Status                   = Snp->Statistics (Snp, FALSE, &StatisticsSize, &SnpStatistics);
+  if (!EFI_ERROR (Status)) {
+    Statistics->SnpRxDropped = SnpStatistics.RxDroppedFrames;
+  }
+
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Print the receive statistics of the mnp device, and the number of frames
+  Snp dropped if it keeps the statistics.
+
+  @param[in]  MnpDeviceData      Pointer to the mnp device context data.
+
+**/
+VOID
+MnpPrintStatistics (
+  IN MNP_DEVICE_DATA  *MnpDeviceData
+  )
+{
+  EDKII_MNP_STATISTICS  Statistics;
+
+  MnpGetStatistics (&MnpDeviceData->Statistics, &Statistics);
+
+  DEBUG (
+    (DEBUG_INFO,
+     "MnpPrintStatistics: Received %ld frames in %ld polls, %ld per poll, %d at most.\n",
+     Statistics.RxFrames,
+     Statistics.RxPolls,
+     DivU64x64Remainder (Statistics.RxFrames, MAX (Statistics.RxPolls, 1), NULL),
+     Statistics.RxPollMax)
+    );
+
+  DEBUG (
+    (DEBUG_INFO,
+     "MnpPrintStatistics: No buffer %d, bad size %d, dropped from queues %d.\n",
+     Statistics.RxNoBuffer,
+     Statistics.RxErrors,
+     Statistics.RxDropped)
+    );
+
+  if (Statistics.SnpRxDropped != MAX_UINT64) {
+    DEBUG ((DEBUG_INFO, "MnpPrintStatistics: Dropped by SNP %ld.\n", Statistics.SnpRxDropped));
+  }
+}
+
 /**
   Stop the simple network.
 
@@ -1159,6 +1260,10 @@ MnpStopSnp (
     return Status;
   }
 
+  DEBUG_CODE_BEGIN ();
+  MnpPrintStatistics (MnpDeviceData);
+  DEBUG_CODE_END ();
+
   //
   // Shut down the simple network.
   //
@@ -1220,6 +1325,19 @@ MnpStart (
         goto ErrorExit;
       }
 
+      MnpDeviceData->StatRxPackets  = 0;
+      MnpDeviceData->StatRxPolls    = 0;
+      MnpDeviceData->StatRxPollMax  = 0;
+      MnpDeviceData->StatRxNoBuffer = 0;
+      MnpDeviceData->StatRxErrors   = 0;
+      MnpDeviceData->StatRxDropped  = 0;
+
+      //
+      // The simple network may have been reinitialized, learn again whether
+      // it signals WaitForPacket.
+      //
+      MnpDeviceData->WaitForPacketSignaled = FALSE;
+
       //
       // Start the timeout timer.
       //
@@ -1263,7 +1381,8 @@ MnpStart (
     // The EnableSystemPoll differs with the current state, disable or enable
     // the system poll.
     //
-    TimerOpType = EnableSystemPoll ? TimerPeriodic : TimerCancel;
+    TimerOpType                 = EnableSystemPoll ? TimerPeriodic : TimerCancel;
+    MnpDeviceData->PollInterval = MNP_SYS_POLL_INTERVAL;
 
     Status = gBS->SetTimer (MnpDeviceData->PollTimer, TimerOpType, MNP_SYS_POLL_INTERVAL);
     if (EFI_ERROR (Status)) {
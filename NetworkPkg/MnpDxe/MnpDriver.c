@@ -250,6 +250,18 @@ Exit:
     FreePool (VlanVariable);
   }
 
+  if (!EFI_ERROR (Status)) {
+    //
+    // Install the statistics protocol on the controller.
+    //
+    Status = gBS->InstallMultipleProtocolInterfaces (
+                    &ControllerHandle,
+                    &gEdkiiMnpStatisticsProtocolGuid,
+                    &MnpDeviceData->Statistics,
+                    NULL
+                    );
+  }
+
   if (EFI_ERROR (Status)) {
     //
     // Destroy all MNP service data
@@ -366,6 +378,16 @@ MnpDriverBindingStop (
       return EFI_DEVICE_ERROR;
     }
 
+    //
+    // Uninstall the statistics protocol.
+    //
+    gBS->UninstallMultipleProtocolInterfaces (
+           MnpDeviceData->ControllerHandle,
+           &gEdkiiMnpStatisticsProtocolGuid,
+           &MnpDeviceData->Statistics,
+           NULL
+           );
+
     //
     // Uninstall the VLAN Config Protocol if any
     //
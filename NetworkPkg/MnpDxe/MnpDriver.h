@@ -15,6 +15,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Protocol/SimpleNetwork.h>
 #include <Protocol/ServiceBinding.h>
 #include <Protocol/VlanConfig.h>
+#include <Protocol/MnpStatistics.h>
 
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
@@ -69,6 +70,12 @@ typedef struct {
 
   EFI_EVENT                      PollTimer;
   BOOLEAN                        EnableSystemPoll;
+  //
+  // The current period of the PollTimer, and whether the WaitForPacket
+  // event of Snp was ever seen signaled.
+  //
+  UINT64                         PollInterval;
+  BOOLEAN                        WaitForPacketSignaled;
 
   EFI_EVENT                      TimeoutCheckTimer;
   EFI_EVENT                      MediaDetectTimer;
@@ -85,6 +92,18 @@ typedef struct {
   UINT32                         BufferLength;
   UINT32                         PaddingSize;
   NET_BUF                        *RxNbufCache;
+
+  //
+  // Receive statistics, returned by EDKII_MNP_STATISTICS_PROTOCOL and printed
+  // when the simple network is stopped.
+  //
+  EDKII_MNP_STATISTICS_PROTOCOL  Statistics;
+  UINT64                         StatRxPackets;  // Frames received from Snp
+  UINT64                         StatRxPolls;    // Polls receiving at least one frame
+  UINT32                         StatRxPollMax;  // Most frames received by one poll
+  UINT32                         StatRxNoBuffer; // Receive attempts without a free NET_BUF
+  UINT32                         StatRxErrors;   // Frames failing the size check
+  UINT32                         StatRxDropped;  // Frames dropped from the instance queues
 } MNP_DEVICE_DATA;
 
 #define MNP_DEVICE_DATA_FROM_THIS(a) \
@@ -95,6 +114,14 @@ typedef struct {
   MNP_DEVICE_DATA_SIGNATURE \
   )
 
+#define MNP_DEVICE_DATA_FROM_STATISTICS(a) \
+  CR ( \
+  (a), \
+  MNP_DEVICE_DATA, \
+  Statistics, \
+  MNP_DEVICE_DATA_SIGNATURE \
+  )
+
 #define MNP_SERVICE_DATA_SIGNATURE  SIGNATURE_32 ('M', 'n', 'p', 'S')
 
 typedef struct {
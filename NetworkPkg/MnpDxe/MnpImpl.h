@@ -14,6 +14,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #define NET_ETHER_FCS_SIZE  4
 
 #define MNP_SYS_POLL_INTERVAL        (10 * TICKS_PER_MS)    // 10 milliseconds
+#define MNP_SYS_POLL_INTERVAL_MIN    (1 * TICKS_PER_MS)     // 1 millisecond
 #define MNP_TIMEOUT_CHECK_INTERVAL   (50 * TICKS_PER_MS)    // 50 milliseconds
 #define MNP_MEDIA_DETECT_INTERVAL    (500 * TICKS_PER_MS)   // 500 milliseconds
 #define MNP_TX_TIMEOUT_TIME          (500 * TICKS_PER_MS)   // 500 milliseconds
@@ -25,6 +26,17 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 
 #define MNP_MAX_RCVD_PACKET_QUE_SIZE  256
 
+//
+// The frames are received in batches of MNP_RX_BATCH_SIZE, and the DPCs are
+// dispatched after each batch to let the receivers take them. One poll stops
+// when Snp has no more frames, or after MNP_RX_POLL_MAX frames. A poll with
+// at least MNP_RX_POLL_BUSY frames halves the system poll interval, an empty
+// one doubles it.
+//
+#define MNP_RX_BATCH_SIZE  32
+#define MNP_RX_POLL_MAX    512
+#define MNP_RX_POLL_BUSY   8
+
 #define MNP_RECEIVE_UNICAST    0x01
 #define MNP_RECEIVE_BROADCAST  0x02
 
@@ -430,6 +442,24 @@ MnpReceivePacket (
   IN OUT MNP_DEVICE_DATA  *MnpDeviceData
   );
 
+/**
+  Receive the packets pending in Snp and deliver them, in batches, until
+  Snp has no more packet or MNP_RX_POLL_MAX packets are received.
+
+  @param[in, out]  MnpDeviceData        Pointer to the mnp device context data.
+  @param[out]      Received             The number of packets received, optional.
+
+  @retval EFI_SUCCESS           At least one packet is received.
+  @retval Others                No packet is received, the status returned by
+                                MnpReceivePacket.
+
+**/
+EFI_STATUS
+MnpReceivePackets (
+  IN OUT MNP_DEVICE_DATA  *MnpDeviceData,
+  OUT    UINT32           *Received OPTIONAL
+  );
+
 /**
   Allocate a free NET_BUF from MnpDeviceData->FreeNbufQue. If there is none
   in the queue, first try to allocate some and add them into the queue, then
@@ -895,4 +925,23 @@ MnpConfigReceiveFilters (
   IN MNP_DEVICE_DATA  *MnpDeviceData
   );
 
+/**
+  Return the receive statistics of the mnp device, and the number of frames
+  Snp dropped if it keeps the statistics.
+
+  @param[in]  This              Pointer to the EDKII_MNP_STATISTICS_PROTOCOL
+                                instance.
+  @param[out] Statistics        Pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS           The statistics are returned.
+  @retval EFI_INVALID_PARAMETER This or Statistics is NULL.
+
+**/
+EFI_STATUS
+EFIAPI
+MnpGetStatistics (
+  IN  EDKII_MNP_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_MNP_STATISTICS           *Statistics
+  );
+
 #endif
@@ -496,6 +496,7 @@ MnpQueueRcvdPacket (
     //
     MnpRecycleRxData (NULL, (VOID *)OldRxDataWrap);
     Instance->RcvdPacketQueueSize--;
+    Instance->MnpServiceData->MnpDeviceData->StatRxDropped++;
   }
 
   //
@@ -860,6 +861,7 @@ MnpReceivePacket (
       //
       // No available buffer in the buffer pool.
       //
+      MnpDeviceData->StatRxNoBuffer++;
       return EFI_DEVICE_ERROR;
     }
 
@@ -900,9 +902,12 @@ MnpReceivePacket (
        HeaderSize,
        BufLen)
       );
+    MnpDeviceData->StatRxErrors++;
     return EFI_DEVICE_ERROR;
   }
 
+  MnpDeviceData->StatRxPackets++;
+
   Trimmed = 0;
   if (Nbuf->TotalSize != BufLen) {
     //
@@ -954,6 +959,7 @@ MnpReceivePacket (
     MnpDeviceData->RxNbufCache = Nbuf;
     if (Nbuf == NULL) {
       DEBUG ((DEBUG_ERROR, "MnpReceivePacket: Alloc packet for receiving cache failed.\n"));
+      MnpDeviceData->StatRxNoBuffer++;
       return EFI_DEVICE_ERROR;
     }
 
@@ -985,6 +991,69 @@ EXIT:
   return Status;
 }
 
+/**
+  Receive the packets pending in Snp and deliver them, in batches, until
+  Snp has no more packet or MNP_RX_POLL_MAX packets are received.
+
+  The DPCs queued by the delivery are dispatched after each batch, so the
+  receivers take their packets and recycle the buffers before the instance
+  queues and the buffer pool fill up.
+
+  @param[in, out]  MnpDeviceData        Pointer to the mnp device context data.
+  @param[out]      Received             The number of packets received, optional.
+
+  @retval EFI_SUCCESS           At least one packet is received.
+  @retval Others                No packet is received, the status returned by
+                                MnpReceivePacket.
+
+**/
+EFI_STATUS
+MnpReceivePackets (
+  IN OUT MNP_DEVICE_DATA  *MnpDeviceData,
+  OUT    UINT32           *Received OPTIONAL
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      RxPackets;
+  UINT32      Count;
+  UINT32      Tries;
+
+  Status    = EFI_NOT_READY;
+  RxPackets = MnpDeviceData->StatRxPackets;
+
+  for (Tries = 1; Tries <= MNP_RX_POLL_MAX; Tries++) {
+    Status = MnpReceivePacket (MnpDeviceData);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    if ((Tries % MNP_RX_BATCH_SIZE) == 0) {
+      DispatchDpc ();
+    }
+  }
+
+  //
+  // Dispatch the DPC queued by the NotifyFunction of rx token's events.
+  //
+  DispatchDpc ();
+
+  //
+  // A packet may be received even if MnpReceivePacket fails afterwards.
+  //
+  Count = (UINT32)(MnpDeviceData->StatRxPackets - RxPackets);
+  if (Count > 0) {
+    MnpDeviceData->StatRxPolls++;
+    MnpDeviceData->StatRxPollMax = MAX (MnpDeviceData->StatRxPollMax, Count);
+    Status                       = EFI_SUCCESS;
+  }
+
+  if (Received != NULL) {
+    *Received = Count;
+  }
+
+  return Status;
+}
+
 /**
   Remove the received packets if timeout occurs.
 
@@ -1044,6 +1113,7 @@ MnpCheckPacketTimeout (
           DEBUG ((DEBUG_WARN, "MnpCheckPacketTimeout: Received packet timeout.\n"));
           MnpRecycleRxData (NULL, RxDataWrap);
           Instance->RcvdPacketQueueSize--;
+          MnpDeviceData->StatRxDropped++;
         }
       }
 
@@ -1084,8 +1154,14 @@ MnpCheckMediaStatus (
 }
 
 /**
-  Poll to receive the packets from Snp. This function is either called by upperlayer
-  protocols/applications or the system poll timer notify mechanism.
+  Poll to receive the packets from Snp. This function is called by the system
+  poll timer notify mechanism.
+
+  The poll interval adapts to the load: it shrinks down to
+  MNP_SYS_POLL_INTERVAL_MIN while the polls find many packets, and grows back
+  to MNP_SYS_POLL_INTERVAL when they find none. At the longest interval, if Snp
+  is known to signal its WaitForPacket event, that event tells whether there
+  is anything to receive.
 
   @param[in]  Event        The event this notify function registered to.
   @param[in]  Context      Pointer to the context data registered to the event.
@@ -1099,17 +1175,40 @@ MnpSystemPoll (
   )
 {
   MNP_DEVICE_DATA  *MnpDeviceData;
+  EFI_EVENT        WaitForPacket;
+  UINT64           Interval;
+  UINT32           Received;
 
   MnpDeviceData = (MNP_DEVICE_DATA *)Context;
   NET_CHECK_SIGNATURE (MnpDeviceData, MNP_DEVICE_DATA_SIGNATURE);
 
+  WaitForPacket = MnpDeviceData->Snp->WaitForPacket;
+  if ((MnpDeviceData->PollInterval == MNP_SYS_POLL_INTERVAL) && (WaitForPacket != NULL)) {
+    if (!EFI_ERROR (gBS->CheckEvent (WaitForPacket))) {
+      MnpDeviceData->WaitForPacketSignaled = TRUE;
+    } else if (MnpDeviceData->WaitForPacketSignaled) {
+      //
+      // The device is idle and Snp has no packet for us.
+      //
+      return;
+    }
+  }
+
   //
   // Try to receive packets from Snp.
   //
-  MnpReceivePacket (MnpDeviceData);
+  MnpReceivePackets (MnpDeviceData, &Received);
 
-  //
-  // Dispatch the DPC queued by the NotifyFunction of rx token's events.
-  //
-  DispatchDpc ();
+  Interval = MnpDeviceData->PollInterval;
+  if (Received >= MNP_RX_POLL_BUSY) {
+    Interval = MAX (Interval >> 1, MNP_SYS_POLL_INTERVAL_MIN);
+  } else if (Received == 0) {
+    Interval = MIN (Interval << 1, MNP_SYS_POLL_INTERVAL);
+  }
+
+  if ((Interval != MnpDeviceData->PollInterval) && MnpDeviceData->EnableSystemPoll) {
+    if (!EFI_ERROR (gBS->SetTimer (MnpDeviceData->PollTimer, TimerPeriodic, Interval))) {
+      MnpDeviceData->PollInterval = Interval;
+    }
+  }
 }
@@ -773,12 +773,7 @@ MnpPoll (
   //
   // Try to receive packets.
   //
-  Status = MnpReceivePacket (Instance->MnpServiceData->MnpDeviceData);
-
-  //
-  // Dispatch the DPC queued by the NotifyFunction of rx token's events.
-  //
-  DispatchDpc ();
+  Status = MnpReceivePackets (Instance->MnpServiceData->MnpDeviceData, NULL);
 
 ON_EXIT:
   gBS->RestoreTPL (OldTpl);
@@ -0,0 +1,798 @@
+/** @file
+  Host-based unit tests for the batched receive and the adaptive system poll
+  of the MNP driver, with frames fed through a stub simple network.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../MnpImpl.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "MNP Receive Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_MEDIA_HEADER_SIZE  14
+#define TEST_MAX_PACKET_SIZE    1500
+#define TEST_FRAME_SIZE         60
+#define TEST_NBUF_COUNT         16
+#define TEST_SNP_RX_DROPPED     42
+
+//
+// A burst larger than three polls.
+//
+#define TEST_BURST  (3 * MNP_RX_POLL_MAX + MNP_RX_POLL_MAX / 2)
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+EFI_BOOT_SERVICES         *gBS = &mBootServices;
+
+//
+// The VLAN variable is never read or written by the tests.
+//
+EFI_RUNTIME_SERVICES  *gRT = NULL;
+
+STATIC EFI_SIMPLE_NETWORK_MODE      mSnpMode;
+STATIC EFI_SIMPLE_NETWORK_PROTOCOL  mSnp;
+STATIC MNP_DEVICE_DATA              mDevice;
+STATIC MNP_SERVICE_DATA             mService;
+
+//
+// The frames pending in the stub simple network, and what MNP did with it.
+//
+STATIC UINT32   mPending;
+STATIC BOOLEAN  mSignals;
+STATIC BOOLEAN  mKeepsStatistics;
+STATIC UINT32   mReceiveCalls;
+STATIC UINT32   mDpcCalls;
+STATIC UINT64   mPollTimerInterval;
+
+/**
+  Count the dispatches of the DPCs, there is no DPC queued by the tests.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+EFI_STATUS
+EFIAPI
+DispatchDpc (
+  VOID
+  )
+{
+  mDpcCalls++;
+  return EFI_SUCCESS;
+}
+
+/**
+  Remove the first node of a list.
+
+  @param[in, out]  Head  The list head.
+
+  @return The first node, or NULL if the list is empty.
+
+**/
+LIST_ENTRY *
+EFIAPI
+NetListRemoveHead (
+  IN OUT LIST_ENTRY  *Head
+  )
+{
+  LIST_ENTRY  *First;
+
+  if (IsListEmpty (Head)) {
+    return NULL;
+  }
+
+  First = GetFirstNode (Head);
+  RemoveEntryList (First);
+  return First;
+}
+
+//
+// The functions below are linked from the driver, but never called by the
+// tests: they have no MNP child, and neither VLAN nor MAC string.
+//
+
+VOID
+EFIAPI
+NetMapInit (
+  IN OUT NET_MAP  *Map
+  )
+{
+  ZeroMem (Map, sizeof (*Map));
+}
+
+BOOLEAN
+EFIAPI
+NetMapIsEmpty (
+  IN NET_MAP  *Map
+  )
+{
+  return TRUE;
+}
+
+EFI_STATUS
+EFIAPI
+NetMapInsertTail (
+  IN OUT NET_MAP  *Map,
+  IN VOID         *Key,
+  IN VOID         *Value    OPTIONAL
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+EFIAPI
+NetMapIterate (
+  IN NET_MAP           *Map,
+  IN NET_MAP_CALLBACK  CallBack,
+  IN VOID              *Arg      OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+VOID *
+EFIAPI
+NetMapRemoveHead (
+  IN OUT NET_MAP  *Map,
+  OUT VOID        **Value         OPTIONAL
+  )
+{
+  return NULL;
+}
+
+VOID *
+EFIAPI
+NetMapRemoveItem (
+  IN  OUT NET_MAP       *Map,
+  IN  OUT NET_MAP_ITEM  *Item,
+  OUT VOID              **Value           OPTIONAL
+  )
+{
+  return NULL;
+}
+
+EFI_STATUS
+EFIAPI
+NetDestroyLinkList (
+  IN   LIST_ENTRY                      *List,
+  IN   NET_DESTROY_LINK_LIST_CALLBACK  CallBack,
+  IN   VOID                            *Context     OPTIONAL,
+  OUT  UINTN                           *ListLength  OPTIONAL
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+EFIAPI
+NetLibGetMacString (
+  IN  EFI_HANDLE  ServiceHandle,
+  IN  EFI_HANDLE  ImageHandle  OPTIONAL,
+  OUT CHAR16      **MacString
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_DEVICE_PATH_PROTOCOL *
+EFIAPI
+AppendDevicePathNode (
+  IN CONST EFI_DEVICE_PATH_PROTOCOL  *FirstDevicePath   OPTIONAL,
+  IN CONST EFI_DEVICE_PATH_PROTOCOL  *DevicePathNode    OPTIONAL
+  )
+{
+  return NULL;
+}
+
+EFI_STATUS
+EFIAPI
+MnpServiceBindingCreateChild (
+  IN     EFI_SERVICE_BINDING_PROTOCOL  *This,
+  IN OUT EFI_HANDLE                    *ChildHandle
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+EFIAPI
+MnpServiceBindingDestroyChild (
+  IN EFI_SERVICE_BINDING_PROTOCOL  *This,
+  IN EFI_HANDLE                    ChildHandle
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Free a pool allocated by the tests or by the NET_BUF library.
+
+  @param[in]  Buffer  The buffer to free.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestFreePool (
+  IN VOID  *Buffer
+  )
+{
+  FreePool (Buffer);
+  return EFI_SUCCESS;
+}
+
+/**
+  Report the WaitForPacket event signaled if the stub simple network signals
+  it and has a frame pending.
+
+  @param[in]  Event  Unused.
+
+  @retval EFI_SUCCESS    A frame is pending.
+  @retval EFI_NOT_READY  No frame is pending, or the event is not signaled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  return (mSignals && (mPending > 0)) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
+/**
+  Record the interval of the poll timer.
+
+  @param[in]  Event    Unused.
+  @param[in]  Type     Unused.
+  @param[in]  Trigger  The timer interval.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           Trigger
+  )
+{
+  if (Event == mDevice.PollTimer) {
+    mPollTimerInterval = Trigger;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Pretend to raise the TPL.
+
+  @param[in]  NewTpl  Unused.
+
+  @return TPL_APPLICATION.
+
+**/
+STATIC
+EFI_TPL
+EFIAPI
+TestRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  return TPL_APPLICATION;
+}
+
+/**
+  Pretend to restore the TPL.
+
+  @param[in]  OldTpl  Unused.
+
+**/
+STATIC
+VOID
+EFIAPI
+TestRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+}
+
+/**
+  Start or initialize the stub simple network.
+
+  @param[in]  This  Unused.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSnpStart (
+  IN EFI_SIMPLE_NETWORK_PROTOCOL  *This
+  )
+{
+  mSnpMode.State = EfiSimpleNetworkInitialized;
+  return EFI_SUCCESS;
+}
+
+/**
+  Initialize the stub simple network.
+
+  @param[in]  This              Unused.
+  @param[in]  ExtraRxBufferSize Unused.
+  @param[in]  ExtraTxBufferSize Unused.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSnpInitialize (
+  IN EFI_SIMPLE_NETWORK_PROTOCOL  *This,
+  IN UINTN                        ExtraRxBufferSize  OPTIONAL,
+  IN UINTN                        ExtraTxBufferSize  OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Accept any receive filter.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSnpReceiveFilters (
+  IN EFI_SIMPLE_NETWORK_PROTOCOL  *This,
+  IN UINT32                       Enable,
+  IN UINT32                       Disable,
+  IN BOOLEAN                      ResetMCastFilter,
+  IN UINTN                        MCastFilterCnt     OPTIONAL,
+  IN EFI_MAC_ADDRESS              *MCastFilter       OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the statistics of the stub simple network, if it keeps them.
+
+  @retval EFI_SUCCESS      The statistics are returned.
+  @retval EFI_UNSUPPORTED  The stub keeps no statistics.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSnpStatistics (
+  IN EFI_SIMPLE_NETWORK_PROTOCOL  *This,
+  IN BOOLEAN                      Reset,
+  IN OUT UINTN                    *StatisticsSize   OPTIONAL,
+  OUT EFI_NETWORK_STATISTICS      *StatisticsTable  OPTIONAL
+  )
+{
+  if (!mKeepsStatistics) {
+    return EFI_UNSUPPORTED;
+  }
+
+  SetMem (StatisticsTable, *StatisticsSize, 0xFF);
+  StatisticsTable->RxDroppedFrames = TEST_SNP_RX_DROPPED;
+  return EFI_SUCCESS;
+}
+
+/**
+  Receive a minimal frame if one is pending.
+
+  @retval EFI_SUCCESS    A frame is received.
+  @retval EFI_NOT_READY  No frame is pending.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSnpReceive (
+  IN EFI_SIMPLE_NETWORK_PROTOCOL  *This,
+  OUT UINTN                       *HeaderSize  OPTIONAL,
+  IN OUT UINTN                    *BufferSize,
+  OUT VOID                        *Buffer,
+  OUT EFI_MAC_ADDRESS             *SrcAddr     OPTIONAL,
+  OUT EFI_MAC_ADDRESS             *DestAddr    OPTIONAL,
+  OUT UINT16                      *Protocol    OPTIONAL
+  )
+{
+  mReceiveCalls++;
+  if (mPending == 0) {
+    return EFI_NOT_READY;
+  }
+
+  mPending--;
+  ZeroMem (Buffer, TEST_FRAME_SIZE);
+  *BufferSize = TEST_FRAME_SIZE;
+  if (HeaderSize != NULL) {
+    *HeaderSize = TEST_MEDIA_HEADER_SIZE;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up a device with no MNP child, its system poll enabled at the longest
+  interval, and a simple network that does not signal WaitForPacket.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED  The device is set up.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+SetUpDevice (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  ZeroMem (&mSnpMode, sizeof (mSnpMode));
+  mSnpMode.State           = EfiSimpleNetworkInitialized;
+  mSnpMode.MediaHeaderSize = TEST_MEDIA_HEADER_SIZE;
+  mSnpMode.MaxPacketSize   = TEST_MAX_PACKET_SIZE;
+
+  ZeroMem (&mSnp, sizeof (mSnp));
+  mSnp.Mode           = &mSnpMode;
+  mSnp.Start          = TestSnpStart;
+  mSnp.Initialize     = TestSnpInitialize;
+  mSnp.ReceiveFilters = TestSnpReceiveFilters;
+  mSnp.Statistics     = TestSnpStatistics;
+  mSnp.Receive        = TestSnpReceive;
+  mSnp.WaitForPacket  = (EFI_EVENT)&mSnp;
+
+  ZeroMem (&mDevice, sizeof (mDevice));
+  mDevice.Signature                = MNP_DEVICE_DATA_SIGNATURE;
+  mDevice.Snp                      = &mSnp;
+  mDevice.Statistics.GetStatistics = MnpGetStatistics;
+  mDevice.PollTimer                = (EFI_EVENT)&mDevice.PollTimer;
+  mDevice.BufferLength             = TEST_MEDIA_HEADER_SIZE + NET_VLAN_TAG_LEN + TEST_MAX_PACKET_SIZE + NET_ETHER_FCS_SIZE;
+  mDevice.PaddingSize              = 6;
+  mDevice.EnableSystemPoll         = TRUE;
+  mDevice.PollInterval             = MNP_SYS_POLL_INTERVAL;
+  InitializeListHead (&mDevice.ServiceList);
+  InitializeListHead (&mDevice.GroupAddressList);
+  NetbufQueInit (&mDevice.FreeNbufQue);
+
+  ZeroMem (&mService, sizeof (mService));
+  mService.Signature     = MNP_SERVICE_DATA_SIGNATURE;
+  mService.MnpDeviceData = &mDevice;
+  InitializeListHead (&mService.ChildrenList);
+
+  mPending           = 0;
+  mSignals           = FALSE;
+  mKeepsStatistics   = FALSE;
+  mReceiveCalls      = 0;
+  mDpcCalls          = 0;
+  mPollTimerInterval = MNP_SYS_POLL_INTERVAL;
+
+  UT_ASSERT_NOT_EFI_ERROR (MnpAddFreeNbuf (&mDevice, TEST_NBUF_COUNT));
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Free the buffers of the device.
+
+  @param[in]  Context  Unused.
+
+**/
+STATIC
+VOID
+EFIAPI
+TearDownDevice (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  if (mDevice.RxNbufCache != NULL) {
+    MnpFreeNbuf (&mDevice, mDevice.RxNbufCache);
+    mDevice.RxNbufCache = NULL;
+  }
+
+  NetbufQueFlush (&mDevice.FreeNbufQue);
+}
+
+/**
+  Run the system poll a number of times.
+
+  @param[in]  Count  The number of polls.
+
+**/
+STATIC
+VOID
+SystemPoll (
+  IN UINT32  Count
+  )
+{
+  while (Count-- > 0) {
+    MnpSystemPoll (NULL, &mDevice);
+  }
+}
+
+/**
+  A burst of frames is drained in a few polls, the DPCs dispatched after each
+  batch, and the poll interval shrinks to its minimum while the burst lasts.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The burst is drained as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BurstIsDrainedInBatches (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  mPending = TEST_BURST;
+
+  SystemPoll (1);
+  UT_ASSERT_EQUAL (mPending, TEST_BURST - MNP_RX_POLL_MAX);
+  UT_ASSERT_EQUAL (mDpcCalls, MNP_RX_POLL_MAX / MNP_RX_BATCH_SIZE + 1);
+  UT_ASSERT_EQUAL (mDevice.PollInterval, MNP_SYS_POLL_INTERVAL / 2);
+  UT_ASSERT_EQUAL (mPollTimerInterval, mDevice.PollInterval);
+
+  SystemPoll (3);
+  UT_ASSERT_EQUAL (mPending, 0);
+  UT_ASSERT_EQUAL (mDevice.PollInterval, MNP_SYS_POLL_INTERVAL_MIN);
+  UT_ASSERT_EQUAL (mPollTimerInterval, MNP_SYS_POLL_INTERVAL_MIN);
+
+  UT_ASSERT_EQUAL (mDevice.StatRxPackets, TEST_BURST);
+  UT_ASSERT_EQUAL (mDevice.StatRxPolls, 4);
+  UT_ASSERT_EQUAL (mDevice.StatRxPollMax, MNP_RX_POLL_MAX);
+  UT_ASSERT_EQUAL (mDevice.StatRxNoBuffer, 0);
+  UT_ASSERT_EQUAL (mDevice.StatRxErrors, 0);
+
+  //
+  // Idle polls grow the interval back to the longest one.
+  //
+  SystemPoll (10);
+  UT_ASSERT_EQUAL (mDevice.PollInterval, MNP_SYS_POLL_INTERVAL);
+  UT_ASSERT_EQUAL (mPollTimerInterval, MNP_SYS_POLL_INTERVAL);
+  UT_ASSERT_EQUAL (mDevice.StatRxPolls, 4);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Idle polls keep calling Receive() on a simple network that never signals
+  WaitForPacket, and stop once it is seen signaling the event.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The idle polls are as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They are not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+IdlePollUsesWaitForPacket (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  SystemPoll (5);
+  UT_ASSERT_EQUAL (mReceiveCalls, 5);
+  UT_ASSERT_FALSE (mDevice.WaitForPacketSignaled);
+
+  mSignals = TRUE;
+  mPending = 3;
+  SystemPoll (1);
+  UT_ASSERT_EQUAL (mPending, 0);
+  UT_ASSERT_TRUE (mDevice.WaitForPacketSignaled);
+
+  mReceiveCalls = 0;
+  SystemPoll (5);
+  UT_ASSERT_EQUAL (mReceiveCalls, 0);
+
+  mPending = 1;
+  SystemPoll (1);
+  UT_ASSERT_EQUAL (mPending, 0);
+  UT_ASSERT_EQUAL (mDevice.StatRxPackets, 4);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Starting the simple network again resets the counters, and forgets that
+  WaitForPacket was signaled, as the driver may behave differently once
+  reinitialized.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The device is reset as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  It is not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+StartResetsTheDevice (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  mSignals = TRUE;
+  mPending = 2 * MNP_RX_POLL_BUSY;
+  SystemPoll (1);
+  UT_ASSERT_TRUE (mDevice.WaitForPacketSignaled);
+  UT_ASSERT_EQUAL (mDevice.StatRxPackets, 2 * MNP_RX_POLL_BUSY);
+  UT_ASSERT_EQUAL (mDevice.PollInterval, MNP_SYS_POLL_INTERVAL / 2);
+
+  //
+  // The system poll is stopped with the last child, then the simple network
+  // is started again for a new one.
+  //
+  mDevice.EnableSystemPoll = FALSE;
+  mSignals                 = FALSE;
+  UT_ASSERT_NOT_EFI_ERROR (MnpStart (&mService, FALSE, TRUE));
+
+  UT_ASSERT_FALSE (mDevice.WaitForPacketSignaled);
+  UT_ASSERT_TRUE (mDevice.EnableSystemPoll);
+  UT_ASSERT_EQUAL (mDevice.PollInterval, MNP_SYS_POLL_INTERVAL);
+  UT_ASSERT_EQUAL (mPollTimerInterval, MNP_SYS_POLL_INTERVAL);
+  UT_ASSERT_EQUAL (mDevice.StatRxPackets, 0);
+  UT_ASSERT_EQUAL (mDevice.StatRxPolls, 0);
+  UT_ASSERT_EQUAL (mDevice.StatRxPollMax, 0);
+
+  //
+  // A driver that no longer signals the event is polled again.
+  //
+  mPending = 1;
+  SystemPoll (1);
+  UT_ASSERT_EQUAL (mPending, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The statistics protocol returns the counters of the device, and the frames
+  dropped by the simple network only when it counts them.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The statistics are as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  They are not.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+StatisticsAreReturned (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EDKII_MNP_STATISTICS  Statistics;
+
+  mPending = MNP_RX_POLL_MAX + MNP_RX_POLL_BUSY;
+  SystemPoll (2);
+  mDevice.StatRxErrors  = 1;
+  mDevice.StatRxDropped = 2;
+
+  UT_ASSERT_EQUAL (MnpGetStatistics (&mDevice.Statistics, NULL), EFI_INVALID_PARAMETER);
+
+  UT_ASSERT_NOT_EFI_ERROR (mDevice.Statistics.GetStatistics (&mDevice.Statistics, &Statistics));
+  UT_ASSERT_EQUAL (Statistics.RxFrames, MNP_RX_POLL_MAX + MNP_RX_POLL_BUSY);
+  UT_ASSERT_EQUAL (Statistics.RxPolls, 2);
+  UT_ASSERT_EQUAL (Statistics.RxPollMax, MNP_RX_POLL_MAX);
+  UT_ASSERT_EQUAL (Statistics.RxNoBuffer, 0);
+  UT_ASSERT_EQUAL (Statistics.RxErrors, 1);
+  UT_ASSERT_EQUAL (Statistics.RxDropped, 2);
+  UT_ASSERT_EQUAL (Statistics.PollInterval, MNP_SYS_POLL_INTERVAL / 4);
+  UT_ASSERT_FALSE (Statistics.WaitForPacketSignaled);
+  UT_ASSERT_EQUAL (Statistics.SnpRxDropped, MAX_UINT64);
+
+  mKeepsStatistics = TRUE;
+  UT_ASSERT_NOT_EFI_ERROR (mDevice.Statistics.GetStatistics (&mDevice.Statistics, &Statistics));
+  UT_ASSERT_EQUAL (Statistics.SnpRxDropped, TEST_SNP_RX_DROPPED);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the MNP
+  receive path and run the unit tests.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      ReceiveTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  mBootServices.FreePool   = TestFreePool;
+  mBootServices.CheckEvent = TestCheckEvent;
+  mBootServices.SetTimer   = TestSetTimer;
+  mBootServices.RaiseTPL   = TestRaiseTpl;
+  mBootServices.RestoreTPL = TestRestoreTpl;
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&ReceiveTests, Framework, "MNP Receive Tests", "Mnp.Receive", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for MNP Receive Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite-----------Description--------------------------------------Name------------Function-------------------Pre----------Post------------Context
+  //
+  AddTestCase (ReceiveTests, "Burst is drained in batches", "Burst", BurstIsDrainedInBatches, SetUpDevice, TearDownDevice, NULL);
+  AddTestCase (ReceiveTests, "Idle poll uses WaitForPacket", "Idle", IdlePollUsesWaitForPacket, SetUpDevice, TearDownDevice, NULL);
+  AddTestCase (ReceiveTests, "Start resets the device", "Start", StartResetsTheDevice, SetUpDevice, TearDownDevice, NULL);
+  AddTestCase (ReceiveTests, "Statistics are returned", "Statistics", StatisticsAreReturned, SetUpDevice, TearDownDevice, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define MnpIoUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+MnpIoUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
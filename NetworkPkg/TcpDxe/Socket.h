@@ -32,7 +32,7 @@
 #define SOCK_SND_BUFF_SIZE   (8 * 1024)
 #define SOCK_BACKLOG         5
 
-#define PROTO_RESERVED_LEN  20
+#define PROTO_RESERVED_LEN  32
 
 #define SO_NO_MORE_DATA  0x0001
 
@@ -0,0 +1,347 @@
+/** @file
+  TCP congestion control algorithms.
+
+  The algorithm of a connection only decides the slow start threshold
+  after a loss and how the congestion window grows outside of the loss
+  recovery. The recovery itself, NewReno or SACK based, is common to
+  all of them.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "TcpMain.h"
+
+/**
+  Compute the slow start threshold after a loss, as defined in RFC5681.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+  @return The new slow start threshold, in bytes.
+
+**/
+UINT32
+TcpNewRenoSsthresh (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  UINT32  FlightSize;
+
+  FlightSize = TCP_SUB_SEQ (Tcb->SndNxt, Tcb->SndUna);
+
+  return MAX (FlightSize >> 1, (UINT32)(2 * Tcb->SndMss));
+}
+
+/**
+  Grow the congestion window by one SMSS every ACK in slow start,
+  and by about one SMSS every RTT in congestion avoidance.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Acked    The number of bytes newly acknowledged.
+
+**/
+VOID
+TcpNewRenoCongAvoid (
+  IN OUT TCP_CB  *Tcb,
+  IN     UINT32  Acked
+  )
+{
+  if (Tcb->CWnd < Tcb->Ssthresh) {
+    Tcb->CWnd += Tcb->SndMss;
+  } else {
+    Tcb->CWnd += MAX (Tcb->SndMss * Tcb->SndMss / Tcb->CWnd, 1);
+  }
+}
+
+/**
+  Compute the integer cube root of a value.
+
+  @param[in]  Value     The value, less than 2^63.
+
+  @return The largest integer whose cube doesn't exceed Value.
+
+**/
+UINT32
+TcpCubicRoot (
+  IN UINT64  Value
+  )
+{
+  UINT32  Root;
+  UINT32  Next;
+  INTN    Bit;
+
+  Root = 0;
+
+  for (Bit = 20; Bit >= 0; Bit--) {
+    Next = Root | (1U << Bit);
+
+    if (MultU64x32 (MultU64x32 (Next, Next), Next) <= Value) {
+      Root = Next;
+    }
+  }
+
+  return Root;
+}
+
+/**
+  Forget the window history of CUBIC.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpCubicInit (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  ZeroMem (&Tcb->CongestData.Cubic, sizeof (TCP_CUBIC));
+}
+
+/**
+  Record the window where the loss happened, and reduce the window by
+  the CUBIC multiplicative decrease factor, as specified in RFC9438.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+  @return The new slow start threshold, in bytes.
+
+**/
+UINT32
+TcpCubicSsthresh (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  TCP_CUBIC  *Cubic;
+
+  Cubic             = &Tcb->CongestData.Cubic;
+  Cubic->EpochStart = 0;
+
+  //
+  // Fast convergence: a loss before the last WMax is reached means
+  // more flows compete for the path, release some bandwidth to them.
+  //
+  if (Tcb->CWnd < Cubic->WMax) {
+    Cubic->WMax = (UINT32)DivU64x32 (
+                            MultU64x32 (Tcb->CWnd, TCP_CUBIC_SCALE + TCP_CUBIC_BETA),
+                            2 * TCP_CUBIC_SCALE
+                            );
+  } else {
+    Cubic->WMax = Tcb->CWnd;
+  }
+
+  return MAX (
+           (UINT32)DivU64x32 (MultU64x32 (Tcb->CWnd, TCP_CUBIC_BETA), TCP_CUBIC_SCALE),
+           (UINT32)(2 * Tcb->SndMss)
+           );
+}
+
+/**
+  Grow the congestion window along the cubic function of the time since
+  the last loss, or as Reno would if that is faster, as specified in
+  RFC9438.
+
+  Time is counted in 1/1024 seconds, but it only advances with mTcpTick.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Acked    The number of bytes newly acknowledged.
+
+**/
+VOID
+TcpCubicCongAvoid (
+  IN OUT TCP_CB  *Tcb,
+  IN     UINT32  Acked
+  )
+{
+  TCP_CUBIC  *Cubic;
+  UINT64     Value;
+  UINT64     Target;
+  UINT32     Ticks;
+  UINT32     Time;
+  UINT32     Offset;
+  UINT32     Alpha;
+
+  //
+  // Slow start with appropriate byte counting, RFC3465.
+  //
+  if (Tcb->CWnd < Tcb->Ssthresh) {
+    Tcb->CWnd += MIN (Acked, (UINT32)(2 * Tcb->SndMss));
+    return;
+  }
+
+  Cubic = &Tcb->CongestData.Cubic;
+
+  if (Cubic->EpochStart == 0) {
+    Cubic->EpochStart = MAX (mTcpTick, 1);
+    Cubic->WEst       = Tcb->CWnd;
+
+    if (Tcb->CWnd < Cubic->WMax) {
+      //
+      // K = cubic_root ((WMax - cwnd) / C), with the window in segments.
+      //
+      Value = DivU64x32 (LShiftU64 (Cubic->WMax - Tcb->CWnd, 30), Tcb->SndMss);
+      Value = LShiftU64 (DivU64x32 (Value, TCP_CUBIC_C), 10);
+
+      Cubic->K      = TcpCubicRoot (MIN (Value, MAX_INT64));
+      Cubic->Origin = Cubic->WMax;
+    } else {
+      Cubic->K      = 0;
+      Cubic->Origin = Tcb->CWnd;
+    }
+  }
+
+  //
+  // W_cubic (t + RTT) = C * (t + RTT - K)^3 + Origin
+  //
+  Ticks = TCP_SUB_TIME (mTcpTick, Cubic->EpochStart) + (Tcb->SRtt >> TCP_RTT_SHIFT);
+  Time  = MIN (Ticks, TCP_CUBIC_TIME_MAX) * TCP_CUBIC_SCALE / TCP_TICK_HZ;
+
+  Offset = (Time > Cubic->K) ? Time - Cubic->K : Cubic->K - Time;
+  Offset = MIN (Offset, TCP_CUBIC_TIME_MAX);
+
+  Value = RShiftU64 (MultU64x32 (Offset, Offset), 10);
+  Value = RShiftU64 (MultU64x32 (Value, Offset), 10);
+  Value = RShiftU64 (MultU64x32 (Value, TCP_CUBIC_C), 10);
+  Value = RShiftU64 (MultU64x32 (Value, Tcb->SndMss), 10);
+
+  if (Time > Cubic->K) {
+    Target = Cubic->Origin + Value;
+  } else {
+    Target = (Value < Cubic->Origin) ? Cubic->Origin - Value : 0;
+  }
+
+  //
+  // The Reno-friendly estimate grows by Alpha segments every RTT,
+  // then one segment every RTT once the old WMax is reached.
+  //
+  Alpha        = (Cubic->WEst >= Cubic->WMax) ? TCP_CUBIC_SCALE : TCP_CUBIC_ALPHA;
+  Value        = MultU64x32 (MultU64x32 (Acked, Tcb->SndMss), Alpha);
+  Cubic->WEst += (UINT32)DivU64x32 (RShiftU64 (Value, 10), Tcb->CWnd);
+
+  Target = MAX (Target, Cubic->WEst);
+
+  //
+  // Never more than half the window in one RTT.
+  //
+  Target = MIN (Target, Tcb->CWnd + (Tcb->CWnd >> 1));
+
+  if (Target > Tcb->CWnd) {
+    Tcb->CWnd += (UINT32)DivU64x32 (MultU64x32 (Target - Tcb->CWnd, Acked), Tcb->CWnd);
+  }
+}
+
+TCP_CONGESTION_OPS  mTcpNewReno = {
+  "NewReno",
+  TCP_CONGESTION_NEWRENO,
+  NULL,
+  TcpNewRenoSsthresh,
+  TcpNewRenoCongAvoid
+};
+
+TCP_CONGESTION_OPS  mTcpCubic = {
+  "CUBIC",
+  TCP_CONGESTION_CUBIC,
+  TcpCubicInit,
+  TcpCubicSsthresh,
+  TcpCubicCongAvoid
+};
+
+TCP_CONGESTION_OPS  *mTcpCongestionOps[TCP_CONGESTION_NUMBER] = {
+  &mTcpNewReno,
+  &mTcpCubic
+};
+
+/**
+  Select the congestion control algorithm of a connection from
+  PcdTcpCongestionControl.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpSelectCongestionControl (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  UINT8  Index;
+
+  Index = PcdGet8 (PcdTcpCongestionControl);
+  if (Index >= TCP_CONGESTION_NUMBER) {
+    Index = TCP_CONGESTION_NEWRENO;
+  }
+
+  Tcb->CongestOps = mTcpCongestionOps[Index];
+}
+
+/**
+  Initialize the congestion control state of a connection synchronized
+  with its peer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpCongestionInit (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  Tcb->CWnd        = Tcb->SndMss;
+  Tcb->StatCWndMax = Tcb->CWnd;
+
+  if (Tcb->CongestOps->Init != NULL) {
+    Tcb->CongestOps->Init (Tcb);
+  }
+}
+
+/**
+  Set the slow start threshold after a loss. The caller then
+  sets the congestion window according to the recovery used.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpCongestionEvent (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  Tcb->Ssthresh = Tcb->CongestOps->Ssthresh (Tcb);
+  Tcb->StatCongestion++;
+
+  DEBUG (
+    (DEBUG_NET,
+     "TcpCongestionEvent: %a sets ssthresh to %d, cwnd was %d for TCB %p\n",
+     Tcb->CongestOps->Name,
+     Tcb->Ssthresh,
+     Tcb->CWnd,
+     Tcb)
+    );
+}
+
+/**
+  Grow the congestion window when new data is acknowledged outside of
+  the fast recovery. It is called before SndUna is advanced.
+
+  The window only grows while it limits the sender, as in RFC7661.
+  Otherwise a sender held back by the application or the receive
+  window would build a window it never validated, and send it at
+  once later.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Acked    The number of bytes newly acknowledged.
+
+**/
+VOID
+TcpCongestionAvoid (
+  IN OUT TCP_CB  *Tcb,
+  IN     UINT32  Acked
+  )
+{
+  if (TCP_SUB_SEQ (Tcb->SndNxt, Tcb->SndUna) < (Tcb->CWnd >> 1)) {
+    return;
+  }
+
+  Tcb->CongestOps->CongAvoid (Tcb, Acked);
+
+  Tcb->CWnd        = MIN (Tcb->CWnd, TCP_MAX_WIN << Tcb->SndWndScale);
+  Tcb->StatCWndMax = MAX (Tcb->StatCWndMax, Tcb->CWnd);
+}
@@ -118,7 +118,7 @@ Tcp4GetMode (
       Option->EnableTimeStamp     = (BOOLEAN)(!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_TS));
       Option->EnableWindowScaling = (BOOLEAN)(!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_WS));
 
-      Option->EnableSelectiveAck     = FALSE;
+      Option->EnableSelectiveAck     = (BOOLEAN)(!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_SACK));
       Option->EnablePathMtuDiscovery = FALSE;
     }
   }
@@ -195,7 +195,7 @@ Tcp6GetMode (
       Option->EnableTimeStamp     = (BOOLEAN)(!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_TS));
       Option->EnableWindowScaling = (BOOLEAN)(!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_WS));
 
-      Option->EnableSelectiveAck     = FALSE;
+      Option->EnableSelectiveAck     = (BOOLEAN)(!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_SACK));
       Option->EnablePathMtuDiscovery = FALSE;
     }
   }
@@ -563,6 +563,7 @@ TcpConfigurePcb (
   Tcb->Ssthresh = 0xffffffff;
 
   Tcb->CongestState = TCP_CONGEST_OPEN;
+  TcpSelectCongestionControl (Tcb);
 
   Tcb->KeepAliveIdle   = TCP_KEEPALIVE_IDLE_MIN;
   Tcb->KeepAlivePeriod = TCP_KEEPALIVE_PERIOD;
@@ -610,7 +611,7 @@ TcpConfigurePcb (
       Sk,
       (UINT32)(TCP_COMP_VAL (
                  TCP_RCV_BUF_SIZE_MIN,
-                 TCP_RCV_BUF_SIZE,
+                 MAX (PcdGet32 (PcdTcpMaxReceiveBufferSize), TCP_RCV_BUF_SIZE),
                  TCP_RCV_BUF_SIZE,
                  Option->ReceiveBufferSize
                  )
@@ -703,6 +704,18 @@ TcpConfigurePcb (
     if (!Option->EnableWindowScaling) {
       TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_NO_WS);
     }
+
+    if (!Option->EnableSelectiveAck) {
+      TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_NO_SACK);
+    }
+  }
+
+  //
+  // Unless the application sizes the receive buffer, it starts
+  // with the default size and follows the bandwidth-delay product.
+  //
+  if ((Option == NULL) || (Option->ReceiveBufferSize == 0)) {
+    TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_RCV_AUTOTUNE);
   }
 
   //
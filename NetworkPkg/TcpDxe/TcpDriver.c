@@ -744,6 +744,7 @@ TcpCreateSocketCallback (
 {
   EFI_STATUS        Status;
   TCP_SERVICE_DATA  *TcpServiceData;
+  TCP_PROTO_DATA    *ProtoData;
   EFI_GUID          *IpProtocolGuid;
   VOID              *Ip;
 
@@ -753,7 +754,8 @@ TcpCreateSocketCallback (
     IpProtocolGuid = &gEfiIp6ProtocolGuid;
   }
 
-  TcpServiceData = ((TCP_PROTO_DATA *)This->ProtoReserved)->TcpService;
+  ProtoData      = (TCP_PROTO_DATA *)This->ProtoReserved;
+  TcpServiceData = ProtoData->TcpService;
 
   //
   // Open the default IP protocol of IP_IO BY_DRIVER.
@@ -781,6 +783,20 @@ TcpCreateSocketCallback (
                   This->SockHandle,
                   EFI_OPEN_PROTOCOL_GET_PROTOCOL
                   );
+  if (!EFI_ERROR (Status)) {
+    //
+    // Install the statistics of the connection next to the TCP protocol.
+    //
+    ProtoData->Statistics.GetStatistics = TcpGetStatistics;
+
+    Status = gBS->InstallProtocolInterface (
+                    &This->SockHandle,
+                    &gEdkiiTcpStatisticsProtocolGuid,
+                    EFI_NATIVE_INTERFACE,
+                    &ProtoData->Statistics
+                    );
+  }
+
   if (EFI_ERROR (Status)) {
     gBS->CloseProtocol (
            TcpServiceData->IpIo->ChildHandle,
@@ -812,6 +828,7 @@ TcpDestroySocketCallback (
   )
 {
   TCP_SERVICE_DATA  *TcpServiceData;
+  TCP_PROTO_DATA    *ProtoData;
   EFI_GUID          *IpProtocolGuid;
 
   if (This->IpVersion == IP_VERSION_4) {
@@ -820,13 +837,20 @@ TcpDestroySocketCallback (
     IpProtocolGuid = &gEfiIp6ProtocolGuid;
   }
 
-  TcpServiceData = ((TCP_PROTO_DATA *)This->ProtoReserved)->TcpService;
+  ProtoData      = (TCP_PROTO_DATA *)This->ProtoReserved;
+  TcpServiceData = ProtoData->TcpService;
 
   //
   // Remove this node from the list.
   //
   RemoveEntryList (&This->Link);
 
+  gBS->UninstallProtocolInterface (
+         This->SockHandle,
+         &gEdkiiTcpStatisticsProtocolGuid,
+         &ProtoData->Statistics
+         );
+
   //
   // Close the IP protocol.
   //
@@ -31,10 +31,14 @@ typedef struct _TCP_SERVICE_DATA {
 } TCP_SERVICE_DATA;
 
 typedef struct _TCP_PROTO_DATA {
-  TCP_SERVICE_DATA    *TcpService;
-  TCP_CB              *TcpPcb;
+  TCP_SERVICE_DATA                 *TcpService;
+  TCP_CB                           *TcpPcb;
+  EDKII_TCP_STATISTICS_PROTOCOL    Statistics;
 } TCP_PROTO_DATA;
 
+#define TCP_PROTO_DATA_FROM_STATISTICS(a) \
+  BASE_CR ((a), TCP_PROTO_DATA, Statistics)
+
 #define TCP_SERVICE_FROM_THIS(a) \
   CR ( \
   (a), \
@@ -152,6 +152,20 @@ TcpGetRcvMss (
   IN SOCKET  *Sock
   );
 
+/**
+  Collect the throughput and congestion statistics of a connection.
+
+  @param[in]   Tcb                  Pointer to the TCP_CB of this TCP instance.
+  @param[out]  Statistics           Pointer to the buffer to receive the
+                                    statistics.
+
+**/
+VOID
+TcpCollectStatistics (
+  IN  TCP_CB                *Tcb,
+  OUT EDKII_TCP_STATISTICS  *Statistics
+  );
+
 /**
   Set the Tcb's state.
 
@@ -359,6 +373,26 @@ TcpRetransmit (
   IN TCP_SEQNO  Seq
   );
 
+/**
+  Retransmit the segments deemed lost on the SACK scoreboard in
+  sequence order, as long as the pipe is below the congestion
+  window, as specified in RFC6675.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Una     The first unacknowledged sequence number.
+  @param[in]       Force   If TRUE, retransmit the first lost segment
+                           even if the pipe is full.
+
+  @return The number of segments retransmitted.
+
+**/
+INTN
+TcpSackRetransmit (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Una,
+  IN     INTN       Force
+  );
+
 /**
   Check whether to send data/SYN/FIN and piggyback an ACK.
 
@@ -498,6 +532,154 @@ TcpInput (
   IN UINT8           Version
   );
 
+//
+// Functions in TcpSack.c
+//
+
+/**
+  Stamp the segments on the SndQue covered by a transmission.
+
+  @param[in, out]  Tcb         Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Seq         The first sequence number transmitted.
+  @param[in]       End         The sequence number following the last one transmitted.
+  @param[in]       Retransmit  TRUE if this is a retransmission.
+
+**/
+VOID
+TcpSackOnXmit (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Seq,
+  IN     TCP_SEQNO  End,
+  IN     BOOLEAN    Retransmit
+  );
+
+/**
+  Compute the pipe defined in RFC6675, that is the number of bytes
+  that are still in the network.
+
+  @param[in]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]  Una     The first unacknowledged sequence number.
+
+  @return The number of bytes in flight.
+
+**/
+UINT32
+TcpSackPipe (
+  IN TCP_CB     *Tcb,
+  IN TCP_SEQNO  Una
+  );
+
+/**
+  Detect the lost segments with RACK as specified in RFC8985.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Ack     The cumulative acknowledgment.
+
+  @return The number of segments newly deemed lost.
+
+**/
+UINT32
+TcpRackDetectLoss (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Ack
+  );
+
+/**
+  Update the SACK scoreboard with an incoming ACK and detect the
+  lost segments.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Ack     The acknowledgment number of the incoming segment.
+  @param[in]       Option  The options of the incoming segment.
+
+  @return The number of segments newly deemed lost.
+
+**/
+UINT32
+TcpSackUpdate (
+  IN OUT TCP_CB      *Tcb,
+  IN     TCP_SEQNO   Ack,
+  IN     TCP_OPTION  *Option
+  );
+
+/**
+  Update the SACK scoreboard on a retransmission timeout.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpSackOnRto (
+  IN OUT TCP_CB  *Tcb
+  );
+
+/**
+  SACK based loss recovery defined in RFC6675.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Ack     The cumulative acknowledgment.
+
+**/
+VOID
+TcpSackRecover (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Ack
+  );
+
+//
+// Functions in TcpCongestion.c
+//
+
+/**
+  Select the congestion control algorithm of a connection from
+  PcdTcpCongestionControl.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpSelectCongestionControl (
+  IN OUT TCP_CB  *Tcb
+  );
+
+/**
+  Initialize the congestion control state of a connection synchronized
+  with its peer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpCongestionInit (
+  IN OUT TCP_CB  *Tcb
+  );
+
+/**
+  Set the slow start threshold after a loss. The caller then
+  sets the congestion window according to the recovery used.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpCongestionEvent (
+  IN OUT TCP_CB  *Tcb
+  );
+
+/**
+  Grow the congestion window when new data is acknowledged outside of
+  the fast recovery.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Acked    The number of bytes newly acknowledged.
+
+**/
+VOID
+TcpCongestionAvoid (
+  IN OUT TCP_CB  *Tcb,
+  IN     UINT32  Acked
+  );
+
 //
 // Functions in TcpTimer.c
 //
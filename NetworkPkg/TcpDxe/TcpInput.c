@@ -52,10 +52,8 @@ TcpFastRecover (
     //
     // Step 1A: Invoking fast retransmission.
     //
-    FlightSize = TCP_SUB_SEQ (Tcb->SndNxt, Tcb->SndUna);
-
-    Tcb->Ssthresh = MAX (FlightSize >> 1, (UINT32)(2 * Tcb->SndMss));
-    Tcb->Recover  = Tcb->SndNxt;
+    TcpCongestionEvent (Tcb);
+    Tcb->Recover = Tcb->SndNxt;
 
     Tcb->CongestState = TCP_CONGEST_RECOVER;
     TCP_CLEAR_FLG (Tcb->CtrlFlag, TCP_CTRL_RTT_ON);
@@ -179,9 +177,15 @@ TcpFastLossRecover (
     } else {
       //
       // Partial ACK:
-      // fast retransmit the first unacknowledge field.
+      // fast retransmit the first unacknowledge field,
+      // or the segments deemed lost if SACK is in use.
       //
-      TcpRetransmit (Tcb, Seg->Ack);
+      if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK)) {
+        TcpSackRetransmit (Tcb, Seg->Ack, 1);
+      } else {
+        TcpRetransmit (Tcb, Seg->Ack);
+      }
+
       DEBUG (
         (DEBUG_NET,
          "TcpFastLossRecover: received a partial ACK(%d) for TCB %p\n",
@@ -355,6 +359,60 @@ TcpTrimInWnd (
   return TcpTrimSegment (Nbuf, Tcb->RcvNxt, Tcb->RcvWl2 + Tcb->RcvWnd);
 }
 
+/**
+  Grow the receive buffer of an auto-tuned connection with the
+  bandwidth-delay product.
+
+  The data received in sequence is measured over at least one RTT,
+  and the buffer is grown to twice that amount so the advertised
+  window stays ahead of the congestion window of the sender. The
+  RTT is taken as at least one heartbeat, which only errs toward a
+  larger buffer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpTuneRcvBuf (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  UINT32  Rtt;
+  UINT32  Elapsed;
+  UINT32  Space;
+
+  if (!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RCV_AUTOTUNE)) {
+    return;
+  }
+
+  Rtt     = MAX (Tcb->SRtt >> TCP_RTT_SHIFT, 1);
+  Elapsed = TCP_SUB_TIME (mTcpTick, Tcb->RcvSpaceTick);
+
+  if (Elapsed < Rtt) {
+    return;
+  }
+
+  Space = (UINT32)MIN (
+                    DivU64x32 (MultU64x32 (TCP_SUB_SEQ (Tcb->RcvNxt, Tcb->RcvSpaceSeq), 2 * Rtt), Elapsed),
+                    PcdGet32 (PcdTcpMaxReceiveBufferSize)
+                    );
+
+  if (Space > GET_RCV_BUFFSIZE (Tcb->Sk)) {
+    DEBUG (
+      (DEBUG_NET,
+       "TcpTuneRcvBuf: grow the receive buffer from %d to %d for TCB %p\n",
+       GET_RCV_BUFFSIZE (Tcb->Sk),
+       Space,
+       Tcb)
+      );
+
+    SET_RCV_BUFFSIZE (Tcb->Sk, Space);
+  }
+
+  Tcb->RcvSpaceSeq  = Tcb->RcvNxt;
+  Tcb->RcvSpaceTick = mTcpTick;
+}
+
 /**
   Process the data and FIN flag, and check whether to deliver
   data to the socket layer.
@@ -522,6 +580,7 @@ TcpDeliverData (
       }
 
       SockDataRcvd (Tcb->Sk, Nbuf, Urgent);
+      Tcb->StatBytesRcvd += Nbuf->TotalSize;
     }
 
     if (TCP_FIN_RCVD (Tcb->State)) {
@@ -531,6 +590,8 @@ TcpDeliverData (
     NetbufFree (Nbuf);
   }
 
+  TcpTuneRcvBuf (Tcb);
+
   return 0;
 }
 
@@ -563,6 +624,11 @@ TcpQueueData (
   Seg  = TCPSEG_NETBUF (Nbuf);
   Head = &Tcb->RcvQue;
 
+  //
+  // The block of the latest segment is reported first in SACK option.
+  //
+  Tcb->SackRecent = Seg->Seq;
+
   //
   // Fast path to process normal case. That is,
   // no out-of-order segments are received.
@@ -680,6 +746,10 @@ TcpAdjustSndQue (
     if (TCP_SEQ_LEQ (Seg->End, Ack)) {
       Cur = Cur->ForwardLink;
 
+      if (TCP_FLG_ON (Seg->SackState, TCP_SEG_SACKED)) {
+        Tcb->SackedOut--;
+      }
+
       RemoveEntryList (&Node->List);
       NetbufFree (Node);
       continue;
@@ -724,6 +794,7 @@ TcpInput (
   TCP_SEQNO   Urg;
   UINT16      Checksum;
   INT32       Usable;
+  UINT32      Lost;
 
   ASSERT ((Version == IP_VERSION_4) || (Version == IP_VERSION_6));
 
@@ -1188,8 +1259,16 @@ TcpInput (
       Tcb->TsRecentAge = mTcpTick;
     }
 
-    TcpComputeRtt (Tcb, TCP_SUB_TIME (mTcpTick, Option.TSEcr));
-  } else if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RTT_ON)) {
+    //
+    // Only an ACK for new data measures the RTT, the TSEcr of the
+    // others may echo a segment sent long ago, see RFC7323 4.1.
+    //
+    if (TCP_SEQ_GT (Seg->Ack, Tcb->SndUna)) {
+      TcpComputeRtt (Tcb, TCP_SUB_TIME (mTcpTick, Option.TSEcr));
+    }
+  } else if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RTT_ON) &&
+             TCP_SEQ_GT (Seg->Ack, Tcb->RttSeq))
+  {
     ASSERT (Tcb->CongestState == TCP_CONGEST_OPEN);
 
     TcpComputeRtt (Tcb, Tcb->RttMeasure);
@@ -1215,20 +1294,30 @@ TcpInput (
     Tcb->DupAck = 0;
   }
 
+  //
+  // Update the SACK scoreboard and detect the lost segments.
+  //
+  Lost = 0;
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK)) {
+    Lost = TcpSackUpdate (Tcb, Seg->Ack, &Option);
+  }
+
   //
   // Congestion avoidance, fast recovery and fast retransmission.
+  // With SACK, the lost segments are found by the scoreboard
+  // rather than by counting the duplicate ACKs.
   //
-  if (((Tcb->CongestState == TCP_CONGEST_OPEN) && (Tcb->DupAck < 3)) ||
-      (Tcb->CongestState == TCP_CONGEST_LOSS))
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK) &&
+      ((Tcb->CongestState == TCP_CONGEST_RECOVER) ||
+       ((Tcb->CongestState == TCP_CONGEST_OPEN) && (Lost != 0))))
+  {
+    TcpSackRecover (Tcb, Seg->Ack);
+  } else if (((Tcb->CongestState == TCP_CONGEST_OPEN) &&
+              ((Tcb->DupAck < 3) || TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK))) ||
+             (Tcb->CongestState == TCP_CONGEST_LOSS))
   {
     if (TCP_SEQ_GT (Seg->Ack, Tcb->SndUna)) {
-      if (Tcb->CWnd < Tcb->Ssthresh) {
-        Tcb->CWnd += Tcb->SndMss;
-      } else {
-        Tcb->CWnd += MAX (Tcb->SndMss * Tcb->SndMss / Tcb->CWnd, 1);
-      }
-
-      Tcb->CWnd = MIN (Tcb->CWnd, TCP_MAX_WIN << Tcb->SndWndScale);
+      TcpCongestionAvoid (Tcb, TCP_SUB_SEQ (Seg->Ack, Tcb->SndUna));
     }
 
     if (Tcb->CongestState == TCP_CONGEST_LOSS) {
@@ -1249,7 +1338,8 @@ TcpInput (
       goto DISCARD;
     }
 
-    Tcb->SndUna = Seg->Ack;
+    Tcb->StatBytesAcked += TCP_SUB_SEQ (Seg->Ack, Tcb->SndUna);
+    Tcb->SndUna          = Seg->Ack;
 
     if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_URG) &&
         TCP_SEQ_LT (Tcb->SndUp, Seg->Ack))
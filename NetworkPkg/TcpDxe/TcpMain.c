@@ -163,7 +163,7 @@ Tcp4Configure (
     }
 
     Option = TcpConfigData->ControlOption;
-    if ((NULL != Option) && (Option->EnableSelectiveAck || Option->EnablePathMtuDiscovery)) {
+    if ((NULL != Option) && Option->EnablePathMtuDiscovery) {
       return EFI_UNSUPPORTED;
     }
   }
@@ -698,7 +698,7 @@ Tcp6Configure (
     }
 
     Option = Tcp6ConfigData->ControlOption;
-    if ((NULL != Option) && (Option->EnableSelectiveAck || Option->EnablePathMtuDiscovery)) {
+    if ((NULL != Option) && Option->EnablePathMtuDiscovery) {
       return EFI_UNSUPPORTED;
     }
   }
@@ -1106,3 +1106,46 @@ Tcp6Poll (
 
   return Status;
 }
+
+/**
+  Return the statistics of the connection of a TCP child.
+
+  @param[in]  This               Pointer to the EDKII_TCP_STATISTICS_PROTOCOL
+                                 instance.
+  @param[out] Statistics         Pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS            The statistics are returned.
+  @retval EFI_INVALID_PARAMETER  This or Statistics is NULL.
+  @retval EFI_NOT_STARTED        The TCP child has no connection.
+
+**/
+EFI_STATUS
+EFIAPI
+TcpGetStatistics (
+  IN  EDKII_TCP_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_TCP_STATISTICS           *Statistics
+  )
+{
+  TCP_PROTO_DATA  *ProtoData;
+  EFI_STATUS      Status;
+  EFI_TPL         OldTpl;
+
+  if ((NULL == This) || (NULL == Statistics)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ProtoData = TCP_PROTO_DATA_FROM_STATISTICS (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  if (ProtoData->TcpPcb == NULL) {
+    Status = EFI_NOT_STARTED;
+  } else {
+    TcpCollectStatistics (ProtoData->TcpPcb, Statistics);
+    Status = EFI_SUCCESS;
+  }
+
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
@@ -11,11 +11,15 @@
 #ifndef _TCP_MAIN_H_
 #define _TCP_MAIN_H_
 
+#include <Uefi.h>
+
 #include <Protocol/ServiceBinding.h>
 #include <Protocol/DriverBinding.h>
+#include <Protocol/TcpStatistics.h>
 #include <Library/IpIoLib.h>
 #include <Library/DevicePathLib.h>
 #include <Library/PrintLib.h>
+#include <Library/PcdLib.h>
 
 #include "Socket.h"
 #include "TcpProto.h"
@@ -29,10 +33,11 @@ extern EFI_COMPONENT_NAME_PROTOCOL   gTcpComponentName;
 extern EFI_COMPONENT_NAME2_PROTOCOL  gTcpComponentName2;
 extern EFI_UNICODE_STRING_TABLE      *gTcpControllerNameTable;
 
-extern LIST_ENTRY  mTcpRunQue;
-extern LIST_ENTRY  mTcpListenQue;
-extern TCP_SEQNO   mTcpGlobalIss;
-extern UINT32      mTcpTick;
+extern LIST_ENTRY          mTcpRunQue;
+extern LIST_ENTRY          mTcpListenQue;
+extern TCP_SEQNO           mTcpGlobalIss;
+extern UINT32              mTcpTick;
+extern TCP_CONGESTION_OPS  *mTcpCongestionOps[TCP_CONGESTION_NUMBER];
 
 ///
 /// 30 seconds.
@@ -774,4 +779,23 @@ Tcp6Poll (
   IN EFI_TCP6_PROTOCOL  *This
   );
 
+/**
+  Return the statistics of the connection of a TCP child.
+
+  @param[in]  This               Pointer to the EDKII_TCP_STATISTICS_PROTOCOL
+                                 instance.
+  @param[out] Statistics         Pointer to the buffer to receive the statistics.
+
+  @retval EFI_SUCCESS            The statistics are returned.
+  @retval EFI_INVALID_PARAMETER  This or Statistics is NULL.
+  @retval EFI_NOT_STARTED        The TCP child has no connection.
+
+**/
+EFI_STATUS
+EFIAPI
+TcpGetStatistics (
+  IN  EDKII_TCP_STATISTICS_PROTOCOL  *This,
+  OUT EDKII_TCP_STATISTICS           *Statistics
+  );
+
 #endif
@@ -81,6 +81,18 @@ TcpInitTcbLocal (
   Tcb->RcvWndScale   = 0;
   Tcb->RetxmitSeqMax = 0;
 
+  Tcb->SackedOut     = 0;
+  Tcb->XmitCount     = 0;
+  Tcb->RackXmitCount = 0;
+  Tcb->RackRtt       = 0;
+
+  Tcb->StatStartTick  = mTcpTick;
+  Tcb->StatEndTick    = mTcpTick;
+  Tcb->StatBytesAcked = 0;
+  Tcb->StatBytesRcvd  = 0;
+  Tcb->StatRetransmit = 0;
+  Tcb->StatCongestion = 0;
+
   Tcb->ProbeTimerOn = FALSE;
 }
 
@@ -128,12 +140,14 @@ TcpInitTcbPeer (
     Tcb->RcvMss = 536;
   }
 
-  Tcb->CWnd = Tcb->SndMss;
+  TcpCongestionInit (Tcb);
 
   Tcb->Irs    = Seg->Seq;
   Tcb->RcvNxt = Tcb->Irs + 1;
 
-  Tcb->RcvWl2 = Tcb->RcvNxt;
+  Tcb->RcvWl2       = Tcb->RcvNxt;
+  Tcb->RcvSpaceSeq  = Tcb->RcvNxt;
+  Tcb->RcvSpaceTick = mTcpTick;
 
   if (TCP_FLG_ON (Opt->Flag, TCP_OPTION_RCVD_WS) && !TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_WS)) {
     Tcb->SndWndScale = Opt->WndScale;
@@ -160,6 +174,15 @@ TcpInitTcbPeer (
     //
     Tcb->SndMss -= TCP_OPTION_TS_ALIGNED_LEN;
   }
+
+  if (TCP_FLG_ON (Opt->Flag, TCP_OPTION_RCVD_SACK_PERM) && !TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_SACK)) {
+    TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_SND_SACK);
+  } else {
+    //
+    // One end doesn't support SACK, recover by the duplicate ACKs.
+    //
+    TCP_CLEAR_FLG (Tcb->CtrlFlag, TCP_CTRL_SND_SACK);
+  }
 }
 
 /**
@@ -585,6 +608,83 @@ TcpGetRcvMss (
   }
 }
 
+/**
+  Collect the throughput and congestion statistics of a connection.
+
+  @param[in]   Tcb                  Pointer to the TCP_CB of this TCP instance.
+  @param[out]  Statistics           Pointer to the buffer to receive the
+                                    statistics.
+
+**/
+VOID
+TcpCollectStatistics (
+  IN  TCP_CB                *Tcb,
+  OUT EDKII_TCP_STATISTICS  *Statistics
+  )
+{
+  UINT32  EndTick;
+
+  EndTick = TCP_CONNECTED (Tcb->State) ? mTcpTick : Tcb->StatEndTick;
+
+  Statistics->BytesSent               = Tcb->StatBytesAcked;
+  Statistics->BytesReceived           = Tcb->StatBytesRcvd;
+  Statistics->Duration                = TCP_SUB_TIME (EndTick, Tcb->StatStartTick) * TCP_TICK;
+  Statistics->CongestionWindow        = Tcb->CWnd;
+  Statistics->MaxCongestionWindow     = Tcb->StatCWndMax;
+  Statistics->SlowStartThreshold      = Tcb->Ssthresh;
+  Statistics->SmoothedRtt             = (Tcb->SRtt >> TCP_RTT_SHIFT) * TCP_TICK;
+  Statistics->Retransmissions         = Tcb->StatRetransmit;
+  Statistics->CongestionEvents        = Tcb->StatCongestion;
+  Statistics->ReceiveBufferSize       = GET_RCV_BUFFSIZE (Tcb->Sk);
+  Statistics->CongestionControl       = Tcb->CongestOps->Algorithm;
+  Statistics->SendWindowScale         = Tcb->SndWndScale;
+  Statistics->ReceiveWindowScale      = Tcb->RcvWndScale;
+  Statistics->ReceiveBufferAutoTuning = TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RCV_AUTOTUNE);
+}
+
+/**
+  Report the throughput and congestion statistics of a connection.
+
+  @param[in]  Tcb                   Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpReportStatistics (
+  IN TCP_CB  *Tcb
+  )
+{
+  EDKII_TCP_STATISTICS  Statistics;
+  UINT32                Duration;
+
+  TcpCollectStatistics (Tcb, &Statistics);
+  Duration = MAX (Statistics.Duration, 1);
+
+  DEBUG (
+    (DEBUG_INFO,
+     "TCB %p: %a, %d ms, sent %Ld bytes (%Ld B/s), received %Ld bytes (%Ld B/s)\n",
+     Tcb,
+     Tcb->CongestOps->Name,
+     Statistics.Duration,
+     Statistics.BytesSent,
+     DivU64x32 (MultU64x32 (Statistics.BytesSent, 1000), Duration),
+     Statistics.BytesReceived,
+     DivU64x32 (MultU64x32 (Statistics.BytesReceived, 1000), Duration))
+    );
+
+  DEBUG (
+    (DEBUG_INFO,
+     "TCB %p: cwnd %d (max %d), ssthresh %d, srtt %d ms, %d retransmissions, %d congestion events, receive buffer %d\n",
+     Tcb,
+     Statistics.CongestionWindow,
+     Statistics.MaxCongestionWindow,
+     Statistics.SlowStartThreshold,
+     Statistics.SmoothedRtt,
+     Statistics.Retransmissions,
+     Statistics.CongestionEvents,
+     Statistics.ReceiveBufferSize)
+    );
+}
+
 /**
   Set the Tcb's state.
 
@@ -601,6 +701,11 @@ TcpSetState (
   ASSERT (Tcb->State < (sizeof (mTcpStateName) / sizeof (CHAR16 *)));
   ASSERT (State < (sizeof (mTcpStateName) / sizeof (CHAR16 *)));
 
+  if ((State == TCP_CLOSED) && TCP_CONNECTED (Tcb->State)) {
+    Tcb->StatEndTick = mTcpTick;
+    TcpReportStatistics (Tcb);
+  }
+
   DEBUG (
     (DEBUG_NET,
      "Tcb (%p) state %s --> %s\n",
@@ -614,6 +719,7 @@ TcpSetState (
   switch (State) {
     case TCP_ESTABLISHED:
 
+      Tcb->StatStartTick = mTcpTick;
       SockConnEstablished (Tcb->Sk);
 
       if (Tcb->Parent != NULL) {
@@ -84,6 +84,14 @@ TcpComputeScale (
 
   BufSize = GET_RCV_BUFFSIZE (Tcb->Sk);
 
+  //
+  // An auto-tuned buffer may grow up to the maximum later, but
+  // the scale is only negotiated now.
+  //
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_RCV_AUTOTUNE)) {
+    BufSize = MAX (BufSize, PcdGet32 (PcdTcpMaxReceiveBufferSize));
+  }
+
   Scale = 0;
   while ((Scale < TCP_OPTION_MAX_WS) && ((UINT32)(TCP_OPTION_MAX_WIN << Scale) < BufSize)) {
     Scale++;
@@ -160,6 +168,28 @@ TcpSynBuildOption (
     TcpPutUint32 (Data, TCP_OPTION_WS_FAST | TcpComputeScale (Tcb));
   }
 
+  //
+  // Build SACK permitted option, only when not disabled by
+  // the application, and either we are doing active open
+  // or the peer has permitted SACK in its SYN.
+  //
+  if (!TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_NO_SACK) &&
+      (!TCP_FLG_ON (TCPSEG_NETBUF (Nbuf)->Flag, TCP_FLG_ACK) ||
+       TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK))
+      )
+  {
+    Data = NetbufAllocSpace (
+             Nbuf,
+             TCP_OPTION_SACK_PERM_ALIGNED_LEN,
+             NET_BUF_HEAD
+             );
+
+    ASSERT (Data != NULL);
+
+    Len += TCP_OPTION_SACK_PERM_ALIGNED_LEN;
+    TcpPutUint32 (Data, TCP_OPTION_SACK_PERM_FAST);
+  }
+
   //
   // Build the MSS option.
   //
@@ -172,6 +202,124 @@ TcpSynBuildOption (
   return Len;
 }
 
+/**
+  Build the SACK option to report the out-of-order data on the RcvQue.
+
+  The block that contains the most recently received segment is
+  reported first as RFC2018 requires, followed by the other blocks
+  in sequence order as many as the option space allows.
+
+  @param[in]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]  Nbuf    Pointer to the buffer to store the options.
+  @param[in]  Used    The length of the options already built in Nbuf.
+
+  @return             The length of the SACK option, 0 if none is built.
+
+**/
+UINT16
+TcpBuildSackOption (
+  IN TCP_CB   *Tcb,
+  IN NET_BUF  *Nbuf,
+  IN UINT16   Used
+  )
+{
+  TCP_SACK_BLOCK  Block[TCP_OPTION_MAX_SACK_BLOCK + 1];
+  LIST_ENTRY      *Entry;
+  TCP_SEG         *Seg;
+  TCP_SEQNO       Left;
+  TCP_SEQNO       Right;
+  INT32           Room;
+  UINT32          Max;
+  UINT32          Count;
+  UINT32          First;
+  UINT32          Index;
+  UINT8           *Data;
+
+  //
+  // The option must fit in the option field, and must not
+  // push a data segment beyond the MSS the peer announced.
+  //
+  Room = TCP_OPTION_MAX_LEN - Used;
+
+  if (Nbuf->TotalSize != 0) {
+    Room = MIN (Room, (INT32)Tcb->SndMss - (INT32)Nbuf->TotalSize);
+  }
+
+  if (Room < 4 + TCP_OPTION_SACK_BLOCK_LEN) {
+    return 0;
+  }
+
+  Max = MIN ((UINT32)(Room - 4) / TCP_OPTION_SACK_BLOCK_LEN, TCP_OPTION_MAX_SACK_BLOCK);
+
+  //
+  // Block[0] is reserved for the block of the latest segment, the
+  // others are collected from Block[1] in case it is not found.
+  //
+  Count = 1;
+  First = 1;
+  Entry = Tcb->RcvQue.ForwardLink;
+
+  while ((Entry != &Tcb->RcvQue) && ((First != 0) || (Count < Max))) {
+    Seg   = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+    Left  = Seg->Seq;
+    Right = Seg->End;
+
+    //
+    // Merge the contiguous segments into one block.
+    //
+    for (Entry = Entry->ForwardLink; Entry != &Tcb->RcvQue; Entry = Entry->ForwardLink) {
+      Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+      if (Seg->Seq != Right) {
+        break;
+      }
+
+      Right = Seg->End;
+    }
+
+    if (TCP_SEQ_LEQ (Right, Tcb->RcvNxt)) {
+      continue;
+    }
+
+    if ((First != 0) && TCP_SEQ_LEQ (Left, Tcb->SackRecent) && TCP_SEQ_LT (Tcb->SackRecent, Right)) {
+      Block[0].Left  = Left;
+      Block[0].Right = Right;
+      First          = 0;
+    } else if (Count <= Max) {
+      Block[Count].Left  = Left;
+      Block[Count].Right = Right;
+      Count++;
+    }
+  }
+
+  if (First == 0) {
+    Count = MIN (Count, Max);
+  } else {
+    Count--;
+  }
+
+  if (Count == 0) {
+    return 0;
+  }
+
+  Data = NetbufAllocSpace (
+           Nbuf,
+           4 + Count * TCP_OPTION_SACK_BLOCK_LEN,
+           NET_BUF_HEAD
+           );
+
+  ASSERT (Data != NULL);
+
+  TcpPutUint32 (Data, TCP_OPTION_SACK_FAST | (2 + Count * TCP_OPTION_SACK_BLOCK_LEN));
+
+  for (Index = 0; Index < Count; Index++) {
+    TcpPutUint32 (Data + 4 + Index * TCP_OPTION_SACK_BLOCK_LEN, Block[First + Index].Left);
+    TcpPutUint32 (Data + 8 + Index * TCP_OPTION_SACK_BLOCK_LEN, Block[First + Index].Right);
+  }
+
+  return (UINT16)(4 + Count * TCP_OPTION_SACK_BLOCK_LEN);
+}
+
 /**
   Build the TCP option in synchronized states.
 
@@ -214,6 +362,17 @@ TcpBuildOption (
     TcpPutUint32 (Data + 8, Tcb->TsRecent);
   }
 
+  //
+  // Build the SACK option if there is out-of-order data.
+  //
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK) &&
+      !TCP_FLG_ON (TCPSEG_NETBUF (Nbuf)->Flag, TCP_FLG_RST) &&
+      !IsListEmpty (&Tcb->RcvQue)
+      )
+  {
+    Len = (UINT16)(Len + TcpBuildSackOption (Tcb, Nbuf, Len));
+  }
+
   return Len;
 }
 
@@ -239,10 +398,12 @@ TcpParseOption (
   UINT8  Cur;
   UINT8  Type;
   UINT8  Len;
+  UINT8  Index;
 
   ASSERT ((Tcp != NULL) && (Option != NULL));
 
-  Option->Flag = 0;
+  Option->Flag      = 0;
+  Option->SackCount = 0;
 
   TotalLen = (UINT8)((Tcp->HeadLen << 2) - sizeof (TCP_HEAD));
   if (TotalLen <= 0) {
@@ -311,6 +472,39 @@ TcpParseOption (
         Cur += TCP_OPTION_TS_LEN;
         break;
 
+      case TCP_OPTION_SACK_PERM:
+        Len = Head[Cur + 1];
+
+        if ((Len != TCP_OPTION_SACK_PERM_LEN) || (TotalLen - Cur < TCP_OPTION_SACK_PERM_LEN)) {
+          return -1;
+        }
+
+        TCP_SET_FLG (Option->Flag, TCP_OPTION_RCVD_SACK_PERM);
+
+        Cur += TCP_OPTION_SACK_PERM_LEN;
+        break;
+
+      case TCP_OPTION_SACK:
+        Len = Head[Cur + 1];
+
+        if (((TotalLen - Cur) < Len) || (Len < 2 + TCP_OPTION_SACK_BLOCK_LEN) ||
+            ((Len - 2) % TCP_OPTION_SACK_BLOCK_LEN != 0))
+        {
+          return -1;
+        }
+
+        Option->SackCount = (UINT8)MIN ((Len - 2) / TCP_OPTION_SACK_BLOCK_LEN, TCP_OPTION_MAX_SACK_BLOCK);
+
+        for (Index = 0; Index < Option->SackCount; Index++) {
+          Option->Sack[Index].Left  = TcpGetUint32 (&Head[Cur + 2 + Index * TCP_OPTION_SACK_BLOCK_LEN]);
+          Option->Sack[Index].Right = TcpGetUint32 (&Head[Cur + 6 + Index * TCP_OPTION_SACK_BLOCK_LEN]);
+        }
+
+        TCP_SET_FLG (Option->Flag, TCP_OPTION_RCVD_SACK);
+
+        Cur = (UINT8)(Cur + Len);
+        break;
+
       case TCP_OPTION_NOP:
         Cur++;
         break;
@@ -173,6 +173,7 @@ TcpDataToSend (
   UINT32  Len;
   UINT32  Left;
   UINT32  Limit;
+  UINT32  Pipe;
 
   Sk = Tcb->Sk;
   ASSERT (Sk != NULL);
@@ -191,6 +192,24 @@ TcpDataToSend (
     Limit = Tcb->SndUna + Tcb->CWnd;
   }
 
+  //
+  // During the SACK based loss recovery, the data in flight is
+  // the pipe defined in RFC6675 instead of SND.NXT - SND.UNA, as
+  // the SACKed and lost segments have left the network.
+  //
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK) &&
+      (Tcb->CongestState == TCP_CONGEST_RECOVER))
+  {
+    Pipe  = TcpSackPipe (Tcb, Tcb->SndUna);
+    Limit = Tcb->SndWl2 + Tcb->SndWnd;
+
+    if (Pipe >= Tcb->CWnd) {
+      Limit = Tcb->SndNxt;
+    } else if (TCP_SEQ_GT (Limit, Tcb->SndNxt + Tcb->CWnd - Pipe)) {
+      Limit = Tcb->SndNxt + Tcb->CWnd - Pipe;
+    }
+  }
+
   if (TCP_SEQ_GT (Limit, Tcb->SndNxt)) {
     Win = TCP_SUB_SEQ (Limit, Tcb->SndNxt);
   }
@@ -692,6 +711,12 @@ TcpRetransmit (
     Tcb->RetxmitSeqMax = Seq;
   }
 
+  Tcb->StatRetransmit++;
+
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK)) {
+    TcpSackOnXmit (Tcb, Seq, TCPSEG_NETBUF (Nbuf)->End, TRUE);
+  }
+
   //
   // The retransmitted buffer may be on the SndQue,
   // trim TCP head because all the buffers on SndQue
@@ -712,6 +737,69 @@ OnError:
   return -1;
 }
 
+/**
+  Retransmit the segments deemed lost on the SACK scoreboard in
+  sequence order, as long as the pipe is below the congestion
+  window, as specified in RFC6675.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Una     The first unacknowledged sequence number.
+  @param[in]       Force   If TRUE, retransmit the first lost segment
+                           even if the pipe is full.
+
+  @return The number of segments retransmitted.
+
+**/
+INTN
+TcpSackRetransmit (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Una,
+  IN     INTN       Force
+  )
+{
+  LIST_ENTRY  *Entry;
+  TCP_SEG     *Seg;
+  TCP_SEQNO   Seq;
+  UINT32      Pipe;
+  INTN        Sent;
+
+  Pipe = TcpSackPipe (Tcb, Una);
+  Sent = 0;
+
+  NET_LIST_FOR_EACH (Entry, &Tcb->SndQue) {
+    Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+    if (TCP_SEQ_LEQ (Tcb->SndNxt, Seg->Seq)) {
+      break;
+    }
+
+    if (TCP_SEQ_LEQ (Seg->End, Una) ||
+        ((Seg->SackState & (TCP_SEG_SACKED | TCP_SEG_LOST | TCP_SEG_RETRANS)) != TCP_SEG_LOST))
+    {
+      continue;
+    }
+
+    if ((Pipe >= Tcb->CWnd) && ((Force == 0) || (Sent != 0))) {
+      break;
+    }
+
+    Seq = TCP_SEQ_LT (Seg->Seq, Una) ? Una : Seg->Seq;
+
+    //
+    // TcpRetransmit marks the segment retransmitted unless the
+    // send window doesn't allow it to go.
+    //
+    if ((TcpRetransmit (Tcb, Seq) != 0) || !TCP_FLG_ON (Seg->SackState, TCP_SEG_RETRANS)) {
+      break;
+    }
+
+    Pipe += TCP_SUB_SEQ (Seg->End, Seq);
+    Sent++;
+  }
+
+  return Sent;
+}
+
 /**
   Verify that all the segments in SndQue are in good shape.
 
@@ -912,6 +1000,10 @@ TcpToSendData (
 
     NetbufFree (Nbuf);
 
+    if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK)) {
+      TcpSackOnXmit (Tcb, Seq, End, FALSE);
+    }
+
     //
     // Update the status in TCB.
     //
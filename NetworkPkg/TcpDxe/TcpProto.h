@@ -52,6 +52,22 @@
 #define TCP_CONGEST_LOSS     2      ///< Retxmit because of retxmit time out.
 #define TCP_CONGEST_OPEN     3      ///< TCP is opening its congestion window.
 
+//
+// Congestion control algorithms, selected by PcdTcpCongestionControl.
+//
+#define TCP_CONGESTION_NEWRENO  0   ///< RFC5681 slow start and congestion avoidance.
+#define TCP_CONGESTION_CUBIC    1   ///< RFC9438 CUBIC.
+#define TCP_CONGESTION_NUMBER   2   ///< The total number of the algorithms.
+
+//
+// CUBIC constants of RFC9438, scaled by 1024.
+//
+#define TCP_CUBIC_SCALE     1024
+#define TCP_CUBIC_BETA      717        ///< Multiplicative decrease factor, 0.7.
+#define TCP_CUBIC_C         410        ///< Aggressiveness of the window growth, 0.4.
+#define TCP_CUBIC_ALPHA     542        ///< Reno-friendly additive increase, 3 * (1 - 0.7) / (1 + 0.7).
+#define TCP_CUBIC_TIME_MAX  0x1FFFFF   ///< Maximum distance from the plateau, in 1/1024 seconds.
+
 //
 // TCP control flags
 //
@@ -70,6 +86,9 @@
 #define TCP_CTRL_TIMER_ON      0x1000   ///< At least one of the timer is on.
 #define TCP_CTRL_RTT_ON        0x2000   ///< The RTT measurement is on.
 #define TCP_CTRL_ACK_NOW       0x4000   ///< Send the ACK now, don't delay.
+#define TCP_CTRL_NO_SACK       0x8000   ///< Disable selective acknowledgment.
+#define TCP_CTRL_SND_SACK      0x10000  ///< Peer permits SACK, send and process SACK options.
+#define TCP_CTRL_RCV_AUTOTUNE  0x20000  ///< Size the receive buffer from the bandwidth-delay product.
 
 //
 // Timer related values
@@ -80,7 +99,8 @@
 #define TCP_TIMER_KEEPALIVE  3                      ///< Keepalive timer.
 #define TCP_TIMER_FINWAIT2   4                      ///< FIN_WAIT_2 timer.
 #define TCP_TIMER_2MSL       5                      ///< TIME_WAIT timer.
-#define TCP_TIMER_NUMBER     6                      ///< The total number of the TCP timer.
+#define TCP_TIMER_REORDER    6                      ///< RACK reordering window timer.
+#define TCP_TIMER_NUMBER     7                      ///< The total number of the TCP timer.
 #define TCP_TICK             200                    ///< Every TCP tick is 200ms.
 #define TCP_TICK_HZ          5                      ///< The frequence of TCP tick.
 #define TCP_RTT_SHIFT        3                      ///< SRTT & RTTVAR scaled by 8.
@@ -88,6 +108,14 @@
 #define TCP_RTO_MAX          (TCP_TICK_HZ * 60)     ///< The maximum value of RTO.
 #define TCP_FOLD_RTT         4                      ///< Timeout threshold to fold RTT.
 
+//
+// Scoreboard state of a segment on the SndQue, RFC2018 and RFC8985.
+//
+#define TCP_SEG_SACKED       0x01   ///< Selectively acknowledged by the peer.
+#define TCP_SEG_LOST         0x02   ///< Deemed lost, to be retransmitted.
+#define TCP_SEG_RETRANS      0x04   ///< Retransmitted since it was deemed lost.
+#define TCP_SACK_DUP_THRESH  3      ///< Segments SACKed above a hole before reordering is ruled out.
+
 //
 // Default values for some timers
 //
@@ -214,6 +242,13 @@ typedef struct _TCP_SEG {
   UINT8        Flag; ///< TCP header flags.
   UINT16       Urg;  ///< Valid if URG flag is set.
   UINT32       Wnd;  ///< TCP window size field.
+
+  //
+  // Only valid for the segments on the SndQue when SACK is in use.
+  //
+  UINT32       XmitTick;  ///< mTcpTick of the latest transmission.
+  UINT32       XmitCount; ///< Tcb->XmitCount of the latest transmission, orders the segments by send time.
+  UINT8        SackState; ///< Scoreboard state, such as TCP_SEG_SACKED.
 } TCP_SEG;
 
 ///
@@ -226,6 +261,78 @@ typedef struct _TCP_PEER {
 
 typedef struct _TCP_CONTROL_BLOCK TCP_CB;
 
+/**
+  Initialize the private data of a congestion control algorithm,
+  called when the connection is synchronized with its peer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+typedef
+VOID
+(*TCP_CONGESTION_INIT) (
+  IN OUT TCP_CB  *Tcb
+  );
+
+/**
+  Compute the slow start threshold after a loss, detected either by
+  the duplicate ACKs, the SACK scoreboard or the retransmission timer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+  @return The new slow start threshold, in bytes.
+
+**/
+typedef
+UINT32
+(*TCP_CONGESTION_SSTHRESH) (
+  IN OUT TCP_CB  *Tcb
+  );
+
+/**
+  Grow the congestion window when new data is acknowledged and the
+  connection is not in fast recovery.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Acked    The number of bytes newly acknowledged.
+
+**/
+typedef
+VOID
+(*TCP_CONGESTION_AVOID) (
+  IN OUT TCP_CB  *Tcb,
+  IN     UINT32  Acked
+  );
+
+///
+/// A congestion control algorithm.
+///
+typedef struct _TCP_CONGESTION_OPS {
+  CHAR8                      *Name;
+  UINT8                      Algorithm; ///< Its value of PcdTcpCongestionControl.
+  TCP_CONGESTION_INIT        Init;      ///< Optional, may be NULL.
+  TCP_CONGESTION_SSTHRESH    Ssthresh;
+  TCP_CONGESTION_AVOID       CongAvoid;
+} TCP_CONGESTION_OPS;
+
+///
+/// Per connection state of CUBIC.
+///
+typedef struct _TCP_CUBIC {
+  UINT32    EpochStart; ///< mTcpTick when the current epoch started, 0 if none.
+  UINT32    WMax;       ///< Window before the last reduction, in bytes.
+  UINT32    Origin;     ///< Window at the plateau of the cubic function, in bytes.
+  UINT32    K;          ///< Time to reach Origin from EpochStart, in 1/1024 seconds.
+  UINT32    WEst;       ///< Window estimated for Reno in the same conditions, in bytes.
+} TCP_CUBIC;
+
+///
+/// Private data of the congestion control algorithms.
+///
+typedef union {
+  TCP_CUBIC    Cubic;
+} TCP_CONGESTION_DATA;
+
 ///
 /// TCP control block: it includes various states.
 ///
@@ -306,12 +413,42 @@ struct _TCP_CONTROL_BLOCK {
   UINT8               LossTimes;    ///< Number of retxmit timeouts in a row.
   TCP_SEQNO           LossRecover;  ///< Recover point for retxmit.
 
+  TCP_CONGESTION_OPS     *CongestOps;  ///< The congestion control algorithm.
+  TCP_CONGESTION_DATA    CongestData;  ///< The private data of the algorithm.
+
   //
   // RFC7323
   // Addressing Window Retraction for TCP Window Scale Option.
   //
   TCP_SEQNO           RetxmitSeqMax;     ///< Max Seq number in previous retransmission.
 
+  //
+  // RFC2018 selective acknowledgment, RFC6675 SACK based loss
+  // recovery and RFC8985 RACK time based loss detection.
+  //
+  TCP_SEQNO           SackRecent;    ///< Seq of the latest segment queued on RcvQue, reported first.
+  UINT32              SackedOut;     ///< Number of segments on the SndQue SACKed by the peer.
+  UINT32              XmitCount;     ///< Number of transmissions, stamped on the SndQue segments.
+  UINT32              RackXmitCount; ///< XmitCount of the most recently sent segment delivered.
+  UINT32              RackRtt;       ///< RTT of that segment, in heartbeats.
+
+  //
+  // Receive buffer auto-tuning.
+  //
+  TCP_SEQNO           RcvSpaceSeq;  ///< RcvNxt when the current measurement started.
+  UINT32              RcvSpaceTick; ///< mTcpTick when the current measurement started.
+
+  //
+  // Statistics, returned by EDKII_TCP_STATISTICS_PROTOCOL.
+  //
+  UINT32              StatStartTick;  ///< mTcpTick when the connection was established.
+  UINT32              StatEndTick;    ///< mTcpTick when the connection was closed.
+  UINT64              StatBytesAcked; ///< Bytes sent and acknowledged by the peer.
+  UINT64              StatBytesRcvd;  ///< Bytes received in sequence.
+  UINT32              StatRetransmit; ///< Number of segments retransmitted.
+  UINT32              StatCongestion; ///< Number of congestion events.
+  UINT32              StatCWndMax;    ///< The largest congestion window.
+
   //
   // configuration parameters, for EFI_TCP4_PROTOCOL specification
   //
@@ -0,0 +1,427 @@
+/** @file
+  TCP selective acknowledgment and loss detection routines.
+
+  The SACK scoreboard lives on the SndQue: every queued segment records
+  whether the peer has SACKed it, whether it is deemed lost and whether
+  it has been retransmitted since. Losses are detected by RACK (RFC8985):
+  a segment is lost once a segment sent after it has been delivered and
+  a reordering window has passed. Loss recovery follows RFC6675, which
+  limits the data in flight by the pipe instead of SND.NXT - SND.UNA.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "TcpMain.h"
+
+/**
+  Stamp the segments on the SndQue covered by a transmission.
+
+  @param[in, out]  Tcb         Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Seq         The first sequence number transmitted.
+  @param[in]       End         The sequence number following the last one transmitted.
+  @param[in]       Retransmit  TRUE if this is a retransmission.
+
+**/
+VOID
+TcpSackOnXmit (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Seq,
+  IN     TCP_SEQNO  End,
+  IN     BOOLEAN    Retransmit
+  )
+{
+  LIST_ENTRY  *Entry;
+  TCP_SEG     *Seg;
+
+  Tcb->XmitCount++;
+
+  //
+  // New data is at the tail of the SndQue, while the
+  // retransmitted data is usually close to the head.
+  //
+  if (Retransmit) {
+    for (Entry = Tcb->SndQue.ForwardLink; Entry != &Tcb->SndQue; Entry = Entry->ForwardLink) {
+      Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+      if (TCP_SEQ_LEQ (End, Seg->Seq)) {
+        break;
+      }
+
+      if (TCP_SEQ_LT (Seq, Seg->End)) {
+        Seg->XmitTick  = mTcpTick;
+        Seg->XmitCount = Tcb->XmitCount;
+
+        if (TCP_FLG_ON (Seg->SackState, TCP_SEG_LOST)) {
+          TCP_SET_FLG (Seg->SackState, TCP_SEG_RETRANS);
+        }
+      }
+    }
+  } else {
+    for (Entry = Tcb->SndQue.BackLink; Entry != &Tcb->SndQue; Entry = Entry->BackLink) {
+      Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+      if (TCP_SEQ_LEQ (Seg->End, Seq)) {
+        break;
+      }
+
+      if (TCP_SEQ_LT (Seg->Seq, End)) {
+        Seg->XmitTick  = mTcpTick;
+        Seg->XmitCount = Tcb->XmitCount;
+      }
+    }
+  }
+}
+
+/**
+  Compute the pipe defined in RFC6675, that is the number of bytes
+  that are still in the network.
+
+  The segments SACKed or deemed lost have left the network, and the
+  retransmitted ones are in the network once more.
+
+  @param[in]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]  Una     The first unacknowledged sequence number.
+
+  @return The number of bytes in flight.
+
+**/
+UINT32
+TcpSackPipe (
+  IN TCP_CB     *Tcb,
+  IN TCP_SEQNO  Una
+  )
+{
+  LIST_ENTRY  *Entry;
+  TCP_SEG     *Seg;
+  TCP_SEQNO   Seq;
+  UINT32      Len;
+  UINT32      Pipe;
+
+  Pipe = 0;
+
+  NET_LIST_FOR_EACH (Entry, &Tcb->SndQue) {
+    Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+    if (TCP_SEQ_LEQ (Tcb->SndNxt, Seg->Seq)) {
+      break;
+    }
+
+    if (TCP_SEQ_LEQ (Seg->End, Una) || TCP_FLG_ON (Seg->SackState, TCP_SEG_SACKED)) {
+      continue;
+    }
+
+    Seq = TCP_SEQ_LT (Seg->Seq, Una) ? Una : Seg->Seq;
+    Len = TCP_SUB_SEQ (Seg->End, Seq);
+
+    if (!TCP_FLG_ON (Seg->SackState, TCP_SEG_LOST)) {
+      Pipe += Len;
+    }
+
+    if (TCP_FLG_ON (Seg->SackState, TCP_SEG_RETRANS)) {
+      Pipe += Len;
+    }
+  }
+
+  return Pipe;
+}
+
+/**
+  Update the RACK state with a segment newly delivered to the peer.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Seg     The segment that is SACKed or cumulatively ACKed.
+
+**/
+VOID
+TcpRackUpdate (
+  IN OUT TCP_CB   *Tcb,
+  IN     TCP_SEG  *Seg
+  )
+{
+  //
+  // Without timestamps there is no telling which transmission
+  // of a retransmitted segment is delivered, skip it.
+  //
+  if ((Seg->XmitCount == 0) || TCP_FLG_ON (Seg->SackState, TCP_SEG_RETRANS)) {
+    return;
+  }
+
+  if (TCP_TIME_LT (Tcb->RackXmitCount, Seg->XmitCount)) {
+    Tcb->RackXmitCount = Seg->XmitCount;
+    Tcb->RackRtt       = TCP_SUB_TIME (mTcpTick, Seg->XmitTick);
+  }
+}
+
+/**
+  Detect the lost segments with RACK as specified in RFC8985.
+
+  A segment is deemed lost if a segment sent after it has been
+  delivered, and the RTT of that segment plus a reordering window
+  has passed since the segment was sent. If some segments are still
+  in their reordering window, the reordering timer is set to check
+  them again later.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Ack     The cumulative acknowledgment.
+
+  @return The number of segments newly deemed lost.
+
+**/
+UINT32
+TcpRackDetectLoss (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Ack
+  )
+{
+  LIST_ENTRY  *Entry;
+  TCP_SEG     *Seg;
+  UINT32      ReoWnd;
+  UINT32      Elapsed;
+  UINT32      Wait;
+  UINT32      Lost;
+
+  //
+  // No reordering window once in recovery or enough segments are
+  // SACKed above the hole, otherwise a quarter of the smoothed RTT.
+  //
+  if ((Tcb->CongestState == TCP_CONGEST_RECOVER) || (Tcb->SackedOut >= TCP_SACK_DUP_THRESH)) {
+    ReoWnd = 0;
+  } else {
+    ReoWnd = MAX (1, Tcb->SRtt >> (TCP_RTT_SHIFT + 2));
+  }
+
+  Wait = 0;
+  Lost = 0;
+
+  NET_LIST_FOR_EACH (Entry, &Tcb->SndQue) {
+    Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+    if (TCP_SEQ_LEQ (Seg->End, Ack) ||
+        (Seg->XmitCount == 0) ||
+        TCP_FLG_ON (Seg->SackState, TCP_SEG_SACKED) ||
+        ((Seg->SackState & (TCP_SEG_LOST | TCP_SEG_RETRANS)) == TCP_SEG_LOST) ||
+        !TCP_TIME_LT (Seg->XmitCount, Tcb->RackXmitCount))
+    {
+      continue;
+    }
+
+    Elapsed = TCP_SUB_TIME (mTcpTick, Seg->XmitTick);
+
+    if (Elapsed >= Tcb->RackRtt + ReoWnd) {
+      Seg->SackState = TCP_SEG_LOST;
+      Lost++;
+    } else {
+      Wait = MAX (Wait, Tcb->RackRtt + ReoWnd - Elapsed);
+    }
+  }
+
+  if (Wait != 0) {
+    TcpSetTimer (Tcb, TCP_TIMER_REORDER, Wait);
+  } else if (TCP_TIMER_ON (Tcb->EnabledTimer, TCP_TIMER_REORDER)) {
+    TcpClearTimer (Tcb, TCP_TIMER_REORDER);
+  }
+
+  if (Lost != 0) {
+    DEBUG (
+      (DEBUG_NET,
+       "TcpRackDetectLoss: %d segments deemed lost for TCB %p\n",
+       Lost,
+       Tcb)
+      );
+  }
+
+  return Lost;
+}
+
+/**
+  Update the SACK scoreboard with an incoming ACK and detect the
+  lost segments.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Ack     The acknowledgment number of the incoming segment.
+  @param[in]       Option  The options of the incoming segment.
+
+  @return The number of segments newly deemed lost.
+
+**/
+UINT32
+TcpSackUpdate (
+  IN OUT TCP_CB      *Tcb,
+  IN     TCP_SEQNO   Ack,
+  IN     TCP_OPTION  *Option
+  )
+{
+  TCP_SACK_BLOCK  Block[TCP_OPTION_MAX_SACK_BLOCK];
+  LIST_ENTRY      *Entry;
+  TCP_SEG         *Seg;
+  TCP_SEQNO       MaxSndNxt;
+  UINT8           Count;
+  UINT8           Index;
+  UINT32          Lost;
+
+  //
+  // Only keep the blocks above the cumulative ACK and within the data
+  // sent, the others are either D-SACK or bogus.
+  //
+  Count     = 0;
+  MaxSndNxt = TcpGetMaxSndNxt (Tcb);
+
+  for (Index = 0; Index < Option->SackCount; Index++) {
+    if (TCP_SEQ_LT (Option->Sack[Index].Left, Option->Sack[Index].Right) &&
+        TCP_SEQ_LT (Ack, Option->Sack[Index].Right) &&
+        TCP_SEQ_LEQ (Option->Sack[Index].Right, MaxSndNxt))
+    {
+      Block[Count] = Option->Sack[Index];
+      if (TCP_SEQ_LT (Block[Count].Left, Ack)) {
+        Block[Count].Left = Ack;
+      }
+
+      Count++;
+    }
+  }
+
+  //
+  // Fast path: nothing is SACKed and nothing seems lost.
+  //
+  if ((Count == 0) &&
+      (Tcb->SackedOut == 0) &&
+      (Tcb->CongestState == TCP_CONGEST_OPEN) &&
+      (Tcb->DupAck < TCP_SACK_DUP_THRESH))
+  {
+    return 0;
+  }
+
+  NET_LIST_FOR_EACH (Entry, &Tcb->SndQue) {
+    Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+    if (TCP_SEQ_LEQ (Seg->End, Ack)) {
+      if (!TCP_FLG_ON (Seg->SackState, TCP_SEG_SACKED)) {
+        TcpRackUpdate (Tcb, Seg);
+      }
+
+      continue;
+    }
+
+    if (TCP_FLG_ON (Seg->SackState, TCP_SEG_SACKED)) {
+      continue;
+    }
+
+    for (Index = 0; Index < Count; Index++) {
+      if (TCP_SEQ_LEQ (Block[Index].Left, Seg->Seq) && TCP_SEQ_LEQ (Seg->End, Block[Index].Right)) {
+        TcpRackUpdate (Tcb, Seg);
+
+        Seg->SackState = TCP_SEG_SACKED;
+        Tcb->SackedOut++;
+        break;
+      }
+    }
+  }
+
+  Lost = 0;
+
+  //
+  // The peer sends duplicate ACKs without SACK blocks, fall back
+  // to deeming the first segment lost after three of them.
+  //
+  if ((Tcb->SackedOut == 0) &&
+      (Tcb->DupAck >= TCP_SACK_DUP_THRESH) &&
+      !IsListEmpty (&Tcb->SndQue))
+  {
+    Seg = TCPSEG_NETBUF (NET_LIST_HEAD (&Tcb->SndQue, NET_BUF, List));
+
+    if (Seg->SackState == 0) {
+      Seg->SackState = TCP_SEG_LOST;
+      Lost++;
+    }
+  }
+
+  return Lost + TcpRackDetectLoss (Tcb, Ack);
+}
+
+/**
+  Update the SACK scoreboard on a retransmission timeout.
+
+  All the segments not SACKed are deemed lost. The SACKed ones are
+  kept, but the timeout always retransmits the first segment so that
+  a peer discarding the SACKed data can not stall the connection.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpSackOnRto (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  LIST_ENTRY  *Entry;
+  TCP_SEG     *Seg;
+
+  NET_LIST_FOR_EACH (Entry, &Tcb->SndQue) {
+    Seg = TCPSEG_NETBUF (NET_LIST_USER_STRUCT (Entry, NET_BUF, List));
+
+    if (!TCP_FLG_ON (Seg->SackState, TCP_SEG_SACKED)) {
+      Seg->SackState = TCP_SEG_LOST;
+    }
+  }
+
+  if (TCP_TIMER_ON (Tcb->EnabledTimer, TCP_TIMER_REORDER)) {
+    TcpClearTimer (Tcb, TCP_TIMER_REORDER);
+  }
+}
+
+/**
+  SACK based loss recovery defined in RFC6675.
+
+  Enter the recovery when some segments are deemed lost, retransmit
+  the lost segments as the pipe allows during the recovery, and exit
+  it once all the data outstanding when it was entered is ACKed.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Ack     The cumulative acknowledgment.
+
+**/
+VOID
+TcpSackRecover (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Ack
+  )
+{
+  UINT32  FlightSize;
+
+  if (Tcb->CongestState != TCP_CONGEST_RECOVER) {
+    TcpCongestionEvent (Tcb);
+    Tcb->CWnd    = Tcb->Ssthresh;
+    Tcb->Recover = Tcb->SndNxt;
+
+    Tcb->CongestState = TCP_CONGEST_RECOVER;
+    TCP_CLEAR_FLG (Tcb->CtrlFlag, TCP_CTRL_RTT_ON);
+
+    DEBUG (
+      (DEBUG_NET,
+       "TcpSackRecover: enter SACK recovery for TCB %p, recover point is %d\n",
+       Tcb,
+       Tcb->Recover)
+      );
+
+    TcpSackRetransmit (Tcb, Ack, 1);
+    return;
+  }
+
+  if (TCP_SEQ_GEQ (Ack, Tcb->Recover)) {
+    FlightSize = TCP_SUB_SEQ (Tcb->SndNxt, Ack);
+
+    Tcb->CWnd         = MIN (Tcb->Ssthresh, FlightSize + Tcb->SndMss);
+    Tcb->CongestState = TCP_CONGEST_OPEN;
+
+    DEBUG (
+      (DEBUG_NET,
+       "TcpSackRecover: received a full ACK(%d) for TCB %p, exit SACK recovery\n",
+       Ack,
+       Tcb)
+      );
+    return;
+  }
+
+  TcpSackRetransmit (Tcb, Ack, 0);
+}
@@ -77,6 +77,17 @@ Tcp2MSLTimeout (
   IN OUT TCP_CB  *Tcb
   );
 
+/**
+  Timeout handler for RACK reordering window timer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpReorderTimeout (
+  IN OUT TCP_CB  *Tcb
+  );
+
 TCP_TIMER_HANDLER  mTcpTimerHandler[TCP_TIMER_NUMBER] = {
   TcpConnectTimeout,
   TcpRexmitTimeout,
@@ -84,6 +95,7 @@ TCP_TIMER_HANDLER  mTcpTimerHandler[TCP_TIMER_NUMBER] = {
   TcpKeepaliveTimeout,
   TcpFinwait2Timeout,
   Tcp2MSLTimeout,
+  TcpReorderTimeout,
 };
 
 /**
@@ -180,8 +192,6 @@ TcpRexmitTimeout (
   IN OUT TCP_CB  *Tcb
   )
 {
-  UINT32  FlightSize;
-
   DEBUG (
     (DEBUG_WARN,
      "TcpRexmitTimeout: transmission timeout for TCB %p\n",
@@ -189,12 +199,10 @@ TcpRexmitTimeout (
     );
 
   //
-  // Set the congestion window. FlightSize is the
-  // amount of data that has been sent but not
-  // yet ACKed.
+  // Set the congestion window, the slow start
+  // threshold is left to the congestion control.
   //
-  FlightSize    = TCP_SUB_SEQ (Tcb->SndNxt, Tcb->SndUna);
-  Tcb->Ssthresh = MAX ((UINT32)(2 * Tcb->SndMss), FlightSize / 2);
+  TcpCongestionEvent (Tcb);
 
   Tcb->CWnd        = Tcb->SndMss;
   Tcb->LossRecover = Tcb->SndNxt;
@@ -216,6 +224,11 @@ TcpRexmitTimeout (
   }
 
   TcpBackoffRto (Tcb);
+
+  if (TCP_FLG_ON (Tcb->CtrlFlag, TCP_CTRL_SND_SACK)) {
+    TcpSackOnRto (Tcb);
+  }
+
   TcpRetransmit (Tcb, Tcb->SndUna);
   TcpSetTimer (Tcb, TCP_TIMER_REXMIT, Tcb->Rto);
 
@@ -320,6 +333,32 @@ Tcp2MSLTimeout (
   TcpClose (Tcb);
 }
 
+/**
+  Timeout handler for RACK reordering window timer.
+
+  Some segments were sent before a delivered one, but were still in
+  their reordering window. Check them again and retransmit those
+  deemed lost now.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpReorderTimeout (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  if (TcpRackDetectLoss (Tcb, Tcb->SndUna) == 0) {
+    return;
+  }
+
+  if (Tcb->CongestState == TCP_CONGEST_LOSS) {
+    TcpSackRetransmit (Tcb, Tcb->SndUna, 0);
+  } else {
+    TcpSackRecover (Tcb, Tcb->SndUna);
+  }
+}
+
 /**
   Update the timer status and the next expire time according to the timers
   to expire in a specific future time slot.
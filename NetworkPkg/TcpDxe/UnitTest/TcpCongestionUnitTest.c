@@ -0,0 +1,1015 @@
+/** @file
+  Host-based unit tests for the congestion control and the receive buffer
+  auto-tuning of the TCP driver.
+
+  A client and a server TCP_CB exchange segments over a link with a fixed
+  delay and a bottleneck that forwards a fixed number of segments per
+  heartbeat and drops the segments its queue cannot hold. The client sends
+  a byte pattern that the server checks as it is delivered.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../TcpMain.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "TCP Congestion Control Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_CLIENT_IP    1
+#define TEST_SERVER_IP    2
+#define TEST_CLIENT_PORT  1000
+#define TEST_SERVER_PORT  80
+
+#define TEST_MAX_PACKET_SIZE  1480
+#define TEST_QUEUE_SIZE       0x10000
+#define TEST_MAX_TICKS        20000
+#define TEST_SEND_CHUNK       0x10000
+#define TEST_SEND_QUEUED      (8 * 1024 * 1024)
+#define TEST_WINDOW           65535
+
+#define TEST_TO_SERVER  0
+#define TEST_TO_CLIENT  1
+
+//
+// The link of the bandwidth-delay product tests: 300 segments per heartbeat
+// and 3 heartbeats of delay each way, about 2.6 MB in flight.
+//
+#define TEST_BDP_DELAY  3
+#define TEST_BDP_RATE   300
+#define TEST_BDP        (2 * TEST_BDP_DELAY * TEST_BDP_RATE * (TEST_MAX_PACKET_SIZE - sizeof (TCP_HEAD)))
+
+typedef struct {
+  UINT8             *Data;
+  UINT32            Length;
+  EFI_IP_ADDRESS    Src;
+  EFI_IP_ADDRESS    Dst;
+  UINT32            Due;        ///< mTcpTick when the packet arrives.
+} TEST_PACKET;
+
+typedef struct {
+  TEST_PACKET    Packets[TEST_QUEUE_SIZE];
+  UINT32         Head;
+  UINT32         Tail;
+} TEST_QUEUE;
+
+typedef struct {
+  UINT32    Delay;          ///< One-way delay, in heartbeats.
+  UINT32    Rate;           ///< Segments the bottleneck forwards per heartbeat.
+  UINT32    QueueLimit;     ///< Segments the bottleneck queues.
+  UINT32    LossPpm;        ///< Random loss of data segments, in parts per million.
+  UINT32    *Drops;         ///< Numbers of the new data segments to drop, from 1.
+  UINTN     DropCount;
+} TEST_LINK;
+
+typedef struct {
+  UINT32                  Ticks;
+  UINT32                  QueueDrops;
+  EDKII_TCP_STATISTICS    Sender;
+  EDKII_TCP_STATISTICS    Receiver;
+} TEST_RESULT;
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+EFI_BOOT_SERVICES         *gBS = &mBootServices;
+
+STATIC TCP_SERVICE_DATA  mService;
+STATIC IP_IO             mIpIo;
+STATIC EFI_IP4_PROTOCOL  mIp4;
+STATIC IP_IO_IP_INFO     mIpInfo;
+
+STATIC TEST_LINK   *mLink;
+STATIC TEST_QUEUE  mQueues[2];
+STATIC UINT64      mSlot;
+STATIC UINT32      mQueueDrops;
+STATIC UINT32      mSeed;
+STATIC UINT32      mNewSegments;
+STATIC TCP_SEQNO   mMaxSeq;
+STATIC UINT32      mReceived;
+STATIC BOOLEAN     mCorrupted;
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  VOID
+  )
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return (mSeed >> 8);
+}
+
+/**
+  Free a buffer of the NET_BUF library.
+
+  @param[in]  Buffer  The buffer to free.
+
+  @retval EFI_SUCCESS   The buffer is freed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestFreePool (
+  IN VOID  *Buffer
+  )
+{
+  FreePool (Buffer);
+  return EFI_SUCCESS;
+}
+
+/**
+  Get a byte of the data sent by the client.
+
+  @param[in]  Offset   The offset of the byte in the stream.
+
+  @return The value of the byte.
+
+**/
+STATIC
+UINT8
+TestPattern (
+  IN UINT32  Offset
+  )
+{
+  return (UINT8)(Offset * 7 + Offset / 251);
+}
+
+UINT32
+EFIAPI
+NetGetUint32 (
+  IN UINT8  *Buf
+  )
+{
+  return SwapBytes32 (ReadUnaligned32 ((UINT32 *)Buf));
+}
+
+VOID
+EFIAPI
+NetPutUint32 (
+  IN OUT UINT8   *Buf,
+  IN     UINT32  Data
+  )
+{
+  WriteUnaligned32 ((UINT32 *)Buf, SwapBytes32 (Data));
+}
+
+LIST_ENTRY *
+EFIAPI
+NetListRemoveHead (
+  IN OUT LIST_ENTRY  *Head
+  )
+{
+  LIST_ENTRY  *First;
+
+  if (IsListEmpty (Head)) {
+    return NULL;
+  }
+
+  First = Head->ForwardLink;
+  RemoveEntryList (First);
+  return First;
+}
+
+VOID
+EFIAPI
+NetLibCreateIPv4DPathNode (
+  IN OUT IPv4_DEVICE_PATH  *Node,
+  IN EFI_HANDLE            Controller,
+  IN IP4_ADDR              LocalIp,
+  IN UINT16                LocalPort,
+  IN IP4_ADDR              RemoteIp,
+  IN UINT16                RemotePort,
+  IN UINT16                Protocol,
+  IN BOOLEAN               UseDefaultAddress
+  )
+{
+  ZeroMem (Node, sizeof (*Node));
+}
+
+VOID
+EFIAPI
+NetLibCreateIPv6DPathNode (
+  IN OUT IPv6_DEVICE_PATH  *Node,
+  IN EFI_HANDLE            Controller,
+  IN EFI_IPv6_ADDRESS      *LocalIp,
+  IN UINT16                LocalPort,
+  IN EFI_IPv6_ADDRESS      *RemoteIp,
+  IN UINT16                RemotePort,
+  IN UINT16                Protocol
+  )
+{
+  ZeroMem (Node, sizeof (*Node));
+}
+
+/**
+  The accepted connections of the tests have no device path.
+
+  @param[in]  FirstDevicePath   Unused.
+  @param[in]  DevicePathNode    Unused.
+
+  @return NULL.
+
+**/
+EFI_DEVICE_PATH_PROTOCOL *
+EFIAPI
+AppendDevicePathNode (
+  IN CONST EFI_DEVICE_PATH_PROTOCOL  *FirstDevicePath   OPTIONAL,
+  IN CONST EFI_DEVICE_PATH_PROTOCOL  *DevicePathNode    OPTIONAL
+  )
+{
+  return NULL;
+}
+
+EFI_STATUS
+EFIAPI
+QueueDpc (
+  IN EFI_TPL            DpcTpl,
+  IN EFI_DPC_PROCEDURE  DpcProcedure,
+  IN VOID               *DpcContext    OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+Tcp6RefreshNeighbor (
+  IN TCP_CB          *Tcb,
+  IN EFI_IP_ADDRESS  *Neighbor,
+  IN UINT32          Timeout
+  )
+{
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+IpIoGetIcmpErrStatus (
+  IN  UINT8    IcmpError,
+  IN  UINT8    IpVersion,
+  OUT BOOLEAN  *IsHard     OPTIONAL,
+  OUT BOOLEAN  *Notify     OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+VOID
+SockConnEstablished (
+  IN OUT SOCKET  *Sock
+  )
+{
+}
+
+VOID
+SockConnClosed (
+  IN OUT SOCKET  *Sock
+  )
+{
+}
+
+VOID
+SockNoMoreData (
+  IN OUT SOCKET  *Sock
+  )
+{
+}
+
+/**
+  Check the data delivered to the server against the pattern. The
+  application consumes it at once, so the receive window never closes.
+
+  @param[in, out]  Sock       The socket of the server.
+  @param[in, out]  NetBuffer  The data delivered in sequence.
+  @param[in]       UrgLen     Unused.
+
+**/
+VOID
+SockDataRcvd (
+  IN OUT SOCKET   *Sock,
+  IN OUT NET_BUF  *NetBuffer,
+  IN     UINT32   UrgLen
+  )
+{
+  UINT8   *Data;
+  UINT32  Index;
+
+  Data = AllocatePool (NetBuffer->TotalSize);
+  ASSERT (Data != NULL);
+  NetbufCopy (NetBuffer, 0, NetBuffer->TotalSize, Data);
+
+  for (Index = 0; Index < NetBuffer->TotalSize; Index++) {
+    if (Data[Index] != TestPattern (mReceived + Index)) {
+      mCorrupted = TRUE;
+    }
+  }
+
+  mReceived += NetBuffer->TotalSize;
+  FreePool (Data);
+}
+
+UINT32
+SockGetFreeSpace (
+  IN SOCKET  *Sock,
+  IN UINT32  Which
+  )
+{
+  SOCK_BUFFER  *Buffer;
+
+  Buffer = (Which == SOCK_SND_BUF) ? &Sock->SndBuffer : &Sock->RcvBuffer;
+  return Buffer->HighWater - Buffer->DataQueue->BufSize;
+}
+
+UINT32
+SockGetDataToSend (
+  IN  SOCKET  *Sock,
+  IN  UINT32  Offset,
+  IN  UINT32  Len,
+  OUT UINT8   *Dest
+  )
+{
+  return NetbufQueCopy (Sock->SndBuffer.DataQueue, Offset, Len, Dest);
+}
+
+VOID
+SockDataSent (
+  IN OUT SOCKET  *Sock,
+  IN     UINT32  Count
+  )
+{
+  NetbufQueTrim (Sock->SndBuffer.DataQueue, Count);
+}
+
+/**
+  Return the maximum packet size of the link.
+
+  @param[in]   This          Unused.
+  @param[out]  Ip4ModeData   The mode data.
+  @param[out]  MnpConfigData Unused.
+  @param[out]  SnpModeData   Unused.
+
+  @retval EFI_SUCCESS   The mode data is returned.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestIp4GetModeData (
+  IN  CONST EFI_IP4_PROTOCOL         *This,
+  OUT EFI_IP4_MODE_DATA              *Ip4ModeData     OPTIONAL,
+  OUT EFI_MANAGED_NETWORK_CONFIG_DATA  *MnpConfigData   OPTIONAL,
+  OUT EFI_SIMPLE_NETWORK_MODE        *SnpModeData     OPTIONAL
+  )
+{
+  Ip4ModeData->MaxPacketSize = TEST_MAX_PACKET_SIZE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Create a socket of the test service.
+
+  @return The socket.
+
+**/
+STATIC
+SOCKET *
+CreateSocket (
+  VOID
+  )
+{
+  SOCKET  *Sock;
+
+  Sock = AllocateZeroPool (sizeof (SOCKET));
+  ASSERT (Sock != NULL);
+
+  Sock->SndBuffer.DataQueue = NetbufQueAlloc ();
+  Sock->RcvBuffer.DataQueue = NetbufQueAlloc ();
+  Sock->SndBuffer.HighWater = 2 * TEST_SEND_QUEUED;
+  Sock->RcvBuffer.HighWater = TEST_WINDOW;
+  Sock->IpVersion           = IP_VERSION_4;
+
+  ((TCP_PROTO_DATA *)Sock->ProtoReserved)->TcpService = &mService;
+  return Sock;
+}
+
+SOCKET *
+SockClone (
+  IN SOCKET  *Sock
+  )
+{
+  return CreateSocket ();
+}
+
+/**
+  Send a segment over the link.
+
+  The data segments from the client go through the bottleneck, which drops
+  them when its queue is full, at random with TEST_LINK.LossPpm, or when
+  they are listed in TEST_LINK.Drops.
+
+  @param[in]  Tcb       The TCP_CB of the sender.
+  @param[in]  Nbuf      The segment.
+  @param[in]  Src       The source address.
+  @param[in]  Dest      The destination address.
+  @param[in]  Version   IP_VERSION_4.
+
+  @return 0, the segment is always sent.
+
+**/
+INTN
+TcpSendIpPacket (
+  IN TCP_CB          *Tcb,
+  IN NET_BUF         *Nbuf,
+  IN EFI_IP_ADDRESS  *Src,
+  IN EFI_IP_ADDRESS  *Dest,
+  IN UINT8           Version
+  )
+{
+  TEST_QUEUE   *Queue;
+  TEST_PACKET  *Packet;
+  TCP_HEAD     *Head;
+  UINT8        *Data;
+  UINT32       Length;
+  UINT32       DataLength;
+  UINT32       Due;
+  UINT64       Now;
+  UINTN        Index;
+
+  Length = Nbuf->TotalSize;
+  Data   = AllocatePool (Length);
+  ASSERT (Data != NULL);
+  NetbufCopy (Nbuf, 0, Length, Data);
+
+  Head       = (TCP_HEAD *)Data;
+  DataLength = Length - (Head->HeadLen << 2);
+
+  if (Src->Addr[0] == TEST_CLIENT_IP) {
+    Queue = &mQueues[TEST_TO_SERVER];
+
+    if ((DataLength > 0) && TCP_SEQ_GEQ (NTOHL (Head->Seq), mMaxSeq)) {
+      mMaxSeq = NTOHL (Head->Seq) + DataLength;
+      mNewSegments++;
+
+      for (Index = 0; Index < mLink->DropCount; Index++) {
+        if (mLink->Drops[Index] == mNewSegments) {
+          FreePool (Data);
+          return 0;
+        }
+      }
+    }
+
+    Now = MultU64x32 (mTcpTick, mLink->Rate);
+    if (mSlot < Now) {
+      mSlot = Now;
+    }
+
+    if (mSlot - Now >= mLink->QueueLimit) {
+      mQueueDrops++;
+      FreePool (Data);
+      return 0;
+    }
+
+    Due = (UINT32)DivU64x32 (mSlot, mLink->Rate) + mLink->Delay;
+    mSlot++;
+
+    if ((DataLength > 0) && (NextRandom () % 1000000 < mLink->LossPpm)) {
+      FreePool (Data);
+      return 0;
+    }
+  } else {
+    Queue = &mQueues[TEST_TO_CLIENT];
+    Due   = mTcpTick + mLink->Delay;
+  }
+
+  ASSERT (((Queue->Tail + 1) % TEST_QUEUE_SIZE) != Queue->Head);
+
+  Packet         = &Queue->Packets[Queue->Tail];
+  Packet->Data   = Data;
+  Packet->Length = Length;
+  Packet->Due    = Due;
+  CopyMem (&Packet->Src, Src, sizeof (EFI_IP_ADDRESS));
+  CopyMem (&Packet->Dst, Dest, sizeof (EFI_IP_ADDRESS));
+  Queue->Tail = (Queue->Tail + 1) % TEST_QUEUE_SIZE;
+
+  return 0;
+}
+
+/**
+  Deliver the segments that have arrived, including those sent in response.
+
+**/
+STATIC
+VOID
+DeliverPackets (
+  VOID
+  )
+{
+  TEST_QUEUE   *Queue;
+  TEST_PACKET  Packet;
+  NET_BUF      *Nbuf;
+  BOOLEAN      More;
+  UINTN        Index;
+
+  do {
+    More = FALSE;
+    for (Index = 0; Index < ARRAY_SIZE (mQueues); Index++) {
+      Queue = &mQueues[Index];
+      while ((Queue->Head != Queue->Tail) && TCP_TIME_LEQ (Queue->Packets[Queue->Head].Due, mTcpTick)) {
+        CopyMem (&Packet, &Queue->Packets[Queue->Head], sizeof (Packet));
+        Queue->Head = (Queue->Head + 1) % TEST_QUEUE_SIZE;
+
+        Nbuf = NetbufAlloc (Packet.Length);
+        ASSERT (Nbuf != NULL);
+        CopyMem (NetbufAllocSpace (Nbuf, Packet.Length, NET_BUF_TAIL), Packet.Data, Packet.Length);
+        FreePool (Packet.Data);
+
+        TcpInput (Nbuf, &Packet.Src, &Packet.Dst, IP_VERSION_4);
+        More = TRUE;
+      }
+    }
+  } while (More);
+}
+
+/**
+  Drop the segments still on the link.
+
+**/
+STATIC
+VOID
+FreePackets (
+  VOID
+  )
+{
+  TEST_QUEUE  *Queue;
+  UINTN       Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (mQueues); Index++) {
+    Queue = &mQueues[Index];
+    while (Queue->Head != Queue->Tail) {
+      FreePool (Queue->Packets[Queue->Head].Data);
+      Queue->Head = (Queue->Head + 1) % TEST_QUEUE_SIZE;
+    }
+  }
+}
+
+/**
+  Create a TCP_CB the way the TCP driver configures one.
+
+  @param[in]  Ip          The local address.
+  @param[in]  Port        The local port.
+  @param[in]  Sack        TRUE to use SACK.
+  @param[in]  AutoTune    TRUE to auto-tune the receive buffer.
+  @param[in]  Algorithm   The congestion control algorithm.
+
+  @return The TCP_CB.
+
+**/
+STATIC
+TCP_CB *
+CreateTcb (
+  IN UINT32   Ip,
+  IN UINT16   Port,
+  IN BOOLEAN  Sack,
+  IN BOOLEAN  AutoTune,
+  IN UINT8    Algorithm
+  )
+{
+  TCP_CB  *Tcb;
+
+  Tcb = AllocateZeroPool (sizeof (TCP_CB));
+  ASSERT (Tcb != NULL);
+
+  InitializeListHead (&Tcb->List);
+  InitializeListHead (&Tcb->SndQue);
+  InitializeListHead (&Tcb->RcvQue);
+
+  Tcb->Sk                                                = CreateSocket ();
+  ((TCP_PROTO_DATA *)Tcb->Sk->ProtoReserved)->TcpPcb = Tcb;
+  Tcb->IpInfo                                            = &mIpInfo;
+
+  Tcb->CtrlFlag = TCP_CTRL_NO_KEEPALIVE | TCP_CTRL_NO_NAGLE;
+  if (!Sack) {
+    TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_NO_SACK);
+  }
+
+  if (AutoTune) {
+    TCP_SET_FLG (Tcb->CtrlFlag, TCP_CTRL_RCV_AUTOTUNE);
+  }
+
+  Tcb->State           = TCP_CLOSED;
+  Tcb->CongestState    = TCP_CONGEST_OPEN;
+  Tcb->CongestOps      = mTcpCongestionOps[Algorithm];
+  Tcb->SndMss          = 536;
+  Tcb->RcvMss          = TcpGetRcvMss (Tcb->Sk);
+  Tcb->Rto             = 3 * TCP_TICK_HZ;
+  Tcb->CWnd            = Tcb->SndMss;
+  Tcb->Ssthresh        = 0xffffffff;
+  Tcb->MaxRexmit       = TCP_MAX_LOSS;
+  Tcb->ConnectTimeout  = TCP_CONNECT_TIME;
+  Tcb->FinWait2Timeout = TCP_FIN_WAIT2_TIME;
+  Tcb->TimeWaitTimeout = TCP_TIME_WAIT_TIME;
+  Tcb->Ttl             = 64;
+
+  Tcb->LocalEnd.Ip.Addr[0] = Ip;
+  Tcb->LocalEnd.Port       = HTONS (Port);
+  return Tcb;
+}
+
+/**
+  Free the TCP_CBs on a queue and their sockets.
+
+  @param[in]  Head    mTcpRunQue or mTcpListenQue.
+
+**/
+STATIC
+VOID
+FreeTcbs (
+  IN LIST_ENTRY  *Head
+  )
+{
+  TCP_CB  *Tcb;
+
+  while (!IsListEmpty (Head)) {
+    Tcb = NET_LIST_HEAD (Head, TCP_CB, List);
+    RemoveEntryList (&Tcb->List);
+
+    NetbufFreeList (&Tcb->SndQue);
+    NetbufFreeList (&Tcb->RcvQue);
+    NetbufQueFree (Tcb->Sk->SndBuffer.DataQueue);
+    NetbufQueFree (Tcb->Sk->RcvBuffer.DataQueue);
+    FreePool (Tcb->Sk);
+    FreePool (Tcb);
+  }
+}
+
+/**
+  Transfer data from the client to the server over a link.
+
+  @param[in]   Algorithm   The congestion control algorithm of the client.
+  @param[in]   Sack        TRUE to use SACK on both ends.
+  @param[in]   AutoTune    TRUE to auto-tune the receive buffer of the server.
+  @param[in]   Link        The link.
+  @param[in]   Size        The number of bytes to transfer.
+  @param[out]  Result      The statistics of the transfer.
+
+  @retval TRUE    All the data is delivered intact.
+  @retval FALSE   The transfer failed.
+
+**/
+STATIC
+BOOLEAN
+RunTransfer (
+  IN  UINT8        Algorithm,
+  IN  BOOLEAN      Sack,
+  IN  BOOLEAN      AutoTune,
+  IN  TEST_LINK    *Link,
+  IN  UINT32       Size,
+  OUT TEST_RESULT  *Result
+  )
+{
+  TCP_CB      *Listen;
+  TCP_CB      *Client;
+  TCP_CB      *Server;
+  LIST_ENTRY  *Entry;
+  NET_BUF     *Nbuf;
+  UINT8       *Data;
+  UINT32      Queued;
+  UINT32      Chunk;
+  UINT32      Index;
+  UINT32      StartTick;
+  BOOLEAN     Intact;
+
+  ZeroMem (Result, sizeof (*Result));
+  mLink        = Link;
+  mSlot        = 0;
+  mQueueDrops  = 0;
+  mSeed        = 1;
+  mNewSegments = 0;
+  mReceived    = 0;
+  mCorrupted   = FALSE;
+
+  Listen        = CreateTcb (TEST_SERVER_IP, TEST_SERVER_PORT, Sack, AutoTune, Algorithm);
+  Listen->State = TCP_LISTEN;
+  TcpInsertTcb (Listen);
+
+  Client                       = CreateTcb (TEST_CLIENT_IP, TEST_CLIENT_PORT, Sack, FALSE, Algorithm);
+  Client->RemoteEnd.Ip.Addr[0] = TEST_SERVER_IP;
+  Client->RemoteEnd.Port       = HTONS (TEST_SERVER_PORT);
+  TcpInsertTcb (Client);
+
+  TcpOnAppConnect (Client);
+  mMaxSeq = Client->Iss + 1;
+
+  for (Index = 0; (Index < 4 * Link->Delay + 2) && (Client->State != TCP_ESTABLISHED); Index++) {
+    DeliverPackets ();
+    TcpTickingDpc (NULL);
+  }
+
+  DeliverPackets ();
+
+  Server = NULL;
+  BASE_LIST_FOR_EACH (Entry, &mTcpRunQue) {
+    if (NET_LIST_USER_STRUCT (Entry, TCP_CB, List)->Parent == Listen) {
+      Server = NET_LIST_USER_STRUCT (Entry, TCP_CB, List);
+    }
+  }
+
+  Intact = FALSE;
+  if ((Client->State != TCP_ESTABLISHED) || (Server == NULL)) {
+    goto ON_EXIT;
+  }
+
+  StartTick = mTcpTick;
+  Queued    = 0;
+  while ((mReceived < Size) && !mCorrupted && (TCP_SUB_TIME (mTcpTick, StartTick) < TEST_MAX_TICKS)) {
+    while ((Queued < Size) && (GET_SND_DATASIZE (Client->Sk) < TEST_SEND_QUEUED)) {
+      Chunk = MIN (TEST_SEND_CHUNK, Size - Queued);
+      Nbuf  = NetbufAlloc (Chunk);
+      ASSERT (Nbuf != NULL);
+      Data = NetbufAllocSpace (Nbuf, Chunk, NET_BUF_TAIL);
+      for (Index = 0; Index < Chunk; Index++) {
+        Data[Index] = TestPattern (Queued + Index);
+      }
+
+      NetbufQueAppend (Client->Sk->SndBuffer.DataQueue, Nbuf);
+      Queued += Chunk;
+    }
+
+    TcpToSendData (Client, 0);
+    DeliverPackets ();
+    TcpTickingDpc (NULL);
+    DeliverPackets ();
+  }
+
+  Result->Ticks      = TCP_SUB_TIME (mTcpTick, StartTick);
+  Result->QueueDrops = mQueueDrops;
+
+  //
+  // Let the last ACKs reach the client before sampling its statistics.
+  //
+  while (!mCorrupted && (Client->SndUna != Client->SndNxt) && (TCP_SUB_TIME (mTcpTick, StartTick) < TEST_MAX_TICKS)) {
+    TcpTickingDpc (NULL);
+    DeliverPackets ();
+  }
+
+  TcpCollectStatistics (Client, &Result->Sender);
+  TcpCollectStatistics (Server, &Result->Receiver);
+
+  Intact = (BOOLEAN)((mReceived == Size) && !mCorrupted);
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: %a, sack %d, auto-tuning %d: %d ticks, %d retransmissions, %d congestion events, cwnd max %d, receive buffer %d\n",
+    __func__,
+    Client->CongestOps->Name,
+    Sack,
+    AutoTune,
+    Result->Ticks,
+    Result->Sender.Retransmissions,
+    Result->Sender.CongestionEvents,
+    Result->Sender.MaxCongestionWindow,
+    Result->Receiver.ReceiveBufferSize
+    ));
+
+ON_EXIT:
+  FreeTcbs (&mTcpRunQue);
+  FreeTcbs (&mTcpListenQue);
+  FreePackets ();
+  return Intact;
+}
+
+/**
+  Dropped segments are retransmitted once each with SACK, and the data is
+  delivered intact with and without SACK, with both algorithms.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The transfers are as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A transfer failed.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+DroppedSegmentsAreRecovered (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  STATIC UINT32  Holes[]  = { 20, 22 };
+  STATIC UINT32  Burst[]  = { 30, 31, 32, 60 };
+  STATIC UINT32  Tail[]   = { 37 };
+  TEST_LINK      Links[3] = {
+    { 1, 100, 1000, 0, Holes, ARRAY_SIZE (Holes) },
+    { 1, 100, 1000, 0, Burst, ARRAY_SIZE (Burst) },
+    { 1, 100, 1000, 0, Tail,  ARRAY_SIZE (Tail)  }
+  };
+  UINT32         Sizes[3] = { 500000, 500000, 1460 * 38 };
+  TEST_RESULT    Result;
+  UINT8          Algorithm;
+  UINTN          Index;
+
+  for (Algorithm = 0; Algorithm < TCP_CONGESTION_NUMBER; Algorithm++) {
+    for (Index = 0; Index < ARRAY_SIZE (Links); Index++) {
+      UT_ASSERT_TRUE (RunTransfer (Algorithm, TRUE, FALSE, &Links[Index], Sizes[Index], &Result));
+      UT_ASSERT_EQUAL (Result.Sender.Retransmissions, Links[Index].DropCount);
+      UT_ASSERT_EQUAL (Result.Sender.CongestionControl, Algorithm);
+
+      UT_ASSERT_TRUE (RunTransfer (Algorithm, FALSE, FALSE, &Links[Index], Sizes[Index], &Result));
+      UT_ASSERT_TRUE (Result.Sender.Retransmissions >= Links[Index].DropCount);
+    }
+  }
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  With a fixed 64 KiB receive buffer, a link with a 2.6 MB bandwidth-delay
+  product stays mostly idle. Auto-tuning grows the receive buffer and the
+  window scale for the product, and the congestion window follows.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The transfers are as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A transfer failed.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+AutoTuningFillsThePipe (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_LINK    Link = { TEST_BDP_DELAY, TEST_BDP_RATE, 2500, 0, NULL, 0 };
+  TEST_RESULT  Fixed;
+  TEST_RESULT  Tuned;
+  UINT32       FixedSize;
+  UINT32       TunedSize;
+  UINT8        Algorithm;
+
+  FixedSize = 4 * 1024 * 1024;
+  TunedSize = 32 * 1024 * 1024;
+
+  for (Algorithm = 0; Algorithm < TCP_CONGESTION_NUMBER; Algorithm++) {
+    UT_ASSERT_TRUE (RunTransfer (Algorithm, TRUE, FALSE, &Link, FixedSize, &Fixed));
+    UT_ASSERT_EQUAL (Fixed.Receiver.ReceiveBufferSize, TEST_WINDOW);
+    UT_ASSERT_FALSE (Fixed.Receiver.ReceiveBufferAutoTuning);
+
+    UT_ASSERT_TRUE (RunTransfer (Algorithm, TRUE, TRUE, &Link, TunedSize, &Tuned));
+    UT_ASSERT_TRUE (Tuned.Receiver.ReceiveBufferAutoTuning);
+    UT_ASSERT_TRUE (Tuned.Receiver.ReceiveBufferSize >= TEST_BDP);
+    UT_ASSERT_TRUE ((TEST_WINDOW << Tuned.Sender.SendWindowScale) >= TEST_BDP);
+    UT_ASSERT_TRUE (Tuned.Sender.MaxCongestionWindow >= TEST_BDP);
+    UT_ASSERT_EQUAL (Tuned.Sender.Retransmissions, 0);
+    UT_ASSERT_EQUAL (Tuned.Sender.BytesSent, TunedSize);
+    UT_ASSERT_EQUAL (Tuned.Receiver.BytesReceived, TunedSize);
+
+    //
+    // At least ten times the throughput of the fixed buffer.
+    //
+    UT_ASSERT_TRUE (
+      MultU64x32 (TunedSize, Fixed.Ticks) >= MultU64x32 (MultU64x32 (FixedSize, Tuned.Ticks), 10)
+      );
+
+    //
+    // The receiver only sends pure ACKs, which never sample its RTT, and the
+    // RTT of the sender is the delay of the link plus its queue.
+    //
+    UT_ASSERT_TRUE (Tuned.Receiver.SmoothedRtt <= 2 * (TEST_BDP_DELAY + 1) * TCP_TICK);
+    UT_ASSERT_TRUE (Tuned.Sender.SmoothedRtt >= 2 * TEST_BDP_DELAY * TCP_TICK);
+  }
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  With random loss on a link with a large bandwidth-delay product, CUBIC
+  regrows the congestion window faster than NewReno after a loss.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The transfers are as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A transfer failed.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+CubicRecoversFasterThanNewReno (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_LINK    Link = { TEST_BDP_DELAY, TEST_BDP_RATE, 2500, 50, NULL, 0 };
+  TEST_RESULT  NewReno;
+  TEST_RESULT  Cubic;
+  UINT32       Size;
+
+  Size = 64 * 1024 * 1024;
+
+  UT_ASSERT_TRUE (RunTransfer (TCP_CONGESTION_NEWRENO, TRUE, TRUE, &Link, Size, &NewReno));
+  UT_ASSERT_TRUE (NewReno.Sender.CongestionEvents > 0);
+
+  UT_ASSERT_TRUE (RunTransfer (TCP_CONGESTION_CUBIC, TRUE, TRUE, &Link, Size, &Cubic));
+  UT_ASSERT_TRUE (Cubic.Sender.CongestionEvents > 0);
+
+  UT_ASSERT_TRUE (Cubic.Ticks < NewReno.Ticks);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the
+  congestion control and the receive buffer auto-tuning and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      CongestionTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  mBootServices.FreePool = TestFreePool;
+
+  mIp4.GetModeData  = TestIp4GetModeData;
+  mIpIo.Ip.Ip4      = &mIp4;
+  mService.IpIo     = &mIpIo;
+  mIpInfo.IpVersion = IP_VERSION_4;
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&CongestionTests, Framework, "TCP Congestion Control Tests", "Tcp.Congestion", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for TCP Congestion Control Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite--------------Description-------------------------------------Name------------Function-------------------------Pre---Post---Context
+  //
+  AddTestCase (CongestionTests, "Dropped segments are recovered", "Dropped", DroppedSegmentsAreRecovered, NULL, NULL, NULL);
+  AddTestCase (CongestionTests, "Auto-tuning fills the pipe", "AutoTuning", AutoTuningFillsThePipe, NULL, NULL, NULL);
+  AddTestCase (CongestionTests, "CUBIC recovers faster than NewReno", "Cubic", CubicRecoversFasterThanNewReno, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define TcpCongestionUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+TcpCongestionUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -0,0 +1,580 @@
+/** @file
+  Host-based unit tests for the SACK scoreboard and the RACK loss detection
+  of the TCP driver, with segments that the network drops or reorders.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../TcpMain.h"
+
+#include <Library/UnitTestLib.h>
+
+#define UNIT_TEST_APP_NAME     "TCP SACK Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_MSS        1000
+#define TEST_SEG_COUNT  10
+#define TEST_XMIT_TICK  100
+#define TEST_RTT        10
+
+//
+// The sequence numbers wrap around in the middle of the segments.
+//
+#define TEST_ISS  ((TCP_SEQNO)(0 - 4 * TEST_MSS - TEST_MSS / 2))
+
+//
+// The first sequence number of the Index-th segment.
+//
+#define TEST_SEQ(Index)  ((TCP_SEQNO)(TEST_ISS + (Index) * TEST_MSS))
+
+UINT32  mTcpTick;
+
+STATIC TCP_CB   mTcb;
+STATIC NET_BUF  mSegments[TEST_SEG_COUNT];
+STATIC UINTN    mCongestionEvents;
+STATIC UINTN    mSackRetransmits;
+STATIC INTN     mSackRetransmitForce;
+
+/**
+  Get the maximum SndNxt, which is SndNxt as the tests never go back.
+
+  @param[in]  Tcb     Pointer to the TCP_CB of this TCP instance.
+
+  @return The sequence number of the maximum SndNxt.
+
+**/
+TCP_SEQNO
+TcpGetMaxSndNxt (
+  IN TCP_CB  *Tcb
+  )
+{
+  return Tcb->SndNxt;
+}
+
+/**
+  Enable a TCP timer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Timer    The index of the timer to be enabled.
+  @param[in]       TimeOut  The timeout value of this timer.
+
+**/
+VOID
+TcpSetTimer (
+  IN OUT TCP_CB  *Tcb,
+  IN     UINT16  Timer,
+  IN     UINT32  TimeOut
+  )
+{
+  TCP_SET_TIMER (Tcb->EnabledTimer, Timer);
+  Tcb->Timer[Timer] = mTcpTick + TimeOut;
+}
+
+/**
+  Clear one TCP timer.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Timer    The index of the timer to be cleared.
+
+**/
+VOID
+TcpClearTimer (
+  IN OUT TCP_CB  *Tcb,
+  IN     UINT16  Timer
+  )
+{
+  TCP_CLEAR_TIMER (Tcb->EnabledTimer, Timer);
+}
+
+/**
+  Set the slow start threshold after a loss to half the flight size.
+
+  @param[in, out]  Tcb      Pointer to the TCP_CB of this TCP instance.
+
+**/
+VOID
+TcpCongestionEvent (
+  IN OUT TCP_CB  *Tcb
+  )
+{
+  mCongestionEvents++;
+  Tcb->Ssthresh = MAX (2 * Tcb->SndMss, TCP_SUB_SEQ (Tcb->SndNxt, Tcb->SndUna) / 2);
+}
+
+/**
+  Record a request to retransmit the lost segments.
+
+  @param[in, out]  Tcb     Pointer to the TCP_CB of this TCP instance.
+  @param[in]       Una     The first unacknowledged sequence number.
+  @param[in]       Force   If TRUE, retransmit the first lost segment
+                           even if the pipe is full.
+
+  @return 0, nothing is retransmitted.
+
+**/
+INTN
+TcpSackRetransmit (
+  IN OUT TCP_CB     *Tcb,
+  IN     TCP_SEQNO  Una,
+  IN     INTN       Force
+  )
+{
+  mSackRetransmits++;
+  mSackRetransmitForce = Force;
+  return 0;
+}
+
+/**
+  Get the scoreboard entry of a segment.
+
+  @param[in]  Index   The index of the segment.
+
+  @return The TCP_SEG of the segment.
+**/
+STATIC
+TCP_SEG *
+TestSeg (
+  IN UINTN  Index
+  )
+{
+  return TCPSEG_NETBUF (&mSegments[Index]);
+}
+
+/**
+  Queue TEST_SEG_COUNT segments of TEST_MSS bytes on the SndQue and send
+  them all at TEST_XMIT_TICK.
+
+  @param[in]  SRtt    The smoothed RTT in heartbeats.
+**/
+STATIC
+VOID
+SendSegments (
+  IN UINT32  SRtt
+  )
+{
+  UINTN    Index;
+  TCP_SEG  *Seg;
+
+  ZeroMem (&mTcb, sizeof (mTcb));
+  ZeroMem (mSegments, sizeof (mSegments));
+  InitializeListHead (&mTcb.SndQue);
+  mCongestionEvents = 0;
+  mSackRetransmits  = 0;
+
+  mTcb.SndMss       = TEST_MSS;
+  mTcb.CWnd         = TEST_SEG_COUNT * TEST_MSS;
+  mTcb.Ssthresh     = MAX_UINT32;
+  mTcb.SRtt         = SRtt << TCP_RTT_SHIFT;
+  mTcb.CongestState = TCP_CONGEST_OPEN;
+  mTcb.SndUna       = TEST_SEQ (0);
+  mTcb.SndNxt       = TEST_SEQ (0);
+
+  mTcpTick = TEST_XMIT_TICK;
+  for (Index = 0; Index < TEST_SEG_COUNT; Index++) {
+    Seg      = TestSeg (Index);
+    Seg->Seq = TEST_SEQ (Index);
+    Seg->End = TEST_SEQ (Index + 1);
+    InsertTailList (&mTcb.SndQue, &mSegments[Index].List);
+
+    mTcb.SndNxt = Seg->End;
+    TcpSackOnXmit (&mTcb, Seg->Seq, Seg->End, FALSE);
+  }
+}
+
+/**
+  Process an ACK from the peer.
+
+  @param[in]  Ack         The cumulative acknowledgment.
+  @param[in]  BlockCount  The number of SACK blocks.
+  @param[in]  ...         The left and right edges of each SACK block, as
+                          TCP_SEQNO.
+
+  @return The number of segments newly deemed lost.
+**/
+STATIC
+UINT32
+ReceiveAck (
+  IN TCP_SEQNO  Ack,
+  IN UINT8      BlockCount,
+  ...
+  )
+{
+  TCP_OPTION  Option;
+  VA_LIST     Marker;
+  UINT8       Index;
+
+  ZeroMem (&Option, sizeof (Option));
+  Option.SackCount = BlockCount;
+
+  VA_START (Marker, BlockCount);
+  for (Index = 0; Index < BlockCount; Index++) {
+    Option.Sack[Index].Left  = VA_ARG (Marker, TCP_SEQNO);
+    Option.Sack[Index].Right = VA_ARG (Marker, TCP_SEQNO);
+  }
+
+  VA_END (Marker);
+
+  return TcpSackUpdate (&mTcb, Ack, &Option);
+}
+
+/**
+  A dropped segment is deemed lost as soon as the segments after it are
+  SACKed, is counted again in the pipe once retransmitted, and bogus SACK
+  blocks are ignored.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The scoreboard is as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The scoreboard is wrong.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+DroppedSegmentIsDeemedLost (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  SendSegments (4 * TEST_RTT);
+  UT_ASSERT_EQUAL (TcpSackPipe (&mTcb, mTcb.SndUna), TEST_SEG_COUNT * TEST_MSS);
+
+  //
+  // Segment 2 is dropped. The ACK of the segments after it carries a
+  // D-SACK block below the cumulative ACK and a block beyond SND.NXT.
+  //
+  mTcpTick = TEST_XMIT_TICK + TEST_RTT;
+  UT_ASSERT_EQUAL (
+    ReceiveAck (
+      TEST_SEQ (2),
+      3,
+      TEST_SEQ (3),
+      TEST_SEQ (TEST_SEG_COUNT),
+      TEST_SEQ (0),
+      TEST_SEQ (1),
+      TEST_SEQ (TEST_SEG_COUNT),
+      TEST_SEQ (TEST_SEG_COUNT + 1)
+      ),
+    1
+    );
+
+  UT_ASSERT_EQUAL (mTcb.SackedOut, TEST_SEG_COUNT - 3);
+  UT_ASSERT_EQUAL (mTcb.RackXmitCount, TEST_SEG_COUNT);
+  UT_ASSERT_EQUAL (mTcb.RackRtt, TEST_RTT);
+  UT_ASSERT_EQUAL (TestSeg (2)->SackState, TCP_SEG_LOST);
+  for (Index = 3; Index < TEST_SEG_COUNT; Index++) {
+    UT_ASSERT_EQUAL (TestSeg (Index)->SackState, TCP_SEG_SACKED);
+  }
+
+  UT_ASSERT_FALSE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+  UT_ASSERT_EQUAL (TcpSackPipe (&mTcb, TEST_SEQ (2)), 0);
+
+  //
+  // The retransmission is in flight, and is not deemed lost again by a
+  // duplicate ACK.
+  //
+  mTcpTick++;
+  TcpSackOnXmit (&mTcb, TEST_SEQ (2), TEST_SEQ (3), TRUE);
+  UT_ASSERT_EQUAL (TestSeg (2)->SackState, TCP_SEG_LOST | TCP_SEG_RETRANS);
+  UT_ASSERT_EQUAL (TcpSackPipe (&mTcb, TEST_SEQ (2)), TEST_MSS);
+
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (2), 1, TEST_SEQ (3), TEST_SEQ (TEST_SEG_COUNT)), 0);
+  UT_ASSERT_EQUAL (TestSeg (2)->SackState, TCP_SEG_LOST | TCP_SEG_RETRANS);
+
+  //
+  // The retransmission is delivered, its RTT is ambiguous and not sampled.
+  //
+  mTcpTick += TEST_RTT;
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (TEST_SEG_COUNT), 0), 0);
+  UT_ASSERT_EQUAL (mTcb.RackRtt, TEST_RTT);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A segment that arrives after the segment sent after it is not deemed lost
+  within the reordering window, and the reordering timer is stopped once it
+  is ACKed.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The scoreboard is as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The scoreboard is wrong.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ReorderedSegmentIsNotDeemedLost (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  //
+  // The reordering window is a quarter of the smoothed RTT.
+  //
+  SendSegments (4 * TEST_RTT);
+
+  mTcpTick = TEST_XMIT_TICK + TEST_RTT;
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (2), 1, TEST_SEQ (3), TEST_SEQ (4)), 0);
+  UT_ASSERT_EQUAL (mTcb.SackedOut, 1);
+  UT_ASSERT_EQUAL (TestSeg (2)->SackState, 0);
+  UT_ASSERT_TRUE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+  UT_ASSERT_EQUAL (mTcb.Timer[TCP_TIMER_REORDER], mTcpTick + TEST_RTT);
+
+  //
+  // Segment 2 arrives within the window.
+  //
+  mTcpTick += TEST_RTT / 2;
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (4), 0), 0);
+  UT_ASSERT_EQUAL (TestSeg (2)->SackState, 0);
+  UT_ASSERT_FALSE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+  UT_ASSERT_EQUAL (TcpSackPipe (&mTcb, TEST_SEQ (4)), (TEST_SEG_COUNT - 4) * TEST_MSS);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  A segment that does not arrive within the reordering window is deemed lost
+  when the reordering timer expires, and immediately once enough segments
+  are SACKed after it.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The scoreboard is as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The scoreboard is wrong.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ReorderingWindowExpires (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  SendSegments (4 * TEST_RTT);
+
+  mTcpTick = TEST_XMIT_TICK + TEST_RTT;
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (2), 1, TEST_SEQ (3), TEST_SEQ (4)), 0);
+  UT_ASSERT_TRUE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+
+  //
+  // The reordering timer expires.
+  //
+  mTcpTick = mTcb.Timer[TCP_TIMER_REORDER];
+  UT_ASSERT_EQUAL (TcpRackDetectLoss (&mTcb, TEST_SEQ (2)), 1);
+  UT_ASSERT_EQUAL (TestSeg (2)->SackState, TCP_SEG_LOST);
+  UT_ASSERT_FALSE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+
+  //
+  // Same drop, but three segments are SACKed after it: reordering is ruled
+  // out without waiting.
+  //
+  SendSegments (4 * TEST_RTT);
+
+  mTcpTick = TEST_XMIT_TICK + TEST_RTT;
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (2), 1, TEST_SEQ (3), TEST_SEQ (4)), 0);
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (2), 1, TEST_SEQ (3), TEST_SEQ (5)), 0);
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (2), 1, TEST_SEQ (3), TEST_SEQ (6)), 1);
+  UT_ASSERT_EQUAL (TestSeg (2)->SackState, TCP_SEG_LOST);
+  UT_ASSERT_FALSE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Without SACK blocks from the peer, the first segment is deemed lost after
+  three duplicate ACKs, and a retransmission timeout deems all the segments
+  not SACKed lost.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The scoreboard is as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The scoreboard is wrong.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+DupAcksAndTimeoutWithoutSack (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINTN  Index;
+
+  SendSegments (4 * TEST_RTT);
+
+  mTcpTick = TEST_XMIT_TICK + TEST_RTT;
+  for (Index = 0; Index < TCP_SACK_DUP_THRESH - 1; Index++) {
+    mTcb.DupAck++;
+    UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (0), 0), 0);
+  }
+
+  mTcb.DupAck++;
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (0), 0), 1);
+  UT_ASSERT_EQUAL (TestSeg (0)->SackState, TCP_SEG_LOST);
+  UT_ASSERT_EQUAL (TestSeg (1)->SackState, 0);
+
+  //
+  // Segment 5 is SACKed late, then the retransmission timer expires.
+  //
+  mTcb.DupAck = 0;
+  UT_ASSERT_EQUAL (ReceiveAck (TEST_SEQ (0), 1, TEST_SEQ (5), TEST_SEQ (6)), 0);
+  UT_ASSERT_TRUE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+
+  TcpSackOnRto (&mTcb);
+  for (Index = 0; Index < TEST_SEG_COUNT; Index++) {
+    UT_ASSERT_EQUAL (TestSeg (Index)->SackState, (Index == 5) ? TCP_SEG_SACKED : TCP_SEG_LOST);
+  }
+
+  UT_ASSERT_FALSE (TCP_TIMER_ON (mTcb.EnabledTimer, TCP_TIMER_REORDER));
+  UT_ASSERT_EQUAL (TcpSackPipe (&mTcb, TEST_SEQ (0)), 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  The loss recovery starts with a forced retransmission, keeps retransmitting
+  as the partial ACKs arrive and ends with the ACK of the recovery point.
+
+  @param[in]  Context  Unused.
+
+  @retval  UNIT_TEST_PASSED             The recovery is as expected.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The recovery is wrong.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RecoveryEndsAtRecoveryPoint (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  SendSegments (4 * TEST_RTT);
+
+  mTcpTick = TEST_XMIT_TICK + TEST_RTT;
+  UT_ASSERT_EQUAL (
+    ReceiveAck (
+      TEST_SEQ (1),
+      2,
+      TEST_SEQ (2),
+      TEST_SEQ (5),
+      TEST_SEQ (6),
+      TEST_SEQ (TEST_SEG_COUNT)
+      ),
+    2
+    );
+  UT_ASSERT_EQUAL (TestSeg (1)->SackState, TCP_SEG_LOST);
+  UT_ASSERT_EQUAL (TestSeg (5)->SackState, TCP_SEG_LOST);
+
+  TcpSackRecover (&mTcb, TEST_SEQ (1));
+  UT_ASSERT_EQUAL (mTcb.CongestState, TCP_CONGEST_RECOVER);
+  UT_ASSERT_EQUAL (mTcb.Recover, TEST_SEQ (TEST_SEG_COUNT));
+  UT_ASSERT_EQUAL (mTcb.CWnd, mTcb.Ssthresh);
+  UT_ASSERT_EQUAL (mCongestionEvents, 1);
+  UT_ASSERT_EQUAL (mSackRetransmits, 1);
+  UT_ASSERT_EQUAL (mSackRetransmitForce, 1);
+
+  //
+  // A partial ACK keeps the recovery going without another congestion
+  // event.
+  //
+  TcpSackRecover (&mTcb, TEST_SEQ (5));
+  UT_ASSERT_EQUAL (mTcb.CongestState, TCP_CONGEST_RECOVER);
+  UT_ASSERT_EQUAL (mCongestionEvents, 1);
+  UT_ASSERT_EQUAL (mSackRetransmits, 2);
+  UT_ASSERT_EQUAL (mSackRetransmitForce, 0);
+
+  TcpSackRecover (&mTcb, TEST_SEQ (TEST_SEG_COUNT));
+  UT_ASSERT_EQUAL (mTcb.CongestState, TCP_CONGEST_OPEN);
+  UT_ASSERT_EQUAL (mSackRetransmits, 2);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the SACK
+  scoreboard and the RACK loss detection and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      SackTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&SackTests, Framework, "TCP SACK Tests", "Tcp.Sack", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for TCP SACK Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite--------Description-----------------------------------------Name-----------Function---------------------------Pre---Post---Context
+  //
+  AddTestCase (SackTests, "Dropped segment is deemed lost", "Dropped", DroppedSegmentIsDeemedLost, NULL, NULL, NULL);
+  AddTestCase (SackTests, "Reordered segment is not deemed lost", "Reordered", ReorderedSegmentIsNotDeemedLost, NULL, NULL, NULL);
+  AddTestCase (SackTests, "Reordering window expires", "ReorderWindow", ReorderingWindowExpires, NULL, NULL, NULL);
+  AddTestCase (SackTests, "Duplicate ACKs and timeout without SACK", "NoSack", DupAcksAndTimeoutWithoutSack, NULL, NULL, NULL);
+  AddTestCase (SackTests, "Recovery ends at the recovery point", "Recovery", RecoveryEndsAtRecoveryPoint, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define TcpSackUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+TcpSackUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -232,25 +232,32 @@ TlsDecryptPacket (
     BufferInSize += (*FragmentTable)[Index].FragmentLength;
   }
 
-  //
-  // Allocate buffer for processing data
-  //
-  BufferIn = AllocateZeroPool (BufferInSize);
-  if (BufferIn == NULL) {
-    Status = EFI_OUT_OF_RESOURCES;
-    goto ERROR;
-  }
+  if (*FragmentCount == 1) {
+    //
+    // The records are already contiguous, process them in place.
+    //
+    BufferIn = (*FragmentTable)[0].FragmentBuffer;
+  } else {
+    //
+    // Allocate buffer for processing data
+    //
+    BufferIn = AllocatePool (BufferInSize);
+    if (BufferIn == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+      goto ERROR;
+    }
 
-  //
-  // Copy all TLS plain record header and payload to BufferIn
-  //
-  for (Index = 0; Index < *FragmentCount; Index++) {
-    CopyMem (
-      (BufferIn + BytesCopied),
-      (*FragmentTable)[Index].FragmentBuffer,
-      (*FragmentTable)[Index].FragmentLength
-      );
-    BytesCopied += (*FragmentTable)[Index].FragmentLength;
+    //
+    // Copy all TLS plain record header and payload to BufferIn
+    //
+    for (Index = 0; Index < *FragmentCount; Index++) {
+      CopyMem (
+        (BufferIn + BytesCopied),
+        (*FragmentTable)[Index].FragmentBuffer,
+        (*FragmentTable)[Index].FragmentLength
+        );
+      BytesCopied += (*FragmentTable)[Index].FragmentLength;
+    }
   }
 
   //
@@ -271,7 +278,7 @@ TlsDecryptPacket (
   //
   // Allocate enough buffer to hold TLS Plaintext.
   //
-  BufferOut = AllocateZeroPool (RecordCount * (TLS_RECORD_HEADER_LENGTH + TLS_PLAINTEXT_RECORD_MAX_PAYLOAD_LENGTH));
+  BufferOut = AllocatePool (RecordCount * (TLS_RECORD_HEADER_LENGTH + TLS_PLAINTEXT_RECORD_MAX_PAYLOAD_LENGTH));
   if (BufferOut == NULL) {
     Status = EFI_OUT_OF_RESOURCES;
     goto ERROR;
@@ -316,7 +323,10 @@ TlsDecryptPacket (
     TempRecordHeader = (TLS_RECORD_HEADER *)((UINT8 *)TempRecordHeader + TLS_RECORD_HEADER_LENGTH + ThisPlainMessageSize);
   }
 
-  FreePool (BufferIn);
+  if (*FragmentCount > 1) {
+    FreePool (BufferIn);
+  }
+
   BufferIn = NULL;
 
   //
@@ -336,7 +346,7 @@ TlsDecryptPacket (
 
 ERROR:
 
-  if (BufferIn != NULL) {
+  if ((BufferIn != NULL) && (*FragmentCount > 1)) {
     FreePool (BufferIn);
     BufferIn = NULL;
   }
@@ -0,0 +1,1427 @@
+/** @file
+  Host-based unit tests for the request engine of the virtio-blk driver, with
+  blocking and non-blocking requests on a simulated virtio device that
+  completes the descriptor chains out of order and bounce buffers the
+  mappings.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <IndustryStandard/VirtioBlk.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+#include <Library/UnitTestLib.h>
+#include <Protocol/VirtioDevice.h>
+
+#include "../VirtioBlk.h"
+
+#define UNIT_TEST_APP_NAME     "Virtio Block Request Engine Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_BLOCK_SIZE      512
+#define TEST_BLOCK_COUNT     1024
+#define TEST_DISK_SIZE       (TEST_BLOCK_SIZE * TEST_BLOCK_COUNT)
+#define TEST_MAX_OPERATIONS  256
+#define TEST_ITERATIONS      5000
+
+typedef struct {
+  LIST_ENTRY          Link;
+  UINT32              Type;
+  EFI_TPL             Tpl;
+  EFI_EVENT_NOTIFY    NotifyFunction;
+  VOID                *NotifyContext;
+  BOOLEAN             Signaled;
+  BOOLEAN             TimerArmed;
+} TEST_EVENT;
+
+///
+/// A mapping of a buffer for the device
+///
+typedef struct {
+  VIRTIO_MAP_OPERATION    Operation;
+  VOID                    *HostAddress;
+  VOID                    *DeviceAddress;
+  UINTN                   NumberOfBytes;
+} TEST_MAPPING;
+
+///
+/// A non-blocking Block I/O 2 request of the test
+///
+typedef struct {
+  EFI_BLOCK_IO2_TOKEN    Token;
+  BOOLEAN                Write;
+  BOOLEAN                Flush;
+  BOOLEAN                Done;
+  EFI_LBA                Lba;
+  UINTN                  BufferSize;
+  UINT8                  *Buffer;
+  UINT8                  *Expected;  ///< Disk content to read, NULL otherwise
+} TEST_OPERATION;
+
+///
+/// The configuration of the simulated device
+///
+typedef struct {
+  UINT16     QueueSize;
+  BOOLEAN    WriteCaching;
+} TEST_DEVICE_CONFIG;
+
+///
+/// Functions of the driver that its header does not declare
+///
+EFI_STATUS
+EFIAPI
+VirtioBlkDriverBindingStart (
+  IN EFI_DRIVER_BINDING_PROTOCOL  *This,
+  IN EFI_HANDLE                   DeviceHandle,
+  IN EFI_DEVICE_PATH_PROTOCOL     *RemainingDevicePath
+  );
+
+EFI_STATUS
+EFIAPI
+VirtioBlkDriverBindingStop (
+  IN EFI_DRIVER_BINDING_PROTOCOL  *This,
+  IN EFI_HANDLE                   DeviceHandle,
+  IN UINTN                        NumberOfChildren,
+  IN EFI_HANDLE                   *ChildHandleBuffer
+  );
+
+///
+/// Boot services of the simulated firmware
+///
+STATIC EFI_TPL            mTpl    = TPL_APPLICATION;
+STATIC LIST_ENTRY         mEvents = INITIALIZE_LIST_HEAD_VARIABLE (mEvents);
+STATIC EFI_BOOT_SERVICES  mBootServices;
+STATIC TEST_EVENT         *mReapTimer;
+STATIC UINTN              mTimerArms;
+
+///
+/// The simulated device, and the content the disk must have
+///
+STATIC UINT8                   mDisk[TEST_DISK_SIZE];
+STATIC UINT8                   mModel[TEST_DISK_SIZE];
+STATIC TEST_DEVICE_CONFIG      mConfig;
+STATIC VIRTIO_DEVICE_PROTOCOL  mVirtIo;
+STATIC VRING                   *mRing;
+STATIC UINT16                  mHostAvailIdx;
+STATIC UINT16                  mTaken[TEST_MAX_OPERATIONS];
+STATIC UINTN                   mTakenCount;
+STATIC UINTN                   mMaxInFlight;
+STATIC UINTN                   mHostFlushes;
+STATIC UINT32                  mSeed;
+
+///
+/// The Block I/O protocols that the driver installs
+///
+STATIC EFI_BLOCK_IO_PROTOCOL        *mBlockIo;
+STATIC EFI_BLOCK_IO2_PROTOCOL       *mBlockIo2;
+STATIC EFI_DRIVER_BINDING_PROTOCOL  mDriverBinding;
+
+STATIC TEST_OPERATION  mOperations[TEST_MAX_OPERATIONS];
+STATIC UINTN           mOperationCount;
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  VOID
+  )
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return (mSeed >> 8);
+}
+
+/**
+  Processes some of the descriptor chains that the driver made available, in
+  random order, the way the host side of the device does.
+
+**/
+STATIC
+VOID
+ProcessRequests (
+  VOID
+  )
+{
+  UINTN                Index;
+  UINT16               HeadDescIdx;
+  UINT16               UsedIdx;
+  volatile VRING_DESC  *HeaderDesc;
+  volatile VRING_DESC  *DataDesc;
+  volatile VRING_DESC  *StatusDesc;
+  VIRTIO_BLK_REQ       *Request;
+  UINT64               Offset;
+
+  if (mRing == NULL) {
+    return;
+  }
+
+  while (mHostAvailIdx != *mRing->Avail.Idx) {
+    ASSERT (mTakenCount < TEST_MAX_OPERATIONS);
+    mTaken[mTakenCount++] = mRing->Avail.Ring[mHostAvailIdx++ % mRing->QueueSize];
+  }
+
+  mMaxInFlight = MAX (mMaxInFlight, mTakenCount);
+
+  while ((mTakenCount > 0) && (NextRandom () % 3 != 0)) {
+    Index         = NextRandom () % mTakenCount;
+    HeadDescIdx   = mTaken[Index];
+    mTaken[Index] = mTaken[--mTakenCount];
+
+    HeaderDesc = &mRing->Desc[HeadDescIdx];
+    Request    = (VIRTIO_BLK_REQ *)(UINTN)HeaderDesc->Addr;
+    ASSERT ((HeaderDesc->Flags & VRING_DESC_F_NEXT) != 0);
+    DataDesc = &mRing->Desc[HeaderDesc->Next];
+
+    if (Request->Type == VIRTIO_BLK_T_FLUSH) {
+      //
+      // The driver does not run a flush alongside other requests
+      //
+      ASSERT (mTakenCount == 0);
+      StatusDesc = DataDesc;
+      mHostFlushes++;
+    } else {
+      StatusDesc = &mRing->Desc[DataDesc->Next];
+      Offset     = MultU64x32 (Request->Sector, 512);
+      ASSERT (Offset + DataDesc->Len <= TEST_DISK_SIZE);
+      if (Request->Type == VIRTIO_BLK_T_OUT) {
+        ASSERT ((DataDesc->Flags & VRING_DESC_F_WRITE) == 0);
+        CopyMem (mDisk + Offset, (VOID *)(UINTN)DataDesc->Addr, DataDesc->Len);
+      } else {
+        ASSERT ((DataDesc->Flags & VRING_DESC_F_WRITE) != 0);
+        CopyMem ((VOID *)(UINTN)DataDesc->Addr, mDisk + Offset, DataDesc->Len);
+      }
+    }
+
+    *(UINT8 *)(UINTN)StatusDesc->Addr = VIRTIO_BLK_S_OK;
+
+    UsedIdx                                                  = *mRing->Used.Idx;
+    mRing->Used.UsedElem[UsedIdx % mRing->QueueSize].Id  = HeadDescIdx;
+    mRing->Used.UsedElem[UsedIdx % mRing->QueueSize].Len = 0;
+    *mRing->Used.Idx                                         = (UINT16)(UsedIdx + 1);
+  }
+}
+
+/**
+  Dispatches the signaled events whose TPL is above the current TPL, the
+  highest TPL first.
+
+**/
+STATIC
+VOID
+DispatchEvents (
+  VOID
+  )
+{
+  LIST_ENTRY  *Link;
+  TEST_EVENT  *Event;
+  TEST_EVENT  *Next;
+  EFI_TPL     SavedTpl;
+
+  for ( ; ;) {
+    Next = NULL;
+    for (Link = GetFirstNode (&mEvents); !IsNull (&mEvents, Link); Link = GetNextNode (&mEvents, Link)) {
+      Event = BASE_CR (Link, TEST_EVENT, Link);
+      if (Event->Signaled && (Event->NotifyFunction != NULL) && (Event->Tpl > mTpl) &&
+          ((Next == NULL) || (Event->Tpl > Next->Tpl)))
+      {
+        Next = Event;
+      }
+    }
+
+    if (Next == NULL) {
+      return;
+    }
+
+    Next->Signaled = FALSE;
+    SavedTpl       = mTpl;
+    mTpl           = Next->Tpl;
+    Next->NotifyFunction (Next, Next->NotifyContext);
+    mTpl = SavedTpl;
+  }
+}
+
+/**
+  Lets time pass: the host processes requests, the armed timers expire and
+  the events are dispatched.
+
+**/
+STATIC
+VOID
+Tick (
+  VOID
+  )
+{
+  LIST_ENTRY  *Link;
+  TEST_EVENT  *Event;
+
+  if (NextRandom () % 2 == 0) {
+    ProcessRequests ();
+  }
+
+  if (NextRandom () % 3 == 0) {
+    for (Link = GetFirstNode (&mEvents); !IsNull (&mEvents, Link); Link = GetNextNode (&mEvents, Link)) {
+      Event = BASE_CR (Link, TEST_EVENT, Link);
+      if (Event->TimerArmed) {
+        Event->Signaled = TRUE;
+      }
+    }
+  }
+
+  DispatchEvents ();
+}
+
+/**
+  Raises the task priority level.
+
+  @param  NewTpl  The new task priority level.
+
+  @return The previous task priority level.
+
+**/
+STATIC
+EFI_TPL
+EFIAPI
+TestRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  EFI_TPL  OldTpl;
+
+  OldTpl = mTpl;
+  ASSERT (NewTpl >= OldTpl);
+  mTpl = NewTpl;
+  return OldTpl;
+}
+
+/**
+  Restores the task priority level, and lets time pass.
+
+  @param  OldTpl  The task priority level to restore.
+
+**/
+STATIC
+VOID
+EFIAPI
+TestRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+  ASSERT (OldTpl <= mTpl);
+  mTpl = OldTpl;
+  Tick ();
+}
+
+/**
+  Creates an event.
+
+  @param  Type            The type of event.
+  @param  NotifyTpl       The task priority level of the notification.
+  @param  NotifyFunction  The notification function, NULL for none.
+  @param  NotifyContext   The context of the notification function.
+  @param  Event           The new event.
+
+  @retval EFI_SUCCESS           The event is created.
+  @retval EFI_OUT_OF_RESOURCES  The event cannot be allocated.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  TEST_EVENT  *NewEvent;
+
+  NewEvent = AllocateZeroPool (sizeof (TEST_EVENT));
+  if (NewEvent == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NewEvent->Type           = Type;
+  NewEvent->Tpl            = NotifyTpl;
+  NewEvent->NotifyFunction = NotifyFunction;
+  NewEvent->NotifyContext  = NotifyContext;
+  InsertTailList (&mEvents, &NewEvent->Link);
+  if ((Type & EVT_TIMER) != 0) {
+    mReapTimer = NewEvent;
+  }
+
+  *Event = NewEvent;
+  return EFI_SUCCESS;
+}
+
+/**
+  Closes an event.
+
+  @param  Event  The event to close.
+
+  @retval EFI_SUCCESS  The event is closed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  if (Event == mReapTimer) {
+    mReapTimer = NULL;
+  }
+
+  RemoveEntryList (&((TEST_EVENT *)Event)->Link);
+  FreePool (Event);
+  return EFI_SUCCESS;
+}
+
+/**
+  Signals an event, and dispatches it if its TPL is above the current TPL.
+
+  @param  Event  The event to signal.
+
+  @retval EFI_SUCCESS  The event is signaled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((TEST_EVENT *)Event)->Signaled = TRUE;
+  DispatchEvents ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Arms or cancels a timer event.
+
+  @param  Event        The timer event.
+  @param  Type         The type of the timer.
+  @param  TriggerTime  The period of the timer, in 100ns units.
+
+  @retval EFI_SUCCESS  The timer is set.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  ASSERT ((((TEST_EVENT *)Event)->Type & EVT_TIMER) != 0);
+  ((TEST_EVENT *)Event)->TimerArmed = (BOOLEAN)(Type != TimerCancel);
+  if (Type != TimerCancel) {
+    mTimerArms++;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Stalls the processor, and lets time pass.
+
+  @param  Microseconds  The number of microseconds to stall.
+
+  @retval EFI_SUCCESS  The stall is over.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestStall (
+  IN UINTN  Microseconds
+  )
+{
+  Tick ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Opens the virtio device protocol for the driver, or returns the Block I/O
+  protocol that it installed.
+
+  @param  Handle            The handle of the device.
+  @param  Protocol          The GUID of the protocol.
+  @param  Interface         The interface returned.
+  @param  AgentHandle       The agent opening the protocol.
+  @param  ControllerHandle  The controller handle.
+  @param  Attributes        The open mode.
+
+  @retval EFI_SUCCESS      The protocol is returned.
+  @retval EFI_UNSUPPORTED  The device does not have the protocol.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestOpenProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Protocol,
+  OUT VOID        **Interface OPTIONAL,
+  IN  EFI_HANDLE  AgentHandle,
+  IN  EFI_HANDLE  ControllerHandle,
+  IN  UINT32      Attributes
+  )
+{
+  if (CompareGuid (Protocol, &gVirtioDeviceProtocolGuid)) {
+    *Interface = &mVirtIo;
+    return EFI_SUCCESS;
+  }
+
+  if (CompareGuid (Protocol, &gEfiBlockIoProtocolGuid) && (mBlockIo != NULL)) {
+    *Interface = mBlockIo;
+    return EFI_SUCCESS;
+  }
+
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Closes a protocol, the test does not track the opens.
+
+  @param  Handle            The handle of the device.
+  @param  Protocol          The GUID of the protocol.
+  @param  AgentHandle       The agent that opened the protocol.
+  @param  ControllerHandle  The controller handle.
+
+  @retval EFI_SUCCESS  The protocol is closed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCloseProtocol (
+  IN EFI_HANDLE  Handle,
+  IN EFI_GUID    *Protocol,
+  IN EFI_HANDLE  AgentHandle,
+  IN EFI_HANDLE  ControllerHandle
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Records the Block I/O and Block I/O 2 protocols that the driver installs.
+
+  @param  Handle  The handle to install the protocols on.
+  @param  ...     Pairs of protocol GUIDs and interfaces, terminated by NULL.
+
+  @retval EFI_SUCCESS  The protocols are installed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestInstallMultipleProtocolInterfaces (
+  IN OUT EFI_HANDLE  *Handle,
+  ...
+  )
+{
+  VA_LIST   Args;
+  EFI_GUID  *Protocol;
+  VOID      *Interface;
+
+  VA_START (Args, Handle);
+  for (Protocol = VA_ARG (Args, EFI_GUID *); Protocol != NULL; Protocol = VA_ARG (Args, EFI_GUID *)) {
+    Interface = VA_ARG (Args, VOID *);
+    if (CompareGuid (Protocol, &gEfiBlockIoProtocolGuid)) {
+      mBlockIo = Interface;
+    } else if (CompareGuid (Protocol, &gEfiBlockIo2ProtocolGuid)) {
+      mBlockIo2 = Interface;
+    }
+  }
+
+  VA_END (Args);
+  return EFI_SUCCESS;
+}
+
+/**
+  Forgets the Block I/O and Block I/O 2 protocols of the driver.
+
+  @param  Handle  The handle to uninstall the protocols from.
+  @param  ...     Pairs of protocol GUIDs and interfaces, terminated by NULL.
+
+  @retval EFI_SUCCESS  The protocols are uninstalled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestUninstallMultipleProtocolInterfaces (
+  IN EFI_HANDLE  Handle,
+  ...
+  )
+{
+  mBlockIo  = NULL;
+  mBlockIo2 = NULL;
+  return EFI_SUCCESS;
+}
+
+/**
+  Installs the driver binding and component name protocols, which the test
+  does not use.
+
+  @param  ImageHandle          The image handle of the driver.
+  @param  SystemTable          The EFI System Table.
+  @param  DriverBinding        The driver binding protocol.
+  @param  DriverBindingHandle  The handle to install the protocols on.
+  @param  ComponentName        The component name protocol.
+  @param  ComponentName2       The component name 2 protocol.
+
+  @retval EFI_SUCCESS  The protocols are installed.
+
+**/
+EFI_STATUS
+EFIAPI
+EfiLibInstallDriverBindingComponentName2 (
+  IN CONST EFI_HANDLE                    ImageHandle,
+  IN CONST EFI_SYSTEM_TABLE              *SystemTable,
+  IN EFI_DRIVER_BINDING_PROTOCOL         *DriverBinding,
+  IN EFI_HANDLE                          DriverBindingHandle,
+  IN CONST EFI_COMPONENT_NAME_PROTOCOL   *ComponentName   OPTIONAL,
+  IN CONST EFI_COMPONENT_NAME2_PROTOCOL  *ComponentName2  OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Looks up the name of the driver, which the test does not use.
+
+  @param  Language              The language of the name.
+  @param  SupportedLanguages    The languages of the table.
+  @param  UnicodeStringTable    The table of names.
+  @param  UnicodeString         The name returned.
+  @param  Iso639Language        TRUE for ISO 639-2 language codes.
+
+  @retval EFI_UNSUPPORTED  The test does not support names.
+
+**/
+EFI_STATUS
+EFIAPI
+LookupUnicodeString2 (
+  IN CONST CHAR8                     *Language,
+  IN CONST CHAR8                     *SupportedLanguages,
+  IN CONST EFI_UNICODE_STRING_TABLE  *UnicodeStringTable,
+  OUT CHAR16                         **UnicodeString,
+  IN BOOLEAN                         Iso639Language
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Sets the status of the virtio device.
+
+  @param  This          The virtio device protocol.
+  @param  DeviceStatus  The new status.
+
+  @retval EFI_SUCCESS  The status is set.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetDeviceStatus (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT8                   DeviceStatus
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Returns the features of the virtio device.
+
+  @param  This            The virtio device protocol.
+  @param  DeviceFeatures  The features returned.
+
+  @retval EFI_SUCCESS  The features are returned.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestGetDeviceFeatures (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  OUT UINT64                  *DeviceFeatures
+  )
+{
+  *DeviceFeatures = VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_SIZE_MAX;
+  if (mConfig.WriteCaching) {
+    *DeviceFeatures |= VIRTIO_BLK_F_FLUSH;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Reads the configuration of the virtio device, only its capacity is not
+  zero.
+
+  @param  This         The virtio device protocol.
+  @param  FieldOffset  The offset of the field.
+  @param  FieldSize    The size of the field.
+  @param  BufferSize   The size of Buffer.
+  @param  Buffer       The buffer to receive the field.
+
+  @retval EFI_SUCCESS  The field is read.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadDevice (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  IN  UINTN                   FieldOffset,
+  IN  UINTN                   FieldSize,
+  IN  UINTN                   BufferSize,
+  OUT VOID                    *Buffer
+  )
+{
+  UINT64  Value;
+
+  Value = (FieldOffset == OFFSET_OF (VIRTIO_BLK_CONFIG, Capacity)) ? TEST_DISK_SIZE / 512 : 0;
+  CopyMem (Buffer, &Value, BufferSize);
+  return EFI_SUCCESS;
+}
+
+/**
+  Accepts a value the driver writes to the virtio device.
+
+  @param  This   The virtio device protocol.
+  @param  Value  The value.
+
+  @retval EFI_SUCCESS  The value is written.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetUint16 (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT16                  Value
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Accepts a value the driver writes to the virtio device.
+
+  @param  This   The virtio device protocol.
+  @param  Value  The value.
+
+  @retval EFI_SUCCESS  The value is written.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetUint32 (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT32                  Value
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Accepts the features the driver negotiates.
+
+  @param  This      The virtio device protocol.
+  @param  Features  The features.
+
+  @retval EFI_SUCCESS  The features are set.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetGuestFeatures (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT64                  Features
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Returns the size of the queue of the virtio device.
+
+  @param  This            The virtio device protocol.
+  @param  QueueNumMax     The size returned.
+
+  @retval EFI_SUCCESS  The size is returned.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestGetQueueNumMax (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  OUT UINT16                  *QueueNumMax
+  )
+{
+  *QueueNumMax = mConfig.QueueSize;
+  return EFI_SUCCESS;
+}
+
+/**
+  Records the ring of the queue of the virtio device.
+
+  @param  This           The virtio device protocol.
+  @param  Ring           The ring.
+  @param  RingBaseShift  The offset of the device addresses of the ring.
+
+  @retval EFI_SUCCESS  The ring is recorded.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetQueueAddress (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN VRING                   *Ring,
+  IN UINT64                  RingBaseShift
+  )
+{
+  mRing = Ring;
+  return EFI_SUCCESS;
+}
+
+/**
+  Notifies the virtio device, which processes requests sometimes.
+
+  @param  This         The virtio device protocol.
+  @param  QueueNotify  The index of the queue.
+
+  @retval EFI_SUCCESS  The device is notified.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetQueueNotify (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT16                  QueueNotify
+  )
+{
+  if (NextRandom () % 4 == 0) {
+    ProcessRequests ();
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Allocates pages shared with the virtio device.
+
+  @param  This         The virtio device protocol.
+  @param  Pages        The number of pages.
+  @param  HostAddress  The pages returned.
+
+  @retval EFI_SUCCESS           The pages are allocated.
+  @retval EFI_OUT_OF_RESOURCES  The pages cannot be allocated.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestAllocateSharedPages (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  IN  UINTN                   Pages,
+  OUT VOID                    **HostAddress
+  )
+{
+  *HostAddress = AllocateAlignedPages (Pages, EFI_PAGE_SIZE);
+  return (*HostAddress == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+/**
+  Frees pages shared with the virtio device.
+
+  @param  This         The virtio device protocol.
+  @param  Pages        The number of pages.
+  @param  HostAddress  The pages.
+
+**/
+STATIC
+VOID
+EFIAPI
+TestFreeSharedPages (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINTN                   Pages,
+  IN VOID                    *HostAddress
+  )
+{
+  FreeAlignedPages (HostAddress, Pages);
+}
+
+/**
+  Maps a buffer for the virtio device. The buffers other than the common
+  buffers are bounced, and the bounce buffer of a read is filled with a
+  pattern, so that data that does not go through the mapping is detected.
+
+  @param  This           The virtio device protocol.
+  @param  Operation      The direction of the transfers.
+  @param  HostAddress    The buffer.
+  @param  NumberOfBytes  The size of the buffer.
+  @param  DeviceAddress  The device address returned.
+  @param  Mapping        The mapping returned.
+
+  @retval EFI_SUCCESS           The buffer is mapped.
+  @retval EFI_OUT_OF_RESOURCES  The mapping cannot be allocated.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestMapSharedBuffer (
+  IN     VIRTIO_DEVICE_PROTOCOL  *This,
+  IN     VIRTIO_MAP_OPERATION    Operation,
+  IN     VOID                    *HostAddress,
+  IN OUT UINTN                   *NumberOfBytes,
+  OUT    EFI_PHYSICAL_ADDRESS    *DeviceAddress,
+  OUT    VOID                    **Mapping
+  )
+{
+  TEST_MAPPING  *Map;
+
+  Map = AllocatePool (sizeof (TEST_MAPPING));
+  if (Map == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Map->Operation     = Operation;
+  Map->HostAddress   = HostAddress;
+  Map->NumberOfBytes = *NumberOfBytes;
+  if (Operation == VirtioOperationBusMasterCommonBuffer) {
+    Map->DeviceAddress = HostAddress;
+  } else {
+    Map->DeviceAddress = AllocatePool (*NumberOfBytes);
+    if (Map->DeviceAddress == NULL) {
+      FreePool (Map);
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    if (Operation == VirtioOperationBusMasterRead) {
+      CopyMem (Map->DeviceAddress, HostAddress, *NumberOfBytes);
+    } else {
+      SetMem (Map->DeviceAddress, *NumberOfBytes, 0xEE);
+    }
+  }
+
+  *DeviceAddress = (EFI_PHYSICAL_ADDRESS)(UINTN)Map->DeviceAddress;
+  *Mapping       = Map;
+  return EFI_SUCCESS;
+}
+
+/**
+  Unmaps a buffer of the virtio device, and copies the data the device wrote
+  back to the buffer.
+
+  @param  This     The virtio device protocol.
+  @param  Mapping  The mapping.
+
+  @retval EFI_SUCCESS  The buffer is unmapped.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestUnmapSharedBuffer (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN VOID                    *Mapping
+  )
+{
+  TEST_MAPPING  *Map;
+
+  Map = Mapping;
+  if (Map->Operation == VirtioOperationBusMasterWrite) {
+    CopyMem (Map->HostAddress, Map->DeviceAddress, Map->NumberOfBytes);
+  }
+
+  if (Map->Operation != VirtioOperationBusMasterCommonBuffer) {
+    SetMem (Map->DeviceAddress, Map->NumberOfBytes, 0xDD);
+    FreePool (Map->DeviceAddress);
+  }
+
+  FreePool (Map);
+  return EFI_SUCCESS;
+}
+
+/**
+  Starts the driver on a simulated virtio-blk device whose disk and model are
+  filled with the same random data.
+
+  @param  Config  The configuration of the device.
+
+  @retval EFI_SUCCESS  The driver installed Block I/O and Block I/O 2.
+  @return              The error of the driver binding Start() function.
+
+**/
+STATIC
+EFI_STATUS
+StartTestDevice (
+  IN CONST TEST_DEVICE_CONFIG  *Config
+  )
+{
+  UINTN  Index;
+
+  mBootServices.RaiseTPL                            = TestRaiseTpl;
+  mBootServices.RestoreTPL                          = TestRestoreTpl;
+  mBootServices.CreateEvent                         = TestCreateEvent;
+  mBootServices.CloseEvent                          = TestCloseEvent;
+  mBootServices.SignalEvent                         = TestSignalEvent;
+  mBootServices.SetTimer                            = TestSetTimer;
+  mBootServices.Stall                               = TestStall;
+  mBootServices.OpenProtocol                        = TestOpenProtocol;
+  mBootServices.CloseProtocol                       = TestCloseProtocol;
+  mBootServices.InstallMultipleProtocolInterfaces   = TestInstallMultipleProtocolInterfaces;
+  mBootServices.UninstallMultipleProtocolInterfaces = TestUninstallMultipleProtocolInterfaces;
+  gBS                                               = &mBootServices;
+
+  mVirtIo.Revision            = VIRTIO_SPEC_REVISION (0, 9, 5);
+  mVirtIo.SubSystemDeviceId   = VIRTIO_SUBSYSTEM_BLOCK_DEVICE;
+  mVirtIo.SetDeviceStatus     = TestSetDeviceStatus;
+  mVirtIo.GetDeviceFeatures   = TestGetDeviceFeatures;
+  mVirtIo.SetGuestFeatures    = TestSetGuestFeatures;
+  mVirtIo.ReadDevice          = TestReadDevice;
+  mVirtIo.SetPageSize         = TestSetUint32;
+  mVirtIo.SetQueueSel         = TestSetUint16;
+  mVirtIo.GetQueueNumMax      = TestGetQueueNumMax;
+  mVirtIo.SetQueueNum         = TestSetUint16;
+  mVirtIo.SetQueueAlign       = TestSetUint32;
+  mVirtIo.SetQueueAddress     = TestSetQueueAddress;
+  mVirtIo.SetQueueNotify      = TestSetQueueNotify;
+  mVirtIo.AllocateSharedPages = TestAllocateSharedPages;
+  mVirtIo.FreeSharedPages     = TestFreeSharedPages;
+  mVirtIo.MapSharedBuffer     = TestMapSharedBuffer;
+  mVirtIo.UnmapSharedBuffer   = TestUnmapSharedBuffer;
+
+  mConfig         = *Config;
+  mRing           = NULL;
+  mHostAvailIdx   = 0;
+  mTakenCount     = 0;
+  mMaxInFlight    = 0;
+  mHostFlushes    = 0;
+  mTimerArms      = 0;
+  mOperationCount = 0;
+
+  for (Index = 0; Index < TEST_DISK_SIZE; Index++) {
+    mDisk[Index]  = (UINT8)NextRandom ();
+    mModel[Index] = mDisk[Index];
+  }
+
+  return VirtioBlkDriverBindingStart (&mDriverBinding, &mVirtIo, NULL);
+}
+
+/**
+  Retires the completed non-blocking requests, and checks the data they read.
+
+  @param  Lba         The first block of the next request.
+  @param  BufferSize  The size of the next request.
+  @param  Write       TRUE if the next request is a write.
+
+  @retval TRUE   A request in flight accesses blocks of the next request, and
+                 one of them writes.
+  @retval FALSE  The next request can be submitted.
+
+**/
+STATIC
+BOOLEAN
+RetireOperations (
+  IN EFI_LBA  Lba,
+  IN UINTN    BufferSize,
+  IN BOOLEAN  Write
+  )
+{
+  UINTN           Index;
+  TEST_OPERATION  *Operation;
+  BOOLEAN         Overlap;
+
+  Overlap = FALSE;
+  for (Index = 0; Index < mOperationCount; Index++) {
+    Operation = &mOperations[Index];
+    if (Operation->Done) {
+      continue;
+    }
+
+    if (((TEST_EVENT *)Operation->Token.Event)->Signaled) {
+      ASSERT_EFI_ERROR (Operation->Token.TransactionStatus);
+      if (Operation->Expected != NULL) {
+        ASSERT (CompareMem (Operation->Buffer, Operation->Expected, Operation->BufferSize) == 0);
+        FreePool (Operation->Expected);
+      }
+
+      gBS->CloseEvent (Operation->Token.Event);
+      if (Operation->Buffer != NULL) {
+        FreePool (Operation->Buffer);
+      }
+
+      Operation->Done = TRUE;
+      continue;
+    }
+
+    if ((Write || Operation->Write) && !Operation->Flush &&
+        (Lba < Operation->Lba + Operation->BufferSize / TEST_BLOCK_SIZE) &&
+        (Operation->Lba < Lba + BufferSize / TEST_BLOCK_SIZE))
+    {
+      Overlap = TRUE;
+    }
+  }
+
+  return Overlap;
+}
+
+/**
+  Lets time pass until the driver completed all the non-blocking requests.
+
+**/
+STATIC
+VOID
+DrainOperations (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < mOperationCount; Index++) {
+    while (!mOperations[Index].Done) {
+      Tick ();
+      RetireOperations (0, 0, FALSE);
+    }
+  }
+
+  mOperationCount = 0;
+}
+
+/**
+  Reads, writes and flushes random blocks of the device, blocking and
+  non-blocking, and checks the data read and the disk content against a
+  model of the disk.
+
+  @param[in]  Context  The configuration of the device.
+
+  @retval  UNIT_TEST_PASSED             The data matches the model.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The data does not match the model.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RandomRequestsMatchDisk (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_OPERATION  *Operation;
+  UINTN           Iteration;
+  UINTN           Kind;
+  UINTN           Index;
+  EFI_LBA         Lba;
+  UINTN           BlockCount;
+  UINTN           BufferSize;
+  UINT8           *Buffer;
+  BOOLEAN         Write;
+  EFI_STATUS      Status;
+
+  mSeed = 1;
+  UT_ASSERT_NOT_EFI_ERROR (StartTestDevice (Context));
+  UT_ASSERT_NOT_NULL (mBlockIo);
+  UT_ASSERT_NOT_NULL (mBlockIo2);
+
+  for (Iteration = 0; Iteration < TEST_ITERATIONS; Iteration++) {
+    Kind       = NextRandom () % 12;
+    Write      = (BOOLEAN)((Kind >= 6) && (Kind < 11));
+    BlockCount = 1 + ((NextRandom () % 4 != 0) ? NextRandom () % 8 : NextRandom () % 64);
+    Lba        = (NextRandom () % 4 != 0) ? NextRandom () % 64 : NextRandom () % (TEST_BLOCK_COUNT - BlockCount);
+    Lba        = MIN (Lba, TEST_BLOCK_COUNT - BlockCount);
+    BufferSize = BlockCount * TEST_BLOCK_SIZE;
+
+    if (mOperationCount == TEST_MAX_OPERATIONS) {
+      DrainOperations ();
+    }
+
+    if (Kind == 11) {
+      if (NextRandom () % 2 == 0) {
+        UT_ASSERT_NOT_EFI_ERROR (mBlockIo->FlushBlocks (mBlockIo));
+        UT_ASSERT_NOT_EFI_ERROR (mBlockIo2->FlushBlocksEx (mBlockIo2, NULL));
+        continue;
+      }
+
+      Operation = &mOperations[mOperationCount++];
+      ZeroMem (Operation, sizeof (TEST_OPERATION));
+      Operation->Write = TRUE;
+      Operation->Flush = TRUE;
+      UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operation->Token.Event));
+      UT_ASSERT_NOT_EFI_ERROR (mBlockIo2->FlushBlocksEx (mBlockIo2, &Operation->Token));
+      continue;
+    }
+
+    while (RetireOperations (Lba, BufferSize, Write)) {
+      Tick ();
+    }
+
+    Buffer = AllocatePool (BufferSize);
+    UT_ASSERT_NOT_NULL (Buffer);
+    if (Write) {
+      for (Index = 0; Index < BufferSize; Index++) {
+        Buffer[Index] = (UINT8)NextRandom ();
+      }
+
+      CopyMem (mModel + Lba * TEST_BLOCK_SIZE, Buffer, BufferSize);
+    }
+
+    if (Kind % 3 == 0) {
+      if (Write) {
+        Status = (NextRandom () % 2 == 0) ?
+                 mBlockIo->WriteBlocks (mBlockIo, 0, Lba, BufferSize, Buffer) :
+                 mBlockIo2->WriteBlocksEx (mBlockIo2, 0, Lba, NULL, BufferSize, Buffer);
+        UT_ASSERT_NOT_EFI_ERROR (Status);
+      } else {
+        Status = (NextRandom () % 2 == 0) ?
+                 mBlockIo->ReadBlocks (mBlockIo, 0, Lba, BufferSize, Buffer) :
+                 mBlockIo2->ReadBlocksEx (mBlockIo2, 0, Lba, NULL, BufferSize, Buffer);
+        UT_ASSERT_NOT_EFI_ERROR (Status);
+        UT_ASSERT_MEM_EQUAL (Buffer, mModel + Lba * TEST_BLOCK_SIZE, BufferSize);
+      }
+
+      FreePool (Buffer);
+      continue;
+    }
+
+    Operation = &mOperations[mOperationCount++];
+    ZeroMem (Operation, sizeof (TEST_OPERATION));
+    Operation->Write      = Write;
+    Operation->Lba        = Lba;
+    Operation->BufferSize = BufferSize;
+    Operation->Buffer     = Buffer;
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operation->Token.Event));
+    if (Write) {
+      Status = mBlockIo2->WriteBlocksEx (mBlockIo2, 0, Lba, &Operation->Token, BufferSize, Buffer);
+    } else {
+      Operation->Expected = AllocateCopyPool (BufferSize, mModel + Lba * TEST_BLOCK_SIZE);
+      UT_ASSERT_NOT_NULL (Operation->Expected);
+      Status = mBlockIo2->ReadBlocksEx (mBlockIo2, 0, Lba, &Operation->Token, BufferSize, Buffer);
+    }
+
+    UT_ASSERT_NOT_EFI_ERROR (Status);
+  }
+
+  //
+  // The host cannot cancel requests, ResetEx() waits for them
+  //
+  UT_ASSERT_NOT_EFI_ERROR (mBlockIo2->Reset (mBlockIo2, FALSE));
+  RetireOperations (0, 0, FALSE);
+  for (Index = 0; Index < mOperationCount; Index++) {
+    UT_ASSERT_TRUE (mOperations[Index].Done);
+  }
+
+  UT_ASSERT_NOT_NULL (mReapTimer);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  UT_ASSERT_MEM_EQUAL (mDisk, mModel, TEST_DISK_SIZE);
+  //
+  // A read or write takes three descriptors
+  //
+  UT_ASSERT_EQUAL (mMaxInFlight > 1, mConfig.QueueSize >= 6);
+  UT_ASSERT_EQUAL (mHostFlushes > 0, mConfig.WriteCaching);
+
+  UT_LOG_INFO (
+    "queue size %d: max in flight %d, timer armed %d times\n",
+    mConfig.QueueSize,
+    (UINT32)mMaxInFlight,
+    (UINT32)mTimerArms
+    );
+
+  UT_ASSERT_NOT_EFI_ERROR (VirtioBlkDriverBindingStop (&mDriverBinding, &mVirtIo, 0, NULL));
+  UT_ASSERT_TRUE (IsListEmpty (&mEvents));
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that the timer that reaps the completed requests runs only while
+  non-blocking requests are outstanding.
+
+  @param[in]  Context  The configuration of the device.
+
+  @retval  UNIT_TEST_PASSED             The timer runs only when needed.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The timer runs while the device is
+                                        idle, or not while a non-blocking
+                                        request is outstanding.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ReapTimerRunsOnlyWhenNeeded (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  EFI_BLOCK_IO2_TOKEN  Tokens[2];
+  UINT8                Buffer[2][TEST_BLOCK_SIZE];
+  UINTN                Index;
+
+  mSeed = 2;
+  UT_ASSERT_NOT_EFI_ERROR (StartTestDevice (Context));
+  UT_ASSERT_NOT_NULL (mReapTimer);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+
+  //
+  // Blocking requests poll for their completion
+  //
+  UT_ASSERT_NOT_EFI_ERROR (mBlockIo->ReadBlocks (mBlockIo, 0, 0, TEST_BLOCK_SIZE, Buffer[0]));
+  UT_ASSERT_NOT_EFI_ERROR (mBlockIo2->WriteBlocksEx (mBlockIo2, 0, 1, NULL, TEST_BLOCK_SIZE, Buffer[0]));
+  CopyMem (mModel + TEST_BLOCK_SIZE, Buffer[0], TEST_BLOCK_SIZE);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  UT_ASSERT_EQUAL (mTimerArms, 0);
+
+  //
+  // The timer runs from the first non-blocking request until the last one
+  // completes, and only the timer completes them
+  //
+  for (Index = 0; Index < ARRAY_SIZE (Tokens); Index++) {
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Tokens[Index].Event));
+    UT_ASSERT_NOT_EFI_ERROR (mBlockIo2->ReadBlocksEx (mBlockIo2, 0, Index, &Tokens[Index], TEST_BLOCK_SIZE, Buffer[Index]));
+    UT_ASSERT_TRUE (mReapTimer->TimerArmed);
+  }
+
+  UT_ASSERT_EQUAL (mTimerArms, 1);
+  while (!((TEST_EVENT *)Tokens[0].Event)->Signaled || !((TEST_EVENT *)Tokens[1].Event)->Signaled) {
+    UT_ASSERT_TRUE (mReapTimer->TimerArmed);
+    Tick ();
+  }
+
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  for (Index = 0; Index < ARRAY_SIZE (Tokens); Index++) {
+    UT_ASSERT_NOT_EFI_ERROR (Tokens[Index].TransactionStatus);
+    UT_ASSERT_MEM_EQUAL (Buffer[Index], mModel + Index * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+    gBS->CloseEvent (Tokens[Index].Event);
+  }
+
+  //
+  // It is armed again for the next one
+  //
+  UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Tokens[0].Event));
+  UT_ASSERT_NOT_EFI_ERROR (mBlockIo2->FlushBlocksEx (mBlockIo2, &Tokens[0]));
+  UT_ASSERT_TRUE (mReapTimer->TimerArmed);
+  UT_ASSERT_EQUAL (mTimerArms, 2);
+  UT_ASSERT_NOT_EFI_ERROR (mBlockIo2->Reset (mBlockIo2, FALSE));
+  UT_ASSERT_TRUE (((TEST_EVENT *)Tokens[0].Event)->Signaled);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  gBS->CloseEvent (Tokens[0].Event);
+
+  UT_ASSERT_NOT_EFI_ERROR (VirtioBlkDriverBindingStop (&mDriverBinding, &mVirtIo, 0, NULL));
+  UT_ASSERT_TRUE (IsListEmpty (&mEvents));
+  return UNIT_TEST_PASSED;
+}
+
+STATIC CONST TEST_DEVICE_CONFIG  mSmallQueue    = { 3, TRUE };
+STATIC CONST TEST_DEVICE_CONFIG  mMediumQueue   = { 16, TRUE };
+STATIC CONST TEST_DEVICE_CONFIG  mLargeNoCache  = { 256, FALSE };
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the request
+  engine of the virtio-blk driver and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      RequestTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&RequestTests, Framework, "Virtio Block Request Tests", "VirtioBlk.Requests", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Virtio Block Request Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite-----------Description-------------------------------------------Name-------------Function-------------------Pre---Post---Context------------------------------
+  //
+  AddTestCase (RequestTests, "Requests on a queue of 3 match the disk", "SmallQueue", RandomRequestsMatchDisk, NULL, NULL, (UNIT_TEST_CONTEXT)&mSmallQueue);
+  AddTestCase (RequestTests, "Requests on a queue of 16 match the disk", "MediumQueue", RandomRequestsMatchDisk, NULL, NULL, (UNIT_TEST_CONTEXT)&mMediumQueue);
+  AddTestCase (RequestTests, "Requests without write caching match the disk", "LargeNoCache", RandomRequestsMatchDisk, NULL, NULL, (UNIT_TEST_CONTEXT)&mLargeNoCache);
+  AddTestCase (RequestTests, "Reap timer runs only with non-blocking requests", "ReapTimer", ReapTimerRunsOnlyWhenNeeded, NULL, NULL, (UNIT_TEST_CONTEXT)&mMediumQueue);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define VirtioBlkUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+VirtioBlkUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
@@ -1,14 +1,16 @@
 /** @file
 
-  This driver produces Block I/O Protocol instances for virtio-blk devices.
+  This driver produces Block I/O and Block I/O 2 Protocol instances for
+  virtio-blk devices.
 
   The implementation is basic:
 
   - No attach/detach (ie. removable media).
 
-  - Although the non-blocking interfaces of EFI_BLOCK_IO2_PROTOCOL could be a
-    good match for multiple in-flight virtio-blk requests, we stick to
-    synchronous requests and EFI_BLOCK_IO_PROTOCOL for now.
+  - Requests go through the single "requestq" virtqueue. Up to
+    VBLK_MAX_IN_FLIGHT requests are in flight at once, each in a slot of three
+    descriptors; further requests wait in a FIFO queue. Completions are polled,
+    either by blocking callers or by a periodic timer.
 
   Copyright (C) 2012, Red Hat, Inc.
   Copyright (c) 2012 - 2018, Intel Corporation. All rights reserved.<BR>
@@ -18,6 +20,8 @@
 
 **/
 
+#include <Uefi.h>
+
 #include <IndustryStandard/VirtioBlk.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
@@ -176,203 +180,107 @@ VerifyReadWriteRequest (
 
 /**
 
-  Format a read / write / flush request as three consecutive virtio
-  descriptors, push them to the host, and poll for the response.
-
-  This is the main workhorse function. Two use cases are supported, read/write
-  and flush. The function may only be called after the request parameters have
-  been verified by
-  - specific checks in ReadBlocks() / WriteBlocks() / FlushBlocks(), and
-  - VerifyReadWriteRequest() (for read/write only).
-
-  Parameters handled commonly:
-
-    @param[in] Dev             The virtio-blk device the request is targeted
-                               at.
-
-  Flush request:
-
-    @param[in] Lba             Must be zero.
+  Format a read / write / flush request as two or three consecutive virtio
+  descriptors in a free slot, and push them to the host without waiting for
+  the response.
 
-    @param[in] BufferSize      Must be zero.
+  The caller is responsible for raising the TPL to TPL_NOTIFY, and for
+  verifying the request parameters as described for SynchronousRequest().
 
-    @param[in out] Buffer      Ignored by the function.
+  @param[in] Dev      The virtio-blk device the request is targeted at.
 
-    @param[in] RequestIsWrite  Must be TRUE.
-
-  Read/Write request:
-
-    @param[in] Lba             Logical Block Address: number of logical blocks
-                               to skip from the beginning of the device.
-
-    @param[in] BufferSize      Size of buffer to transfer, in bytes. The caller
-                               is responsible to ensure this parameter is
-                               positive.
-
-    @param[in out] Buffer      The guest side area to read data from the device
-                               into, or write data to the device from.
-
-    @param[in] RequestIsWrite  TRUE iff data transfer goes from guest to
-                               device.
+  @param[in] SlotIdx  The free slot to carry the request.
 
-  Return values are common to both use cases, and are appropriate to be
-  forwarded by the EFI_BLOCK_IO_PROTOCOL functions (ReadBlocks(),
-  WriteBlocks(), FlushBlocks()).
+  @param[in] Req      The request to submit.
 
 
-  @retval EFI_SUCCESS          Transfer complete.
+  @retval EFI_SUCCESS       The request has been made available to the host.
 
-  @retval EFI_DEVICE_ERROR     Failed to notify host side via VirtIo write, or
-                               unable to parse host response, or host response
-                               is not VIRTIO_BLK_S_OK or failed to map Buffer
-                               for a bus master operation.
+  @retval EFI_DEVICE_ERROR  Failed to map Req->Buffer for a bus master
+                            operation, or failed to notify the host side via
+                            VirtIo write.
 
 **/
 STATIC
 EFI_STATUS
-EFIAPI
-SynchronousRequest (
-  IN              VBLK_DEV  *Dev,
-  IN              EFI_LBA   Lba,
-  IN              UINTN     BufferSize,
-  IN OUT volatile VOID      *Buffer,
-  IN              BOOLEAN   RequestIsWrite
+SubmitRequest (
+  IN VBLK_DEV  *Dev,
+  IN UINT16    SlotIdx,
+  IN VBLK_REQ  *Req
   )
 {
-  UINT32                   BlockSize;
-  volatile VIRTIO_BLK_REQ  Request;
-  volatile UINT8           *HostStatus;
-  VOID                     *HostStatusBuffer;
-  DESC_INDICES             Indices;
-  VOID                     *RequestMapping;
-  VOID                     *StatusMapping;
-  VOID                     *BufferMapping;
-  EFI_PHYSICAL_ADDRESS     BufferDeviceAddress;
-  EFI_PHYSICAL_ADDRESS     HostStatusDeviceAddress;
-  EFI_PHYSICAL_ADDRESS     RequestDeviceAddress;
-  EFI_STATUS               Status;
-  EFI_STATUS               UnmapStatus;
-
-  BlockSize = Dev->BlockIoMedia.BlockSize;
-
-  //
-  // Set BufferMapping and BufferDeviceAddress to suppress incorrect
-  // compiler/analyzer warnings.
-  //
+  UINT32                     BlockSize;
+  volatile VBLK_SHARED_SLOT  *Shared;
+  EFI_PHYSICAL_ADDRESS       SharedDeviceAddress;
+  VOID                       *BufferMapping;
+  EFI_PHYSICAL_ADDRESS       BufferDeviceAddress;
+  DESC_INDICES               Indices;
+  UINT16                     AvailIdx;
+  EFI_STATUS                 Status;
+
+  BlockSize           = Dev->BlockIoMedia.BlockSize;
+  Shared              = &Dev->Shared[SlotIdx];
+  SharedDeviceAddress = Dev->SharedDeviceAddr +
+                        SlotIdx * sizeof (VBLK_SHARED_SLOT);
   BufferMapping       = NULL;
   BufferDeviceAddress = 0;
 
-  //
-  // ensured by VirtioBlkInit()
-  //
-  ASSERT (BlockSize > 0);
-  ASSERT (BlockSize % 512 == 0);
-
-  //
-  // ensured by contract above, plus VerifyReadWriteRequest()
-  //
-  ASSERT (BufferSize % BlockSize == 0);
+  ASSERT (Dev->Slots[SlotIdx].Req == NULL);
+  ASSERT (Req->BufferSize % BlockSize == 0);
 
   //
   // Prepare virtio-blk request header, setting zero size for flush.
   // IO Priority is homogeneously 0.
   //
-  Request.Type = RequestIsWrite ?
-                 (BufferSize == 0 ? VIRTIO_BLK_T_FLUSH : VIRTIO_BLK_T_OUT) :
-                 VIRTIO_BLK_T_IN;
-  Request.IoPrio = 0;
-  Request.Sector = MultU64x32 (Lba, BlockSize / 512);
-
-  //
-  // Host status is bi-directional (we preset with a value and expect the
-  // device to update it). Allocate a host status buffer which can be mapped
-  // to access equally by both processor and the device.
-  //
-  Status = Dev->VirtIo->AllocateSharedPages (
-                          Dev->VirtIo,
-                          EFI_SIZE_TO_PAGES (sizeof *HostStatus),
-                          &HostStatusBuffer
-                          );
-  if (EFI_ERROR (Status)) {
-    return EFI_DEVICE_ERROR;
-  }
-
-  HostStatus = HostStatusBuffer;
+  Shared->Request.Type = Req->RequestIsWrite ?
+                         (Req->BufferSize == 0 ? VIRTIO_BLK_T_FLUSH : VIRTIO_BLK_T_OUT) :
+                         VIRTIO_BLK_T_IN;
+  Shared->Request.IoPrio = 0;
+  Shared->Request.Sector = MultU64x32 (Req->Lba, BlockSize / 512);
 
   //
-  // Map virtio-blk request header (must be done after request header is
-  // populated)
+  // preset a host status for ourselves that we do not accept as success
   //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterRead,
-             (VOID *)&Request,
-             sizeof Request,
-             &RequestDeviceAddress,
-             &RequestMapping
-             );
-  if (EFI_ERROR (Status)) {
-    Status = EFI_DEVICE_ERROR;
-    goto FreeHostStatusBuffer;
-  }
+  Shared->HostStatus = VIRTIO_BLK_S_IOERR;
 
   //
   // Map data buffer
   //
-  if (BufferSize > 0) {
+  if (Req->BufferSize > 0) {
     Status = VirtioMapAllBytesInSharedBuffer (
                Dev->VirtIo,
-               (RequestIsWrite ?
+               (Req->RequestIsWrite ?
                 VirtioOperationBusMasterRead :
                 VirtioOperationBusMasterWrite),
-               (VOID *)Buffer,
-               BufferSize,
+               Req->Buffer,
+               Req->BufferSize,
                &BufferDeviceAddress,
                &BufferMapping
                );
     if (EFI_ERROR (Status)) {
-      Status = EFI_DEVICE_ERROR;
-      goto UnmapRequestBuffer;
+      return EFI_DEVICE_ERROR;
     }
   }
 
   //
-  // preset a host status for ourselves that we do not accept as success
+  // We're going to poll the answer, the host should not send an interrupt.
   //
-  *HostStatus = VIRTIO_BLK_S_IOERR;
+  *Dev->Ring.Avail.Flags = (UINT16)VRING_AVAIL_F_NO_INTERRUPT;
 
   //
-  // Map the Status Buffer with VirtioOperationBusMasterCommonBuffer so that
-  // both processor and device can access it.
+  // Each slot owns three consecutive descriptors, starting at the head
+  // descriptor of its chain. VirtioBlkInit() ensures they all exist.
   //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterCommonBuffer,
-             HostStatusBuffer,
-             sizeof *HostStatus,
-             &HostStatusDeviceAddress,
-             &StatusMapping
-             );
-  if (EFI_ERROR (Status)) {
-    Status = EFI_DEVICE_ERROR;
-    goto UnmapDataBuffer;
-  }
-
-  VirtioPrepare (&Dev->Ring, &Indices);
-
-  //
-  // ensured by VirtioBlkInit() -- this predicate, in combination with the
-  // lock-step progress, ensures we don't have to track free descriptors.
-  //
-  ASSERT (Dev->Ring.QueueSize >= 3);
+  Indices.HeadDescIdx = (UINT16)(SlotIdx * 3);
+  Indices.NextDescIdx = Indices.HeadDescIdx;
 
   //
   // virtio-blk header in first desc
   //
   VirtioAppendDesc (
     &Dev->Ring,
-    RequestDeviceAddress,
-    sizeof Request,
+    SharedDeviceAddress + OFFSET_OF (VBLK_SHARED_SLOT, Request),
+    sizeof Shared->Request,
     VRING_DESC_F_NEXT,
     &Indices
     );
@@ -380,16 +288,15 @@ SynchronousRequest (
   //
   // data buffer for read/write in second desc
   //
-  if (BufferSize > 0) {
+  if (Req->BufferSize > 0) {
     //
     // From virtio-0.9.5, 2.3.2 Descriptor Table:
     // "no descriptor chain may be more than 2^32 bytes long in total".
     //
-    // The predicate is ensured by the call contract above (for flush), or
-    // VerifyReadWriteRequest() (for read/write). It also implies that
-    // converting BufferSize to UINT32 will not truncate it.
+    // The predicate is ensured by VerifyReadWriteRequest(). It also implies
+    // that converting BufferSize to UINT32 will not truncate it.
     //
-    ASSERT (BufferSize <= SIZE_1GB);
+    ASSERT (Req->BufferSize <= SIZE_1GB);
 
     //
     // VRING_DESC_F_WRITE is interpreted from the host's point of view.
@@ -397,8 +304,8 @@ SynchronousRequest (
     VirtioAppendDesc (
       &Dev->Ring,
       BufferDeviceAddress,
-      (UINT32)BufferSize,
-      VRING_DESC_F_NEXT | (RequestIsWrite ? 0 : VRING_DESC_F_WRITE),
+      (UINT32)Req->BufferSize,
+      VRING_DESC_F_NEXT | (Req->RequestIsWrite ? 0 : VRING_DESC_F_WRITE),
       &Indices
       );
   }
@@ -408,53 +315,477 @@ SynchronousRequest (
   //
   VirtioAppendDesc (
     &Dev->Ring,
-    HostStatusDeviceAddress,
-    sizeof *HostStatus,
+    SharedDeviceAddress + OFFSET_OF (VBLK_SHARED_SLOT, HostStatus),
+    sizeof Shared->HostStatus,
     VRING_DESC_F_WRITE,
     &Indices
     );
 
+  Dev->Slots[SlotIdx].Req           = Req;
+  Dev->Slots[SlotIdx].BufferMapping = BufferMapping;
+  Dev->InFlight++;
+  if (Req->BufferSize == 0) {
+    Dev->FlushInFlight = TRUE;
+  }
+
+  //
+  // virtio-0.9.5, 2.4.1.2 Updating the Available Ring
+  //
+  // The available index is never written by the host, we can read it back
+  // without a barrier.
+  //
+  AvailIdx                                               = *Dev->Ring.Avail.Idx;
+  Dev->Ring.Avail.Ring[AvailIdx++ % Dev->Ring.QueueSize] = Indices.HeadDescIdx;
+
   //
-  // virtio-blk's only virtqueue is #0, called "requestq" (see Appendix D).
+  // virtio-0.9.5, 2.4.1.3 Updating the Index Field
   //
-  if ((VirtioFlush (
-         Dev->VirtIo,
-         0,
-         &Dev->Ring,
-         &Indices,
-         NULL
-         ) == EFI_SUCCESS) &&
-      (*HostStatus == VIRTIO_BLK_S_OK))
+  MemoryFence ();
+  *Dev->Ring.Avail.Idx = AvailIdx;
+
+  //
+  // virtio-0.9.5, 2.4.1.4 Notifying the Device -- virtio-blk's only virtqueue
+  // is #0, called "requestq" (see Appendix D). A failed notification leaves
+  // the request in flight; it completes whenever the host looks at the ring.
+  //
+  MemoryFence ();
+  Status = Dev->VirtIo->SetQueueNotify (Dev->VirtIo, 0);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: SetQueueNotify: %r\n", __FUNCTION__, Status));
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Report the outcome of a request to its submitter.
+
+  Non-blocking requests signal their token and are freed; blocking requests
+  are marked done for SynchronousRequest() to pick up. The reap timer is
+  cancelled when the last non-blocking request completes.
+
+  The caller is responsible for raising the TPL to TPL_NOTIFY.
+
+  @param[in] Dev     The virtio-blk device.
+
+  @param[in] Req     The request that has completed.
+
+  @param[in] Status  The outcome of the request.
+
+**/
+STATIC
+VOID
+CompleteRequest (
+  IN VBLK_DEV    *Dev,
+  IN VBLK_REQ    *Req,
+  IN EFI_STATUS  Status
+  )
+{
+  EFI_BLOCK_IO2_TOKEN  *Token;
+
+  Token = Req->Token;
+  if (Token == NULL) {
+    Req->Status = Status;
+    Req->Done   = TRUE;
+    return;
+  }
+
+  FreePool (Req);
+
+  ASSERT (Dev->AsyncPending > 0);
+  Dev->AsyncPending--;
+  if (Dev->AsyncPending == 0) {
+    gBS->SetTimer (Dev->ReapTimer, TimerCancel, 0);
+  }
+
+  Token->TransactionStatus = Status;
+  gBS->SignalEvent (Token->Event);
+}
+
+/**
+
+  Submit requests from the head of the pending queue, for as long as there are
+  free slots.
+
+  A flush request is only submitted when no other request is in flight, and no
+  request is submitted while a flush is in flight. This keeps the order of
+  writes and flushes that the callers observe.
+
+  The caller is responsible for raising the TPL to TPL_NOTIFY.
+
+  @param[in] Dev  The virtio-blk device.
+
+**/
+STATIC
+VOID
+StartPendingRequests (
+  IN VBLK_DEV  *Dev
+  )
+{
+  VBLK_REQ    *Req;
+  UINT16      SlotIdx;
+  EFI_STATUS  Status;
+
+  while (!IsListEmpty (&Dev->PendingQueue) && !Dev->FlushInFlight &&
+         (Dev->InFlight < Dev->SlotCount))
   {
-    Status = EFI_SUCCESS;
-  } else {
-    Status = EFI_DEVICE_ERROR;
+    Req = VBLK_REQ_FROM_LINK (GetFirstNode (&Dev->PendingQueue));
+    if ((Req->BufferSize == 0) && (Dev->InFlight > 0)) {
+      break;
+    }
+
+    for (SlotIdx = 0; Dev->Slots[SlotIdx].Req != NULL; SlotIdx++) {
+    }
+
+    ASSERT (SlotIdx < Dev->SlotCount);
+
+    RemoveEntryList (&Req->Link);
+    Status = SubmitRequest (Dev, SlotIdx, Req);
+    if (EFI_ERROR (Status)) {
+      CompleteRequest (Dev, Req, Status);
+    }
   }
+}
 
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, StatusMapping);
+/**
 
-UnmapDataBuffer:
-  if (BufferSize > 0) {
-    UnmapStatus = Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, BufferMapping);
-    if (EFI_ERROR (UnmapStatus) && !RequestIsWrite && !EFI_ERROR (Status)) {
-      //
-      // Data from the bus master may not reach the caller; fail the request.
-      //
-      Status = EFI_DEVICE_ERROR;
+  Collect the requests that the host has processed from the used ring, report
+  their outcome, and submit pending requests into the slots released.
+
+  The caller is responsible for raising the TPL to TPL_NOTIFY.
+
+  @param[in] Dev  The virtio-blk device.
+
+**/
+STATIC
+VOID
+ReapRequests (
+  IN VBLK_DEV  *Dev
+  )
+{
+  UINT16                          UsedIdx;
+  volatile CONST VRING_USED_ELEM  *UsedElem;
+  UINT32                          HeadDescIdx;
+  UINT16                          SlotIdx;
+  VBLK_SLOT                       *Slot;
+  VBLK_REQ                        *Req;
+  EFI_STATUS                      Status;
+  EFI_STATUS                      UnmapStatus;
+
+  //
+  // virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device
+  //
+  MemoryFence ();
+  UsedIdx = *Dev->Ring.Used.Idx;
+  MemoryFence ();
+
+  while (Dev->LastUsedIdx != UsedIdx) {
+    UsedElem    = &Dev->Ring.Used.UsedElem[Dev->LastUsedIdx++ % Dev->Ring.QueueSize];
+    HeadDescIdx = UsedElem->Id;
+    SlotIdx     = (UINT16)(HeadDescIdx / 3);
+    if ((HeadDescIdx % 3 != 0) || (SlotIdx >= Dev->SlotCount) ||
+        (Dev->Slots[SlotIdx].Req == NULL))
+    {
+      DEBUG ((DEBUG_ERROR, "%a: bogus used element %u\n", __FUNCTION__, HeadDescIdx));
+      ASSERT (FALSE);
+      continue;
+    }
+
+    Slot = &Dev->Slots[SlotIdx];
+    Req  = Slot->Req;
+
+    Status = (Dev->Shared[SlotIdx].HostStatus == VIRTIO_BLK_S_OK) ?
+             EFI_SUCCESS :
+             EFI_DEVICE_ERROR;
+
+    if (Req->BufferSize > 0) {
+      UnmapStatus = Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Slot->BufferMapping);
+      if (EFI_ERROR (UnmapStatus) && !Req->RequestIsWrite && !EFI_ERROR (Status)) {
+        //
+        // Data from the bus master may not reach the caller; fail the request.
+        //
+        Status = EFI_DEVICE_ERROR;
+      }
+    } else {
+      Dev->FlushInFlight = FALSE;
     }
+
+    Slot->Req           = NULL;
+    Slot->BufferMapping = NULL;
+    Dev->InFlight--;
+
+    CompleteRequest (Dev, Req, Status);
   }
 
-UnmapRequestBuffer:
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, RequestMapping);
+  StartPendingRequests (Dev);
+}
 
-FreeHostStatusBuffer:
-  Dev->VirtIo->FreeSharedPages (
-                 Dev->VirtIo,
-                 EFI_SIZE_TO_PAGES (sizeof *HostStatus),
-                 HostStatusBuffer
-                 );
+/**
 
-  return Status;
+  Timer notification function that completes the requests processed by the
+  host while nobody polls for them. The timer runs only while non-blocking
+  requests are outstanding.
+
+  @param[in] Event    Event whose notification function is being invoked.
+
+  @param[in] Context  Pointer to the VBLK_DEV structure.
+
+**/
+STATIC
+VOID
+EFIAPI
+VirtioBlkReapTimer (
+  IN  EFI_EVENT  Event,
+  IN  VOID       *Context
+  )
+{
+  ReapRequests (Context);
+}
+
+/**
+
+  Append a request to the pending queue, and submit it right away if a slot is
+  available.
+
+  @param[in] Dev  The virtio-blk device.
+
+  @param[in] Req  The request to queue.
+
+**/
+STATIC
+VOID
+QueueRequest (
+  IN VBLK_DEV  *Dev,
+  IN VBLK_REQ  *Req
+  )
+{
+  EFI_TPL  OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  InsertTailList (&Dev->PendingQueue, &Req->Link);
+  StartPendingRequests (Dev);
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+
+  Wait until the pending queue is empty and no request is in flight.
+
+  @param[in] Dev  The virtio-blk device.
+
+**/
+STATIC
+VOID
+DrainRequests (
+  IN VBLK_DEV  *Dev
+  )
+{
+  EFI_TPL  OldTpl;
+  BOOLEAN  Idle;
+  UINTN    PollPeriodUsecs;
+
+  PollPeriodUsecs = 1;
+  for ( ; ;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    Idle = (BOOLEAN)(IsListEmpty (&Dev->PendingQueue) && (Dev->InFlight == 0));
+    gBS->RestoreTPL (OldTpl);
+
+    if (Idle) {
+      return;
+    }
+
+    gBS->Stall (PollPeriodUsecs);
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
+}
+
+/**
+
+  Queue a read / write / flush request, and poll for its response.
+
+  The function may only be called after the request parameters have been
+  verified by
+  - specific checks in ReadBlocks() / WriteBlocks() / FlushBlocks(), and
+  - VerifyReadWriteRequest() (for read/write only).
+
+  Requests queued earlier, blocking or not, are submitted first. The poll also
+  completes the non-blocking requests that the host processes meanwhile.
+
+  Parameters handled commonly:
+
+    @param[in] Dev             The virtio-blk device the request is targeted
+                               at.
+
+  Flush request:
+
+    @param[in] Lba             Must be zero.
+
+    @param[in] BufferSize      Must be zero.
+
+    @param[in out] Buffer      Ignored by the function.
+
+    @param[in] RequestIsWrite  Must be TRUE.
+
+  Read/Write request:
+
+    @param[in] Lba             Logical Block Address: number of logical blocks
+                               to skip from the beginning of the device.
+
+    @param[in] BufferSize      Size of buffer to transfer, in bytes. The caller
+                               is responsible to ensure this parameter is
+                               positive.
+
+    @param[in out] Buffer      The guest side area to read data from the device
+                               into, or write data to the device from.
+
+    @param[in] RequestIsWrite  TRUE iff data transfer goes from guest to
+                               device.
+
+  Return values are common to both use cases, and are appropriate to be
+  forwarded by the EFI_BLOCK_IO_PROTOCOL functions (ReadBlocks(),
+  WriteBlocks(), FlushBlocks()).
+
+
+  @retval EFI_SUCCESS          Transfer complete.
+
+  @retval EFI_DEVICE_ERROR     Failed to notify host side via VirtIo write, or
+                               unable to parse host response, or host response
+                               is not VIRTIO_BLK_S_OK or failed to map Buffer
+                               for a bus master operation.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+SynchronousRequest (
+  IN              VBLK_DEV  *Dev,
+  IN              EFI_LBA   Lba,
+  IN              UINTN     BufferSize,
+  IN OUT volatile VOID      *Buffer,
+  IN              BOOLEAN   RequestIsWrite
+  )
+{
+  VBLK_REQ  Req;
+  EFI_TPL   OldTpl;
+  UINTN     PollPeriodUsecs;
+
+  //
+  // ensured by VirtioBlkInit()
+  //
+  ASSERT (Dev->BlockIoMedia.BlockSize > 0);
+  ASSERT (Dev->BlockIoMedia.BlockSize % 512 == 0);
+
+  //
+  // ensured by contract above, plus VerifyReadWriteRequest()
+  //
+  ASSERT (BufferSize % Dev->BlockIoMedia.BlockSize == 0);
+
+  Req.Signature      = VBLK_REQ_SIG;
+  Req.Lba            = Lba;
+  Req.BufferSize     = BufferSize;
+  Req.Buffer         = (VOID *)Buffer;
+  Req.RequestIsWrite = RequestIsWrite;
+  Req.Token          = NULL;
+  Req.Done           = FALSE;
+  Req.Status         = EFI_DEVICE_ERROR;
+
+  QueueRequest (Dev, &Req);
+
+  //
+  // Keep slowing down until we reach a poll period of slightly above 1 ms.
+  //
+  PollPeriodUsecs = 1;
+  for ( ; ;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    gBS->RestoreTPL (OldTpl);
+
+    if (Req.Done) {
+      break;
+    }
+
+    gBS->Stall (PollPeriodUsecs); // calls AcpiTimerLib::MicroSecondDelay
+
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
+
+  return Req.Status;
+}
+
+/**
+
+  Queue a read / write / flush request for a non-blocking BlockIo2 caller.
+
+  The parameters are the same as for SynchronousRequest(). Token->Event is
+  signaled when the request completes, with the outcome in
+  Token->TransactionStatus.
+
+  @retval EFI_SUCCESS           The request has been queued.
+
+  @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
+
+  @retval EFI_DEVICE_ERROR      The timer that reaps the request could not be
+                                armed.
+
+**/
+STATIC
+EFI_STATUS
+AsynchronousRequest (
+  IN     VBLK_DEV             *Dev,
+  IN     EFI_LBA              Lba,
+  IN     UINTN                BufferSize,
+  IN OUT VOID                 *Buffer,
+  IN     BOOLEAN              RequestIsWrite,
+  IN OUT EFI_BLOCK_IO2_TOKEN  *Token
+  )
+{
+  VBLK_REQ    *Req;
+  EFI_TPL     OldTpl;
+  EFI_STATUS  Status;
+
+  ASSERT (BufferSize % Dev->BlockIoMedia.BlockSize == 0);
+
+  Req = AllocatePool (sizeof *Req);
+  if (Req == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Blocking callers reap their own requests; the timer is armed for the
+  // first outstanding non-blocking request, and cancelled by
+  // CompleteRequest() when the last one completes.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (Dev->AsyncPending == 0) {
+    Status = gBS->SetTimer (Dev->ReapTimer, TimerPeriodic, VBLK_REAP_TIMER_PERIOD);
+    if (EFI_ERROR (Status)) {
+      gBS->RestoreTPL (OldTpl);
+      FreePool (Req);
+      return EFI_DEVICE_ERROR;
+    }
+  }
+
+  Dev->AsyncPending++;
+  gBS->RestoreTPL (OldTpl);
+
+  Req->Signature      = VBLK_REQ_SIG;
+  Req->Lba            = Lba;
+  Req->BufferSize     = BufferSize;
+  Req->Buffer         = Buffer;
+  Req->RequestIsWrite = RequestIsWrite;
+  Req->Token          = Token;
+  Req->Done           = FALSE;
+  Req->Status         = EFI_DEVICE_ERROR;
+
+  Token->TransactionStatus = EFI_NOT_READY;
+  QueueRequest (Dev, Req);
+  return EFI_SUCCESS;
 }
 
 /**
@@ -601,6 +932,231 @@ VirtioBlkFlushBlocks (
          EFI_SUCCESS;
 }
 
+//
+// UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol
+// Driver Writer's Guide for UEFI 2.3.1 v1.01,
+//   24.2 Block I/O Protocol Implementations
+//
+EFI_STATUS
+EFIAPI
+VirtioBlkResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN BOOLEAN                 ExtendedVerification
+  )
+{
+  VBLK_DEV  *Dev;
+
+  //
+  // The host does not allow cancelling requests; let the outstanding ones
+  // complete. The device itself is working correctly, see VirtioBlkReset().
+  //
+  Dev = VIRTIO_BLK_FROM_BLOCK_IO2 (This);
+  DrainRequests (Dev);
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Complete a zero-sized or no-op BlockIo2 request, signaling Token->Event if
+  the caller asked for a non-blocking request.
+
+  @param[in,out] Token  The token of the request, or NULL.
+
+  @retval EFI_SUCCESS  Always.
+
+**/
+STATIC
+EFI_STATUS
+CompleteTokenNow (
+  IN OUT EFI_BLOCK_IO2_TOKEN  *Token
+  )
+{
+  if ((Token != NULL) && (Token->Event != NULL)) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+
+  ReadBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.ReadBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.2. ReadBlocks() and
+    ReadBlocksEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking, as in
+  ReadBlocks(). Otherwise the request is queued, and Token->Event is signaled
+  when it completes.
+
+**/
+EFI_STATUS
+EFIAPI
+VirtioBlkReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  OUT    VOID                    *Buffer
+  )
+{
+  VBLK_DEV    *Dev;
+  EFI_STATUS  Status;
+
+  if (BufferSize == 0) {
+    return CompleteTokenNow (Token);
+  }
+
+  Dev    = VIRTIO_BLK_FROM_BLOCK_IO2 (This);
+  Status = VerifyReadWriteRequest (
+             &Dev->BlockIoMedia,
+             Lba,
+             BufferSize,
+             FALSE               // RequestIsWrite
+             );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if ((Token == NULL) || (Token->Event == NULL)) {
+    return SynchronousRequest (
+             Dev,
+             Lba,
+             BufferSize,
+             Buffer,
+             FALSE       // RequestIsWrite
+             );
+  }
+
+  return AsynchronousRequest (
+           Dev,
+           Lba,
+           BufferSize,
+           Buffer,
+           FALSE,      // RequestIsWrite
+           Token
+           );
+}
+
+/**
+
+  WriteBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.WriteBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.3 WriteBlocks() and
+    WriteBlockEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking, as in
+  WriteBlocks(). Otherwise the request is queued, and Token->Event is signaled
+  when it completes.
+
+**/
+EFI_STATUS
+EFIAPI
+VirtioBlkWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  IN     VOID                    *Buffer
+  )
+{
+  VBLK_DEV    *Dev;
+  EFI_STATUS  Status;
+
+  if (BufferSize == 0) {
+    return CompleteTokenNow (Token);
+  }
+
+  Dev    = VIRTIO_BLK_FROM_BLOCK_IO2 (This);
+  Status = VerifyReadWriteRequest (
+             &Dev->BlockIoMedia,
+             Lba,
+             BufferSize,
+             TRUE                // RequestIsWrite
+             );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if ((Token == NULL) || (Token->Event == NULL)) {
+    return SynchronousRequest (
+             Dev,
+             Lba,
+             BufferSize,
+             Buffer,
+             TRUE        // RequestIsWrite
+             );
+  }
+
+  return AsynchronousRequest (
+           Dev,
+           Lba,
+           BufferSize,
+           Buffer,
+           TRUE,       // RequestIsWrite
+           Token
+           );
+}
+
+/**
+
+  FlushBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.FlushBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.4 FlushBlocks() and
+    FlushBlocksEx() Implementation.
+
+  The flush is only submitted to the host after all requests queued before it
+  have completed, and no request queued after it is submitted before the flush
+  completes. Without write-caching on the device, the flush is a no-op, as in
+  FlushBlocks().
+
+**/
+EFI_STATUS
+EFIAPI
+VirtioBlkFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token
+  )
+{
+  VBLK_DEV  *Dev;
+
+  Dev = VIRTIO_BLK_FROM_BLOCK_IO2 (This);
+  if (!Dev->BlockIoMedia.WriteCaching) {
+    return CompleteTokenNow (Token);
+  }
+
+  if ((Token == NULL) || (Token->Event == NULL)) {
+    return SynchronousRequest (
+             Dev,
+             0,      // Lba
+             0,      // BufferSize
+             NULL,   // Buffer
+             TRUE    // RequestIsWrite
+             );
+  }
+
+  return AsynchronousRequest (
+           Dev,
+           0,      // Lba
+           0,      // BufferSize
+           NULL,   // Buffer
+           TRUE,   // RequestIsWrite
+           Token
+           );
+}
+
 /**
 
   Device probe function for this driver.
@@ -721,6 +1277,8 @@ VirtioBlkInit (
   UINT32  OptIoSize;
   UINT16  QueueSize;
   UINT64  RingBaseShift;
+  UINTN   SharedPages;
+  VOID    *SharedBuffer;
 
   PhysicalBlockExp = 0;
   AlignmentOffset  = 0;
@@ -848,11 +1406,17 @@ VirtioBlkInit (
   }
 
   if (QueueSize < 3) {
-    // SynchronousRequest() uses at most three descriptors
+    // SubmitRequest() uses at most three descriptors
     Status = EFI_UNSUPPORTED;
     goto Failed;
   }
 
+  //
+  // Each slot takes three descriptors; we don't queue more requests on the
+  // host side than the descriptor table can hold.
+  //
+  Dev->SlotCount = (UINT16)MIN (QueueSize / 3, VBLK_MAX_IN_FLIGHT);
+
   Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Dev->Ring);
   if (EFI_ERROR (Status)) {
     goto Failed;
@@ -871,18 +1435,52 @@ VirtioBlkInit (
     goto ReleaseQueue;
   }
 
+  //
+  // Allocate the request headers and host status bytes of all slots, in a
+  // buffer which can be mapped to access equally by both processor and the
+  // device. If anything fails from here on, we must release it.
+  //
+  SharedPages = EFI_SIZE_TO_PAGES (Dev->SlotCount * sizeof (VBLK_SHARED_SLOT));
+  Status      = Dev->VirtIo->AllocateSharedPages (
+                               Dev->VirtIo,
+                               SharedPages,
+                               &SharedBuffer
+                               );
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
+  ZeroMem (SharedBuffer, EFI_PAGES_TO_SIZE (SharedPages));
+  Status = VirtioMapAllBytesInSharedBuffer (
+             Dev->VirtIo,
+             VirtioOperationBusMasterCommonBuffer,
+             SharedBuffer,
+             EFI_PAGES_TO_SIZE (SharedPages),
+             &Dev->SharedDeviceAddr,
+             &Dev->SharedMap
+             );
+  if (EFI_ERROR (Status)) {
+    goto FreeSharedBuffer;
+  }
+
+  Dev->Shared        = SharedBuffer;
+  Dev->LastUsedIdx   = *Dev->Ring.Used.Idx;
+  Dev->InFlight      = 0;
+  Dev->FlushInFlight = FALSE;
+  ZeroMem (Dev->Slots, sizeof Dev->Slots);
+
   //
   // Additional steps for MMIO: align the queue appropriately, and set the
-  // size. If anything fails from here on, we must unmap the ring resources.
+  // size. If anything fails from here on, we must unmap the shared buffer.
   //
   Status = Dev->VirtIo->SetQueueNum (Dev->VirtIo, QueueSize);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   Status = Dev->VirtIo->SetQueueAlign (Dev->VirtIo, EFI_PAGE_SIZE);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   //
@@ -894,7 +1492,7 @@ VirtioBlkInit (
                           RingBaseShift
                           );
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   //
@@ -904,7 +1502,7 @@ VirtioBlkInit (
     Features &= ~(UINT64)(VIRTIO_F_VERSION_1 | VIRTIO_F_IOMMU_PLATFORM);
     Status    = Dev->VirtIo->SetGuestFeatures (Dev->VirtIo, Features);
     if (EFI_ERROR (Status)) {
-      goto UnmapQueue;
+      goto UnmapSharedBuffer;
     }
   }
 
@@ -914,7 +1512,7 @@ VirtioBlkInit (
   NextDevStat |= VSTAT_DRIVER_OK;
   Status       = Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, NextDevStat);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   //
@@ -927,6 +1525,11 @@ VirtioBlkInit (
   Dev->BlockIo.ReadBlocks            = &VirtioBlkReadBlocks;
   Dev->BlockIo.WriteBlocks           = &VirtioBlkWriteBlocks;
   Dev->BlockIo.FlushBlocks           = &VirtioBlkFlushBlocks;
+  Dev->BlockIo2.Media                = &Dev->BlockIoMedia;
+  Dev->BlockIo2.Reset                = &VirtioBlkResetEx;
+  Dev->BlockIo2.ReadBlocksEx         = &VirtioBlkReadBlocksEx;
+  Dev->BlockIo2.WriteBlocksEx        = &VirtioBlkWriteBlocksEx;
+  Dev->BlockIo2.FlushBlocksEx        = &VirtioBlkFlushBlocksEx;
   Dev->BlockIoMedia.MediaId          = 0;
   Dev->BlockIoMedia.RemovableMedia   = FALSE;
   Dev->BlockIoMedia.MediaPresent     = TRUE;
@@ -942,10 +1545,11 @@ VirtioBlkInit (
 
   DEBUG ((
     DEBUG_INFO,
-    "%a: LbaSize=0x%x[B] NumBlocks=0x%Lx[Lba]\n",
+    "%a: LbaSize=0x%x[B] NumBlocks=0x%Lx[Lba] InFlight=%u\n",
     __FUNCTION__,
     Dev->BlockIoMedia.BlockSize,
-    Dev->BlockIoMedia.LastBlock + 1
+    Dev->BlockIoMedia.LastBlock + 1,
+    Dev->SlotCount
     ));
 
   if (Features & VIRTIO_BLK_F_TOPOLOGY) {
@@ -972,6 +1576,12 @@ VirtioBlkInit (
 
   return EFI_SUCCESS;
 
+UnmapSharedBuffer:
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedMap);
+
+FreeSharedBuffer:
+  Dev->VirtIo->FreeSharedPages (Dev->VirtIo, SharedPages, SharedBuffer);
+
 UnmapQueue:
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
 
@@ -1011,10 +1621,18 @@ VirtioBlkUninit (
   //
   Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, 0);
 
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedMap);
+  Dev->VirtIo->FreeSharedPages (
+                 Dev->VirtIo,
+                 EFI_SIZE_TO_PAGES (Dev->SlotCount * sizeof (VBLK_SHARED_SLOT)),
+                 Dev->Shared
+                 );
+
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
   VirtioRingUninit (Dev->VirtIo, &Dev->Ring);
 
   SetMem (&Dev->BlockIo, sizeof Dev->BlockIo, 0x00);
+  SetMem (&Dev->BlockIo2, sizeof Dev->BlockIo2, 0x00);
   SetMem (&Dev->BlockIoMedia, sizeof Dev->BlockIoMedia, 0x00);
 }
 
@@ -1068,13 +1686,16 @@ VirtioBlkExitBoot (
 
   @retval EFI_SUCCESS           Driver instance has been created and
                                 initialized  for the virtio-blk device, it
-                                is now accessible via EFI_BLOCK_IO_PROTOCOL.
+                                is now accessible via EFI_BLOCK_IO_PROTOCOL
+                                and EFI_BLOCK_IO2_PROTOCOL.
 
   @retval EFI_OUT_OF_RESOURCES  Memory allocation failed.
 
   @return                       Error codes from the OpenProtocol() boot
                                 service, the VirtIo protocol, VirtioBlkInit(),
-                                or the InstallProtocolInterface() boot service.
+                                the CreateEvent() boot service, or the
+                                InstallMultipleProtocolInterfaces() boot
+                                service.
 
 **/
 EFI_STATUS
@@ -1105,6 +1726,8 @@ VirtioBlkDriverBindingStart (
     goto FreeVirtioBlk;
   }
 
+  InitializeListHead (&Dev->PendingQueue);
+
   //
   // VirtIo access granted, configure virtio-blk device.
   //
@@ -1125,21 +1748,42 @@ VirtioBlkDriverBindingStart (
   }
 
   //
-  // Setup complete, attempt to export the driver instance's BlockIo interface.
+  // Complete the non-blocking requests that the host processes. The timer is
+  // armed by AsynchronousRequest().
+  //
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_NOTIFY,
+                  &VirtioBlkReapTimer,
+                  Dev,
+                  &Dev->ReapTimer
+                  );
+  if (EFI_ERROR (Status)) {
+    goto CloseExitBoot;
+  }
+
+  //
+  // Setup complete, attempt to export the driver instance's BlockIo and
+  // BlockIo2 interfaces.
   //
   Dev->Signature = VBLK_SIG;
-  Status         = gBS->InstallProtocolInterface (
+  Status         = gBS->InstallMultipleProtocolInterfaces (
                           &DeviceHandle,
                           &gEfiBlockIoProtocolGuid,
-                          EFI_NATIVE_INTERFACE,
-                          &Dev->BlockIo
+                          &Dev->BlockIo,
+                          &gEfiBlockIo2ProtocolGuid,
+                          &Dev->BlockIo2,
+                          NULL
                           );
   if (EFI_ERROR (Status)) {
-    goto CloseExitBoot;
+    goto CloseReapTimer;
   }
 
   return EFI_SUCCESS;
 
+CloseReapTimer:
+  gBS->CloseEvent (Dev->ReapTimer);
+
 CloseExitBoot:
   gBS->CloseEvent (Dev->ExitBoot);
 
@@ -1162,7 +1806,8 @@ FreeVirtioBlk:
 
 /**
 
-  Stop driving a virtio-blk device and remove its BlockIo interface.
+  Stop driving a virtio-blk device and remove its BlockIo and BlockIo2
+  interfaces.
 
   This function replays the success path of DriverBindingStart() in reverse.
   The host side virtio-blk device is reset, so that the OS boot loader or the
@@ -1212,15 +1857,25 @@ VirtioBlkDriverBindingStop (
   //
   // Handle Stop() requests for in-use driver instances gracefully.
   //
-  Status = gBS->UninstallProtocolInterface (
+  Status = gBS->UninstallMultipleProtocolInterfaces (
                   DeviceHandle,
                   &gEfiBlockIoProtocolGuid,
-                  &Dev->BlockIo
+                  &Dev->BlockIo,
+                  &gEfiBlockIo2ProtocolGuid,
+                  &Dev->BlockIo2,
+                  NULL
                   );
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
+  //
+  // No new requests can arrive; let the outstanding non-blocking ones
+  // complete before the ring goes away.
+  //
+  DrainRequests (Dev);
+  gBS->CloseEvent (Dev->ReapTimer);
+
   gBS->CloseEvent (Dev->ExitBoot);
 
   VirtioBlkUninit (Dev);
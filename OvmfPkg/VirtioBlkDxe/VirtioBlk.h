@@ -1,7 +1,7 @@
 /** @file
 
   Internal definitions for the virtio-blk driver, which produces Block I/O
-  Protocol instances for virtio-blk devices.
+  and Block I/O 2 Protocol instances for virtio-blk devices.
 
   Copyright (C) 2012, Red Hat, Inc.
 
@@ -13,6 +13,7 @@
 #define _VIRTIO_BLK_DXE_H_
 
 #include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
 #include <Protocol/ComponentName.h>
 #include <Protocol/DriverBinding.h>
 
@@ -20,6 +21,56 @@
 
 #define VBLK_SIG  SIGNATURE_32 ('V', 'B', 'L', 'K')
 
+//
+// The number of requests that the driver keeps in flight on the virtqueue at
+// most. Each request occupies a slot of three consecutive descriptors.
+//
+#define VBLK_MAX_IN_FLIGHT  32
+
+//
+// The period of the timer that reaps completed requests, in 100ns units. The
+// timer runs only while non-blocking requests are outstanding.
+//
+#define VBLK_REAP_TIMER_PERIOD  EFI_TIMER_PERIOD_MILLISECONDS (1)
+
+#define VBLK_REQ_SIG  SIGNATURE_32 ('V', 'B', 'R', 'Q')
+
+//
+// A read, write or flush request, from submission by the caller until
+// completion. Blocking requests live on the caller's stack, non-blocking ones
+// are allocated from pool and freed when they complete.
+//
+typedef struct {
+  UINT32                 Signature;
+  LIST_ENTRY             Link;         // in VBLK_DEV.PendingQueue
+  EFI_LBA                Lba;
+  UINTN                  BufferSize;   // zero for flush
+  VOID                   *Buffer;
+  BOOLEAN                RequestIsWrite;
+  EFI_BLOCK_IO2_TOKEN    *Token;       // NULL for blocking requests
+  volatile BOOLEAN       Done;         // blocking requests only
+  EFI_STATUS             Status;       // blocking requests only
+} VBLK_REQ;
+
+#define VBLK_REQ_FROM_LINK(LinkPointer) \
+        CR (LinkPointer, VBLK_REQ, Link, VBLK_REQ_SIG)
+
+//
+// The virtio-blk request header and the host status byte of a slot, in memory
+// that the device and the processor access equally.
+//
+#pragma pack(1)
+typedef struct {
+  VIRTIO_BLK_REQ    Request;
+  UINT8             HostStatus;
+} VBLK_SHARED_SLOT;
+#pragma pack()
+
+typedef struct {
+  VBLK_REQ    *Req;          // NULL if the slot is free
+  VOID        *BufferMapping;
+} VBLK_SLOT;
+
 typedef struct {
   //
   // Parts of this structure are initialized / torn down in various functions
@@ -33,13 +84,29 @@ typedef struct {
   EFI_EVENT                 ExitBoot;          // DriverBindingStart  0
   VRING                     Ring;              // VirtioRingInit      2
   EFI_BLOCK_IO_PROTOCOL     BlockIo;           // VirtioBlkInit       1
+  EFI_BLOCK_IO2_PROTOCOL    BlockIo2;          // VirtioBlkInit       1
   EFI_BLOCK_IO_MEDIA        BlockIoMedia;      // VirtioBlkInit       1
   VOID                      *RingMap;          // VirtioRingMap       2
+  VBLK_SHARED_SLOT          *Shared;           // VirtioBlkInit       1
+  EFI_PHYSICAL_ADDRESS      SharedDeviceAddr;  // VirtioBlkInit       1
+  VOID                      *SharedMap;        // VirtioBlkInit       1
+  UINT16                    SlotCount;         // VirtioBlkInit       1
+  UINT16                    LastUsedIdx;       // VirtioBlkInit       1
+  VBLK_SLOT                 Slots[VBLK_MAX_IN_FLIGHT];
+                                               // VirtioBlkInit       1
+  UINT16                    InFlight;          // VirtioBlkInit       1
+  BOOLEAN                   FlushInFlight;     // VirtioBlkInit       1
+  LIST_ENTRY                PendingQueue;      // DriverBindingStart  0
+  EFI_EVENT                 ReapTimer;         // DriverBindingStart  0
+  UINTN                     AsyncPending;      // DriverBindingStart  0
 } VBLK_DEV;
 
 #define VIRTIO_BLK_FROM_BLOCK_IO(BlockIoPointer) \
         CR (BlockIoPointer, VBLK_DEV, BlockIo, VBLK_SIG)
 
+#define VIRTIO_BLK_FROM_BLOCK_IO2(BlockIo2Pointer) \
+        CR (BlockIo2Pointer, VBLK_DEV, BlockIo2, VBLK_SIG)
+
 /**
 
   Device probe function for this driver.
@@ -123,7 +190,8 @@ VirtioBlkDriverBindingStart (
 
 /**
 
-  Stop driving a virtio-blk device and remove its BlockIo interface.
+  Stop driving a virtio-blk device and remove its BlockIo and BlockIo2
+  interfaces.
 
   This function replays the success path of DriverBindingStart() in reverse.
   The host side virtio-blk device is reset, so that the OS boot loader or the
@@ -244,6 +312,95 @@ VirtioBlkFlushBlocks (
   IN EFI_BLOCK_IO_PROTOCOL  *This
   );
 
+//
+// UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol
+// Driver Writer's Guide for UEFI 2.3.1 v1.01,
+//   24.2 Block I/O Protocol Implementations
+//
+EFI_STATUS
+EFIAPI
+VirtioBlkResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN BOOLEAN                 ExtendedVerification
+  );
+
+/**
+
+  ReadBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.ReadBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.2. ReadBlocks() and
+    ReadBlocksEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking, as in
+  ReadBlocks(). Otherwise the request is queued, and Token->Event is signaled
+  when it completes.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  OUT    VOID                    *Buffer
+  );
+
+/**
+
+  WriteBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.WriteBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.3 WriteBlocks() and
+    WriteBlockEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking, as in
+  WriteBlocks(). Otherwise the request is queued, and Token->Event is signaled
+  when it completes.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  IN     VOID                    *Buffer
+  );
+
+/**
+
+  FlushBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.3.1 + Errata C, 12.9 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.FlushBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.4 FlushBlocks() and
+    FlushBlocksEx() Implementation.
+
+  The flush is only submitted to the host after all requests queued before it
+  have completed, and no request queued after it is submitted before the flush
+  completes.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token
+  );
+
 //
 // The purpose of the following scaffolding (EFI_COMPONENT_NAME_PROTOCOL and
 // EFI_COMPONENT_NAME2_PROTOCOL implementation) is to format the driver's name
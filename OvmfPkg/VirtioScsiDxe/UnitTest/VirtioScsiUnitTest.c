@@ -0,0 +1,1736 @@
+/** @file
+  Host-based unit tests for the request engine of the virtio-scsi driver, with
+  blocking and non-blocking requests on a simulated virtio-scsi device that
+  completes the descriptor chains out of order, bounce buffers the mappings,
+  and has a target that reports itself busy.
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <Uefi.h>
+#include <IndustryStandard/Scsi.h>
+#include <IndustryStandard/VirtioScsi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+#include <Library/UnitTestLib.h>
+#include <Protocol/VirtioDevice.h>
+
+#include "../VirtioScsi.h"
+
+#define UNIT_TEST_APP_NAME     "Virtio SCSI Request Engine Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define TEST_CDB_SIZE        10
+#define TEST_BLOCK_SIZE      512
+#define TEST_BLOCK_COUNT     1024
+#define TEST_DISK_SIZE       (TEST_BLOCK_SIZE * TEST_BLOCK_COUNT)
+#define TEST_MAX_OPERATIONS  256
+#define TEST_ITERATIONS      5000
+
+///
+/// The targets of the simulated device: LUN 0 of the disk target is a disk,
+/// the busy target never accepts a command, the other targets are absent
+///
+#define TEST_DISK_TARGET  0
+#define TEST_BUSY_TARGET  1
+#define TEST_MAX_TARGET   3
+
+typedef struct {
+  LIST_ENTRY          Link;
+  UINT32              Type;
+  EFI_TPL             Tpl;
+  EFI_EVENT_NOTIFY    NotifyFunction;
+  VOID                *NotifyContext;
+  BOOLEAN             Signaled;
+  BOOLEAN             TimerArmed;
+} TEST_EVENT;
+
+///
+/// A mapping of a buffer for the device
+///
+typedef struct {
+  VIRTIO_MAP_OPERATION    Operation;
+  VOID                    *HostAddress;
+  VOID                    *DeviceAddress;
+  UINTN                   NumberOfBytes;
+} TEST_MAPPING;
+
+///
+/// A non-blocking SCSI request of the test
+///
+typedef struct {
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET    Packet;
+  UINT8                                         Cdb[TEST_CDB_SIZE];
+  UINT8                                         Sense[VIRTIO_SCSI_SENSE_SIZE];
+  EFI_EVENT                                     Event;
+  BOOLEAN                                       Write;
+  BOOLEAN                                       Done;
+  EFI_LBA                                       Lba;
+  UINTN                                         BufferSize;
+  UINT8                                         *Buffer;
+  UINT8                                         *Expected;  ///< Disk content to read, NULL otherwise
+} TEST_OPERATION;
+
+///
+/// The configuration of the simulated device
+///
+typedef struct {
+  UINT16    QueueSize;
+} TEST_DEVICE_CONFIG;
+
+///
+/// Boot services of the simulated firmware
+///
+STATIC EFI_TPL            mTpl    = TPL_APPLICATION;
+STATIC LIST_ENTRY         mEvents = INITIALIZE_LIST_HEAD_VARIABLE (mEvents);
+STATIC EFI_BOOT_SERVICES  mBootServices;
+STATIC TEST_EVENT         *mReapTimer;
+STATIC UINTN              mTimerArms;
+
+///
+/// The simulated device, and the content the disk must have
+///
+STATIC UINT8                   mDisk[TEST_DISK_SIZE];
+STATIC UINT8                   mModel[TEST_DISK_SIZE];
+STATIC TEST_DEVICE_CONFIG      mConfig;
+STATIC VIRTIO_DEVICE_PROTOCOL  mVirtIo;
+STATIC VRING                   *mRing;
+STATIC UINT16                  mHostAvailIdx;
+STATIC UINT16                  mTaken[TEST_MAX_OPERATIONS];
+STATIC UINTN                   mTakenCount;
+STATIC UINTN                   mMaxInFlight;
+STATIC UINTN                   mOutOfOrder;
+STATIC UINTN                   mBusyResponses;
+STATIC UINTN                   mSharedPages;
+STATIC UINTN                   mMappings;
+STATIC BOOLEAN                 mHostPaused;
+STATIC UINT32                  mSeed;
+
+///
+/// The Extended SCSI Pass Thru protocol that the driver installs
+///
+STATIC EFI_EXT_SCSI_PASS_THRU_PROTOCOL  *mPassThru;
+STATIC EFI_DRIVER_BINDING_PROTOCOL      mDriverBinding;
+
+STATIC TEST_OPERATION  mOperations[TEST_MAX_OPERATIONS];
+STATIC UINTN           mOperationCount;
+
+/**
+  Simple deterministic pseudo random generator.
+
+  @return The next pseudo random value.
+
+**/
+STATIC
+UINT32
+NextRandom (
+  VOID
+  )
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return (mSeed >> 8);
+}
+
+/**
+  Executes a READ (10) or WRITE (10) command on the disk.
+
+  @param  Cdb       The command descriptor block.
+  @param  Data      The data of the command.
+  @param  DataSize  The size of Data.
+  @param  Write     TRUE if the data of the command flows to the device.
+
+**/
+STATIC
+VOID
+ExecuteDiskCommand (
+  IN     CONST UINT8  *Cdb,
+  IN OUT UINT8        *Data,
+  IN     UINT32       DataSize,
+  IN     BOOLEAN      Write
+  )
+{
+  UINT32  Lba;
+  UINT32  BlockCount;
+
+  Lba        = SwapBytes32 (ReadUnaligned32 ((CONST UINT32 *)&Cdb[2]));
+  BlockCount = SwapBytes16 (ReadUnaligned16 ((CONST UINT16 *)&Cdb[7]));
+  ASSERT (Cdb[0] == (Write ? EFI_SCSI_OP_WRITE10 : EFI_SCSI_OP_READ10));
+  ASSERT (DataSize == BlockCount * TEST_BLOCK_SIZE);
+  ASSERT (Lba + BlockCount <= TEST_BLOCK_COUNT);
+  if (Write) {
+    CopyMem (mDisk + Lba * TEST_BLOCK_SIZE, Data, DataSize);
+  } else {
+    CopyMem (Data, mDisk + Lba * TEST_BLOCK_SIZE, DataSize);
+  }
+}
+
+/**
+  Processes some of the descriptor chains that the driver made available, in
+  random order, the way the host side of the device does.
+
+**/
+STATIC
+VOID
+ProcessRequests (
+  VOID
+  )
+{
+  UINTN                Index;
+  UINT16               HeadDescIdx;
+  UINT16               UsedIdx;
+  volatile VRING_DESC  *Desc;
+  VIRTIO_SCSI_REQ      *Request;
+  VIRTIO_SCSI_RESP     *Response;
+  UINT8                *Data;
+  UINT32               DataSize;
+  BOOLEAN              Write;
+
+  if ((mRing == NULL) || mHostPaused) {
+    return;
+  }
+
+  while (mHostAvailIdx != *mRing->Avail.Idx) {
+    ASSERT (mTakenCount < TEST_MAX_OPERATIONS);
+    mTaken[mTakenCount++] = mRing->Avail.Ring[mHostAvailIdx++ % mRing->QueueSize];
+  }
+
+  mMaxInFlight = MAX (mMaxInFlight, mTakenCount);
+
+  while ((mTakenCount > 0) && (NextRandom () % 3 != 0)) {
+    Index = NextRandom () % mTakenCount;
+    if (Index != 0) {
+      mOutOfOrder++;
+    }
+
+    HeadDescIdx = mTaken[Index];
+    CopyMem (&mTaken[Index], &mTaken[Index + 1], (mTakenCount - Index - 1) * sizeof (UINT16));
+    mTakenCount--;
+
+    //
+    // request, dataout if any, response, datain if any
+    //
+    Desc    = &mRing->Desc[HeadDescIdx];
+    Request = (VIRTIO_SCSI_REQ *)(UINTN)Desc->Addr;
+    ASSERT (Desc->Len == sizeof (VIRTIO_SCSI_REQ));
+    ASSERT ((Desc->Flags & (VRING_DESC_F_NEXT | VRING_DESC_F_WRITE)) == VRING_DESC_F_NEXT);
+    Desc     = &mRing->Desc[Desc->Next];
+    Data     = NULL;
+    DataSize = 0;
+    Write    = FALSE;
+    if ((Desc->Flags & VRING_DESC_F_WRITE) == 0) {
+      ASSERT ((Desc->Flags & VRING_DESC_F_NEXT) != 0);
+      Data     = (UINT8 *)(UINTN)Desc->Addr;
+      DataSize = Desc->Len;
+      Write    = TRUE;
+      Desc     = &mRing->Desc[Desc->Next];
+    }
+
+    ASSERT (Desc->Len == sizeof (VIRTIO_SCSI_RESP));
+    Response = (VIRTIO_SCSI_RESP *)(UINTN)Desc->Addr;
+    ASSERT (Response->Response == VIRTIO_SCSI_S_FAILURE);
+    if ((Desc->Flags & VRING_DESC_F_NEXT) != 0) {
+      ASSERT (Data == NULL);
+      Desc = &mRing->Desc[Desc->Next];
+      ASSERT ((Desc->Flags & (VRING_DESC_F_NEXT | VRING_DESC_F_WRITE)) == VRING_DESC_F_WRITE);
+      Data     = (UINT8 *)(UINTN)Desc->Addr;
+      DataSize = Desc->Len;
+    }
+
+    ZeroMem (Response, sizeof (VIRTIO_SCSI_RESP));
+    ASSERT (Request->Lun[0] == 1);
+    if (Request->Lun[1] == TEST_BUSY_TARGET) {
+      Response->Response = VIRTIO_SCSI_S_BUSY;
+      mBusyResponses++;
+    } else if ((Request->Lun[1] != TEST_DISK_TARGET) || (Request->Lun[3] != 0)) {
+      Response->Response = VIRTIO_SCSI_S_BAD_TARGET;
+    } else {
+      ExecuteDiskCommand (Request->Cdb, Data, DataSize, Write);
+      Response->Response = VIRTIO_SCSI_S_OK;
+    }
+
+    UsedIdx                                              = *mRing->Used.Idx;
+    mRing->Used.UsedElem[UsedIdx % mRing->QueueSize].Id  = HeadDescIdx;
+    mRing->Used.UsedElem[UsedIdx % mRing->QueueSize].Len = sizeof (VIRTIO_SCSI_RESP) + (Write ? 0 : DataSize);
+    *mRing->Used.Idx                                     = (UINT16)(UsedIdx + 1);
+  }
+}
+
+/**
+  Dispatches the signaled events whose TPL is above the current TPL, the
+  highest TPL first.
+
+**/
+STATIC
+VOID
+DispatchEvents (
+  VOID
+  )
+{
+  LIST_ENTRY  *Link;
+  TEST_EVENT  *Event;
+  TEST_EVENT  *Next;
+  EFI_TPL     SavedTpl;
+
+  for ( ; ;) {
+    Next = NULL;
+    for (Link = GetFirstNode (&mEvents); !IsNull (&mEvents, Link); Link = GetNextNode (&mEvents, Link)) {
+      Event = BASE_CR (Link, TEST_EVENT, Link);
+      if (Event->Signaled && (Event->NotifyFunction != NULL) && (Event->Tpl > mTpl) &&
+          ((Next == NULL) || (Event->Tpl > Next->Tpl)))
+      {
+        Next = Event;
+      }
+    }
+
+    if (Next == NULL) {
+      return;
+    }
+
+    Next->Signaled = FALSE;
+    SavedTpl       = mTpl;
+    mTpl           = Next->Tpl;
+    Next->NotifyFunction (Next, Next->NotifyContext);
+    mTpl = SavedTpl;
+  }
+}
+
+/**
+  Lets time pass: the host processes requests, the armed timers expire and
+  the events are dispatched.
+
+**/
+STATIC
+VOID
+Tick (
+  VOID
+  )
+{
+  LIST_ENTRY  *Link;
+  TEST_EVENT  *Event;
+
+  if (NextRandom () % 2 == 0) {
+    ProcessRequests ();
+  }
+
+  if (NextRandom () % 3 == 0) {
+    for (Link = GetFirstNode (&mEvents); !IsNull (&mEvents, Link); Link = GetNextNode (&mEvents, Link)) {
+      Event = BASE_CR (Link, TEST_EVENT, Link);
+      if (Event->TimerArmed) {
+        Event->Signaled = TRUE;
+      }
+    }
+  }
+
+  DispatchEvents ();
+}
+
+/**
+  Raises the task priority level.
+
+  @param  NewTpl  The new task priority level.
+
+  @return The previous task priority level.
+
+**/
+STATIC
+EFI_TPL
+EFIAPI
+TestRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  EFI_TPL  OldTpl;
+
+  OldTpl = mTpl;
+  ASSERT (NewTpl >= OldTpl);
+  mTpl = NewTpl;
+  return OldTpl;
+}
+
+/**
+  Restores the task priority level, and lets time pass.
+
+  @param  OldTpl  The task priority level to restore.
+
+**/
+STATIC
+VOID
+EFIAPI
+TestRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+  ASSERT (OldTpl <= mTpl);
+  mTpl = OldTpl;
+  Tick ();
+}
+
+/**
+  Creates an event.
+
+  @param  Type            The type of event.
+  @param  NotifyTpl       The task priority level of the notification.
+  @param  NotifyFunction  The notification function, NULL for none.
+  @param  NotifyContext   The context of the notification function.
+  @param  Event           The new event.
+
+  @retval EFI_SUCCESS           The event is created.
+  @retval EFI_OUT_OF_RESOURCES  The event cannot be allocated.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  TEST_EVENT  *NewEvent;
+
+  NewEvent = AllocateZeroPool (sizeof (TEST_EVENT));
+  if (NewEvent == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NewEvent->Type           = Type;
+  NewEvent->Tpl            = NotifyTpl;
+  NewEvent->NotifyFunction = NotifyFunction;
+  NewEvent->NotifyContext  = NotifyContext;
+  InsertTailList (&mEvents, &NewEvent->Link);
+  if ((Type & EVT_TIMER) != 0) {
+    mReapTimer = NewEvent;
+  }
+
+  *Event = NewEvent;
+  return EFI_SUCCESS;
+}
+
+/**
+  Closes an event.
+
+  @param  Event  The event to close.
+
+  @retval EFI_SUCCESS  The event is closed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  if (Event == mReapTimer) {
+    mReapTimer = NULL;
+  }
+
+  RemoveEntryList (&((TEST_EVENT *)Event)->Link);
+  FreePool (Event);
+  return EFI_SUCCESS;
+}
+
+/**
+  Signals an event, and dispatches it if its TPL is above the current TPL.
+
+  @param  Event  The event to signal.
+
+  @retval EFI_SUCCESS  The event is signaled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((TEST_EVENT *)Event)->Signaled = TRUE;
+  DispatchEvents ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Arms or cancels a timer event.
+
+  @param  Event        The timer event.
+  @param  Type         The type of the timer.
+  @param  TriggerTime  The period of the timer, in 100ns units.
+
+  @retval EFI_SUCCESS  The timer is set.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  ASSERT ((((TEST_EVENT *)Event)->Type & EVT_TIMER) != 0);
+  ((TEST_EVENT *)Event)->TimerArmed = (BOOLEAN)(Type != TimerCancel);
+  if (Type != TimerCancel) {
+    mTimerArms++;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Stalls the processor, and lets time pass.
+
+  @param  Microseconds  The number of microseconds to stall.
+
+  @retval EFI_SUCCESS  The stall is over.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestStall (
+  IN UINTN  Microseconds
+  )
+{
+  Tick ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Opens the virtio device protocol for the driver, or returns the Extended
+  SCSI Pass Thru protocol that it installed.
+
+  @param  Handle            The handle of the device.
+  @param  Protocol          The GUID of the protocol.
+  @param  Interface         The interface returned.
+  @param  AgentHandle       The agent opening the protocol.
+  @param  ControllerHandle  The controller handle.
+  @param  Attributes        The open mode.
+
+  @retval EFI_SUCCESS      The protocol is returned.
+  @retval EFI_UNSUPPORTED  The device does not have the protocol.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestOpenProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Protocol,
+  OUT VOID        **Interface OPTIONAL,
+  IN  EFI_HANDLE  AgentHandle,
+  IN  EFI_HANDLE  ControllerHandle,
+  IN  UINT32      Attributes
+  )
+{
+  if (CompareGuid (Protocol, &gVirtioDeviceProtocolGuid)) {
+    *Interface = &mVirtIo;
+    return EFI_SUCCESS;
+  }
+
+  if (CompareGuid (Protocol, &gEfiExtScsiPassThruProtocolGuid) && (mPassThru != NULL)) {
+    *Interface = mPassThru;
+    return EFI_SUCCESS;
+  }
+
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Closes a protocol, the test does not track the opens.
+
+  @param  Handle            The handle of the device.
+  @param  Protocol          The GUID of the protocol.
+  @param  AgentHandle       The agent that opened the protocol.
+  @param  ControllerHandle  The controller handle.
+
+  @retval EFI_SUCCESS  The protocol is closed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestCloseProtocol (
+  IN EFI_HANDLE  Handle,
+  IN EFI_GUID    *Protocol,
+  IN EFI_HANDLE  AgentHandle,
+  IN EFI_HANDLE  ControllerHandle
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Records the Extended SCSI Pass Thru protocol that the driver installs.
+
+  @param  Handle         The handle to install the protocol on.
+  @param  Protocol       The GUID of the protocol.
+  @param  InterfaceType  The type of the interface.
+  @param  Interface      The interface.
+
+  @retval EFI_SUCCESS  The protocol is installed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestInstallProtocolInterface (
+  IN OUT EFI_HANDLE          *Handle,
+  IN     EFI_GUID            *Protocol,
+  IN     EFI_INTERFACE_TYPE  InterfaceType,
+  IN     VOID                *Interface
+  )
+{
+  ASSERT (CompareGuid (Protocol, &gEfiExtScsiPassThruProtocolGuid));
+  mPassThru = Interface;
+  return EFI_SUCCESS;
+}
+
+/**
+  Forgets the Extended SCSI Pass Thru protocol of the driver.
+
+  @param  Handle     The handle to uninstall the protocol from.
+  @param  Protocol   The GUID of the protocol.
+  @param  Interface  The interface.
+
+  @retval EFI_SUCCESS  The protocol is uninstalled.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestUninstallProtocolInterface (
+  IN EFI_HANDLE  Handle,
+  IN EFI_GUID    *Protocol,
+  IN VOID        *Interface
+  )
+{
+  ASSERT (Interface == mPassThru);
+  mPassThru = NULL;
+  return EFI_SUCCESS;
+}
+
+/**
+  Installs the driver binding and component name protocols, which the test
+  does not use.
+
+  @param  ImageHandle          The image handle of the driver.
+  @param  SystemTable          The EFI System Table.
+  @param  DriverBinding        The driver binding protocol.
+  @param  DriverBindingHandle  The handle to install the protocols on.
+  @param  ComponentName        The component name protocol.
+  @param  ComponentName2       The component name 2 protocol.
+
+  @retval EFI_SUCCESS  The protocols are installed.
+
+**/
+EFI_STATUS
+EFIAPI
+EfiLibInstallDriverBindingComponentName2 (
+  IN CONST EFI_HANDLE                    ImageHandle,
+  IN CONST EFI_SYSTEM_TABLE              *SystemTable,
+  IN EFI_DRIVER_BINDING_PROTOCOL         *DriverBinding,
+  IN EFI_HANDLE                          DriverBindingHandle,
+  IN CONST EFI_COMPONENT_NAME_PROTOCOL   *ComponentName   OPTIONAL,
+  IN CONST EFI_COMPONENT_NAME2_PROTOCOL  *ComponentName2  OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Looks up the name of the driver, which the test does not use.
+
+  @param  Language              The language of the name.
+  @param  SupportedLanguages    The languages of the table.
+  @param  UnicodeStringTable    The table of names.
+  @param  UnicodeString         The name returned.
+  @param  Iso639Language        TRUE for ISO 639-2 language codes.
+
+  @retval EFI_UNSUPPORTED  The test does not support names.
+
+**/
+EFI_STATUS
+EFIAPI
+LookupUnicodeString2 (
+  IN CONST CHAR8                     *Language,
+  IN CONST CHAR8                     *SupportedLanguages,
+  IN CONST EFI_UNICODE_STRING_TABLE  *UnicodeStringTable,
+  OUT CHAR16                         **UnicodeString,
+  IN BOOLEAN                         Iso639Language
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Sets the status of the virtio device.
+
+  @param  This          The virtio device protocol.
+  @param  DeviceStatus  The new status.
+
+  @retval EFI_SUCCESS  The status is set.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetDeviceStatus (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT8                   DeviceStatus
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Returns the features of the virtio device.
+
+  @param  This            The virtio device protocol.
+  @param  DeviceFeatures  The features returned.
+
+  @retval EFI_SUCCESS  The features are returned.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestGetDeviceFeatures (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  OUT UINT64                  *DeviceFeatures
+  )
+{
+  *DeviceFeatures = VIRTIO_SCSI_F_INOUT;
+  return EFI_SUCCESS;
+}
+
+/**
+  Reads the configuration of the virtio device: a single channel and request
+  queue, TEST_MAX_TARGET targets with two LUNs each.
+
+  @param  This         The virtio device protocol.
+  @param  FieldOffset  The offset of the field.
+  @param  FieldSize    The size of the field.
+  @param  BufferSize   The size of Buffer.
+  @param  Buffer       The buffer to receive the field.
+
+  @retval EFI_SUCCESS  The field is read.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestReadDevice (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  IN  UINTN                   FieldOffset,
+  IN  UINTN                   FieldSize,
+  IN  UINTN                   BufferSize,
+  OUT VOID                    *Buffer
+  )
+{
+  UINT64  Value;
+
+  switch (FieldOffset) {
+    case OFFSET_OF_VSCSI (NumQueues):
+      Value = 1;
+      break;
+    case OFFSET_OF_VSCSI (MaxTarget):
+      Value = TEST_MAX_TARGET;
+      break;
+    case OFFSET_OF_VSCSI (MaxLun):
+      Value = 1;
+      break;
+    case OFFSET_OF_VSCSI (MaxSectors):
+      Value = 256;
+      break;
+    default:
+      Value = 0;
+      break;
+  }
+
+  CopyMem (Buffer, &Value, BufferSize);
+  return EFI_SUCCESS;
+}
+
+/**
+  Accepts a field of the configuration that the driver writes.
+
+  @param  This         The virtio device protocol.
+  @param  FieldOffset  The offset of the field.
+  @param  FieldSize    The size of the field.
+  @param  Value        The value of the field.
+
+  @retval EFI_SUCCESS  The field is written.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestWriteDevice (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINTN                   FieldOffset,
+  IN UINTN                   FieldSize,
+  IN UINT64                  Value
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Accepts a value the driver writes to the virtio device.
+
+  @param  This   The virtio device protocol.
+  @param  Value  The value.
+
+  @retval EFI_SUCCESS  The value is written.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetUint16 (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT16                  Value
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Accepts a value the driver writes to the virtio device.
+
+  @param  This   The virtio device protocol.
+  @param  Value  The value.
+
+  @retval EFI_SUCCESS  The value is written.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetUint32 (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT32                  Value
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Accepts the features the driver negotiates.
+
+  @param  This      The virtio device protocol.
+  @param  Features  The features.
+
+  @retval EFI_SUCCESS  The features are set.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetGuestFeatures (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT64                  Features
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Returns the size of the queue of the virtio device.
+
+  @param  This            The virtio device protocol.
+  @param  QueueNumMax     The size returned.
+
+  @retval EFI_SUCCESS  The size is returned.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestGetQueueNumMax (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  OUT UINT16                  *QueueNumMax
+  )
+{
+  *QueueNumMax = mConfig.QueueSize;
+  return EFI_SUCCESS;
+}
+
+/**
+  Records the ring of the queue of the virtio device.
+
+  @param  This           The virtio device protocol.
+  @param  Ring           The ring.
+  @param  RingBaseShift  The offset of the device addresses of the ring.
+
+  @retval EFI_SUCCESS  The ring is recorded.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetQueueAddress (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN VRING                   *Ring,
+  IN UINT64                  RingBaseShift
+  )
+{
+  mRing = Ring;
+  return EFI_SUCCESS;
+}
+
+/**
+  Notifies the virtio device, which processes requests sometimes.
+
+  @param  This         The virtio device protocol.
+  @param  QueueNotify  The index of the queue.
+
+  @retval EFI_SUCCESS  The device is notified.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestSetQueueNotify (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINT16                  QueueNotify
+  )
+{
+  ASSERT (QueueNotify == VIRTIO_SCSI_REQUEST_QUEUE);
+  if (NextRandom () % 4 == 0) {
+    ProcessRequests ();
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Allocates pages shared with the virtio device.
+
+  @param  This         The virtio device protocol.
+  @param  Pages        The number of pages.
+  @param  HostAddress  The pages returned.
+
+  @retval EFI_SUCCESS           The pages are allocated.
+  @retval EFI_OUT_OF_RESOURCES  The pages cannot be allocated.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestAllocateSharedPages (
+  IN  VIRTIO_DEVICE_PROTOCOL  *This,
+  IN  UINTN                   Pages,
+  OUT VOID                    **HostAddress
+  )
+{
+  *HostAddress = AllocateAlignedPages (Pages, EFI_PAGE_SIZE);
+  if (*HostAddress == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  mSharedPages += Pages;
+  return EFI_SUCCESS;
+}
+
+/**
+  Frees pages shared with the virtio device.
+
+  @param  This         The virtio device protocol.
+  @param  Pages        The number of pages.
+  @param  HostAddress  The pages.
+
+**/
+STATIC
+VOID
+EFIAPI
+TestFreeSharedPages (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN UINTN                   Pages,
+  IN VOID                    *HostAddress
+  )
+{
+  ASSERT (mSharedPages >= Pages);
+  mSharedPages -= Pages;
+  FreeAlignedPages (HostAddress, Pages);
+}
+
+/**
+  Maps a buffer for the virtio device. The buffers other than the common
+  buffers are bounced, and the bounce buffer of a read is filled with a
+  pattern, so that data that does not go through the mapping is detected.
+
+  @param  This           The virtio device protocol.
+  @param  Operation      The direction of the transfers.
+  @param  HostAddress    The buffer.
+  @param  NumberOfBytes  The size of the buffer.
+  @param  DeviceAddress  The device address returned.
+  @param  Mapping        The mapping returned.
+
+  @retval EFI_SUCCESS           The buffer is mapped.
+  @retval EFI_OUT_OF_RESOURCES  The mapping cannot be allocated.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestMapSharedBuffer (
+  IN     VIRTIO_DEVICE_PROTOCOL  *This,
+  IN     VIRTIO_MAP_OPERATION    Operation,
+  IN     VOID                    *HostAddress,
+  IN OUT UINTN                   *NumberOfBytes,
+  OUT    EFI_PHYSICAL_ADDRESS    *DeviceAddress,
+  OUT    VOID                    **Mapping
+  )
+{
+  TEST_MAPPING  *Map;
+
+  Map = AllocatePool (sizeof (TEST_MAPPING));
+  if (Map == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Map->Operation     = Operation;
+  Map->HostAddress   = HostAddress;
+  Map->NumberOfBytes = *NumberOfBytes;
+  if (Operation == VirtioOperationBusMasterCommonBuffer) {
+    Map->DeviceAddress = HostAddress;
+  } else {
+    Map->DeviceAddress = AllocatePool (*NumberOfBytes);
+    if (Map->DeviceAddress == NULL) {
+      FreePool (Map);
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    if (Operation == VirtioOperationBusMasterRead) {
+      CopyMem (Map->DeviceAddress, HostAddress, *NumberOfBytes);
+    } else {
+      SetMem (Map->DeviceAddress, *NumberOfBytes, 0xEE);
+    }
+  }
+
+  mMappings++;
+  *DeviceAddress = (EFI_PHYSICAL_ADDRESS)(UINTN)Map->DeviceAddress;
+  *Mapping       = Map;
+  return EFI_SUCCESS;
+}
+
+/**
+  Unmaps a buffer of the virtio device, and copies the data the device wrote
+  back to the buffer. A common buffer is scrambled, the way memory encryption
+  would leave it for the processor, so that data which is not copied out of
+  it before the unmapping is detected.
+
+  @param  This     The virtio device protocol.
+  @param  Mapping  The mapping.
+
+  @retval EFI_SUCCESS  The buffer is unmapped.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+TestUnmapSharedBuffer (
+  IN VIRTIO_DEVICE_PROTOCOL  *This,
+  IN VOID                    *Mapping
+  )
+{
+  TEST_MAPPING  *Map;
+
+  Map = Mapping;
+  if (Map->Operation == VirtioOperationBusMasterWrite) {
+    CopyMem (Map->HostAddress, Map->DeviceAddress, Map->NumberOfBytes);
+  }
+
+  if (Map->Operation != VirtioOperationBusMasterCommonBuffer) {
+    SetMem (Map->DeviceAddress, Map->NumberOfBytes, 0xDD);
+    FreePool (Map->DeviceAddress);
+  } else {
+    SetMem (Map->HostAddress, Map->NumberOfBytes, 0xCC);
+  }
+
+  ASSERT (mMappings > 0);
+  mMappings--;
+  FreePool (Map);
+  return EFI_SUCCESS;
+}
+
+/**
+  Starts the driver on a simulated virtio-scsi device whose disk and model are
+  filled with the same random data.
+
+  @param  Config  The configuration of the device.
+
+  @retval EFI_SUCCESS  The driver installed Extended SCSI Pass Thru.
+  @return              The error of the driver binding Start() function.
+
+**/
+STATIC
+EFI_STATUS
+StartTestDevice (
+  IN CONST TEST_DEVICE_CONFIG  *Config
+  )
+{
+  UINTN  Index;
+
+  mBootServices.RaiseTPL                   = TestRaiseTpl;
+  mBootServices.RestoreTPL                 = TestRestoreTpl;
+  mBootServices.CreateEvent                = TestCreateEvent;
+  mBootServices.CloseEvent                 = TestCloseEvent;
+  mBootServices.SignalEvent                = TestSignalEvent;
+  mBootServices.SetTimer                   = TestSetTimer;
+  mBootServices.Stall                      = TestStall;
+  mBootServices.OpenProtocol               = TestOpenProtocol;
+  mBootServices.CloseProtocol              = TestCloseProtocol;
+  mBootServices.InstallProtocolInterface   = TestInstallProtocolInterface;
+  mBootServices.UninstallProtocolInterface = TestUninstallProtocolInterface;
+  gBS                                      = &mBootServices;
+
+  mVirtIo.Revision            = VIRTIO_SPEC_REVISION (0, 9, 5);
+  mVirtIo.SubSystemDeviceId   = VIRTIO_SUBSYSTEM_SCSI_HOST;
+  mVirtIo.SetDeviceStatus     = TestSetDeviceStatus;
+  mVirtIo.GetDeviceFeatures   = TestGetDeviceFeatures;
+  mVirtIo.SetGuestFeatures    = TestSetGuestFeatures;
+  mVirtIo.ReadDevice          = TestReadDevice;
+  mVirtIo.WriteDevice         = TestWriteDevice;
+  mVirtIo.SetPageSize         = TestSetUint32;
+  mVirtIo.SetQueueSel         = TestSetUint16;
+  mVirtIo.GetQueueNumMax      = TestGetQueueNumMax;
+  mVirtIo.SetQueueNum         = TestSetUint16;
+  mVirtIo.SetQueueAlign       = TestSetUint32;
+  mVirtIo.SetQueueAddress     = TestSetQueueAddress;
+  mVirtIo.SetQueueNotify      = TestSetQueueNotify;
+  mVirtIo.AllocateSharedPages = TestAllocateSharedPages;
+  mVirtIo.FreeSharedPages     = TestFreeSharedPages;
+  mVirtIo.MapSharedBuffer     = TestMapSharedBuffer;
+  mVirtIo.UnmapSharedBuffer   = TestUnmapSharedBuffer;
+
+  mConfig         = *Config;
+  mRing           = NULL;
+  mHostAvailIdx   = 0;
+  mTakenCount     = 0;
+  mMaxInFlight    = 0;
+  mOutOfOrder     = 0;
+  mBusyResponses  = 0;
+  mSharedPages    = 0;
+  mMappings       = 0;
+  mHostPaused     = FALSE;
+  mTimerArms      = 0;
+  mOperationCount = 0;
+
+  for (Index = 0; Index < TEST_DISK_SIZE; Index++) {
+    mDisk[Index]  = (UINT8)NextRandom ();
+    mModel[Index] = mDisk[Index];
+  }
+
+  return VirtioScsiDriverBindingStart (&mDriverBinding, &mVirtIo, NULL);
+}
+
+/**
+  Stops the driver, and checks that it released the events, the shared pages
+  and the mappings of the device.
+
+  @retval TRUE   The driver stopped and released everything.
+  @retval FALSE  The driver failed to stop, or leaked resources.
+
+**/
+STATIC
+BOOLEAN
+StopTestDevice (
+  VOID
+  )
+{
+  if (EFI_ERROR (VirtioScsiDriverBindingStop (&mDriverBinding, &mVirtIo, 0, NULL))) {
+    return FALSE;
+  }
+
+  return (BOOLEAN)(IsListEmpty (&mEvents) && (mSharedPages == 0) && (mMappings == 0));
+}
+
+/**
+  Prepares a READ (10) or WRITE (10) request packet.
+
+  @param  Packet      The packet to prepare.
+  @param  Cdb         The command descriptor block of the packet.
+  @param  Sense       The sense data buffer of the packet.
+  @param  Write       TRUE for a write, FALSE for a read.
+  @param  Lba         The first block to transfer.
+  @param  BufferSize  The size of Buffer.
+  @param  Buffer      The data of the packet.
+
+**/
+STATIC
+VOID
+PreparePacket (
+  OUT EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  *Packet,
+  OUT UINT8                                       *Cdb,
+  OUT UINT8                                       *Sense,
+  IN  BOOLEAN                                     Write,
+  IN  EFI_LBA                                     Lba,
+  IN  UINTN                                       BufferSize,
+  IN  UINT8                                       *Buffer
+  )
+{
+  ZeroMem (Cdb, TEST_CDB_SIZE);
+  Cdb[0] = Write ? EFI_SCSI_OP_WRITE10 : EFI_SCSI_OP_READ10;
+  WriteUnaligned32 ((UINT32 *)&Cdb[2], SwapBytes32 ((UINT32)Lba));
+  WriteUnaligned16 ((UINT16 *)&Cdb[7], SwapBytes16 ((UINT16)(BufferSize / TEST_BLOCK_SIZE)));
+
+  ZeroMem (Packet, sizeof (EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET));
+  Packet->Cdb             = Cdb;
+  Packet->CdbLength       = TEST_CDB_SIZE;
+  Packet->SenseData       = Sense;
+  Packet->SenseDataLength = VIRTIO_SCSI_SENSE_SIZE;
+  if (Write) {
+    Packet->OutDataBuffer     = Buffer;
+    Packet->OutTransferLength = (UINT32)BufferSize;
+    Packet->DataDirection     = EFI_EXT_SCSI_DATA_DIRECTION_WRITE;
+  } else {
+    Packet->InDataBuffer     = Buffer;
+    Packet->InTransferLength = (UINT32)BufferSize;
+    Packet->DataDirection    = EFI_EXT_SCSI_DATA_DIRECTION_READ;
+  }
+}
+
+/**
+  Retires the completed non-blocking requests, and checks their status and
+  the data they read.
+
+  @param  Lba         The first block of the next request.
+  @param  BufferSize  The size of the next request.
+  @param  Write       TRUE if the next request is a write.
+
+  @retval TRUE   A request in flight accesses blocks of the next request, and
+                 one of them writes.
+  @retval FALSE  The next request can be submitted.
+
+**/
+STATIC
+BOOLEAN
+RetireOperations (
+  IN EFI_LBA  Lba,
+  IN UINTN    BufferSize,
+  IN BOOLEAN  Write
+  )
+{
+  UINTN           Index;
+  TEST_OPERATION  *Operation;
+  BOOLEAN         Overlap;
+
+  Overlap = FALSE;
+  for (Index = 0; Index < mOperationCount; Index++) {
+    Operation = &mOperations[Index];
+    if (Operation->Done) {
+      continue;
+    }
+
+    if (((TEST_EVENT *)Operation->Event)->Signaled) {
+      ASSERT (Operation->Packet.HostAdapterStatus == EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK);
+      ASSERT (Operation->Packet.TargetStatus == EFI_EXT_SCSI_STATUS_TARGET_GOOD);
+      if (Operation->Expected != NULL) {
+        ASSERT (Operation->Packet.InTransferLength == Operation->BufferSize);
+        ASSERT (CompareMem (Operation->Buffer, Operation->Expected, Operation->BufferSize) == 0);
+        FreePool (Operation->Expected);
+      } else {
+        ASSERT (Operation->Packet.OutTransferLength == Operation->BufferSize);
+      }
+
+      gBS->CloseEvent (Operation->Event);
+      FreePool (Operation->Buffer);
+      Operation->Done = TRUE;
+      continue;
+    }
+
+    if ((Write || Operation->Write) &&
+        (Lba < Operation->Lba + Operation->BufferSize / TEST_BLOCK_SIZE) &&
+        (Operation->Lba < Lba + BufferSize / TEST_BLOCK_SIZE))
+    {
+      Overlap = TRUE;
+    }
+  }
+
+  return Overlap;
+}
+
+/**
+  Lets time pass until the driver completed all the non-blocking requests.
+
+**/
+STATIC
+VOID
+DrainOperations (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < mOperationCount; Index++) {
+    while (!mOperations[Index].Done) {
+      Tick ();
+      RetireOperations (0, 0, FALSE);
+    }
+  }
+
+  mOperationCount = 0;
+}
+
+/**
+  Reads and writes random blocks of the disk, blocking and non-blocking, and
+  checks the data read and the disk content against a model of the disk.
+
+  @param[in]  Context  The configuration of the device.
+
+  @retval  UNIT_TEST_PASSED             The data matches the model.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The data does not match the model.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+RandomRequestsMatchDisk (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_OPERATION                              *Operation;
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  Packet;
+  UINT8                                       Cdb[TEST_CDB_SIZE];
+  UINT8                                       Sense[VIRTIO_SCSI_SENSE_SIZE];
+  UINT8                                       Target[TARGET_MAX_BYTES];
+  UINTN                                       Iteration;
+  UINTN                                       Kind;
+  UINTN                                       Index;
+  EFI_LBA                                     Lba;
+  UINTN                                       BlockCount;
+  UINTN                                       BufferSize;
+  UINT8                                       *Buffer;
+  BOOLEAN                                     Write;
+
+  mSeed = 1;
+  UT_ASSERT_NOT_EFI_ERROR (StartTestDevice (Context));
+  UT_ASSERT_NOT_NULL (mPassThru);
+  UT_ASSERT_TRUE ((mPassThru->Mode->Attributes & EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_NONBLOCKIO) != 0);
+
+  SetMem (Target, sizeof (Target), 0);
+  Target[0] = TEST_DISK_TARGET;
+
+  for (Iteration = 0; Iteration < TEST_ITERATIONS; Iteration++) {
+    Kind       = NextRandom () % 12;
+    Write      = (BOOLEAN)(Kind >= 6);
+    BlockCount = 1 + ((NextRandom () % 4 != 0) ? NextRandom () % 8 : NextRandom () % 64);
+    Lba        = (NextRandom () % 4 != 0) ? NextRandom () % 64 : NextRandom () % (TEST_BLOCK_COUNT - BlockCount);
+    Lba        = MIN (Lba, TEST_BLOCK_COUNT - BlockCount);
+    BufferSize = BlockCount * TEST_BLOCK_SIZE;
+
+    if (mOperationCount == TEST_MAX_OPERATIONS) {
+      DrainOperations ();
+    }
+
+    while (RetireOperations (Lba, BufferSize, Write)) {
+      Tick ();
+    }
+
+    Buffer = AllocatePool (BufferSize);
+    UT_ASSERT_NOT_NULL (Buffer);
+    if (Write) {
+      for (Index = 0; Index < BufferSize; Index++) {
+        Buffer[Index] = (UINT8)NextRandom ();
+      }
+
+      CopyMem (mModel + Lba * TEST_BLOCK_SIZE, Buffer, BufferSize);
+    }
+
+    if (Kind % 3 == 0) {
+      PreparePacket (&Packet, Cdb, Sense, Write, Lba, BufferSize, Buffer);
+      UT_ASSERT_NOT_EFI_ERROR (mPassThru->PassThru (mPassThru, Target, 0, &Packet, NULL));
+      UT_ASSERT_EQUAL (Packet.HostAdapterStatus, EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK);
+      UT_ASSERT_EQUAL (Packet.TargetStatus, EFI_EXT_SCSI_STATUS_TARGET_GOOD);
+      if (!Write) {
+        UT_ASSERT_EQUAL (Packet.InTransferLength, BufferSize);
+        UT_ASSERT_MEM_EQUAL (Buffer, mModel + Lba * TEST_BLOCK_SIZE, BufferSize);
+      }
+
+      FreePool (Buffer);
+      continue;
+    }
+
+    Operation = &mOperations[mOperationCount++];
+    ZeroMem (Operation, sizeof (TEST_OPERATION));
+    Operation->Write      = Write;
+    Operation->Lba        = Lba;
+    Operation->BufferSize = BufferSize;
+    Operation->Buffer     = Buffer;
+    if (!Write) {
+      Operation->Expected = AllocateCopyPool (BufferSize, mModel + Lba * TEST_BLOCK_SIZE);
+      UT_ASSERT_NOT_NULL (Operation->Expected);
+    }
+
+    PreparePacket (&Operation->Packet, Operation->Cdb, Operation->Sense, Write, Lba, BufferSize, Buffer);
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operation->Event));
+    UT_ASSERT_NOT_EFI_ERROR (mPassThru->PassThru (mPassThru, Target, 0, &Operation->Packet, Operation->Event));
+  }
+
+  DrainOperations ();
+
+  UT_ASSERT_NOT_NULL (mReapTimer);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  UT_ASSERT_MEM_EQUAL (mDisk, mModel, TEST_DISK_SIZE);
+  //
+  // A queue of 8 descriptors holds two requests
+  //
+  UT_ASSERT_EQUAL (mMaxInFlight > 1, mConfig.QueueSize >= 8);
+  UT_ASSERT_EQUAL (mOutOfOrder > 0, mConfig.QueueSize >= 8);
+  UT_ASSERT_TRUE (mMaxInFlight <= MIN (mConfig.QueueSize / 4, VSCSI_MAX_IN_FLIGHT));
+
+  UT_LOG_INFO (
+    "queue size %d: max in flight %d, %d out of order, timer armed %d times\n",
+    mConfig.QueueSize,
+    (UINT32)mMaxInFlight,
+    (UINT32)mOutOfOrder,
+    (UINT32)mTimerArms
+    );
+
+  UT_ASSERT_TRUE (StopTestDevice ());
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that a busy target is reported to blocking and non-blocking callers,
+  and does not disturb the requests to the disk around it.
+
+  @param[in]  Context  The configuration of the device.
+
+  @retval  UNIT_TEST_PASSED             The busy target is reported.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The busy target is reported wrong.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+BusyTargetIsReported (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_OPERATION                              Operations[6];
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  Packet;
+  UINT8                                       Cdb[TEST_CDB_SIZE];
+  UINT8                                       Sense[VIRTIO_SCSI_SENSE_SIZE];
+  UINT8                                       Buffer[ARRAY_SIZE (Operations)][TEST_BLOCK_SIZE];
+  UINT8                                       DiskTarget[TARGET_MAX_BYTES];
+  UINT8                                       BusyTarget[TARGET_MAX_BYTES];
+  UINT8                                       AbsentTarget[TARGET_MAX_BYTES];
+  UINTN                                       Index;
+  BOOLEAN                                     Busy;
+
+  mSeed = 3;
+  UT_ASSERT_NOT_EFI_ERROR (StartTestDevice (Context));
+  SetMem (DiskTarget, sizeof (DiskTarget), 0);
+  SetMem (BusyTarget, sizeof (BusyTarget), 0);
+  SetMem (AbsentTarget, sizeof (AbsentTarget), 0);
+  DiskTarget[0]   = TEST_DISK_TARGET;
+  BusyTarget[0]   = TEST_BUSY_TARGET;
+  AbsentTarget[0] = TEST_MAX_TARGET;
+
+  //
+  // A blocking caller gets the status of the host
+  //
+  PreparePacket (&Packet, Cdb, Sense, FALSE, 0, TEST_BLOCK_SIZE, Buffer[0]);
+  UT_ASSERT_STATUS_EQUAL (mPassThru->PassThru (mPassThru, BusyTarget, 0, &Packet, NULL), EFI_NOT_READY);
+  UT_ASSERT_EQUAL (Packet.HostAdapterStatus, EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK);
+
+  PreparePacket (&Packet, Cdb, Sense, FALSE, 0, TEST_BLOCK_SIZE, Buffer[0]);
+  UT_ASSERT_STATUS_EQUAL (mPassThru->PassThru (mPassThru, AbsentTarget, 0, &Packet, NULL), EFI_TIMEOUT);
+  UT_ASSERT_EQUAL (Packet.HostAdapterStatus, EFI_EXT_SCSI_STATUS_HOST_ADAPTER_TIMEOUT_COMMAND);
+
+  //
+  // A non-blocking caller only sees the packet: the busy target must show in
+  // the target status, between requests to the disk that succeed
+  //
+  for (Index = 0; Index < ARRAY_SIZE (Operations); Index++) {
+    Busy = (BOOLEAN)(Index % 2 != 0);
+    ZeroMem (&Operations[Index], sizeof (TEST_OPERATION));
+    PreparePacket (&Operations[Index].Packet, Operations[Index].Cdb, Operations[Index].Sense, FALSE, Index, TEST_BLOCK_SIZE, Buffer[Index]);
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operations[Index].Event));
+    UT_ASSERT_NOT_EFI_ERROR (
+      mPassThru->PassThru (mPassThru, Busy ? BusyTarget : DiskTarget, 0, &Operations[Index].Packet, Operations[Index].Event)
+      );
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (Operations); Index++) {
+    while (!((TEST_EVENT *)Operations[Index].Event)->Signaled) {
+      Tick ();
+    }
+
+    if (Index % 2 != 0) {
+      UT_ASSERT_EQUAL (Operations[Index].Packet.HostAdapterStatus, EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK);
+      UT_ASSERT_EQUAL (Operations[Index].Packet.TargetStatus, EFI_EXT_SCSI_STATUS_TARGET_BUSY);
+    } else {
+      UT_ASSERT_EQUAL (Operations[Index].Packet.HostAdapterStatus, EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK);
+      UT_ASSERT_EQUAL (Operations[Index].Packet.TargetStatus, EFI_EXT_SCSI_STATUS_TARGET_GOOD);
+      UT_ASSERT_MEM_EQUAL (Buffer[Index], mModel + Index * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+    }
+
+    gBS->CloseEvent (Operations[Index].Event);
+  }
+
+  UT_ASSERT_EQUAL (mBusyResponses, 1 + ARRAY_SIZE (Operations) / 2);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  UT_ASSERT_TRUE (StopTestDevice ());
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that the requests that find no free slot wait in the driver, and are
+  submitted in order as the host completes the ones in flight.
+
+  @param[in]  Context  The configuration of the device.
+
+  @retval  UNIT_TEST_PASSED             The requests wait for the slots.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  More requests than slots are in
+                                        flight, or a request is lost.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+PendingRequestsWaitForSlots (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_OPERATION  *Operation;
+  UINT8           Target[TARGET_MAX_BYTES];
+  UINTN           Index;
+  UINTN           Count;
+
+  mSeed = 4;
+  UT_ASSERT_NOT_EFI_ERROR (StartTestDevice (Context));
+  SetMem (Target, sizeof (Target), 0);
+  Target[0] = TEST_DISK_TARGET;
+
+  //
+  // While the host does not look at the ring, the driver fills the slots,
+  // and queues the rest
+  //
+  mHostPaused = TRUE;
+  Count       = VSCSI_MAX_IN_FLIGHT + VSCSI_MAX_IN_FLIGHT / 2;
+  for (Index = 0; Index < Count; Index++) {
+    Operation = &mOperations[mOperationCount++];
+    ZeroMem (Operation, sizeof (TEST_OPERATION));
+    Operation->Lba        = Index;
+    Operation->BufferSize = TEST_BLOCK_SIZE;
+    Operation->Buffer     = AllocatePool (TEST_BLOCK_SIZE);
+    Operation->Expected   = AllocateCopyPool (TEST_BLOCK_SIZE, mModel + Index * TEST_BLOCK_SIZE);
+    UT_ASSERT_NOT_NULL (Operation->Buffer);
+    UT_ASSERT_NOT_NULL (Operation->Expected);
+    PreparePacket (&Operation->Packet, Operation->Cdb, Operation->Sense, FALSE, Index, TEST_BLOCK_SIZE, Operation->Buffer);
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operation->Event));
+    UT_ASSERT_NOT_EFI_ERROR (mPassThru->PassThru (mPassThru, Target, 0, &Operation->Packet, Operation->Event));
+  }
+
+  UT_ASSERT_EQUAL ((UINT16)(*mRing->Avail.Idx - mHostAvailIdx), VSCSI_MAX_IN_FLIGHT);
+  for (Index = 0; Index < 8; Index++) {
+    Tick ();
+  }
+
+  UT_ASSERT_EQUAL ((UINT16)(*mRing->Avail.Idx - mHostAvailIdx), VSCSI_MAX_IN_FLIGHT);
+
+  //
+  // Each completion lets a waiting request in
+  //
+  mHostPaused = FALSE;
+  DrainOperations ();
+  UT_ASSERT_EQUAL (mMaxInFlight, VSCSI_MAX_IN_FLIGHT);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  UT_ASSERT_TRUE (StopTestDevice ());
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Checks that the timer that reaps the completed requests runs only while
+  non-blocking requests are outstanding.
+
+  @param[in]  Context  The configuration of the device.
+
+  @retval  UNIT_TEST_PASSED             The timer runs only when needed.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  The timer runs while the device is
+                                        idle, or not while a non-blocking
+                                        request is outstanding.
+
+**/
+STATIC
+UNIT_TEST_STATUS
+EFIAPI
+ReapTimerRunsOnlyWhenNeeded (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  TEST_OPERATION                              Operations[2];
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  Packet;
+  UINT8                                       Cdb[TEST_CDB_SIZE];
+  UINT8                                       Sense[VIRTIO_SCSI_SENSE_SIZE];
+  UINT8                                       Buffer[ARRAY_SIZE (Operations)][TEST_BLOCK_SIZE];
+  UINT8                                       Target[TARGET_MAX_BYTES];
+  UINTN                                       Index;
+
+  mSeed = 2;
+  UT_ASSERT_NOT_EFI_ERROR (StartTestDevice (Context));
+  UT_ASSERT_NOT_NULL (mReapTimer);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  SetMem (Target, sizeof (Target), 0);
+  Target[0] = TEST_DISK_TARGET;
+
+  //
+  // Blocking requests poll for their completion
+  //
+  PreparePacket (&Packet, Cdb, Sense, FALSE, 0, TEST_BLOCK_SIZE, Buffer[0]);
+  UT_ASSERT_NOT_EFI_ERROR (mPassThru->PassThru (mPassThru, Target, 0, &Packet, NULL));
+  PreparePacket (&Packet, Cdb, Sense, TRUE, 1, TEST_BLOCK_SIZE, Buffer[0]);
+  UT_ASSERT_NOT_EFI_ERROR (mPassThru->PassThru (mPassThru, Target, 0, &Packet, NULL));
+  CopyMem (mModel + TEST_BLOCK_SIZE, Buffer[0], TEST_BLOCK_SIZE);
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  UT_ASSERT_EQUAL (mTimerArms, 0);
+
+  //
+  // The timer runs from the first non-blocking request until the last one
+  // completes, and only the timer completes them
+  //
+  for (Index = 0; Index < ARRAY_SIZE (Operations); Index++) {
+    ZeroMem (&Operations[Index], sizeof (TEST_OPERATION));
+    PreparePacket (&Operations[Index].Packet, Operations[Index].Cdb, Operations[Index].Sense, FALSE, Index, TEST_BLOCK_SIZE, Buffer[Index]);
+    UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operations[Index].Event));
+    UT_ASSERT_NOT_EFI_ERROR (mPassThru->PassThru (mPassThru, Target, 0, &Operations[Index].Packet, Operations[Index].Event));
+    UT_ASSERT_TRUE (mReapTimer->TimerArmed);
+  }
+
+  UT_ASSERT_EQUAL (mTimerArms, 1);
+  while (!((TEST_EVENT *)Operations[0].Event)->Signaled || !((TEST_EVENT *)Operations[1].Event)->Signaled) {
+    UT_ASSERT_TRUE (mReapTimer->TimerArmed);
+    Tick ();
+  }
+
+  UT_ASSERT_FALSE (mReapTimer->TimerArmed);
+  for (Index = 0; Index < ARRAY_SIZE (Operations); Index++) {
+    UT_ASSERT_EQUAL (Operations[Index].Packet.HostAdapterStatus, EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK);
+    UT_ASSERT_MEM_EQUAL (Buffer[Index], mModel + Index * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+    gBS->CloseEvent (Operations[Index].Event);
+  }
+
+  //
+  // It is armed again for the next one, which Stop() waits for
+  //
+  PreparePacket (&Operations[0].Packet, Operations[0].Cdb, Operations[0].Sense, FALSE, 2, TEST_BLOCK_SIZE, Buffer[0]);
+  UT_ASSERT_NOT_EFI_ERROR (gBS->CreateEvent (0, TPL_APPLICATION, NULL, NULL, &Operations[0].Event));
+  UT_ASSERT_NOT_EFI_ERROR (mPassThru->PassThru (mPassThru, Target, 0, &Operations[0].Packet, Operations[0].Event));
+  UT_ASSERT_TRUE (mReapTimer->TimerArmed);
+  UT_ASSERT_EQUAL (mTimerArms, 2);
+  UT_ASSERT_NOT_EFI_ERROR (VirtioScsiDriverBindingStop (&mDriverBinding, &mVirtIo, 0, NULL));
+  UT_ASSERT_TRUE (((TEST_EVENT *)Operations[0].Event)->Signaled);
+  UT_ASSERT_MEM_EQUAL (Buffer[0], mModel + 2 * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+  gBS->CloseEvent (Operations[0].Event);
+
+  UT_ASSERT_TRUE (IsListEmpty (&mEvents));
+  UT_ASSERT_EQUAL (mSharedPages, 0);
+  UT_ASSERT_EQUAL (mMappings, 0);
+  return UNIT_TEST_PASSED;
+}
+
+STATIC CONST TEST_DEVICE_CONFIG  mTinyQueue   = { 4 };
+STATIC CONST TEST_DEVICE_CONFIG  mSmallQueue  = { 8 };
+STATIC CONST TEST_DEVICE_CONFIG  mMediumQueue = { 64 };
+STATIC CONST TEST_DEVICE_CONFIG  mLargeQueue  = { 256 };
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the request
+  engine of the virtio-scsi driver and run them.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+UnitTestingEntry (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      RequestTests;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&RequestTests, Framework, "Virtio SCSI Request Tests", "VirtioScsi.Requests", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for Virtio SCSI Request Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  //
+  // --------------Suite-----------Description----------------------------------------Name-------------Function------------------Pre---Post---Context----------------------------
+  //
+  AddTestCase (RequestTests, "Requests on a queue of 4 match the disk", "TinyQueue", RandomRequestsMatchDisk, NULL, NULL, (UNIT_TEST_CONTEXT)&mTinyQueue);
+  AddTestCase (RequestTests, "Requests on a queue of 8 match the disk", "SmallQueue", RandomRequestsMatchDisk, NULL, NULL, (UNIT_TEST_CONTEXT)&mSmallQueue);
+  AddTestCase (RequestTests, "Requests on a queue of 64 match the disk", "MediumQueue", RandomRequestsMatchDisk, NULL, NULL, (UNIT_TEST_CONTEXT)&mMediumQueue);
+  AddTestCase (RequestTests, "Requests beyond the slots wait for one", "PendingQueue", PendingRequestsWaitForSlots, NULL, NULL, (UNIT_TEST_CONTEXT)&mLargeQueue);
+  AddTestCase (RequestTests, "Busy target is reported", "BusyTarget", BusyTargetIsReported, NULL, NULL, (UNIT_TEST_CONTEXT)&mSmallQueue);
+  AddTestCase (RequestTests, "Reap timer runs only with non-blocking requests", "ReapTimer", ReapTimerRunsOnlyWhenNeeded, NULL, NULL, (UNIT_TEST_CONTEXT)&mMediumQueue);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+///
+/// Avoid ECC error for function name that starts with lower case letter
+///
+#define VirtioScsiUnitTestMain  main
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param[in] Argc  Number of arguments
+  @param[in] Argv  Array of pointers to arguments
+
+  @retval 0      Success
+  @retval other  Error
+**/
+INT32
+VirtioScsiUnitTestMain (
+  IN INT32  Argc,
+  IN CHAR8  *Argv[]
+  )
+{
+  UnitTestingEntry ();
+  return 0;
+}
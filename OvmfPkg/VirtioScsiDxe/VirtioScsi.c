@@ -7,16 +7,17 @@
 
   - No hotplug / hot-unplug.
 
-  - Although EFI_EXT_SCSI_PASS_THRU_PROTOCOL.PassThru() could be a good match
-    for multiple in-flight virtio-scsi requests, we stick to synchronous
-    requests for now.
+  - EFI_EXT_SCSI_PASS_THRU_PROTOCOL.PassThru() supports non-blocking requests.
+    Up to VSCSI_MAX_IN_FLIGHT requests are kept in flight on the request
+    queue, further ones wait in a FIFO queue. Completions are reaped by a
+    timer, and by blocking callers while they poll for their own request.
 
   - Timeouts are not supported for EFI_EXT_SCSI_PASS_THRU_PROTOCOL.PassThru().
 
   - Only one channel is supported. (At the time of this writing, host-side
     virtio-scsi supports a single channel too.)
 
-  - Only one request queue is used (for the one synchronous request).
+  - Only one request queue is used.
 
   - The ResetChannel() and ResetTargetLun() functions of
     EFI_EXT_SCSI_PASS_THRU_PROTOCOL are not supported (which is allowed by the
@@ -33,6 +34,8 @@
 
 **/
 
+#include <Uefi.h>
+
 #include <IndustryStandard/VirtioScsi.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
@@ -410,6 +413,400 @@ ReportHostAdapterError (
   return EFI_DEVICE_ERROR;
 }
 
+/**
+
+  Format a prepared request as up to four consecutive virtio descriptors in a
+  free slot, and push them to the host without waiting for the response.
+
+  The caller is responsible for raising the TPL to TPL_NOTIFY.
+
+  @param[in] Dev      The virtio-scsi host device the request is targeted at.
+
+  @param[in] SlotIdx  The free slot to carry the request.
+
+  @param[in] Req      The request to submit, prepared by VirtioScsiPassThru().
+
+**/
+STATIC
+VOID
+SubmitRequest (
+  IN VSCSI_DEV  *Dev,
+  IN UINT16     SlotIdx,
+  IN VSCSI_REQ  *Req
+  )
+{
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  *Packet;
+  volatile VSCSI_SHARED_SLOT                  *Shared;
+  EFI_PHYSICAL_ADDRESS                        SharedDeviceAddress;
+  DESC_INDICES                                Indices;
+  UINT16                                      AvailIdx;
+  EFI_STATUS                                  Status;
+
+  Packet              = Req->Packet;
+  Shared              = &Dev->Shared[SlotIdx];
+  SharedDeviceAddress = Dev->SharedAddr + SlotIdx * sizeof (VSCSI_SHARED_SLOT);
+
+  ASSERT (Dev->Slots[SlotIdx] == NULL);
+
+  Shared->Request = Req->Request;
+
+  //
+  // preset a host status for ourselves that we do not accept as success
+  //
+  ZeroMem ((VOID *)&Shared->Response, sizeof Shared->Response);
+  Shared->Response.Response = VIRTIO_SCSI_S_FAILURE;
+
+  //
+  // We're going to poll the answer, the host should not send an interrupt.
+  //
+  *Dev->Ring.Avail.Flags = (UINT16)VRING_AVAIL_F_NO_INTERRUPT;
+
+  //
+  // Each slot owns four consecutive descriptors, starting at the head
+  // descriptor of its chain. VirtioScsiInit() ensures they all exist.
+  //
+  Indices.HeadDescIdx = (UINT16)(SlotIdx * 4);
+  Indices.NextDescIdx = Indices.HeadDescIdx;
+
+  //
+  // enqueue Request
+  //
+  VirtioAppendDesc (
+    &Dev->Ring,
+    SharedDeviceAddress + OFFSET_OF (VSCSI_SHARED_SLOT, Request),
+    sizeof Shared->Request,
+    VRING_DESC_F_NEXT,
+    &Indices
+    );
+
+  //
+  // enqueue "dataout" if any
+  //
+  if (Packet->OutTransferLength > 0) {
+    VirtioAppendDesc (
+      &Dev->Ring,
+      Req->OutDataDeviceAddress,
+      Packet->OutTransferLength,
+      VRING_DESC_F_NEXT,
+      &Indices
+      );
+  }
+
+  //
+  // enqueue Response, to be written by the host
+  //
+  VirtioAppendDesc (
+    &Dev->Ring,
+    SharedDeviceAddress + OFFSET_OF (VSCSI_SHARED_SLOT, Response),
+    sizeof Shared->Response,
+    VRING_DESC_F_WRITE | (Packet->InTransferLength > 0 ? VRING_DESC_F_NEXT : 0),
+    &Indices
+    );
+
+  //
+  // enqueue "datain" if any, to be written by the host
+  //
+  if (Packet->InTransferLength > 0) {
+    VirtioAppendDesc (
+      &Dev->Ring,
+      Req->InDataDeviceAddress,
+      Packet->InTransferLength,
+      VRING_DESC_F_WRITE,
+      &Indices
+      );
+  }
+
+  Dev->Slots[SlotIdx] = Req;
+  Dev->InFlight++;
+
+  //
+  // virtio-0.9.5, 2.4.1.2 Updating the Available Ring
+  //
+  // The available index is never written by the host, we can read it back
+  // without a barrier.
+  //
+  AvailIdx                                               = *Dev->Ring.Avail.Idx;
+  Dev->Ring.Avail.Ring[AvailIdx++ % Dev->Ring.QueueSize] = Indices.HeadDescIdx;
+
+  //
+  // virtio-0.9.5, 2.4.1.3 Updating the Index Field
+  //
+  MemoryFence ();
+  *Dev->Ring.Avail.Idx = AvailIdx;
+
+  //
+  // virtio-0.9.5, 2.4.1.4 Notifying the Device. A failed notification leaves
+  // the request in flight; it completes whenever the host looks at the ring.
+  //
+  MemoryFence ();
+  Status = Dev->VirtIo->SetQueueNotify (Dev->VirtIo, VIRTIO_SCSI_REQUEST_QUEUE);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: SetQueueNotify: %r\n", __FUNCTION__, Status));
+  }
+}
+
+/**
+
+  Release the data buffer mappings and the intermediate input buffer of a
+  request.
+
+  If the request has been processed by the host, then the contents of the
+  intermediate input buffer are copied to the caller's buffer first.
+
+  @param[in] Dev        The virtio-scsi host device.
+
+  @param[in] Req        The request whose resources should be released.
+
+  @param[in] Processed  TRUE iff the host has processed the request, and
+                        Req->Packet->InTransferLength has been updated by
+                        ParseResponse().
+
+**/
+STATIC
+VOID
+ReleaseRequest (
+  IN VSCSI_DEV  *Dev,
+  IN VSCSI_REQ  *Req,
+  IN BOOLEAN    Processed
+  )
+{
+  //
+  // If the virtio request was successful and it was a CPU read request, then
+  // we have used an intermediate buffer. Copy the data from the intermediate
+  // buffer to the final buffer, while it is still mapped.
+  //
+  if (Processed && (Req->InDataBuffer != NULL)) {
+    CopyMem (
+      Req->Packet->InDataBuffer,
+      Req->InDataBuffer,
+      Req->Packet->InTransferLength
+      );
+  }
+
+  if (Req->OutDataMapping != NULL) {
+    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Req->OutDataMapping);
+  }
+
+  if (Req->InDataMapping != NULL) {
+    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Req->InDataMapping);
+  }
+
+  if (Req->InDataBuffer != NULL) {
+    Dev->VirtIo->FreeSharedPages (
+                   Dev->VirtIo,
+                   Req->InDataNumPages,
+                   Req->InDataBuffer
+                   );
+  }
+}
+
+/**
+
+  Report the outcome of a request to its submitter.
+
+  Non-blocking requests signal their event and are freed; blocking requests
+  are marked done for VirtioScsiPassThru() to pick up. The reap timer is
+  cancelled when the last non-blocking request completes.
+
+  The submitter of a non-blocking request only sees the packet, so an error
+  that the host adapter and target status fields of the packet do not reflect
+  yet is recorded there: EFI_NOT_READY as a busy target, anything else as a
+  host adapter failure.
+
+  The caller is responsible for raising the TPL to TPL_NOTIFY.
+
+  @param[in] Dev     The virtio-scsi host device.
+
+  @param[in] Req     The request that has completed.
+
+  @param[in] Status  The outcome of the request.
+
+**/
+STATIC
+VOID
+CompleteRequest (
+  IN VSCSI_DEV   *Dev,
+  IN VSCSI_REQ   *Req,
+  IN EFI_STATUS  Status
+  )
+{
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  *Packet;
+  EFI_EVENT                                   Event;
+
+  Req->Status = Status;
+
+  Event = Req->Event;
+  if (Event == NULL) {
+    Req->Done = TRUE;
+    return;
+  }
+
+  Packet = Req->Packet;
+  if (EFI_ERROR (Status) &&
+      (Packet->HostAdapterStatus == EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK) &&
+      (Packet->TargetStatus == EFI_EXT_SCSI_STATUS_TARGET_GOOD))
+  {
+    if (Status == EFI_NOT_READY) {
+      Packet->TargetStatus = EFI_EXT_SCSI_STATUS_TARGET_BUSY;
+    } else {
+      Packet->HostAdapterStatus = EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OTHER;
+    }
+  }
+
+  FreePool (Req);
+
+  ASSERT (Dev->AsyncPending > 0);
+  Dev->AsyncPending--;
+  if (Dev->AsyncPending == 0) {
+    gBS->SetTimer (Dev->ReapTimer, TimerCancel, 0);
+  }
+
+  gBS->SignalEvent (Event);
+}
+
+/**
+
+  Submit requests from the head of the pending queue, for as long as there are
+  free slots.
+
+  The caller is responsible for raising the TPL to TPL_NOTIFY.
+
+  @param[in] Dev  The virtio-scsi host device.
+
+**/
+STATIC
+VOID
+StartPendingRequests (
+  IN VSCSI_DEV  *Dev
+  )
+{
+  VSCSI_REQ  *Req;
+  UINT16     SlotIdx;
+
+  while (!IsListEmpty (&Dev->PendingQueue) && (Dev->InFlight < Dev->SlotCount)) {
+    Req = VSCSI_REQ_FROM_LINK (GetFirstNode (&Dev->PendingQueue));
+
+    for (SlotIdx = 0; Dev->Slots[SlotIdx] != NULL; SlotIdx++) {
+    }
+
+    ASSERT (SlotIdx < Dev->SlotCount);
+
+    RemoveEntryList (&Req->Link);
+    SubmitRequest (Dev, SlotIdx, Req);
+  }
+}
+
+/**
+
+  Collect the requests that the host has processed from the used ring, report
+  their outcome, and submit pending requests into the slots released.
+
+  The caller is responsible for raising the TPL to TPL_NOTIFY.
+
+  @param[in] Dev  The virtio-scsi host device.
+
+**/
+STATIC
+VOID
+ReapRequests (
+  IN VSCSI_DEV  *Dev
+  )
+{
+  UINT16                          UsedIdx;
+  volatile CONST VRING_USED_ELEM  *UsedElem;
+  UINT32                          HeadDescIdx;
+  UINT16                          SlotIdx;
+  VSCSI_REQ                       *Req;
+  EFI_STATUS                      Status;
+
+  //
+  // virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device
+  //
+  MemoryFence ();
+  UsedIdx = *Dev->Ring.Used.Idx;
+  MemoryFence ();
+
+  while (Dev->LastUsedIdx != UsedIdx) {
+    UsedElem    = &Dev->Ring.Used.UsedElem[Dev->LastUsedIdx++ % Dev->Ring.QueueSize];
+    HeadDescIdx = UsedElem->Id;
+    SlotIdx     = (UINT16)(HeadDescIdx / 4);
+    if ((HeadDescIdx % 4 != 0) || (SlotIdx >= Dev->SlotCount) ||
+        (Dev->Slots[SlotIdx] == NULL))
+    {
+      DEBUG ((DEBUG_ERROR, "%a: bogus used element %u\n", __FUNCTION__, HeadDescIdx));
+      ASSERT (FALSE);
+      continue;
+    }
+
+    Req                 = Dev->Slots[SlotIdx];
+    Dev->Slots[SlotIdx] = NULL;
+    Dev->InFlight--;
+
+    Status = ParseResponse (Req->Packet, &Dev->Shared[SlotIdx].Response);
+    ReleaseRequest (Dev, Req, TRUE);
+    CompleteRequest (Dev, Req, Status);
+  }
+
+  StartPendingRequests (Dev);
+}
+
+/**
+
+  Timer notification function that completes the requests processed by the
+  host while nobody polls for them. The timer runs only while non-blocking
+  requests are outstanding.
+
+  @param[in] Event    Event whose notification function is being invoked.
+
+  @param[in] Context  Pointer to the VSCSI_DEV structure.
+
+**/
+STATIC
+VOID
+EFIAPI
+VirtioScsiReapTimer (
+  IN  EFI_EVENT  Event,
+  IN  VOID       *Context
+  )
+{
+  ReapRequests (Context);
+}
+
+/**
+
+  Wait until the pending queue is empty and no request is in flight.
+
+  @param[in] Dev  The virtio-scsi host device.
+
+**/
+STATIC
+VOID
+DrainRequests (
+  IN VSCSI_DEV  *Dev
+  )
+{
+  EFI_TPL  OldTpl;
+  BOOLEAN  Idle;
+  UINTN    PollPeriodUsecs;
+
+  PollPeriodUsecs = 1;
+  for ( ; ;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    Idle = (BOOLEAN)(IsListEmpty (&Dev->PendingQueue) && (Dev->InFlight == 0));
+    gBS->RestoreTPL (OldTpl);
+
+    if (Idle) {
+      return;
+    }
+
+    gBS->Stall (PollPeriodUsecs);
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
+}
+
 //
 // The next seven functions implement EFI_EXT_SCSI_PASS_THRU_PROTOCOL
 // for the virtio-scsi HBA. Refer to UEFI Spec 2.3.1 + Errata C, sections
@@ -427,61 +824,39 @@ VirtioScsiPassThru (
   IN     EFI_EVENT                                   Event   OPTIONAL
   )
 {
-  VSCSI_DEV                  *Dev;
-  UINT16                     TargetValue;
-  EFI_STATUS                 Status;
-  volatile VIRTIO_SCSI_REQ   Request;
-  volatile VIRTIO_SCSI_RESP  *Response;
-  VOID                       *ResponseBuffer;
-  DESC_INDICES               Indices;
-  VOID                       *RequestMapping;
-  VOID                       *ResponseMapping;
-  VOID                       *InDataMapping;
-  VOID                       *OutDataMapping;
-  EFI_PHYSICAL_ADDRESS       RequestDeviceAddress;
-  EFI_PHYSICAL_ADDRESS       ResponseDeviceAddress;
-  EFI_PHYSICAL_ADDRESS       InDataDeviceAddress;
-  EFI_PHYSICAL_ADDRESS       OutDataDeviceAddress;
-  VOID                       *InDataBuffer;
-  UINTN                      InDataNumPages;
-  BOOLEAN                    OutDataBufferIsMapped;
-
-  //
-  // Set InDataMapping,OutDataMapping,InDataDeviceAddress and OutDataDeviceAddress to
-  // suppress incorrect compiler/analyzer warnings.
-  //
-  InDataMapping        = NULL;
-  OutDataMapping       = NULL;
-  InDataDeviceAddress  = 0;
-  OutDataDeviceAddress = 0;
-
-  ZeroMem ((VOID *)&Request, sizeof (Request));
+  VSCSI_DEV   *Dev;
+  UINT16      TargetValue;
+  EFI_STATUS  Status;
+  VSCSI_REQ   BlockingReq;
+  VSCSI_REQ   *Req;
+  EFI_TPL     OldTpl;
+  UINTN       PollPeriodUsecs;
 
   Dev = VIRTIO_SCSI_FROM_PASS_THRU (This);
   CopyMem (&TargetValue, Target, sizeof TargetValue);
 
-  InDataBuffer          = NULL;
-  OutDataBufferIsMapped = FALSE;
-  InDataNumPages        = 0;
-
-  Status = PopulateRequest (Dev, TargetValue, Lun, Packet, &Request);
-  if (EFI_ERROR (Status)) {
-    return Status;
-  }
-
   //
-  // Map the virtio-scsi Request header buffer
+  // Blocking requests live on the stack. Non-blocking ones outlive this call,
+  // until the host processes them.
   //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterRead,
-             (VOID *)&Request,
-             sizeof Request,
-             &RequestDeviceAddress,
-             &RequestMapping
-             );
+  if (Event == NULL) {
+    Req = &BlockingReq;
+  } else {
+    Req = AllocatePool (sizeof *Req);
+    if (Req == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  ZeroMem (Req, sizeof *Req);
+  Req->Signature = VSCSI_REQ_SIG;
+  Req->Packet    = Packet;
+  Req->Event     = Event;
+  Req->Status    = EFI_DEVICE_ERROR;
+
+  Status = PopulateRequest (Dev, TargetValue, Lun, Packet, &Req->Request);
   if (EFI_ERROR (Status)) {
-    return ReportHostAdapterError (Packet);
+    goto FreeReq;
   }
 
   //
@@ -503,30 +878,32 @@ VirtioScsiPassThru (
     // the Virtio request is successful then we copy the data from temporary
     // buffer into Packet->InDataBuffer.
     //
-    InDataNumPages = EFI_SIZE_TO_PAGES ((UINTN)Packet->InTransferLength);
-    Status         = Dev->VirtIo->AllocateSharedPages (
-                                    Dev->VirtIo,
-                                    InDataNumPages,
-                                    &InDataBuffer
-                                    );
+    Req->InDataNumPages = EFI_SIZE_TO_PAGES ((UINTN)Packet->InTransferLength);
+    Status              = Dev->VirtIo->AllocateSharedPages (
+                                         Dev->VirtIo,
+                                         Req->InDataNumPages,
+                                         &Req->InDataBuffer
+                                         );
     if (EFI_ERROR (Status)) {
-      Status = ReportHostAdapterError (Packet);
-      goto UnmapRequestBuffer;
+      Req->InDataBuffer = NULL;
+      Status            = ReportHostAdapterError (Packet);
+      goto FreeReq;
     }
 
-    ZeroMem (InDataBuffer, Packet->InTransferLength);
+    ZeroMem (Req->InDataBuffer, Packet->InTransferLength);
 
     Status = VirtioMapAllBytesInSharedBuffer (
                Dev->VirtIo,
                VirtioOperationBusMasterCommonBuffer,
-               InDataBuffer,
+               Req->InDataBuffer,
                Packet->InTransferLength,
-               &InDataDeviceAddress,
-               &InDataMapping
+               &Req->InDataDeviceAddress,
+               &Req->InDataMapping
                );
     if (EFI_ERROR (Status)) {
-      Status = ReportHostAdapterError (Packet);
-      goto FreeInDataBuffer;
+      Req->InDataMapping = NULL;
+      Status             = ReportHostAdapterError (Packet);
+      goto ReleaseReq;
     }
   }
 
@@ -539,169 +916,76 @@ VirtioScsiPassThru (
                VirtioOperationBusMasterRead,
                Packet->OutDataBuffer,
                Packet->OutTransferLength,
-               &OutDataDeviceAddress,
-               &OutDataMapping
+               &Req->OutDataDeviceAddress,
+               &Req->OutDataMapping
                );
     if (EFI_ERROR (Status)) {
-      Status = ReportHostAdapterError (Packet);
-      goto UnmapInDataBuffer;
+      Req->OutDataMapping = NULL;
+      Status              = ReportHostAdapterError (Packet);
+      goto ReleaseReq;
     }
-
-    OutDataBufferIsMapped = TRUE;
   }
 
   //
-  // Response header is bi-direction (we preset with host status and expect
-  // the device to update it). Allocate a response buffer which can be mapped
-  // to access equally by both processor and device.
+  // Queue the request behind the ones submitted earlier, and submit it right
+  // away if a slot is available. Blocking callers reap their own requests;
+  // the timer is armed for the first outstanding non-blocking request, and
+  // cancelled by CompleteRequest() when the last one completes.
   //
-  Status = Dev->VirtIo->AllocateSharedPages (
-                          Dev->VirtIo,
-                          EFI_SIZE_TO_PAGES (sizeof *Response),
-                          &ResponseBuffer
-                          );
-  if (EFI_ERROR (Status)) {
-    Status = ReportHostAdapterError (Packet);
-    goto UnmapOutDataBuffer;
-  }
-
-  Response = ResponseBuffer;
-
-  ZeroMem ((VOID *)Response, sizeof (*Response));
-
-  //
-  // preset a host status for ourselves that we do not accept as success
-  //
-  Response->Response = VIRTIO_SCSI_S_FAILURE;
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (Event != NULL) {
+    if (Dev->AsyncPending == 0) {
+      Status = gBS->SetTimer (Dev->ReapTimer, TimerPeriodic, VSCSI_REAP_TIMER_PERIOD);
+      if (EFI_ERROR (Status)) {
+        gBS->RestoreTPL (OldTpl);
+        Status = ReportHostAdapterError (Packet);
+        goto ReleaseReq;
+      }
+    }
 
-  //
-  // Map the response buffer with BusMasterCommonBuffer so that response
-  // buffer can be accessed by both host and device.
-  //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterCommonBuffer,
-             ResponseBuffer,
-             sizeof (*Response),
-             &ResponseDeviceAddress,
-             &ResponseMapping
-             );
-  if (EFI_ERROR (Status)) {
-    Status = ReportHostAdapterError (Packet);
-    goto FreeResponseBuffer;
+    Dev->AsyncPending++;
   }
 
-  VirtioPrepare (&Dev->Ring, &Indices);
+  InsertTailList (&Dev->PendingQueue, &Req->Link);
+  StartPendingRequests (Dev);
+  gBS->RestoreTPL (OldTpl);
 
-  //
-  // ensured by VirtioScsiInit() -- this predicate, in combination with the
-  // lock-step progress, ensures we don't have to track free descriptors.
-  //
-  ASSERT (Dev->Ring.QueueSize >= 4);
-
-  //
-  // enqueue Request
-  //
-  VirtioAppendDesc (
-    &Dev->Ring,
-    RequestDeviceAddress,
-    sizeof Request,
-    VRING_DESC_F_NEXT,
-    &Indices
-    );
-
-  //
-  // enqueue "dataout" if any
-  //
-  if (Packet->OutTransferLength > 0) {
-    VirtioAppendDesc (
-      &Dev->Ring,
-      OutDataDeviceAddress,
-      Packet->OutTransferLength,
-      VRING_DESC_F_NEXT,
-      &Indices
-      );
+  if (Event != NULL) {
+    return EFI_SUCCESS;
   }
 
   //
-  // enqueue Response, to be written by the host
+  // Poll for the response. Keep slowing down until we reach a poll period of
+  // slightly above 1 ms. The poll also completes the non-blocking requests
+  // that the host processes meanwhile.
   //
-  VirtioAppendDesc (
-    &Dev->Ring,
-    ResponseDeviceAddress,
-    sizeof *Response,
-    VRING_DESC_F_WRITE | (Packet->InTransferLength > 0 ? VRING_DESC_F_NEXT : 0),
-    &Indices
-    );
-
-  //
-  // enqueue "datain" if any, to be written by the host
-  //
-  if (Packet->InTransferLength > 0) {
-    VirtioAppendDesc (
-      &Dev->Ring,
-      InDataDeviceAddress,
-      Packet->InTransferLength,
-      VRING_DESC_F_WRITE,
-      &Indices
-      );
-  }
+  PollPeriodUsecs = 1;
+  for ( ; ;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    gBS->RestoreTPL (OldTpl);
 
-  // If kicking the host fails, we must fake a host adapter error.
-  // EFI_NOT_READY would save us the effort, but it would also suggest that the
-  // caller retry.
-  //
-  if (VirtioFlush (
-        Dev->VirtIo,
-        VIRTIO_SCSI_REQUEST_QUEUE,
-        &Dev->Ring,
-        &Indices,
-        NULL
-        ) != EFI_SUCCESS)
-  {
-    Status = ReportHostAdapterError (Packet);
-    goto UnmapResponseBuffer;
-  }
+    if (Req->Done) {
+      break;
+    }
 
-  Status = ParseResponse (Packet, Response);
+    gBS->Stall (PollPeriodUsecs); // calls AcpiTimerLib::MicroSecondDelay
 
-  //
-  // If virtio request was successful and it was a CPU read request then we
-  // have used an intermediate buffer. Copy the data from intermediate buffer
-  // to the final buffer.
-  //
-  if (InDataBuffer != NULL) {
-    CopyMem (Packet->InDataBuffer, InDataBuffer, Packet->InTransferLength);
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
   }
 
-UnmapResponseBuffer:
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, ResponseMapping);
+  return Req->Status;
 
-FreeResponseBuffer:
-  Dev->VirtIo->FreeSharedPages (
-                 Dev->VirtIo,
-                 EFI_SIZE_TO_PAGES (sizeof *Response),
-                 ResponseBuffer
-                 );
-
-UnmapOutDataBuffer:
-  if (OutDataBufferIsMapped) {
-    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, OutDataMapping);
-  }
+ReleaseReq:
+  ReleaseRequest (Dev, Req, FALSE);
 
-UnmapInDataBuffer:
-  if (InDataBuffer != NULL) {
-    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, InDataMapping);
+FreeReq:
+  if (Req != &BlockingReq) {
+    FreePool (Req);
   }
 
-FreeInDataBuffer:
-  if (InDataBuffer != NULL) {
-    Dev->VirtIo->FreeSharedPages (Dev->VirtIo, InDataNumPages, InDataBuffer);
-  }
-
-UnmapRequestBuffer:
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, RequestMapping);
-
   return Status;
 }
 
@@ -932,6 +1216,8 @@ VirtioScsiInit (
   UINT16      MaxChannel; // for validation only
   UINT32      NumQueues;  // for validation only
   UINT16      QueueSize;
+  UINTN       SharedPages;
+  VOID        *SharedBuffer;
 
   //
   // Execute virtio-0.9.5, 2.2.1 Device Initialization Sequence.
@@ -1055,13 +1341,16 @@ VirtioScsiInit (
   }
 
   //
-  // VirtioScsiPassThru() uses at most four descriptors
+  // VirtioScsiPassThru() uses at most four descriptors per request, and each
+  // slot in flight owns four consecutive descriptors.
   //
   if (QueueSize < 4) {
     Status = EFI_UNSUPPORTED;
     goto Failed;
   }
 
+  Dev->SlotCount = (UINT16)MIN (QueueSize / 4, VSCSI_MAX_IN_FLIGHT);
+
   Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Dev->Ring);
   if (EFI_ERROR (Status)) {
     goto Failed;
@@ -1080,18 +1369,51 @@ VirtioScsiInit (
     goto ReleaseQueue;
   }
 
+  //
+  // Allocate the request and response headers of all slots, in a buffer which
+  // can be mapped to access equally by both processor and the device. If
+  // anything fails from here on, we must release it.
+  //
+  SharedPages = EFI_SIZE_TO_PAGES (Dev->SlotCount * sizeof (VSCSI_SHARED_SLOT));
+  Status      = Dev->VirtIo->AllocateSharedPages (
+                               Dev->VirtIo,
+                               SharedPages,
+                               &SharedBuffer
+                               );
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
+  ZeroMem (SharedBuffer, EFI_PAGES_TO_SIZE (SharedPages));
+  Status = VirtioMapAllBytesInSharedBuffer (
+             Dev->VirtIo,
+             VirtioOperationBusMasterCommonBuffer,
+             SharedBuffer,
+             EFI_PAGES_TO_SIZE (SharedPages),
+             &Dev->SharedAddr,
+             &Dev->SharedMap
+             );
+  if (EFI_ERROR (Status)) {
+    goto FreeSharedBuffer;
+  }
+
+  Dev->Shared      = SharedBuffer;
+  Dev->LastUsedIdx = *Dev->Ring.Used.Idx;
+  Dev->InFlight    = 0;
+  ZeroMem (Dev->Slots, sizeof Dev->Slots);
+
   //
   // Additional steps for MMIO: align the queue appropriately, and set the
-  // size. If anything fails from here on, we must unmap the ring resources.
+  // size. If anything fails from here on, we must unmap the shared buffer.
   //
   Status = Dev->VirtIo->SetQueueNum (Dev->VirtIo, QueueSize);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   Status = Dev->VirtIo->SetQueueAlign (Dev->VirtIo, EFI_PAGE_SIZE);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   //
@@ -1103,7 +1425,7 @@ VirtioScsiInit (
                           RingBaseShift
                           );
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   //
@@ -1113,7 +1435,7 @@ VirtioScsiInit (
     Features &= ~(UINT64)(VIRTIO_F_VERSION_1 | VIRTIO_F_IOMMU_PLATFORM);
     Status    = Dev->VirtIo->SetGuestFeatures (Dev->VirtIo, Features);
     if (EFI_ERROR (Status)) {
-      goto UnmapQueue;
+      goto UnmapSharedBuffer;
     }
   }
 
@@ -1123,12 +1445,12 @@ VirtioScsiInit (
   //
   Status = VIRTIO_CFG_WRITE (Dev, CdbSize, VIRTIO_SCSI_CDB_SIZE);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   Status = VIRTIO_CFG_WRITE (Dev, SenseSize, VIRTIO_SCSI_SENSE_SIZE);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   //
@@ -1137,7 +1459,7 @@ VirtioScsiInit (
   NextDevStat |= VSTAT_DRIVER_OK;
   Status       = Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, NextDevStat);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedBuffer;
   }
 
   //
@@ -1163,8 +1485,13 @@ VirtioScsiInit (
   // Driver Writer's Guide for UEFI 2.3.1 v1.01, 20.1.5 Implementing Extended
   // SCSI Pass Thru Protocol.
   //
+  // Non-blocking requests are queued on the request queue, so that
+  // EFI_SCSI_IO_PROTOCOL (and the EFI_BLOCK_IO2_PROTOCOL of the disks on top
+  // of it) can keep several requests in flight.
+  //
   Dev->PassThruMode.Attributes = EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_PHYSICAL |
-                                 EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_LOGICAL;
+                                 EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_LOGICAL |
+                                 EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_NONBLOCKIO;
 
   //
   // no restriction on transfer buffer alignment
@@ -1173,6 +1500,12 @@ VirtioScsiInit (
 
   return EFI_SUCCESS;
 
+UnmapSharedBuffer:
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedMap);
+
+FreeSharedBuffer:
+  Dev->VirtIo->FreeSharedPages (Dev->VirtIo, SharedPages, SharedBuffer);
+
 UnmapQueue:
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
 
@@ -1214,6 +1547,13 @@ VirtioScsiUninit (
   Dev->MaxLun         = 0;
   Dev->MaxSectors     = 0;
 
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedMap);
+  Dev->VirtIo->FreeSharedPages (
+                 Dev->VirtIo,
+                 EFI_SIZE_TO_PAGES (Dev->SlotCount * sizeof (VSCSI_SHARED_SLOT)),
+                 Dev->Shared
+                 );
+
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
   VirtioRingUninit (Dev->VirtIo, &Dev->Ring);
 
@@ -1337,6 +1677,8 @@ VirtioScsiDriverBindingStart (
     goto FreeVirtioScsi;
   }
 
+  InitializeListHead (&Dev->PendingQueue);
+
   //
   // VirtIo access granted, configure virtio-scsi device.
   //
@@ -1356,6 +1698,21 @@ VirtioScsiDriverBindingStart (
     goto UninitDev;
   }
 
+  //
+  // Complete the non-blocking requests that the host processes. The timer is
+  // armed by VirtioScsiPassThru().
+  //
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_NOTIFY,
+                  &VirtioScsiReapTimer,
+                  Dev,
+                  &Dev->ReapTimer
+                  );
+  if (EFI_ERROR (Status)) {
+    goto CloseExitBoot;
+  }
+
   //
   // Setup complete, attempt to export the driver instance's PassThru
   // interface.
@@ -1368,11 +1725,14 @@ VirtioScsiDriverBindingStart (
                           &Dev->PassThru
                           );
   if (EFI_ERROR (Status)) {
-    goto CloseExitBoot;
+    goto CloseReapTimer;
   }
 
   return EFI_SUCCESS;
 
+CloseReapTimer:
+  gBS->CloseEvent (Dev->ReapTimer);
+
 CloseExitBoot:
   gBS->CloseEvent (Dev->ExitBoot);
 
@@ -1432,6 +1792,13 @@ VirtioScsiDriverBindingStop (
     return Status;
   }
 
+  //
+  // No new requests can arrive; let the outstanding non-blocking ones
+  // complete before the ring goes away.
+  //
+  DrainRequests (Dev);
+  gBS->CloseEvent (Dev->ReapTimer);
+
   gBS->CloseEvent (Dev->ExitBoot);
 
   VirtioScsiUninit (Dev);
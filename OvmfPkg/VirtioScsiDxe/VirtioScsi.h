@@ -17,6 +17,7 @@
 #include <Protocol/ScsiPassThruExt.h>
 
 #include <IndustryStandard/Virtio.h>
+#include <IndustryStandard/VirtioScsi.h>
 
 //
 // This driver supports 2-byte target identifiers and 4-byte LUN identifiers.
@@ -34,6 +35,55 @@
 
 #define VSCSI_SIG  SIGNATURE_32 ('V', 'S', 'C', 'S')
 
+//
+// The number of requests that the driver keeps in flight on the request queue
+// at most. Each request occupies a slot of four consecutive descriptors.
+//
+#define VSCSI_MAX_IN_FLIGHT  32
+
+//
+// The period of the timer that reaps completed requests, in 100ns units.
+//
+#define VSCSI_REAP_TIMER_PERIOD  EFI_TIMER_PERIOD_MILLISECONDS (1)
+
+#define VSCSI_REQ_SIG  SIGNATURE_32 ('V', 'S', 'R', 'Q')
+
+//
+// A SCSI request packet, from submission by the caller until completion. The
+// data buffers are mapped when the request is queued. Blocking requests live
+// on the caller's stack, non-blocking ones are allocated from pool and freed
+// when they complete.
+//
+typedef struct {
+  UINT32                                        Signature;
+  LIST_ENTRY                                    Link;   // in VSCSI_DEV.PendingQueue
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET    *Packet;
+  VIRTIO_SCSI_REQ                               Request;
+  VOID                                          *InDataBuffer;
+  UINTN                                         InDataNumPages;
+  VOID                                          *InDataMapping;
+  EFI_PHYSICAL_ADDRESS                          InDataDeviceAddress;
+  VOID                                          *OutDataMapping;
+  EFI_PHYSICAL_ADDRESS                          OutDataDeviceAddress;
+  EFI_EVENT                                     Event;  // NULL for blocking requests
+  volatile BOOLEAN                              Done;   // blocking requests only
+  EFI_STATUS                                    Status; // outcome, see CompleteRequest()
+} VSCSI_REQ;
+
+#define VSCSI_REQ_FROM_LINK(LinkPointer) \
+        CR (LinkPointer, VSCSI_REQ, Link, VSCSI_REQ_SIG)
+
+//
+// The virtio-scsi request and response headers of a slot, in memory that the
+// device and the processor access equally.
+//
+#pragma pack(1)
+typedef struct {
+  VIRTIO_SCSI_REQ     Request;
+  VIRTIO_SCSI_RESP    Response;
+} VSCSI_SHARED_SLOT;
+#pragma pack()
+
 typedef struct {
   //
   // Parts of this structure are initialized / torn down in various functions
@@ -53,6 +103,17 @@ typedef struct {
   EFI_EXT_SCSI_PASS_THRU_PROTOCOL    PassThru;       // VirtioScsiInit      1
   EFI_EXT_SCSI_PASS_THRU_MODE        PassThruMode;   // VirtioScsiInit      1
   VOID                               *RingMap;       // VirtioRingMap       2
+  VSCSI_SHARED_SLOT                  *Shared;        // VirtioScsiInit      1
+  EFI_PHYSICAL_ADDRESS               SharedAddr;     // VirtioScsiInit      1
+  VOID                               *SharedMap;     // VirtioScsiInit      1
+  UINT16                             SlotCount;      // VirtioScsiInit      1
+  UINT16                             LastUsedIdx;    // VirtioScsiInit      1
+  VSCSI_REQ                          *Slots[VSCSI_MAX_IN_FLIGHT];
+                                                     // VirtioScsiInit      1
+  UINT16                             InFlight;       // VirtioScsiInit      1
+  LIST_ENTRY                         PendingQueue;   // DriverBindingStart  0
+  EFI_EVENT                          ReapTimer;      // DriverBindingStart  0
+  UINTN                              AsyncPending;   // DriverBindingStart  0
 } VSCSI_DEV;
 
 #define VIRTIO_SCSI_FROM_PASS_THRU(PassThruPointer) \